@@ -18,21 +18,25 @@
 #include "driver/rmt.h"
 #include <stdio.h>
 #include "esp_log.h"
+#include "ir_codec.h"
+
+#define IR_TX_REPEAT_FOREVER    (0xffff)    /*!< repeat until CIrNecSender::stopRepeat is called */
 
 #ifdef __cplusplus
-typedef enum {
-    IR_PROTO_NEC,     /* IR NEC protocol */
-    IR_PROTO_MAX,
-} ir_proto_t;
 
+/**
+ * Frames queued by sendAsync are sent by a worker task of the sender, so several senders can run
+ * from one caller task. The encoded items of recent frames are cached and padded up to the protocol
+ * period, repeats are sent back to back from the cache.
+ */
 class CIrNecSender
 {
 private:
     rmt_channel_t m_channel;
     gpio_num_t m_io_num;
     ir_proto_t m_proto;
-    bool m_carrier_en;
     rmt_mode_t m_rmt_mode;
+    void* m_tx;
 
     /**
      * prevent copy constructing
@@ -50,7 +54,8 @@ public:
     CIrNecSender(rmt_channel_t channel, gpio_num_t io_num, bool carrier_en = true, ir_proto_t proto = IR_PROTO_NEC);
 
     /*
-     * @brief send NEC data waveform
+     * @brief send data waveform in the protocol of this sender
+     * @note For NEC, addr and cmd are 8 bit values, each is sent followed by its inverse.
      * @param addr address field to send
      * @param cmd command field to send
      * @return
@@ -58,6 +63,53 @@ public:
      */
     esp_err_t send(uint16_t addr, uint16_t cmd);
 
+    /*
+     * @brief send one frame in any protocol, the carrier follows the protocol of the frame
+     * @param frame frame to send, set frame->repeat to send the repeat code of NEC
+     * @return
+     *     - ESP_OK if success
+     *     - ESP_ERR_INVALID_ARG if the protocol is unknown
+     */
+    esp_err_t sendFrame(const ir_frame_t* frame);
+
+    /*
+     * @brief replay a waveform captured by CIrNecRecv::recvRaw
+     * @param raw mark and space durations
+     * @return
+     *     - ESP_OK if success
+     */
+    esp_err_t sendRaw(const ir_raw_t* raw);
+
+    /*
+     * @brief queue a frame and return without waiting for the transmission
+     * @note NEC repeats are sent as repeat codes, other protocols repeat the frame,
+     *       at least the number of frames of one key press of the protocol is sent.
+     * @param frame frame to send
+     * @param repeat number of repeats after the frame, IR_TX_REPEAT_FOREVER to repeat until stopRepeat
+     * @param ticks_to_wait max wait time for room in the queue
+     * @return
+     *     - ESP_OK if success
+     *     - ESP_ERR_INVALID_ARG if the protocol is unknown or frame->repeat is set
+     *     - ESP_ERR_TIMEOUT if the queue is full
+     */
+    esp_err_t sendAsync(const ir_frame_t* frame, uint16_t repeat = 0, TickType_t ticks_to_wait = portMAX_DELAY);
+
+    /*
+     * @brief end the running repeat after the current frame and drop the queued frames, for a released key
+     * @return
+     *     - ESP_OK if success
+     */
+    esp_err_t stopRepeat();
+
+    /*
+     * @brief wait until all queued frames are sent
+     * @param ticks_to_wait max wait time in tick
+     * @return
+     *     - ESP_OK if success
+     *     - ESP_ERR_TIMEOUT if timeout
+     */
+    esp_err_t waitTxDone(TickType_t ticks_to_wait = portMAX_DELAY);
+
     /**
      * @brief Destructor function of CIrNecSender class
      */
@@ -72,6 +124,8 @@ private:
     ir_proto_t m_proto;
     rmt_mode_t m_rmt_mode;
     int m_active_level;
+    ir_frame_t m_last;
+    bool m_last_valid;
 
     /**
      * prevent copy constructing
@@ -83,8 +137,9 @@ public:
      * @brief Constructor for CIrNecRecv class
      * @param channel RMT hardware channel number
      * @param io_num gpio index for RMT
-     * @param ir_proto_t IR protocol
-     * @param carrier_en whether to enable carrier for TX mode
+     * @param active_level level of the receiver output while the carrier is on
+     * @param proto IR protocol, IR_PROTO_AUTO to accept all protocols
+     * @param rx_buf_size size of the RMT RX ringbuffer
      */
     CIrNecRecv(rmt_channel_t channel, gpio_num_t io_num, int active_level = 0, ir_proto_t proto = IR_PROTO_NEC, int rx_buf_size = 1000);
 
@@ -100,6 +155,28 @@ public:
      */
     esp_err_t recv(uint16_t *addr, uint16_t *cmd, TickType_t wait_time);
 
+    /*
+     * @brief Receive one frame
+     * @note A NEC repeat code is returned with frame->repeat set and the fields of the last frame.
+     * @param frame pointer to accept the frame
+     * @param wait_time max wait time in tick
+     * @return
+     *     - ESP_OK if success
+     *     - ESP_ERR_TIMEOUT if timeout
+     *     - ESP_FAIL if the waveform is not a frame of the protocol
+     */
+    esp_err_t recvFrame(ir_frame_t* frame, TickType_t wait_time);
+
+    /*
+     * @brief Capture the waveform without decoding, to learn unknown remotes
+     * @param raw pointer to accept mark and space durations
+     * @param wait_time max wait time in tick
+     * @return
+     *     - ESP_OK if success
+     *     - ESP_ERR_TIMEOUT if timeout
+     */
+    esp_err_t recvRaw(ir_raw_t* raw, TickType_t wait_time);
+
     /**
      * @brief Destructor function of CIrNecRecv class
      */
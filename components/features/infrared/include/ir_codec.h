@@ -0,0 +1,164 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _IOT_IR_CODEC_H_
+#define _IOT_IR_CODEC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "driver/rmt.h"
+
+/*
+ * Table driven IR codec. Every protocol is a timing descriptor, one generic encoder builds
+ * RMT items from a descriptor and one generic decoder parses them back.
+ * All durations in the descriptors are in microseconds, a mark is the carrier on.
+ */
+
+#define IR_RMT_CLK_DIV      (100)                                   /*!< RMT counter clock divider used by the IR devices */
+#define IR_RMT_TICK_10_US   (80000000 / IR_RMT_CLK_DIV / 100000)    /*!< RMT counter value for 10 us (APB clock source) */
+#define IR_ITEM_NUM_MAX     (64)                                    /*!< items of the longest encoded frame */
+#define IR_RAW_NUM_MAX      (256)                                   /*!< durations kept by a raw capture */
+
+typedef enum {
+    IR_PROTO_NEC,           /*!< NEC, 16 bit address and 16 bit command, LSB first */
+    IR_PROTO_SONY_SIRC,     /*!< Sony SIRC 12 bit, 5 bit address and 7 bit command */
+    IR_PROTO_RC5,           /*!< Philips RC5, 5 bit address, 6 bit command and toggle */
+    IR_PROTO_RC6,           /*!< Philips RC6 mode 0, 8 bit address, 8 bit command and toggle */
+    IR_PROTO_MAX,
+    IR_PROTO_AUTO = IR_PROTO_MAX,   /*!< receive only, detect any of the protocols above */
+} ir_proto_t;
+
+typedef enum {
+    IR_CODING_PULSE_DISTANCE,   /*!< the space length carries the bit */
+    IR_CODING_PULSE_WIDTH,      /*!< the mark length carries the bit */
+    IR_CODING_MANCHESTER,       /*!< bi-phase with a fixed half bit unit */
+} ir_coding_t;
+
+typedef struct {
+    const char* name;
+    ir_coding_t coding;
+    uint16_t carrier_hz;
+    uint16_t header_mark;       /*!< 0 if the protocol has no header */
+    uint16_t header_space;
+    uint16_t one_mark;          /*!< pulse coding: mark and space of bit 1 */
+    uint16_t one_space;
+    uint16_t zero_mark;         /*!< pulse coding: mark and space of bit 0 */
+    uint16_t zero_space;
+    uint16_t unit;              /*!< manchester: half bit */
+    bool one_mark_first;        /*!< manchester: bit 1 is mark then space */
+    uint8_t wide_bit;           /*!< manchester: index of the double width bit, 0xff if none */
+    uint16_t trailer_mark;      /*!< stop mark, 0 if none */
+    uint8_t pre_bits;           /*!< constant bits sent before the toggle bit */
+    uint8_t pre_value;
+    bool toggle;                /*!< a toggle bit follows the constant bits */
+    uint8_t addr_bits;
+    uint8_t cmd_bits;
+    bool cmd_first;             /*!< the command field is sent before the address field */
+    bool msb_first;
+    uint16_t repeat_space;      /*!< space after the header mark of a repeat code, 0 if frames are repeated instead */
+    uint32_t frame_period_us;   /*!< start to start interval of repeated frames */
+    uint8_t min_frames;         /*!< number of frames of one key press */
+    uint8_t tolerance;          /*!< accepted duration error, in percent */
+} ir_timing_t;
+
+typedef struct {
+    ir_proto_t proto;
+    uint16_t addr;
+    uint16_t cmd;
+    uint8_t toggle;
+    bool repeat;                /*!< repeat code without data, addr and cmd are not decoded */
+} ir_frame_t;
+
+typedef struct {
+    uint16_t num;                   /*!< number of durations */
+    uint16_t dur[IR_RAW_NUM_MAX];   /*!< durations in us, alternating mark and space, starting with a mark */
+} ir_raw_t;
+
+/**
+ * @brief Get the timing descriptor of a protocol
+ *
+ * @param proto protocol
+ *
+ * @return descriptor, NULL if the protocol is unknown
+ */
+const ir_timing_t* ir_codec_timing(ir_proto_t proto);
+
+/**
+ * @brief Encode a frame into RMT items, the mark is level 1
+ *
+ * @param frame frame to encode, frame->repeat builds the repeat code of the protocol
+ * @param item item buffer
+ * @param item_num size of the buffer
+ *
+ * @return number of items, -1 if the frame does not fit or the protocol is unknown
+ */
+int ir_codec_encode(const ir_frame_t* frame, rmt_item32_t* item, int item_num);
+
+/**
+ * @brief Decode RMT items
+ *
+ * @param proto protocol, IR_PROTO_AUTO to try all of them
+ * @param item received items
+ * @param item_num number of items
+ * @param active_level level of a mark at the receiver output
+ * @param frame decoded frame
+ *
+ * @return ESP_OK if a frame is decoded, ESP_FAIL otherwise
+ */
+esp_err_t ir_codec_decode(ir_proto_t proto, const rmt_item32_t* item, int item_num, int active_level, ir_frame_t* frame);
+
+/**
+ * @brief Capture RMT items as raw durations
+ *
+ * @param item received items
+ * @param item_num number of items
+ * @param active_level level of a mark at the receiver output
+ * @param raw captured durations, leading spaces are dropped and equal levels are merged
+ *
+ * @return ESP_OK if success, ESP_FAIL if there is no mark
+ */
+esp_err_t ir_codec_raw_capture(const rmt_item32_t* item, int item_num, int active_level, ir_raw_t* raw);
+
+/**
+ * @brief Build RMT items to replay raw durations, the mark is level 1
+ *
+ * @param raw durations
+ * @param item item buffer
+ * @param item_num size of the buffer
+ *
+ * @return number of items, -1 if the durations do not fit
+ */
+int ir_codec_raw_replay(const ir_raw_t* raw, rmt_item32_t* item, int item_num);
+
+/**
+ * @brief Stretch the idle time at the end of encoded items, so back to back transmissions start one period apart
+ *
+ * @param item encoded items
+ * @param item_num number of encoded items
+ * @param item_max size of the buffer
+ * @param period_us start to start period
+ *
+ * @return number of items, -1 if the buffer is too small
+ */
+int ir_codec_pad_period(rmt_item32_t* item, int item_num, int item_max, uint32_t period_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
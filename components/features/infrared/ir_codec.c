@@ -0,0 +1,470 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include "ir_codec.h"
+
+#define IR_ITEM_DURATION_MAX    (0x7fff)
+#define IR_US_TO_TICKS(us)      ((uint32_t)(us) * IR_RMT_TICK_10_US / 10)
+#define IR_TICKS_TO_US(ticks)   ((uint32_t)(ticks) * 10 / IR_RMT_TICK_10_US)
+#define IR_MARGIN_MIN_US        (80)
+#define IR_BITS_MAX             (40)
+#define IR_HALVES_MAX           (2 * IR_BITS_MAX + 8)
+#define IR_WIDE_NONE            (0xff)
+
+static const ir_timing_t s_ir_timing[IR_PROTO_MAX] = {
+    [IR_PROTO_NEC] = {
+        .name = "NEC", .coding = IR_CODING_PULSE_DISTANCE, .carrier_hz = 38000,
+        .header_mark = 9000, .header_space = 4500,
+        .one_mark = 560, .one_space = 1690, .zero_mark = 560, .zero_space = 560,
+        .wide_bit = IR_WIDE_NONE, .trailer_mark = 560,
+        .addr_bits = 16, .cmd_bits = 16, .cmd_first = false, .msb_first = false,
+        .repeat_space = 2250, .frame_period_us = 108000, .min_frames = 1, .tolerance = 25,
+    },
+    [IR_PROTO_SONY_SIRC] = {
+        .name = "SIRC", .coding = IR_CODING_PULSE_WIDTH, .carrier_hz = 40000,
+        .header_mark = 2400, .header_space = 600,
+        .one_mark = 1200, .one_space = 600, .zero_mark = 600, .zero_space = 600,
+        .wide_bit = IR_WIDE_NONE,
+        .addr_bits = 5, .cmd_bits = 7, .cmd_first = true, .msb_first = false,
+        .frame_period_us = 45000, .min_frames = 3, .tolerance = 20,
+    },
+    [IR_PROTO_RC5] = {
+        .name = "RC5", .coding = IR_CODING_MANCHESTER, .carrier_hz = 36000,
+        .unit = 889, .one_mark_first = false, .wide_bit = IR_WIDE_NONE,
+        .pre_bits = 2, .pre_value = 0x3, .toggle = true,
+        .addr_bits = 5, .cmd_bits = 6, .cmd_first = false, .msb_first = true,
+        .frame_period_us = 113778, .min_frames = 1, .tolerance = 25,
+    },
+    [IR_PROTO_RC6] = {
+        .name = "RC6", .coding = IR_CODING_MANCHESTER, .carrier_hz = 36000,
+        .header_mark = 2666, .header_space = 889,
+        .unit = 444, .one_mark_first = true, .wide_bit = 4,
+        .pre_bits = 4, .pre_value = 0x8, .toggle = true,
+        .addr_bits = 8, .cmd_bits = 8, .cmd_first = false, .msb_first = true,
+        .frame_period_us = 106667, .min_frames = 1, .tolerance = 25,
+    },
+};
+
+/* the encoder merges equal levels and splits long durations, so every protocol only emits (level, us) pairs */
+typedef struct {
+    rmt_item32_t* item;
+    int item_num;
+    int half;           /* halves written */
+    int level;
+    uint32_t ticks;     /* pending duration of level */
+} ir_writer_t;
+
+typedef struct {
+    const rmt_item32_t* item;
+    int item_num;
+    int half;           /* halves read */
+    int active_level;
+    bool mark;          /* level of the segment returned by ir_read_seg */
+} ir_reader_t;
+
+static bool ir_write_half(ir_writer_t* w, int level, uint32_t ticks)
+{
+    int idx = w->half / 2;
+    if (idx >= w->item_num) {
+        return false;
+    }
+    if (w->half % 2 == 0) {
+        w->item[idx].level0 = level;
+        w->item[idx].duration0 = ticks;
+    } else {
+        w->item[idx].level1 = level;
+        w->item[idx].duration1 = ticks;
+    }
+    w->half++;
+    return true;
+}
+
+static bool ir_write_flush(ir_writer_t* w)
+{
+    while (w->ticks > 0) {
+        uint32_t ticks = w->ticks > IR_ITEM_DURATION_MAX ? IR_ITEM_DURATION_MAX : w->ticks;
+        if (!ir_write_half(w, w->level, ticks)) {
+            return false;
+        }
+        w->ticks -= ticks;
+    }
+    return true;
+}
+
+static bool ir_write_ticks(ir_writer_t* w, bool mark, uint32_t ticks)
+{
+    int level = mark ? 1 : 0;
+    if (ticks == 0) {
+        return true;
+    }
+    if (level != w->level && !ir_write_flush(w)) {
+        return false;
+    }
+    w->level = level;
+    w->ticks += ticks;
+    return true;
+}
+
+static bool ir_write(ir_writer_t* w, bool mark, uint32_t us)
+{
+    return ir_write_ticks(w, mark, IR_US_TO_TICKS(us));
+}
+
+/* an unpaired last half is closed with a zero duration, which ends the transmission */
+static int ir_write_end(ir_writer_t* w)
+{
+    if (!ir_write_flush(w)) {
+        return -1;
+    }
+    if (w->half % 2 == 1 && !ir_write_half(w, !w->item[w->half / 2].level0, 0)) {
+        return -1;
+    }
+    return w->half / 2;
+}
+
+/* next segment of one level, 0 at the end of the items */
+static uint32_t ir_read_seg(ir_reader_t* r)
+{
+    uint32_t ticks = 0;
+    int level = -1;
+    while (r->half < r->item_num * 2) {
+        const rmt_item32_t* item = &r->item[r->half / 2];
+        int l = (r->half % 2 == 0) ? item->level0 : item->level1;
+        uint32_t d = (r->half % 2 == 0) ? item->duration0 : item->duration1;
+        if (d == 0) {
+            r->half = r->item_num * 2;
+            break;
+        }
+        if (level >= 0 && l != level) {
+            break;
+        }
+        level = l;
+        ticks += d;
+        r->half++;
+    }
+    r->mark = (level == r->active_level);
+    return IR_TICKS_TO_US(ticks);
+}
+
+static bool ir_match(uint32_t us, uint32_t target, uint8_t tolerance)
+{
+    uint32_t margin = target * tolerance / 100;
+    if (margin < IR_MARGIN_MIN_US) {
+        margin = IR_MARGIN_MIN_US;
+    }
+    return us + margin >= target && us <= target + margin;
+}
+
+static int ir_bits_num(const ir_timing_t* t)
+{
+    return t->pre_bits + (t->toggle ? 1 : 0) + t->addr_bits + t->cmd_bits;
+}
+
+static void ir_field_put(uint8_t* bits, int* n, uint32_t val, int width, bool msb_first)
+{
+    for (int i = 0; i < width; i++) {
+        int shift = msb_first ? width - 1 - i : i;
+        bits[(*n)++] = (val >> shift) & 0x1;
+    }
+}
+
+static uint32_t ir_field_get(const uint8_t* bits, int* n, int width, bool msb_first)
+{
+    uint32_t val = 0;
+    for (int i = 0; i < width; i++) {
+        int shift = msb_first ? width - 1 - i : i;
+        val |= (uint32_t) bits[(*n)++] << shift;
+    }
+    return val;
+}
+
+static int ir_frame_to_bits(const ir_timing_t* t, const ir_frame_t* frame, uint8_t* bits)
+{
+    int n = 0;
+    ir_field_put(bits, &n, t->pre_value, t->pre_bits, true);
+    if (t->toggle) {
+        bits[n++] = frame->toggle & 0x1;
+    }
+    if (t->cmd_first) {
+        ir_field_put(bits, &n, frame->cmd, t->cmd_bits, t->msb_first);
+        ir_field_put(bits, &n, frame->addr, t->addr_bits, t->msb_first);
+    } else {
+        ir_field_put(bits, &n, frame->addr, t->addr_bits, t->msb_first);
+        ir_field_put(bits, &n, frame->cmd, t->cmd_bits, t->msb_first);
+    }
+    return n;
+}
+
+static bool ir_bits_to_frame(const ir_timing_t* t, const uint8_t* bits, ir_frame_t* frame)
+{
+    int n = 0;
+    if (ir_field_get(bits, &n, t->pre_bits, true) != t->pre_value) {
+        return false;
+    }
+    frame->toggle = t->toggle ? bits[n++] : 0;
+    if (t->cmd_first) {
+        frame->cmd = ir_field_get(bits, &n, t->cmd_bits, t->msb_first);
+        frame->addr = ir_field_get(bits, &n, t->addr_bits, t->msb_first);
+    } else {
+        frame->addr = ir_field_get(bits, &n, t->addr_bits, t->msb_first);
+        frame->cmd = ir_field_get(bits, &n, t->cmd_bits, t->msb_first);
+    }
+    frame->repeat = false;
+    return true;
+}
+
+const ir_timing_t* ir_codec_timing(ir_proto_t proto)
+{
+    if ((int) proto < 0 || proto >= IR_PROTO_MAX) {
+        return NULL;
+    }
+    return &s_ir_timing[proto];
+}
+
+int ir_codec_encode(const ir_frame_t* frame, rmt_item32_t* item, int item_num)
+{
+    const ir_timing_t* t = ir_codec_timing(frame->proto);
+    if (t == NULL || item == NULL) {
+        return -1;
+    }
+    ir_writer_t w = { .item = item, .item_num = item_num, .half = 0, .level = 0, .ticks = 0 };
+    bool ok = true;
+    memset(item, 0, item_num * sizeof(rmt_item32_t));
+    if (frame->repeat && t->repeat_space) {
+        ok &= ir_write(&w, true, t->header_mark);
+        ok &= ir_write(&w, false, t->repeat_space);
+        ok &= ir_write(&w, true, t->trailer_mark);
+        return ok ? ir_write_end(&w) : -1;
+    }
+
+    uint8_t bits[IR_BITS_MAX];
+    int bit_num = ir_frame_to_bits(t, frame, bits);
+    ok &= ir_write(&w, true, t->header_mark);
+    ok &= ir_write(&w, false, t->header_space);
+    for (int i = 0; i < bit_num && ok; i++) {
+        if (t->coding == IR_CODING_MANCHESTER) {
+            uint32_t half = (i == t->wide_bit) ? 2 * t->unit : t->unit;
+            bool first = bits[i] ? t->one_mark_first : !t->one_mark_first;
+            ok &= ir_write(&w, first, half);
+            ok &= ir_write(&w, !first, half);
+        } else {
+            ok &= ir_write(&w, true, bits[i] ? t->one_mark : t->zero_mark);
+            ok &= ir_write(&w, false, bits[i] ? t->one_space : t->zero_space);
+        }
+    }
+    ok &= ir_write(&w, true, t->trailer_mark);
+    return ok ? ir_write_end(&w) : -1;
+}
+
+static bool ir_decode_pulse(const ir_timing_t* t, ir_reader_t* r, uint8_t* bits, int bit_num)
+{
+    for (int i = 0; i < bit_num; i++) {
+        uint32_t mark = ir_read_seg(r);
+        if (!r->mark) {
+            return false;
+        }
+        uint32_t space = ir_read_seg(r);
+        bool last = (i == bit_num - 1) && t->trailer_mark == 0;
+        if (t->coding == IR_CODING_PULSE_DISTANCE) {
+            if (!ir_match(mark, t->one_mark, t->tolerance)) {
+                return false;
+            } else if (ir_match(space, t->one_space, t->tolerance)) {
+                bits[i] = 1;
+            } else if (ir_match(space, t->zero_space, t->tolerance)) {
+                bits[i] = 0;
+            } else {
+                return false;
+            }
+        } else {
+            if (ir_match(mark, t->one_mark, t->tolerance)) {
+                bits[i] = 1;
+            } else if (ir_match(mark, t->zero_mark, t->tolerance)) {
+                bits[i] = 0;
+            } else {
+                return false;
+            }
+            // the space of the last bit runs into the idle time
+            if (!last && !ir_match(space, t->one_space, t->tolerance)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool ir_decode_manchester(const ir_timing_t* t, ir_reader_t* r, uint8_t* bits, int bit_num)
+{
+    uint8_t halves[IR_HALVES_MAX];
+    int half_num = 0;
+    int need = 2 * bit_num + (t->wide_bit != IR_WIDE_NONE ? 2 : 0);
+    /* a frame starting with a space half shows up as a mark, the space is the idle level */
+    bool first_mark = ((t->pre_value >> (t->pre_bits - 1)) & 0x1) ? t->one_mark_first : !t->one_mark_first;
+    if (!first_mark) {
+        halves[half_num++] = 0;
+    }
+    while (half_num < need) {
+        uint32_t us = ir_read_seg(r);
+        if (us == 0) {
+            break;
+        }
+        uint32_t n = (us + t->unit / 2) / t->unit;
+        if (n == 0 || n > 4) {
+            if (r->mark) {
+                return false;
+            }
+            n = need - half_num;    // the last space is the idle time
+        } else if (!ir_match(us, n * t->unit, t->tolerance)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < n && half_num < need; i++) {
+            halves[half_num++] = r->mark ? 1 : 0;
+        }
+    }
+    while (half_num < need) {
+        halves[half_num++] = 0;
+    }
+    int k = 0;
+    for (int i = 0; i < bit_num; i++) {
+        int w = (i == t->wide_bit) ? 2 : 1;
+        uint8_t h0 = halves[k], h1 = halves[k + w];
+        for (int j = 1; j < w; j++) {
+            if (halves[k + j] != h0 || halves[k + w + j] != h1) {
+                return false;
+            }
+        }
+        if (h0 == h1) {
+            return false;
+        }
+        bits[i] = (h0 == 1) == t->one_mark_first ? 1 : 0;
+        k += 2 * w;
+    }
+    return true;
+}
+
+static esp_err_t ir_decode_proto(ir_proto_t proto, const rmt_item32_t* item, int item_num, int active_level, ir_frame_t* frame)
+{
+    const ir_timing_t* t = &s_ir_timing[proto];
+    ir_reader_t r = { .item = item, .item_num = item_num, .half = 0, .active_level = active_level, .mark = false };
+    uint8_t bits[IR_BITS_MAX];
+    int bit_num = ir_bits_num(t);
+
+    int start = 0;
+    uint32_t us = ir_read_seg(&r);
+    if (us > 0 && !r.mark) {
+        start = r.half;         // leading idle level
+        us = ir_read_seg(&r);
+    }
+    if (us == 0 || !r.mark) {
+        return ESP_FAIL;
+    }
+    if (t->header_mark) {
+        if (!ir_match(us, t->header_mark, t->tolerance)) {
+            return ESP_FAIL;
+        }
+        us = ir_read_seg(&r);
+        if (t->repeat_space && ir_match(us, t->repeat_space, t->tolerance)) {
+            if (!ir_match(ir_read_seg(&r), t->trailer_mark, t->tolerance) || !r.mark) {
+                return ESP_FAIL;
+            }
+            memset(frame, 0, sizeof(ir_frame_t));
+            frame->proto = proto;
+            frame->repeat = true;
+            return ESP_OK;
+        }
+        if (r.mark || !ir_match(us, t->header_space, t->tolerance)) {
+            return ESP_FAIL;
+        }
+    } else {
+        r.half = start;     // no header, read the first mark again as data
+    }
+
+    bool ok;
+    if (t->coding == IR_CODING_MANCHESTER) {
+        ok = ir_decode_manchester(t, &r, bits, bit_num);
+    } else {
+        ok = ir_decode_pulse(t, &r, bits, bit_num);
+        if (ok && t->trailer_mark) {
+            ok = ir_match(ir_read_seg(&r), t->trailer_mark, t->tolerance) && r.mark;
+        }
+    }
+    if (!ok || !ir_bits_to_frame(t, bits, frame)) {
+        return ESP_FAIL;
+    }
+    frame->proto = proto;
+    return ESP_OK;
+}
+
+esp_err_t ir_codec_decode(ir_proto_t proto, const rmt_item32_t* item, int item_num, int active_level, ir_frame_t* frame)
+{
+    if (item == NULL || frame == NULL || item_num <= 0) {
+        return ESP_FAIL;
+    }
+    if (proto != IR_PROTO_AUTO) {
+        return ir_codec_timing(proto) ? ir_decode_proto(proto, item, item_num, active_level, frame) : ESP_FAIL;
+    }
+    for (int p = 0; p < IR_PROTO_MAX; p++) {
+        if (ir_decode_proto((ir_proto_t) p, item, item_num, active_level, frame) == ESP_OK) {
+            return ESP_OK;
+        }
+    }
+    return ESP_FAIL;
+}
+
+esp_err_t ir_codec_raw_capture(const rmt_item32_t* item, int item_num, int active_level, ir_raw_t* raw)
+{
+    ir_reader_t r = { .item = item, .item_num = item_num, .half = 0, .active_level = active_level, .mark = false };
+    raw->num = 0;
+    uint32_t us;
+    while ((us = ir_read_seg(&r)) > 0 && raw->num < IR_RAW_NUM_MAX) {
+        if (raw->num == 0 && !r.mark) {
+            continue;
+        }
+        raw->dur[raw->num++] = us > UINT16_MAX ? UINT16_MAX : us;
+    }
+    return raw->num > 0 ? ESP_OK : ESP_FAIL;
+}
+
+int ir_codec_raw_replay(const ir_raw_t* raw, rmt_item32_t* item, int item_num)
+{
+    ir_writer_t w = { .item = item, .item_num = item_num, .half = 0, .level = 0, .ticks = 0 };
+    memset(item, 0, item_num * sizeof(rmt_item32_t));
+    for (int i = 0; i < raw->num; i++) {
+        if (!ir_write(&w, i % 2 == 0, raw->dur[i])) {
+            return -1;
+        }
+    }
+    return ir_write_end(&w);
+}
+
+int ir_codec_pad_period(rmt_item32_t* item, int item_num, int item_max, uint32_t period_us)
+{
+    if (item_num <= 0) {
+        return -1;
+    }
+    uint32_t ticks = 0;
+    for (int i = 0; i < item_num; i++) {
+        ticks += item[i].duration0 + item[i].duration1;
+    }
+    uint32_t period = IR_US_TO_TICKS(period_us);
+    if (ticks >= period) {
+        return item_num;
+    }
+    /* the gap replaces the end marker, a new end marker follows it */
+    bool end = item[item_num - 1].duration1 == 0;
+    ir_writer_t w = { .item = item, .item_num = item_max, .half = 2 * item_num - (end ? 1 : 0), .level = 0, .ticks = 0 };
+    if (!ir_write_ticks(&w, false, period - ticks)) {
+        return -1;
+    }
+    return ir_write_end(&w);
+}
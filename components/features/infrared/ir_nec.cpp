@@ -21,25 +21,24 @@ extern "C" {
 #include "esp_log.h"
 #include "esp_err.h"
 #include "driver/rmt.h"
+#include "soc/soc.h"
 #include "iot_ir.h"
 #include "freertos/ringbuf.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
 
 
-#define NEC_HEADER_HIGH_US    9000                         /*!< NEC protocol header: positive 9ms */
-#define NEC_HEADER_LOW_US     4500                         /*!< NEC protocol header: negative 4.5ms*/
-#define NEC_BIT_ONE_HIGH_US    560                         /*!< NEC protocol data bit 1: positive 0.56ms */
-#define NEC_BIT_ONE_LOW_US    (2250-NEC_BIT_ONE_HIGH_US)   /*!< NEC protocol data bit 1: negative 1.69ms */
-#define NEC_BIT_ZERO_HIGH_US   560                         /*!< NEC protocol data bit 0: positive 0.56ms */
-#define NEC_BIT_ZERO_LOW_US   (1120-NEC_BIT_ZERO_HIGH_US)  /*!< NEC protocol data bit 0: negative 0.56ms */
-#define NEC_BIT_END            560                         /*!< NEC protocol end: positive 0.56ms */
-#define NEC_BIT_MARGIN         20                          /*!< NEC parse margin time */
-
-#define NEC_DATA_ITEM_NUM   34  /*!< NEC code item number: header + 32bit data + end */
-#define RMT_TX_DATA_NUM  1    /*!< NEC tx test data number */
-#define RMT_CLK_DIV      100    /*!< RMT counter clock divider */
-#define RMT_TICK_10_US    (80000000/RMT_CLK_DIV/100000)   /*!< RMT counter value for 10 us.(Source clock is APB clock) */
-#define NEC_ITEM_DURATION(d)  ((d & 0x7fff)*10/RMT_TICK_10_US)  /*!< Parse duration time from memory register value */
 #define RMT_NEC_TIMEOUT_US  9500   /*!< RMT receiver timeout value(us) */
+#define IR_CARRIER_DEFAULT_HZ  38000  /*!< carrier used when the protocol has no descriptor */
+#define IR_TX_QUEUE_LEN     (8)
+#define IR_TX_CACHE_NUM     (4)
+#define IR_TX_ITEM_NUM      (IR_ITEM_NUM_MAX + 4)   /*!< room for the gap up to the next frame */
+#define IR_TX_TASK_STACK    (2048)
+#define IR_TX_TASK_PRIO     (5)
+#define IR_TX_IDLE_BIT      (1 << 0)
 
 static const char* IR_NEC_TAG = "ir_nec";
 
@@ -49,261 +48,403 @@ static const char* IR_NEC_TAG = "ir_nec";
         return (ret_val); \
     }
 
-/*
- * @brief Build register value of waveform for NEC one data bit
- */
-static inline void nec_fill_item_level(rmt_item32_t* item, int high_us, int low_us)
+static esp_err_t ir_items_send(rmt_channel_t channel, const rmt_item32_t* item, int item_num)
 {
-    item->level0 = 1;
-    item->duration0 = (high_us) / 10 * RMT_TICK_10_US;
-    item->level1 = 0;
-    item->duration1 = (low_us) / 10 * RMT_TICK_10_US;
+    IR_NEC_CHECK(item_num > 0, "IR frame encode error", ESP_FAIL);
+    rmt_write_items(channel, item, item_num, true);
+    //Wait until sending is done.
+    rmt_wait_tx_done(channel, portMAX_DELAY);
+    return ESP_OK;
 }
 
-/*
- * @brief Generate NEC header value: active 9ms + negative 4.5ms
- */
-static void nec_fill_item_header(rmt_item32_t* item)
+static esp_err_t ir_frame_send(rmt_channel_t channel, const ir_frame_t* frame)
 {
-    nec_fill_item_level(item, NEC_HEADER_HIGH_US, NEC_HEADER_LOW_US);
+    size_t size = (sizeof(rmt_item32_t) * IR_ITEM_NUM_MAX);
+    rmt_item32_t* item = (rmt_item32_t*) malloc(size);
+    IR_NEC_CHECK(item != NULL, "IR item malloc error", ESP_ERR_NO_MEM);
+    //To build a series of waveforms.
+    int item_num = ir_codec_encode(frame, item, IR_ITEM_NUM_MAX);
+    esp_err_t ret = ir_items_send(channel, item, item_num);
+    //before we free the data, make sure sending is already done.
+    free(item);
+    return ret;
 }
 
 /*
- * @brief Generate NEC data bit 1: positive 0.56ms + negative 1.69ms
+ * @brief Take one received frame from the ringbuffer and hand the items to the parser
  */
-static void nec_fill_item_bit_one(rmt_item32_t* item)
+static esp_err_t ir_items_recv(rmt_channel_t channel, TickType_t wait_time,
+        esp_err_t (*parse)(const rmt_item32_t* item, int item_num, void* arg), void* arg)
 {
-    nec_fill_item_level(item, NEC_BIT_ONE_HIGH_US, NEC_BIT_ONE_LOW_US);
+    RingbufHandle_t rb = NULL;
+    //get RMT RX ringbuffer
+    rmt_get_ringbuf_handle(channel, &rb);
+    IR_NEC_CHECK(rb != NULL, "IR NEC dev ringbuffer error", ESP_FAIL);
+    size_t rx_size = 0;
+    //try to receive data from ringbuffer.
+    //RMT driver will push all the data it receives to its ringbuffer.
+    //We just need to parse the value and return the spaces of ringbuffer.
+    rmt_item32_t* item = (rmt_item32_t*) xRingbufferReceive(rb, &rx_size, wait_time);
+    IR_NEC_CHECK(item != NULL, "IR NEC dev ringbuffer data error", ESP_ERR_TIMEOUT);
+    esp_err_t ret = parse(item, rx_size / sizeof(rmt_item32_t), arg);
+    //after parsing the data, return spaces to ringbuffer.
+    vRingbufferReturnItem(rb, (void*) item);
+    return ret;
 }
 
-/*
- * @brief Generate NEC data bit 0: positive 0.56ms + negative 0.56ms
- */
-static void nec_fill_item_bit_zero(rmt_item32_t* item)
+typedef struct {
+    ir_proto_t proto;
+    int active_level;
+    ir_frame_t* frame;
+} ir_decode_arg_t;
+
+static esp_err_t ir_decode_cb(const rmt_item32_t* item, int item_num, void* arg)
 {
-    nec_fill_item_level(item, NEC_BIT_ZERO_HIGH_US, NEC_BIT_ZERO_LOW_US);
+    ir_decode_arg_t* dec = (ir_decode_arg_t*) arg;
+    return ir_codec_decode(dec->proto, item, item_num, dec->active_level, dec->frame);
 }
 
-/*
- * @brief Generate NEC end signal: positive 0.56ms
- */
-static void nec_fill_item_end(rmt_item32_t* item)
+typedef struct {
+    int active_level;
+    ir_raw_t* raw;
+} ir_capture_arg_t;
+
+static esp_err_t ir_capture_cb(const rmt_item32_t* item, int item_num, void* arg)
 {
-    nec_fill_item_level(item, NEC_BIT_END, 0x7fff);
+    ir_capture_arg_t* cap = (ir_capture_arg_t*) arg;
+    return ir_codec_raw_capture(item, item_num, cap->active_level, cap->raw);
 }
 
-/*
- * @brief Check whether duration is around target_us
- */
-inline bool nec_check_in_range(int duration_ticks, int target_us, int margin_us)
-{
-    if(( NEC_ITEM_DURATION(duration_ticks) < (target_us + margin_us))
-        && ( NEC_ITEM_DURATION(duration_ticks) > (target_us - margin_us))) {
-        return true;
-    } else {
-        return false;
-    }
+#ifdef __cplusplus
 }
+#endif
+
+typedef struct {
+    ir_frame_t frame;
+    uint16_t repeat;
+    uint32_t gen;           /* requests queued before the last stopRepeat are dropped */
+    bool exit;
+} ir_tx_req_t;
+
+/* encoded items of one frame, each padded up to the frame period */
+typedef struct {
+    bool valid;
+    ir_proto_t proto;
+    uint16_t addr;
+    uint16_t cmd;
+    uint8_t toggle;
+    uint32_t used;
+    int frame_num;
+    int repeat_num;         /* 0 if the protocol repeats the whole frame */
+    rmt_item32_t frame_item[IR_TX_ITEM_NUM];
+    rmt_item32_t repeat_item[IR_TX_ITEM_NUM];
+} ir_tx_cache_t;
+
+typedef struct {
+    rmt_channel_t channel;
+    bool carrier_en;
+    ir_proto_t carrier_proto;
+    SemaphoreHandle_t lock;         /* owner of the RMT channel */
+    SemaphoreHandle_t state_mux;    /* guards pending, gen, the idle bit and the worker start */
+    QueueHandle_t queue;
+    EventGroupHandle_t evt;
+    SemaphoreHandle_t exit;
+    TaskHandle_t task;
+    uint32_t pending;
+    volatile uint32_t gen;
+    uint32_t stamp;
+    ir_tx_cache_t cache[IR_TX_CACHE_NUM];
+} ir_tx_t;
 
 /*
- * @brief Check whether this value represents an NEC header
+ * @brief Carrier setting for the protocol, in APB clock cycles
  */
-static bool nec_header_if(rmt_item32_t* item, int active_level)
+static void ir_carrier_set(rmt_channel_t channel, bool carrier_en, ir_proto_t proto)
 {
-    if((item->level0 == active_level && item->level1 != active_level)
-        && nec_check_in_range(item->duration0, NEC_HEADER_HIGH_US, NEC_BIT_MARGIN)
-        && nec_check_in_range(item->duration1, NEC_HEADER_LOW_US, NEC_BIT_MARGIN)) {
-        return true;
-    }
-    return false;
+    const ir_timing_t* timing = ir_codec_timing(proto);
+    uint16_t half = APB_CLK_FREQ / (timing ? timing->carrier_hz : IR_CARRIER_DEFAULT_HZ) / 2;
+    rmt_set_tx_carrier(channel, carrier_en, half, half, RMT_CARRIER_LEVEL_HIGH);
 }
 
-/*
- * @brief Check whether this value represents an NEC data bit 1
- */
-static bool nec_bit_one_if(rmt_item32_t* item, int active_level)
+/* call with tx->lock held */
+static void ir_tx_carrier(ir_tx_t* tx, ir_proto_t proto)
 {
-    if((item->level0 == active_level && item->level1 != active_level)
-        && nec_check_in_range(item->duration0, NEC_BIT_ONE_HIGH_US, NEC_BIT_MARGIN)
-        && nec_check_in_range(item->duration1, NEC_BIT_ONE_LOW_US, NEC_BIT_MARGIN)) {
-        return true;
+    if (proto != tx->carrier_proto) {
+        ir_carrier_set(tx->channel, tx->carrier_en, proto);
+        tx->carrier_proto = proto;
     }
-    return false;
 }
 
-/*
- * @brief Check whether this value represents an NEC data bit 0
- */
-static bool nec_bit_zero_if(rmt_item32_t* item, int active_level)
+static ir_tx_cache_t* ir_tx_cache_get(ir_tx_t* tx, const ir_frame_t* frame)
 {
-    if((item->level0 == active_level && item->level1 != active_level)
-        && nec_check_in_range(item->duration0, NEC_BIT_ZERO_HIGH_US, NEC_BIT_MARGIN)
-        && nec_check_in_range(item->duration1, NEC_BIT_ZERO_LOW_US, NEC_BIT_MARGIN)) {
-        return true;
+    ir_tx_cache_t* entry = &tx->cache[0];
+    for (int i = 0; i < IR_TX_CACHE_NUM; i++) {
+        ir_tx_cache_t* c = &tx->cache[i];
+        if (c->valid && c->proto == frame->proto && c->addr == frame->addr
+                && c->cmd == frame->cmd && c->toggle == frame->toggle) {
+            c->used = ++tx->stamp;
+            return c;
+        }
+        // replace a free entry, or the least recently used one
+        if (entry->valid && (!c->valid || c->used < entry->used)) {
+            entry = c;
+        }
+    }
+    const ir_timing_t* timing = ir_codec_timing(frame->proto);
+    entry->valid = false;
+    entry->frame_num = ir_codec_encode(frame, entry->frame_item, IR_ITEM_NUM_MAX);
+    entry->frame_num = ir_codec_pad_period(entry->frame_item, entry->frame_num, IR_TX_ITEM_NUM, timing->frame_period_us);
+    entry->repeat_num = 0;
+    if (timing->repeat_space) {
+        ir_frame_t rep = *frame;
+        rep.repeat = true;
+        entry->repeat_num = ir_codec_encode(&rep, entry->repeat_item, IR_ITEM_NUM_MAX);
+        entry->repeat_num = ir_codec_pad_period(entry->repeat_item, entry->repeat_num, IR_TX_ITEM_NUM, timing->frame_period_us);
     }
-    return false;
+    IR_NEC_CHECK(entry->frame_num > 0 && entry->repeat_num >= 0, "IR frame encode error", NULL);
+    entry->proto = frame->proto;
+    entry->addr = frame->addr;
+    entry->cmd = frame->cmd;
+    entry->toggle = frame->toggle;
+    entry->used = ++tx->stamp;
+    entry->valid = true;
+    return entry;
 }
 
-
 /*
- * @brief Parse NEC 32 bit waveform to address and command.
+ * The items carry the idle time up to the next frame, so sending them back to back
+ * keeps the protocol period without any timer.
  */
-static int nec_parse_items(rmt_item32_t* item, int item_num, uint16_t* addr, uint16_t* data, int active_level)
+static void ir_tx_run(ir_tx_t* tx, const ir_tx_req_t* req)
 {
-    int w_len = item_num;
-    if(w_len < NEC_DATA_ITEM_NUM) {
-        return -1;
+    const ir_timing_t* timing = ir_codec_timing(req->frame.proto);
+    if (req->gen != tx->gen) {
+        return;
     }
-    int i = 0, j = 0;
-    if(!nec_header_if(item++, active_level)) {
-        return -1;
+    ir_tx_cache_t* entry = ir_tx_cache_get(tx, &req->frame);
+    if (entry == NULL) {
+        return;
     }
-    uint16_t addr_t = 0;
-    for(j = 0; j < 16; j++) {
-        if(nec_bit_one_if(item, active_level)) {
-            addr_t |= (1 << j);
-        } else if(nec_bit_zero_if(item, active_level)) {
-            addr_t |= (0 << j);
-        } else {
-            return -1;
-        }
-        item++;
-        i++;
+    bool forever = req->repeat == IR_TX_REPEAT_FOREVER;
+    uint32_t repeat = req->repeat;
+    if (repeat + 1 < timing->min_frames) {
+        repeat = timing->min_frames - 1;
     }
-    uint16_t data_t = 0;
-    for(j = 0; j < 16; j++) {
-        if(nec_bit_one_if(item, active_level)) {
-            data_t |= (1 << j);
-        } else if(nec_bit_zero_if(item, active_level)) {
-            data_t |= (0 << j);
-        } else {
-            return -1;
+    const rmt_item32_t* item = entry->frame_item;
+    int item_num = entry->frame_num;
+    for (uint32_t i = 0; i <= repeat || forever; i++) {
+        if (req->gen != tx->gen) {
+            break;
+        }
+        xSemaphoreTake(tx->lock, portMAX_DELAY);
+        ir_tx_carrier(tx, req->frame.proto);
+        ir_items_send(tx->channel, item, item_num);
+        xSemaphoreGive(tx->lock);
+        if (entry->repeat_num > 0) {
+            item = entry->repeat_item;
+            item_num = entry->repeat_num;
         }
-        item++;
-        i++;
     }
-    *addr = addr_t;
-    *data = data_t;
-    return i;
 }
 
-/*
- * @brief Build NEC 32bit waveform.
- */
-static int nec_build_items(int channel, rmt_item32_t* item, int item_num, uint16_t addr, uint16_t cmd_data)
+static void ir_tx_task(void* arg)
 {
-    int i = 0, j = 0;
-    if(item_num < NEC_DATA_ITEM_NUM) {
-        return -1;
-    }
-    nec_fill_item_header(item++);
-    i++;
-    for(j = 0; j < 16; j++) {
-        if(addr & 0x1) {
-            nec_fill_item_bit_one(item);
-        } else {
-            nec_fill_item_bit_zero(item);
+    ir_tx_t* tx = (ir_tx_t*) arg;
+    ir_tx_req_t req;
+    while (xQueueReceive(tx->queue, &req, portMAX_DELAY) == pdTRUE) {
+        if (req.exit) {
+            break;
         }
-        item++;
-        i++;
-        addr >>= 1;
-    }
-    for(j = 0; j < 16; j++) {
-        if(cmd_data & 0x1) {
-            nec_fill_item_bit_one(item);
-        } else {
-            nec_fill_item_bit_zero(item);
+        ir_tx_run(tx, &req);
+        xSemaphoreTake(tx->state_mux, portMAX_DELAY);
+        if (--tx->pending == 0) {
+            xEventGroupSetBits(tx->evt, IR_TX_IDLE_BIT);
         }
-        item++;
-        i++;
-        cmd_data >>= 1;
+        xSemaphoreGive(tx->state_mux);
     }
-    nec_fill_item_end(item);
-    i++;
-    return i;
-}
-
-static esp_err_t ir_nec_send(rmt_channel_t channel, uint16_t addr, uint16_t cmd)
-{
-	size_t size = (sizeof(rmt_item32_t) * NEC_DATA_ITEM_NUM);
-	rmt_item32_t* item = (rmt_item32_t*) malloc(size);
-    int item_num = NEC_DATA_ITEM_NUM;
-    memset((void*) item, 0, size);
-
-	//To build a series of waveforms.
-	nec_build_items(channel, item, item_num, ((~addr) << 8) | addr,((~cmd) << 8) | cmd);
-
-    rmt_write_items(channel, item, item_num, true);
-    //Wait until sending is done.
-    rmt_wait_tx_done(channel, portMAX_DELAY);
-    //before we free the data, make sure sending is already done.
-    free(item);
-    return ESP_OK;
+    xSemaphoreGive(tx->exit);
+    vTaskDelete(NULL);
 }
 
-static esp_err_t ir_nec_recv(rmt_channel_t channel, uint16_t* addr, uint16_t* cmd, int active_level, TickType_t wait_time)
+static void ir_tx_free(ir_tx_t* tx)
 {
-    esp_err_t ret = ESP_FAIL;
-    RingbufHandle_t rb = NULL;
-    //get RMT RX ringbuffer
-    rmt_get_ringbuf_handle(channel, &rb);
-    IR_NEC_CHECK(rb != NULL, "IR NEC dev ringbuffer error", ESP_FAIL);
-    size_t rx_size = 0;
-    //try to receive data from ringbuffer.
-    //RMT driver will push all the data it receives to its ringbuffer.
-    //We just need to parse the value and return the spaces of ringbuffer.
-    rmt_item32_t* item = (rmt_item32_t*) xRingbufferReceive(rb, &rx_size, wait_time);
-    IR_NEC_CHECK(item != NULL, "IR NEC dev ringbuffer data error", ESP_FAIL);
-    //parse data value from ringbuffer.
-    int res = nec_parse_items(item, rx_size / 4, addr, cmd, active_level);
-    if(res > 0) {
-        ret = ESP_OK;
-    } else {
-        ret = ESP_FAIL;
+    if (tx == NULL) {
+        return;
     }
-    //after parsing the data, return spaces to ringbuffer.
-    vRingbufferReturnItem(rb, (void*) item);
-    return ret;
-}
-
-#ifdef __cplusplus
+    if (tx->lock) {
+        vSemaphoreDelete(tx->lock);
+    }
+    if (tx->state_mux) {
+        vSemaphoreDelete(tx->state_mux);
+    }
+    if (tx->queue) {
+        vQueueDelete(tx->queue);
+    }
+    if (tx->evt) {
+        vEventGroupDelete(tx->evt);
+    }
+    if (tx->exit) {
+        vSemaphoreDelete(tx->exit);
+    }
+    free(tx);
 }
-#endif
 
 CIrNecSender::CIrNecSender(rmt_channel_t channel, gpio_num_t io_num, bool carrier_en, ir_proto_t proto)
 {
     m_channel = channel;
     m_io_num = io_num;
     m_proto = proto;
-    m_carrier_en = carrier_en;
     m_rmt_mode = RMT_MODE_TX;
+    m_tx = NULL;
 
+    const ir_timing_t* timing = ir_codec_timing(proto);
     rmt_config_t rmt;
     rmt.channel = m_channel;
     rmt.gpio_num = m_io_num;
     rmt.mem_block_num = 1;
-    rmt.clk_div = RMT_CLK_DIV;
+    rmt.clk_div = IR_RMT_CLK_DIV;
     int rx_buf_size = 0;
     rmt.rmt_mode = m_rmt_mode;
     rmt.tx_config.loop_en = false;
     rmt.tx_config.carrier_duty_percent = 50;
-    rmt.tx_config.carrier_freq_hz = 38000;
+    rmt.tx_config.carrier_freq_hz = timing ? timing->carrier_hz : IR_CARRIER_DEFAULT_HZ;
     rmt.tx_config.carrier_level = RMT_CARRIER_LEVEL_HIGH;
-    rmt.tx_config.carrier_en = m_carrier_en;
+    rmt.tx_config.carrier_en = carrier_en;
     rmt.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
     rmt.tx_config.idle_output_en = true;
     rmt_config(&rmt);
     rmt_driver_install(rmt.channel, rx_buf_size, 0);
+
+    ir_tx_t* tx = (ir_tx_t*) calloc(1, sizeof(ir_tx_t));
+    if (tx == NULL) {
+        ESP_LOGE(IR_NEC_TAG, "no memory for IR sender");
+        return;
+    }
+    tx->channel = channel;
+    tx->carrier_en = carrier_en;
+    tx->carrier_proto = proto;
+    tx->lock = xSemaphoreCreateMutex();
+    tx->state_mux = xSemaphoreCreateMutex();
+    tx->queue = xQueueCreate(IR_TX_QUEUE_LEN, sizeof(ir_tx_req_t));
+    tx->evt = xEventGroupCreate();
+    tx->exit = xSemaphoreCreateBinary();
+    if (tx->lock == NULL || tx->state_mux == NULL || tx->queue == NULL || tx->evt == NULL || tx->exit == NULL) {
+        ESP_LOGE(IR_NEC_TAG, "no memory for IR sender");
+        ir_tx_free(tx);
+        return;
+    }
+    xEventGroupSetBits(tx->evt, IR_TX_IDLE_BIT);
+    m_tx = tx;
 }
 
 esp_err_t CIrNecSender::send(uint16_t addr, uint16_t cmd)
 {
     IR_NEC_CHECK(m_rmt_mode == RMT_MODE_TX, "IR NEC dev not in TX mode", ESP_FAIL);
-    return ir_nec_send(m_channel, addr, cmd);
+    ir_frame_t frame;
+    memset(&frame, 0, sizeof(ir_frame_t));
+    frame.proto = m_proto;
+    frame.addr = addr;
+    frame.cmd = cmd;
+    if (m_proto == IR_PROTO_NEC) {
+        // 8 bit address and command, each followed by its inverse
+        frame.addr = ((~addr) << 8) | addr;
+        frame.cmd = ((~cmd) << 8) | cmd;
+    }
+    return sendFrame(&frame);
+}
+
+esp_err_t CIrNecSender::sendFrame(const ir_frame_t* frame)
+{
+    ir_tx_t* tx = (ir_tx_t*) m_tx;
+    IR_NEC_CHECK(tx != NULL, "IR NEC sender not created", ESP_FAIL);
+    IR_NEC_CHECK(frame != NULL && ir_codec_timing(frame->proto) != NULL, "IR frame error", ESP_ERR_INVALID_ARG);
+    xSemaphoreTake(tx->lock, portMAX_DELAY);
+    ir_tx_carrier(tx, frame->proto);
+    esp_err_t ret = ir_frame_send(m_channel, frame);
+    xSemaphoreGive(tx->lock);
+    return ret;
+}
+
+esp_err_t CIrNecSender::sendRaw(const ir_raw_t* raw)
+{
+    ir_tx_t* tx = (ir_tx_t*) m_tx;
+    IR_NEC_CHECK(tx != NULL, "IR NEC sender not created", ESP_FAIL);
+    IR_NEC_CHECK(raw != NULL, "IR raw data is NULL", ESP_ERR_INVALID_ARG);
+    int max = raw->num / 2 + 2 * IR_ITEM_NUM_MAX;
+    rmt_item32_t* item = (rmt_item32_t*) malloc(sizeof(rmt_item32_t) * max);
+    IR_NEC_CHECK(item != NULL, "IR item malloc error", ESP_ERR_NO_MEM);
+    xSemaphoreTake(tx->lock, portMAX_DELAY);
+    esp_err_t ret = ir_items_send(m_channel, item, ir_codec_raw_replay(raw, item, max));
+    xSemaphoreGive(tx->lock);
+    free(item);
+    return ret;
+}
+
+esp_err_t CIrNecSender::sendAsync(const ir_frame_t* frame, uint16_t repeat, TickType_t ticks_to_wait)
+{
+    ir_tx_t* tx = (ir_tx_t*) m_tx;
+    IR_NEC_CHECK(tx != NULL, "IR NEC sender not created", ESP_FAIL);
+    IR_NEC_CHECK(frame != NULL && ir_codec_timing(frame->proto) != NULL && !frame->repeat, "IR frame error", ESP_ERR_INVALID_ARG);
+    ir_tx_req_t req;
+    memset(&req, 0, sizeof(ir_tx_req_t));
+    req.frame = *frame;
+    req.repeat = repeat;
+    xSemaphoreTake(tx->state_mux, portMAX_DELAY);
+    if (tx->task == NULL) {
+        // the worker is only started by the first queued frame, under state_mux so two callers start one task
+        xTaskCreate(ir_tx_task, "ir_tx", IR_TX_TASK_STACK, tx, IR_TX_TASK_PRIO, &tx->task);
+        if (tx->task == NULL) {
+            xSemaphoreGive(tx->state_mux);
+            ESP_LOGE(IR_NEC_TAG, "IR TX task create error");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    req.gen = tx->gen;
+    tx->pending++;
+    xEventGroupClearBits(tx->evt, IR_TX_IDLE_BIT);
+    xSemaphoreGive(tx->state_mux);
+    if (xQueueSend(tx->queue, &req, ticks_to_wait) != pdTRUE) {
+        xSemaphoreTake(tx->state_mux, portMAX_DELAY);
+        if (--tx->pending == 0) {
+            xEventGroupSetBits(tx->evt, IR_TX_IDLE_BIT);
+        }
+        xSemaphoreGive(tx->state_mux);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+esp_err_t CIrNecSender::stopRepeat()
+{
+    ir_tx_t* tx = (ir_tx_t*) m_tx;
+    IR_NEC_CHECK(tx != NULL, "IR NEC sender not created", ESP_FAIL);
+    xSemaphoreTake(tx->state_mux, portMAX_DELAY);
+    tx->gen++;
+    xSemaphoreGive(tx->state_mux);
+    return ESP_OK;
+}
+
+esp_err_t CIrNecSender::waitTxDone(TickType_t ticks_to_wait)
+{
+    ir_tx_t* tx = (ir_tx_t*) m_tx;
+    IR_NEC_CHECK(tx != NULL, "IR NEC sender not created", ESP_FAIL);
+    EventBits_t bits = xEventGroupWaitBits(tx->evt, IR_TX_IDLE_BIT, pdFALSE, pdTRUE, ticks_to_wait);
+    return (bits & IR_TX_IDLE_BIT) ? ESP_OK : ESP_ERR_TIMEOUT;
 }
 
 CIrNecSender::~CIrNecSender()
 {
+    ir_tx_t* tx = (ir_tx_t*) m_tx;
+    if (tx != NULL && tx->task != NULL) {
+        ir_tx_req_t req;
+        memset(&req, 0, sizeof(ir_tx_req_t));
+        req.exit = true;
+        stopRepeat();
+        xQueueSendToFront(tx->queue, &req, portMAX_DELAY);
+        xSemaphoreTake(tx->exit, portMAX_DELAY);
+    }
+    ir_tx_free(tx);
+    m_tx = NULL;
     rmt_driver_uninstall(m_channel);
 }
 
@@ -314,16 +455,18 @@ CIrNecRecv::CIrNecRecv(rmt_channel_t channel, gpio_num_t io_num, int active_leve
     m_proto = proto;
     m_rmt_mode = RMT_MODE_RX;
     m_active_level = active_level;
+    memset(&m_last, 0, sizeof(ir_frame_t));
+    m_last_valid = false;
 
     rmt_config_t rmt;
     rmt.channel = m_channel;
     rmt.gpio_num = m_io_num;
     rmt.mem_block_num = 1;
-    rmt.clk_div = RMT_CLK_DIV;
+    rmt.clk_div = IR_RMT_CLK_DIV;
     rmt.rmt_mode = m_rmt_mode;
     rmt.rx_config.filter_en = true;
     rmt.rx_config.filter_ticks_thresh = 100;
-    rmt.rx_config.idle_threshold = RMT_NEC_TIMEOUT_US / 10 * (RMT_TICK_10_US);
+    rmt.rx_config.idle_threshold = RMT_NEC_TIMEOUT_US / 10 * (IR_RMT_TICK_10_US);
     rmt_rx_start(channel, 1);
     rmt_config(&rmt);
     rmt_driver_install(rmt.channel, rx_buf_size, 0);
@@ -331,14 +474,46 @@ CIrNecRecv::CIrNecRecv(rmt_channel_t channel, gpio_num_t io_num, int active_leve
 
 esp_err_t CIrNecRecv::recv(uint16_t *addr, uint16_t *cmd, TickType_t wait_time)
 {
-    IR_NEC_CHECK(m_rmt_mode == RMT_MODE_RX, "IR NEC dev not in TX mode", ESP_FAIL);
-    return ir_nec_recv(m_channel, addr, cmd, m_active_level, wait_time);
+    ir_frame_t frame;
+    esp_err_t ret = recvFrame(&frame, wait_time);
+    if (ret == ESP_OK) {
+        *addr = frame.addr;
+        *cmd = frame.cmd;
+    }
+    return ret;
 }
 
-CIrNecRecv::~CIrNecRecv()
+esp_err_t CIrNecRecv::recvFrame(ir_frame_t* frame, TickType_t wait_time)
 {
-    rmt_driver_uninstall(m_channel);
+    IR_NEC_CHECK(m_rmt_mode == RMT_MODE_RX, "IR NEC dev not in RX mode", ESP_FAIL);
+    IR_NEC_CHECK(frame != NULL, "IR frame is NULL", ESP_ERR_INVALID_ARG);
+    ir_decode_arg_t dec = { m_proto, m_active_level, frame };
+    esp_err_t ret = ir_items_recv(m_channel, wait_time, ir_decode_cb, &dec);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (frame->repeat) {
+        // a repeat code only counts after a frame of the same protocol
+        IR_NEC_CHECK(m_last_valid && m_last.proto == frame->proto, "IR repeat code without frame", ESP_FAIL);
+        frame->addr = m_last.addr;
+        frame->cmd = m_last.cmd;
+        frame->toggle = m_last.toggle;
+    } else {
+        m_last = *frame;
+        m_last_valid = true;
+    }
+    return ESP_OK;
 }
 
+esp_err_t CIrNecRecv::recvRaw(ir_raw_t* raw, TickType_t wait_time)
+{
+    IR_NEC_CHECK(m_rmt_mode == RMT_MODE_RX, "IR NEC dev not in RX mode", ESP_FAIL);
+    IR_NEC_CHECK(raw != NULL, "IR raw data is NULL", ESP_ERR_INVALID_ARG);
+    ir_capture_arg_t cap = { m_active_level, raw };
+    return ir_items_recv(m_channel, wait_time, ir_capture_cb, &cap);
+}
 
-
+CIrNecRecv::~CIrNecRecv()
+{
+    rmt_driver_uninstall(m_channel);
+}
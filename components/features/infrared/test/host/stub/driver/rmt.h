@@ -0,0 +1,17 @@
+#pragma once
+
+/* rmt_item32_t of driver/rmt.h in ESP-IDF v3.2, the part the IR codec uses */
+
+#include <stdint.h>
+
+typedef struct {
+    union {
+        struct {
+            uint32_t duration0 :15;
+            uint32_t level0 :1;
+            uint32_t duration1 :15;
+            uint32_t level1 :1;
+        };
+        uint32_t val;
+    };
+} rmt_item32_t;
@@ -0,0 +1,194 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include <string.h>
+#include "ir_codec.h"
+#include "unity.h"
+
+/*
+ * Turn transmitted items into what a receiver would hand over: inverted output levels,
+ * marks stretched and spaces shortened by the demodulator, and the end marker replaced by the idle time.
+ */
+static void ir_test_channel(rmt_item32_t* item, int item_num, int active_level, int skew_pct)
+{
+    for (int i = 0; i < item_num; i++) {
+        uint32_t d0 = item[i].duration0, d1 = item[i].duration1;
+        d0 = item[i].level0 ? d0 * (100 + skew_pct) / 100 : d0 * (100 - skew_pct) / 100;
+        d1 = item[i].level1 ? d1 * (100 + skew_pct) / 100 : d1 * (100 - skew_pct) / 100;
+        item[i].duration0 = d0 ? d0 : 1;
+        item[i].duration1 = (i == item_num - 1 && d1 == 0) ? 0 : (d1 ? d1 : 1);
+        item[i].level0 = item[i].level0 ? active_level : !active_level;
+        item[i].level1 = item[i].level1 ? active_level : !active_level;
+    }
+}
+
+TEST_CASE("IR codec round trip test", "[rmt_nec][iot]")
+{
+    const ir_frame_t frames[] = {
+        {IR_PROTO_NEC, 0xfe01, 0xf708, 0, false},
+        {IR_PROTO_NEC, 0x1234, 0xabcd, 0, false},
+        {IR_PROTO_SONY_SIRC, 0x01, 0x15, 0, false},
+        {IR_PROTO_SONY_SIRC, 0x1f, 0x7f, 0, false},
+        {IR_PROTO_SONY_SIRC, 0x00, 0x00, 0, false},
+        {IR_PROTO_RC5, 0x00, 0x0c, 1, false},
+        {IR_PROTO_RC5, 0x1f, 0x3f, 0, false},
+        {IR_PROTO_RC5, 0x05, 0x00, 1, false},
+        {IR_PROTO_RC6, 0x00, 0x0c, 0, false},
+        {IR_PROTO_RC6, 0xff, 0x81, 1, false},
+        {IR_PROTO_RC6, 0x5a, 0x00, 1, false},
+    };
+    const int levels[] = {1, 0};
+    const int skews[] = {0, 10, -10};
+    rmt_item32_t item[IR_ITEM_NUM_MAX];
+    ir_frame_t out;
+
+    for (int f = 0; f < sizeof(frames) / sizeof(frames[0]); f++) {
+        for (int l = 0; l < 2; l++) {
+            for (int s = 0; s < 3; s++) {
+                int num = ir_codec_encode(&frames[f], item, IR_ITEM_NUM_MAX);
+                TEST_ASSERT_TRUE(num > 0);
+                ir_test_channel(item, num, levels[l], skews[s]);
+                memset(&out, 0xff, sizeof(out));
+                TEST_ASSERT_EQUAL(ESP_OK, ir_codec_decode(frames[f].proto, item, num, levels[l], &out));
+                TEST_ASSERT_EQUAL(frames[f].proto, out.proto);
+                TEST_ASSERT_EQUAL(frames[f].addr, out.addr);
+                TEST_ASSERT_EQUAL(frames[f].cmd, out.cmd);
+                TEST_ASSERT_EQUAL(frames[f].toggle, out.toggle);
+                TEST_ASSERT_FALSE(out.repeat);
+                /* the protocol is found without being told */
+                memset(&out, 0xff, sizeof(out));
+                TEST_ASSERT_EQUAL(ESP_OK, ir_codec_decode(IR_PROTO_AUTO, item, num, levels[l], &out));
+                TEST_ASSERT_EQUAL(frames[f].proto, out.proto);
+                TEST_ASSERT_EQUAL(frames[f].addr, out.addr);
+                TEST_ASSERT_EQUAL(frames[f].cmd, out.cmd);
+            }
+        }
+    }
+    /* a frame does not decode as another protocol */
+    int num = ir_codec_encode(&frames[0], item, IR_ITEM_NUM_MAX);
+    TEST_ASSERT_EQUAL(34, num);
+    for (int p = IR_PROTO_SONY_SIRC; p < IR_PROTO_MAX; p++) {
+        TEST_ASSERT_EQUAL(ESP_FAIL, ir_codec_decode((ir_proto_t) p, item, num, 1, &out));
+    }
+    /* the buffer is too small */
+    TEST_ASSERT_EQUAL(-1, ir_codec_encode(&frames[0], item, 20));
+}
+
+TEST_CASE("IR codec repeat code test", "[rmt_nec][iot]")
+{
+    rmt_item32_t item[IR_ITEM_NUM_MAX];
+    ir_frame_t frame = {IR_PROTO_NEC, 0, 0, 0, true};
+    ir_frame_t out;
+    int num = ir_codec_encode(&frame, item, IR_ITEM_NUM_MAX);
+    TEST_ASSERT_EQUAL(2, num);
+    ir_test_channel(item, num, 0, 5);
+    TEST_ASSERT_EQUAL(ESP_OK, ir_codec_decode(IR_PROTO_AUTO, item, num, 0, &out));
+    TEST_ASSERT_EQUAL(IR_PROTO_NEC, out.proto);
+    TEST_ASSERT_TRUE(out.repeat);
+
+    /* protocols without a repeat code send the whole frame again */
+    frame.proto = IR_PROTO_SONY_SIRC;
+    frame.cmd = 0x12;
+    num = ir_codec_encode(&frame, item, IR_ITEM_NUM_MAX);
+    TEST_ASSERT_EQUAL(ESP_OK, ir_codec_decode(IR_PROTO_SONY_SIRC, item, num, 1, &out));
+    TEST_ASSERT_FALSE(out.repeat);
+    TEST_ASSERT_EQUAL(0x12, out.cmd);
+    TEST_ASSERT_EQUAL(3, ir_codec_timing(IR_PROTO_SONY_SIRC)->min_frames);
+    TEST_ASSERT_NULL(ir_codec_timing(IR_PROTO_AUTO));
+}
+
+TEST_CASE("IR codec raw capture test", "[rmt_nec][iot]")
+{
+    static ir_raw_t raw, raw2;
+    rmt_item32_t item[IR_ITEM_NUM_MAX];
+    ir_frame_t frame = {IR_PROTO_RC5, 0x0a, 0x21, 1, false};
+    ir_frame_t out;
+    int num = ir_codec_encode(&frame, item, IR_ITEM_NUM_MAX);
+    ir_test_channel(item, num, 0, 0);
+
+    /* learn the frame, replay it, and decode the replayed items */
+    TEST_ASSERT_EQUAL(ESP_OK, ir_codec_raw_capture(item, num, 0, &raw));
+    TEST_ASSERT_TRUE(raw.num > 10);
+    TEST_ASSERT_INT_WITHIN(2, 889, raw.dur[0]);
+    num = ir_codec_raw_replay(&raw, item, IR_ITEM_NUM_MAX);
+    TEST_ASSERT_TRUE(num > 0);
+    TEST_ASSERT_EQUAL(ESP_OK, ir_codec_decode(IR_PROTO_AUTO, item, num, 1, &out));
+    TEST_ASSERT_EQUAL(IR_PROTO_RC5, out.proto);
+    TEST_ASSERT_EQUAL(0x0a, out.addr);
+    TEST_ASSERT_EQUAL(0x21, out.cmd);
+
+    /* long durations are split over several items and merged back */
+    raw.num = 3;
+    raw.dur[0] = 60000;
+    raw.dur[1] = 500;
+    raw.dur[2] = 700;
+    num = ir_codec_raw_replay(&raw, item, IR_ITEM_NUM_MAX);
+    TEST_ASSERT_EQUAL(2, num);
+    TEST_ASSERT_EQUAL(ESP_OK, ir_codec_raw_capture(item, num, 1, &raw2));
+    TEST_ASSERT_EQUAL(3, raw2.num);
+    TEST_ASSERT_EQUAL(60000, raw2.dur[0]);
+    TEST_ASSERT_EQUAL(500, raw2.dur[1]);
+    TEST_ASSERT_EQUAL(700, raw2.dur[2]);
+}
+
+static uint32_t ir_test_us(const rmt_item32_t* item, int item_num)
+{
+    uint32_t ticks = 0;
+    for (int i = 0; i < item_num; i++) {
+        ticks += item[i].duration0 + item[i].duration1;
+    }
+    return ticks * 10 / IR_RMT_TICK_10_US;
+}
+
+TEST_CASE("IR codec period padding test", "[rmt_nec][iot]")
+{
+    rmt_item32_t item[IR_ITEM_NUM_MAX + 4];
+    ir_frame_t frame = {IR_PROTO_NEC, 0x00ff, 0xef10, 0, false};
+    ir_frame_t out;
+    const ir_timing_t* timing = ir_codec_timing(IR_PROTO_NEC);
+
+    /* the gap takes the place of the end marker behind the stop mark */
+    int num = ir_codec_encode(&frame, item, IR_ITEM_NUM_MAX);
+    TEST_ASSERT_EQUAL(0, item[num - 1].duration1);
+    num = ir_codec_pad_period(item, num, IR_ITEM_NUM_MAX + 4, timing->frame_period_us);
+    TEST_ASSERT_EQUAL(34, num);
+    TEST_ASSERT_INT_WITHIN(20, timing->frame_period_us, ir_test_us(item, num));
+    TEST_ASSERT_EQUAL(ESP_OK, ir_codec_decode(IR_PROTO_NEC, item, num, 1, &out));
+    TEST_ASSERT_EQUAL(0xef10, out.cmd);
+
+    /* a repeat code needs more padding than fits in one item */
+    frame.repeat = true;
+    num = ir_codec_encode(&frame, item, IR_ITEM_NUM_MAX);
+    num = ir_codec_pad_period(item, num, IR_ITEM_NUM_MAX + 4, timing->frame_period_us);
+    TEST_ASSERT_TRUE(num > 2);
+    TEST_ASSERT_INT_WITHIN(20, timing->frame_period_us, ir_test_us(item, num));
+    TEST_ASSERT_EQUAL(ESP_OK, ir_codec_decode(IR_PROTO_NEC, item, num, 1, &out));
+    TEST_ASSERT_TRUE(out.repeat);
+
+    /* RC5 may end on a space half, which is kept */
+    frame.proto = IR_PROTO_RC5;
+    frame.repeat = false;
+    frame.addr = 0x01;
+    frame.cmd = 0x3e;
+    timing = ir_codec_timing(IR_PROTO_RC5);
+    num = ir_codec_encode(&frame, item, IR_ITEM_NUM_MAX);
+    num = ir_codec_pad_period(item, num, IR_ITEM_NUM_MAX + 4, timing->frame_period_us);
+    TEST_ASSERT_INT_WITHIN(20, timing->frame_period_us, ir_test_us(item, num));
+    TEST_ASSERT_EQUAL(ESP_OK, ir_codec_decode(IR_PROTO_RC5, item, num, 1, &out));
+    TEST_ASSERT_EQUAL(0x3e, out.cmd);
+
+    /* too small a buffer */
+    num = ir_codec_encode(&frame, item, IR_ITEM_NUM_MAX);
+    TEST_ASSERT_EQUAL(-1, ir_codec_pad_period(item, num, num, timing->frame_period_us));
+}
@@ -42,3 +42,76 @@ TEST_CASE("IR nec test", "[rmt_nec][iot]")
     rx_test.recv(&addr, &cmd, 1000/ portTICK_RATE_MS);
     printf("RMT RCV --- addr: 0x%04x cmd: 0x%04x\n", addr, cmd);
 }
+
+TEST_CASE("IR protocol loopback test", "[rmt_nec][iot]")
+{
+    CIrNecSender tx_test(RMT_CHANNEL_0, GPIO_NUM_18, false);
+    CIrNecRecv rx_test(RMT_CHANNEL_1, GPIO_NUM_19, 1, IR_PROTO_AUTO);
+    const ir_frame_t frames[] = {
+        {IR_PROTO_NEC, 0xfe01, 0xf708, 0, false},
+        {IR_PROTO_NEC, 0, 0, 0, true},
+        {IR_PROTO_SONY_SIRC, 0x01, 0x15, 0, false},
+        {IR_PROTO_RC5, 0x05, 0x0c, 1, false},
+        {IR_PROTO_RC6, 0x00, 0x0c, 0, false},
+    };
+    ir_frame_t frame;
+    for (int i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, tx_test.sendFrame(&frames[i]));
+        TEST_ASSERT_EQUAL(ESP_OK, rx_test.recvFrame(&frame, 1000 / portTICK_RATE_MS));
+        printf("RMT RCV --- %s addr: 0x%04x cmd: 0x%04x repeat: %d\n", ir_codec_timing(frame.proto)->name,
+                frame.addr, frame.cmd, frame.repeat);
+        TEST_ASSERT_EQUAL(frames[i].proto, frame.proto);
+        TEST_ASSERT_EQUAL(frames[i].repeat, frame.repeat);
+        // the repeat code carries the fields of the frame before it
+        TEST_ASSERT_EQUAL(frames[i].repeat ? frames[i - 1].cmd : frames[i].cmd, frame.cmd);
+    }
+
+    // learn a frame and send it back
+    static ir_raw_t raw;
+    TEST_ASSERT_EQUAL(ESP_OK, tx_test.sendFrame(&frames[3]));
+    TEST_ASSERT_EQUAL(ESP_OK, rx_test.recvRaw(&raw, 1000 / portTICK_RATE_MS));
+    TEST_ASSERT_EQUAL(ESP_OK, tx_test.sendRaw(&raw));
+    TEST_ASSERT_EQUAL(ESP_OK, rx_test.recvFrame(&frame, 1000 / portTICK_RATE_MS));
+    TEST_ASSERT_EQUAL(IR_PROTO_RC5, frame.proto);
+    TEST_ASSERT_EQUAL(0x0c, frame.cmd);
+}
+
+TEST_CASE("IR queued send test", "[rmt_nec][iot]")
+{
+    CIrNecSender tx_test(RMT_CHANNEL_0, GPIO_NUM_18, false);
+    CIrNecRecv rx_test(RMT_CHANNEL_1, GPIO_NUM_19, 1, IR_PROTO_AUTO);
+    const ir_frame_t nec = {IR_PROTO_NEC, 0xfe01, 0xf708, 0, false};
+    const ir_frame_t sirc = {IR_PROTO_SONY_SIRC, 0x01, 0x15, 0, false};
+    ir_frame_t frame;
+
+    // one frame and two repeat codes, the caller is not blocked
+    TEST_ASSERT_EQUAL(ESP_OK, tx_test.sendAsync(&nec, 2));
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, tx_test.waitTxDone(0));
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, rx_test.recvFrame(&frame, 1000 / portTICK_RATE_MS));
+        TEST_ASSERT_EQUAL(i > 0, frame.repeat);
+        TEST_ASSERT_EQUAL(0xf708, frame.cmd);
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, tx_test.waitTxDone(1000 / portTICK_RATE_MS));
+
+    // SIRC sends at least three frames of a key press
+    TEST_ASSERT_EQUAL(ESP_OK, tx_test.sendAsync(&sirc));
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, rx_test.recvFrame(&frame, 1000 / portTICK_RATE_MS));
+        TEST_ASSERT_EQUAL(IR_PROTO_SONY_SIRC, frame.proto);
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, tx_test.waitTxDone(1000 / portTICK_RATE_MS));
+
+    // a held key repeats until it is released
+    TEST_ASSERT_EQUAL(ESP_OK, tx_test.sendAsync(&nec, IR_TX_REPEAT_FOREVER));
+    vTaskDelay(500 / portTICK_RATE_MS);
+    TEST_ASSERT_EQUAL(ESP_OK, tx_test.stopRepeat());
+    TEST_ASSERT_EQUAL(ESP_OK, tx_test.waitTxDone(1000 / portTICK_RATE_MS));
+    int num = 0;
+    while (rx_test.recvFrame(&frame, 200 / portTICK_RATE_MS) == ESP_OK) {
+        num++;
+    }
+    printf("frames of the held key: %d\n", num);
+    // 108 ms from frame to frame
+    TEST_ASSERT_INT_WITHIN(2, 5, num);
+}
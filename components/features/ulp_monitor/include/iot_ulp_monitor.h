@@ -19,6 +19,8 @@ extern "C" {
 #endif
 
 #include "driver/adc.h"
+#include "driver/gpio.h"
+#include "ulp_builder.h"
 
 /**
   * @brief  initialize deep sleep ulp monitor
@@ -74,6 +76,45 @@ esp_err_t iot_ulp_add_temprature_monitor(int16_t low_threshold, int16_t high_thr
   */
 esp_err_t iot_ulp_monitor_start(uint32_t meas_per_hour);
 
+/**
+  * @brief  set the bitbang I2C bus of a program builder, the pins are set up as RTC IOs
+  *
+  * @param  b program builder
+  * @param  scl_io SCL pin, it must be an RTC IO
+  * @param  sda_io SDA pin, it must be an RTC IO
+  *
+  * @return
+  *     - ESP_OK: succeed
+  *     - others: fail
+  */
+esp_err_t iot_ulp_builder_set_i2c(ulp_builder_t* b, gpio_num_t scl_io, gpio_num_t sda_io);
+
+/**
+  * @brief  build the monitors of a program builder, clear the ring and start running the ulp program
+  *
+  * @note   it does not mix with iot_ulp_monitor_init(), both run from the same program buffer
+  *
+  * @param  b program builder
+  * @param  meas_per_hour the number of ulp program runs per hour
+  *
+  * @return
+  *     - ESP_OK: succeed
+  *     - others: fail
+  */
+esp_err_t iot_ulp_program_start(const ulp_builder_t* b, uint32_t meas_per_hour);
+
+/**
+  * @brief  take the records the ulp program logged since the last read, it can be called while the program runs
+  *
+  * @param  data_addr the RTC slow memory address of the ring
+  * @param  rec buffer of records
+  * @param  max size of the buffer
+  * @param  lost set to the number of records overwritten before they were read, can be NULL
+  *
+  * @return number of records, -1 if the ring is not initialized
+  */
+int iot_ulp_ring_read(uint16_t data_addr, ulp_record_t* rec, int max, uint16_t* lost);
+
 /**
   * @brief  read value from RTC slow memory
   *
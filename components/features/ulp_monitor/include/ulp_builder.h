@@ -0,0 +1,174 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _IOT_ULP_BUILDER_H_
+#define _IOT_ULP_BUILDER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp32/ulp.h"
+
+/*
+ * ULP program builder. Monitors are composed into one program, the ULP runs it once per wake up period
+ * and every monitor samples once every `period` runs. Results go to a ring of records in RTC slow memory:
+ *
+ *     data_addr + 0                      header, ULP_RING_HDR_WORDS words
+ *     data_addr + ULP_RING_HDR_WORDS     capacity records of two words, (tick << 4 | monitor id) and value
+ *
+ * The ULP owns the write counter, the CPU owns the read counter, so the ring is read without stopping the ULP.
+ * The capacity is a power of two, the slot of a record is its count modulo the capacity, so a single store of
+ * the write counter publishes a record and the reader never pairs a slot with a stale count.
+ */
+
+#define ULP_MON_NUM_MAX         (8)
+#define ULP_RING_MAGIC          (0x5552)
+#define ULP_RING_REC_WORDS      (2)
+
+/* word offsets in the ring header */
+#define ULP_RING_MAGIC_OFS      (0)
+#define ULP_RING_WRITTEN_OFS    (1)     /*!< records written, wraps at 16 bit, ULP owned */
+#define ULP_RING_READ_OFS       (2)     /*!< records read, wraps at 16 bit, CPU owned */
+#define ULP_RING_CAP_OFS        (3)
+#define ULP_RING_TICK_OFS       (4)     /*!< program runs, 12 bit */
+#define ULP_RING_WAKE_OFS       (5)     /*!< set by a threshold hit */
+#define ULP_RING_RET_OFS        (6)     /*!< return address of the I2C subroutines */
+#define ULP_RING_CNT_OFS        (7)     /*!< period countdown of each monitor */
+#define ULP_RING_HDR_WORDS      (ULP_RING_CNT_OFS + ULP_MON_NUM_MAX)
+
+typedef enum {
+    ULP_MON_ADC,            /*!< ADC1 channel */
+    ULP_MON_TSENS,          /*!< temperature sensor */
+    ULP_MON_I2C,            /*!< 16 bit big endian register of an I2C device, over the bitbang bus */
+} ulp_mon_type_t;
+
+typedef struct {
+    ulp_mon_type_t type;
+    uint16_t period;            /*!< sample once every period program runs */
+    uint16_t low_threshold;     /*!< wake up the chip if a value is lower, 0 to disable */
+    uint16_t high_threshold;    /*!< wake up the chip if a value is higher, 0xffff to disable */
+    uint8_t adc_channel;        /*!< ULP_MON_ADC: ADC1 channel */
+    uint8_t i2c_addr;           /*!< ULP_MON_I2C: 7 bit device address */
+    uint8_t i2c_reg;            /*!< ULP_MON_I2C: register to read */
+} ulp_mon_t;
+
+typedef struct {
+    uint16_t program_addr;      /*!< word address of the program in RTC slow memory */
+    uint16_t data_addr;         /*!< word address of the ring header */
+    uint16_t capacity;          /*!< records in the ring */
+    uint16_t wake_count;        /*!< wake up the chip when this many records are unread, 0 to disable */
+    int8_t i2c_scl;             /*!< RTC IO numbers of the bitbang bus, -1 if not set */
+    int8_t i2c_sda;
+    uint8_t mon_num;
+    ulp_mon_t mon[ULP_MON_NUM_MAX];
+} ulp_builder_t;
+
+typedef struct {
+    uint8_t id;                 /*!< monitor id returned by ulp_builder_add */
+    uint16_t tick;              /*!< program run of the sample, 12 bit */
+    uint16_t value;
+} ulp_record_t;
+
+/**
+ * @brief Init a program builder
+ *
+ * @param b builder
+ * @param program_addr word address of the program
+ * @param data_addr word address of the ring, after the program
+ * @param capacity records in the ring, a power of two up to 0x8000
+ * @param wake_count unread records that wake up the chip, 0 to disable
+ *
+ * @return
+ *     - ESP_OK if success
+ *     - ESP_ERR_INVALID_ARG if a parameter is invalid
+ */
+esp_err_t ulp_builder_init(ulp_builder_t* b, uint16_t program_addr, uint16_t data_addr, uint16_t capacity, uint16_t wake_count);
+
+/**
+ * @brief Set the RTC IOs of the bitbang I2C bus, shared by all I2C monitors
+ *
+ * @note Both lines need a pull up, the program only drives them low.
+ *
+ * @param b builder
+ * @param scl_rtc_io RTC IO number of SCL
+ * @param sda_rtc_io RTC IO number of SDA
+ *
+ * @return
+ *     - ESP_OK if success
+ *     - ESP_ERR_INVALID_ARG if a parameter is invalid
+ */
+esp_err_t ulp_builder_set_i2c(ulp_builder_t* b, int scl_rtc_io, int sda_rtc_io);
+
+/**
+ * @brief Add a monitor
+ *
+ * @param b builder
+ * @param mon monitor
+ *
+ * @return monitor id, -1 if the monitor is invalid or there are too many monitors
+ */
+int ulp_builder_add(ulp_builder_t* b, const ulp_mon_t* mon);
+
+/**
+ * @brief Generate the program, it has no macros and is loaded as it is
+ *
+ * @param b builder
+ * @param prog instruction buffer
+ * @param len size of the buffer in instructions, set to the program length
+ *
+ * @return
+ *     - ESP_OK if success
+ *     - ESP_ERR_INVALID_SIZE if the program does not fit or overlaps the data
+ *     - ESP_FAIL if a branch is out of range
+ */
+esp_err_t ulp_builder_build(const ulp_builder_t* b, ulp_insn_t* prog, size_t* len);
+
+/**
+ * @brief Size of the ring with its header
+ *
+ * @param b builder
+ *
+ * @return size in words
+ */
+size_t ulp_builder_data_words(const ulp_builder_t* b);
+
+/**
+ * @brief Clear the ring and the period counters, call it before the program starts
+ *
+ * @param mem RTC slow memory
+ * @param b builder
+ */
+void ulp_ring_init(volatile uint32_t* mem, const ulp_builder_t* b);
+
+/**
+ * @brief Take the unread records out of the ring, oldest first
+ *
+ * @param mem RTC slow memory
+ * @param data_addr word address of the ring
+ * @param rec buffer of records
+ * @param max size of the buffer
+ * @param lost set to the number of records overwritten before they were read, may be NULL
+ *
+ * @return number of records, -1 if the ring is not initialized
+ */
+int ulp_ring_read(volatile uint32_t* mem, uint16_t data_addr, ulp_record_t* rec, int max, uint16_t* lost);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ * Runs the TEST_CASEs of the component tests on the host.
+ *
+ *     host_unity              all test cases
+ *     host_unity <text>       the test cases whose name contains text
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include "unity.h"
+
+#define HOST_TEST_MAX   (64)
+
+static host_test_t s_tests[HOST_TEST_MAX];
+static int s_test_num;
+static jmp_buf s_fail_jmp;
+
+void host_test_register(const char* name, void (*fn)(void))
+{
+    if (s_test_num >= HOST_TEST_MAX) {
+        printf("too many test cases\n");
+        exit(2);
+    }
+    s_tests[s_test_num].name = name;
+    s_tests[s_test_num].fn = fn;
+    s_test_num++;
+}
+
+void host_test_fail(const char* file, int line, const char* msg, long expected, long actual)
+{
+    printf("  FAIL %s:%d: %s (expected %ld, actual %ld)\n", file, line, msg, expected, actual);
+    longjmp(s_fail_jmp, 1);
+}
+
+int main(int argc, char** argv)
+{
+    int run = 0, fail = 0;
+    for (int i = 0; i < s_test_num; i++) {
+        if (argc > 1 && strstr(s_tests[i].name, argv[1]) == NULL) {
+            continue;
+        }
+        printf("RUN  %s\n", s_tests[i].name);
+        run++;
+        if (setjmp(s_fail_jmp) == 0) {
+            s_tests[i].fn();
+        } else {
+            fail++;
+        }
+    }
+    if (fail) {
+        printf("%d of %d test cases FAILED\n", fail, run);
+        return 1;
+    }
+    printf("ALL PASS (%d test cases)\n", run);
+    return 0;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+/* instruction layout and macros of esp32/ulp.h in ESP-IDF v3.2, the part the builder and the emulator use */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "soc/soc.h"
+#define R0 0
+#define R1 1
+#define R2 2
+#define R3 3
+#define OPCODE_WR_REG 1
+#define OPCODE_RD_REG 2
+#define OPCODE_I2C 3
+#define OPCODE_DELAY 4
+#define OPCODE_ADC 5
+#define OPCODE_ST 6
+#define SUB_OPCODE_ST 4
+#define OPCODE_ALU 7
+#define SUB_OPCODE_ALU_REG 0
+#define SUB_OPCODE_ALU_IMM 1
+#define ALU_SEL_ADD 0
+#define ALU_SEL_SUB 1
+#define ALU_SEL_AND 2
+#define ALU_SEL_OR 3
+#define ALU_SEL_MOV 4
+#define ALU_SEL_LSH 5
+#define ALU_SEL_RSH 6
+#define SUB_OPCODE_ALU_CNT 2
+#define OPCODE_BRANCH 8
+#define SUB_OPCODE_BX 0
+#define BX_JUMP_TYPE_DIRECT 0
+#define BX_JUMP_TYPE_ZERO 1
+#define BX_JUMP_TYPE_OVF 2
+#define SUB_OPCODE_B 1
+#define B_CMP_L 0
+#define B_CMP_GE 1
+#define SUB_OPCODE_BS 2
+#define OPCODE_END 9
+#define SUB_OPCODE_END 0
+#define SUB_OPCODE_SLEEP 1
+#define OPCODE_TSENS 10
+#define OPCODE_HALT 11
+#define OPCODE_LD 13
+#define OPCODE_MACRO 15
+typedef union {
+    struct { uint32_t cycles : 16; uint32_t unused : 12; uint32_t opcode : 4; } delay;
+    struct { uint32_t dreg : 2; uint32_t sreg : 2; uint32_t unused1 : 6; uint32_t offset : 11; uint32_t unused2 : 4; uint32_t sub_opcode : 3; uint32_t opcode : 4; } st;
+    struct { uint32_t dreg : 2; uint32_t sreg : 2; uint32_t unused1 : 6; uint32_t offset : 11; uint32_t unused2 : 7; uint32_t opcode : 4; } ld;
+    struct { uint32_t unused : 28; uint32_t opcode : 4; } halt;
+    struct { uint32_t dreg : 2; uint32_t addr : 11; uint32_t unused : 8; uint32_t reg : 1; uint32_t type : 3; uint32_t sub_opcode : 3; uint32_t opcode : 4; } bx;
+    struct { uint32_t imm : 16; uint32_t cmp : 1; uint32_t offset : 7; uint32_t sign : 1; uint32_t sub_opcode : 3; uint32_t opcode : 4; } b;
+    struct { uint32_t dreg : 2; uint32_t sreg : 2; uint32_t treg : 2; uint32_t unused : 15; uint32_t sel : 4; uint32_t sub_opcode : 3; uint32_t opcode : 4; } alu_reg;
+    struct { uint32_t dreg : 2; uint32_t sreg : 2; uint32_t imm : 16; uint32_t unused : 1; uint32_t sel : 4; uint32_t sub_opcode : 3; uint32_t opcode : 4; } alu_imm;
+    struct { uint32_t addr : 8; uint32_t periph_sel : 2; uint32_t data : 8; uint32_t low : 5; uint32_t high : 5; uint32_t opcode : 4; } wr_reg;
+    struct { uint32_t addr : 8; uint32_t periph_sel : 2; uint32_t unused : 8; uint32_t low : 5; uint32_t high : 5; uint32_t opcode : 4; } rd_reg;
+    struct { uint32_t dreg : 2; uint32_t mux : 4; uint32_t sar_sel : 1; uint32_t unused1 : 1; uint32_t cycles : 16; uint32_t unused2 : 4; uint32_t opcode: 4; } adc;
+    struct { uint32_t dreg : 2; uint32_t wait_delay : 14; uint32_t reserved : 12; uint32_t opcode : 4; } tsens;
+    struct { uint32_t wakeup : 1; uint32_t unused : 24; uint32_t sub_opcode : 3; uint32_t opcode : 4; } end;
+    struct { uint32_t label : 16; uint32_t unused : 8; uint32_t sub_opcode : 4; uint32_t opcode : 4; } macro;
+    uint32_t instruction;
+} ulp_insn_t;
+#define SOC_REG_TO_ULP_PERIPH_SEL(reg) (((reg) - DR_REG_RTCCNTL_BASE) / 0x400)
+#define I_DELAY(cycles_) { .delay = { .cycles = cycles_, .unused = 0, .opcode = OPCODE_DELAY } }
+#define I_HALT() { .halt = { .unused = 0, .opcode = OPCODE_HALT } }
+#define I_WAKE() { .end = { .wakeup = 1, .unused = 0, .sub_opcode = SUB_OPCODE_END, .opcode = OPCODE_END } }
+#define I_WR_REG(reg, low_bit, high_bit, val) {.wr_reg = { .addr = (reg & 0xff) / sizeof(uint32_t), .periph_sel = SOC_REG_TO_ULP_PERIPH_SEL(reg), .data = val, .low = low_bit, .high = high_bit, .opcode = OPCODE_WR_REG } }
+#define I_RD_REG(reg, low_bit, high_bit) {.rd_reg = { .addr = (reg & 0xff) / sizeof(uint32_t), .periph_sel = SOC_REG_TO_ULP_PERIPH_SEL(reg), .unused = 0, .low = low_bit, .high = high_bit, .opcode = OPCODE_RD_REG } }
+#define I_TSENS(reg_dest, delay) { .tsens = { .dreg = reg_dest, .wait_delay = delay, .reserved = 0, .opcode = OPCODE_TSENS } }
+#define I_ADC(reg_dest, adc_idx, pad_idx) { .adc = { .dreg = reg_dest, .mux = pad_idx + 1, .sar_sel = adc_idx, .unused1 = 0, .cycles = 0, .unused2 = 0, .opcode = OPCODE_ADC } }
+#define I_ST(reg_val, reg_addr, offset_) { .st = { .dreg = reg_val, .sreg = reg_addr, .unused1 = 0, .offset = offset_, .unused2 = 0, .sub_opcode = SUB_OPCODE_ST, .opcode = OPCODE_ST } }
+#define I_LD(reg_dest, reg_addr, offset_) { .ld = { .dreg = reg_dest, .sreg = reg_addr, .unused1 = 0, .offset = offset_, .unused2 = 0, .opcode = OPCODE_LD } }
+#define I_BL(pc_offset, imm_value) { .b = { .imm = imm_value, .cmp = B_CMP_L, .offset = (pc_offset) >= 0 ? (pc_offset) : -(pc_offset), .sign = (pc_offset) >= 0 ? 0 : 1, .sub_opcode = SUB_OPCODE_B, .opcode = OPCODE_BRANCH } }
+#define I_BGE(pc_offset, imm_value) { .b = { .imm = imm_value, .cmp = B_CMP_GE, .offset = (pc_offset) >= 0 ? (pc_offset) : -(pc_offset), .sign = (pc_offset) >= 0 ? 0 : 1, .sub_opcode = SUB_OPCODE_B, .opcode = OPCODE_BRANCH } }
+#define I_BXR(reg_pc) { .bx = { .dreg = reg_pc, .addr = 0, .unused = 0, .reg = 1, .type = BX_JUMP_TYPE_DIRECT, .sub_opcode = SUB_OPCODE_BX, .opcode = OPCODE_BRANCH } }
+#define I_BXI(imm_pc) { .bx = { .dreg = 0, .addr = imm_pc, .unused = 0, .reg = 0, .type = BX_JUMP_TYPE_DIRECT, .sub_opcode = SUB_OPCODE_BX, .opcode = OPCODE_BRANCH } }
+#define I_BXZI(imm_pc) { .bx = { .dreg = 0, .addr = imm_pc, .unused = 0, .reg = 0, .type = BX_JUMP_TYPE_ZERO, .sub_opcode = SUB_OPCODE_BX, .opcode = OPCODE_BRANCH } }
+#define I_BXFI(imm_pc) { .bx = { .dreg = 0, .addr = imm_pc, .unused = 0, .reg = 0, .type = BX_JUMP_TYPE_OVF, .sub_opcode = SUB_OPCODE_BX, .opcode = OPCODE_BRANCH } }
+#define I_ALUR(s, reg_dest, reg_src1, reg_src2) { .alu_reg = { .dreg = reg_dest, .sreg = reg_src1, .treg = reg_src2, .unused = 0, .sel = s, .sub_opcode = SUB_OPCODE_ALU_REG, .opcode = OPCODE_ALU } }
+#define I_ALUI(s, reg_dest, reg_src, imm_) { .alu_imm = { .dreg = reg_dest, .sreg = reg_src, .imm = imm_, .unused = 0, .sel = s, .sub_opcode = SUB_OPCODE_ALU_IMM, .opcode = OPCODE_ALU } }
+#define I_ADDR(a,b,c) I_ALUR(ALU_SEL_ADD,a,b,c)
+#define I_SUBR(a,b,c) I_ALUR(ALU_SEL_SUB,a,b,c)
+#define I_ANDR(a,b,c) I_ALUR(ALU_SEL_AND,a,b,c)
+#define I_ORR(a,b,c) I_ALUR(ALU_SEL_OR,a,b,c)
+#define I_MOVR(a,b) I_ALUR(ALU_SEL_MOV,a,b,0)
+#define I_LSHR(a,b,c) I_ALUR(ALU_SEL_LSH,a,b,c)
+#define I_RSHR(a,b,c) I_ALUR(ALU_SEL_RSH,a,b,c)
+#define I_ADDI(a,b,i) I_ALUI(ALU_SEL_ADD,a,b,i)
+#define I_SUBI(a,b,i) I_ALUI(ALU_SEL_SUB,a,b,i)
+#define I_ANDI(a,b,i) I_ALUI(ALU_SEL_AND,a,b,i)
+#define I_ORI(a,b,i) I_ALUI(ALU_SEL_OR,a,b,i)
+#define I_MOVI(a,i) I_ALUI(ALU_SEL_MOV,a,0,i)
+#define I_LSHI(a,b,i) I_ALUI(ALU_SEL_LSH,a,b,i)
+#define I_RSHI(a,b,i) I_ALUI(ALU_SEL_RSH,a,b,i)
@@ -0,0 +1,6 @@
+#pragma once
+#define DR_REG_RTCCNTL_BASE 0x3ff48000
+#define DR_REG_RTCIO_BASE   0x3ff48400
+#define DR_REG_SENS_BASE    0x3ff48800
+#define DR_REG_RTC_I2C_BASE 0x3ff48C00
+#define BIT(n) (1UL << (n))
@@ -0,0 +1,434 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include "esp_log.h"
+#include "esp32/ulp.h"
+#include "soc/rtc_io_reg.h"
+#include "ulp_builder.h"
+#include "ulp_emu.h"
+#include "unity.h"
+
+#define TEST_MEM_WORDS      (2048)
+#define TEST_PROG_MAX       (512)
+#define TEST_DATA_ADDR      (400)
+#define TEST_STEP_MAX       (100000)
+#define TEST_SCL_IO         (9)
+#define TEST_SDA_IO         (8)
+#define TEST_I2C_ADDR       (0x48)
+
+typedef enum {
+    I2C_SIM_IDLE,
+    I2C_SIM_RX,             /* shifting a byte in */
+    I2C_SIM_ACK,            /* the slave drives the ack bit */
+    I2C_SIM_TX,             /* shifting a byte out */
+    I2C_SIM_MASTER_ACK,     /* the master acks the byte sent */
+} i2c_sim_state_t;
+
+/* I2C slave with 16 bit registers, on the open drain lines of the RTC IO registers */
+typedef struct {
+    uint32_t enable;        /* output enable bits, an enabled line is low */
+    bool slave_low;
+    bool scl;
+    bool sda;
+    i2c_sim_state_t state;
+    int bit;
+    uint8_t byte;
+    int rx_num;
+    bool read;
+    bool nack;
+    uint8_t reg;
+    int tx_num;
+    uint16_t regs[4];
+    int starts;
+} i2c_sim_t;
+
+typedef struct {
+    uint32_t mem[TEST_MEM_WORDS];
+    uint16_t adc[8];
+    uint16_t tsens;
+    i2c_sim_t i2c;
+    ulp_emu_t emu;
+    uint16_t program_addr;
+} test_env_t;
+
+static test_env_t s_env;
+
+static bool i2c_sim_line(const i2c_sim_t* s, int io)
+{
+    bool high = !(s->enable & BIT(RTC_GPIO_ENABLE_W1TS_S + io));
+    return io == TEST_SDA_IO ? high && !s->slave_low : high;
+}
+
+static void i2c_sim_tx_bit(i2c_sim_t* s)
+{
+    uint16_t val = s->regs[s->reg & 0x3];
+    uint8_t byte = s->tx_num == 0 ? val >> 8 : val & 0xff;
+    s->slave_low = !(byte & BIT(7 - s->bit));
+}
+
+static void i2c_sim_rising(i2c_sim_t* s)
+{
+    if (s->state == I2C_SIM_RX) {
+        s->byte = (s->byte << 1) | s->sda;
+        s->bit++;
+    } else if (s->state == I2C_SIM_MASTER_ACK) {
+        s->nack = s->sda;
+    }
+}
+
+static void i2c_sim_falling(i2c_sim_t* s)
+{
+    switch (s->state) {
+    case I2C_SIM_RX:
+        if (s->bit < 8) {
+            break;
+        }
+        if (s->rx_num == 0) {
+            if ((s->byte >> 1) != TEST_I2C_ADDR) {
+                s->state = I2C_SIM_IDLE;
+                break;
+            }
+            s->read = s->byte & 1;
+        } else {
+            s->reg = s->byte;
+        }
+        s->rx_num++;
+        s->slave_low = true;
+        s->state = I2C_SIM_ACK;
+        break;
+    case I2C_SIM_ACK:
+        s->slave_low = false;
+        s->bit = 0;
+        s->byte = 0;
+        if (s->read) {
+            s->state = I2C_SIM_TX;
+            s->tx_num = 0;
+            i2c_sim_tx_bit(s);
+        } else {
+            s->state = I2C_SIM_RX;
+        }
+        break;
+    case I2C_SIM_TX:
+        if (++s->bit < 8) {
+            i2c_sim_tx_bit(s);
+        } else {
+            s->slave_low = false;
+            s->state = I2C_SIM_MASTER_ACK;
+        }
+        break;
+    case I2C_SIM_MASTER_ACK:
+        if (s->nack) {
+            s->state = I2C_SIM_IDLE;
+        } else {
+            s->tx_num++;
+            s->bit = 0;
+            s->state = I2C_SIM_TX;
+            i2c_sim_tx_bit(s);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void i2c_sim_update(i2c_sim_t* s)
+{
+    bool scl = i2c_sim_line(s, TEST_SCL_IO);
+    bool sda = i2c_sim_line(s, TEST_SDA_IO);
+    if (scl && s->scl && sda != s->sda) {
+        // SDA moves while SCL is high: start or stop
+        if (!sda) {
+            s->starts++;
+            s->state = I2C_SIM_RX;
+            s->bit = 0;
+            s->byte = 0;
+            s->rx_num = 0;
+        } else {
+            s->state = I2C_SIM_IDLE;
+        }
+        s->slave_low = false;
+    } else if (scl && !s->scl) {
+        s->sda = sda;
+        i2c_sim_rising(s);
+    } else if (!scl && s->scl) {
+        i2c_sim_falling(s);
+    }
+    s->scl = scl;
+    s->sda = i2c_sim_line(s, TEST_SDA_IO);
+}
+
+static uint16_t test_adc(void* arg, int sar_sel, int channel)
+{
+    test_env_t* env = (test_env_t*) arg;
+    TEST_ASSERT_EQUAL_INT(0, sar_sel);
+    return env->adc[channel];
+}
+
+static uint16_t test_tsens(void* arg)
+{
+    return ((test_env_t*) arg)->tsens;
+}
+
+static uint32_t test_reg_read(void* arg, uint32_t reg)
+{
+    test_env_t* env = (test_env_t*) arg;
+    TEST_ASSERT_EQUAL_UINT32(RTC_GPIO_IN_REG, reg);
+    uint32_t val = 0;
+    val |= i2c_sim_line(&env->i2c, TEST_SCL_IO) << (RTC_GPIO_IN_NEXT_S + TEST_SCL_IO);
+    val |= i2c_sim_line(&env->i2c, TEST_SDA_IO) << (RTC_GPIO_IN_NEXT_S + TEST_SDA_IO);
+    return val;
+}
+
+static void test_reg_write(void* arg, uint32_t reg, int low, int high, uint32_t data)
+{
+    test_env_t* env = (test_env_t*) arg;
+    TEST_ASSERT_EQUAL_INT(low, high);
+    TEST_ASSERT_EQUAL_INT(1, data);
+    if (reg == RTC_GPIO_ENABLE_W1TS_REG) {
+        env->i2c.enable |= BIT(low);
+    } else {
+        TEST_ASSERT_EQUAL_UINT32(RTC_GPIO_ENABLE_W1TC_REG, reg);
+        env->i2c.enable &= ~BIT(low);
+    }
+    i2c_sim_update(&env->i2c);
+}
+
+static void test_env_load(test_env_t* env, const ulp_builder_t* b)
+{
+    ulp_insn_t prog[TEST_PROG_MAX];
+    size_t len = TEST_PROG_MAX;
+    memset(env, 0, sizeof(test_env_t));
+    env->i2c.scl = true;
+    env->i2c.sda = true;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, ulp_builder_build(b, prog, &len));
+    memcpy(env->mem + b->program_addr, prog, len * sizeof(ulp_insn_t));
+    ulp_ring_init(env->mem, b);
+    env->program_addr = b->program_addr;
+    env->emu.mem = env->mem;
+    env->emu.mem_words = TEST_MEM_WORDS;
+    env->emu.adc = test_adc;
+    env->emu.tsens = test_tsens;
+    env->emu.reg_read = test_reg_read;
+    env->emu.reg_write = test_reg_write;
+    env->emu.arg = env;
+}
+
+/* one wake up period of the ULP, returns whether the chip was woken up */
+static bool test_env_run(test_env_t* env)
+{
+    TEST_ASSERT_EQUAL_INT(ESP_OK, ulp_emu_run(&env->emu, env->program_addr, TEST_STEP_MAX));
+    return env->emu.woken;
+}
+
+TEST_CASE("ULP builder monitor period test", "[ulp_monitor][rtc]")
+{
+    ulp_builder_t b;
+    ulp_mon_t adc = { .type = ULP_MON_ADC, .period = 1, .high_threshold = 0xffff, .adc_channel = 6 };
+    ulp_mon_t tsens = { .type = ULP_MON_TSENS, .period = 3, .high_threshold = 0xffff };
+    TEST_ASSERT_EQUAL_INT(ESP_OK, ulp_builder_init(&b, 0, TEST_DATA_ADDR, 16, 0));
+    TEST_ASSERT_EQUAL_INT(0, ulp_builder_add(&b, &adc));
+    TEST_ASSERT_EQUAL_INT(1, ulp_builder_add(&b, &tsens));
+    test_env_load(&s_env, &b);
+    for (int i = 1; i <= 6; i++) {
+        s_env.adc[6] = 1000 + i;
+        s_env.tsens = 140 + i;
+        TEST_ASSERT_FALSE(test_env_run(&s_env));
+    }
+
+    const uint8_t ids[] = { 0, 1, 0, 0, 0, 1, 0, 0 };
+    const uint16_t ticks[] = { 1, 1, 2, 3, 4, 4, 5, 6 };
+    ulp_record_t rec[16];
+    uint16_t lost = 1;
+    TEST_ASSERT_EQUAL_INT(8, ulp_ring_read(s_env.mem, TEST_DATA_ADDR, rec, 16, &lost));
+    TEST_ASSERT_EQUAL_INT(0, lost);
+    for (int i = 0; i < 8; i++) {
+        TEST_ASSERT_EQUAL_INT(ids[i], rec[i].id);
+        TEST_ASSERT_EQUAL_INT(ticks[i], rec[i].tick);
+        TEST_ASSERT_EQUAL_INT(ids[i] ? 140 + ticks[i] : 1000 + ticks[i], rec[i].value);
+    }
+    TEST_ASSERT_EQUAL_INT(0, ulp_ring_read(s_env.mem, TEST_DATA_ADDR, rec, 16, &lost));
+}
+
+TEST_CASE("ULP builder ring wrap test", "[ulp_monitor][rtc]")
+{
+    ulp_builder_t b;
+    ulp_mon_t adc = { .type = ULP_MON_ADC, .period = 1, .high_threshold = 0xffff, .adc_channel = 0 };
+    TEST_ASSERT_EQUAL_INT(ESP_OK, ulp_builder_init(&b, 16, TEST_DATA_ADDR, 4, 0));
+    TEST_ASSERT_EQUAL_INT(0, ulp_builder_add(&b, &adc));
+    test_env_load(&s_env, &b);
+    for (int i = 1; i <= 10; i++) {
+        s_env.adc[0] = i;
+        test_env_run(&s_env);
+    }
+
+    ulp_record_t rec[4];
+    uint16_t lost;
+    // the oldest 6 records are gone, take the rest in two reads
+    TEST_ASSERT_EQUAL_INT(3, ulp_ring_read(s_env.mem, TEST_DATA_ADDR, rec, 3, &lost));
+    TEST_ASSERT_EQUAL_INT(6, lost);
+    TEST_ASSERT_EQUAL_INT(7, rec[0].value);
+    TEST_ASSERT_EQUAL_INT(9, rec[2].value);
+    TEST_ASSERT_EQUAL_INT(1, ulp_ring_read(s_env.mem, TEST_DATA_ADDR, rec, 4, &lost));
+    TEST_ASSERT_EQUAL_INT(0, lost);
+    TEST_ASSERT_EQUAL_INT(10, rec[0].value);
+
+    for (int i = 11; i <= 12; i++) {
+        s_env.adc[0] = i;
+        test_env_run(&s_env);
+    }
+    TEST_ASSERT_EQUAL_INT(2, ulp_ring_read(s_env.mem, TEST_DATA_ADDR, rec, 4, &lost));
+    TEST_ASSERT_EQUAL_INT(0, lost);
+    TEST_ASSERT_EQUAL_INT(11, rec[0].value);
+    TEST_ASSERT_EQUAL_INT(12, rec[1].tick);
+}
+
+/* stop the ULP after every instruction of a run, the records read before and after must follow on */
+TEST_CASE("ULP builder ring read while running test", "[ulp_monitor][rtc]")
+{
+    ulp_builder_t b;
+    ulp_mon_t adc = { .type = ULP_MON_ADC, .period = 1, .high_threshold = 0xffff, .adc_channel = 2 };
+    ulp_mon_t tsens = { .type = ULP_MON_TSENS, .period = 1, .high_threshold = 0xffff };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, ulp_builder_init(&b, 0, TEST_DATA_ADDR, 6, 0));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, ulp_builder_init(&b, 0, TEST_DATA_ADDR, 4, 0));
+    TEST_ASSERT_EQUAL_INT(0, ulp_builder_add(&b, &adc));
+    TEST_ASSERT_EQUAL_INT(1, ulp_builder_add(&b, &tsens));
+    test_env_load(&s_env, &b);
+    uint32_t steps = s_env.emu.steps;
+    test_env_run(&s_env);
+    uint32_t run_steps = s_env.emu.steps - steps;
+
+    for (uint32_t cut = 0; cut <= run_steps; cut++) {
+        ulp_record_t rec[4], got[4];
+        uint16_t lost;
+        int num = 0;
+        test_env_load(&s_env, &b);
+        // three runs wrap the ring, leave the newest record unread
+        for (int i = 1; i <= 3; i++) {
+            s_env.adc[2] = 100 + i;
+            s_env.tsens = 200 + i;
+            test_env_run(&s_env);
+        }
+        TEST_ASSERT_EQUAL_INT(3, ulp_ring_read(s_env.mem, TEST_DATA_ADDR, rec, 3, &lost));
+        TEST_ASSERT_EQUAL_INT(2, lost);
+        TEST_ASSERT_EQUAL_INT(102, rec[0].value);
+
+        s_env.adc[2] = 104;
+        s_env.tsens = 204;
+        esp_err_t ret = ulp_emu_run(&s_env.emu, s_env.program_addr, cut);
+        TEST_ASSERT(ret == ESP_ERR_TIMEOUT || ret == ESP_OK);
+        int n = ulp_ring_read(s_env.mem, TEST_DATA_ADDR, got, 4, &lost);
+        TEST_ASSERT_EQUAL_INT(0, lost);
+        memcpy(rec, got, n * sizeof(ulp_record_t));
+        num = n;
+        if (ret == ESP_ERR_TIMEOUT) {
+            TEST_ASSERT_EQUAL_INT(ESP_OK, ulp_emu_resume(&s_env.emu, TEST_STEP_MAX));
+        }
+        n = ulp_ring_read(s_env.mem, TEST_DATA_ADDR, got, 4, &lost);
+        TEST_ASSERT_EQUAL_INT(0, lost);
+        TEST_ASSERT(num + n <= 3);
+        memcpy(rec + num, got, n * sizeof(ulp_record_t));
+        num += n;
+
+        TEST_ASSERT_EQUAL_INT(3, num);
+        TEST_ASSERT_EQUAL_INT(203, rec[0].value);
+        TEST_ASSERT_EQUAL_INT(104, rec[1].value);
+        TEST_ASSERT_EQUAL_INT(0, rec[1].id);
+        TEST_ASSERT_EQUAL_INT(204, rec[2].value);
+        TEST_ASSERT_EQUAL_INT(4, rec[2].tick);
+    }
+}
+
+TEST_CASE("ULP builder wake up test", "[ulp_monitor][rtc]")
+{
+    ulp_builder_t b;
+    ulp_mon_t adc = { .type = ULP_MON_ADC, .period = 1, .low_threshold = 500, .high_threshold = 3000, .adc_channel = 3 };
+    ulp_record_t rec[8];
+    TEST_ASSERT_EQUAL_INT(ESP_OK, ulp_builder_init(&b, 0, TEST_DATA_ADDR, 8, 3));
+    TEST_ASSERT_EQUAL_INT(0, ulp_builder_add(&b, &adc));
+    test_env_load(&s_env, &b);
+
+    // unread records
+    s_env.adc[3] = 1000;
+    TEST_ASSERT_FALSE(test_env_run(&s_env));
+    TEST_ASSERT_FALSE(test_env_run(&s_env));
+    TEST_ASSERT_TRUE(test_env_run(&s_env));
+    TEST_ASSERT_EQUAL_INT(3, ulp_ring_read(s_env.mem, TEST_DATA_ADDR, rec, 8, NULL));
+    TEST_ASSERT_FALSE(test_env_run(&s_env));
+    TEST_ASSERT_EQUAL_INT(1, ulp_ring_read(s_env.mem, TEST_DATA_ADDR, rec, 8, NULL));
+
+    // thresholds, the limits themselves are in range
+    s_env.adc[3] = 3001;
+    TEST_ASSERT_TRUE(test_env_run(&s_env));
+    s_env.adc[3] = 3000;
+    TEST_ASSERT_FALSE(test_env_run(&s_env));
+    TEST_ASSERT_EQUAL_INT(2, ulp_ring_read(s_env.mem, TEST_DATA_ADDR, rec, 8, NULL));
+    s_env.adc[3] = 500;
+    TEST_ASSERT_FALSE(test_env_run(&s_env));
+    s_env.adc[3] = 499;
+    TEST_ASSERT_TRUE(test_env_run(&s_env));
+}
+
+TEST_CASE("ULP builder I2C monitor test", "[ulp_monitor][rtc]")
+{
+    ulp_builder_t b;
+    ulp_mon_t sensor = { .type = ULP_MON_I2C, .period = 2, .high_threshold = 0xffff, .i2c_addr = TEST_I2C_ADDR, .i2c_reg = 1 };
+    ulp_mon_t missing = { .type = ULP_MON_I2C, .period = 2, .high_threshold = 0xffff, .i2c_addr = 0x23, .i2c_reg = 0 };
+    TEST_ASSERT_EQUAL_INT(ESP_OK, ulp_builder_init(&b, 0, TEST_DATA_ADDR, 8, 0));
+    TEST_ASSERT_EQUAL_INT(-1, ulp_builder_add(&b, &sensor));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, ulp_builder_set_i2c(&b, TEST_SCL_IO, TEST_SDA_IO));
+    TEST_ASSERT_EQUAL_INT(0, ulp_builder_add(&b, &sensor));
+    TEST_ASSERT_EQUAL_INT(1, ulp_builder_add(&b, &missing));
+    test_env_load(&s_env, &b);
+    s_env.i2c.regs[1] = 0x1a2b;
+    TEST_ASSERT_FALSE(test_env_run(&s_env));
+    s_env.i2c.regs[1] = 0x8001;
+    TEST_ASSERT_FALSE(test_env_run(&s_env));
+    TEST_ASSERT_FALSE(test_env_run(&s_env));
+    // two starts for each read, the bus is released at the end
+    TEST_ASSERT_EQUAL_INT(8, s_env.i2c.starts);
+    TEST_ASSERT_EQUAL_UINT32(0, s_env.i2c.enable);
+
+    ulp_record_t rec[8];
+    TEST_ASSERT_EQUAL_INT(4, ulp_ring_read(s_env.mem, TEST_DATA_ADDR, rec, 8, NULL));
+    TEST_ASSERT_EQUAL_INT(0, rec[0].id);
+    TEST_ASSERT_EQUAL_INT(0x1a2b, rec[0].value);
+    TEST_ASSERT_EQUAL_INT(1, rec[1].id);
+    TEST_ASSERT_EQUAL_INT(0xffff, rec[1].value);
+    TEST_ASSERT_EQUAL_INT(3, rec[2].tick);
+    TEST_ASSERT_EQUAL_INT(0x8001, rec[2].value);
+}
+
+TEST_CASE("ULP builder program size test", "[ulp_monitor][rtc]")
+{
+    ulp_builder_t b;
+    ulp_insn_t prog[TEST_PROG_MAX];
+    size_t len = TEST_PROG_MAX;
+    ulp_mon_t adc = { .type = ULP_MON_ADC, .period = 1, .high_threshold = 0xffff };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, ulp_builder_init(&b, 100, 100, 8, 0));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, ulp_builder_init(&b, 0, 100, 8, 9));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, ulp_builder_init(&b, 0, 30, 8, 0));
+    for (int i = 0; i < ULP_MON_NUM_MAX; i++) {
+        TEST_ASSERT_EQUAL_INT(i, ulp_builder_add(&b, &adc));
+    }
+    TEST_ASSERT_EQUAL_INT(-1, ulp_builder_add(&b, &adc));
+    // overlaps the ring
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, ulp_builder_build(&b, prog, &len));
+    TEST_ASSERT_EQUAL_INT(TEST_PROG_MAX, len);
+    b.data_addr = TEST_DATA_ADDR;
+    len = 20;
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, ulp_builder_build(&b, prog, &len));
+    len = TEST_PROG_MAX;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, ulp_builder_build(&b, prog, &len));
+    TEST_ASSERT(len > 20 && len < TEST_DATA_ADDR);
+}
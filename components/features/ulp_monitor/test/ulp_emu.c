@@ -0,0 +1,188 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include "esp32/ulp.h"
+#include "ulp_emu.h"
+
+#define ULP_EMU_PERIPH_SIZE     (0x400)
+
+static uint16_t ulp_emu_alu(ulp_emu_t* emu, int sel, uint16_t a, uint16_t b, bool* ok)
+{
+    uint32_t res;
+    emu->ovf = false;
+    switch (sel) {
+    case ALU_SEL_ADD:
+        res = (uint32_t) a + b;
+        emu->ovf = res > 0xffff;
+        break;
+    case ALU_SEL_SUB:
+        res = (uint32_t) a - b;
+        emu->ovf = a < b;
+        break;
+    case ALU_SEL_AND:
+        res = a & b;
+        break;
+    case ALU_SEL_OR:
+        res = a | b;
+        break;
+    case ALU_SEL_MOV:
+        res = b;
+        break;
+    case ALU_SEL_LSH:
+        res = (uint32_t) a << (b & 0xf);
+        break;
+    case ALU_SEL_RSH:
+        res = a >> (b & 0xf);
+        break;
+    default:
+        *ok = false;
+        return 0;
+    }
+    emu->zero = (res & 0xffff) == 0;
+    return res & 0xffff;
+}
+
+static uint32_t ulp_emu_reg(uint32_t periph_sel, uint32_t addr)
+{
+    return DR_REG_RTCCNTL_BASE + periph_sel * ULP_EMU_PERIPH_SIZE + addr * sizeof(uint32_t);
+}
+
+/* one instruction, false if it can not be run */
+static bool ulp_emu_step(ulp_emu_t* emu, bool* halt)
+{
+    if (emu->pc >= emu->mem_words) {
+        return false;
+    }
+    ulp_insn_t insn;
+    insn.instruction = emu->mem[emu->pc];
+    uint16_t next = emu->pc + 1;
+    bool ok = true;
+    switch (insn.halt.opcode) {
+    case OPCODE_ALU:
+        if (insn.alu_reg.sub_opcode == SUB_OPCODE_ALU_REG) {
+            // a move takes its source as the first operand
+            uint16_t b = insn.alu_reg.sel == ALU_SEL_MOV ? emu->r[insn.alu_reg.sreg] : emu->r[insn.alu_reg.treg];
+            emu->r[insn.alu_reg.dreg] = ulp_emu_alu(emu, insn.alu_reg.sel, emu->r[insn.alu_reg.sreg], b, &ok);
+        } else if (insn.alu_imm.sub_opcode == SUB_OPCODE_ALU_IMM) {
+            emu->r[insn.alu_imm.dreg] = ulp_emu_alu(emu, insn.alu_imm.sel, emu->r[insn.alu_imm.sreg], insn.alu_imm.imm, &ok);
+        } else {
+            ok = false;
+        }
+        break;
+    case OPCODE_LD: {
+        uint32_t addr = emu->r[insn.ld.sreg] + insn.ld.offset;
+        if (addr >= emu->mem_words) {
+            return false;
+        }
+        emu->r[insn.ld.dreg] = emu->mem[addr] & 0xffff;
+        break;
+    }
+    case OPCODE_ST: {
+        uint32_t addr = emu->r[insn.st.sreg] + insn.st.offset;
+        if (insn.st.sub_opcode != SUB_OPCODE_ST || addr >= emu->mem_words) {
+            return false;
+        }
+        // the upper half holds the PC of the store
+        emu->mem[addr] = ((uint32_t) (emu->pc << 5) << 16) | emu->r[insn.st.dreg];
+        break;
+    }
+    case OPCODE_BRANCH:
+        if (insn.bx.sub_opcode == SUB_OPCODE_BX) {
+            uint16_t target = insn.bx.reg ? emu->r[insn.bx.dreg] : insn.bx.addr;
+            if (insn.bx.type == BX_JUMP_TYPE_DIRECT
+                    || (insn.bx.type == BX_JUMP_TYPE_ZERO && emu->zero)
+                    || (insn.bx.type == BX_JUMP_TYPE_OVF && emu->ovf)) {
+                next = target;
+            }
+        } else if (insn.b.sub_opcode == SUB_OPCODE_B) {
+            bool take = insn.b.cmp == B_CMP_GE ? emu->r[R0] >= insn.b.imm : emu->r[R0] < insn.b.imm;
+            if (take) {
+                next = insn.b.sign ? emu->pc - insn.b.offset : emu->pc + insn.b.offset;
+            }
+        } else {
+            ok = false;
+        }
+        break;
+    case OPCODE_HALT:
+        *halt = true;
+        break;
+    case OPCODE_END:
+        if (insn.end.sub_opcode == SUB_OPCODE_END) {
+            emu->woken |= insn.end.wakeup;
+        }
+        break;
+    case OPCODE_DELAY:
+        break;
+    case OPCODE_ADC:
+        ok = emu->adc != NULL;
+        if (ok) {
+            emu->r[insn.adc.dreg] = emu->adc(emu->arg, insn.adc.sar_sel, insn.adc.mux - 1);
+        }
+        break;
+    case OPCODE_TSENS:
+        ok = emu->tsens != NULL;
+        if (ok) {
+            emu->r[insn.tsens.dreg] = emu->tsens(emu->arg);
+        }
+        break;
+    case OPCODE_RD_REG: {
+        ok = emu->reg_read != NULL;
+        if (ok) {
+            uint32_t val = emu->reg_read(emu->arg, ulp_emu_reg(insn.rd_reg.periph_sel, insn.rd_reg.addr));
+            int width = insn.rd_reg.high - insn.rd_reg.low + 1;
+            uint32_t mask = width >= 32 ? 0xffffffff : (1UL << width) - 1;
+            emu->r[R0] = (val >> insn.rd_reg.low) & mask & 0xffff;
+        }
+        break;
+    }
+    case OPCODE_WR_REG:
+        ok = emu->reg_write != NULL;
+        if (ok) {
+            emu->reg_write(emu->arg, ulp_emu_reg(insn.wr_reg.periph_sel, insn.wr_reg.addr),
+                    insn.wr_reg.low, insn.wr_reg.high, insn.wr_reg.data);
+        }
+        break;
+    default:
+        ok = false;
+        break;
+    }
+    if (!ok) {
+        printf("ulp_emu: unsupported instruction 0x%08x at %d\n", insn.instruction, emu->pc);
+        return false;
+    }
+    emu->pc = next;
+    return true;
+}
+
+esp_err_t ulp_emu_run(ulp_emu_t* emu, uint16_t entry, uint32_t max_steps)
+{
+    emu->pc = entry;
+    emu->woken = false;
+    return ulp_emu_resume(emu, max_steps);
+}
+
+esp_err_t ulp_emu_resume(ulp_emu_t* emu, uint32_t max_steps)
+{
+    for (uint32_t i = 0; i < max_steps; i++) {
+        bool halt = false;
+        if (!ulp_emu_step(emu, &halt)) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        emu->steps++;
+        if (halt) {
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_TIMEOUT;
+}
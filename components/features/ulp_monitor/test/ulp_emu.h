@@ -0,0 +1,67 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _ULP_EMU_H_
+#define _ULP_EMU_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/*
+ * Instruction level emulator of the ULP coprocessor, to run generated programs in unit tests.
+ * Peripherals are callbacks, registers are given as full addresses.
+ */
+
+typedef struct {
+    uint32_t* mem;                  /* RTC slow memory, in words */
+    size_t mem_words;
+    uint16_t r[4];
+    uint16_t pc;
+    bool zero;
+    bool ovf;
+    bool woken;                     /* a wake instruction ran */
+    uint32_t steps;
+    uint16_t (*adc)(void* arg, int sar_sel, int channel);
+    uint16_t (*tsens)(void* arg);
+    uint32_t (*reg_read)(void* arg, uint32_t reg);
+    void (*reg_write)(void* arg, uint32_t reg, int low, int high, uint32_t data);
+    void* arg;
+} ulp_emu_t;
+
+/**
+ * @brief Run from an address until a halt
+ *
+ * @param emu emulator, registers are kept across runs like on the ULP
+ * @param entry word address of the first instruction
+ * @param max_steps instructions before giving up
+ *
+ * @return
+ *     - ESP_OK if the program halts
+ *     - ESP_ERR_TIMEOUT if it does not halt within max_steps
+ *     - ESP_ERR_INVALID_STATE on an unsupported instruction or an address out of memory
+ */
+esp_err_t ulp_emu_run(ulp_emu_t* emu, uint16_t entry, uint32_t max_steps);
+
+/**
+ * @brief Go on from the instruction where a run gave up, to stop the ULP at any point of a program
+ *
+ * @param emu emulator
+ * @param max_steps instructions before giving up
+ *
+ * @return same as ulp_emu_run
+ */
+esp_err_t ulp_emu_resume(ulp_emu_t* emu, uint32_t max_steps);
+
+#endif
@@ -0,0 +1,519 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "soc/rtc_io_reg.h"
+#include "ulp_builder.h"
+
+static const char* TAG = "ulp_builder";
+
+#define ULP_BUILDER_CHECK(a, str, ret) \
+    if (!(a)) { \
+        ESP_LOGE(TAG,"%s:%d (%s):%s", __FILE__, __LINE__, __FUNCTION__, str); \
+        return (ret); \
+    }
+
+#define ULP_LABEL_MAX           (64)
+#define ULP_FIX_MAX             (128)
+#define ULP_BRANCH_REL_MAX      (127)
+#define ULP_BRANCH_ABS_MAX      (2047)
+#define ULP_RTC_IO_MAX          (17)
+#define ULP_TSENS_DELAY         (8000)
+#define ULP_I2C_DELAY           (50)        /* about 6 us at 8 MHz, a 100 kHz bus at most */
+
+typedef enum {
+    ULP_FIX_REL,            /* relative branch offset */
+    ULP_FIX_ABS,            /* absolute branch address */
+    ULP_FIX_IMM,            /* absolute address as a move immediate */
+} ulp_fix_kind_t;
+
+typedef struct {
+    uint16_t insn;
+    uint8_t label;
+    uint8_t kind;
+} ulp_fix_t;
+
+typedef struct {
+    const ulp_builder_t* b;
+    ulp_insn_t* prog;
+    size_t max;
+    size_t len;
+    bool err;
+    int label_num;
+    int16_t label_pos[ULP_LABEL_MAX];
+    int fix_num;
+    ulp_fix_t fix[ULP_FIX_MAX];
+    int sub_start;          /* labels of the I2C subroutines */
+    int sub_stop;
+    int sub_write;
+    int sub_read;
+} ulp_asm_t;
+
+static void ulp_emit(ulp_asm_t* a, ulp_insn_t insn)
+{
+    if (a->len >= a->max) {
+        a->err = true;
+        return;
+    }
+    a->prog[a->len++] = insn;
+}
+
+static int ulp_label_new(ulp_asm_t* a)
+{
+    if (a->label_num >= ULP_LABEL_MAX) {
+        a->err = true;
+        return 0;
+    }
+    a->label_pos[a->label_num] = -1;
+    return a->label_num++;
+}
+
+static void ulp_label_set(ulp_asm_t* a, int label)
+{
+    a->label_pos[label] = a->len;
+}
+
+/* the next emitted instruction refers to the label */
+static void ulp_fix_add(ulp_asm_t* a, int label, ulp_fix_kind_t kind)
+{
+    if (a->fix_num >= ULP_FIX_MAX) {
+        a->err = true;
+        return;
+    }
+    a->fix[a->fix_num].insn = a->len;
+    a->fix[a->fix_num].label = label;
+    a->fix[a->fix_num].kind = kind;
+    a->fix_num++;
+}
+
+/* relative branch on R0, B_CMP_L jumps if R0 < imm, B_CMP_GE if R0 >= imm */
+static void ulp_emit_b(ulp_asm_t* a, int cmp, uint16_t imm, int label)
+{
+    ulp_fix_add(a, label, ULP_FIX_REL);
+    ulp_insn_t insn = (ulp_insn_t) I_BGE(0, imm);
+    insn.b.cmp = cmp;
+    ulp_emit(a, insn);
+}
+
+/* R0 is never below 0, this one always jumps */
+static void ulp_emit_jump(ulp_asm_t* a, int label)
+{
+    ulp_emit_b(a, B_CMP_GE, 0, label);
+}
+
+/* absolute branch on the flags of the last ALU operation */
+static void ulp_emit_bx(ulp_asm_t* a, int type, int label)
+{
+    ulp_fix_add(a, label, ULP_FIX_ABS);
+    ulp_insn_t insn = (ulp_insn_t) I_BXI(0);
+    insn.bx.type = type;
+    ulp_emit(a, insn);
+}
+
+static bool ulp_fix_resolve(ulp_asm_t* a)
+{
+    for (int i = 0; i < a->fix_num; i++) {
+        const ulp_fix_t* fix = &a->fix[i];
+        int pos = a->label_pos[fix->label];
+        ulp_insn_t* insn = &a->prog[fix->insn];
+        ULP_BUILDER_CHECK(pos >= 0, "label not placed", false);
+        int abs_pos = a->b->program_addr + pos;
+        if (fix->kind == ULP_FIX_REL) {
+            int offset = pos - fix->insn;
+            ULP_BUILDER_CHECK(abs(offset) <= ULP_BRANCH_REL_MAX, "relative branch out of range", false);
+            insn->b.offset = abs(offset);
+            insn->b.sign = offset < 0 ? 1 : 0;
+        } else if (fix->kind == ULP_FIX_ABS) {
+            ULP_BUILDER_CHECK(abs_pos <= ULP_BRANCH_ABS_MAX, "branch address out of range", false);
+            insn->bx.addr = abs_pos;
+        } else {
+            insn->alu_imm.imm = abs_pos;
+        }
+    }
+    return true;
+}
+
+static void ulp_emit_call(ulp_asm_t* a, int sub)
+{
+    int ret = ulp_label_new(a);
+    // the return address goes through the header, so subroutines do not nest
+    ulp_fix_add(a, ret, ULP_FIX_IMM);
+    ulp_emit(a, (ulp_insn_t) I_MOVI(R0, 0));
+    ulp_emit(a, (ulp_insn_t) I_ST(R0, R2, ULP_RING_RET_OFS));
+    ulp_emit_bx(a, BX_JUMP_TYPE_DIRECT, sub);
+    ulp_label_set(a, ret);
+}
+
+static void ulp_emit_ret(ulp_asm_t* a)
+{
+    ulp_emit(a, (ulp_insn_t) I_LD(R0, R2, ULP_RING_RET_OFS));
+    ulp_emit(a, (ulp_insn_t) I_BXR(R0));
+}
+
+/* open drain: high releases the line, low enables the output, which holds 0 */
+static void ulp_emit_line(ulp_asm_t* a, int rtc_io, bool high)
+{
+    if (high) {
+        ulp_emit(a, (ulp_insn_t) I_WR_REG(RTC_GPIO_ENABLE_W1TC_REG, RTC_GPIO_ENABLE_W1TC_S + rtc_io, RTC_GPIO_ENABLE_W1TC_S + rtc_io, 1));
+    } else {
+        ulp_emit(a, (ulp_insn_t) I_WR_REG(RTC_GPIO_ENABLE_W1TS_REG, RTC_GPIO_ENABLE_W1TS_S + rtc_io, RTC_GPIO_ENABLE_W1TS_S + rtc_io, 1));
+    }
+}
+
+/* the line level goes to R0 */
+static void ulp_emit_line_read(ulp_asm_t* a, int rtc_io)
+{
+    ulp_emit(a, (ulp_insn_t) I_RD_REG(RTC_GPIO_IN_REG, RTC_GPIO_IN_NEXT_S + rtc_io, RTC_GPIO_IN_NEXT_S + rtc_io));
+}
+
+/* release SCL and wait for a stretching slave */
+static void ulp_emit_scl_high(ulp_asm_t* a)
+{
+    ulp_emit_line(a, a->b->i2c_scl, true);
+    ulp_emit_line_read(a, a->b->i2c_scl);
+    ulp_emit(a, (ulp_insn_t) I_BL(-1, 1));
+}
+
+static void ulp_emit_delay(ulp_asm_t* a)
+{
+    ulp_emit(a, (ulp_insn_t) I_DELAY(ULP_I2C_DELAY));
+}
+
+/* one clock pulse with SDA already set */
+static void ulp_emit_clock(ulp_asm_t* a)
+{
+    ulp_emit_delay(a);
+    ulp_emit_scl_high(a);
+    ulp_emit_delay(a);
+    ulp_emit_line(a, a->b->i2c_scl, false);
+}
+
+/*
+ * Subroutines of the bitbang bus, they use R0 and R1 only.
+ * write: R1 holds the byte in the high half and a stop marker at bit 7, the ack is not checked.
+ * read: the byte is returned in R1, the caller sends the ack.
+ * A missing device leaves SDA high and reads as 0xff.
+ */
+static void ulp_emit_i2c_subs(ulp_asm_t* a)
+{
+    const ulp_builder_t* b = a->b;
+    ulp_label_set(a, a->sub_start);
+    ulp_emit_line(a, b->i2c_sda, true);
+    ulp_emit_scl_high(a);
+    ulp_emit_delay(a);
+    ulp_emit_line(a, b->i2c_sda, false);
+    ulp_emit_delay(a);
+    ulp_emit_line(a, b->i2c_scl, false);
+    ulp_emit_ret(a);
+
+    ulp_label_set(a, a->sub_stop);
+    ulp_emit_line(a, b->i2c_sda, false);
+    ulp_emit_delay(a);
+    ulp_emit_scl_high(a);
+    ulp_emit_delay(a);
+    ulp_emit_line(a, b->i2c_sda, true);
+    ulp_emit_delay(a);
+    ulp_emit_ret(a);
+
+    int loop = ulp_label_new(a);
+    int one = ulp_label_new(a);
+    int clk = ulp_label_new(a);
+    int done = ulp_label_new(a);
+    ulp_label_set(a, a->sub_write);
+    ulp_label_set(a, loop);
+    ulp_emit(a, (ulp_insn_t) I_ANDI(R0, R1, 0x8000));
+    ulp_emit_b(a, B_CMP_GE, 1, one);
+    ulp_emit_line(a, b->i2c_sda, false);
+    ulp_emit_jump(a, clk);
+    ulp_label_set(a, one);
+    ulp_emit_line(a, b->i2c_sda, true);
+    ulp_label_set(a, clk);
+    ulp_emit_clock(a);
+    ulp_emit(a, (ulp_insn_t) I_LSHI(R1, R1, 1));
+    // the marker reaches bit 15 after 8 bits
+    ulp_emit(a, (ulp_insn_t) I_SUBI(R0, R1, 0x8000));
+    ulp_emit_bx(a, BX_JUMP_TYPE_ZERO, done);
+    ulp_emit_jump(a, loop);
+    ulp_label_set(a, done);
+    ulp_emit_line(a, b->i2c_sda, true);
+    ulp_emit_clock(a);
+    ulp_emit_ret(a);
+
+    loop = ulp_label_new(a);
+    ulp_label_set(a, a->sub_read);
+    ulp_emit(a, (ulp_insn_t) I_MOVI(R1, 1));
+    ulp_emit_line(a, b->i2c_sda, true);
+    ulp_label_set(a, loop);
+    ulp_emit_delay(a);
+    ulp_emit_scl_high(a);
+    ulp_emit_delay(a);
+    ulp_emit_line_read(a, b->i2c_sda);
+    ulp_emit(a, (ulp_insn_t) I_LSHI(R1, R1, 1));
+    ulp_emit(a, (ulp_insn_t) I_ORR(R1, R1, R0));
+    ulp_emit_line(a, b->i2c_scl, false);
+    // the leading 1 reaches bit 8 after 8 bits
+    ulp_emit(a, (ulp_insn_t) I_MOVR(R0, R1));
+    ulp_emit_b(a, B_CMP_L, 0x100, loop);
+    ulp_emit(a, (ulp_insn_t) I_ANDI(R1, R1, 0xff));
+    ulp_emit_ret(a);
+}
+
+static void ulp_emit_i2c_read(ulp_asm_t* a, const ulp_mon_t* mon)
+{
+    const ulp_builder_t* b = a->b;
+    ulp_emit_call(a, a->sub_start);
+    ulp_emit(a, (ulp_insn_t) I_MOVI(R1, ((mon->i2c_addr << 1) << 8) | 0x80));
+    ulp_emit_call(a, a->sub_write);
+    ulp_emit(a, (ulp_insn_t) I_MOVI(R1, (mon->i2c_reg << 8) | 0x80));
+    ulp_emit_call(a, a->sub_write);
+    ulp_emit_call(a, a->sub_start);
+    ulp_emit(a, (ulp_insn_t) I_MOVI(R1, (((mon->i2c_addr << 1) | 1) << 8) | 0x80));
+    ulp_emit_call(a, a->sub_write);
+    ulp_emit_call(a, a->sub_read);
+    ulp_emit(a, (ulp_insn_t) I_LSHI(R3, R1, 8));
+    // ack the first byte, nack the second one
+    ulp_emit_line(a, b->i2c_sda, false);
+    ulp_emit_clock(a);
+    ulp_emit_call(a, a->sub_read);
+    ulp_emit(a, (ulp_insn_t) I_ORR(R3, R3, R1));
+    ulp_emit_line(a, b->i2c_sda, true);
+    ulp_emit_clock(a);
+    ulp_emit_call(a, a->sub_stop);
+}
+
+/* append the value in R3 to the ring */
+static void ulp_emit_record(ulp_asm_t* a, int id)
+{
+    // the slot is the write counter modulo the capacity
+    ulp_emit(a, (ulp_insn_t) I_LD(R1, R2, ULP_RING_WRITTEN_OFS));
+    ulp_emit(a, (ulp_insn_t) I_ANDI(R1, R1, a->b->capacity - 1));
+    ulp_emit(a, (ulp_insn_t) I_LSHI(R1, R1, 1));
+    ulp_emit(a, (ulp_insn_t) I_ADDR(R1, R1, R2));
+    ulp_emit(a, (ulp_insn_t) I_ST(R3, R1, ULP_RING_HDR_WORDS + 1));
+    ulp_emit(a, (ulp_insn_t) I_LD(R0, R2, ULP_RING_TICK_OFS));
+    ulp_emit(a, (ulp_insn_t) I_LSHI(R0, R0, 4));
+    ulp_emit(a, (ulp_insn_t) I_ORI(R0, R0, id));
+    ulp_emit(a, (ulp_insn_t) I_ST(R0, R1, ULP_RING_HDR_WORDS));
+    // one store of the write counter publishes the record
+    ulp_emit(a, (ulp_insn_t) I_LD(R0, R2, ULP_RING_WRITTEN_OFS));
+    ulp_emit(a, (ulp_insn_t) I_ADDI(R0, R0, 1));
+    ulp_emit(a, (ulp_insn_t) I_ST(R0, R2, ULP_RING_WRITTEN_OFS));
+}
+
+static void ulp_emit_monitor(ulp_asm_t* a, int id)
+{
+    const ulp_mon_t* mon = &a->b->mon[id];
+    int skip = ulp_label_new(a);
+    int next = ulp_label_new(a);
+
+    // sample when the countdown is 0, it restarts from period - 1
+    ulp_emit(a, (ulp_insn_t) I_LD(R0, R2, ULP_RING_CNT_OFS + id));
+    ulp_emit_b(a, B_CMP_GE, 1, skip);
+    ulp_emit(a, (ulp_insn_t) I_MOVI(R0, mon->period - 1));
+    ulp_emit(a, (ulp_insn_t) I_ST(R0, R2, ULP_RING_CNT_OFS + id));
+
+    if (mon->type == ULP_MON_ADC) {
+        ulp_emit(a, (ulp_insn_t) I_ADC(R3, 0, mon->adc_channel));
+    } else if (mon->type == ULP_MON_TSENS) {
+        ulp_emit(a, (ulp_insn_t) I_TSENS(R3, ULP_TSENS_DELAY));
+    } else {
+        ulp_emit_i2c_read(a, mon);
+    }
+    ulp_emit_record(a, id);
+
+    // a borrow of the subtraction means the value is out of range
+    if (mon->high_threshold != 0xffff || mon->low_threshold != 0) {
+        int hit = ulp_label_new(a);
+        ulp_emit(a, (ulp_insn_t) I_MOVI(R0, mon->high_threshold));
+        ulp_emit(a, (ulp_insn_t) I_SUBR(R0, R0, R3));
+        ulp_emit_bx(a, BX_JUMP_TYPE_OVF, hit);
+        ulp_emit(a, (ulp_insn_t) I_MOVI(R0, mon->low_threshold));
+        ulp_emit(a, (ulp_insn_t) I_SUBR(R0, R3, R0));
+        ulp_emit_bx(a, BX_JUMP_TYPE_OVF, hit);
+        ulp_emit_jump(a, next);
+        ulp_label_set(a, hit);
+        ulp_emit(a, (ulp_insn_t) I_MOVI(R0, 1));
+        ulp_emit(a, (ulp_insn_t) I_ST(R0, R2, ULP_RING_WAKE_OFS));
+    }
+    ulp_emit_jump(a, next);
+
+    ulp_label_set(a, skip);
+    ulp_emit(a, (ulp_insn_t) I_SUBI(R0, R0, 1));
+    ulp_emit(a, (ulp_insn_t) I_ST(R0, R2, ULP_RING_CNT_OFS + id));
+    ulp_label_set(a, next);
+}
+
+esp_err_t ulp_builder_init(ulp_builder_t* b, uint16_t program_addr, uint16_t data_addr, uint16_t capacity, uint16_t wake_count)
+{
+    ULP_BUILDER_CHECK(b != NULL, "builder is NULL", ESP_ERR_INVALID_ARG);
+    ULP_BUILDER_CHECK(data_addr > program_addr, "data must follow the program", ESP_ERR_INVALID_ARG);
+    ULP_BUILDER_CHECK(capacity > 0 && capacity <= 0x8000 && (capacity & (capacity - 1)) == 0 && wake_count <= capacity,
+            "capacity error", ESP_ERR_INVALID_ARG);
+    memset(b, 0, sizeof(ulp_builder_t));
+    b->program_addr = program_addr;
+    b->data_addr = data_addr;
+    b->capacity = capacity;
+    b->wake_count = wake_count;
+    b->i2c_scl = -1;
+    b->i2c_sda = -1;
+    return ESP_OK;
+}
+
+esp_err_t ulp_builder_set_i2c(ulp_builder_t* b, int scl_rtc_io, int sda_rtc_io)
+{
+    ULP_BUILDER_CHECK(b != NULL, "builder is NULL", ESP_ERR_INVALID_ARG);
+    ULP_BUILDER_CHECK(scl_rtc_io >= 0 && scl_rtc_io <= ULP_RTC_IO_MAX && sda_rtc_io >= 0 && sda_rtc_io <= ULP_RTC_IO_MAX
+            && scl_rtc_io != sda_rtc_io, "RTC IO error", ESP_ERR_INVALID_ARG);
+    b->i2c_scl = scl_rtc_io;
+    b->i2c_sda = sda_rtc_io;
+    return ESP_OK;
+}
+
+int ulp_builder_add(ulp_builder_t* b, const ulp_mon_t* mon)
+{
+    ULP_BUILDER_CHECK(b != NULL && mon != NULL, "monitor is NULL", -1);
+    ULP_BUILDER_CHECK(b->mon_num < ULP_MON_NUM_MAX, "too many monitors", -1);
+    ULP_BUILDER_CHECK(mon->period > 0, "period error", -1);
+    ULP_BUILDER_CHECK(mon->low_threshold <= mon->high_threshold, "threshold error", -1);
+    ULP_BUILDER_CHECK(mon->type != ULP_MON_I2C || (b->i2c_scl >= 0 && mon->i2c_addr < 0x80), "I2C monitor error", -1);
+    ULP_BUILDER_CHECK(mon->type != ULP_MON_ADC || mon->adc_channel < 8, "ADC channel error", -1);
+    b->mon[b->mon_num] = *mon;
+    return b->mon_num++;
+}
+
+esp_err_t ulp_builder_build(const ulp_builder_t* b, ulp_insn_t* prog, size_t* len)
+{
+    ULP_BUILDER_CHECK(b != NULL && prog != NULL && len != NULL, "parameter is NULL", ESP_ERR_INVALID_ARG);
+    ulp_asm_t* a = (ulp_asm_t*) calloc(1, sizeof(ulp_asm_t));
+    ULP_BUILDER_CHECK(a != NULL, "no memory for the builder", ESP_ERR_NO_MEM);
+    a->b = b;
+    a->prog = prog;
+    a->max = *len;
+
+    bool i2c = false;
+    for (int i = 0; i < b->mon_num; i++) {
+        i2c |= b->mon[i].type == ULP_MON_I2C;
+    }
+    if (i2c) {
+        a->sub_start = ulp_label_new(a);
+        a->sub_stop = ulp_label_new(a);
+        a->sub_write = ulp_label_new(a);
+        a->sub_read = ulp_label_new(a);
+    }
+
+    ulp_emit(a, (ulp_insn_t) I_MOVI(R2, b->data_addr));
+    ulp_emit(a, (ulp_insn_t) I_LD(R0, R2, ULP_RING_TICK_OFS));
+    ulp_emit(a, (ulp_insn_t) I_ADDI(R0, R0, 1));
+    ulp_emit(a, (ulp_insn_t) I_ANDI(R0, R0, 0xfff));
+    ulp_emit(a, (ulp_insn_t) I_ST(R0, R2, ULP_RING_TICK_OFS));
+    for (int i = 0; i < b->mon_num; i++) {
+        ulp_emit_monitor(a, i);
+    }
+
+    int wake = ulp_label_new(a);
+    ulp_emit(a, (ulp_insn_t) I_LD(R0, R2, ULP_RING_WAKE_OFS));
+    ulp_emit_b(a, B_CMP_GE, 1, wake);
+    if (b->wake_count) {
+        ulp_emit(a, (ulp_insn_t) I_LD(R0, R2, ULP_RING_WRITTEN_OFS));
+        ulp_emit(a, (ulp_insn_t) I_LD(R1, R2, ULP_RING_READ_OFS));
+        ulp_emit(a, (ulp_insn_t) I_SUBR(R0, R0, R1));
+        ulp_emit_b(a, B_CMP_GE, b->wake_count, wake);
+    }
+    ulp_emit(a, (ulp_insn_t) I_HALT());
+    ulp_label_set(a, wake);
+    ulp_emit(a, (ulp_insn_t) I_MOVI(R0, 0));
+    ulp_emit(a, (ulp_insn_t) I_ST(R0, R2, ULP_RING_WAKE_OFS));
+    ulp_emit(a, (ulp_insn_t) I_WAKE());
+    ulp_emit(a, (ulp_insn_t) I_HALT());
+    if (i2c) {
+        ulp_emit_i2c_subs(a);
+    }
+
+    esp_err_t ret = ESP_OK;
+    if (a->err || b->program_addr + a->len > b->data_addr) {
+        ESP_LOGE(TAG, "program is too long: %d instructions", a->len);
+        ret = ESP_ERR_INVALID_SIZE;
+    } else if (!ulp_fix_resolve(a)) {
+        ret = ESP_FAIL;
+    } else {
+        *len = a->len;
+        ESP_LOGI(TAG, "program of %d monitors: %d instructions", b->mon_num, a->len);
+    }
+    free(a);
+    return ret;
+}
+
+size_t ulp_builder_data_words(const ulp_builder_t* b)
+{
+    return ULP_RING_HDR_WORDS + b->capacity * ULP_RING_REC_WORDS;
+}
+
+void ulp_ring_init(volatile uint32_t* mem, const ulp_builder_t* b)
+{
+    volatile uint32_t* hdr = mem + b->data_addr;
+    for (size_t i = 0; i < ulp_builder_data_words(b); i++) {
+        hdr[i] = 0;
+    }
+    hdr[ULP_RING_CAP_OFS] = b->capacity;
+    hdr[ULP_RING_MAGIC_OFS] = ULP_RING_MAGIC;
+}
+
+static uint16_t ulp_ring_word(volatile uint32_t* hdr, int ofs)
+{
+    // the ULP keeps its PC in the upper half of a stored word
+    return hdr[ofs] & 0xffff;
+}
+
+int ulp_ring_read(volatile uint32_t* mem, uint16_t data_addr, ulp_record_t* rec, int max, uint16_t* lost)
+{
+    volatile uint32_t* hdr = mem + data_addr;
+    ULP_BUILDER_CHECK(rec != NULL && max >= 0, "parameter error", -1);
+    ULP_BUILDER_CHECK(ulp_ring_word(hdr, ULP_RING_MAGIC_OFS) == ULP_RING_MAGIC, "ring not initialized", -1);
+    uint16_t cap = ulp_ring_word(hdr, ULP_RING_CAP_OFS);
+    uint16_t read = ulp_ring_word(hdr, ULP_RING_READ_OFS);
+    // a record is published by one store of the counter, its slot follows from the count alone
+    uint16_t written = ulp_ring_word(hdr, ULP_RING_WRITTEN_OFS);
+    uint16_t unread = written - read;
+    uint16_t drop = 0;
+    if (unread > cap) {
+        drop = unread - cap;
+        unread = cap;
+    }
+    int num = unread < max ? unread : max;
+    uint16_t slot = (uint16_t) (written - unread) & (cap - 1);
+    for (int i = 0; i < num; i++) {
+        volatile uint32_t* r = hdr + ULP_RING_HDR_WORDS + slot * ULP_RING_REC_WORDS;
+        rec[i].id = r[0] & 0xf;
+        rec[i].tick = (r[0] & 0xffff) >> 4;
+        rec[i].value = r[1] & 0xffff;
+        slot = (slot + 1) & (cap - 1);
+    }
+    // records written meanwhile may have overwritten the oldest ones taken
+    uint16_t more = ulp_ring_word(hdr, ULP_RING_WRITTEN_OFS) - written;
+    int over = more > cap - unread ? more - (cap - unread) : 0;
+    if (over > num) {
+        over = num;
+    }
+    if (over > 0) {
+        memmove(rec, rec + over, (num - over) * sizeof(ulp_record_t));
+        num -= over;
+        drop += over;
+    }
+    hdr[ULP_RING_READ_OFS] = (uint16_t) (written - unread + num + over);
+    if (lost) {
+        *lost = drop;
+    }
+    return num;
+}
@@ -37,6 +37,29 @@ static const char* TAG = "ulp_monitor";
 static ulp_insn_t g_program[ULP_PROGRAM_SIZE];
 static uint16_t g_program_len, g_program_addr, g_data_addr;
 
+static void ulp_adc_setup()
+{
+    CLEAR_PERI_REG_MASK(SENS_SAR_MEAS_START1_REG, SENS_SAR1_EN_PAD_FORCE);
+    CLEAR_PERI_REG_MASK(SENS_SAR_MEAS_START2_REG, SENS_SAR2_EN_PAD_FORCE);
+    SET_PERI_REG_BITS(SENS_SAR_MEAS_WAIT2_REG, SENS_FORCE_XPD_AMP_V, 0x2, SENS_FORCE_XPD_AMP_S);
+    CLEAR_PERI_REG_MASK(SENS_SAR_MEAS_START1_REG, SENS_MEAS1_START_FORCE);
+    SET_PERI_REG_BITS(SENS_SAR_MEAS_WAIT2_REG, SENS_FORCE_XPD_SAR_V, 3, SENS_FORCE_XPD_SAR_S);
+    CLEAR_PERI_REG_MASK(SENS_SAR_MEAS_START1_REG, SENS_SAR1_EN_PAD_FORCE);
+    CLEAR_PERI_REG_MASK(SENS_SAR_START_FORCE_REG, SENS_ULP_CP_START_TOP);
+    CLEAR_PERI_REG_MASK(SENS_SAR_START_FORCE_REG, SENS_ULP_CP_FORCE_START_TOP);
+    SET_PERI_REG_MASK(SENS_SAR_READ_CTRL_REG, SENS_SAR1_DATA_INV);
+    SET_PERI_REG_MASK(SENS_SAR_READ_CTRL2_REG, SENS_SAR2_DATA_INV);
+}
+
+static void ulp_tsens_setup()
+{
+    SET_PERI_REG_BITS(SENS_SAR_TSENS_CTRL_REG, SENS_TSENS_CLK_DIV_V, 2, SENS_TSENS_CLK_DIV_S);
+    SET_PERI_REG_BITS(SENS_SAR_MEAS_WAIT2_REG, SENS_FORCE_XPD_SAR_V, 3, SENS_FORCE_XPD_SAR_S);
+    CLEAR_PERI_REG_MASK(SENS_SAR_TSENS_CTRL_REG, SENS_TSENS_POWER_UP);
+    CLEAR_PERI_REG_MASK(SENS_SAR_TSENS_CTRL_REG, SENS_TSENS_DUMP_OUT);
+    CLEAR_PERI_REG_MASK(SENS_SAR_TSENS_CTRL_REG, SENS_TSENS_POWER_UP_FORCE);
+}
+
 static esp_err_t ulp_add_subprogram(const ulp_insn_t sub_program[], size_t sub_program_size)
 {
     if ((g_program_len + sub_program_size/sizeof(ulp_insn_t)) > ULP_PROGRAM_SIZE) {
@@ -126,16 +149,7 @@ esp_err_t iot_ulp_add_adc_monitor(adc1_channel_t adc_chn, int16_t low_threshold,
         return ESP_FAIL;
     }
 
-    CLEAR_PERI_REG_MASK(SENS_SAR_MEAS_START1_REG, SENS_SAR1_EN_PAD_FORCE);
-    CLEAR_PERI_REG_MASK(SENS_SAR_MEAS_START2_REG, SENS_SAR2_EN_PAD_FORCE);
-    SET_PERI_REG_BITS(SENS_SAR_MEAS_WAIT2_REG, SENS_FORCE_XPD_AMP_V, 0x2, SENS_FORCE_XPD_AMP_S);
-    CLEAR_PERI_REG_MASK(SENS_SAR_MEAS_START1_REG, SENS_MEAS1_START_FORCE);
-    SET_PERI_REG_BITS(SENS_SAR_MEAS_WAIT2_REG, SENS_FORCE_XPD_SAR_V, 3, SENS_FORCE_XPD_SAR_S);
-    CLEAR_PERI_REG_MASK(SENS_SAR_MEAS_START1_REG, SENS_SAR1_EN_PAD_FORCE);
-    CLEAR_PERI_REG_MASK(SENS_SAR_START_FORCE_REG, SENS_ULP_CP_START_TOP);
-    CLEAR_PERI_REG_MASK(SENS_SAR_START_FORCE_REG, SENS_ULP_CP_FORCE_START_TOP);
-    SET_PERI_REG_MASK(SENS_SAR_READ_CTRL_REG, SENS_SAR1_DATA_INV);
-    SET_PERI_REG_MASK(SENS_SAR_READ_CTRL2_REG, SENS_SAR2_DATA_INV);
+    ulp_adc_setup();
     iot_ulp_data_write(g_data_addr + data_offset + data_num, data_num);
     iot_ulp_data_write(g_data_addr + data_offset + data_num + 1, 0);
     ERR_ASSERT(TAG, ulp_add_monitor_program((ulp_insn_t)I_ADC(R3, 0, adc_chn), low_threshold, high_threshold, data_offset, data_num, num_max_wake)); 
@@ -148,11 +162,7 @@ esp_err_t iot_ulp_add_temprature_monitor(int16_t low_threshold, int16_t high_thr
         ESP_LOGE(TAG, "data_offset or data_num is to large");
         return ESP_FAIL;
     }
-    SET_PERI_REG_BITS(SENS_SAR_TSENS_CTRL_REG, SENS_TSENS_CLK_DIV_V, 2, SENS_TSENS_CLK_DIV_S);
-    SET_PERI_REG_BITS(SENS_SAR_MEAS_WAIT2_REG, SENS_FORCE_XPD_SAR_V, 3, SENS_FORCE_XPD_SAR_S);
-    CLEAR_PERI_REG_MASK(SENS_SAR_TSENS_CTRL_REG, SENS_TSENS_POWER_UP);
-    CLEAR_PERI_REG_MASK(SENS_SAR_TSENS_CTRL_REG, SENS_TSENS_DUMP_OUT);
-    CLEAR_PERI_REG_MASK(SENS_SAR_TSENS_CTRL_REG, SENS_TSENS_POWER_UP_FORCE);
+    ulp_tsens_setup();
     iot_ulp_data_write(g_data_addr + data_offset + data_num, data_num);
     iot_ulp_data_write(g_data_addr + data_offset + data_num + 1, 0);
     ERR_ASSERT(TAG, ulp_add_monitor_program((ulp_insn_t)I_TSENS(R3, 8000), low_threshold, high_threshold, data_offset, data_num, num_max_wake));
@@ -178,6 +188,60 @@ esp_err_t iot_ulp_monitor_start(uint32_t meas_per_hour)
     return ESP_OK;
 }
 
+esp_err_t iot_ulp_builder_set_i2c(ulp_builder_t* b, gpio_num_t scl_io, gpio_num_t sda_io)
+{
+    IOT_CHECK(TAG, b != NULL, ESP_ERR_INVALID_ARG);
+    IOT_CHECK(TAG, rtc_gpio_is_valid_gpio(scl_io) && rtc_gpio_is_valid_gpio(sda_io), ESP_ERR_INVALID_ARG);
+    // the output holds 0, the program drives a line low by enabling it
+    gpio_num_t io[] = { scl_io, sda_io };
+    for (int i = 0; i < 2; i++) {
+        rtc_gpio_init(io[i]);
+        rtc_gpio_set_level(io[i], 0);
+        rtc_gpio_set_direction(io[i], RTC_GPIO_MODE_INPUT_ONLY);
+        rtc_gpio_pullup_en(io[i]);
+    }
+    return ulp_builder_set_i2c(b, rtc_gpio_desc[scl_io].rtc_num, rtc_gpio_desc[sda_io].rtc_num);
+}
+
+esp_err_t iot_ulp_program_start(const ulp_builder_t* b, uint32_t meas_per_hour)
+{
+    IOT_CHECK(TAG, b != NULL && meas_per_hour != 0, ESP_ERR_INVALID_ARG);
+    if (b->data_addr + ulp_builder_data_words(b) > ULP_DATA_ADDR_LIMI) {
+        ESP_LOGE(TAG, "ring capacity is too large");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    bool adc = false, tsens = false;
+    for (int i = 0; i < b->mon_num; i++) {
+        adc |= b->mon[i].type == ULP_MON_ADC;
+        tsens |= b->mon[i].type == ULP_MON_TSENS;
+    }
+    if (adc) {
+        ulp_adc_setup();
+    }
+    if (tsens) {
+        ulp_tsens_setup();
+    }
+    size_t size = ULP_PROGRAM_SIZE;
+    esp_err_t ret = ulp_builder_build(b, g_program, &size);
+    IOT_CHECK(TAG, ret == ESP_OK, ret);
+    ulp_ring_init(RTC_SLOW_MEM, b);
+    esp_sleep_enable_ulp_wakeup();
+    ERR_ASSERT(TAG, ulp_process_macros_and_load(b->program_addr, g_program, &size));
+    const uint32_t sleep_cycles = rtc_clk_slow_freq_get_hz() * 3600 / meas_per_hour;
+    REG_WRITE(SENS_ULP_CP_SLEEP_CYC0_REG, sleep_cycles);
+    ERR_ASSERT(TAG, ulp_run(b->program_addr));
+    return ESP_OK;
+}
+
+int iot_ulp_ring_read(uint16_t data_addr, ulp_record_t* rec, int max, uint16_t* lost)
+{
+    if (data_addr >= ULP_DATA_ADDR_LIMI) {
+        ESP_LOGE(TAG, "ulp ring address is too large");
+        return -1;
+    }
+    return ulp_ring_read(RTC_SLOW_MEM, data_addr, rec, max, lost);
+}
+
 uint16_t iot_ulp_data_read(size_t addr)
 {
     if (addr >= ULP_DATA_ADDR_LIMI) {
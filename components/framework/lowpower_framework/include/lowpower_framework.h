@@ -20,6 +20,7 @@ extern "C" {
 #endif
 
 #include "esp_err.h"
+#include "lowpower_stage.h"
 
 /**
   * @brief start lowpower application framework.
@@ -40,6 +41,27 @@ typedef enum {
     LPFCB_START_DEEP_SLEEP,          /*!<set wakeup cause and start deepsleep*/
 } lowpower_framework_cb_t;
 
+#define LPF_DEPEND(cb_type)     (1UL << (cb_type))   /*!<prerequisite bit of a callback, for lowpower_framework_set_depends*/
+
+/**
+  * @brief timing of a callback stage, the stages run once per wake up
+  */
+typedef struct {
+    lp_stage_state_t state;         /*!<state in the last wake up*/
+    uint32_t start_ms;              /*!<start time in the last wake up, from boot*/
+    uint32_t time_ms;               /*!<run time in the last wake up*/
+    uint32_t avg_ms;                /*!<running average of the run time*/
+} lowpower_stage_stat_t;
+
+/**
+  * @brief timing of the wake ups, kept in RTC memory across deep sleep
+  */
+typedef struct {
+    uint32_t cycles;                /*!<wake ups since power on*/
+    uint32_t awake_ms;              /*!<time from boot to the deep sleep callback in the last wake up*/
+    lowpower_stage_stat_t stage[LPFCB_START_DEEP_SLEEP];
+} lowpower_framework_stat_t;
+
 /**
   * @brief register callback
   *
@@ -52,6 +74,32 @@ typedef enum {
   */
 esp_err_t lowpower_framework_register_callback(lowpower_framework_cb_t cb_type, void *cb_func);
 
+/**
+  * @brief set the prerequisites of a callback, it runs as soon as they succeed and is skipped if one fails.
+  *        Callbacks without prerequisites in common run at the same time, in different tasks.
+  *        By default wifi connect runs alongside the ULP and CPU data callbacks, and the upload waits for both.
+  *        The deep sleep callback always runs last.
+  *
+  * @param cb_type callback type, except LPFCB_START_DEEP_SLEEP.
+  * @param depends LPF_DEPEND() of the prerequisite callbacks, or 0.
+  *
+  * @return
+  *     - ESP_OK success
+  *     - ESP_ERR_INVALID_ARG invalid callback type or prerequisites
+  */
+esp_err_t lowpower_framework_set_depends(lowpower_framework_cb_t cb_type, uint32_t depends);
+
+/**
+  * @brief get the stage timing of the last wake ups
+  *
+  * @param stat timing of the wake ups
+  *
+  * @return
+  *     - ESP_OK success
+  *     - ESP_ERR_INVALID_ARG stat is NULL
+  */
+esp_err_t lowpower_framework_get_stat(lowpower_framework_stat_t* stat);
+
 #ifdef __cplusplus
 }
 #endif
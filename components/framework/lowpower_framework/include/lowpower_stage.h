@@ -0,0 +1,79 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _IOT_LOWPOWER_STAGE_H_
+#define _IOT_LOWPOWER_STAGE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define LP_STAGE_NUM_MAX        (16)
+#define LP_STAGE_BIT(id)        (1UL << (id))
+
+typedef esp_err_t (*lp_stage_func_t)(void* arg);
+
+/**
+  * @brief state of a stage after lp_stage_run
+  */
+typedef enum {
+    LP_STAGE_WAIT = 0,      /*!<not started*/
+    LP_STAGE_RUN,           /*!<running*/
+    LP_STAGE_DONE,          /*!<returned ESP_OK*/
+    LP_STAGE_FAIL,          /*!<returned an error*/
+    LP_STAGE_SKIP,          /*!<not run because a prerequisite did not succeed*/
+} lp_stage_state_t;
+
+/**
+  * @brief stage of a dependency graph, its index in the stage array is its id
+  */
+typedef struct {
+    const char* name;
+    lp_stage_func_t func;       /*!<stage function, NULL for a stage that succeeds at once*/
+    void* arg;
+    uint32_t depends;           /*!<LP_STAGE_BIT of the stages to succeed first*/
+} lp_stage_t;
+
+typedef struct {
+    lp_stage_state_t state;
+    uint32_t start_ms;          /*!<start time, from the start of the graph*/
+    uint32_t time_ms;           /*!<run time*/
+} lp_stage_result_t;
+
+/**
+  * @brief run a dependency graph of stages, every stage starts as soon as its prerequisites succeed
+  *
+  * @param stage stage array
+  * @param num number of stages
+  * @param worker_num number of tasks to run stages at the same time
+  * @param stack_size stack size of the tasks
+  * @param result result of each stage, num elements
+  *
+  * @return
+  *     - ESP_OK all stages succeeded
+  *     - ESP_FAIL a stage failed or was skipped
+  *     - ESP_ERR_INVALID_ARG a parameter is invalid
+  *     - ESP_ERR_INVALID_STATE the dependencies have a cycle, the stages in it are skipped
+  *     - ESP_ERR_NO_MEM no memory for the tasks
+  */
+esp_err_t lp_stage_run(const lp_stage_t* stage, int num, int worker_num, uint32_t stack_size, lp_stage_result_t* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
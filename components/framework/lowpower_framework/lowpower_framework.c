@@ -14,8 +14,12 @@
 
 #include <string.h>
 #include "esp_system.h"
+#include "esp_sleep.h"
+#include "esp_attr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "lowpower_framework.h"
+#include "lowpower_stage.h"
 
 static const char* TAG = "lowpower_framework";
 #define GOTO_EXIT_IF_FAIL(FUNC, LOG, EXIT)  if(FUNC != ESP_OK) {    \
@@ -23,6 +27,11 @@ static const char* TAG = "lowpower_framework";
                                                 goto EXIT;          \
                                             }
 
+#define LPF_STAGE_NUM           (LPFCB_START_DEEP_SLEEP)
+#define LPF_STAGE_WORKER_NUM    (3)
+#define LPF_STAGE_TASK_STACK    (4096)
+#define LPF_AVG_WEIGHT          (8)
+
 typedef esp_err_t (*callback_without_param_t)(void);
 
 typedef struct {
@@ -38,6 +47,24 @@ typedef struct {
 
 static lowpower_frm_cb_t lowpower_framework_cb;
 
+/* network bring-up overlaps the sensor stages, the upload waits for both */
+static uint32_t lowpower_framework_depends[LPF_STAGE_NUM] = {
+    [LPFCB_DEVICE_INIT]         = 0,
+    [LPFCB_WIFI_CONNECT]        = LPF_DEPEND(LPFCB_DEVICE_INIT),
+    [LPFCB_GET_DATA_BY_CPU]     = LPF_DEPEND(LPFCB_ULP_PROGRAM_INIT),
+    [LPFCB_ULP_PROGRAM_INIT]    = LPF_DEPEND(LPFCB_DEVICE_INIT),
+    [LPFCB_GET_DATA_FROM_ULP]   = LPF_DEPEND(LPFCB_DEVICE_INIT),
+    [LPFCB_SEND_DATA_TO_SERVER] = LPF_DEPEND(LPFCB_WIFI_CONNECT) | LPF_DEPEND(LPFCB_GET_DATA_BY_CPU) | LPF_DEPEND(LPFCB_GET_DATA_FROM_ULP),
+    [LPFCB_SEND_DATA_DONE]      = LPF_DEPEND(LPFCB_SEND_DATA_TO_SERVER),
+};
+
+static const char* lowpower_framework_stage_name[LPF_STAGE_NUM] = {
+    "device init", "wifi connect", "cpu data", "ulp init", "ulp data", "upload", "upload done",
+};
+
+/* kept in RTC memory across deep sleep */
+static RTC_DATA_ATTR lowpower_framework_stat_t lowpower_framework_stat;
+
 esp_err_t lowpower_framework_register_callback(lowpower_framework_cb_t cb_type, void *cb_func)
 {
     switch (cb_type) {
@@ -81,75 +108,96 @@ static esp_err_t _check_and_run_callback(callback_without_param_t func)
     return ESP_OK;
 }
 
-static esp_err_t fw_device_init()
-{
-    return _check_and_run_callback(lowpower_framework_cb.init);
-}
-
-static esp_err_t fw_network_connect()
-{
-    return _check_and_run_callback(lowpower_framework_cb.network_connect);
-}
-
-static esp_err_t fw_upload_data_to_server()
+static esp_err_t fw_enter_deep_sleep()
 {
-    return _check_and_run_callback(lowpower_framework_cb.upload);
+    return _check_and_run_callback(lowpower_framework_cb.enter_deep_sleep);
 }
 
-static esp_err_t fw_upload_data_to_server_done()
+esp_err_t lowpower_framework_set_depends(lowpower_framework_cb_t cb_type, uint32_t depends)
 {
-    return _check_and_run_callback(lowpower_framework_cb.upload_done);
-}
-
-static esp_err_t fw_enter_deep_sleep()
-{
-    return _check_and_run_callback(lowpower_framework_cb.enter_deep_sleep);
+    if (cb_type >= LPF_STAGE_NUM || (depends & LPF_DEPEND(cb_type)) || (depends >> LPF_STAGE_NUM)) {
+        ESP_LOGE(TAG, "stage %d can not depend on 0x%x", cb_type, depends);
+        return ESP_ERR_INVALID_ARG;
+    }
+    lowpower_framework_depends[cb_type] = depends;
+    return ESP_OK;
 }
 
-static esp_err_t fw_read_ulp_data_from_rtc_memory()
+esp_err_t lowpower_framework_get_stat(lowpower_framework_stat_t* stat)
 {
-    return _check_and_run_callback(lowpower_framework_cb.get_ulp_data);
+    if (stat == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(stat, &lowpower_framework_stat, sizeof(lowpower_framework_stat_t));
+    return ESP_OK;
 }
 
-static esp_err_t fw_ulp_coprocessor_init()
+static esp_err_t fw_run_stage(void* arg)
 {
-    return _check_and_run_callback(lowpower_framework_cb.ulp_cp_init);
+    return _check_and_run_callback((callback_without_param_t) arg);
 }
 
-static esp_err_t fw_collect_data_by_cpu()
+static void fw_update_stat(const lp_stage_result_t* result, uint32_t graph_start_ms)
 {
-    return _check_and_run_callback(lowpower_framework_cb.collect_data);
+    lowpower_framework_stat_t* stat = &lowpower_framework_stat;
+    stat->cycles++;
+    stat->awake_ms = esp_timer_get_time() / 1000;
+    for (int i = 0; i < LPF_STAGE_NUM; i++) {
+        lowpower_stage_stat_t* stage = &stat->stage[i];
+        stage->state = result[i].state;
+        stage->start_ms = graph_start_ms + result[i].start_ms;
+        stage->time_ms = result[i].time_ms;
+        if (result[i].state == LP_STAGE_DONE || result[i].state == LP_STAGE_FAIL) {
+            stage->avg_ms = stage->avg_ms ? (stage->avg_ms * (LPF_AVG_WEIGHT - 1) + stage->time_ms) / LPF_AVG_WEIGHT : stage->time_ms;
+        }
+        ESP_LOGD(TAG, "%-12s state:%d start:%dms time:%dms avg:%dms", lowpower_framework_stage_name[i],
+                 stage->state, stage->start_ms, stage->time_ms, stage->avg_ms);
+    }
+    ESP_LOGI(TAG, "cycle %d awake:%dms", stat->cycles, stat->awake_ms);
 }
 
 void lowpower_framework_start(void)
 {
-    GOTO_EXIT_IF_FAIL(fw_device_init(), "Board init error", EXIT_PORT_DEEP_SLEEP);
-    GOTO_EXIT_IF_FAIL(fw_network_connect(), "Board network error", EXIT_PORT_DEEP_SLEEP);
-
     esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
     ESP_LOGI(TAG, "wake up cause:%d", cause);
 
+    callback_without_param_t func[LPF_STAGE_NUM] = {
+        [LPFCB_DEVICE_INIT]         = lowpower_framework_cb.init,
+        [LPFCB_WIFI_CONNECT]        = lowpower_framework_cb.network_connect,
+        [LPFCB_SEND_DATA_TO_SERVER] = lowpower_framework_cb.upload,
+        [LPFCB_SEND_DATA_DONE]      = lowpower_framework_cb.upload_done,
+    };
     if (cause == ESP_SLEEP_WAKEUP_ULP) {
         /* If wakeup cause is ULP wakeup, we will read data from ULP. */
-        GOTO_EXIT_IF_FAIL(fw_read_ulp_data_from_rtc_memory(), "Board read ulp data error", EXIT_PORT_DEEP_SLEEP);
+        func[LPFCB_GET_DATA_FROM_ULP] = lowpower_framework_cb.get_ulp_data;
     } else {
         ESP_LOGI(TAG, "Not ULP wakeup");
-        GOTO_EXIT_IF_FAIL(fw_ulp_coprocessor_init(), "Board ulp coprocessor init error", EXIT_PORT_DEEP_SLEEP);
-
-        /* If wakeup cause is not defined, we should go to start deep sleep callback, */
-        /* which will define wakeup cause and start deepsleep. */
+        func[LPFCB_ULP_PROGRAM_INIT] = lowpower_framework_cb.ulp_cp_init;
+        /* If wakeup cause is not defined, there is no data to upload, the deep sleep callback */
+        /* defines the wakeup cause. Otherwise we use cpu to read sensor data. */
         if (cause == ESP_SLEEP_WAKEUP_UNDEFINED) {
-            goto EXIT_PORT_DEEP_SLEEP;
+            func[LPFCB_SEND_DATA_TO_SERVER] = NULL;
+            func[LPFCB_SEND_DATA_DONE] = NULL;
+        } else {
+            func[LPFCB_GET_DATA_BY_CPU] = lowpower_framework_cb.collect_data;
         }
-
-        /* If wakeup cause is defined but not ULP wakeup, we will use cpu to read sensor data. */
-        GOTO_EXIT_IF_FAIL(fw_collect_data_by_cpu(), "Board collect data by CPU error", EXIT_PORT_DEEP_SLEEP);
     }
 
-    GOTO_EXIT_IF_FAIL(fw_upload_data_to_server(), "Board upload data error", EXIT_PORT_DEEP_SLEEP);
-    GOTO_EXIT_IF_FAIL(fw_upload_data_to_server_done(), "Board upload data done error", EXIT_PORT_DEEP_SLEEP);
+    /* stages without a callback succeed at once, so their dependents go on */
+    lp_stage_t stage[LPF_STAGE_NUM];
+    for (int i = 0; i < LPF_STAGE_NUM; i++) {
+        stage[i].name = lowpower_framework_stage_name[i];
+        stage[i].func = func[i] ? fw_run_stage : NULL;
+        stage[i].arg = func[i];
+        stage[i].depends = lowpower_framework_depends[i];
+    }
+    lp_stage_result_t result[LPF_STAGE_NUM];
+    uint32_t start_ms = esp_timer_get_time() / 1000;
+    if (lp_stage_run(stage, LPF_STAGE_NUM, LPF_STAGE_WORKER_NUM, LPF_STAGE_TASK_STACK, result) != ESP_OK) {
+        ESP_LOGE(TAG, "Board wake up stages error");
+    }
+    fw_update_stat(result, start_ms);
 
 EXIT_PORT_DEEP_SLEEP:
     GOTO_EXIT_IF_FAIL(fw_enter_deep_sleep(), "Board enter deep sleep error", EXIT_PORT_DEEP_SLEEP);
 }
-
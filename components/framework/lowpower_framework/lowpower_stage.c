@@ -0,0 +1,184 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lowpower_stage.h"
+
+static const char* TAG = "lowpower_stage";
+#define LP_STAGE_CHECK(a, str, ret)  if(!(a)) {                             \
+        ESP_LOGE(TAG,"%s:%d (%s):%s", __FILE__, __LINE__, __FUNCTION__, str); \
+        return (ret);                                                       \
+        }
+
+#define LP_STAGE_EXIT           (-1)
+#define LP_STAGE_TASK_PRIO      (5)
+
+typedef struct {
+    const lp_stage_t* stage;
+    lp_stage_result_t* result;
+    QueueHandle_t work;         /* stage ids to run, LP_STAGE_EXIT stops a worker */
+    QueueHandle_t done;         /* stage ids that ended, LP_STAGE_EXIT when a worker stops */
+    int64_t start_us;
+} lp_stage_ctx_t;
+
+static uint32_t lp_stage_ms(const lp_stage_ctx_t* ctx)
+{
+    return (esp_timer_get_time() - ctx->start_us) / 1000;
+}
+
+static void lp_stage_worker(void* arg)
+{
+    lp_stage_ctx_t* ctx = (lp_stage_ctx_t*) arg;
+    int id;
+    while (xQueueReceive(ctx->work, &id, portMAX_DELAY) == pdTRUE && id != LP_STAGE_EXIT) {
+        const lp_stage_t* stage = &ctx->stage[id];
+        lp_stage_result_t* result = &ctx->result[id];
+        result->start_ms = lp_stage_ms(ctx);
+        esp_err_t ret = stage->func(stage->arg);
+        result->time_ms = lp_stage_ms(ctx) - result->start_ms;
+        result->state = ret == ESP_OK ? LP_STAGE_DONE : LP_STAGE_FAIL;
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "stage %s error: %d", stage->name ? stage->name : "", ret);
+        }
+        xQueueSend(ctx->done, &id, portMAX_DELAY);
+    }
+    id = LP_STAGE_EXIT;
+    xQueueSend(ctx->done, &id, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+/* start every stage whose prerequisites ended, returns the number of stages sent to the workers */
+static int lp_stage_dispatch(lp_stage_ctx_t* ctx, int num, uint32_t* ended, uint32_t* succeeded, uint32_t* started)
+{
+    int sent = 0;
+    bool changed;
+    do {
+        changed = false;
+        for (int i = 0; i < num; i++) {
+            const lp_stage_t* stage = &ctx->stage[i];
+            if ((*started & LP_STAGE_BIT(i)) || (stage->depends & ~*ended)) {
+                continue;
+            }
+            *started |= LP_STAGE_BIT(i);
+            if (stage->depends & ~*succeeded) {
+                ctx->result[i].state = LP_STAGE_SKIP;
+                *ended |= LP_STAGE_BIT(i);
+                changed = true;
+            } else if (stage->func == NULL) {
+                ctx->result[i].state = LP_STAGE_DONE;
+                ctx->result[i].start_ms = lp_stage_ms(ctx);
+                *ended |= LP_STAGE_BIT(i);
+                *succeeded |= LP_STAGE_BIT(i);
+                changed = true;
+            } else {
+                ctx->result[i].state = LP_STAGE_RUN;
+                xQueueSend(ctx->work, &i, portMAX_DELAY);
+                sent++;
+            }
+        }
+    } while (changed);
+    return sent;
+}
+
+esp_err_t lp_stage_run(const lp_stage_t* stage, int num, int worker_num, uint32_t stack_size, lp_stage_result_t* result)
+{
+    LP_STAGE_CHECK(stage != NULL && result != NULL, "parameter is NULL", ESP_ERR_INVALID_ARG);
+    LP_STAGE_CHECK(num > 0 && num <= LP_STAGE_NUM_MAX && worker_num > 0, "stage or worker number error", ESP_ERR_INVALID_ARG);
+    const uint32_t all = LP_STAGE_BIT(num) - 1;
+    for (int i = 0; i < num; i++) {
+        LP_STAGE_CHECK((stage[i].depends & ~all) == 0, "depends on a stage that does not exist", ESP_ERR_INVALID_ARG);
+    }
+
+    lp_stage_ctx_t ctx = {
+        .stage = stage,
+        .result = result,
+        .start_us = esp_timer_get_time(),
+    };
+    ctx.work = xQueueCreate(num + worker_num, sizeof(int));
+    ctx.done = xQueueCreate(num + worker_num, sizeof(int));
+    if (ctx.work == NULL || ctx.done == NULL) {
+        ESP_LOGE(TAG, "no memory for the queues");
+        goto EXIT_NO_MEM;
+    }
+    int workers = 0;
+    for (; workers < worker_num && workers < num; workers++) {
+        if (xTaskCreate(lp_stage_worker, "lp_stage", stack_size, &ctx, LP_STAGE_TASK_PRIO, NULL) != pdPASS) {
+            break;
+        }
+    }
+    if (workers == 0) {
+        ESP_LOGE(TAG, "no memory for the workers");
+        goto EXIT_NO_MEM;
+    }
+
+    memset(result, 0, num * sizeof(lp_stage_result_t));
+    uint32_t ended = 0, succeeded = 0, started = 0;
+    int running = 0;
+    esp_err_t ret = ESP_OK;
+    while (ended != all) {
+        running += lp_stage_dispatch(&ctx, num, &ended, &succeeded, &started);
+        if (running == 0) {
+            if (ended != all) {
+                ESP_LOGE(TAG, "dependency cycle in stages 0x%x", all & ~ended);
+                for (int i = 0; i < num; i++) {
+                    if (!(ended & LP_STAGE_BIT(i))) {
+                        result[i].state = LP_STAGE_SKIP;
+                    }
+                }
+                ret = ESP_ERR_INVALID_STATE;
+            }
+            break;
+        }
+        int id;
+        xQueueReceive(ctx.done, &id, portMAX_DELAY);
+        running--;
+        ended |= LP_STAGE_BIT(id);
+        if (result[id].state == LP_STAGE_DONE) {
+            succeeded |= LP_STAGE_BIT(id);
+        }
+    }
+    if (ret == ESP_OK && succeeded != all) {
+        ret = ESP_FAIL;
+    }
+
+    // the context is on this stack, wait for every worker to stop
+    for (int i = 0; i < workers; i++) {
+        int id = LP_STAGE_EXIT;
+        xQueueSend(ctx.work, &id, portMAX_DELAY);
+    }
+    while (workers > 0) {
+        int id;
+        xQueueReceive(ctx.done, &id, portMAX_DELAY);
+        if (id == LP_STAGE_EXIT) {
+            workers--;
+        }
+    }
+    vQueueDelete(ctx.work);
+    vQueueDelete(ctx.done);
+    return ret;
+
+EXIT_NO_MEM:
+    if (ctx.work) {
+        vQueueDelete(ctx.work);
+    }
+    if (ctx.done) {
+        vQueueDelete(ctx.done);
+    }
+    return ESP_ERR_NO_MEM;
+}
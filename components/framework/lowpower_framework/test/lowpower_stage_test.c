@@ -0,0 +1,97 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lowpower_stage.h"
+#include "unity.h"
+
+#define STAGE_TEST_STACK    (2048)
+
+typedef struct {
+    int delay_ms;
+    esp_err_t ret;
+} stage_test_arg_t;
+
+static esp_err_t stage_test_func(void* arg)
+{
+    stage_test_arg_t* test = (stage_test_arg_t*) arg;
+    vTaskDelay(test->delay_ms / portTICK_PERIOD_MS);
+    return test->ret;
+}
+
+TEST_CASE("lowpower stage parallel test", "[lowpower_framework]")
+{
+    // 0 -> (1, 2) -> 3, 1 and 2 overlap
+    stage_test_arg_t arg[] = { { 50, ESP_OK }, { 200, ESP_OK }, { 100, ESP_OK }, { 50, ESP_OK } };
+    lp_stage_t stage[] = {
+        { "init", stage_test_func, &arg[0], 0 },
+        { "net", stage_test_func, &arg[1], LP_STAGE_BIT(0) },
+        { "sensor", stage_test_func, &arg[2], LP_STAGE_BIT(0) },
+        { "upload", stage_test_func, &arg[3], LP_STAGE_BIT(1) | LP_STAGE_BIT(2) },
+    };
+    lp_stage_result_t result[4];
+    TEST_ASSERT_EQUAL_INT(ESP_OK, lp_stage_run(stage, 4, 3, STAGE_TEST_STACK, result));
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL_INT(LP_STAGE_DONE, result[i].state);
+        TEST_ASSERT_INT_WITHIN(30, arg[i].delay_ms, result[i].time_ms);
+    }
+    TEST_ASSERT_INT_WITHIN(30, 50, result[1].start_ms);
+    TEST_ASSERT_INT_WITHIN(30, 50, result[2].start_ms);
+    TEST_ASSERT_INT_WITHIN(30, 250, result[3].start_ms);
+
+    // one worker runs them in order
+    TEST_ASSERT_EQUAL_INT(ESP_OK, lp_stage_run(stage, 4, 1, STAGE_TEST_STACK, result));
+    TEST_ASSERT_INT_WITHIN(50, 350, result[3].start_ms);
+}
+
+TEST_CASE("lowpower stage failure test", "[lowpower_framework]")
+{
+    stage_test_arg_t ok = { 10, ESP_OK };
+    stage_test_arg_t fail = { 10, ESP_FAIL };
+    lp_stage_t stage[] = {
+        { "init", stage_test_func, &ok, 0 },
+        { "net", stage_test_func, &fail, LP_STAGE_BIT(0) },
+        { "sensor", NULL, NULL, LP_STAGE_BIT(0) },
+        { "upload", stage_test_func, &ok, LP_STAGE_BIT(1) | LP_STAGE_BIT(2) },
+        { "done", stage_test_func, &ok, LP_STAGE_BIT(3) },
+        { "log", stage_test_func, &ok, LP_STAGE_BIT(2) },
+    };
+    lp_stage_result_t result[6];
+    TEST_ASSERT_EQUAL_INT(ESP_FAIL, lp_stage_run(stage, 6, 2, STAGE_TEST_STACK, result));
+    TEST_ASSERT_EQUAL_INT(LP_STAGE_DONE, result[0].state);
+    TEST_ASSERT_EQUAL_INT(LP_STAGE_FAIL, result[1].state);
+    TEST_ASSERT_EQUAL_INT(LP_STAGE_DONE, result[2].state);
+    TEST_ASSERT_EQUAL_INT(LP_STAGE_SKIP, result[3].state);
+    TEST_ASSERT_EQUAL_INT(LP_STAGE_SKIP, result[4].state);
+    TEST_ASSERT_EQUAL_INT(LP_STAGE_DONE, result[5].state);
+}
+
+TEST_CASE("lowpower stage dependency error test", "[lowpower_framework]")
+{
+    stage_test_arg_t ok = { 0, ESP_OK };
+    lp_stage_t stage[] = {
+        { "a", stage_test_func, &ok, 0 },
+        { "b", stage_test_func, &ok, LP_STAGE_BIT(2) },
+        { "c", stage_test_func, &ok, LP_STAGE_BIT(1) },
+    };
+    lp_stage_result_t result[3];
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_STATE, lp_stage_run(stage, 3, 2, STAGE_TEST_STACK, result));
+    TEST_ASSERT_EQUAL_INT(LP_STAGE_DONE, result[0].state);
+    TEST_ASSERT_EQUAL_INT(LP_STAGE_SKIP, result[1].state);
+    TEST_ASSERT_EQUAL_INT(LP_STAGE_SKIP, result[2].state);
+    stage[0].depends = LP_STAGE_BIT(3);
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, lp_stage_run(stage, 3, 2, STAGE_TEST_STACK, result));
+}
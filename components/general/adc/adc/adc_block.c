@@ -0,0 +1,113 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <string.h>
+#include "adc_block.h"
+
+#define ADC_BLOCK_SAMPLE_CHN(s)     ((s) >> 12)
+#define ADC_BLOCK_SAMPLE_RAW(s)     ((s) & 0xfff)
+
+esp_err_t adc_block_init(adc_block_t* blk, int avg_num, int block_len, adc_block_cb_t cb, void* arg)
+{
+    if (blk == NULL || avg_num <= 0 || avg_num > UINT16_MAX || block_len <= 0 || block_len > UINT16_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(blk, 0, sizeof(adc_block_t));
+    blk->avg_num = avg_num;
+    blk->block_len = block_len;
+    blk->cb = cb;
+    blk->arg = arg;
+    return ESP_OK;
+}
+
+esp_err_t adc_block_add_channel(adc_block_t* blk, int channel, const uint16_t* lut)
+{
+    if (channel < 0 || channel >= ADC_BLOCK_CHANNEL_MAX || lut == NULL || blk->chn[channel] != NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    adc_block_chn_t* chn = (adc_block_chn_t*) calloc(1, sizeof(adc_block_chn_t));
+    if (chn == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    chn->ring = (uint16_t*) calloc(ADC_BLOCK_RING_NUM * blk->block_len, sizeof(uint16_t));
+    if (chn->ring == NULL) {
+        free(chn);
+        return ESP_ERR_NO_MEM;
+    }
+    chn->lut = lut;
+    chn->latest = -1;
+    blk->chn[channel] = chn;
+    return ESP_OK;
+}
+
+void adc_block_feed(adc_block_t* blk, const uint16_t* sample, int num)
+{
+    for (int i = 0; i < num; i++) {
+        int channel = ADC_BLOCK_SAMPLE_CHN(sample[i]);
+        adc_block_chn_t* chn = channel < ADC_BLOCK_CHANNEL_MAX ? blk->chn[channel] : NULL;
+        if (chn == NULL) {
+            continue;
+        }
+        chn->sum += ADC_BLOCK_SAMPLE_RAW(sample[i]);
+        if (++chn->count < blk->avg_num) {
+            continue;
+        }
+        /* average the raw values first, the table turns the rounded mean into mV */
+        uint16_t mv = chn->lut[(chn->sum + blk->avg_num / 2) / blk->avg_num];
+        chn->sum = 0;
+        chn->count = 0;
+        chn->latest = mv;
+        uint16_t* block = chn->ring + chn->cur * blk->block_len;
+        block[chn->fill++] = mv;
+        if (chn->fill < blk->block_len) {
+            continue;
+        }
+        chn->fill = 0;
+        chn->cur = (chn->cur + 1) % ADC_BLOCK_RING_NUM;
+        if (blk->cb) {
+            blk->cb(channel, block, blk->block_len, blk->arg);
+        }
+    }
+}
+
+void adc_block_reset(adc_block_t* blk)
+{
+    for (int i = 0; i < ADC_BLOCK_CHANNEL_MAX; i++) {
+        adc_block_chn_t* chn = blk->chn[i];
+        if (chn != NULL) {
+            chn->sum = 0;
+            chn->count = 0;
+            chn->fill = 0;
+        }
+    }
+}
+
+int adc_block_latest(const adc_block_t* blk, int channel)
+{
+    if (channel < 0 || channel >= ADC_BLOCK_CHANNEL_MAX || blk->chn[channel] == NULL) {
+        return -1;
+    }
+    return blk->chn[channel]->latest;
+}
+
+void adc_block_deinit(adc_block_t* blk)
+{
+    for (int i = 0; i < ADC_BLOCK_CHANNEL_MAX; i++) {
+        if (blk->chn[i] != NULL) {
+            free(blk->chn[i]->ring);
+            free(blk->chn[i]);
+            blk->chn[i] = NULL;
+        }
+    }
+}
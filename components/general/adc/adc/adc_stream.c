@@ -0,0 +1,213 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_adc_cal.h"
+#include "driver/i2s.h"
+#include "soc/syscon_struct.h"
+#include "iot_adc_stream.h"
+
+static const char *TAG = "adc_stream";
+
+#define ADC_STREAM_CHECK(a, str, ret) \
+    if (!(a)) { \
+        ESP_LOGE(TAG,"%s:%d (%s):%s", __FILE__, __LINE__, __FUNCTION__, str); \
+        return (ret); \
+    }
+
+#define ADC_STREAM_I2S_NUM          I2S_NUM_0   /* only I2S0 can read the built-in ADC */
+#define ADC_STREAM_READ_TIMEOUT     (100 / portTICK_PERIOD_MS)
+#define ADC_STREAM_PATT_WIDTH       (3)         /* 12 bit */
+
+typedef struct {
+    adc_block_t blk;
+    uint16_t* lut[ADC_ATTEN_MAX];
+    adc_stream_channel_t channels[ADC_BLOCK_CHANNEL_MAX];
+    int channel_num;
+    uint16_t* buf;
+    TaskHandle_t task;
+    SemaphoreHandle_t exit;
+    volatile bool run;
+} adc_stream_t;
+
+static bool s_i2s_in_use = false;
+
+/*
+ * The driver sets up a single channel scan, the pattern table is rewritten with every channel
+ * once the ADC is enabled. Each entry is channel, bit width and attenuation, four entries per word, first one at the top.
+ */
+static void adc_stream_pattern_set(const adc_stream_t* stream)
+{
+    uint32_t tab[4] = {0};
+    for (int i = 0; i < stream->channel_num; i++) {
+        uint32_t entry = (stream->channels[i].channel << 4) | (ADC_STREAM_PATT_WIDTH << 2) | stream->channels[i].atten;
+        tab[i / 4] |= entry << (24 - 8 * (i % 4));
+    }
+    for (int i = 0; i < 4; i++) {
+        SYSCON.saradc_sar1_patt_tab[i] = tab[i];
+    }
+    SYSCON.saradc_ctrl.sar1_patt_len = stream->channel_num - 1;
+    // keep converting without a limit on the number of measurements
+    SYSCON.saradc_ctrl2.meas_num_limit = 0;
+}
+
+static uint16_t* adc_stream_lut_create(adc_atten_t atten, uint32_t vref)
+{
+    esp_adc_cal_characteristics_t chars;
+    esp_adc_cal_characterize(ADC_UNIT_1, atten, ADC_WIDTH_BIT_12, vref, &chars);
+    uint16_t* lut = (uint16_t*) malloc(ADC_BLOCK_RAW_MAX * sizeof(uint16_t));
+    if (lut == NULL) {
+        return NULL;
+    }
+    for (uint32_t raw = 0; raw < ADC_BLOCK_RAW_MAX; raw++) {
+        lut[raw] = esp_adc_cal_raw_to_voltage(raw, &chars);
+    }
+    return lut;
+}
+
+static void adc_stream_task(void* arg)
+{
+    adc_stream_t* stream = (adc_stream_t*) arg;
+    while (stream->run) {
+        size_t bytes = 0;
+        i2s_read(ADC_STREAM_I2S_NUM, stream->buf, ADC_STREAM_DMA_BUF_LEN * sizeof(uint16_t), &bytes, ADC_STREAM_READ_TIMEOUT);
+        adc_block_feed(&stream->blk, stream->buf, bytes / sizeof(uint16_t));
+    }
+    xSemaphoreGive(stream->exit);
+    vTaskDelete(NULL);
+}
+
+static void adc_stream_free(adc_stream_t* stream)
+{
+    adc_block_deinit(&stream->blk);
+    for (int i = 0; i < ADC_ATTEN_MAX; i++) {
+        free(stream->lut[i]);
+    }
+    if (stream->exit) {
+        vSemaphoreDelete(stream->exit);
+    }
+    free(stream->buf);
+    free(stream);
+}
+
+adc_stream_handle_t iot_adc_stream_create(const adc_stream_config_t* config)
+{
+    ADC_STREAM_CHECK(config != NULL && config->channels != NULL, "config is NULL", NULL);
+    ADC_STREAM_CHECK(config->channel_num > 0 && config->channel_num <= ADC_BLOCK_CHANNEL_MAX, "channel number error", NULL);
+    ADC_STREAM_CHECK(config->sample_rate > 0, "sample rate error", NULL);
+    ADC_STREAM_CHECK(!s_i2s_in_use, "I2S ADC is in use by another stream", NULL);
+
+    adc_stream_t* stream = (adc_stream_t*) calloc(1, sizeof(adc_stream_t));
+    ADC_STREAM_CHECK(stream != NULL, "no memory for adc stream", NULL);
+    stream->buf = (uint16_t*) malloc(ADC_STREAM_DMA_BUF_LEN * sizeof(uint16_t));
+    stream->exit = xSemaphoreCreateBinary();
+    if (stream->buf == NULL || stream->exit == NULL
+            || adc_block_init(&stream->blk, config->avg_num, config->block_len, config->block_cb, config->cb_arg) != ESP_OK) {
+        ESP_LOGE(TAG, "adc stream init error");
+        adc_stream_free(stream);
+        return NULL;
+    }
+    stream->channel_num = config->channel_num;
+    for (int i = 0; i < config->channel_num; i++) {
+        const adc_stream_channel_t* chn = &config->channels[i];
+        if (chn->channel >= ADC1_CHANNEL_MAX || chn->atten >= ADC_ATTEN_MAX) {
+            ESP_LOGE(TAG, "channel %d config error", i);
+            adc_stream_free(stream);
+            return NULL;
+        }
+        // one table for each attenuation in use
+        if (stream->lut[chn->atten] == NULL) {
+            stream->lut[chn->atten] = adc_stream_lut_create(chn->atten, config->vref);
+        }
+        if (stream->lut[chn->atten] == NULL || adc_block_add_channel(&stream->blk, chn->channel, stream->lut[chn->atten]) != ESP_OK) {
+            ESP_LOGE(TAG, "channel %d add error", i);
+            adc_stream_free(stream);
+            return NULL;
+        }
+        stream->channels[i] = *chn;
+        adc1_config_channel_atten(chn->channel, chn->atten);
+    }
+
+    i2s_config_t i2s_config;
+    memset(&i2s_config, 0, sizeof(i2s_config));
+    i2s_config.mode = (i2s_mode_t) (I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN);
+    i2s_config.sample_rate = config->sample_rate;
+    i2s_config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+    i2s_config.channel_format = I2S_CHANNEL_FMT_ONLY_RIGHT;
+    i2s_config.communication_format = I2S_COMM_FORMAT_I2S_MSB;
+    i2s_config.dma_buf_count = ADC_STREAM_DMA_BUF_NUM;
+    i2s_config.dma_buf_len = ADC_STREAM_DMA_BUF_LEN;
+    if (i2s_driver_install(ADC_STREAM_I2S_NUM, &i2s_config, 0, NULL) != ESP_OK) {
+        ESP_LOGE(TAG, "I2S driver install error");
+        adc_stream_free(stream);
+        return NULL;
+    }
+    i2s_set_adc_mode(ADC_UNIT_1, config->channels[0].channel);
+    s_i2s_in_use = true;
+    return (adc_stream_handle_t) stream;
+}
+
+esp_err_t iot_adc_stream_start(adc_stream_handle_t stream_handle)
+{
+    adc_stream_t* stream = (adc_stream_t*) stream_handle;
+    ADC_STREAM_CHECK(stream != NULL, "stream is NULL", ESP_FAIL);
+    ADC_STREAM_CHECK(!stream->run, "stream is running", ESP_FAIL);
+    adc_block_reset(&stream->blk);
+    i2s_adc_enable(ADC_STREAM_I2S_NUM);
+    adc_stream_pattern_set(stream);
+    stream->run = true;
+    if (xTaskCreate(adc_stream_task, "adc_stream", ADC_STREAM_TASK_STACK, stream, ADC_STREAM_TASK_PRIO, &stream->task) != pdPASS) {
+        stream->run = false;
+        i2s_adc_disable(ADC_STREAM_I2S_NUM);
+        ESP_LOGE(TAG, "adc stream task create error");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t iot_adc_stream_stop(adc_stream_handle_t stream_handle)
+{
+    adc_stream_t* stream = (adc_stream_t*) stream_handle;
+    ADC_STREAM_CHECK(stream != NULL, "stream is NULL", ESP_FAIL);
+    if (!stream->run) {
+        return ESP_OK;
+    }
+    stream->run = false;
+    xSemaphoreTake(stream->exit, portMAX_DELAY);
+    i2s_adc_disable(ADC_STREAM_I2S_NUM);
+    return ESP_OK;
+}
+
+int iot_adc_stream_read(adc_stream_handle_t stream_handle, adc1_channel_t channel)
+{
+    adc_stream_t* stream = (adc_stream_t*) stream_handle;
+    ADC_STREAM_CHECK(stream != NULL, "stream is NULL", -1);
+    return adc_block_latest(&stream->blk, channel);
+}
+
+esp_err_t iot_adc_stream_delete(adc_stream_handle_t stream_handle)
+{
+    adc_stream_t* stream = (adc_stream_t*) stream_handle;
+    ADC_STREAM_CHECK(stream != NULL, "stream is NULL", ESP_FAIL);
+    iot_adc_stream_stop(stream);
+    i2s_driver_uninstall(ADC_STREAM_I2S_NUM);
+    s_i2s_in_use = false;
+    adc_stream_free(stream);
+    return ESP_OK;
+}
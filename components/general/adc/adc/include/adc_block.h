@@ -0,0 +1,122 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _IOT_ADC_BLOCK_H_
+#define _IOT_ADC_BLOCK_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*
+ * Block averaging of a stream of ADC samples in the digital controller format,
+ * the channel number in bits [15:12] and the raw value in bits [11:0].
+ * Every avg_num raw values of a channel are averaged and turned into mV through the lookup table of the channel,
+ * every block_len mV values of a channel are handed to the callback.
+ */
+
+#define ADC_BLOCK_CHANNEL_MAX   (8)     /*!< channels of ADC1 */
+#define ADC_BLOCK_RING_NUM      (2)     /*!< blocks in the ring of a channel, the callback owns one while the next fills */
+#define ADC_BLOCK_RAW_MAX       (4096)  /*!< lookup table size, 12 bit raw values */
+
+typedef void (*adc_block_cb_t)(int channel, const uint16_t* mv, int num, void* arg);
+
+typedef struct {
+    const uint16_t* lut;        /* raw value to mV */
+    uint32_t sum;
+    uint16_t count;
+    uint16_t fill;              /* values in the block being filled */
+    uint8_t cur;                /* block being filled */
+    int32_t latest;             /* last averaged value in mV, -1 before the first one */
+    uint16_t* ring;             /* ADC_BLOCK_RING_NUM blocks of block_len values */
+} adc_block_chn_t;
+
+typedef struct {
+    uint16_t avg_num;
+    uint16_t block_len;
+    adc_block_cb_t cb;
+    void* arg;
+    adc_block_chn_t* chn[ADC_BLOCK_CHANNEL_MAX];    /* indexed by channel number, NULL if not sampled */
+} adc_block_t;
+
+/**
+ * @brief Init a block averager
+ *
+ * @param blk block averager
+ * @param avg_num raw values averaged into one value
+ * @param block_len values of one block
+ * @param cb callback of a filled block, may be NULL
+ * @param arg callback argument
+ *
+ * @return
+ *     - ESP_OK if success
+ *     - ESP_ERR_INVALID_ARG if a parameter is invalid
+ */
+esp_err_t adc_block_init(adc_block_t* blk, int avg_num, int block_len, adc_block_cb_t cb, void* arg);
+
+/**
+ * @brief Add a channel to the block averager
+ *
+ * @param blk block averager
+ * @param channel channel number
+ * @param lut ADC_BLOCK_RAW_MAX entries of raw value to mV, kept by the caller
+ *
+ * @return
+ *     - ESP_OK if success
+ *     - ESP_ERR_INVALID_ARG if the channel is invalid or added already
+ *     - ESP_ERR_NO_MEM if the ring can not be allocated
+ */
+esp_err_t adc_block_add_channel(adc_block_t* blk, int channel, const uint16_t* lut);
+
+/**
+ * @brief Feed samples, the callback is called from here
+ *
+ * @param blk block averager
+ * @param sample samples, samples of channels not added are dropped
+ * @param num number of samples
+ */
+void adc_block_feed(adc_block_t* blk, const uint16_t* sample, int num);
+
+/**
+ * @brief Restart averaging and drop the values of the blocks being filled
+ *
+ * @param blk block averager
+ */
+void adc_block_reset(adc_block_t* blk);
+
+/**
+ * @brief Get the last averaged value of a channel
+ *
+ * @param blk block averager
+ * @param channel channel number
+ *
+ * @return value in mV, -1 if there is no value yet
+ */
+int adc_block_latest(const adc_block_t* blk, int channel);
+
+/**
+ * @brief Free the rings of a block averager
+ *
+ * @param blk block averager
+ */
+void adc_block_deinit(adc_block_t* blk);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
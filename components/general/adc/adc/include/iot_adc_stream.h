@@ -0,0 +1,101 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _IOT_ADC_STREAM_H_
+#define _IOT_ADC_STREAM_H_
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "driver/adc.h"
+#include "adc_block.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ADC_STREAM_DMA_BUF_LEN      (256)   /* samples of one DMA buffer */
+#define ADC_STREAM_DMA_BUF_NUM      (4)
+#define ADC_STREAM_TASK_STACK       (2048)
+#define ADC_STREAM_TASK_PRIO        (10)
+
+typedef void* adc_stream_handle_t;
+
+typedef struct {
+    adc1_channel_t channel;
+    adc_atten_t atten;
+} adc_stream_channel_t;
+
+typedef struct {
+    const adc_stream_channel_t* channels;   /*!< ADC1 channels, scanned in this order */
+    int channel_num;                        /*!< number of channels, up to ADC_BLOCK_CHANNEL_MAX */
+    uint32_t sample_rate;                   /*!< conversions per second, shared by all channels */
+    uint16_t avg_num;                       /*!< conversions averaged into one value */
+    uint16_t block_len;                     /*!< values of one callback */
+    adc_block_cb_t block_cb;                /*!< callback of a filled block, called from the sampling task */
+    void* cb_arg;
+    uint32_t vref;                          /*!< reference voltage for the calibration, mV */
+} adc_stream_config_t;
+
+/**
+ * @brief Create a continuous sampling stream of ADC1 channels through I2S0 DMA
+ *
+ * @note I2S0 and ADC1 are owned by the stream, the one-shot ADC1 API can not be used while it runs.
+ *       The calibration of every attenuation in use is turned into a lookup table at creation.
+ *
+ * @param config stream configuration
+ *
+ * @return handle of the stream, NULL in case of error
+ */
+adc_stream_handle_t iot_adc_stream_create(const adc_stream_config_t* config);
+
+/**
+ * @brief Start sampling
+ * @param stream handle of the stream
+ * @return
+ *     - ESP_OK if success
+ *     - ESP_FAIL otherwise
+ */
+esp_err_t iot_adc_stream_start(adc_stream_handle_t stream);
+
+/**
+ * @brief Stop sampling, the values of the blocks being filled are dropped
+ * @param stream handle of the stream
+ * @return
+ *     - ESP_OK if success
+ *     - ESP_FAIL otherwise
+ */
+esp_err_t iot_adc_stream_stop(adc_stream_handle_t stream);
+
+/**
+ * @brief Get the last averaged value of a channel
+ * @param stream handle of the stream
+ * @param channel ADC1 channel
+ * @return
+ *     - Voltage value (uint: mV)
+ *     - -1 if there is no value yet
+ */
+int iot_adc_stream_read(adc_stream_handle_t stream, adc1_channel_t channel);
+
+/**
+ * @brief Stop and delete a stream
+ * @param stream handle of the stream
+ * @return
+ *     - ESP_OK if success
+ *     - ESP_FAIL otherwise
+ */
+esp_err_t iot_adc_stream_delete(adc_stream_handle_t stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include <string.h>
+#include "adc_block.h"
+#include "unity.h"
+
+#define ADC_TEST_SAMPLE(chn, raw)   ((uint16_t)(((chn) << 12) | (raw)))
+
+static uint16_t s_lut[ADC_BLOCK_RAW_MAX];
+static int s_cb_num;
+static int s_cb_chn;
+static uint16_t s_cb_block[16];
+
+static void adc_test_block_cb(int channel, const uint16_t* mv, int num, void* arg)
+{
+    s_cb_num++;
+    s_cb_chn = channel;
+    memcpy(s_cb_block, mv, num * sizeof(uint16_t));
+    (*(int*) arg) += num;
+}
+
+TEST_CASE("ADC block average test", "[adc][iot]")
+{
+    adc_block_t blk;
+    int total = 0;
+    uint16_t sample[64];
+    /* a table of 2x, easy to check */
+    for (int i = 0; i < ADC_BLOCK_RAW_MAX; i++) {
+        s_lut[i] = i * 2;
+    }
+    s_cb_num = 0;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, adc_block_init(&blk, 0, 4, NULL, NULL));
+    TEST_ASSERT_EQUAL(ESP_OK, adc_block_init(&blk, 4, 4, adc_test_block_cb, &total));
+    TEST_ASSERT_EQUAL(ESP_OK, adc_block_add_channel(&blk, 0, s_lut));
+    TEST_ASSERT_EQUAL(ESP_OK, adc_block_add_channel(&blk, 6, s_lut));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, adc_block_add_channel(&blk, 6, s_lut));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, adc_block_add_channel(&blk, 8, s_lut));
+    TEST_ASSERT_EQUAL(-1, adc_block_latest(&blk, 0));
+
+    /* channels interleaved as the pattern table scans them, channel 3 is not added */
+    int n = 0;
+    for (int i = 0; i < 16; i++) {
+        sample[n++] = ADC_TEST_SAMPLE(0, 100 + i % 2);
+        sample[n++] = ADC_TEST_SAMPLE(6, 1000 + i);
+        sample[n++] = ADC_TEST_SAMPLE(3, 4095);
+    }
+    adc_block_feed(&blk, sample, 20);
+    TEST_ASSERT_EQUAL(0, s_cb_num);
+    TEST_ASSERT_EQUAL(202, adc_block_latest(&blk, 0));
+    adc_block_feed(&blk, sample + 20, n - 20);
+    /* 16 samples of a channel give 4 values, one block */
+    TEST_ASSERT_EQUAL(2, s_cb_num);
+    TEST_ASSERT_EQUAL(8, total);
+    TEST_ASSERT_EQUAL(6, s_cb_chn);
+    TEST_ASSERT_EQUAL(2 * 1002, s_cb_block[0]);
+    TEST_ASSERT_EQUAL(2 * 1006, s_cb_block[1]);
+    TEST_ASSERT_EQUAL(2 * 1014, s_cb_block[3]);
+    TEST_ASSERT_EQUAL(-1, adc_block_latest(&blk, 3));
+
+    /* a partial average is dropped by a reset */
+    sample[0] = ADC_TEST_SAMPLE(0, 4000);
+    adc_block_feed(&blk, sample, 1);
+    adc_block_reset(&blk);
+    for (int i = 0; i < 4; i++) {
+        sample[i] = ADC_TEST_SAMPLE(0, 10);
+    }
+    adc_block_feed(&blk, sample, 4);
+    TEST_ASSERT_EQUAL(20, adc_block_latest(&blk, 0));
+    adc_block_deinit(&blk);
+    TEST_ASSERT_EQUAL(-1, adc_block_latest(&blk, 0));
+}
@@ -14,6 +14,9 @@
 #include "esp_system.h"
 #include "esp_log.h"
 #include "iot_adc.h"
+#include "iot_adc_stream.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "unity.h"
 
 #define EVB_ADC_CHANNEL ADC_CHANNEL_0     /* GPIO36 */
@@ -35,3 +38,40 @@ TEST_CASE("ADC test", "[adc][iot]")
     adc_test();
 }
 
+
+static volatile int s_stream_blocks = 0;
+
+static void adc_stream_test_cb(int channel, const uint16_t* mv, int num, void* arg)
+{
+    s_stream_blocks++;
+}
+
+TEST_CASE("ADC stream test", "[adc][iot]")
+{
+    const adc_stream_channel_t channels[] = {
+        {ADC1_CHANNEL_0, ADC_ATTEN_DB_11},      /* GPIO36 */
+        {ADC1_CHANNEL_3, ADC_ATTEN_DB_11},      /* GPIO39 */
+        {ADC1_CHANNEL_6, ADC_ATTEN_DB_0},       /* GPIO34 */
+    };
+    adc_stream_config_t config = {
+        .channels = channels,
+        .channel_num = sizeof(channels) / sizeof(channels[0]),
+        .sample_rate = 30000,
+        .avg_num = 10,
+        .block_len = 100,
+        .block_cb = adc_stream_test_cb,
+        .cb_arg = NULL,
+        .vref = DEFAULT_VREF,
+    };
+    adc_stream_handle_t stream = iot_adc_stream_create(&config);
+    TEST_ASSERT_NOT_NULL(stream);
+    TEST_ASSERT_EQUAL(ESP_OK, iot_adc_stream_start(stream));
+    vTaskDelay(1000 / portTICK_PERIOD_MS);
+    TEST_ASSERT_EQUAL(ESP_OK, iot_adc_stream_stop(stream));
+    /* about 10000 conversions per channel, 1000 values, 10 blocks of each channel */
+    printf("blocks: %d, GPIO36: %d mV, GPIO39: %d mV, GPIO34: %d mV\n", s_stream_blocks,
+            iot_adc_stream_read(stream, ADC1_CHANNEL_0), iot_adc_stream_read(stream, ADC1_CHANNEL_3),
+            iot_adc_stream_read(stream, ADC1_CHANNEL_6));
+    TEST_ASSERT_TRUE(s_stream_blocks >= 15);
+    TEST_ASSERT_EQUAL(ESP_OK, iot_adc_stream_delete(stream));
+}
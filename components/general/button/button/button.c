@@ -21,6 +21,9 @@
 #include "iot_button.h"
 #include "esp_timer.h"
 
+/* timer engine, see button_scan.c for the scan engine */
+#ifndef CONFIG_BUTTON_USE_SCAN_TASK
+
 #define USE_ESP_TIMER   CONFIG_BUTTON_USE_ESP_TIMER
 #if USE_ESP_TIMER
 #define STOP_TIMER(tmr)   esp_timer_stop(tmr)
@@ -330,6 +333,17 @@ button_handle_t iot_button_create(gpio_num_t gpio_num, button_active_t active_le
     return (button_handle_t) btn;
 }
 
+button_handle_t iot_button_create_virtual(button_active_t active_level)
+{
+    ESP_LOGE(TAG, "virtual button needs the scan engine");
+    return NULL;
+}
+
+esp_err_t iot_button_set_level(button_handle_t btn_handle, int level)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
 esp_err_t iot_button_rm_cb(button_handle_t btn_handle, button_cb_type_t type)
 {
     button_dev_t* btn = (button_dev_t*) btn_handle;
@@ -434,3 +448,5 @@ esp_err_t iot_button_add_custom_cb(button_handle_t btn_handle, uint32_t press_se
     btn->cb_head = cb_new;
     return ESP_OK;
 }
+
+#endif
@@ -0,0 +1,81 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include "button_fsm.h"
+
+/* compare wrapped time stamps, true if a is at or after b */
+#define BUTTON_TIME_REACHED(a, b)   ((int32_t)((uint32_t)(a) - (uint32_t)(b)) >= 0)
+
+void button_fsm_init(button_fsm_t* fsm, uint16_t debounce_thres)
+{
+    memset(fsm, 0, sizeof(button_fsm_t));
+    fsm->debounce_thres = debounce_thres ? debounce_thres : 1;
+    fsm->state = BUTTON_FSM_IDLE;
+}
+
+void button_fsm_set_serial(button_fsm_t* fsm, uint32_t start_ms, uint32_t interval_ms)
+{
+    fsm->serial_start_ms = start_ms;
+    fsm->serial_interval_ms = interval_ms ? interval_ms : 1;
+    if (fsm->active) {
+        fsm->next_serial_ms = fsm->press_ms + start_ms;
+    }
+}
+
+void button_fsm_set_pressed(button_fsm_t* fsm)
+{
+    if (fsm->state != BUTTON_FSM_IDLE) {
+        fsm->state = BUTTON_FSM_PRESSED;
+    }
+}
+
+uint32_t button_fsm_hold_ms(const button_fsm_t* fsm, uint32_t now_ms)
+{
+    return fsm->active ? now_ms - fsm->press_ms : 0;
+}
+
+uint32_t button_fsm_update(button_fsm_t* fsm, int active, uint32_t now_ms)
+{
+    uint32_t evt = 0;
+    active = active ? 1 : 0;
+
+    if (active != fsm->active) {
+        if (++fsm->debounce_cnt >= fsm->debounce_thres) {
+            fsm->debounce_cnt = 0;
+            fsm->active = active;
+            if (active) {
+                fsm->state = BUTTON_FSM_PUSH;
+                fsm->press_ms = now_ms;
+                fsm->next_serial_ms = now_ms + fsm->serial_start_ms;
+                evt |= BUTTON_FSM_EVT_PUSH;
+            } else {
+                if (fsm->state == BUTTON_FSM_PUSH) {
+                    evt |= BUTTON_FSM_EVT_TAP;
+                }
+                if (fsm->state != BUTTON_FSM_IDLE) {
+                    evt |= BUTTON_FSM_EVT_RELEASE;
+                }
+                fsm->state = BUTTON_FSM_IDLE;
+            }
+        }
+    } else {
+        fsm->debounce_cnt = 0;
+    }
+
+    if (fsm->active && fsm->serial_start_ms && BUTTON_TIME_REACHED(now_ms, fsm->next_serial_ms)) {
+        fsm->next_serial_ms += fsm->serial_interval_ms;
+        evt |= BUTTON_FSM_EVT_SERIAL;
+    }
+    return evt;
+}
@@ -0,0 +1,297 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "driver/gpio.h"
+#include "iot_button.h"
+#include "button_fsm.h"
+
+/*
+ * Scan engine: all the buttons are sampled by one task, no timer and no GPIO interrupt is used.
+ * Callbacks run in the context of the scan task.
+ */
+#ifdef CONFIG_BUTTON_USE_SCAN_TASK
+
+#define IOT_CHECK(tag, a, ret)  if(!(a)) {                                             \
+        ESP_LOGE(tag,"%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__);      \
+        return (ret);                                                                   \
+        }
+#define ERR_ASSERT(tag, param)  IOT_CHECK(tag, (param) == ESP_OK, ESP_FAIL)
+#define POINT_ASSERT(tag, param, ret)    IOT_CHECK(tag, (param) != NULL, (ret))
+
+#define BUTTON_GLITCH_FILTER_TIME_MS   CONFIG_IO_GLITCH_FILTER_TIME_MS
+/* The period is rounded down to whole ticks but never to 0, vTaskDelayUntil would not wait at all */
+#define BUTTON_SCAN_PERIOD_TICKS       (pdMS_TO_TICKS(CONFIG_BUTTON_SCAN_PERIOD_MS) ? pdMS_TO_TICKS(CONFIG_BUTTON_SCAN_PERIOD_MS) : 1)
+#define BUTTON_SCAN_PERIOD_MS          (BUTTON_SCAN_PERIOD_TICKS * portTICK_PERIOD_MS)
+#define BUTTON_SCAN_TASK_PRIORITY      CONFIG_BUTTON_SCAN_TASK_PRIORITY
+#define BUTTON_SCAN_TASK_STACK_SIZE    CONFIG_BUTTON_SCAN_TASK_STACK_SIZE
+#define BUTTON_DEBOUNCE_THRES          ((BUTTON_GLITCH_FILTER_TIME_MS + BUTTON_SCAN_PERIOD_MS - 1) / BUTTON_SCAN_PERIOD_MS)
+#define BUTTON_CB_NUM                  (BUTTON_CB_SERIAL + 1)
+#define BUTTON_IO_NUM_VIRTUAL          (0xff)
+
+typedef struct button_dev button_dev_t;
+typedef struct btn_custom_cb button_custom_cb_t;
+
+struct btn_custom_cb {
+    uint32_t press_ms;
+    uint8_t fired;
+    button_cb cb;
+    void* arg;
+    button_custom_cb_t* next_cb;
+};
+
+struct button_dev {
+    uint8_t io_num;
+    uint8_t active_level;
+    volatile uint8_t raw_level;     /*!< level fed by iot_button_set_level for virtual buttons */
+    button_fsm_t fsm;
+    button_cb cb[BUTTON_CB_NUM];
+    void* arg[BUTTON_CB_NUM];
+    button_custom_cb_t* cb_head;
+    button_dev_t* next;
+};
+
+static const char* TAG = "button_scan";
+static button_dev_t* s_btn_head = NULL;
+static SemaphoreHandle_t s_btn_mux = NULL;
+static TaskHandle_t s_scan_task = NULL;
+
+static inline void button_dispatch(button_dev_t* btn, button_cb_type_t type)
+{
+    if (btn->cb[type]) {
+        btn->cb[type](btn->arg[type]);
+    }
+}
+
+static void button_scan_one(button_dev_t* btn, uint32_t now_ms)
+{
+    int level = (btn->io_num == BUTTON_IO_NUM_VIRTUAL) ? btn->raw_level : gpio_get_level(btn->io_num);
+    int active = (level == btn->active_level);
+    uint32_t evt = button_fsm_update(&btn->fsm, active, now_ms);
+
+    if (evt & BUTTON_FSM_EVT_PUSH) {
+        button_dispatch(btn, BUTTON_CB_PUSH);
+    }
+    if (btn->fsm.active) {
+        uint32_t hold_ms = button_fsm_hold_ms(&btn->fsm, now_ms);
+        button_custom_cb_t* pcb = btn->cb_head;
+        while (pcb != NULL) {
+            if (!pcb->fired && hold_ms >= pcb->press_ms) {
+                pcb->fired = 1;
+                button_fsm_set_pressed(&btn->fsm);
+                if (pcb->cb) {
+                    pcb->cb(pcb->arg);
+                }
+            }
+            pcb = pcb->next_cb;
+        }
+    }
+    if (evt & BUTTON_FSM_EVT_SERIAL) {
+        button_dispatch(btn, BUTTON_CB_SERIAL);
+    }
+    if (evt & BUTTON_FSM_EVT_RELEASE) {
+        button_custom_cb_t* pcb = btn->cb_head;
+        while (pcb != NULL) {
+            pcb->fired = 0;
+            pcb = pcb->next_cb;
+        }
+        if (evt & BUTTON_FSM_EVT_TAP) {
+            button_dispatch(btn, BUTTON_CB_TAP);
+        }
+        button_dispatch(btn, BUTTON_CB_RELEASE);
+    }
+}
+
+static void button_scan_task(void* arg)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+    while (1) {
+        if (s_btn_head == NULL) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            last_wake = xTaskGetTickCount();
+        }
+        vTaskDelayUntil(&last_wake, BUTTON_SCAN_PERIOD_TICKS);
+        uint32_t now_ms = (uint32_t) xTaskGetTickCount() * portTICK_PERIOD_MS;
+        xSemaphoreTakeRecursive(s_btn_mux, portMAX_DELAY);
+        button_dev_t* btn = s_btn_head;
+        while (btn != NULL) {
+            button_dev_t* next = btn->next;
+            button_scan_one(btn, now_ms);
+            btn = next;
+        }
+        xSemaphoreGiveRecursive(s_btn_mux);
+    }
+}
+
+static esp_err_t button_scan_start()
+{
+    if (s_btn_mux == NULL) {
+        s_btn_mux = xSemaphoreCreateRecursiveMutex();
+        POINT_ASSERT(TAG, s_btn_mux, ESP_FAIL);
+    }
+    if (s_scan_task == NULL) {
+        xTaskCreate(button_scan_task, "btn_scan", BUTTON_SCAN_TASK_STACK_SIZE, NULL, BUTTON_SCAN_TASK_PRIORITY, &s_scan_task);
+        POINT_ASSERT(TAG, s_scan_task, ESP_FAIL);
+    }
+    return ESP_OK;
+}
+
+static button_dev_t* button_new(uint8_t io_num, button_active_t active_level)
+{
+    IOT_CHECK(TAG, button_scan_start() == ESP_OK, NULL);
+    button_dev_t* btn = (button_dev_t*) calloc(1, sizeof(button_dev_t));
+    POINT_ASSERT(TAG, btn, NULL);
+    btn->active_level = active_level;
+    btn->raw_level = !active_level;
+    btn->io_num = io_num;
+    button_fsm_init(&btn->fsm, BUTTON_DEBOUNCE_THRES);
+    return btn;
+}
+
+static void button_add(button_dev_t* btn)
+{
+    xSemaphoreTakeRecursive(s_btn_mux, portMAX_DELAY);
+    btn->next = s_btn_head;
+    s_btn_head = btn;
+    xSemaphoreGiveRecursive(s_btn_mux);
+    xTaskNotifyGive(s_scan_task);
+}
+
+button_handle_t iot_button_create(gpio_num_t gpio_num, button_active_t active_level)
+{
+    IOT_CHECK(TAG, gpio_num < GPIO_NUM_MAX, NULL);
+    button_dev_t* btn = button_new(gpio_num, active_level);
+    POINT_ASSERT(TAG, btn, NULL);
+
+    gpio_config_t gpio_conf;
+    gpio_conf.intr_type = GPIO_INTR_DISABLE;
+    gpio_conf.mode = GPIO_MODE_INPUT;
+    gpio_conf.pin_bit_mask = (1ULL << gpio_num);
+    if (btn->active_level) {
+        gpio_conf.pull_down_en = GPIO_PULLDOWN_ENABLE;
+        gpio_conf.pull_up_en = GPIO_PULLUP_DISABLE;
+    } else {
+        gpio_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
+        gpio_conf.pull_up_en = GPIO_PULLUP_ENABLE;
+    }
+    gpio_config(&gpio_conf);
+    button_add(btn);
+    return (button_handle_t) btn;
+}
+
+button_handle_t iot_button_create_virtual(button_active_t active_level)
+{
+    button_dev_t* btn = button_new(BUTTON_IO_NUM_VIRTUAL, active_level);
+    POINT_ASSERT(TAG, btn, NULL);
+    button_add(btn);
+    return (button_handle_t) btn;
+}
+
+esp_err_t iot_button_set_level(button_handle_t btn_handle, int level)
+{
+    POINT_ASSERT(TAG, btn_handle, ESP_ERR_INVALID_ARG);
+    button_dev_t* btn = (button_dev_t*) btn_handle;
+    IOT_CHECK(TAG, btn->io_num == BUTTON_IO_NUM_VIRTUAL, ESP_ERR_INVALID_ARG);
+    btn->raw_level = level ? 1 : 0;
+    return ESP_OK;
+}
+
+esp_err_t iot_button_delete(button_handle_t btn_handle)
+{
+    POINT_ASSERT(TAG, btn_handle, ESP_ERR_INVALID_ARG);
+    button_dev_t* btn = (button_dev_t*) btn_handle;
+    xSemaphoreTakeRecursive(s_btn_mux, portMAX_DELAY);
+    button_dev_t** pp = &s_btn_head;
+    while (*pp != NULL && *pp != btn) {
+        pp = &(*pp)->next;
+    }
+    if (*pp != NULL) {
+        *pp = btn->next;
+    }
+    xSemaphoreGiveRecursive(s_btn_mux);
+
+    button_custom_cb_t* pcb = btn->cb_head;
+    while (pcb != NULL) {
+        button_custom_cb_t* cb_next = pcb->next_cb;
+        free(pcb);
+        pcb = cb_next;
+    }
+    free(btn);
+    return ESP_OK;
+}
+
+esp_err_t iot_button_rm_cb(button_handle_t btn_handle, button_cb_type_t type)
+{
+    POINT_ASSERT(TAG, btn_handle, ESP_ERR_INVALID_ARG);
+    IOT_CHECK(TAG, type < BUTTON_CB_NUM, ESP_ERR_INVALID_ARG);
+    button_dev_t* btn = (button_dev_t*) btn_handle;
+    xSemaphoreTakeRecursive(s_btn_mux, portMAX_DELAY);
+    btn->cb[type] = NULL;
+    btn->arg[type] = NULL;
+    if (type == BUTTON_CB_SERIAL) {
+        button_fsm_set_serial(&btn->fsm, 0, 0);
+    }
+    xSemaphoreGiveRecursive(s_btn_mux);
+    return ESP_OK;
+}
+
+esp_err_t iot_button_set_serial_cb(button_handle_t btn_handle, uint32_t start_after_sec, TickType_t interval_tick, button_cb cb, void* arg)
+{
+    POINT_ASSERT(TAG, btn_handle, ESP_ERR_INVALID_ARG);
+    button_dev_t* btn = (button_dev_t*) btn_handle;
+    xSemaphoreTakeRecursive(s_btn_mux, portMAX_DELAY);
+    btn->cb[BUTTON_CB_SERIAL] = cb;
+    btn->arg[BUTTON_CB_SERIAL] = arg;
+    button_fsm_set_serial(&btn->fsm, start_after_sec * 1000, interval_tick * portTICK_PERIOD_MS);
+    xSemaphoreGiveRecursive(s_btn_mux);
+    return ESP_OK;
+}
+
+esp_err_t iot_button_set_evt_cb(button_handle_t btn_handle, button_cb_type_t type, button_cb cb, void* arg)
+{
+    POINT_ASSERT(TAG, btn_handle, ESP_ERR_INVALID_ARG);
+    IOT_CHECK(TAG, type < BUTTON_CB_NUM, ESP_ERR_INVALID_ARG);
+    if (type == BUTTON_CB_SERIAL) {
+        return iot_button_set_serial_cb(btn_handle, 1, 1000 / portTICK_RATE_MS, cb, arg);
+    }
+    button_dev_t* btn = (button_dev_t*) btn_handle;
+    xSemaphoreTakeRecursive(s_btn_mux, portMAX_DELAY);
+    btn->cb[type] = cb;
+    btn->arg[type] = arg;
+    xSemaphoreGiveRecursive(s_btn_mux);
+    return ESP_OK;
+}
+
+esp_err_t iot_button_add_custom_cb(button_handle_t btn_handle, uint32_t press_sec, button_cb cb, void* arg)
+{
+    POINT_ASSERT(TAG, btn_handle, ESP_ERR_INVALID_ARG);
+    IOT_CHECK(TAG, press_sec != 0, ESP_ERR_INVALID_ARG);
+    button_dev_t* btn = (button_dev_t*) btn_handle;
+    button_custom_cb_t* cb_new = (button_custom_cb_t*) calloc(1, sizeof(button_custom_cb_t));
+    POINT_ASSERT(TAG, cb_new, ESP_FAIL);
+    cb_new->press_ms = press_sec * 1000;
+    cb_new->cb = cb;
+    cb_new->arg = arg;
+    xSemaphoreTakeRecursive(s_btn_mux, portMAX_DELAY);
+    cb_new->next_cb = btn->cb_head;
+    btn->cb_head = cb_new;
+    xSemaphoreGiveRecursive(s_btn_mux);
+    return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,100 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _IOT_BUTTON_FSM_H_
+#define _IOT_BUTTON_FSM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Sampled button state machine used by the scan engine.
+ * It only depends on the sampled level and a millisecond time stamp,
+ * so it holds no timer, no interrupt and no heap memory.
+ */
+
+#define BUTTON_FSM_EVT_PUSH      (1 << 0)  /*!< debounced push */
+#define BUTTON_FSM_EVT_RELEASE   (1 << 1)  /*!< debounced release after a push */
+#define BUTTON_FSM_EVT_TAP       (1 << 2)  /*!< release without any long press in between */
+#define BUTTON_FSM_EVT_SERIAL    (1 << 3)  /*!< serial trigger while holding */
+
+typedef enum {
+    BUTTON_FSM_IDLE = 0,
+    BUTTON_FSM_PUSH,
+    BUTTON_FSM_PRESSED,
+} button_fsm_state_t;
+
+typedef struct {
+    uint32_t press_ms;            /*!< time stamp of the debounced push */
+    uint32_t next_serial_ms;      /*!< time stamp of the next serial event */
+    uint32_t serial_start_ms;     /*!< hold time before the first serial event, 0 to disable */
+    uint32_t serial_interval_ms;  /*!< interval between serial events */
+    uint16_t debounce_cnt;        /*!< consecutive samples that differ from the debounced level */
+    uint16_t debounce_thres;      /*!< samples needed to accept a level change */
+    uint8_t active;               /*!< debounced level, 1 means the button is pushed */
+    uint8_t state;                /*!< button_fsm_state_t */
+} button_fsm_t;
+
+/**
+ * @brief Reset a button state machine
+ *
+ * @param fsm state machine
+ * @param debounce_thres number of consecutive samples needed to accept a level change
+ */
+void button_fsm_init(button_fsm_t* fsm, uint16_t debounce_thres);
+
+/**
+ * @brief Configure serial trigger
+ *
+ * @param fsm state machine
+ * @param start_ms hold time before the first serial event, 0 to disable serial trigger
+ * @param interval_ms interval between serial events
+ */
+void button_fsm_set_serial(button_fsm_t* fsm, uint32_t start_ms, uint32_t interval_ms);
+
+/**
+ * @brief Feed one sample into the state machine
+ *
+ * @param fsm state machine
+ * @param active sampled level, non-zero means the button reads its active level
+ * @param now_ms time stamp of the sample in ms, wrap around is allowed
+ *
+ * @return bit mask of BUTTON_FSM_EVT_XXX events generated by this sample
+ */
+uint32_t button_fsm_update(button_fsm_t* fsm, int active, uint32_t now_ms);
+
+/**
+ * @brief Get how long the button has been held
+ *
+ * @param fsm state machine
+ * @param now_ms current time stamp in ms
+ *
+ * @return hold time in ms since the debounced push, 0 if the button is released
+ */
+uint32_t button_fsm_hold_ms(const button_fsm_t* fsm, uint32_t now_ms);
+
+/**
+ * @brief Mark the current push as a long press, the following release will not generate a TAP event
+ *
+ * @param fsm state machine
+ */
+void button_fsm_set_pressed(button_fsm_t* fsm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -46,6 +46,34 @@ typedef enum {
  */
 button_handle_t iot_button_create(gpio_num_t gpio_num, button_active_t active_level);
 
+/**
+ * @brief Create a button whose level is fed by the application instead of a native GPIO,
+ *        e.g. an input of a GPIO expander.
+ *
+ * @param active_level level passed to iot_button_set_level when the button is pressed
+ *
+ * @note Only supported by the scan engine (CONFIG_BUTTON_USE_SCAN_TASK),
+ *       the level is sampled and debounced by the scan task like a native GPIO.
+ *
+ * @return A button_handle_t handle to the created button object, or NULL in case of error.
+ */
+button_handle_t iot_button_create_virtual(button_active_t active_level);
+
+/**
+ * @brief Update the raw level of a virtual button
+ *
+ * @param btn_handle handle of the button object created by iot_button_create_virtual
+ * @param level current level of the input
+ *
+ * @note This function only stores the level and can be called from any task.
+ *
+ * @return
+ *     - ESP_OK Success
+ *     - ESP_ERR_INVALID_ARG Parameter error
+ *     - ESP_ERR_NOT_SUPPORTED Not supported by the timer engine
+ */
+esp_err_t iot_button_set_level(button_handle_t btn_handle, int level);
+
 /**
  * @brief Register a callback function for a serial trigger event.
  *
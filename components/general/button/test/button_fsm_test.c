@@ -0,0 +1,139 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include "unity.h"
+#include "button_fsm.h"
+
+#define SIM_PERIOD_MS      10
+#define SIM_DEBOUNCE       5
+#define SIM_EVT_MAX        32
+#define SIM_LONG_PRESS_MS  2000
+
+/* level segments of a press trace: the level is kept for dur_ms */
+typedef struct {
+    int level;
+    uint32_t dur_ms;
+} sim_seg_t;
+
+typedef struct {
+    uint32_t evt;
+    uint32_t time_ms;
+} sim_evt_t;
+
+/* replay a trace at SIM_PERIOD_MS, return the number of events recorded */
+static int button_sim_run(const sim_seg_t* trace, int seg_num, uint32_t start_ms, uint32_t serial_start_ms,
+                          uint32_t serial_interval_ms, uint32_t long_press_ms, sim_evt_t* log)
+{
+    button_fsm_t fsm;
+    button_fsm_init(&fsm, SIM_DEBOUNCE);
+    button_fsm_set_serial(&fsm, serial_start_ms, serial_interval_ms);
+    uint32_t now = start_ms;
+    int n = 0;
+    int long_fired = 0;
+    for (int i = 0; i < seg_num; i++) {
+        for (uint32_t t = 0; t < trace[i].dur_ms; t += SIM_PERIOD_MS) {
+            uint32_t evt = button_fsm_update(&fsm, trace[i].level, now);
+            if (long_press_ms && !long_fired && button_fsm_hold_ms(&fsm, now) >= long_press_ms) {
+                long_fired = 1;
+                button_fsm_set_pressed(&fsm);
+            }
+            if (evt & BUTTON_FSM_EVT_RELEASE) {
+                long_fired = 0;
+            }
+            for (uint32_t bit = BUTTON_FSM_EVT_PUSH; bit <= BUTTON_FSM_EVT_SERIAL; bit <<= 1) {
+                if ((evt & bit) && n < SIM_EVT_MAX) {
+                    log[n].evt = bit;
+                    log[n].time_ms = now - start_ms;
+                    n++;
+                }
+            }
+            now += SIM_PERIOD_MS;
+        }
+    }
+    return n;
+}
+
+static void button_sim_check(const sim_evt_t* expect, int expect_num, const sim_evt_t* log, int log_num)
+{
+    TEST_ASSERT_EQUAL_INT(expect_num, log_num);
+    for (int i = 0; i < expect_num; i++) {
+        TEST_ASSERT_EQUAL_UINT32(expect[i].evt, log[i].evt);
+        TEST_ASSERT_EQUAL_UINT32(expect[i].time_ms, log[i].time_ms);
+    }
+}
+
+TEST_CASE("Button fsm glitch test", "[button][iot]")
+{
+    const sim_seg_t trace[] = {
+        {0, 100}, {1, 30}, {0, 100}, {1, 40}, {0, 20}, {1, 20}, {0, 200},
+    };
+    sim_evt_t log[SIM_EVT_MAX];
+    int n = button_sim_run(trace, sizeof(trace) / sizeof(trace[0]), 0, 1000, 500, 0, log);
+    TEST_ASSERT_EQUAL_INT(0, n);
+}
+
+TEST_CASE("Button fsm tap test", "[button][iot]")
+{
+    const sim_seg_t trace[] = {
+        {0, 100}, {1, 200}, {0, 200}, {1, 300}, {0, 200},
+    };
+    /* events of one sample are recorded in bit order, so RELEASE comes before TAP */
+    const sim_evt_t expect[] = {
+        {BUTTON_FSM_EVT_PUSH, 140},
+        {BUTTON_FSM_EVT_RELEASE, 340},
+        {BUTTON_FSM_EVT_TAP, 340},
+        {BUTTON_FSM_EVT_PUSH, 540},
+        {BUTTON_FSM_EVT_RELEASE, 840},
+        {BUTTON_FSM_EVT_TAP, 840},
+    };
+    sim_evt_t log[SIM_EVT_MAX];
+    int n = button_sim_run(trace, sizeof(trace) / sizeof(trace[0]), 0, 0, 0, 0, log);
+    button_sim_check(expect, sizeof(expect) / sizeof(expect[0]), log, n);
+}
+
+TEST_CASE("Button fsm serial and long press test", "[button][iot]")
+{
+    /* hold 2.5s: serial starts after 1s and repeats every 500ms, long press at 2s suppresses TAP */
+    const sim_seg_t trace[] = {
+        {0, 100}, {1, 2500}, {0, 200},
+    };
+    const sim_evt_t expect[] = {
+        {BUTTON_FSM_EVT_PUSH, 140},
+        {BUTTON_FSM_EVT_SERIAL, 1140},
+        {BUTTON_FSM_EVT_SERIAL, 1640},
+        {BUTTON_FSM_EVT_SERIAL, 2140},
+        {BUTTON_FSM_EVT_RELEASE, 2640},
+    };
+    sim_evt_t log[SIM_EVT_MAX];
+    int n = button_sim_run(trace, sizeof(trace) / sizeof(trace[0]), 0, 1000, 500, SIM_LONG_PRESS_MS, log);
+    button_sim_check(expect, sizeof(expect) / sizeof(expect[0]), log, n);
+}
+
+TEST_CASE("Button fsm time wrap test", "[button][iot]")
+{
+    /* same trace as above, but the millisecond counter wraps while the button is held */
+    const sim_seg_t trace[] = {
+        {0, 100}, {1, 2500}, {0, 200},
+    };
+    const sim_evt_t expect[] = {
+        {BUTTON_FSM_EVT_PUSH, 140},
+        {BUTTON_FSM_EVT_SERIAL, 1140},
+        {BUTTON_FSM_EVT_SERIAL, 1640},
+        {BUTTON_FSM_EVT_SERIAL, 2140},
+        {BUTTON_FSM_EVT_RELEASE, 2640},
+    };
+    sim_evt_t log[SIM_EVT_MAX];
+    int n = button_sim_run(trace, sizeof(trace) / sizeof(trace[0]), 0xFFFFFFFF - 1000, 1000, 500, SIM_LONG_PRESS_MS, log);
+    button_sim_check(expect, sizeof(expect) / sizeof(expect[0]), log, n);
+}
@@ -30,6 +30,7 @@ typedef enum {
     LED_ON,
     LED_QUICK_BLINK,
     LED_SLOW_BLINK,
+    LED_PATTERN,            /**< led runs a pattern, set by iot_led_pattern_start() */
 } led_status_t;
 
 typedef enum {
@@ -39,6 +40,26 @@ typedef enum {
 
 typedef void* led_handle_t;
 
+typedef enum {
+    LED_PATTERN_LEVEL = 0,  /**< fade to duty in fade_ms, then keep it for hold_ms */
+    LED_PATTERN_LOOP,       /**< run the steps from loop_to again, loop_times more times */
+} led_pattern_step_type_t;
+
+/**
+ * one step of a led pattern, use LED_STEP_LEVEL() and LED_STEP_LOOP() to fill it
+ */
+typedef struct {
+    uint8_t type;           /**< led_pattern_step_type_t */
+    uint8_t duty;           /**< LED_PATTERN_LEVEL: brightness 0~100 */
+    uint16_t fade_ms;       /**< LED_PATTERN_LEVEL: ramp time to reach duty, 0 to jump */
+    uint32_t hold_ms;       /**< LED_PATTERN_LEVEL: time to keep duty after the ramp */
+    uint8_t loop_to;        /**< LED_PATTERN_LOOP: index of the first step of the loop, must be before this step */
+    uint8_t loop_times;     /**< LED_PATTERN_LOOP: extra runs of the loop */
+} led_pattern_step_t;
+
+#define LED_STEP_LEVEL(duty, fade_ms, hold_ms)  { LED_PATTERN_LEVEL, (duty), (fade_ms), (hold_ms), 0, 0 }
+#define LED_STEP_LOOP(loop_to, loop_times)      { LED_PATTERN_LOOP, 0, 0, 0, (loop_to), (loop_times) }
+
 
 /**
   * @brief  led initialize.
@@ -139,6 +160,41 @@ led_mode_t iot_led_mode_read(led_handle_t led_handle);
   */
 uint8_t iot_led_night_duty_read();
 
+/**
+  * @brief  run a pattern on led
+  *
+  * The steps are checked and copied, then executed as LEDC hardware fades.
+  * An esp_timer is armed once per step, so no task polls the led between steps.
+  * In night mode the duty of each step is scaled by the night duty.
+  *
+  * @param  led_handle
+  * @param  steps pattern steps, can be released after call
+  * @param  step_num number of steps
+  * @param  repeat times to run the whole pattern, 0 to run forever
+  *
+  * @note   A LEDC channel from CONFIG_STATUS_LED_PATTERN_CHANNEL_BASE is used by the led while the pattern is running.
+  *         When the pattern ends the channel is released and the led goes to LED_OFF if the duty of
+  *         the last step is 0, to LED_ON otherwise.
+  *
+  * @return
+  *     - ESP_OK: succeed
+  *     - ESP_ERR_INVALID_ARG: steps are invalid
+  *     - ESP_ERR_NOT_FOUND: no free pattern channel
+  *     - others: fail
+  */
+esp_err_t iot_led_pattern_start(led_handle_t led_handle, const led_pattern_step_t* steps, uint8_t step_num, uint16_t repeat);
+
+/**
+  * @brief  stop the pattern and turn off led
+  *
+  * @param  led_handle
+  *
+  * @return
+  *     - ESP_OK: succeed
+  *     - others: fail
+  */
+esp_err_t iot_led_pattern_stop(led_handle_t led_handle);
+
 #ifdef __cplusplus
 }
 #endif
@@ -308,6 +364,28 @@ public:
      */
     virtual esp_err_t off();
 
+    /**
+     * @brief  run a pattern on led
+     *
+     * @param  steps pattern steps
+     * @param  step_num number of steps
+     * @param  repeat times to run the whole pattern, 0 to run forever
+     *
+     * @return
+     *     - ESP_OK: succeed
+     *     - others: fail
+     */
+    esp_err_t pattern_start(const led_pattern_step_t* steps, uint8_t step_num, uint16_t repeat = 0);
+
+    /**
+     * @brief  stop the pattern and turn off led
+     *
+     * @return
+     *     - ESP_OK: succeed
+     *     - others: fail
+     */
+    esp_err_t pattern_stop();
+
     virtual ~CLED();
 };
 #endif
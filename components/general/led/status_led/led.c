@@ -12,11 +12,14 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include <stdio.h>
+#include <string.h>
 #include "sdkconfig.h"
 #include "driver/ledc.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "iot_led.h"
 
 #define QUICK_BLINK_FREQ            CONFIG_STATUS_LED_QUICK_BLINK_FREQ     /*!< default 5 */
@@ -32,6 +35,13 @@
 #define LED_SLOW_BLINK_TIMER        CONFIG_STATUS_LED_SLOW_BLINK_TIMER     /*!< default 1 */
 #define LED_NORMAL_TIMER            CONFIG_STATUS_LED_NIGHT_MODE_TIMER     /*!< default 2 */
 
+#define LED_PATTERN_CHANNEL_BASE    CONFIG_STATUS_LED_PATTERN_CHANNEL_BASE /*!< default 4 */
+#define LED_PATTERN_CHANNEL_NUM     CONFIG_STATUS_LED_PATTERN_CHANNEL_NUM  /*!< default 2 */
+#define LED_PATTERN_CHANNEL_NONE    0xff
+#if (LED_PATTERN_CHANNEL_BASE + LED_PATTERN_CHANNEL_NUM) > 8
+#error "status led pattern channels exceed LEDC channel 7"
+#endif
+
 #define LED_LONG_BRIGHT_FRE         5000
 #define LED_TIMER_BIT               LEDC_TIMER_13_BIT
 #define LED_BRIGHT_DUTY             ((1 << LED_TIMER_BIT) - 1)
@@ -49,12 +59,44 @@
 static const char* TAG = "LED";
 static uint8_t g_night_duty = 0;
 static bool g_init_flg = false;
+static bool g_fade_installed = false;
+static uint8_t g_pattern_chn_used = 0;
+static SemaphoreHandle_t g_pattern_lock = NULL;
+
+/* a pattern step checked and converted for execution */
+typedef struct {
+    uint8_t type;
+    uint8_t duty;           /* brightness 0~100, scaled to ledc duty when the step runs */
+    uint8_t loop_to;
+    uint8_t loop_times;
+    uint8_t loop_left;      /* runs left of a loop step, reloaded when the loop ends */
+    uint32_t fade_ms;
+    uint64_t step_us;       /* fade + hold, the next step starts after it */
+} led_pattern_cmd_t;
+
+typedef struct {
+    esp_timer_handle_t timer;
+    esp_timer_handle_t fence;       /* runs after any step callback dispatched before it */
+    SemaphoreHandle_t fence_done;
+    led_pattern_cmd_t* cmds;
+    uint8_t cmd_num;
+    uint8_t pc;
+    uint8_t channel;
+    uint8_t last_duty;      /* duty of the last level step, it picks the state the led is left in */
+    int64_t due_us;         /* time the armed step ends, a callback before it belongs to a stopped run */
+    bool active;
+    bool closing;           /* the led is being deleted, a late step callback must not touch it */
+    uint16_t repeat;
+    uint16_t repeat_cnt;
+} led_pattern_t;
+
 typedef struct {
     uint8_t io_num;
     led_status_t state;
     led_dark_level_t dark_level;
     led_mode_t mode;
     uint8_t night_duty;
+    led_pattern_t pattern;
 } led_dev_t;
 
 static esp_err_t led_ledctimer_set(ledc_timer_t timer_num, uint32_t freq_hz, ledc_mode_t speed_mode)
@@ -104,6 +146,148 @@ static esp_err_t led_level_set(led_handle_t led_handle, uint8_t level)
     return ESP_OK;
 }
 
+static uint32_t led_pattern_duty(led_dev_t* led_dev, uint8_t duty)
+{
+    uint32_t val = duty * LED_BRIGHT_DUTY / 100;
+    if (led_dev->mode == LED_NIGHT_MODE) {
+        val = val * g_night_duty / 100;
+    }
+    return led_dev->dark_level == LED_DARK_LOW ? val : LED_BRIGHT_DUTY - val;
+}
+
+/* check the steps and convert them to commands, loops must jump backward so every pass takes time */
+static led_pattern_cmd_t* led_pattern_compile(const led_pattern_step_t* steps, uint8_t step_num)
+{
+    uint64_t level_us = 0;
+    for (int i = 0; i < step_num; i++) {
+        if (steps[i].type == LED_PATTERN_LEVEL) {
+            IOT_CHECK(TAG, steps[i].duty <= 100, NULL);
+            level_us += ((uint64_t) steps[i].fade_ms + steps[i].hold_ms) * 1000;
+        } else if (steps[i].type == LED_PATTERN_LOOP) {
+            IOT_CHECK(TAG, steps[i].loop_to < i, NULL);
+        } else {
+            IOT_CHECK(TAG, false, NULL);
+        }
+    }
+    IOT_CHECK(TAG, level_us > 0, NULL);
+    led_pattern_cmd_t* cmds = (led_pattern_cmd_t*) calloc(step_num, sizeof(led_pattern_cmd_t));
+    IOT_CHECK(TAG, cmds != NULL, NULL);
+    for (int i = 0; i < step_num; i++) {
+        cmds[i].type = steps[i].type;
+        cmds[i].duty = steps[i].duty;
+        cmds[i].fade_ms = steps[i].fade_ms;
+        cmds[i].step_us = ((uint64_t) steps[i].fade_ms + steps[i].hold_ms) * 1000;
+        cmds[i].loop_to = steps[i].loop_to;
+        cmds[i].loop_times = steps[i].loop_times;
+        cmds[i].loop_left = steps[i].loop_times;
+    }
+    return cmds;
+}
+
+/* stop the pattern and release its channel, call it with g_pattern_lock held */
+static void led_pattern_release_locked(led_dev_t* led_dev)
+{
+    led_pattern_t* pattern = &led_dev->pattern;
+    pattern->active = false;
+    if (pattern->timer != NULL) {
+        esp_timer_stop(pattern->timer);
+    }
+    if (pattern->cmds != NULL) {
+        free(pattern->cmds);
+        pattern->cmds = NULL;
+    }
+    if (pattern->channel != LED_PATTERN_CHANNEL_NONE) {
+        g_pattern_chn_used &= ~(1 << (pattern->channel - LED_PATTERN_CHANNEL_BASE));
+        pattern->channel = LED_PATTERN_CHANNEL_NONE;
+    }
+}
+
+/* run steps until one of them takes time, then arm the timer for it; called with g_pattern_lock held */
+static void led_pattern_exec(led_dev_t* led_dev)
+{
+    led_pattern_t* pattern = &led_dev->pattern;
+    while (pattern->active) {
+        if (pattern->pc >= pattern->cmd_num) {
+            if (pattern->repeat != 0 && ++pattern->repeat_cnt >= pattern->repeat) {
+                /* the pattern is done, free its channel and leave the led in a normal state */
+                led_pattern_release_locked(led_dev);
+                led_dev->state = pattern->last_duty ? LED_ON : LED_OFF;
+                led_level_set(led_dev, pattern->last_duty ? 1 : 0);
+                break;
+            }
+            pattern->pc = 0;
+        }
+        led_pattern_cmd_t* cmd = &pattern->cmds[pattern->pc++];
+        if (cmd->type == LED_PATTERN_LOOP) {
+            if (cmd->loop_left > 0) {
+                cmd->loop_left--;
+                pattern->pc = cmd->loop_to;
+            } else {
+                cmd->loop_left = cmd->loop_times;
+            }
+            continue;
+        }
+        uint32_t duty = led_pattern_duty(led_dev, cmd->duty);
+        pattern->last_duty = cmd->duty;
+        if (cmd->fade_ms > 0) {
+            ledc_set_fade_with_time(LED_SPEED_MODE, pattern->channel, duty, cmd->fade_ms);
+            ledc_fade_start(LED_SPEED_MODE, pattern->channel, LEDC_FADE_NO_WAIT);
+        } else {
+            ledc_set_duty(LED_SPEED_MODE, pattern->channel, duty);
+            ledc_update_duty(LED_SPEED_MODE, pattern->channel);
+        }
+        if (cmd->step_us > 0) {
+            pattern->due_us = esp_timer_get_time() + cmd->step_us;
+            esp_timer_start_once(pattern->timer, cmd->step_us);
+            break;
+        }
+    }
+}
+
+static void led_pattern_timer_cb(void* arg)
+{
+    led_dev_t* led_dev = (led_dev_t*) arg;
+    xSemaphoreTake(g_pattern_lock, portMAX_DELAY);
+    if (!led_dev->pattern.closing && esp_timer_get_time() >= led_dev->pattern.due_us) {
+        led_pattern_exec(led_dev);
+    }
+    xSemaphoreGive(g_pattern_lock);
+}
+
+/* esp_timer runs the callbacks one by one in its task, so the step callback is done when this one runs */
+static void led_pattern_fence_cb(void* arg)
+{
+    led_dev_t* led_dev = (led_dev_t*) arg;
+    xSemaphoreGive(led_dev->pattern.fence_done);
+}
+
+static void led_pattern_timer_free(led_pattern_t* pattern)
+{
+    if (pattern->timer != NULL) {
+        esp_timer_delete(pattern->timer);
+        pattern->timer = NULL;
+    }
+    if (pattern->fence != NULL) {
+        esp_timer_delete(pattern->fence);
+        pattern->fence = NULL;
+    }
+    if (pattern->fence_done != NULL) {
+        vSemaphoreDelete(pattern->fence_done);
+        pattern->fence_done = NULL;
+    }
+}
+
+/* stop the pattern and release its channel, the led output is not changed */
+static void led_pattern_release(led_dev_t* led_dev)
+{
+    if (g_pattern_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(g_pattern_lock, portMAX_DELAY);
+    led_pattern_release_locked(led_dev);
+    xSemaphoreGive(g_pattern_lock);
+}
+
 static esp_err_t led_quick_blink(led_handle_t led_handle)
 {
     led_dev_t* led_dev = (led_dev_t*) led_handle;
@@ -143,13 +327,26 @@ led_handle_t iot_led_create(uint8_t io_num, led_dark_level_t dark_level)
     led_p->dark_level = dark_level;
     led_p->state = LED_OFF;
     led_p->mode = LED_NORMAL_MODE;
+    led_p->pattern.channel = LED_PATTERN_CHANNEL_NONE;
     iot_led_state_write(led_p, LED_OFF);
     return (led_handle_t) led_p;
 }
 
 esp_err_t iot_led_delete(led_handle_t led_handle)
 {
+    led_dev_t* led_dev = (led_dev_t*) led_handle;
     POINT_ASSERT(TAG, led_handle);
+    led_pattern_t* pattern = &led_dev->pattern;
+    if (pattern->timer != NULL) {
+        xSemaphoreTake(g_pattern_lock, portMAX_DELAY);
+        pattern->closing = true;
+        led_pattern_release_locked(led_dev);
+        xSemaphoreGive(g_pattern_lock);
+        // a step callback dispatched before the stop may still wait for the lock, let it return first
+        esp_timer_start_once(pattern->fence, 0);
+        xSemaphoreTake(pattern->fence_done, portMAX_DELAY);
+        led_pattern_timer_free(pattern);
+    }
     free(led_handle);
     return ESP_OK;
 }
@@ -158,6 +355,8 @@ esp_err_t iot_led_state_write(led_handle_t led_handle, led_status_t state)
 {
     led_dev_t* led_dev = (led_dev_t*) led_handle;
     POINT_ASSERT(TAG, led_dev);
+    IOT_CHECK(TAG, state != LED_PATTERN, ESP_ERR_INVALID_ARG);
+    led_pattern_release(led_dev);
     switch (state) {
         case LED_OFF:
             led_level_set(led_handle, 0);
@@ -183,6 +382,10 @@ esp_err_t iot_led_mode_write(led_handle_t led_handle, led_mode_t mode)
     led_dev_t* led_dev = (led_dev_t*) led_handle;
     POINT_ASSERT(TAG, led_dev);
     led_dev->mode = mode;
+    if (led_dev->state == LED_PATTERN) {
+        /* the running pattern picks up the new mode from its next step */
+        return ESP_OK;
+    }
     iot_led_state_write(led_handle, led_dev->state);
     return ESP_OK;
 }
@@ -211,4 +414,79 @@ led_mode_t iot_led_mode_read(led_handle_t led_handle)
     return led_dev->mode;
 }
 
+esp_err_t iot_led_pattern_start(led_handle_t led_handle, const led_pattern_step_t* steps, uint8_t step_num, uint16_t repeat)
+{
+    led_dev_t* led_dev = (led_dev_t*) led_handle;
+    POINT_ASSERT(TAG, led_dev);
+    POINT_ASSERT(TAG, steps);
+    IOT_CHECK(TAG, step_num > 0, ESP_ERR_INVALID_ARG);
+    led_pattern_cmd_t* cmds = led_pattern_compile(steps, step_num);
+    IOT_CHECK(TAG, cmds != NULL, ESP_ERR_INVALID_ARG);
+    if (g_pattern_lock == NULL) {
+        g_pattern_lock = xSemaphoreCreateMutex();
+    }
+    if (g_pattern_lock == NULL) {
+        free(cmds);
+        return ESP_ERR_NO_MEM;
+    }
+    if (!g_fade_installed) {
+        ledc_fade_func_install(0);
+        g_fade_installed = true;
+    }
+    led_pattern_t* pattern = &led_dev->pattern;
+    if (pattern->timer == NULL) {
+        esp_timer_create_args_t timer_args = {
+            .callback = led_pattern_timer_cb,
+            .arg = led_dev,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "led_pattern",
+        };
+        esp_timer_create_args_t fence_args = {
+            .callback = led_pattern_fence_cb,
+            .arg = led_dev,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "led_fence",
+        };
+        pattern->fence_done = xSemaphoreCreateBinary();
+        if (pattern->fence_done == NULL || esp_timer_create(&timer_args, &pattern->timer) != ESP_OK
+                || esp_timer_create(&fence_args, &pattern->fence) != ESP_OK) {
+            led_pattern_timer_free(pattern);
+            free(cmds);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    led_pattern_release(led_dev);
+
+    xSemaphoreTake(g_pattern_lock, portMAX_DELAY);
+    for (int i = 0; i < LED_PATTERN_CHANNEL_NUM; i++) {
+        if ((g_pattern_chn_used & (1 << i)) == 0) {
+            g_pattern_chn_used |= (1 << i);
+            pattern->channel = LED_PATTERN_CHANNEL_BASE + i;
+            break;
+        }
+    }
+    if (pattern->channel == LED_PATTERN_CHANNEL_NONE) {
+        xSemaphoreGive(g_pattern_lock);
+        free(cmds);
+        ESP_LOGE(TAG, "no free pattern channel");
+        return ESP_ERR_NOT_FOUND;
+    }
+    gpio_ledc_bind(LED_NORMAL_TIMER, pattern->channel, led_dev->io_num, led_pattern_duty(led_dev, 0), LED_SPEED_MODE);
+    pattern->cmds = cmds;
+    pattern->cmd_num = step_num;
+    pattern->pc = 0;
+    pattern->repeat = repeat;
+    pattern->repeat_cnt = 0;
+    pattern->last_duty = 0;
+    pattern->active = true;
+    led_dev->state = LED_PATTERN;
+    led_pattern_exec(led_dev);
+    xSemaphoreGive(g_pattern_lock);
+    return ESP_OK;
+}
 
+esp_err_t iot_led_pattern_stop(led_handle_t led_handle)
+{
+    POINT_ASSERT(TAG, led_handle);
+    return iot_led_state_write(led_handle, LED_OFF);
+}
@@ -92,6 +92,16 @@ esp_err_t CLED::slow_blink()
     return iot_led_state_write(m_led_handle, LED_SLOW_BLINK);
 }
 
+esp_err_t CLED::pattern_start(const led_pattern_step_t* steps, uint8_t step_num, uint16_t repeat)
+{
+    return iot_led_pattern_start(m_led_handle, steps, step_num, repeat);
+}
+
+esp_err_t CLED::pattern_stop()
+{
+    return iot_led_pattern_stop(m_led_handle);
+}
+
 esp_err_t CLED::night_mode()
 {
     return mode_write(LED_NIGHT_MODE);
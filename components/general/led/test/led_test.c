@@ -14,6 +14,7 @@
 #include "esp_system.h"
 #include "esp_log.h"
 #include "iot_led.h"
+#include "unity.h"
 
 #define LED_IO_NUM_0    16
 #define LED_IO_NUM_1    17
@@ -47,3 +48,41 @@ void led_test()
     ets_delay_us(5 * 1000 * 1000);
     iot_led_mode_write(led_0, LED_NORMAL_MODE);
 }
+
+void led_pattern_test()
+{
+    /* three short flashes, a slow breath, then one second dark */
+    const led_pattern_step_t error_code[] = {
+        LED_STEP_LEVEL(100, 0, 150),
+        LED_STEP_LEVEL(0, 0, 150),
+        LED_STEP_LOOP(0, 2),
+        LED_STEP_LEVEL(100, 800, 0),
+        LED_STEP_LEVEL(0, 800, 1000),
+    };
+    led_0 = iot_led_create(LED_IO_NUM_0, LED_DARK_LOW);
+    led_1 = iot_led_create(LED_IO_NUM_1, LED_DARK_LOW);
+    TEST_ASSERT_EQUAL(ESP_OK, iot_led_pattern_start(led_0, error_code, sizeof(error_code) / sizeof(error_code[0]), 3));
+    TEST_ASSERT_EQUAL(ESP_OK, iot_led_pattern_start(led_1, error_code, sizeof(error_code) / sizeof(error_code[0]), 0));
+    TEST_ASSERT_EQUAL(LED_PATTERN, iot_led_state_read(led_0));
+    ets_delay_us(5 * 1000 * 1000);
+    iot_led_night_duty_write(20);
+    iot_led_mode_write(led_1, LED_NIGHT_MODE);
+    ets_delay_us(5 * 1000 * 1000);
+    iot_led_pattern_stop(led_1);
+    TEST_ASSERT_EQUAL(LED_OFF, iot_led_state_read(led_1));
+    /* led_0 ends its third run dark, its channel is free again */
+    ets_delay_us(2 * 1000 * 1000);
+    TEST_ASSERT_EQUAL(LED_OFF, iot_led_state_read(led_0));
+    TEST_ASSERT_EQUAL(ESP_OK, iot_led_mode_write(led_0, LED_NORMAL_MODE));
+    TEST_ASSERT_EQUAL(ESP_OK, iot_led_pattern_start(led_1, error_code, sizeof(error_code) / sizeof(error_code[0]), 1));
+    TEST_ASSERT_EQUAL(ESP_OK, iot_led_pattern_start(led_0, error_code, sizeof(error_code) / sizeof(error_code[0]), 1));
+    iot_led_pattern_stop(led_0);
+    iot_led_pattern_stop(led_1);
+    iot_led_delete(led_0);
+    iot_led_delete(led_1);
+}
+
+TEST_CASE("LED pattern test", "[led][iot]")
+{
+    led_pattern_test();
+}
@@ -39,6 +39,33 @@ typedef enum {
     LIGHT_CH_NUM_MAX,               /*!< user shouldn't use this */
 } light_channel_num_t;
 #define LIGHT_MAX_CHANNEL_NUM   (5)
+#define LIGHT_COLOR_LEVEL_MAX   (4096)     /*!< perceptual level of a full on channel */
+
+typedef enum {
+    LIGHT_COLOR_CH_RED = 0,         /*!< channel index of red */
+    LIGHT_COLOR_CH_GREEN,           /*!< channel index of green */
+    LIGHT_COLOR_CH_BLUE,            /*!< channel index of blue */
+    LIGHT_COLOR_CH_CW,              /*!< channel index of cold white, also used as the white of RGBW */
+    LIGHT_COLOR_CH_WW,              /*!< channel index of warm white */
+} light_color_ch_t;
+
+/**
+ * colour of a light, perceptual level (0 ~ LIGHT_COLOR_LEVEL_MAX) of each channel,
+ * it is converted to duty by a CIE 1931 lightness table when it is written
+ */
+typedef struct {
+    uint16_t level[LIGHT_MAX_CHANNEL_NUM];
+} light_color_t;
+
+/**
+ * keyframe of a scene: fade to color in fade_ms, then keep it for hold_ms
+ */
+typedef struct {
+    light_color_t color;
+    uint32_t fade_ms;
+    uint32_t hold_ms;
+} light_keyframe_t;
+
 /**
   * @brief  light initialize
   *
@@ -127,6 +154,125 @@ esp_err_t iot_light_blink_starte(light_handle_t light_handle, uint32_t channel_m
   */
 esp_err_t iot_light_blink_stop(light_handle_t light_handle);
 
+/**
+  * @brief  convert RGBW to light colour
+  *
+  * @param  color output colour
+  * @param  r red (0 ~ 255)
+  * @param  g green (0 ~ 255)
+  * @param  b blue (0 ~ 255)
+  * @param  w white (0 ~ 255), output by LIGHT_COLOR_CH_CW
+  */
+void iot_light_color_rgbw(light_color_t* color, uint8_t r, uint8_t g, uint8_t b, uint8_t w);
+
+/**
+  * @brief  convert HSV to light colour
+  *
+  * @param  color output colour
+  * @param  hue hue (0 ~ 359)
+  * @param  saturation saturation (0 ~ 100)
+  * @param  value value (0 ~ 100)
+  */
+void iot_light_color_hsv(light_color_t* color, uint16_t hue, uint8_t saturation, uint8_t value);
+
+/**
+  * @brief  convert colour temperature to light colour
+  *
+  * @param  color output colour
+  * @param  cct colour temperature (0: warm white ~ 100: cold white)
+  * @param  brightness brightness (0 ~ 100)
+  */
+void iot_light_color_cct(light_color_t* color, uint8_t cct, uint8_t brightness);
+
+/**
+  * @brief  interpolate between two colours in perceptual space
+  *
+  * @param  out output colour
+  * @param  from start colour
+  * @param  to end colour
+  * @param  pos current position
+  * @param  len length of the transition, out equals to "to" if pos >= len
+  */
+void iot_light_color_mix(light_color_t* out, const light_color_t* from, const light_color_t* to, uint32_t pos, uint32_t len);
+
+/**
+  * @brief  convert perceptual level to duty
+  *
+  * @param  level perceptual level (0 ~ LIGHT_COLOR_LEVEL_MAX)
+  * @param  full_duty full duty of the light
+  *
+  * @return duty
+  */
+uint32_t iot_light_gamma_duty(uint16_t level, uint32_t full_duty);
+
+/**
+  * @brief  convert duty to perceptual level, the inverse of iot_light_gamma_duty
+  *
+  * @param  duty duty (0 ~ full_duty)
+  * @param  full_duty full duty of the light
+  *
+  * @return perceptual level (0 ~ LIGHT_COLOR_LEVEL_MAX)
+  */
+uint16_t iot_light_gamma_level(uint32_t duty, uint32_t full_duty);
+
+/**
+  * @brief  set the colour component shown by each channel of a light
+  *
+  * @param  light_handle
+  * @param  color_ch colour component of channel 0 ~ num-1,
+  *         e.g. {LIGHT_COLOR_CH_CW, LIGHT_COLOR_CH_WW} for a two channel CCT light
+  * @param  num number of entries, at most the channel number of the light
+  *
+  * @note   By default channel i shows component i: red, green, blue, cold white, warm white.
+  *
+  * @return
+  *     - ESP_OK: succeed
+  *     - others: fail
+  */
+esp_err_t iot_light_color_map(light_handle_t light_handle, const light_color_ch_t* color_ch, uint8_t num);
+
+/**
+  * @brief  fade all the channels of light to a colour synchronously
+  *
+  * @param  light_handle
+  * @param  color target colour
+  * @param  fade_ms fade time, 0 to set the colour directly
+  *
+  * @note   All the lights share one timer, the channels are updated in the same tick.
+  *         Calling iot_light_duty_write, iot_light_breath_write or iot_light_blink_starte stops the transition.
+  *         The fade starts from the last colour written, including the duties set by these functions.
+  *
+  * @return
+  *     - ESP_OK: succeed
+  *     - others: fail
+  */
+esp_err_t iot_light_color_write(light_handle_t light_handle, const light_color_t* color, uint32_t fade_ms);
+
+/**
+  * @brief  play a scene defined by a keyframe table
+  *
+  * @param  light_handle
+  * @param  frames keyframe table, it is copied so it can be released after call
+  * @param  frame_num number of keyframes
+  * @param  repeat times to play the table, 0 to play forever
+  *
+  * @return
+  *     - ESP_OK: succeed
+  *     - others: fail
+  */
+esp_err_t iot_light_scene_start(light_handle_t light_handle, const light_keyframe_t* frames, uint8_t frame_num, uint16_t repeat);
+
+/**
+  * @brief  stop the colour transition or scene, the current colour is kept
+  *
+  * @param  light_handle
+  *
+  * @return
+  *     - ESP_OK: succeed
+  *     - others: fail
+  */
+esp_err_t iot_light_scene_stop(light_handle_t light_handle);
+
 #ifdef __cplusplus
 }
 #endif
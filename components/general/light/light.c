@@ -12,11 +12,14 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include <stdio.h>
+#include <string.h>
 #include "driver/ledc.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/timers.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "soc/ledc_reg.h"
 #include "driver/ledc.h"
 #include "iot_light.h"
@@ -29,6 +32,8 @@ static const char* TAG = "light";
 #define ERR_ASSERT(tag, param, ret)  IOT_CHECK(tag, (param) == ESP_OK, ret)
 #define POINT_ASSERT(tag, param)	IOT_CHECK(tag, (param) != NULL, ESP_FAIL)
 #define LIGHT_NUM_MAX   4
+#define LIGHT_COLOR_TICK_MS     20
+#define LIGHT_TIME_MS()         ((uint32_t)(esp_timer_get_time() / 1000))
 
 typedef struct {
     gpio_num_t io_num;
@@ -37,8 +42,24 @@ typedef struct {
     TimerHandle_t timer;
     int breath_period;
     uint32_t next_duty;
+    uint32_t full_duty;
 } light_channel_t;
 
+typedef struct {
+    light_color_t cur;
+    light_color_t from;
+    light_color_t to;
+    uint32_t start_ms;
+    uint32_t fade_ms;
+    uint32_t hold_ms;
+    light_keyframe_t* frames;
+    uint8_t frame_num;
+    uint8_t frame_idx;
+    uint16_t repeat;
+    uint16_t repeat_cnt;
+    bool active;
+} light_color_ctx_t;
+
 typedef struct {
     uint8_t channel_num;
     ledc_mode_t mode;
@@ -46,30 +67,167 @@ typedef struct {
     uint32_t full_duty;
     uint32_t freq_hz;
     ledc_timer_bit_t timer_bit;
+    uint8_t color_ch[LIGHT_MAX_CHANNEL_NUM];
+    light_color_ctx_t color;
     light_channel_t* channel_group[0];
 } light_t;
 
 static light_t* g_light_group[LIGHT_NUM_MAX];
 static bool g_fade_installed = false;
+static SemaphoreHandle_t g_color_lock = NULL;
+static TimerHandle_t g_color_timer = NULL;
 
 static void breath_timer_callback(TimerHandle_t xTimer)
 {
+    light_channel_t* l_chn = (light_channel_t*) pvTimerGetTimerID(xTimer);
+    ledc_set_fade_with_time(l_chn->mode, l_chn->channel, l_chn->next_duty, l_chn->breath_period / 2);
+    l_chn->next_duty = l_chn->full_duty - l_chn->next_duty;
+    ledc_fade_start(l_chn->mode, l_chn->channel, LEDC_FADE_NO_WAIT);
+}
+
+/* set all the duties first and latch them together, so the channels never show a mixed colour */
+static void light_color_apply(light_t* light, const light_color_t* color)
+{
+    int num = light->channel_num < LIGHT_MAX_CHANNEL_NUM ? light->channel_num : LIGHT_MAX_CHANNEL_NUM;
+    for (int i = 0; i < num; i++) {
+        light_channel_t* l_chn = light->channel_group[i];
+        if (l_chn != NULL) {
+            ledc_set_duty(l_chn->mode, l_chn->channel, iot_light_gamma_duty(color->level[light->color_ch[i]], light->full_duty));
+        }
+    }
+    for (int i = 0; i < num; i++) {
+        light_channel_t* l_chn = light->channel_group[i];
+        if (l_chn != NULL) {
+            ledc_update_duty(l_chn->mode, l_chn->channel);
+        }
+    }
+}
+
+static void light_color_load_frame(light_color_ctx_t* ctx, uint32_t start_ms)
+{
+    const light_keyframe_t* frame = &ctx->frames[ctx->frame_idx];
+    ctx->from = ctx->cur;
+    ctx->to = frame->color;
+    ctx->fade_ms = frame->fade_ms;
+    ctx->hold_ms = frame->hold_ms;
+    ctx->start_ms = start_ms;
+}
+
+/* must be called with g_color_lock held */
+static void light_color_clear(light_color_ctx_t* ctx)
+{
+    ctx->active = false;
+    if (ctx->frames != NULL) {
+        free(ctx->frames);
+        ctx->frames = NULL;
+    }
+    ctx->frame_num = 0;
+}
+
+/* must be called with g_color_lock held */
+static void light_color_step(light_t* light, uint32_t now)
+{
+    light_color_ctx_t* ctx = &light->color;
+    uint32_t elapsed = now - ctx->start_ms;
+    if (elapsed < ctx->fade_ms) {
+        iot_light_color_mix(&ctx->cur, &ctx->from, &ctx->to, elapsed, ctx->fade_ms);
+        light_color_apply(light, &ctx->cur);
+        return;
+    }
+    if (memcmp(&ctx->cur, &ctx->to, sizeof(light_color_t)) != 0) {
+        ctx->cur = ctx->to;
+        light_color_apply(light, &ctx->cur);
+    }
+    if (ctx->frames == NULL) {
+        ctx->active = false;
+        return;
+    }
+    if (elapsed < ctx->fade_ms + ctx->hold_ms) {
+        return;
+    }
+    if (++ctx->frame_idx >= ctx->frame_num) {
+        ctx->frame_idx = 0;
+        if (ctx->repeat != 0 && ++ctx->repeat_cnt >= ctx->repeat) {
+            light_color_clear(ctx);
+            return;
+        }
+    }
+    /* next frame starts where the last one should have ended, so a late tick does not stretch the scene */
+    light_color_load_frame(ctx, ctx->start_ms + ctx->fade_ms + ctx->hold_ms);
+}
+
+static void light_color_timer_callback(TimerHandle_t xTimer)
+{
+    uint32_t now = LIGHT_TIME_MS();
+    bool busy = false;
+    /* runs in the timer task, do not hold up the other timers behind a writer, the next tick catches up from the time */
+    if (xSemaphoreTake(g_color_lock, 0) != pdTRUE) {
+        return;
+    }
     for (int i = 0; i < LIGHT_NUM_MAX; i++) {
-        if (g_light_group[i] != NULL) {
-            light_t* light = g_light_group[i];
-            for (int j = 0; j < light->channel_num; j++) {
-                if (light->channel_group[j] != NULL && light->channel_group[j]->timer == xTimer) {
-                    light_channel_t* l_chn = light->channel_group[j];
-                    ledc_set_fade_with_time(l_chn->mode, l_chn->channel, l_chn->next_duty, l_chn->breath_period / 2);
-                    l_chn->next_duty = light->full_duty - l_chn->next_duty;
-                    ledc_fade_start(l_chn->mode, l_chn->channel, LEDC_FADE_NO_WAIT);
-                }
+        light_t* light = g_light_group[i];
+        if (light != NULL && light->color.active) {
+            light_color_step(light, now);
+            busy |= light->color.active;
+        }
+    }
+    /* stop inside the lock, so a start queued by a writer always comes after this stop */
+    if (!busy) {
+        xTimerStop(xTimer, 0);
+    }
+    xSemaphoreGive(g_color_lock);
+}
+
+/* stop the breath timers, return the mask of the channels that were breathing */
+static uint32_t light_channel_timer_stop(light_t* light)
+{
+    uint32_t mask = 0;
+    for (int i = 0; i < light->channel_num; i++) {
+        light_channel_t* l_chn = light->channel_group[i];
+        if (l_chn != NULL && l_chn->timer != NULL) {
+            if (xTimerIsTimerActive(l_chn->timer)) {
+                mask |= 1 << i;
             }
+            xTimerStop(l_chn->timer, portMAX_DELAY);
         }
     }
+    return mask;
 }
 
-static light_channel_t* light_channel_create(gpio_num_t io_num, ledc_channel_t channel, ledc_mode_t mode, ledc_timer_t timer)
+/* must be called with g_color_lock held */
+static void light_color_sync(light_t* light, uint32_t channel_mask)
+{
+    for (int i = 0; i < light->channel_num && i < LIGHT_MAX_CHANNEL_NUM; i++) {
+        light_channel_t* l_chn = light->channel_group[i];
+        /* a breathing channel is somewhere in its fade, continue from the duty it shows now */
+        if (l_chn != NULL && (channel_mask & (1 << i))) {
+            light->color.cur.level[light->color_ch[i]] = iot_light_gamma_level(ledc_get_duty(l_chn->mode, l_chn->channel), light->full_duty);
+        }
+    }
+}
+
+static void light_color_cancel(light_t* light)
+{
+    xSemaphoreTake(g_color_lock, portMAX_DELAY);
+    light_color_clear(&light->color);
+    xSemaphoreGive(g_color_lock);
+}
+
+/*
+ * stop the transition and record a duty written to one channel, so the next fade starts from it,
+ * full_duty is the full scale of the resolution the duty is given in
+ */
+static void light_color_set_duty(light_t* light, uint8_t channel_idx, uint32_t duty, uint32_t full_duty)
+{
+    xSemaphoreTake(g_color_lock, portMAX_DELAY);
+    light_color_clear(&light->color);
+    if (channel_idx < LIGHT_MAX_CHANNEL_NUM) {
+        light->color.cur.level[light->color_ch[channel_idx]] = iot_light_gamma_level(duty, full_duty);
+    }
+    xSemaphoreGive(g_color_lock);
+}
+
+static light_channel_t* light_channel_create(gpio_num_t io_num, ledc_channel_t channel, ledc_mode_t mode, ledc_timer_t timer, uint32_t full_duty)
 {
     ledc_channel_config_t ledc_channel = {
         .channel = channel,
@@ -87,6 +245,7 @@ static light_channel_t* light_channel_create(gpio_num_t io_num, ledc_channel_t c
     pwm->breath_period = 0;
     pwm->timer = NULL;
     pwm->next_duty = 0;
+    pwm->full_duty = full_duty;
     return pwm;
 }
 
@@ -111,6 +270,10 @@ light_handle_t iot_light_create(ledc_timer_t timer, ledc_mode_t speed_mode, uint
         .bit_num = timer_bit
     };
     ERR_ASSERT(TAG, ledc_timer_config( &timer_conf), NULL);
+    if (g_color_lock == NULL) {
+        g_color_lock = xSemaphoreCreateMutex();
+        IOT_CHECK(TAG, g_color_lock != NULL, NULL);
+    }
     light_t* light_ptr = (light_t*)calloc(1, sizeof(light_t) + sizeof(light_channel_t*) * channel_num);
     light_ptr->channel_num = channel_num;
     light_ptr->ledc_timer = timer;
@@ -121,6 +284,9 @@ light_handle_t iot_light_create(ledc_timer_t timer, ledc_mode_t speed_mode, uint
     for (int i = 0; i < channel_num; i++) {
         light_ptr->channel_group[i] = NULL;
     }
+    for (int i = 0; i < LIGHT_MAX_CHANNEL_NUM; i++) {
+        light_ptr->color_ch[i] = i;
+    }
     for (int i = 0; i < LIGHT_NUM_MAX; i++) {
         if (g_light_group[i] == NULL) {
             g_light_group[i] = light_ptr;
@@ -134,17 +300,20 @@ esp_err_t iot_light_delete(light_handle_t light_handle)
 {
     light_t* light = (light_t*)light_handle;
     POINT_ASSERT(TAG, light_handle);
-    for (int i = 0; i < light->channel_num; i++) {
-        if (light->channel_group[i] != NULL) {
-            light_channel_delete(light->channel_group[i]);
-        }
-    }
+    xSemaphoreTake(g_color_lock, portMAX_DELAY);
+    light_color_clear(&light->color);
     for (int i = 0; i < LIGHT_NUM_MAX; i++) {
         if (g_light_group[i] == light) {
             g_light_group[i] = NULL;
             break;
         }
     }
+    xSemaphoreGive(g_color_lock);
+    for (int i = 0; i < light->channel_num; i++) {
+        if (light->channel_group[i] != NULL) {
+            light_channel_delete(light->channel_group[i]);
+        }
+    }
     for (int i = 0; i < LIGHT_NUM_MAX; i++) {
         if (g_light_group[i] != NULL) {
             goto FREE_MEM;
@@ -166,7 +335,7 @@ esp_err_t iot_light_channel_regist(light_handle_t light_handle, uint8_t channel_
         ESP_LOGE(TAG, "this channel index has been registered");
         return ESP_FAIL;
     }
-    light->channel_group[channel_idx] = light_channel_create(io_num, channel, light->mode, light->ledc_timer);
+    light->channel_group[channel_idx] = light_channel_create(io_num, channel, light->mode, light->ledc_timer, light->full_duty);
     if (g_fade_installed == false) {
         ledc_fade_func_install(0);
         g_fade_installed = true;
@@ -174,17 +343,17 @@ esp_err_t iot_light_channel_regist(light_handle_t light_handle, uint8_t channel_
     return ESP_OK;
 }
 
-esp_err_t iot_light_duty_write(light_handle_t light_handle, uint8_t channel_id, uint32_t duty, light_duty_mode_t duty_mode)
+/* write a duty of the given full scale, the blink runs the timer at another resolution than light->full_duty */
+static esp_err_t light_duty_write(light_t* light, uint8_t channel_id, uint32_t duty, light_duty_mode_t duty_mode, uint32_t full_duty)
 {
-    light_t* light = (light_t*)light_handle;
-    POINT_ASSERT(TAG, light_handle);
     IOT_CHECK(TAG, channel_id < light->channel_num, ESP_FAIL);
     POINT_ASSERT(TAG, light->channel_group[channel_id]);
     light_channel_t* l_chn = light->channel_group[channel_id];
+    IOT_CHECK(TAG, duty_mode < LIGHT_DUTY_FADE_MAX, ESP_FAIL);
+    light_color_set_duty(light, channel_id, duty, full_duty);
     if(l_chn->timer != NULL) {
         xTimerStop(l_chn->timer, portMAX_DELAY);
     }
-    IOT_CHECK(TAG, duty_mode < LIGHT_DUTY_FADE_MAX, ESP_FAIL);
     switch (duty_mode) {
         case LIGHT_SET_DUTY_DIRECTLY:
             ledc_set_duty(l_chn->mode, l_chn->channel, duty);
@@ -198,6 +367,13 @@ esp_err_t iot_light_duty_write(light_handle_t light_handle, uint8_t channel_id,
     return ESP_OK;
 }
 
+esp_err_t iot_light_duty_write(light_handle_t light_handle, uint8_t channel_id, uint32_t duty, light_duty_mode_t duty_mode)
+{
+    light_t* light = (light_t*)light_handle;
+    POINT_ASSERT(TAG, light_handle);
+    return light_duty_write(light, channel_id, duty, duty_mode, light->full_duty);
+}
+
 esp_err_t iot_light_breath_write(light_handle_t light_handle, uint8_t channel_id, int breath_period_ms)
 {
     light_t* light = (light_t*)light_handle;
@@ -205,11 +381,13 @@ esp_err_t iot_light_breath_write(light_handle_t light_handle, uint8_t channel_id
     IOT_CHECK(TAG, channel_id < light->channel_num, FAIL);
     POINT_ASSERT(TAG, light->channel_group[channel_id]);
     light_channel_t* l_chn = light->channel_group[channel_id];
+    /* the breath starts from off */
+    light_color_set_duty(light, channel_id, 0, light->full_duty);
     if (l_chn->breath_period != breath_period_ms) {
         if(l_chn->timer != NULL) {
             xTimerDelete(l_chn->timer, portMAX_DELAY);
         }
-        l_chn->timer = xTimerCreate("light_breath", (breath_period_ms / 2) / portTICK_PERIOD_MS, pdTRUE, (void*) 0, breath_timer_callback);
+        l_chn->timer = xTimerCreate("light_breath", (breath_period_ms / 2) / portTICK_PERIOD_MS, pdTRUE, (void*) l_chn, breath_timer_callback);
     }
     l_chn->breath_period = breath_period_ms;
     ledc_set_duty(l_chn->mode, l_chn->channel, 0);
@@ -240,9 +418,9 @@ esp_err_t iot_light_blink_starte(light_handle_t light_handle, uint32_t channel_m
                 xTimerStop(light->channel_group[i]->timer, portMAX_DELAY);
             }
             if (channel_mask & 1<<i) {
-                iot_light_duty_write(light_handle, i, (1 << LEDC_TIMER_10_BIT) / 2, LIGHT_SET_DUTY_DIRECTLY);
+                light_duty_write(light, i, (1 << LEDC_TIMER_10_BIT) / 2, LIGHT_SET_DUTY_DIRECTLY, (1 << LEDC_TIMER_10_BIT) - 1);
             } else {
-                iot_light_duty_write(light_handle, i, 0, LIGHT_SET_DUTY_DIRECTLY);
+                light_duty_write(light, i, 0, LIGHT_SET_DUTY_DIRECTLY, (1 << LEDC_TIMER_10_BIT) - 1);
             }
         }
     }
@@ -265,3 +443,88 @@ esp_err_t iot_light_blink_stop(light_handle_t light_handle)
     }
     return ESP_OK;
 }
+
+static esp_err_t light_color_start(light_t* light, const light_color_t* color, uint32_t fade_ms,
+                                   light_keyframe_t* frames, uint8_t frame_num, uint16_t repeat)
+{
+    uint32_t breathing = light_channel_timer_stop(light);
+    xSemaphoreTake(g_color_lock, portMAX_DELAY);
+    light_color_sync(light, breathing);
+    if (g_color_timer == NULL) {
+        g_color_timer = xTimerCreate("light_color", LIGHT_COLOR_TICK_MS / portTICK_PERIOD_MS, pdTRUE, NULL, light_color_timer_callback);
+        if (g_color_timer == NULL) {
+            xSemaphoreGive(g_color_lock);
+            free(frames);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    light_color_ctx_t* ctx = &light->color;
+    light_color_clear(ctx);
+    uint32_t now = LIGHT_TIME_MS();
+    if (frames != NULL) {
+        ctx->frames = frames;
+        ctx->frame_num = frame_num;
+        ctx->frame_idx = 0;
+        ctx->repeat = repeat;
+        ctx->repeat_cnt = 0;
+        light_color_load_frame(ctx, now);
+    } else {
+        ctx->from = ctx->cur;
+        ctx->to = *color;
+        ctx->fade_ms = fade_ms;
+        ctx->hold_ms = 0;
+        ctx->start_ms = now;
+    }
+    ctx->active = true;
+    light_color_step(light, now);
+    bool active = ctx->active;
+    xSemaphoreGive(g_color_lock);
+    if (active) {
+        xTimerStart(g_color_timer, portMAX_DELAY);
+    }
+    return ESP_OK;
+}
+
+esp_err_t iot_light_color_map(light_handle_t light_handle, const light_color_ch_t* color_ch, uint8_t num)
+{
+    light_t* light = (light_t*)light_handle;
+    POINT_ASSERT(TAG, light_handle);
+    POINT_ASSERT(TAG, color_ch);
+    IOT_CHECK(TAG, num <= light->channel_num && num <= LIGHT_MAX_CHANNEL_NUM, ESP_ERR_INVALID_ARG);
+    for (int i = 0; i < num; i++) {
+        IOT_CHECK(TAG, color_ch[i] < LIGHT_MAX_CHANNEL_NUM, ESP_ERR_INVALID_ARG);
+    }
+    xSemaphoreTake(g_color_lock, portMAX_DELAY);
+    for (int i = 0; i < num; i++) {
+        light->color_ch[i] = color_ch[i];
+    }
+    xSemaphoreGive(g_color_lock);
+    return ESP_OK;
+}
+
+esp_err_t iot_light_color_write(light_handle_t light_handle, const light_color_t* color, uint32_t fade_ms)
+{
+    light_t* light = (light_t*)light_handle;
+    POINT_ASSERT(TAG, light_handle);
+    POINT_ASSERT(TAG, color);
+    return light_color_start(light, color, fade_ms, NULL, 0, 0);
+}
+
+esp_err_t iot_light_scene_start(light_handle_t light_handle, const light_keyframe_t* frames, uint8_t frame_num, uint16_t repeat)
+{
+    light_t* light = (light_t*)light_handle;
+    POINT_ASSERT(TAG, light_handle);
+    POINT_ASSERT(TAG, frames);
+    IOT_CHECK(TAG, frame_num > 0, ESP_ERR_INVALID_ARG);
+    light_keyframe_t* copy = (light_keyframe_t*)malloc(sizeof(light_keyframe_t) * frame_num);
+    POINT_ASSERT(TAG, copy);
+    memcpy(copy, frames, sizeof(light_keyframe_t) * frame_num);
+    return light_color_start(light, NULL, 0, copy, frame_num, repeat);
+}
+
+esp_err_t iot_light_scene_stop(light_handle_t light_handle)
+{
+    POINT_ASSERT(TAG, light_handle);
+    light_color_cancel((light_t*)light_handle);
+    return ESP_OK;
+}
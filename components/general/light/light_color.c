@@ -0,0 +1,154 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include <string.h>
+#include "iot_light.h"
+
+#define LIGHT_GAMMA_LUT_SHIFT   (4)             /* LIGHT_COLOR_LEVEL_MAX >> LIGHT_GAMMA_LUT_SHIFT == 256 */
+#define LIGHT_GAMMA_LUT_FULL    (65535)
+
+/* CIE 1931 lightness to luminance, 257 points over the level range, luminance scaled to 16 bits */
+static const uint16_t s_gamma_lut[(LIGHT_COLOR_LEVEL_MAX >> LIGHT_GAMMA_LUT_SHIFT) + 1] = {
+        0,    28,    57,    85,   113,   142,   170,   198,
+      227,   255,   283,   312,   340,   368,   397,   425,
+      453,   482,   510,   538,   567,   595,   625,   655,
+      686,   718,   751,   785,   821,   857,   894,   933,
+      972,  1012,  1054,  1097,  1141,  1186,  1232,  1279,
+     1328,  1378,  1429,  1481,  1535,  1590,  1646,  1703,
+     1762,  1822,  1883,  1946,  2010,  2076,  2143,  2211,
+     2281,  2352,  2425,  2500,  2575,  2653,  2731,  2812,
+     2894,  2977,  3062,  3149,  3237,  3327,  3419,  3512,
+     3607,  3704,  3802,  3902,  4004,  4108,  4213,  4320,
+     4429,  4540,  4652,  4767,  4883,  5001,  5121,  5243,
+     5367,  5493,  5621,  5751,  5882,  6016,  6152,  6289,
+     6429,  6571,  6715,  6861,  7009,  7159,  7312,  7466,
+     7623,  7782,  7943,  8106,  8272,  8439,  8609,  8781,
+     8956,  9133,  9312,  9493,  9677,  9863, 10052, 10243,
+    10436, 10632, 10830, 11030, 11234, 11439, 11647, 11858,
+    12071, 12286, 12504, 12725, 12948, 13174, 13403, 13634,
+    13868, 14104, 14343, 14585, 14830, 15077, 15327, 15579,
+    15835, 16093, 16354, 16618, 16885, 17154, 17426, 17702,
+    17980, 18261, 18545, 18831, 19121, 19414, 19710, 20008,
+    20310, 20615, 20922, 21233, 21547, 21864, 22184, 22507,
+    22833, 23163, 23495, 23831, 24170, 24512, 24857, 25206,
+    25558, 25913, 26271, 26632, 26997, 27366, 27737, 28112,
+    28490, 28872, 29257, 29645, 30037, 30432, 30831, 31233,
+    31639, 32048, 32461, 32877, 33297, 33720, 34147, 34578,
+    35012, 35450, 35891, 36336, 36785, 37237, 37693, 38153,
+    38616, 39083, 39554, 40029, 40507, 40990, 41476, 41966,
+    42460, 42957, 43459, 43964, 44473, 44987, 45504, 46025,
+    46550, 47079, 47612, 48149, 48690, 49235, 49785, 50338,
+    50895, 51457, 52022, 52592, 53166, 53744, 54326, 54912,
+    55503, 56097, 56696, 57300, 57907, 58519, 59135, 59755,
+    60380, 61009, 61642, 62280, 62922, 63569, 64220, 64875,
+    65535,
+};
+
+uint32_t iot_light_gamma_duty(uint16_t level, uint32_t full_duty)
+{
+    if (level >= LIGHT_COLOR_LEVEL_MAX) {
+        return full_duty;
+    }
+    uint32_t idx = level >> LIGHT_GAMMA_LUT_SHIFT;
+    uint32_t frac = level & ((1 << LIGHT_GAMMA_LUT_SHIFT) - 1);
+    uint32_t lum = s_gamma_lut[idx] + (((s_gamma_lut[idx + 1] - s_gamma_lut[idx]) * frac) >> LIGHT_GAMMA_LUT_SHIFT);
+    return (uint32_t)(((uint64_t) lum * full_duty + LIGHT_GAMMA_LUT_FULL / 2) / LIGHT_GAMMA_LUT_FULL);
+}
+
+uint16_t iot_light_gamma_level(uint32_t duty, uint32_t full_duty)
+{
+    if (full_duty == 0 || duty >= full_duty) {
+        return LIGHT_COLOR_LEVEL_MAX;
+    }
+    uint32_t lum = (uint32_t)(((uint64_t) duty * LIGHT_GAMMA_LUT_FULL + full_duty / 2) / full_duty);
+    /* last table point at or below lum, the table is strictly increasing */
+    uint32_t lo = 0;
+    uint32_t hi = LIGHT_COLOR_LEVEL_MAX >> LIGHT_GAMMA_LUT_SHIFT;
+    while (hi - lo > 1) {
+        uint32_t mid = (lo + hi) / 2;
+        if (s_gamma_lut[mid] <= lum) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    uint32_t span = s_gamma_lut[hi] - s_gamma_lut[lo];
+    uint32_t frac = (((lum - s_gamma_lut[lo]) << LIGHT_GAMMA_LUT_SHIFT) + span / 2) / span;
+    return (uint16_t)((lo << LIGHT_GAMMA_LUT_SHIFT) + frac);
+}
+
+static inline uint16_t light_level_8bit(uint8_t val)
+{
+    return (uint16_t)((val * LIGHT_COLOR_LEVEL_MAX + 127) / 255);
+}
+
+static inline uint16_t light_level_percent(uint8_t val)
+{
+    if (val > 100) {
+        val = 100;
+    }
+    return (uint16_t)((val * LIGHT_COLOR_LEVEL_MAX + 50) / 100);
+}
+
+void iot_light_color_rgbw(light_color_t* color, uint8_t r, uint8_t g, uint8_t b, uint8_t w)
+{
+    memset(color, 0, sizeof(light_color_t));
+    color->level[LIGHT_COLOR_CH_RED] = light_level_8bit(r);
+    color->level[LIGHT_COLOR_CH_GREEN] = light_level_8bit(g);
+    color->level[LIGHT_COLOR_CH_BLUE] = light_level_8bit(b);
+    color->level[LIGHT_COLOR_CH_CW] = light_level_8bit(w);
+}
+
+void iot_light_color_hsv(light_color_t* color, uint16_t hue, uint8_t saturation, uint8_t value)
+{
+    memset(color, 0, sizeof(light_color_t));
+    uint32_t v = light_level_percent(value);
+    uint32_t s = saturation > 100 ? 100 : saturation;
+    hue %= 360;
+    uint32_t sector = hue / 60;
+    uint32_t rem = hue % 60;
+    uint32_t p = v * (100 - s) / 100;
+    uint32_t q = v * (6000 - s * rem) / 6000;
+    uint32_t t = v * (6000 - s * (60 - rem)) / 6000;
+    uint32_t rgb[6][3] = {
+        { v, t, p }, { q, v, p }, { p, v, t },
+        { p, q, v }, { t, p, v }, { v, p, q },
+    };
+    color->level[LIGHT_COLOR_CH_RED] = rgb[sector][0];
+    color->level[LIGHT_COLOR_CH_GREEN] = rgb[sector][1];
+    color->level[LIGHT_COLOR_CH_BLUE] = rgb[sector][2];
+}
+
+void iot_light_color_cct(light_color_t* color, uint8_t cct, uint8_t brightness)
+{
+    memset(color, 0, sizeof(light_color_t));
+    uint32_t level = light_level_percent(brightness);
+    if (cct > 100) {
+        cct = 100;
+    }
+    color->level[LIGHT_COLOR_CH_CW] = level * cct / 100;
+    color->level[LIGHT_COLOR_CH_WW] = level - color->level[LIGHT_COLOR_CH_CW];
+}
+
+void iot_light_color_mix(light_color_t* out, const light_color_t* from, const light_color_t* to, uint32_t pos, uint32_t len)
+{
+    if (len == 0 || pos >= len) {
+        *out = *to;
+        return;
+    }
+    for (int i = 0; i < LIGHT_MAX_CHANNEL_NUM; i++) {
+        int32_t diff = (int32_t) to->level[i] - (int32_t) from->level[i];
+        out->level[i] = from->level[i] + (int32_t)((int64_t) diff * pos / len);
+    }
+}
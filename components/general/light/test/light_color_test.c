@@ -0,0 +1,110 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include "iot_light.h"
+#include "unity.h"
+
+#define COLOR_FULL_DUTY ((1 << 13) - 1)
+#define COLOR_LEVEL(val) ((val) * LIGHT_COLOR_LEVEL_MAX / 255)
+
+TEST_CASE("Light gamma table test", "[light][iot]")
+{
+    TEST_ASSERT_EQUAL_UINT32(0, iot_light_gamma_duty(0, COLOR_FULL_DUTY));
+    TEST_ASSERT_EQUAL_UINT32(COLOR_FULL_DUTY, iot_light_gamma_duty(LIGHT_COLOR_LEVEL_MAX, COLOR_FULL_DUTY));
+    /* CIE 1931: half lightness is about 18% luminance */
+    TEST_ASSERT_UINT32_WITHIN(COLOR_FULL_DUTY / 100, COLOR_FULL_DUTY * 18 / 100,
+                              iot_light_gamma_duty(LIGHT_COLOR_LEVEL_MAX / 2, COLOR_FULL_DUTY));
+    uint32_t last = 0;
+    for (uint32_t level = 0; level <= LIGHT_COLOR_LEVEL_MAX; level++) {
+        uint32_t duty = iot_light_gamma_duty(level, COLOR_FULL_DUTY);
+        TEST_ASSERT_TRUE(duty >= last);
+        last = duty;
+    }
+}
+
+TEST_CASE("Light gamma inverse test", "[light][iot]")
+{
+    TEST_ASSERT_EQUAL_INT(0, iot_light_gamma_level(0, COLOR_FULL_DUTY));
+    TEST_ASSERT_EQUAL_INT(LIGHT_COLOR_LEVEL_MAX, iot_light_gamma_level(COLOR_FULL_DUTY, COLOR_FULL_DUTY));
+    /* a duty read back as a level gives the same duty again, within one level step */
+    for (uint32_t duty = 0; duty <= COLOR_FULL_DUTY; duty++) {
+        uint16_t level = iot_light_gamma_level(duty, COLOR_FULL_DUTY);
+        uint32_t back = iot_light_gamma_duty(level, COLOR_FULL_DUTY);
+        uint32_t up = iot_light_gamma_duty(level + 1, COLOR_FULL_DUTY) - back;
+        uint32_t down = level > 0 ? back - iot_light_gamma_duty(level - 1, COLOR_FULL_DUTY) : 0;
+        TEST_ASSERT_UINT32_WITHIN((up > down ? up : down) / 2 + 1, duty, back);
+    }
+}
+
+TEST_CASE("Light colour conversion test", "[light][iot]")
+{
+    light_color_t color;
+    iot_light_color_rgbw(&color, 255, 128, 0, 64);
+    TEST_ASSERT_EQUAL_INT(LIGHT_COLOR_LEVEL_MAX, color.level[LIGHT_COLOR_CH_RED]);
+    TEST_ASSERT_INT_WITHIN(1, COLOR_LEVEL(128), color.level[LIGHT_COLOR_CH_GREEN]);
+    TEST_ASSERT_EQUAL_INT(0, color.level[LIGHT_COLOR_CH_BLUE]);
+    TEST_ASSERT_INT_WITHIN(1, COLOR_LEVEL(64), color.level[LIGHT_COLOR_CH_CW]);
+    TEST_ASSERT_EQUAL_INT(0, color.level[LIGHT_COLOR_CH_WW]);
+
+    const struct {
+        uint16_t hue;
+        uint16_t r, g, b;
+    } hsv[] = {
+        {0, LIGHT_COLOR_LEVEL_MAX, 0, 0},
+        {60, LIGHT_COLOR_LEVEL_MAX, LIGHT_COLOR_LEVEL_MAX, 0},
+        {120, 0, LIGHT_COLOR_LEVEL_MAX, 0},
+        {180, 0, LIGHT_COLOR_LEVEL_MAX, LIGHT_COLOR_LEVEL_MAX},
+        {240, 0, 0, LIGHT_COLOR_LEVEL_MAX},
+        {300, LIGHT_COLOR_LEVEL_MAX, 0, LIGHT_COLOR_LEVEL_MAX},
+        {30, LIGHT_COLOR_LEVEL_MAX, LIGHT_COLOR_LEVEL_MAX / 2, 0},
+    };
+    for (int i = 0; i < sizeof(hsv) / sizeof(hsv[0]); i++) {
+        iot_light_color_hsv(&color, hsv[i].hue, 100, 100);
+        TEST_ASSERT_INT_WITHIN(1, hsv[i].r, color.level[LIGHT_COLOR_CH_RED]);
+        TEST_ASSERT_INT_WITHIN(1, hsv[i].g, color.level[LIGHT_COLOR_CH_GREEN]);
+        TEST_ASSERT_INT_WITHIN(1, hsv[i].b, color.level[LIGHT_COLOR_CH_BLUE]);
+    }
+    iot_light_color_hsv(&color, 0, 0, 50);
+    TEST_ASSERT_EQUAL_INT(LIGHT_COLOR_LEVEL_MAX / 2, color.level[LIGHT_COLOR_CH_RED]);
+    TEST_ASSERT_EQUAL_INT(LIGHT_COLOR_LEVEL_MAX / 2, color.level[LIGHT_COLOR_CH_GREEN]);
+    TEST_ASSERT_EQUAL_INT(LIGHT_COLOR_LEVEL_MAX / 2, color.level[LIGHT_COLOR_CH_BLUE]);
+
+    iot_light_color_cct(&color, 25, 100);
+    TEST_ASSERT_EQUAL_INT(LIGHT_COLOR_LEVEL_MAX / 4, color.level[LIGHT_COLOR_CH_CW]);
+    TEST_ASSERT_EQUAL_INT(LIGHT_COLOR_LEVEL_MAX * 3 / 4, color.level[LIGHT_COLOR_CH_WW]);
+    TEST_ASSERT_EQUAL_INT(0, color.level[LIGHT_COLOR_CH_RED]);
+}
+
+TEST_CASE("Light colour mix test", "[light][iot]")
+{
+    light_color_t from, to, out;
+    iot_light_color_rgbw(&from, 255, 0, 0, 0);
+    iot_light_color_rgbw(&to, 0, 0, 255, 255);
+    iot_light_color_mix(&out, &from, &to, 0, 1000);
+    TEST_ASSERT_EQUAL_MEMORY(&from, &out, sizeof(light_color_t));
+    iot_light_color_mix(&out, &from, &to, 1000, 1000);
+    TEST_ASSERT_EQUAL_MEMORY(&to, &out, sizeof(light_color_t));
+    iot_light_color_mix(&out, &from, &to, 5, 0);
+    TEST_ASSERT_EQUAL_MEMORY(&to, &out, sizeof(light_color_t));
+
+    /* every channel moves by the same fraction at each step, so the fade never desyncs */
+    uint16_t last_r = LIGHT_COLOR_LEVEL_MAX;
+    for (uint32_t pos = 0; pos <= 1000; pos += 20) {
+        iot_light_color_mix(&out, &from, &to, pos, 1000);
+        TEST_ASSERT_TRUE(out.level[LIGHT_COLOR_CH_RED] <= last_r);
+        TEST_ASSERT_EQUAL_INT(LIGHT_COLOR_LEVEL_MAX, out.level[LIGHT_COLOR_CH_RED] + out.level[LIGHT_COLOR_CH_BLUE]);
+        TEST_ASSERT_EQUAL_INT(out.level[LIGHT_COLOR_CH_BLUE], out.level[LIGHT_COLOR_CH_CW]);
+        last_r = out.level[LIGHT_COLOR_CH_RED];
+    }
+}
@@ -26,6 +26,8 @@
 #define CHANNEL_B_IO    19
 
 #define LIGHT_FULL_DUTY ((1 << LEDC_TIMER_13_BIT) - 1)
+#define CHANNEL_ID_CW   0
+#define CHANNEL_ID_WW   1
 
 void light_test()
 {
@@ -54,3 +56,35 @@ TEST_CASE("Light test", "[light][iot]")
 {
     light_test();
 }
+
+TEST_CASE("Light colour map test", "[light][iot]")
+{
+    /* two channel CCT light: channel 0 shows cold white, channel 1 warm white */
+    const light_color_ch_t map[] = { LIGHT_COLOR_CH_CW, LIGHT_COLOR_CH_WW };
+    light_color_t color;
+    light_handle_t light = iot_light_create(LEDC_TIMER_0, LEDC_HIGH_SPEED_MODE, 1000, 2, LEDC_TIMER_13_BIT);
+    TEST_ASSERT_NOT_NULL(light);
+    iot_light_channel_regist(light, CHANNEL_ID_CW, CHANNEL_R_IO, LEDC_CHANNEL_0);
+    iot_light_channel_regist(light, CHANNEL_ID_WW, CHANNEL_G_IO, LEDC_CHANNEL_1);
+    TEST_ASSERT_EQUAL(ESP_OK, iot_light_color_map(light, map, 2));
+
+    iot_light_color_cct(&color, 25, 100);
+    TEST_ASSERT_EQUAL(ESP_OK, iot_light_color_write(light, &color, 0));
+    TEST_ASSERT_EQUAL_UINT32(iot_light_gamma_duty(color.level[LIGHT_COLOR_CH_CW], LIGHT_FULL_DUTY),
+                             ledc_get_duty(LEDC_HIGH_SPEED_MODE, LEDC_CHANNEL_0));
+    TEST_ASSERT_EQUAL_UINT32(iot_light_gamma_duty(color.level[LIGHT_COLOR_CH_WW], LIGHT_FULL_DUTY),
+                             ledc_get_duty(LEDC_HIGH_SPEED_MODE, LEDC_CHANNEL_1));
+
+    /* a fade starts from the duty written by iot_light_duty_write, not from the last colour */
+    iot_light_duty_write(light, CHANNEL_ID_CW, LIGHT_FULL_DUTY, LIGHT_SET_DUTY_DIRECTLY);
+    iot_light_color_cct(&color, 0, 0);
+    TEST_ASSERT_EQUAL(ESP_OK, iot_light_color_write(light, &color, 1000));
+    TEST_ASSERT_UINT32_WITHIN(LIGHT_FULL_DUTY / 100, LIGHT_FULL_DUTY, ledc_get_duty(LEDC_HIGH_SPEED_MODE, LEDC_CHANNEL_0));
+    vTaskDelay(1200 / portTICK_PERIOD_MS);
+    TEST_ASSERT_EQUAL_UINT32(0, ledc_get_duty(LEDC_HIGH_SPEED_MODE, LEDC_CHANNEL_0));
+    TEST_ASSERT_EQUAL_UINT32(0, ledc_get_duty(LEDC_HIGH_SPEED_MODE, LEDC_CHANNEL_1));
+
+    const light_color_ch_t bad_map[] = { LIGHT_COLOR_CH_CW, LIGHT_COLOR_CH_WW, LIGHT_COLOR_CH_RED };
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, iot_light_color_map(light, bad_map, 3));
+    iot_light_delete(light);
+}
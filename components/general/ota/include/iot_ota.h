@@ -17,8 +17,47 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+#include <stdbool.h>
 #include "esp_system.h"
 
+/**
+ * @brief OTA download options
+ */
+typedef struct {
+    int buf_size;                   /**< size of each of the two download buffers, rounded up to the 4 KB flash sector.
+                                         One buffer is written to flash while the other is filled from the network */
+    int recv_timeout_ms;            /**< a connection without data for this time is dropped and retried */
+    int max_retry;                  /**< reconnections after a lost connection, each one resumes at the last written block */
+    bool resume;                    /**< keep the download progress in NVS, so a later call continues an interrupted download */
+    uint32_t resume_commit_size;    /**< bytes written between two updates of the NVS progress record */
+    bool delta;                     /**< the file is a patch made by tools/ota_delta.py against the running image.
+                                         It is applied as it downloads, an interrupted patch starts again from zero */
+} iot_ota_config_t;
+
+#define IOT_OTA_CONFIG_DEFAULT() { \
+    .buf_size = 4096, \
+    .recv_timeout_ms = 10000, \
+    .max_retry = 5, \
+    .resume = true, \
+    .resume_commit_size = 64 * 1024, \
+    .delta = false, \
+}
+
+/**
+ * @brief statistics of the last OTA
+ */
+typedef struct {
+    uint32_t total;                 /**< image size, 0 if the server did not tell */
+    uint32_t written;               /**< image bytes on flash */
+    uint32_t resume_offset;         /**< image bytes already on flash from an earlier call */
+    uint32_t recv_bytes;            /**< bytes received from the network */
+    uint32_t retries;               /**< reconnections after a lost connection */
+    uint32_t elapsed_ms;            /**< duration of the OTA */
+    uint32_t flash_wait_ms;         /**< time the download waited for the flash writes */
+    uint32_t bytes_per_sec;         /**< download throughput */
+} iot_ota_stat_t;
+
 
 /**
   * @brief  start ota, you have call esp_restart to run the new app
@@ -34,6 +73,27 @@ extern "C" {
   */
 esp_err_t iot_ota_start(const char *server_ip, uint16_t server_port, const char *file_dir, uint32_t ticks_to_wait);
 
+/**
+  * @brief  start ota with the given options, you have call esp_restart to run the new app.
+  *         The response is parsed as it arrives (chunked transfer encoding included), flash writes
+  *         overlap the network reads, and an interrupted download continues with an HTTP Range request
+  *         from the last block verified on flash.
+  *
+  * @param  server_ip
+  * @param  server_port
+  * @param  file_dir the directory of target bin
+  * @param  config OTA options, NULL for IOT_OTA_CONFIG_DEFAULT()
+  * @param  ticks_to_wait ota would stop after appointed ticks
+  *
+  * @return
+  *     - ESP_OK: succeed
+  *     - ESP_ERR_TIMEOUT: the download did not complete in time or after the retries
+  *     - ESP_ERR_INVALID_STATE: another OTA is running
+  *     - others: fail
+  */
+esp_err_t iot_ota_start_with_config(const char *server_ip, uint16_t server_port, const char *file_dir,
+                                    const iot_ota_config_t *config, uint32_t ticks_to_wait);
+
 /**
  * @brief start OTA via the given URL to the file
  * @param url the URL string point to the file address
@@ -43,6 +103,19 @@ esp_err_t iot_ota_start(const char *server_ip, uint16_t server_port, const char
  */
 esp_err_t iot_ota_start_url(const char *url, uint32_t ticks_to_wait);
 
+/**
+ * @brief start OTA via the given URL with the given options
+ * @param url the URL string point to the file address
+ * @param config OTA options, NULL for IOT_OTA_CONFIG_DEFAULT()
+ * @param ticks_to_wait set timeout
+ * @return
+ *     - ESP_OK: succeed
+ *     - ESP_ERR_INVALID_VERSION: the delta patch was made against another image than the running one
+ *     - ESP_ERR_INVALID_CRC: the image produced by the delta patch does not match its hash
+ *     - others: fail, see iot_ota_start_with_config
+ */
+esp_err_t iot_ota_start_url_with_config(const char *url, const iot_ota_config_t *config, uint32_t ticks_to_wait);
+
 
 /**
  * @brief get OTA progress status
@@ -52,6 +125,22 @@ esp_err_t iot_ota_start_url(const char *url, uint32_t ticks_to_wait);
  */
 int iot_ota_get_ratio();
 
+/**
+ * @brief get the statistics of the running or last OTA
+ * @param stat pointer to the statistics to fill
+ * @return
+ *     - ESP_OK: succeed
+ *     - ESP_ERR_INVALID_ARG: stat is NULL
+ */
+esp_err_t iot_ota_get_stat(iot_ota_stat_t *stat);
+
+/**
+ * @brief drop the stored progress, the next OTA downloads the whole image
+ * @return
+ *     - ESP_OK: succeed
+ */
+esp_err_t iot_ota_clear_resume(void);
+
 #ifdef __cplusplus
 }
 #endif
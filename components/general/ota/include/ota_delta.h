@@ -0,0 +1,135 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _IOT_OTA_DELTA_H_
+#define _IOT_OTA_DELTA_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Delta OTA patch format, generated by tools/ota_delta.py. All integers are little endian.
+ *
+ * header, OTA_DELTA_HEADER_SIZE bytes:
+ *     "IOTD" | u32 version | u32 old_size | u32 new_size | old image sha256 | new image sha256
+ * followed by records until new_size bytes are produced, in the spirit of bsdiff:
+ *     varint diff_len | varint extra_len | zigzag varint seek
+ *     diff data: pairs of (varint zero_run, varint lit_len, lit_len bytes) covering diff_len bytes.
+ *                A zero run copies old bytes, a literal byte is added to the old byte.
+ *     extra data: extra_len bytes copied to the new image
+ *     then the old image position moves by seek
+ * The old image is read at random offsets, the new image is written sequentially,
+ * so applying a patch needs only the small buffers in ota_delta_t.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "mbedtls/sha256.h"
+
+#define OTA_DELTA_MAGIC         "IOTD"
+#define OTA_DELTA_VERSION       1
+#define OTA_DELTA_HEADER_SIZE   80
+#define OTA_DELTA_BUF_SIZE      256
+
+/**
+ * @brief read from the old image
+ */
+typedef esp_err_t (*ota_delta_read_cb_t)(void *arg, uint32_t offset, uint8_t *buf, int len);
+
+/**
+ * @brief write the next piece of the new image
+ */
+typedef esp_err_t (*ota_delta_write_cb_t)(void *arg, const uint8_t *data, int len);
+
+typedef enum {
+    OTA_DELTA_HEADER = 0,
+    OTA_DELTA_CTRL,
+    OTA_DELTA_ZERO_LEN,
+    OTA_DELTA_ZERO,
+    OTA_DELTA_LIT_LEN,
+    OTA_DELTA_LIT,
+    OTA_DELTA_EXTRA,
+    OTA_DELTA_DONE,
+    OTA_DELTA_ERROR,
+} ota_delta_state_t;
+
+typedef struct {
+    ota_delta_state_t state;
+    ota_delta_read_cb_t read_cb;
+    ota_delta_write_cb_t write_cb;
+    void *arg;
+    uint32_t old_size;
+    uint32_t new_size;
+    uint32_t old_pos;           /**< position in the old image */
+    uint32_t new_pos;           /**< bytes of the new image produced */
+    uint32_t diff_left;
+    uint32_t extra_left;
+    uint32_t run;               /**< bytes left in the current zero run or literal */
+    int32_t seek;
+    uint32_t ctrl[3];
+    int ctrl_idx;
+    uint32_t varint;
+    int varint_shift;
+    int hdr_len;
+    uint8_t hdr[OTA_DELTA_HEADER_SIZE];
+    uint32_t old_buf_pos;       /**< old image offset of old_buf */
+    int old_buf_len;
+    uint8_t old_buf[OTA_DELTA_BUF_SIZE];
+    int out_len;
+    uint8_t out_buf[OTA_DELTA_BUF_SIZE];
+    mbedtls_sha256_context sha;
+} ota_delta_t;
+
+/**
+ * @brief prepare to apply a patch
+ * @param delta decoder
+ * @param read_cb reads the old image, the running firmware
+ * @param write_cb receives the new image in order
+ * @param arg callback argument
+ */
+void ota_delta_init(ota_delta_t *delta, ota_delta_read_cb_t read_cb, ota_delta_write_cb_t write_cb, void *arg);
+
+/**
+ * @brief release the decoder
+ */
+void ota_delta_deinit(ota_delta_t *delta);
+
+/**
+ * @brief feed the next patch bytes, the new image is produced as they are decoded
+ * @param delta decoder
+ * @param data patch data
+ * @param len data length
+ * @return
+ *     - ESP_OK: succeed
+ *     - ESP_ERR_INVALID_VERSION: the patch was not made for the running image
+ *     - ESP_ERR_INVALID_CRC: the new image hash does not match
+ *     - ESP_ERR_INVALID_ARG: malformed patch
+ *     - others: error from the callbacks
+ */
+esp_err_t ota_delta_feed(ota_delta_t *delta, const uint8_t *data, int len);
+
+/**
+ * @brief check that the whole new image has been produced and verified
+ */
+bool ota_delta_done(const ota_delta_t *delta);
+
+/**
+ * @brief size of the new image, 0 until the header has been received
+ */
+uint32_t ota_delta_new_size(const ota_delta_t *delta);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,98 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _IOT_OTA_HTTP_H_
+#define _IOT_OTA_HTTP_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define OTA_HTTP_LINE_MAX   256     /**< longer header lines are truncated, the body is not affected */
+#define OTA_HTTP_ETAG_MAX   64
+
+/**
+ * @brief called with each piece of the decoded body, chunked framing removed
+ * @return ESP_OK to continue, others to abort the parsing with this error
+ */
+typedef esp_err_t (*ota_http_body_cb_t)(void *arg, const uint8_t *data, int len);
+
+typedef enum {
+    OTA_HTTP_STATUS_LINE = 0,
+    OTA_HTTP_HEADER,
+    OTA_HTTP_BODY,          /**< body with Content-Length, or until the connection closes */
+    OTA_HTTP_CHUNK_SIZE,
+    OTA_HTTP_CHUNK_DATA,
+    OTA_HTTP_CHUNK_END,     /**< CRLF after the chunk data */
+    OTA_HTTP_TRAILER,
+    OTA_HTTP_DONE,
+    OTA_HTTP_ERROR,
+} ota_http_state_t;
+
+/**
+ * @brief incremental HTTP/1.x response parser, fed with the data as it arrives from the socket
+ */
+typedef struct {
+    ota_http_state_t state;
+    int status;                 /**< response status code */
+    int content_length;         /**< -1 if not given */
+    int range_start;            /**< first byte of a 206 response, -1 if no Content-Range */
+    int range_total;            /**< complete resource size from Content-Range, -1 if unknown */
+    bool chunked;               /**< Transfer-Encoding: chunked */
+    char etag[OTA_HTTP_ETAG_MAX];
+    uint32_t remain;            /**< bytes left in the body or in the current chunk */
+    uint32_t body_len;          /**< decoded body bytes passed to the callback */
+    int line_len;
+    char line[OTA_HTTP_LINE_MAX];
+} ota_http_parser_t;
+
+/**
+ * @brief reset the parser for a new response
+ * @param parser parser
+ */
+void ota_http_parser_init(ota_http_parser_t *parser);
+
+/**
+ * @brief feed received data to the parser.
+ *        Parsing stops once the headers are complete, so the caller can check the status and
+ *        the headers before any body data is passed to the callback, and calls again with the rest.
+ * @param parser parser
+ * @param data received data
+ * @param len data length
+ * @param body_cb callback for the body data
+ * @param arg callback argument
+ * @return
+ *     - >=0: bytes consumed, less than len only when the headers just completed or the response is done
+ *     - <0: malformed response or the callback aborted, the state is OTA_HTTP_ERROR
+ */
+int ota_http_parse(ota_http_parser_t *parser, const uint8_t *data, int len, ota_http_body_cb_t body_cb, void *arg);
+
+/**
+ * @brief check if the response headers have been parsed
+ */
+bool ota_http_headers_done(const ota_http_parser_t *parser);
+
+/**
+ * @brief check if the complete body has been received
+ * @param parser parser
+ * @param closed the connection has been closed by the server, which ends a body without length
+ */
+bool ota_http_body_done(const ota_http_parser_t *parser, bool closed);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
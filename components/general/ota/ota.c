@@ -11,23 +11,38 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/timers.h"
+#include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "freertos/portmacro.h"
 
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "lwip/sockets.h"
 #include "iot_ota.h"
+#include "ota_http.h"
+#include "ota_delta.h"
 #include "esp_log.h"
 #include "esp_ota_ops.h"
 #include "esp_partition.h"
+#include "esp_spi_flash.h"
+#include "nvs.h"
+#include "rom/crc.h"
 #include "lwip/netdb.h"
 #include "lwip/dns.h"
 
-#define BUFF_SIZE   1024
+#define BUFF_SIZE               1024
+#define OTA_BUF_NUM             2       /**< one buffer is written to flash while the other is filled */
+#define OTA_SECTOR_SIZE         SPI_FLASH_SEC_SIZE
+#define OTA_WRITER_STACK_SIZE   3072
+#define OTA_RETRY_DELAY_MS      1000
+#define OTA_RESUME_NAMESPACE    "iot_ota"
+#define OTA_RESUME_KEY          "resume"
+#define OTA_RESUME_MAGIC        0x4f544152
 #define OTA_CHECK(tag, info, a, b)  if((a) != ESP_OK) {                                             \
         ESP_LOGE(tag,"%s %s:%d (%s)", info,__FILE__, __LINE__, __FUNCTION__);      \
         goto b;                                                                   \
@@ -45,168 +60,510 @@ static portMUX_TYPE ota_spinlock = portMUX_INITIALIZER_UNLOCKED;
 
 static xSemaphoreHandle g_ota_mux = NULL;
 static const char* TAG = "OTA";
-static bool g_ota_timeout;
 #define HTTP_STARTER_STR "http://"
 #define HTTPS_STARTER_STR "https://"
 static int ota_cur_len = 0;
 static int ota_total_length = 0;
 
-static esp_err_t connect_http_server(const char *server_ip, uint16_t server_port, int socket_id)
+typedef struct {
+    uint32_t magic;
+    uint32_t url_crc;           /**< crc32 of host, port and path */
+    uint32_t part_addr;         /**< address of the partition being written */
+    uint32_t total;             /**< image size, 0 if unknown */
+    uint32_t offset;            /**< bytes written and verified, multiple of the flash sector */
+    uint32_t crc;               /**< crc32 of the image data in [0, offset) */
+    char etag[OTA_HTTP_ETAG_MAX];
+} ota_resume_t;
+
+typedef struct {
+    int idx;                    /**< buffer index, the writer exits on -1 */
+    int len;
+    uint32_t offset;            /**< image offset of the buffer data */
+} ota_block_t;
+
+typedef struct {
+    const esp_partition_t *part;
+    iot_ota_config_t config;
+    ota_resume_t resume;        /**< owned by the writer task while blocks are queued */
+    uint32_t committed;         /**< resume offset saved to NVS */
+    bool store_ok;
+    uint8_t *buf[OTA_BUF_NUM];
+    QueueHandle_t free_q;
+    QueueHandle_t full_q;
+    SemaphoreHandle_t exit_sem;
+    volatile esp_err_t write_err;
+    /* network side */
+    int cur;                    /**< buffer being filled, -1 if none */
+    int fill;
+    uint32_t recv_offset;       /**< image offset of the next body byte */
+    uint32_t recv_bytes;        /**< bytes received from the network, headers included */
+    int64_t flash_wait_us;      /**< time the network side waited for a free buffer */
+    /* delta update */
+    const esp_partition_t *old_part;
+    ota_delta_t *delta;         /**< patch decoder, NULL for a full image */
+    esp_err_t delta_err;
+} ota_ctx_t;
+
+static iot_ota_stat_t g_ota_stat;
+
+static void ota_set_progress(uint32_t cur, uint32_t total)
+{
+    IOT_OTA_ENTER_CRITICAL();
+    ota_cur_len = cur;
+    ota_total_length = total;
+    IOT_OTA_EXIT_CRITICAL();
+}
+
+static void ota_resume_save(ota_ctx_t *ctx)
+{
+    nvs_handle handle;
+    if (!ctx->config.resume || !ctx->store_ok || ctx->committed == ctx->resume.offset) {
+        return;
+    }
+    if (nvs_open(OTA_RESUME_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        ESP_LOGW(TAG, "NVS not available, interrupted downloads start from zero");
+        ctx->store_ok = false;
+        return;
+    }
+    if (nvs_set_blob(handle, OTA_RESUME_KEY, &ctx->resume, sizeof(ota_resume_t)) == ESP_OK
+            && nvs_commit(handle) == ESP_OK) {
+        ctx->committed = ctx->resume.offset;
+    }
+    nvs_close(handle);
+}
+
+static void ota_resume_clear(void)
 {
-    if (socket_id == -1) {
-        return ESP_ERR_INVALID_ARG;
-    }
-    ESP_LOGI(TAG, "Server IP: %s Server Port: %d", server_ip, server_port);
-    struct sockaddr_in sock_info;
-    memset(&sock_info, 0, sizeof(struct sockaddr_in));
-    sock_info.sin_family = AF_INET;
-    sock_info.sin_addr.s_addr = inet_addr(server_ip);
-    sock_info.sin_port = htons(server_port);
-    IOT_CHECK(TAG, -1 != connect(socket_id, (struct sockaddr*)&sock_info, sizeof(sock_info)), ESP_FAIL);
-    ESP_LOGI(TAG, "Connected to server");
+    nvs_handle handle;
+    if (nvs_open(OTA_RESUME_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_erase_key(handle, OTA_RESUME_KEY);
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+}
+
+/* load the resume record and check the data on flash still matches it */
+static void ota_resume_load(ota_ctx_t *ctx, uint32_t url_crc)
+{
+    nvs_handle handle;
+    ota_resume_t rec;
+    size_t len = sizeof(rec);
+    memset(&ctx->resume, 0, sizeof(ota_resume_t));
+    ctx->resume.magic = OTA_RESUME_MAGIC;
+    ctx->resume.url_crc = url_crc;
+    ctx->resume.part_addr = ctx->part->address;
+    ctx->committed = 0;
+    ctx->store_ok = ctx->config.resume;
+    if (!ctx->config.resume || nvs_open(OTA_RESUME_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    esp_err_t ret = nvs_get_blob(handle, OTA_RESUME_KEY, &rec, &len);
+    nvs_close(handle);
+    if (ret != ESP_OK || len != sizeof(rec) || rec.magic != OTA_RESUME_MAGIC || rec.url_crc != url_crc
+            || rec.part_addr != ctx->part->address || rec.offset > ctx->part->size) {
+        return;
+    }
+    uint32_t crc = 0;
+    for (uint32_t pos = 0; pos < rec.offset; pos += ctx->config.buf_size) {
+        int n = rec.offset - pos < ctx->config.buf_size ? rec.offset - pos : ctx->config.buf_size;
+        if (esp_partition_read(ctx->part, pos, ctx->buf[0], n) != ESP_OK) {
+            return;
+        }
+        crc = crc32_le(crc, ctx->buf[0], n);
+    }
+    if (crc != rec.crc) {
+        ESP_LOGW(TAG, "resume data on flash does not match, download from zero");
+        return;
+    }
+    ctx->resume = rec;
+    ctx->committed = rec.offset;
+    ESP_LOGI(TAG, "resume download at %u / %u", rec.offset, rec.total);
+}
+
+static esp_err_t ota_flash_write(ota_ctx_t *ctx, const ota_block_t *blk)
+{
+    if (blk->offset != ctx->resume.offset || blk->offset + blk->len > ctx->part->size) {
+        ESP_LOGE(TAG, "OTA write out of order or image too large: %u + %d", blk->offset, blk->len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    /* blocks start on a sector boundary, erase just the sectors they cover */
+    uint32_t erase_len = (blk->len + OTA_SECTOR_SIZE - 1) / OTA_SECTOR_SIZE * OTA_SECTOR_SIZE;
+    esp_err_t ret = esp_partition_erase_range(ctx->part, blk->offset, erase_len);
+    if (ret == ESP_OK) {
+        ret = esp_partition_write(ctx->part, blk->offset, ctx->buf[blk->idx], blk->len);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "OTA write data error.");
+        return ret;
+    }
+    ctx->resume.crc = crc32_le(ctx->resume.crc, ctx->buf[blk->idx], blk->len);
+    ctx->resume.offset += blk->len;
+    ota_set_progress(ctx->resume.offset, ctx->resume.total);
+    if (ctx->resume.offset % OTA_SECTOR_SIZE == 0
+            && ctx->resume.offset - ctx->committed >= ctx->config.resume_commit_size) {
+        ota_resume_save(ctx);
+    }
     return ESP_OK;
 }
 
-static bool erase_http_header(uint8_t *buff, int total_len, int *data_len)
+static void ota_writer_task(void *arg)
 {
-    char *pstr = strstr((char*)buff, "\r\n\r\n");
-    if (pstr) {
-        pstr += 4;
-        int write_len = total_len - ((uint8_t*)pstr - buff);
-        *data_len = write_len;
-        int i = 0;
-        while (i < write_len) {
-            buff[i] = pstr[i];
-            i++;
+    ota_ctx_t *ctx = (ota_ctx_t *) arg;
+    ota_block_t blk;
+    while (xQueueReceive(ctx->full_q, &blk, portMAX_DELAY) == pdTRUE && blk.idx >= 0) {
+        if (ctx->write_err == ESP_OK) {
+            ctx->write_err = ota_flash_write(ctx, &blk);
         }
-        return true;
+        xQueueSend(ctx->free_q, &blk.idx, portMAX_DELAY);
     }
-    else {
-        return false;
+    xSemaphoreGive(ctx->exit_sem);
+    vTaskDelete(NULL);
+}
+
+/* wait until the writer has written every queued block and is idle */
+static void ota_writer_drain(ota_ctx_t *ctx)
+{
+    int idx[OTA_BUF_NUM];
+    if (ctx->cur >= 0) {
+        xQueueSend(ctx->free_q, &ctx->cur, portMAX_DELAY);
+        ctx->cur = -1;
+    }
+    for (int i = 0; i < OTA_BUF_NUM; i++) {
+        xQueueReceive(ctx->free_q, &idx[i], portMAX_DELAY);
     }
+    for (int i = 0; i < OTA_BUF_NUM; i++) {
+        xQueueSend(ctx->free_q, &idx[i], portMAX_DELAY);
+    }
+    ctx->fill = 0;
+}
+
+static esp_err_t ota_submit(ota_ctx_t *ctx)
+{
+    ota_block_t blk = { .idx = ctx->cur, .len = ctx->fill, .offset = ctx->recv_offset - ctx->fill };
+    xQueueSend(ctx->full_q, &blk, portMAX_DELAY);
+    ctx->cur = -1;
+    ctx->fill = 0;
+    return ctx->write_err;
+}
+
+/* body data of the HTTP response, copied into the buffer that is not being written to flash */
+static esp_err_t ota_body_cb(void *arg, const uint8_t *data, int len)
+{
+    ota_ctx_t *ctx = (ota_ctx_t *) arg;
+    while (len > 0) {
+        if (ctx->cur < 0) {
+            int64_t start = esp_timer_get_time();
+            xQueueReceive(ctx->free_q, &ctx->cur, portMAX_DELAY);
+            ctx->flash_wait_us += esp_timer_get_time() - start;
+            if (ctx->write_err != ESP_OK) {
+                return ctx->write_err;
+            }
+        }
+        int n = ctx->config.buf_size - ctx->fill;
+        n = n < len ? n : len;
+        memcpy(ctx->buf[ctx->cur] + ctx->fill, data, n);
+        ctx->fill += n;
+        ctx->recv_offset += n;
+        data += n;
+        len -= n;
+        if (ctx->fill == ctx->config.buf_size && ota_submit(ctx) != ESP_OK) {
+            return ctx->write_err;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ota_delta_read_cb(void *arg, uint32_t offset, uint8_t *buf, int len)
+{
+    ota_ctx_t *ctx = (ota_ctx_t *) arg;
+    return esp_partition_read(ctx->old_part, offset, buf, len);
+}
+
+/* body data of a delta patch, the decoded image goes on to ota_body_cb */
+static esp_err_t ota_delta_body_cb(void *arg, const uint8_t *data, int len)
+{
+    ota_ctx_t *ctx = (ota_ctx_t *) arg;
+    esp_err_t ret = ota_delta_feed(ctx->delta, data, len);
+    if (ret != ESP_OK) {
+        ctx->delta_err = ctx->write_err != ESP_OK ? ctx->write_err : ret;
+        return ret;
+    }
+    if (ctx->resume.total == 0 && ota_delta_new_size(ctx->delta) > 0) {
+        ctx->resume.total = ota_delta_new_size(ctx->delta);
+        if (ctx->resume.total > ctx->part->size) {
+            ESP_LOGE(TAG, "image size %u exceeds the partition", ctx->resume.total);
+            ctx->delta_err = ESP_ERR_INVALID_SIZE;
+            return ESP_ERR_INVALID_SIZE;
+        }
+        ota_set_progress(ctx->recv_offset, ctx->resume.total);
+    }
+    return ESP_OK;
 }
 
-static void download_timer_cb(TimerHandle_t xTimer)
+static int ota_http_connect(const char *server_ip, uint16_t server_port, int recv_timeout_ms)
 {
-    int socket_id = (int) pvTimerGetTimerID(xTimer);
-    g_ota_timeout = true;
+    const struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *res = NULL;
+    char port_str[8];
+    snprintf(port_str, sizeof(port_str), "%d", server_port);
+    int err = getaddrinfo(server_ip, port_str, &hints, &res);
+    if (err != 0 || res == NULL) {
+        ESP_LOGE(TAG, "DNS lookup failed err=%d res=%p", err, res);
+        if (res) {
+            freeaddrinfo(res);
+        }
+        return -1;
+    }
+    int socket_id = socket(AF_INET, SOCK_STREAM, 0);
     if (socket_id >= 0) {
-        close(socket_id);
+        struct timeval tv;
+        tv.tv_sec = recv_timeout_ms / 1000;
+        tv.tv_usec = (recv_timeout_ms % 1000) * 1000;
+        setsockopt(socket_id, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        if (connect(socket_id, res->ai_addr, res->ai_addrlen) != 0) {
+            ESP_LOGE(TAG, "connect http server error!");
+            close(socket_id);
+            socket_id = -1;
+        }
     }
+    freeaddrinfo(res);
+    return socket_id;
 }
 
-#define CONTENT_LEN_STR  "Content-Length: "
-static int ota_get_content_length(uint8_t* data_buf)
+static esp_err_t ota_http_request(int socket_id, const char *server_ip, uint16_t server_port, const char *file_dir,
+                                  const ota_resume_t *resume)
 {
-    char* ptr = strstr((const char*)data_buf, CONTENT_LEN_STR);
-    int length = -1;
-    if (ptr) {
-        ptr = ptr + strlen(CONTENT_LEN_STR);
-        length = atoi(ptr);
+    char range[32 + OTA_HTTP_ETAG_MAX] = "";
+    if (resume->offset > 0) {
+        int n = snprintf(range, sizeof(range), "Range: bytes=%u-\r\n", resume->offset);
+        /* the server sends the whole file instead of a range if it changed since */
+        if (resume->etag[0]) {
+            snprintf(range + n, sizeof(range) - n, "If-Range: %s\r\n", resume->etag);
+        }
+    }
+    const char *GET_FORMAT =
+        "GET %s HTTP/1.1\r\n"
+        "Host: %s:%d\r\n"
+        "Connection: close\r\n"
+        "%s"
+        "User-Agent: esp-idf/1.0 esp32\r\n\r\n";
+    char *http_request = NULL;
+    int get_len = asprintf(&http_request, GET_FORMAT, file_dir, server_ip, server_port, range);
+    if (get_len < 0) {
+        ESP_LOGE(TAG, "Failed to allocate memory for GET request buffer");
+        return ESP_ERR_NO_MEM;
     }
-    return length;
+    int ret = send(socket_id, http_request, get_len, 0);
+    free(http_request);
+    return ret == get_len ? ESP_OK : ESP_FAIL;
 }
 
-static esp_err_t ota_download(int socket_id, esp_ota_handle_t ota_handle)
+/* check the response headers, the writer is idle at this point */
+static esp_err_t ota_http_check(ota_ctx_t *ctx, const ota_http_parser_t *parser)
 {
-    IOT_CHECK(TAG, socket_id != -1, ESP_ERR_INVALID_ARG);
-    esp_err_t ret = ESP_OK;
-    bool resp_start = false;
-    uint8_t* data_buff = (uint8_t*) calloc(1, BUFF_SIZE);
-    if (data_buff == NULL) {
-        ret = ESP_FAIL;
+    if (parser->status == 200) {
+        if (ctx->resume.offset > 0) {
+            ESP_LOGW(TAG, "server sent the whole image, download from zero");
+        }
+        g_ota_stat.resume_offset = 0;
+        ctx->resume.offset = 0;
+        ctx->resume.crc = 0;
+        ctx->resume.total = parser->content_length > 0 ? parser->content_length : 0;
+        if (ctx->delta) {
+            /* the image size comes with the patch header */
+            ctx->resume.total = 0;
+        }
+    } else if (parser->status == 206 && parser->range_start == (int) ctx->resume.offset
+               && (ctx->resume.total == 0 || parser->range_total < 0 || parser->range_total == (int) ctx->resume.total)) {
+        if (parser->range_total > 0) {
+            ctx->resume.total = parser->range_total;
+        }
+    } else {
+        ESP_LOGE(TAG, "unexpected HTTP status %d, range %d", parser->status, parser->range_start);
+        /* a range of another file or offset is retried from zero */
+        if (parser->status == 206 || parser->status == 416) {
+            ctx->resume.offset = 0;
+            ctx->resume.crc = 0;
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (ctx->resume.total > ctx->part->size) {
+        ESP_LOGE(TAG, "image size %u exceeds the partition", ctx->resume.total);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    strncpy(ctx->resume.etag, parser->etag, OTA_HTTP_ETAG_MAX);
+    ctx->recv_offset = ctx->resume.offset;
+    ota_set_progress(ctx->resume.offset, ctx->resume.total);
+    return ESP_OK;
+}
+
+static esp_err_t ota_download(ota_ctx_t *ctx, int socket_id, int64_t deadline_us)
+{
+    ota_http_parser_t *parser = (ota_http_parser_t *) calloc(1, sizeof(ota_http_parser_t));
+    uint8_t *data_buff = (uint8_t *) malloc(BUFF_SIZE);
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    if (parser == NULL || data_buff == NULL) {
         ESP_LOGE(TAG, "OTA no enought memory for data buffer");
         goto EXIT;
     }
-    int total_len = 0;
+    ota_http_parser_init(parser);
     for (;;) {
-        memset(data_buff, 0, BUFF_SIZE);
-        int recv_len = recv(socket_id, data_buff, BUFF_SIZE, 0);
-        if (recv_len < 0) {
-            ESP_LOGE(TAG, "recv_len < 0");
-            ret = ESP_FAIL;
+        if (deadline_us > 0 && esp_timer_get_time() > deadline_us) {
+            ret = ESP_ERR_TIMEOUT;
+            break;
         }
-        if (recv_len > 0 && !resp_start) {
-            int data_len = 0;
-            int content_len = ota_get_content_length(data_buff);
-            if (content_len > 0) {
-                ESP_LOGD(TAG, "Content length: %d", content_len);
-                ota_total_length = content_len;
-            } else {
-                continue;
-            }
-            resp_start = erase_http_header(data_buff, recv_len, &data_len);
-            ret = esp_ota_write(ota_handle, data_buff, data_len);
+        int recv_len = recv(socket_id, data_buff, BUFF_SIZE, 0);
+        if (recv_len <= 0) {
+            ret = ota_http_body_done(parser, recv_len == 0) ? ESP_OK : ESP_ERR_TIMEOUT;
             if (ret != ESP_OK) {
-                ret = ESP_FAIL;
-                ESP_LOGE(TAG, "OTA write data error.");
-                goto EXIT;
+                ESP_LOGW(TAG, "connection lost at %u", ctx->recv_offset);
             }
-            total_len += data_len;
-        } else if (recv_len > 0 && resp_start) {
-            ret = esp_ota_write(ota_handle, data_buff, recv_len);
-            if (ret != ESP_OK) {
-                ret = ESP_FAIL;
-                ESP_LOGE(TAG, "OTA write data error.");
+            break;
+        }
+        ctx->recv_bytes += recv_len;
+        int pos = 0;
+        while (pos < recv_len && !ota_http_body_done(parser, false)) {
+            bool headers = ota_http_headers_done(parser);
+            int n = ota_http_parse(parser, data_buff + pos, recv_len - pos,
+                                   ctx->delta ? ota_delta_body_cb : ota_body_cb, ctx);
+            if (n < 0) {
+                ret = ctx->delta_err != ESP_OK ? ctx->delta_err
+                      : ctx->write_err != ESP_OK ? ctx->write_err : ESP_ERR_INVALID_RESPONSE;
                 goto EXIT;
             }
-            total_len += recv_len;
-            ota_cur_len = total_len;
-        } else if (recv_len == 0 && ota_cur_len == ota_total_length && ota_total_length > 0) {
-            if (!g_ota_timeout) {
-                ESP_LOGD(TAG, "all packets received, total length: %d / %d", total_len, ota_total_length);
-            } else {
-                ESP_LOGE(TAG, "OTA timeout!");
-                ret = ESP_ERR_TIMEOUT;
+            pos += n;
+            if (!headers && ota_http_headers_done(parser) && (ret = ota_http_check(ctx, parser)) != ESP_OK) {
                 goto EXIT;
             }
+        }
+        if (ota_http_body_done(parser, false)) {
+            ret = ESP_OK;
             break;
-        } else {
-            ESP_LOGE(TAG, "Unexpected recv result");
         }
-        ESP_LOGD(TAG, "Have written image length %d / %d", total_len, ota_total_length);
     }
-    EXIT:
-    if (data_buff) {
-        free(data_buff);
-        data_buff = NULL;
+    if (ret == ESP_OK && ctx->delta && !ota_delta_done(ctx->delta)) {
+        ESP_LOGE(TAG, "delta patch incomplete");
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    /* the last block is shorter than the buffer */
+    if (ret == ESP_OK && ctx->fill > 0) {
+        ret = ota_submit(ctx);
     }
+EXIT:
+    free(parser);
+    free(data_buff);
     return ret;
 }
 
-int iot_ota_get_ratio()
+static bool ota_retryable(esp_err_t err)
 {
-    int ret = -1;
-    IOT_OTA_ENTER_CRITICAL();
-    if (ota_total_length > 0) {
-        ret = ota_cur_len * 100 / ota_total_length;
+    return err == ESP_FAIL || err == ESP_ERR_TIMEOUT || err == ESP_ERR_INVALID_RESPONSE;
+}
+
+static void ota_ctx_free(ota_ctx_t *ctx)
+{
+    if (ctx->delta) {
+        ota_delta_deinit(ctx->delta);
+        free(ctx->delta);
     }
-    IOT_OTA_EXIT_CRITICAL();
-    return ret;
+    for (int i = 0; i < OTA_BUF_NUM; i++) {
+        free(ctx->buf[i]);
+    }
+    if (ctx->free_q) {
+        vQueueDelete(ctx->free_q);
+    }
+    if (ctx->full_q) {
+        vQueueDelete(ctx->full_q);
+    }
+    if (ctx->exit_sem) {
+        vSemaphoreDelete(ctx->exit_sem);
+    }
+    free(ctx);
 }
 
-esp_err_t iot_ota_start(const char *server_ip, uint16_t server_port, const char *file_dir, uint32_t ticks_to_wait)
+static ota_ctx_t *ota_ctx_create(const esp_partition_t *part, const iot_ota_config_t *config)
+{
+    ota_ctx_t *ctx = (ota_ctx_t *) calloc(1, sizeof(ota_ctx_t));
+    if (ctx == NULL) {
+        return NULL;
+    }
+    ctx->part = part;
+    ctx->config = *config;
+    ctx->config.buf_size = (config->buf_size + OTA_SECTOR_SIZE - 1) / OTA_SECTOR_SIZE * OTA_SECTOR_SIZE;
+    if (ctx->config.buf_size == 0) {
+        ctx->config.buf_size = OTA_SECTOR_SIZE;
+    }
+    ctx->cur = -1;
+    if (config->delta) {
+        /* progress is kept as a patch offset only, a delta download always starts from zero */
+        ctx->config.resume = false;
+        ctx->old_part = esp_ota_get_running_partition();
+        ctx->delta = (ota_delta_t *) calloc(1, sizeof(ota_delta_t));
+        if (ctx->delta == NULL) {
+            free(ctx);
+            return NULL;
+        }
+        ota_delta_init(ctx->delta, ota_delta_read_cb, ota_body_cb, ctx);
+    }
+    ctx->free_q = xQueueCreate(OTA_BUF_NUM, sizeof(int));
+    ctx->full_q = xQueueCreate(OTA_BUF_NUM + 1, sizeof(ota_block_t));
+    ctx->exit_sem = xSemaphoreCreateBinary();
+    bool ok = ctx->free_q && ctx->full_q && ctx->exit_sem;
+    for (int i = 0; i < OTA_BUF_NUM && ok; i++) {
+        ctx->buf[i] = (uint8_t *) malloc(ctx->config.buf_size);
+        ok = ctx->buf[i] != NULL;
+        if (ok) {
+            xQueueSend(ctx->free_q, &i, 0);
+        }
+    }
+    if (!ok || xTaskCreate(ota_writer_task, "ota_writer", OTA_WRITER_STACK_SIZE, ctx,
+                           uxTaskPriorityGet(NULL), NULL) != pdPASS) {
+        ota_ctx_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+static void ota_ctx_delete(ota_ctx_t *ctx)
 {
-    ota_cur_len = 0;
-    ota_total_length = 0;
-    TimerHandle_t ota_timer = NULL;
-    int socket_id = -1;
+    ota_block_t stop = { .idx = -1 };
+    ota_writer_drain(ctx);
+    xQueueSend(ctx->full_q, &stop, portMAX_DELAY);
+    xSemaphoreTake(ctx->exit_sem, portMAX_DELAY);
+    ota_ctx_free(ctx);
+}
+
+esp_err_t iot_ota_start_with_config(const char *server_ip, uint16_t server_port, const char *file_dir,
+                                    const iot_ota_config_t *config, uint32_t ticks_to_wait)
+{
+    iot_ota_config_t default_config = IOT_OTA_CONFIG_DEFAULT();
     esp_err_t ret = ESP_FAIL;
-    esp_ota_handle_t upgrade_handle = 0;
+    ota_ctx_t *ctx = NULL;
     POINT_ASSERT(TAG, server_ip, ESP_ERR_INVALID_ARG);
     POINT_ASSERT(TAG, file_dir, ESP_ERR_INVALID_ARG);
+    if (config == NULL) {
+        config = &default_config;
+    }
     if (g_ota_mux == NULL) {
         g_ota_mux = xSemaphoreCreateMutex();
     }
     if (g_ota_mux == NULL) {
-        ret = ESP_ERR_NO_MEM;
-        goto OTA_FINISH;
+        return ESP_ERR_NO_MEM;
     }
-    if (pdTRUE != xSemaphoreTake(g_ota_mux, 0)){
-        ret = ESP_ERR_INVALID_STATE;
-        goto OTA_FINISH;
+    if (pdTRUE != xSemaphoreTake(g_ota_mux, 0)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ota_set_progress(0, 0);
+    memset(&g_ota_stat, 0, sizeof(g_ota_stat));
+    int64_t start_us = esp_timer_get_time();
+    int64_t deadline_us = 0;
+    if (ticks_to_wait != portMAX_DELAY) {
+        deadline_us = start_us + (int64_t) ticks_to_wait * portTICK_PERIOD_MS * 1000;
     }
-    g_ota_timeout = false;
 
     ESP_LOGI(TAG, "ota starting");
     const esp_partition_t *upgrade_part = NULL;
@@ -214,140 +571,141 @@ esp_err_t iot_ota_start(const char *server_ip, uint16_t server_port, const char
     const esp_partition_t *part_running = esp_ota_get_running_partition();
     if (part_confed != part_running) {
         ESP_LOGI(TAG, "partition error");
-        ret = ESP_FAIL;
         goto OTA_FINISH;
     }
-    ESP_LOGI(TAG, "Running partition type %d subtype %d (offset 0x%08x)",
-             part_confed->type, part_confed->subtype, part_confed->address);
-
-
-    /* Erase flash */
     upgrade_part = esp_ota_get_next_update_partition(NULL);
     if (upgrade_part == NULL) {
-        ret = ESP_FAIL;
         goto OTA_FINISH;
     }
-    ESP_LOGI(TAG, "Erasing to partition subtype %d at offset 0x%x",
-                upgrade_part->subtype, upgrade_part->address);
-    ret = esp_ota_begin(upgrade_part, OTA_SIZE_UNKNOWN, &upgrade_handle);
-    OTA_CHECK(TAG, "ota begin error!", ret, OTA_FINISH);
-
-
+    ESP_LOGI(TAG, "Writing to partition subtype %d at offset 0x%x", upgrade_part->subtype, upgrade_part->address);
+    ctx = ota_ctx_create(upgrade_part, config);
+    if (ctx == NULL) {
+        ESP_LOGE(TAG, "OTA no enought memory for data buffer");
+        ret = ESP_ERR_NO_MEM;
+        goto OTA_FINISH;
+    }
 
-    ESP_LOGI(TAG, "OTA DNS running...");
-    const struct addrinfo hints = {
-        .ai_family = AF_INET,
-        .ai_socktype = SOCK_STREAM,
-    };
-    struct addrinfo *res;
-    ESP_LOGI(TAG, "Running DNS lookup for %s...", server_ip);
-    char *port_str = NULL;
-    asprintf(&port_str, "%d", server_port);
+    char url_id[16];
+    snprintf(url_id, sizeof(url_id), ":%d", server_port);
+    uint32_t url_crc = crc32_le(0, (const uint8_t *) server_ip, strlen(server_ip));
+    url_crc = crc32_le(url_crc, (const uint8_t *) url_id, strlen(url_id));
+    url_crc = crc32_le(url_crc, (const uint8_t *) file_dir, strlen(file_dir));
+    ota_resume_load(ctx, url_crc);
+    g_ota_stat.resume_offset = ctx->resume.offset;
 
-    int err = getaddrinfo(server_ip, port_str, &hints, &res);
-    if (err != 0 || res == NULL) {
-        ESP_LOGI(TAG, "DNS lookup failed err=%d res=%p", err, res);
-        if (res) {
-            freeaddrinfo(res);
+    bool restarted = false;
+    for (int retry = 0; ; retry++) {
+        /* a lost connection leaves a partly filled buffer, continue from the last written block */
+        ota_writer_drain(ctx);
+        if (ctx->write_err != ESP_OK) {
+            ret = ctx->write_err;
+            break;
+        }
+        if (ctx->delta) {
+            /* the decoder state can not be rebuilt at a block boundary, apply the patch again */
+            ctx->resume.offset = 0;
+            ctx->resume.crc = 0;
+            ctx->resume.total = 0;
+            ctx->delta_err = ESP_OK;
+            ota_delta_deinit(ctx->delta);
+            ota_delta_init(ctx->delta, ota_delta_read_cb, ota_body_cb, ctx);
         }
+        int socket_id = ota_http_connect(server_ip, server_port, ctx->config.recv_timeout_ms);
         ret = ESP_FAIL;
-        goto OTA_FINISH;
-    }
-    /* Start a timer for checking timeout */
-    if (ticks_to_wait != portMAX_DELAY) {
-        ota_timer = xTimerCreate("ota_timer", ticks_to_wait, pdFALSE, (void*)socket_id, download_timer_cb);
-        if (ota_timer == NULL) {
-            ret = ESP_ERR_NO_MEM;
-            goto OTA_FINISH;
+        if (socket_id >= 0) {
+            ret = ota_http_request(socket_id, server_ip, server_port, file_dir, &ctx->resume);
+            if (ret == ESP_OK) {
+                ret = ota_download(ctx, socket_id, deadline_us);
+            }
+            close(socket_id);
         }
-        //todo: to check the result of RTOS timer APIs.
-        if (pdTRUE != xTimerStart(ota_timer, ticks_to_wait / portTICK_PERIOD_MS)) {
-            ret = ESP_ERR_TIMEOUT;
-            goto OTA_FINISH;
+        if (ret == ESP_ERR_INVALID_RESPONSE && !restarted) {
+            /* the stored range does not fit the file on the server any more, start over at once */
+            restarted = true;
+            retry--;
+            continue;
+        }
+        if (ret == ESP_OK || !ota_retryable(ret) || retry >= ctx->config.max_retry
+                || (deadline_us > 0 && esp_timer_get_time() > deadline_us)) {
+            break;
         }
+        g_ota_stat.retries++;
+        ESP_LOGW(TAG, "download interrupted (0x%x), retry %d", ret, retry + 1);
+        vTaskDelay(OTA_RETRY_DELAY_MS * (retry < 4 ? retry + 1 : 5) / portTICK_PERIOD_MS);
+    }
+    ota_writer_drain(ctx);
+    if (ret == ESP_OK) {
+        ret = ctx->write_err;
+    }
+    if (ret == ESP_OK && ctx->resume.total > 0 && ctx->resume.offset != ctx->resume.total) {
+        ESP_LOGE(TAG, "image incomplete: %u / %u", ctx->resume.offset, ctx->resume.total);
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    if (ret == ESP_OK) {
+        /* the whole image is on flash, the next download starts from zero whatever the result */
+        ota_resume_clear();
+        ota_set_progress(ctx->resume.offset, ctx->resume.offset);
+        ret = esp_ota_set_boot_partition(upgrade_part);
+        OTA_CHECK(TAG, "set boot partition error!", ret, OTA_FINISH);
+        ESP_LOGI(TAG, "ota succeed");
+    } else {
+        /* keep what was written for the next call */
+        ota_resume_save(ctx);
     }
 
-    /* Note: inet_ntoa is non-reentrant, look at ipaddr_ntoa_r for "real" code */
-    struct in_addr *addr = &((struct sockaddr_in *) res->ai_addr)->sin_addr;
-    ESP_LOGI(TAG, "DNS lookup succeeded. IP=%s", inet_ntoa(*addr));
-    char *server_addr = NULL;
-    asprintf(&server_addr, "%s", inet_ntoa(*addr));
-    server_ip = server_addr;
-
-    socket_id = socket(AF_INET, SOCK_STREAM, 0);
-    if (socket_id == -1) {
-        ESP_LOGI(TAG, "create socket error!");
-        ret = ESP_ERR_NO_MEM;
-        goto OTA_FINISH;
-    }
+OTA_FINISH:
+    if (ctx) {
+        int64_t elapsed_us = esp_timer_get_time() - start_us;
+        g_ota_stat.total = ctx->resume.total;
+        g_ota_stat.written = ctx->resume.offset;
+        g_ota_stat.recv_bytes = ctx->recv_bytes;
+        g_ota_stat.elapsed_ms = elapsed_us / 1000;
+        g_ota_stat.flash_wait_ms = ctx->flash_wait_us / 1000;
+        g_ota_stat.bytes_per_sec = elapsed_us > 0 ? (uint32_t) (ctx->recv_bytes * 1000000LL / elapsed_us) : 0;
+        ESP_LOGI(TAG, "%u bytes in %u ms, %u KB/s, waited %u ms for flash, %u retries",
+                 g_ota_stat.recv_bytes, g_ota_stat.elapsed_ms, g_ota_stat.bytes_per_sec / 1024,
+                 g_ota_stat.flash_wait_ms, g_ota_stat.retries);
+        ota_ctx_delete(ctx);
+    }
+    xSemaphoreGive(g_ota_mux);
+    return ret;
+}
 
-    ret = connect_http_server(server_ip, server_port, socket_id);
-    OTA_CHECK(TAG, "connect http server error!", ret, OTA_FINISH);
-    /*send GET request to http server*/
-    const char *GET_FORMAT =
-        "GET %s HTTP/1.0\r\n"
-        "Host: %s:%d\r\n"
-        "User-Agent: esp-idf/1.0 esp32\r\n\r\n";
-    char *http_request = NULL;
-    int get_len = asprintf(&http_request, GET_FORMAT, file_dir, server_ip, server_port);
-    if (get_len < 0) {
-        ESP_LOGE(TAG, "Failed to allocate memory for GET request buffer");
-        ret = ESP_ERR_NO_MEM;
-        goto OTA_FINISH;
-    }
-    ret = send(socket_id, http_request, get_len, 0);
-    free(http_request);
+esp_err_t iot_ota_start(const char *server_ip, uint16_t server_port, const char *file_dir, uint32_t ticks_to_wait)
+{
+    return iot_ota_start_with_config(server_ip, server_port, file_dir, NULL, ticks_to_wait);
+}
 
-    if (ret == -1) {
-        ESP_LOGI(TAG, "send request to server  error!");
-        ret = ESP_FAIL;
-        goto OTA_FINISH;
-    }
+esp_err_t iot_ota_get_stat(iot_ota_stat_t *stat)
+{
+    POINT_ASSERT(TAG, stat, ESP_ERR_INVALID_ARG);
+    *stat = g_ota_stat;
+    return ESP_OK;
+}
 
-    ret = ota_download(socket_id, upgrade_handle);
-    OTA_CHECK(TAG, "ota data download error!", ret, OTA_FINISH);
-    //Stop timer since downloading has finished.
-    if (ota_timer) {
-        xTimerStop(ota_timer, ticks_to_wait / portTICK_PERIOD_MS);
-    }
-    ret = esp_ota_end(upgrade_handle);
-    upgrade_handle = 0;
-    OTA_CHECK(TAG, "ota end error!", ret, OTA_FINISH);
-    ret = esp_ota_set_boot_partition(upgrade_part);
-    OTA_CHECK(TAG, "set boot partition error!", ret, OTA_FINISH);
-    ESP_LOGI(TAG, "ota succeed");
+esp_err_t iot_ota_clear_resume(void)
+{
+    ota_resume_clear();
+    return ESP_OK;
+}
 
-OTA_FINISH:
-    if (server_addr) {
-        free(server_addr);
-        server_addr = NULL;
-    }
-    if (port_str) {
-        free(port_str);
-        port_str = NULL;
-    }
-    if (upgrade_handle != 0) {
-        esp_ota_end(upgrade_handle);
-        upgrade_handle = 0;
-    }
-    if (g_ota_timeout == true) {
-        ESP_LOGI(TAG, "ota timeout");
-        ret = ESP_ERR_TIMEOUT;
-    } else if (socket_id != -1) {
-        close(socket_id);
-    }
-    if (ticks_to_wait != portMAX_DELAY && ota_timer != NULL) {
-        xTimerStop(ota_timer, 0);
-        xTimerDelete(ota_timer, 0);
-        ota_timer = NULL;
-    }
-    if (g_ota_mux != NULL) {
-        xSemaphoreGive(g_ota_mux);
+int iot_ota_get_ratio()
+{
+    int ret = -1;
+    IOT_OTA_ENTER_CRITICAL();
+    if (ota_total_length > 0) {
+        ret = ota_cur_len * 100 / ota_total_length;
     }
+    IOT_OTA_EXIT_CRITICAL();
     return ret;
 }
 
 esp_err_t iot_ota_start_url(const char *url, uint32_t ticks_to_wait)
+{
+    return iot_ota_start_url_with_config(url, NULL, ticks_to_wait);
+}
+
+esp_err_t iot_ota_start_url_with_config(const char *url, const iot_ota_config_t *config, uint32_t ticks_to_wait)
 {
     esp_err_t ret = ESP_FAIL;
     char *server_addr = NULL;
@@ -407,7 +765,7 @@ esp_err_t iot_ota_start_url(const char *url, uint32_t ticks_to_wait)
         ret = ESP_ERR_INVALID_ARG;
         goto error;
     }
-    ret = iot_ota_start(server_addr, port, file_path, ticks_to_wait);
+    ret = iot_ota_start_with_config(server_addr, port, file_path, config, ticks_to_wait);
 
     error: if (server_addr) {
         free(server_addr);
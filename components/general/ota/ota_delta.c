@@ -0,0 +1,286 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include "esp_log.h"
+#include "ota_delta.h"
+
+static const char *TAG = "ota_delta";
+
+#define OTA_DELTA_FAIL(delta, err, msg) do {   \
+        ESP_LOGE(TAG, "%s", msg);              \
+        (delta)->state = OTA_DELTA_ERROR;      \
+        return (err);                          \
+    } while (0)
+
+static uint32_t ota_delta_get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+void ota_delta_init(ota_delta_t *delta, ota_delta_read_cb_t read_cb, ota_delta_write_cb_t write_cb, void *arg)
+{
+    memset(delta, 0, sizeof(ota_delta_t));
+    delta->state = OTA_DELTA_HEADER;
+    delta->read_cb = read_cb;
+    delta->write_cb = write_cb;
+    delta->arg = arg;
+    mbedtls_sha256_init(&delta->sha);
+}
+
+void ota_delta_deinit(ota_delta_t *delta)
+{
+    mbedtls_sha256_free(&delta->sha);
+}
+
+static esp_err_t ota_delta_flush(ota_delta_t *delta)
+{
+    esp_err_t ret = ESP_OK;
+    if (delta->out_len > 0) {
+        mbedtls_sha256_update_ret(&delta->sha, delta->out_buf, delta->out_len);
+        ret = delta->write_cb(delta->arg, delta->out_buf, delta->out_len);
+        delta->out_len = 0;
+    }
+    return ret;
+}
+
+static esp_err_t ota_delta_emit(ota_delta_t *delta, uint8_t c)
+{
+    delta->out_buf[delta->out_len++] = c;
+    delta->new_pos++;
+    return delta->out_len == OTA_DELTA_BUF_SIZE ? ota_delta_flush(delta) : ESP_OK;
+}
+
+/* old image byte at old_pos, read through a small window */
+static esp_err_t ota_delta_old_byte(ota_delta_t *delta, uint8_t *c)
+{
+    uint32_t pos = delta->old_pos;
+    if (pos < delta->old_buf_pos || pos >= delta->old_buf_pos + delta->old_buf_len) {
+        int len = delta->old_size - pos < OTA_DELTA_BUF_SIZE ? delta->old_size - pos : OTA_DELTA_BUF_SIZE;
+        esp_err_t ret = delta->read_cb(delta->arg, pos, delta->old_buf, len);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        delta->old_buf_pos = pos;
+        delta->old_buf_len = len;
+    }
+    *c = delta->old_buf[pos - delta->old_buf_pos];
+    delta->old_pos++;
+    return ESP_OK;
+}
+
+/* hash the old image and compare it with the one the patch was made against */
+static esp_err_t ota_delta_check_old(ota_delta_t *delta)
+{
+    uint8_t digest[32];
+    mbedtls_sha256_context sha;
+    esp_err_t ret = ESP_OK;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts_ret(&sha, 0);
+    for (uint32_t pos = 0; pos < delta->old_size && ret == ESP_OK; pos += OTA_DELTA_BUF_SIZE) {
+        int len = delta->old_size - pos < OTA_DELTA_BUF_SIZE ? delta->old_size - pos : OTA_DELTA_BUF_SIZE;
+        ret = delta->read_cb(delta->arg, pos, delta->old_buf, len);
+        mbedtls_sha256_update_ret(&sha, delta->old_buf, len);
+    }
+    mbedtls_sha256_finish_ret(&sha, digest);
+    mbedtls_sha256_free(&sha);
+    delta->old_buf_len = 0;
+    if (ret == ESP_OK && memcmp(digest, delta->hdr + 16, 32) != 0) {
+        ret = ESP_ERR_INVALID_VERSION;
+    }
+    return ret;
+}
+
+static esp_err_t ota_delta_header(ota_delta_t *delta)
+{
+    if (memcmp(delta->hdr, OTA_DELTA_MAGIC, 4) != 0 || ota_delta_get_u32(delta->hdr + 4) != OTA_DELTA_VERSION) {
+        OTA_DELTA_FAIL(delta, ESP_ERR_INVALID_ARG, "not a delta patch");
+    }
+    delta->old_size = ota_delta_get_u32(delta->hdr + 8);
+    delta->new_size = ota_delta_get_u32(delta->hdr + 12);
+    esp_err_t ret = ota_delta_check_old(delta);
+    if (ret != ESP_OK) {
+        OTA_DELTA_FAIL(delta, ret, "the patch does not apply to the running image");
+    }
+    mbedtls_sha256_starts_ret(&delta->sha, 0);
+    delta->state = OTA_DELTA_CTRL;
+    return ESP_OK;
+}
+
+static esp_err_t ota_delta_finish(ota_delta_t *delta)
+{
+    uint8_t digest[32];
+    esp_err_t ret = ota_delta_flush(delta);
+    if (ret != ESP_OK) {
+        delta->state = OTA_DELTA_ERROR;
+        return ret;
+    }
+    mbedtls_sha256_finish_ret(&delta->sha, digest);
+    if (memcmp(digest, delta->hdr + 48, 32) != 0) {
+        OTA_DELTA_FAIL(delta, ESP_ERR_INVALID_CRC, "new image hash mismatch");
+    }
+    delta->state = OTA_DELTA_DONE;
+    return ESP_OK;
+}
+
+/* unsigned LEB128, returns true once the value is complete */
+static bool ota_delta_varint(ota_delta_t *delta, uint8_t c, uint32_t *value)
+{
+    delta->varint |= (uint32_t) (c & 0x7f) << delta->varint_shift;
+    delta->varint_shift += 7;
+    if (c & 0x80) {
+        return false;
+    }
+    *value = delta->varint;
+    delta->varint = 0;
+    delta->varint_shift = 0;
+    return true;
+}
+
+esp_err_t ota_delta_feed(ota_delta_t *delta, const uint8_t *data, int len)
+{
+    esp_err_t ret = ESP_OK;
+    int pos = 0;
+    uint8_t c;
+
+    for (;;) {
+        if (delta->state == OTA_DELTA_ERROR) {
+            return ESP_FAIL;
+        }
+        if (delta->state == OTA_DELTA_DONE) {
+            if (pos < len) {
+                OTA_DELTA_FAIL(delta, ESP_ERR_INVALID_ARG, "data after the end of the patch");
+            }
+            return ESP_OK;
+        }
+        /* a zero run copies the old image without patch input */
+        if (delta->state == OTA_DELTA_ZERO) {
+            while (delta->run > 0 && ret == ESP_OK) {
+                ret = ota_delta_old_byte(delta, &c);
+                if (ret == ESP_OK) {
+                    ret = ota_delta_emit(delta, c);
+                }
+                delta->run--;
+            }
+            if (ret != ESP_OK) {
+                delta->state = OTA_DELTA_ERROR;
+                return ret;
+            }
+            delta->state = OTA_DELTA_LIT_LEN;
+            continue;
+        }
+        if (delta->state == OTA_DELTA_EXTRA && delta->extra_left == 0) {
+            int64_t old_pos = (int64_t) delta->old_pos + delta->seek;
+            if (old_pos < 0 || old_pos > delta->old_size) {
+                OTA_DELTA_FAIL(delta, ESP_ERR_INVALID_ARG, "seek out of the old image");
+            }
+            delta->old_pos = old_pos;
+            if (delta->new_pos == delta->new_size) {
+                return ota_delta_finish(delta);
+            }
+            delta->state = OTA_DELTA_CTRL;
+            continue;
+        }
+        if (pos == len) {
+            return ESP_OK;
+        }
+
+        switch (delta->state) {
+        case OTA_DELTA_HEADER: {
+            int n = OTA_DELTA_HEADER_SIZE - delta->hdr_len;
+            n = n < len - pos ? n : len - pos;
+            memcpy(delta->hdr + delta->hdr_len, data + pos, n);
+            delta->hdr_len += n;
+            pos += n;
+            if (delta->hdr_len == OTA_DELTA_HEADER_SIZE && (ret = ota_delta_header(delta)) != ESP_OK) {
+                return ret;
+            }
+            break;
+        }
+        case OTA_DELTA_CTRL:
+            if (!ota_delta_varint(delta, data[pos++], &delta->ctrl[delta->ctrl_idx]) || ++delta->ctrl_idx < 3) {
+                break;
+            }
+            delta->ctrl_idx = 0;
+            delta->diff_left = delta->ctrl[0];
+            delta->extra_left = delta->ctrl[1];
+            delta->seek = (int32_t) (delta->ctrl[2] >> 1) ^ -(int32_t) (delta->ctrl[2] & 1);
+            if ((uint64_t) delta->new_pos + delta->diff_left + delta->extra_left > delta->new_size
+                    || (uint64_t) delta->old_pos + delta->diff_left > delta->old_size) {
+                OTA_DELTA_FAIL(delta, ESP_ERR_INVALID_ARG, "record out of range");
+            }
+            delta->state = delta->diff_left > 0 ? OTA_DELTA_ZERO_LEN : OTA_DELTA_EXTRA;
+            break;
+        case OTA_DELTA_ZERO_LEN:
+        case OTA_DELTA_LIT_LEN:
+            if (!ota_delta_varint(delta, data[pos++], &delta->run)) {
+                break;
+            }
+            if (delta->run > delta->diff_left) {
+                OTA_DELTA_FAIL(delta, ESP_ERR_INVALID_ARG, "diff run out of range");
+            }
+            delta->diff_left -= delta->run;
+            if (delta->state == OTA_DELTA_ZERO_LEN) {
+                delta->state = OTA_DELTA_ZERO;
+            } else {
+                delta->state = OTA_DELTA_LIT;
+            }
+            /* an empty literal ends the pair at once */
+            if (delta->state == OTA_DELTA_LIT && delta->run == 0) {
+                delta->state = delta->diff_left > 0 ? OTA_DELTA_ZERO_LEN : OTA_DELTA_EXTRA;
+            }
+            break;
+        case OTA_DELTA_LIT:
+            while (pos < len && delta->run > 0 && ret == ESP_OK) {
+                ret = ota_delta_old_byte(delta, &c);
+                if (ret == ESP_OK) {
+                    ret = ota_delta_emit(delta, c + data[pos++]);
+                }
+                delta->run--;
+            }
+            if (ret != ESP_OK) {
+                delta->state = OTA_DELTA_ERROR;
+                return ret;
+            }
+            if (delta->run == 0) {
+                delta->state = delta->diff_left > 0 ? OTA_DELTA_ZERO_LEN : OTA_DELTA_EXTRA;
+            }
+            break;
+        case OTA_DELTA_EXTRA: {
+            int n = delta->extra_left < (uint32_t) (len - pos) ? delta->extra_left : len - pos;
+            for (int i = 0; i < n && ret == ESP_OK; i++) {
+                ret = ota_delta_emit(delta, data[pos + i]);
+            }
+            if (ret != ESP_OK) {
+                delta->state = OTA_DELTA_ERROR;
+                return ret;
+            }
+            pos += n;
+            delta->extra_left -= n;
+            break;
+        }
+        default:
+            OTA_DELTA_FAIL(delta, ESP_ERR_INVALID_ARG, "bad decoder state");
+        }
+    }
+}
+
+bool ota_delta_done(const ota_delta_t *delta)
+{
+    return delta->state == OTA_DELTA_DONE;
+}
+
+uint32_t ota_delta_new_size(const ota_delta_t *delta)
+{
+    return delta->state > OTA_DELTA_HEADER ? delta->new_size : 0;
+}
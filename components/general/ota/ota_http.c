@@ -0,0 +1,186 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <ctype.h>
+#include "ota_http.h"
+
+void ota_http_parser_init(ota_http_parser_t *parser)
+{
+    memset(parser, 0, sizeof(ota_http_parser_t));
+    parser->state = OTA_HTTP_STATUS_LINE;
+    parser->content_length = -1;
+    parser->range_start = -1;
+    parser->range_total = -1;
+}
+
+static bool ota_http_header_is(const char *line, const char *name, const char **value)
+{
+    int len = strlen(name);
+    if (strncasecmp(line, name, len) != 0 || line[len] != ':') {
+        return false;
+    }
+    line += len + 1;
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+    *value = line;
+    return true;
+}
+
+static esp_err_t ota_http_parse_header(ota_http_parser_t *parser, const char *line)
+{
+    const char *value = NULL;
+    if (ota_http_header_is(line, "Content-Length", &value)) {
+        if (!isdigit((int) value[0])) {
+            return ESP_FAIL;
+        }
+        parser->content_length = atoi(value);
+    } else if (ota_http_header_is(line, "Transfer-Encoding", &value)) {
+        parser->chunked = strstr(value, "chunked") != NULL;
+    } else if (ota_http_header_is(line, "Content-Range", &value)) {
+        /* bytes <start>-<end>/<total or *> */
+        if (strncasecmp(value, "bytes ", 6) == 0) {
+            parser->range_start = atoi(value + 6);
+            const char *total = strchr(value, '/');
+            parser->range_total = (total && isdigit((int) total[1])) ? atoi(total + 1) : -1;
+        }
+    } else if (ota_http_header_is(line, "ETag", &value)) {
+        strncpy(parser->etag, value, OTA_HTTP_ETAG_MAX - 1);
+        parser->etag[OTA_HTTP_ETAG_MAX - 1] = '\0';
+    }
+    return ESP_OK;
+}
+
+/* called with every complete line, CRLF removed */
+static esp_err_t ota_http_parse_line(ota_http_parser_t *parser, char *line)
+{
+    switch (parser->state) {
+    case OTA_HTTP_STATUS_LINE:
+        if (strncmp(line, "HTTP/1.", 7) != 0 || strlen(line) < 12) {
+            return ESP_FAIL;
+        }
+        parser->status = atoi(line + 9);
+        parser->state = OTA_HTTP_HEADER;
+        break;
+    case OTA_HTTP_HEADER:
+        if (line[0] != '\0') {
+            return ota_http_parse_header(parser, line);
+        }
+        /* informational response, the real one follows */
+        if (parser->status >= 100 && parser->status < 200) {
+            ota_http_parser_init(parser);
+        } else if (parser->chunked) {
+            parser->state = OTA_HTTP_CHUNK_SIZE;
+        } else if (parser->content_length == 0 || parser->status == 204 || parser->status == 304) {
+            parser->state = OTA_HTTP_DONE;
+        } else {
+            parser->remain = parser->content_length;
+            parser->state = OTA_HTTP_BODY;
+        }
+        break;
+    case OTA_HTTP_CHUNK_SIZE: {
+        char *end = NULL;
+        unsigned long size = strtoul(line, &end, 16);
+        if (end == line) {
+            return ESP_FAIL;
+        }
+        parser->remain = size;
+        parser->state = size > 0 ? OTA_HTTP_CHUNK_DATA : OTA_HTTP_TRAILER;
+        break;
+    }
+    case OTA_HTTP_CHUNK_END:
+        if (line[0] != '\0') {
+            return ESP_FAIL;
+        }
+        parser->state = OTA_HTTP_CHUNK_SIZE;
+        break;
+    case OTA_HTTP_TRAILER:
+        if (line[0] == '\0') {
+            parser->state = OTA_HTTP_DONE;
+        }
+        break;
+    default:
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+int ota_http_parse(ota_http_parser_t *parser, const uint8_t *data, int len, ota_http_body_cb_t body_cb, void *arg)
+{
+    int pos = 0;
+    while (pos < len) {
+        ota_http_state_t state = parser->state;
+        if (state == OTA_HTTP_DONE) {
+            break;
+        } else if (state == OTA_HTTP_ERROR) {
+            return -1;
+        } else if (state == OTA_HTTP_BODY || state == OTA_HTTP_CHUNK_DATA) {
+            /* body data goes to the callback straight from the receive buffer */
+            uint32_t n = len - pos;
+            bool sized = state == OTA_HTTP_CHUNK_DATA || parser->content_length >= 0;
+            if (sized && n > parser->remain) {
+                n = parser->remain;
+            }
+            if (body_cb && body_cb(arg, data + pos, n) != ESP_OK) {
+                parser->state = OTA_HTTP_ERROR;
+                return -1;
+            }
+            parser->body_len += n;
+            pos += n;
+            if (sized) {
+                parser->remain -= n;
+                if (parser->remain == 0) {
+                    parser->state = state == OTA_HTTP_CHUNK_DATA ? OTA_HTTP_CHUNK_END : OTA_HTTP_DONE;
+                }
+            }
+            continue;
+        }
+        /* line based states */
+        char c = data[pos++];
+        if (c == '\n') {
+            if (parser->line_len > 0 && parser->line[parser->line_len - 1] == '\r') {
+                parser->line_len--;
+            }
+            parser->line[parser->line_len] = '\0';
+            parser->line_len = 0;
+            if (ota_http_parse_line(parser, parser->line) != ESP_OK) {
+                parser->state = OTA_HTTP_ERROR;
+                return -1;
+            }
+            if (state == OTA_HTTP_HEADER && parser->state != OTA_HTTP_HEADER && parser->state != OTA_HTTP_STATUS_LINE) {
+                /* headers complete, let the caller look at them before the body */
+                break;
+            }
+        } else if (parser->line_len < OTA_HTTP_LINE_MAX - 1) {
+            parser->line[parser->line_len++] = c;
+        }
+    }
+    return pos;
+}
+
+bool ota_http_headers_done(const ota_http_parser_t *parser)
+{
+    return parser->state > OTA_HTTP_HEADER && parser->state != OTA_HTTP_ERROR;
+}
+
+bool ota_http_body_done(const ota_http_parser_t *parser, bool closed)
+{
+    if (parser->state == OTA_HTTP_DONE) {
+        return true;
+    }
+    /* a body without length and without chunks ends with the connection */
+    return closed && parser->state == OTA_HTTP_BODY && parser->content_length < 0;
+}
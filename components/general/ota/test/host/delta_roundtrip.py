@@ -0,0 +1,100 @@
+#!/usr/bin/env python
+#
+# Round trip of a delta OTA patch: make a patch with tools/ota_delta.py and apply it
+# with the device decoder (ota_delta.c built into ota_delta_host), so the encoder and
+# the decoder can't drift apart.
+#
+#   delta_roundtrip.py <ota_delta_host> [work dir]
+#
+# The images are synthetic firmware: code-like bytes with an insert, a delete, a moved
+# block, scattered relocations and an appended tail. The patch is fed in pieces of
+# 1, 7, 1000 and 100000 bytes and the new image must come out byte exact. A patch
+# applied to another running image and a corrupted patch must be refused.
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+TOOL = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "tools", "ota_delta.py")
+FEEDS = (1, 7, 1000, 100000)
+ESP_ERR_INVALID_ARG = 0x102
+ESP_ERR_INVALID_CRC = 0x109
+ESP_ERR_INVALID_VERSION = 0x10A
+
+
+def code(rnd, n):
+    common = b"\x00\x10\x20\x3f\x40\x80\xff"
+    return bytes(rnd.randrange(256) if rnd.random() < 0.3 else rnd.choice(common) for _ in range(n))
+
+
+def make_images(seed=1, size=300000):
+    rnd = random.Random(seed)
+    old = code(rnd, size)
+    new = bytearray(old)
+    new[size // 3:size // 3] = code(rnd, 3000)
+    for i in range(0, len(new), 97):
+        if rnd.random() < 0.2:
+            new[i] = (new[i] + 4) & 0xff
+    del new[size * 2 // 3:size * 2 // 3 + 2000]
+    block = new[size // 6:size // 6 + 10000]
+    del new[size // 6:size // 6 + 10000]
+    new[size * 5 // 6:size * 5 // 6] = block
+    new += code(rnd, 5000)
+    return old, bytes(new)
+
+
+def apply(host, old_path, patch_path, out_path, feed):
+    out = subprocess.run([host, old_path, patch_path, out_path, str(feed)], stdout=subprocess.PIPE,
+                         universal_newlines=True).stdout.strip()
+    if out == "ok":
+        return 0
+    if out.startswith("error "):
+        return int(out.split()[1], 16)
+    raise RuntimeError("ota_delta_host: %r" % out)
+
+
+def main():
+    host = os.path.abspath(sys.argv[1])
+    work = sys.argv[2] if len(sys.argv) > 2 else tempfile.mkdtemp()
+    os.makedirs(work, exist_ok=True)
+    path = {k: os.path.join(work, k + ".bin") for k in ("old", "new", "patch", "out", "bad")}
+    old, new = make_images()
+    for k, data in (("old", old), ("new", new)):
+        with open(path[k], "wb") as f:
+            f.write(data)
+    subprocess.check_call([sys.executable, TOOL, "diff", path["old"], path["new"], path["patch"]])
+    with open(path["patch"], "rb") as f:
+        patch = f.read()
+    print("old %d bytes, new %d bytes, patch %d bytes" % (len(old), len(new), len(patch)))
+
+    failures = 0
+    for feed in FEEDS:
+        ret = apply(host, path["old"], path["patch"], path["out"], feed)
+        with open(path["out"], "rb") as f:
+            ok = ret == 0 and f.read() == new
+        print("feed %6d: %s" % (feed, "ok" if ok else "FAIL 0x%x" % ret))
+        failures += not ok
+
+    # the running image is not the one the patch was made for
+    with open(path["bad"], "wb") as f:
+        f.write(old[:1000] + bytes([old[1000] ^ 1]) + old[1001:])
+    ret = apply(host, path["bad"], path["patch"], path["out"], 1000)
+    print("other running image: 0x%x" % ret)
+    failures += ret != ESP_ERR_INVALID_VERSION
+
+    # a corrupted patch body gives another image or a malformed record
+    bad = bytearray(patch)
+    bad[len(bad) - 100] ^= 0x55
+    with open(path["bad"], "wb") as f:
+        f.write(bad)
+    ret = apply(host, path["old"], path["bad"], path["out"], 1000)
+    print("corrupted patch: 0x%x" % ret)
+    failures += ret not in (ESP_ERR_INVALID_CRC, ESP_ERR_INVALID_ARG)
+
+    print("FAILED %d" % failures if failures else "ALL PASS")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,50 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _OTA_HOST_H_
+#define _OTA_HOST_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_partition.h"
+
+#define HOST_OTA_0_ADDR     0x10000
+#define HOST_OTA_1_ADDR     0x110000
+#define HOST_OTA_SIZE       0x100000
+
+typedef struct {
+    int fd;                         /**< file that holds the flash */
+    esp_partition_t part[2];        /**< running partition and update partition */
+    int us_per_kb;                  /**< write time, to slow the flash down */
+    int bad_writes;                 /**< bytes written without an erase before */
+    int nvs_writes;
+    const uint8_t *expect;          /**< image the update partition must hold when it is made bootable */
+    size_t expect_len;
+    bool boot_set;
+} host_flash_t;
+
+extern host_flash_t g_host_flash;
+extern int g_host_log;
+
+/**
+  * @brief  create the flash file, not erased
+  */
+void host_flash_open(const char *path);
+
+/**
+  * @brief  write raw data to the flash, e.g. the running image or a corruption
+  */
+void host_flash_put(uint32_t addr, const void *data, size_t len);
+
+#endif
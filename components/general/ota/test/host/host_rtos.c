@@ -0,0 +1,385 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * pthread stand-ins for the FreeRTOS calls the OTA code makes, in-memory NVS,
+ * and a flash file with the running and the update partition. The flash has
+ * NOR semantics: a write that would need to set a bit counts as a bad write.
+ * Setting the boot partition checks the update partition against the image
+ * the test expects, in place of esp_image_verify().
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_ota_ops.h"
+#include "nvs.h"
+#include "rom/crc.h"
+#include "host.h"
+
+#define HOST_NVS_NUM        4
+#define HOST_NVS_BLOB_MAX   256
+
+int g_host_log = 0;
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned len;
+    unsigned item_size;
+    unsigned head;
+    unsigned num;
+    uint8_t *buf;
+} host_queue_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size)
+{
+    host_queue_t *q = calloc(1, sizeof(host_queue_t));
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    q->len = len;
+    q->item_size = item_size;
+    q->buf = malloc(len * item_size + 1);
+    return q;
+}
+
+static void host_deadline(struct timespec *ts, TickType_t ticks)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    long long ns = ts->tv_nsec + (long long) ticks * portTICK_PERIOD_MS * 1000000;
+    ts->tv_sec += ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+}
+
+/* wait while the queue is full (or empty), false on timeout */
+static bool host_queue_wait(host_queue_t *q, bool full, TickType_t ticks)
+{
+    struct timespec ts;
+    if (ticks != portMAX_DELAY) {
+        host_deadline(&ts, ticks);
+    }
+    while (full ? q->num == q->len : q->num == 0) {
+        if (ticks == 0) {
+            return false;
+        }
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(&q->cond, &q->mutex);
+        } else if (pthread_cond_timedwait(&q->cond, &q->mutex, &ts)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    host_queue_t *q = queue;
+    pthread_mutex_lock(&q->mutex);
+    if (!host_queue_wait(q, true, ticks)) {
+        pthread_mutex_unlock(&q->mutex);
+        return pdFALSE;
+    }
+    memcpy(q->buf + (q->head + q->num) % q->len * q->item_size, item, q->item_size);
+    q->num++;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    host_queue_t *q = queue;
+    pthread_mutex_lock(&q->mutex);
+    if (!host_queue_wait(q, false, ticks)) {
+        pthread_mutex_unlock(&q->mutex);
+        return pdFALSE;
+    }
+    memcpy(item, q->buf + q->head * q->item_size, q->item_size);
+    q->head = (q->head + 1) % q->len;
+    q->num--;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+    return pdTRUE;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    host_queue_t *q = queue;
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->cond);
+    free(q->buf);
+    free(q);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t sem = xQueueCreate(1, 0);
+    xQueueSend(sem, "", 0);
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    char dummy;
+    return xQueueReceive(sem, &dummy, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return xQueueSend(sem, "", 0);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    vQueueDelete(sem);
+}
+
+typedef struct {
+    TaskFunction_t func;
+    void *arg;
+} host_task_t;
+
+static void *host_task_entry(void *arg)
+{
+    host_task_t task = *(host_task_t *) arg;
+    free(arg);
+    task.func(task.arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, unsigned stack, void *arg, UBaseType_t prio, TaskHandle_t *handle)
+{
+    pthread_t thread;
+    host_task_t *task = malloc(sizeof(host_task_t));
+    task->func = func;
+    task->arg = arg;
+    pthread_create(&thread, NULL, host_task_entry, task);
+    pthread_detach(thread);
+    if (handle) {
+        *handle = (TaskHandle_t) thread;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    if (handle == NULL) {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    usleep(ticks * portTICK_PERIOD_MS * 1000);
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t handle)
+{
+    return 5;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+host_flash_t g_host_flash = {
+    .part = {
+        { 0, 0x10, HOST_OTA_0_ADDR, HOST_OTA_SIZE, "ota_0" },
+        { 0, 0x11, HOST_OTA_1_ADDR, HOST_OTA_SIZE, "ota_1" },
+    },
+};
+
+void host_flash_open(const char *path)
+{
+    /* not erased, so a write without an erase shows up as a bad write */
+    uint8_t buf[4096];
+    memset(buf, 0x5a, sizeof(buf));
+    g_host_flash.fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    for (int i = 0; i < (HOST_OTA_1_ADDR + HOST_OTA_SIZE) / sizeof(buf); i++) {
+        pwrite(g_host_flash.fd, buf, sizeof(buf), i * sizeof(buf));
+    }
+}
+
+void host_flash_put(uint32_t addr, const void *data, size_t len)
+{
+    pwrite(g_host_flash.fd, data, len, addr);
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size)
+{
+    if (offset + size > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return pread(g_host_flash.fd, dst, size, part->address + offset) == size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t size)
+{
+    const uint8_t *data = (const uint8_t *) src;
+    if (offset + size > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t *buf = malloc(size);
+    esp_partition_read(part, offset, buf, size);
+    for (size_t i = 0; i < size; i++) {
+        if ((buf[i] & data[i]) != data[i]) {
+            g_host_flash.bad_writes++;
+        }
+        buf[i] &= data[i];
+    }
+    pwrite(g_host_flash.fd, buf, size, part->address + offset);
+    free(buf);
+    if (g_host_flash.us_per_kb) {
+        usleep(g_host_flash.us_per_kb * size / 1024);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    if (offset % 4096 || size % 4096 || offset + size > part->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t *ff = malloc(size);
+    memset(ff, 0xff, size);
+    pwrite(g_host_flash.fd, ff, size, part->address + offset);
+    free(ff);
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_boot_partition(void)
+{
+    return &g_host_flash.part[0];
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    return &g_host_flash.part[0];
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    return &g_host_flash.part[1];
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *part)
+{
+    uint8_t *buf = malloc(g_host_flash.expect_len);
+    bool ok = esp_partition_read(part, 0, buf, g_host_flash.expect_len) == ESP_OK
+              && memcmp(buf, g_host_flash.expect, g_host_flash.expect_len) == 0;
+    free(buf);
+    g_host_flash.boot_set = ok;
+    return ok ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+}
+
+typedef struct {
+    bool used;
+    char key[16];
+    size_t len;
+    uint8_t data[HOST_NVS_BLOB_MAX];
+} host_nvs_t;
+
+static host_nvs_t s_nvs[HOST_NVS_NUM];
+
+static host_nvs_t *host_nvs_find(const char *key)
+{
+    for (int i = 0; i < HOST_NVS_NUM; i++) {
+        if (s_nvs[i].used && strcmp(s_nvs[i].key, key) == 0) {
+            return &s_nvs[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode open_mode, nvs_handle *out_handle)
+{
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle handle)
+{
+}
+
+esp_err_t nvs_set_blob(nvs_handle handle, const char *key, const void *value, size_t length)
+{
+    host_nvs_t *e = host_nvs_find(key);
+    for (int i = 0; i < HOST_NVS_NUM && e == NULL; i++) {
+        e = s_nvs[i].used ? NULL : &s_nvs[i];
+    }
+    if (e == NULL || length > HOST_NVS_BLOB_MAX || strlen(key) >= sizeof(e->key)) {
+        return ESP_FAIL;
+    }
+    e->used = true;
+    strcpy(e->key, key);
+    memcpy(e->data, value, length);
+    e->len = length;
+    g_host_flash.nvs_writes++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle handle, const char *key, void *out_value, size_t *length)
+{
+    host_nvs_t *e = host_nvs_find(key);
+    if (e == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out_value) {
+        memcpy(out_value, e->data, e->len < *length ? e->len : *length);
+    }
+    *length = e->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle handle, const char *key)
+{
+    host_nvs_t *e = host_nvs_find(key);
+    if (e == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    e->used = false;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle handle)
+{
+    return ESP_OK;
+}
@@ -0,0 +1,95 @@
+#!/usr/bin/env python
+#
+# HTTP server for the OTA host test. Serves one file for any path, with ETag,
+# Range and If-Range, and misbehaves on request.
+#
+#   http_server.py [port]       default 8088, files are relative to the working directory
+#
+# GET /ctl/<key>=<value> sets:
+#   file=<path>         the file to serve
+#   etag=<tag>          the ETag, a changed file with the same ETag is not noticed
+#   chunked=0|1         chunked transfer encoding, with chunk extensions and a trailer
+#   drop_after=<n>      bytes of the body sent before a dropped connection
+#   drops_left=<n>      number of responses to drop
+#   range_shift=<n>     answer the next Range request with a range n bytes off
+import http.server
+import socketserver
+import sys
+
+STATE = {"data": b"", "etag": '"v1"', "chunked": False, "drop_after": 0, "drops_left": 0, "range_shift": 0}
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, *args):
+        pass
+
+    def control(self, key, value):
+        if key == "file":
+            with open(value, "rb") as f:
+                STATE["data"] = f.read()
+        elif key == "etag":
+            STATE["etag"] = '"%s"' % value
+        elif key == "chunked":
+            STATE["chunked"] = value == "1"
+        else:
+            STATE[key] = int(value)
+        self.send_response(200)
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+    def do_GET(self):
+        if self.path.startswith("/ctl/"):
+            self.control(*self.path[5:].split("=", 1))
+            return
+        data = STATE["data"]
+        req_range = self.headers.get("Range")
+        if_range = self.headers.get("If-Range")
+        start = 0
+        if req_range and (if_range is None or if_range == STATE["etag"]):
+            start = int(req_range.split("=")[1].split("-")[0]) + STATE["range_shift"]
+            STATE["range_shift"] = 0
+            self.send_response(206)
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (start, len(data) - 1, len(data)))
+        else:
+            self.send_response(200)
+        body = data[start:]
+        self.send_header("ETag", STATE["etag"])
+        if STATE["chunked"]:
+            self.send_header("Transfer-Encoding", "chunked")
+        else:
+            self.send_header("Content-Length", str(len(body)))
+        self.send_header("Connection", "close")
+        self.end_headers()
+
+        limit = len(body)
+        if STATE["drops_left"] > 0:
+            STATE["drops_left"] -= 1
+            limit = min(limit, STATE["drop_after"])
+        pos = 0
+        try:
+            while pos < limit:
+                # uneven pieces so that headers, chunk sizes and blocks split everywhere
+                n = min(1000 + (pos * 7) % 3000, limit - pos)
+                piece = body[pos:pos + n]
+                if STATE["chunked"]:
+                    self.wfile.write(b"%x;ext=1\r\n" % n + piece + b"\r\n")
+                else:
+                    self.wfile.write(piece)
+                pos += n
+            if pos == len(body) and STATE["chunked"]:
+                self.wfile.write(b"0\r\nX-Trailer: 1\r\n\r\n")
+            self.wfile.flush()
+        except OSError:
+            pass
+        self.close_connection = True
+
+
+class Server(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    allow_reuse_address = True
+    daemon_threads = True
+
+
+if __name__ == "__main__":
+    Server(("127.0.0.1", int(sys.argv[1]) if len(sys.argv) > 1 else 8088), Handler).serve_forever()
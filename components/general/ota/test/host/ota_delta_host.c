@@ -0,0 +1,99 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Applies a patch made by tools/ota_delta.py with the device decoder. The old
+ * image is read from a file at random offsets the way ota.c reads the running
+ * partition, the new image is written to a file the way it goes to the OTA
+ * partition, and the patch is fed in pieces of the given size.
+ *
+ *   ota_delta_host <old image> <patch> <new image out> <feed size>
+ *
+ * Prints "ok" when the new image is complete and its sha256 matches the patch
+ * header, else "error 0x<esp_err_t>".
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "ota_delta.h"
+
+int g_host_log = 0;
+
+typedef struct {
+    FILE *old;
+    FILE *new;
+    long old_size;
+} delta_host_t;
+
+static esp_err_t delta_host_read(void *arg, uint32_t offset, uint8_t *buf, int len)
+{
+    delta_host_t *h = (delta_host_t *) arg;
+    if (offset + len > h->old_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    fseek(h->old, offset, SEEK_SET);
+    return fread(buf, 1, len, h->old) == len ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t delta_host_write(void *arg, const uint8_t *data, int len)
+{
+    delta_host_t *h = (delta_host_t *) arg;
+    return fwrite(data, 1, len, h->new) == len ? ESP_OK : ESP_FAIL;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 5 || atoi(argv[4]) <= 0) {
+        fprintf(stderr, "usage: %s <old image> <patch> <new image out> <feed size>\n", argv[0]);
+        return 2;
+    }
+    if (getenv("LOG")) {
+        g_host_log = atoi(getenv("LOG"));
+    }
+    delta_host_t h = { 0 };
+    FILE *patch = fopen(argv[2], "rb");
+    h.old = fopen(argv[1], "rb");
+    h.new = fopen(argv[3], "wb");
+    if (!patch || !h.old || !h.new) {
+        perror("open");
+        return 2;
+    }
+    fseek(h.old, 0, SEEK_END);
+    h.old_size = ftell(h.old);
+
+    int feed = atoi(argv[4]);
+    uint8_t *buf = malloc(feed);
+    ota_delta_t *delta = calloc(1, sizeof(ota_delta_t));
+    ota_delta_init(delta, delta_host_read, delta_host_write, &h);
+    esp_err_t ret = ESP_OK;
+    size_t len;
+    while (ret == ESP_OK && (len = fread(buf, 1, feed, patch)) > 0) {
+        ret = ota_delta_feed(delta, buf, len);
+    }
+    if (ret == ESP_OK && !ota_delta_done(delta)) {
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    ota_delta_deinit(delta);
+    free(delta);
+    free(buf);
+    fclose(patch);
+    fclose(h.old);
+    fclose(h.new);
+
+    if (ret == ESP_OK) {
+        printf("ok\n");
+    } else {
+        printf("error 0x%x\n", ret);
+    }
+    return ret == ESP_OK ? 0 : 1;
+}
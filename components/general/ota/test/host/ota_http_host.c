@@ -0,0 +1,273 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Runs the OTA HTTP engine (ota.c, ota_http.c, ota_delta.c) on Linux against
+ * http_server.py, with the flash in a file and NVS in memory.
+ *
+ *   ota_http_host <server port> <work dir>
+ *
+ * The server serves files from the work dir. When delta_roundtrip.py has left
+ * old.bin, new.bin and patch.bin there, the delta download is tested too.
+ * Prints a line of statistics per case and "ALL PASS" at the end.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "freertos/FreeRTOS.h"
+#include "iot_ota.h"
+#include "host.h"
+
+#define CHECK(c) do { if (!(c)) { printf("FAIL line %d: %s\n", __LINE__, #c); exit(1); } } while (0)
+
+static int s_port;
+static const char *s_dir;
+static char s_url[64];
+static uint8_t *s_img;
+static size_t s_img_len;
+
+static void host_ctl(const char *fmt, ...)
+{
+    char kv[128];
+    char req[256];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(kv, sizeof(kv), fmt, ap);
+    va_end(ap);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(s_port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    int len = snprintf(req, sizeof(req), "GET /ctl/%s HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", kv);
+    CHECK(send(fd, req, len, 0) == len);
+    CHECK(recv(fd, req, sizeof(req) - 1, 0) > 0 && strncmp(req, "HTTP/1.1 200", 12) == 0);
+    close(fd);
+}
+
+static char *host_path(const char *name)
+{
+    static char path[256];
+    snprintf(path, sizeof(path), "%s/%s", s_dir, name);
+    return path;
+}
+
+static uint8_t *host_load(const char *name, size_t *len)
+{
+    FILE *f = fopen(host_path(name), "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    rewind(f);
+    uint8_t *data = malloc(*len);
+    CHECK(fread(data, 1, *len, f) == *len);
+    fclose(f);
+    return data;
+}
+
+static void host_save(const char *name, const uint8_t *data, size_t len)
+{
+    FILE *f = fopen(host_path(name), "wb");
+    CHECK(f && fwrite(data, 1, len, f) == len);
+    fclose(f);
+    host_ctl("file=%s", name);
+}
+
+/* a new random image on the server, the one the update partition must hold at the end */
+static void host_image(size_t len, unsigned seed)
+{
+    s_img_len = len;
+    s_img = realloc(s_img, len);
+    srand(seed);
+    for (size_t i = 0; i < len; i++) {
+        s_img[i] = rand();
+    }
+    host_save("img.bin", s_img, len);
+    g_host_flash.expect = s_img;
+    g_host_flash.expect_len = len;
+}
+
+static esp_err_t host_ota(const iot_ota_config_t *cfg)
+{
+    g_host_flash.boot_set = false;
+    return iot_ota_start_url_with_config(s_url, cfg, portMAX_DELAY);
+}
+
+static void host_show(const char *name, iot_ota_stat_t *s)
+{
+    iot_ota_get_stat(s);
+    printf("%-24s total %7u written %7u resumed %7u recv %7u retries %u  %5u ms  flash wait %4u ms\n", name,
+           s->total, s->written, s->resume_offset, s->recv_bytes, s->retries, s->elapsed_ms, s->flash_wait_ms);
+}
+
+static void host_test_download(void)
+{
+    iot_ota_config_t cfg = IOT_OTA_CONFIG_DEFAULT();
+    iot_ota_stat_t s;
+    cfg.recv_timeout_ms = 2000;
+    snprintf(s_url, sizeof(s_url), "http://127.0.0.1:%d/img.bin", s_port);
+
+    host_image(300 * 1024 + 123, 1);
+    CHECK(iot_ota_start("127.0.0.1", s_port, "/img.bin", portMAX_DELAY) == ESP_OK);
+    CHECK(g_host_flash.boot_set && iot_ota_get_ratio() == 100);
+    host_show("content-length", &s);
+
+    host_ctl("chunked=1");
+    host_image(200 * 1024 + 7, 2);
+    CHECK(host_ota(&cfg) == ESP_OK && g_host_flash.boot_set);
+    host_show("chunked", &s);
+    host_ctl("chunked=0");
+
+    /* two drops in one call: the writer is drained and the download goes on at the last written block */
+    host_image(400 * 1024 + 99, 3);
+    host_ctl("drop_after=150000");
+    host_ctl("drops_left=2");
+    CHECK(host_ota(&cfg) == ESP_OK && g_host_flash.boot_set);
+    host_show("2 drops, retried", &s);
+    CHECK(s.retries == 2 && s.recv_bytes < s_img_len + 2 * cfg.buf_size);
+
+    /* more drops than max_retry */
+    cfg.max_retry = 1;
+    host_image(400 * 1024, 4);
+    host_ctl("drops_left=3");
+    CHECK(host_ota(&cfg) != ESP_OK && !g_host_flash.boot_set);
+    host_show("max_retry 1, 3 drops", &s);
+    CHECK(s.retries == 1);
+    host_ctl("drops_left=0");
+    CHECK(iot_ota_clear_resume() == ESP_OK);
+
+    /* an interrupted call is resumed by the next one with a Range request */
+    cfg.max_retry = 0;
+    cfg.resume_commit_size = 32 * 1024;
+    host_image(500 * 1024, 5);
+    host_ctl("drop_after=300000");
+    host_ctl("drops_left=1");
+    CHECK(host_ota(&cfg) != ESP_OK && !g_host_flash.boot_set);
+    host_show("interrupted", &s);
+    CHECK(host_ota(&cfg) == ESP_OK && g_host_flash.boot_set);
+    host_show("resumed", &s);
+    CHECK(s.resume_offset >= 256 * 1024 && s.recv_bytes < s_img_len - 250 * 1024);
+
+    /* the file changed on the server: If-Range does not match, the 200 restarts the image */
+    host_image(500 * 1024, 6);
+    host_ctl("drops_left=1");
+    CHECK(host_ota(&cfg) != ESP_OK);
+    host_image(450 * 1024, 7);
+    host_ctl("etag=v2");
+    CHECK(host_ota(&cfg) == ESP_OK && g_host_flash.boot_set);
+    host_show("changed file", &s);
+    CHECK(s.resume_offset == 0 && s.written == s_img_len && s.recv_bytes < s_img_len + 1024);
+
+    /* a 206 at another offset: the range is dropped and the download restarts without a retry */
+    host_image(500 * 1024, 8);
+    host_ctl("drops_left=1");
+    CHECK(host_ota(&cfg) != ESP_OK);
+    host_ctl("range_shift=4096");
+    CHECK(host_ota(&cfg) == ESP_OK && g_host_flash.boot_set);
+    host_show("wrong range", &s);
+    CHECK(s.retries == 0 && s.written == s_img_len);
+
+    /* the resumed part of the image was damaged on flash: the crc check restarts from zero */
+    host_image(300 * 1024, 9);
+    host_ctl("drop_after=200000");
+    host_ctl("drops_left=1");
+    CHECK(host_ota(&cfg) != ESP_OK);
+    host_flash_put(HOST_OTA_1_ADDR + 100, "\0\0", 2);
+    CHECK(host_ota(&cfg) == ESP_OK && g_host_flash.boot_set);
+    host_show("damaged resume data", &s);
+    CHECK(s.resume_offset == 0);
+
+    /* slow flash: the writes overlap the download */
+    cfg.max_retry = 5;
+    g_host_flash.us_per_kb = 300;
+    host_image(1000 * 1024, 10);
+    CHECK(host_ota(&cfg) == ESP_OK && g_host_flash.boot_set);
+    host_show("slow flash 300 us/KB", &s);
+    g_host_flash.us_per_kb = 0;
+}
+
+static void host_test_delta(void)
+{
+    size_t old_len, new_len, patch_len;
+    uint8_t *old = host_load("old.bin", &old_len);
+    uint8_t *new = host_load("new.bin", &new_len);
+    uint8_t *patch = host_load("patch.bin", &patch_len);
+    if (!old || !new || !patch) {
+        printf("no patch in %s, delta skipped\n", s_dir);
+        return;
+    }
+    iot_ota_config_t cfg = IOT_OTA_CONFIG_DEFAULT();
+    iot_ota_stat_t s;
+    cfg.recv_timeout_ms = 2000;
+    cfg.delta = true;
+    snprintf(s_url, sizeof(s_url), "http://127.0.0.1:%d/patch.bin", s_port);
+    host_flash_put(HOST_OTA_0_ADDR, old, old_len);
+    g_host_flash.expect = new;
+    g_host_flash.expect_len = new_len;
+
+    host_ctl("file=patch.bin");
+    CHECK(host_ota(&cfg) == ESP_OK && g_host_flash.boot_set);
+    host_show("delta", &s);
+    CHECK(s.written == new_len && s.recv_bytes < patch_len + 1024);
+
+    /* the decoder can't resume at a block, each retry applies the patch again */
+    host_ctl("chunked=1");
+    host_ctl("drop_after=6000");
+    host_ctl("drops_left=2");
+    CHECK(host_ota(&cfg) == ESP_OK && g_host_flash.boot_set);
+    host_show("delta chunked, 2 drops", &s);
+    CHECK(s.retries == 2 && s.written == new_len);
+    host_ctl("chunked=0");
+
+    /* the running image is not the one the patch was made against */
+    host_flash_put(HOST_OTA_0_ADDR, new, 4096);
+    CHECK(host_ota(&cfg) == ESP_ERR_INVALID_VERSION && !g_host_flash.boot_set);
+    host_flash_put(HOST_OTA_0_ADDR, old, old_len);
+
+    patch[patch_len - 100] ^= 0x55;
+    host_save("bad.bin", patch, patch_len);
+    esp_err_t ret = host_ota(&cfg);
+    CHECK((ret == ESP_ERR_INVALID_CRC || ret == ESP_ERR_INVALID_ARG) && !g_host_flash.boot_set);
+
+    cfg.max_retry = 0;
+    host_save("bad.bin", patch, patch_len / 2);
+    CHECK(host_ota(&cfg) != ESP_OK && !g_host_flash.boot_set);
+    printf("delta errors             wrong base, corrupt and truncated patch refused\n");
+    free(old);
+    free(new);
+    free(patch);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <server port> <work dir>\n", argv[0]);
+        return 2;
+    }
+    if (getenv("LOG")) {
+        g_host_log = atoi(getenv("LOG"));
+    }
+    s_port = atoi(argv[1]);
+    s_dir = argv[2];
+    host_flash_open(host_path("flash.bin"));
+    host_test_download();
+    host_test_delta();
+    printf("ALL PASS\n");
+    return 0;
+}
@@ -0,0 +1,3 @@
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
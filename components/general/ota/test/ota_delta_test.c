@@ -0,0 +1,151 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "ota_delta.h"
+
+#define DELTA_TEST_OLD_SIZE     1000
+#define DELTA_TEST_NEW_SIZE     905
+
+typedef struct {
+    uint8_t old[DELTA_TEST_OLD_SIZE];
+    uint8_t out[DELTA_TEST_NEW_SIZE];
+    int out_len;
+} delta_test_t;
+
+static esp_err_t delta_test_read(void *arg, uint32_t offset, uint8_t *buf, int len)
+{
+    delta_test_t *t = (delta_test_t *) arg;
+    TEST_ASSERT_TRUE(offset + len <= DELTA_TEST_OLD_SIZE);
+    memcpy(buf, t->old + offset, len);
+    return ESP_OK;
+}
+
+static esp_err_t delta_test_write(void *arg, const uint8_t *data, int len)
+{
+    delta_test_t *t = (delta_test_t *) arg;
+    TEST_ASSERT_TRUE(t->out_len + len <= DELTA_TEST_NEW_SIZE);
+    memcpy(t->out + t->out_len, data, len);
+    t->out_len += len;
+    return ESP_OK;
+}
+
+static void delta_test_put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/*
+ * new image: old[0, 600) with two bytes changed at 100, "hello", old[650, 950).
+ * Returns the patch length, the expected image is left in expect.
+ */
+static int delta_test_patch(const uint8_t *old, uint8_t *patch, uint8_t *expect)
+{
+    const uint8_t body[] = {
+        0xd8, 0x04, 0x05, 0x64,             /* diff 600, extra 5, seek +50 */
+        0x64, 0x02, 0x01, 0xff,             /* 100 zeros, 2 literals: +1, -1 */
+        0xf2, 0x03, 0x00,                   /* 498 zeros, no literal */
+        'h', 'e', 'l', 'l', 'o',
+        0xac, 0x02, 0x00, 0x00,             /* diff 300, no extra, no seek */
+        0xac, 0x02, 0x00,                   /* 300 zeros */
+    };
+    memcpy(expect, old, 600);
+    expect[100] += 1;
+    expect[101] -= 1;
+    memcpy(expect + 600, "hello", 5);
+    memcpy(expect + 605, old + 650, 300);
+
+    memcpy(patch, OTA_DELTA_MAGIC, 4);
+    delta_test_put_u32(patch + 4, OTA_DELTA_VERSION);
+    delta_test_put_u32(patch + 8, DELTA_TEST_OLD_SIZE);
+    delta_test_put_u32(patch + 12, DELTA_TEST_NEW_SIZE);
+    mbedtls_sha256_ret(old, DELTA_TEST_OLD_SIZE, patch + 16, 0);
+    mbedtls_sha256_ret(expect, DELTA_TEST_NEW_SIZE, patch + 48, 0);
+    memcpy(patch + OTA_DELTA_HEADER_SIZE, body, sizeof(body));
+    return OTA_DELTA_HEADER_SIZE + sizeof(body);
+}
+
+static esp_err_t delta_test_apply(delta_test_t *t, const uint8_t *patch, int len, int step)
+{
+    ota_delta_t *delta = (ota_delta_t *) calloc(1, sizeof(ota_delta_t));
+    esp_err_t ret = ESP_OK;
+    TEST_ASSERT_NOT_NULL(delta);
+    t->out_len = 0;
+    ota_delta_init(delta, delta_test_read, delta_test_write, t);
+    for (int pos = 0; pos < len && ret == ESP_OK; pos += step) {
+        ret = ota_delta_feed(delta, patch + pos, step < len - pos ? step : len - pos);
+    }
+    if (ret == ESP_OK && !ota_delta_done(delta)) {
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    ota_delta_deinit(delta);
+    free(delta);
+    return ret;
+}
+
+TEST_CASE("OTA delta patch apply", "[ota][rel]")
+{
+    delta_test_t *t = (delta_test_t *) calloc(1, sizeof(delta_test_t));
+    uint8_t patch[128];
+    uint8_t expect[DELTA_TEST_NEW_SIZE];
+    TEST_ASSERT_NOT_NULL(t);
+    for (int i = 0; i < DELTA_TEST_OLD_SIZE; i++) {
+        t->old[i] = i * 7 + (i >> 3);
+    }
+    int len = delta_test_patch(t->old, patch, expect);
+
+    const int steps[] = { len, 1, 3, 17 };
+    for (int i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, delta_test_apply(t, patch, len, steps[i]));
+        TEST_ASSERT_EQUAL(DELTA_TEST_NEW_SIZE, t->out_len);
+        TEST_ASSERT_EQUAL_MEMORY(expect, t->out, DELTA_TEST_NEW_SIZE);
+    }
+
+    /* truncated patch */
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, delta_test_apply(t, patch, len - 3, len));
+    free(t);
+}
+
+TEST_CASE("OTA delta patch errors", "[ota][rel]")
+{
+    delta_test_t *t = (delta_test_t *) calloc(1, sizeof(delta_test_t));
+    uint8_t patch[128];
+    uint8_t expect[DELTA_TEST_NEW_SIZE];
+    TEST_ASSERT_NOT_NULL(t);
+    int len = delta_test_patch(t->old, patch, expect);
+
+    /* the running image is not the one the patch was made against */
+    t->old[500] ^= 1;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_VERSION, delta_test_apply(t, patch, len, len));
+    t->old[500] ^= 1;
+
+    /* a changed literal gives another image */
+    patch[OTA_DELTA_HEADER_SIZE + 6] = 2;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC, delta_test_apply(t, patch, len, 5));
+    patch[OTA_DELTA_HEADER_SIZE + 6] = 1;
+
+    /* a record past the end of the new image */
+    patch[OTA_DELTA_HEADER_SIZE + 1] = 0x10;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, delta_test_apply(t, patch, len, len));
+    patch[OTA_DELTA_HEADER_SIZE + 1] = 0x04;
+
+    /* not a patch */
+    patch[0] = 'X';
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, delta_test_apply(t, patch, len, len));
+    free(t);
+}
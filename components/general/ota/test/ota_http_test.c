@@ -0,0 +1,131 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include "unity.h"
+#include "ota_http.h"
+
+typedef struct {
+    uint8_t data[256];
+    int len;
+    int calls;
+} http_test_body_t;
+
+static esp_err_t http_test_body_cb(void *arg, const uint8_t *data, int len)
+{
+    http_test_body_t *body = (http_test_body_t *) arg;
+    TEST_ASSERT_TRUE(body->len + len <= (int) sizeof(body->data));
+    memcpy(body->data + body->len, data, len);
+    body->len += len;
+    body->calls++;
+    return ESP_OK;
+}
+
+/* feed the response in pieces of step bytes, like the socket would deliver it */
+static void http_test_feed(ota_http_parser_t *parser, const char *resp, int step, http_test_body_t *body)
+{
+    int len = strlen(resp);
+    int pos = 0;
+    memset(body, 0, sizeof(http_test_body_t));
+    ota_http_parser_init(parser);
+    while (pos < len) {
+        int n = len - pos < step ? len - pos : step;
+        while (n > 0) {
+            int ret = ota_http_parse(parser, (const uint8_t *) resp + pos, n, http_test_body_cb, body);
+            TEST_ASSERT_TRUE(ret >= 0);
+            if (ret == 0 && ota_http_body_done(parser, false)) {
+                return;
+            }
+            pos += ret;
+            n -= ret;
+        }
+    }
+}
+
+TEST_CASE("OTA HTTP parser test", "[ota][iot]")
+{
+    ota_http_parser_t parser;
+    http_test_body_t body;
+    const char *plain =
+        "HTTP/1.1 200 OK\r\n"
+        "content-length: 10\r\n"
+        "ETag: \"abc\"\r\n"
+        "\r\n"
+        "0123456789";
+    const char *chunked =
+        "HTTP/1.1 100 Continue\r\n\r\n"
+        "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "4;name=x\r\nabcd\r\n"
+        "A\r\n0123456789\r\n"
+        "0\r\n"
+        "X-Trailer: 1\r\n"
+        "\r\n";
+    const char *range =
+        "HTTP/1.1 206 Partial Content\r\n"
+        "Content-Range: bytes 4096-4100/8192\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n"
+        "hello";
+
+    /* every split position gives the same result */
+    for (int step = 1; step <= (int) strlen(chunked); step++) {
+        http_test_feed(&parser, plain, step, &body);
+        TEST_ASSERT_EQUAL(200, parser.status);
+        TEST_ASSERT_EQUAL(10, parser.content_length);
+        TEST_ASSERT_EQUAL_STRING("\"abc\"", parser.etag);
+        TEST_ASSERT_EQUAL(10, body.len);
+        TEST_ASSERT_EQUAL_MEMORY("0123456789", body.data, 10);
+        TEST_ASSERT_TRUE(ota_http_body_done(&parser, false));
+
+        http_test_feed(&parser, chunked, step, &body);
+        TEST_ASSERT_EQUAL(200, parser.status);
+        TEST_ASSERT_TRUE(parser.chunked);
+        TEST_ASSERT_EQUAL(14, body.len);
+        TEST_ASSERT_EQUAL_MEMORY("abcd0123456789", body.data, 14);
+        TEST_ASSERT_TRUE(ota_http_body_done(&parser, false));
+
+        http_test_feed(&parser, range, step, &body);
+        TEST_ASSERT_EQUAL(206, parser.status);
+        TEST_ASSERT_EQUAL(4096, parser.range_start);
+        TEST_ASSERT_EQUAL(8192, parser.range_total);
+        TEST_ASSERT_EQUAL(5, body.len);
+    }
+
+    /* body without length ends with the connection */
+    http_test_feed(&parser, "HTTP/1.0 200 OK\r\n\r\nabc", 64, &body);
+    TEST_ASSERT_EQUAL(3, body.len);
+    TEST_ASSERT_FALSE(ota_http_body_done(&parser, false));
+    TEST_ASSERT_TRUE(ota_http_body_done(&parser, true));
+
+    /* truncated body with a length is not complete */
+    http_test_feed(&parser, "HTTP/1.1 200 OK\r\nContent-Length: 8\r\n\r\nabc", 64, &body);
+    TEST_ASSERT_FALSE(ota_http_body_done(&parser, true));
+
+    /* headers stop the parsing so the status can be checked before the body */
+    const char *resp = "HTTP/1.1 404 Not Found\r\nContent-Length: 3\r\n\r\nabc";
+    ota_http_parser_init(&parser);
+    int ret = ota_http_parse(&parser, (const uint8_t *) resp, strlen(resp), http_test_body_cb, &body);
+    TEST_ASSERT_EQUAL(strlen(resp) - 3, ret);
+    TEST_ASSERT_TRUE(ota_http_headers_done(&parser));
+    TEST_ASSERT_EQUAL(404, parser.status);
+
+    /* malformed */
+    ota_http_parser_init(&parser);
+    TEST_ASSERT_TRUE(ota_http_parse(&parser, (const uint8_t *) "garbage\r\n", 9, NULL, NULL) < 0);
+    ota_http_parser_init(&parser);
+    resp = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n";
+    int pos = ota_http_parse(&parser, (const uint8_t *) resp, strlen(resp), NULL, NULL);
+    TEST_ASSERT_TRUE(ota_http_parse(&parser, (const uint8_t *) resp + pos, strlen(resp) - pos, NULL, NULL) < 0);
+}
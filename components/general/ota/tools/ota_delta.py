@@ -0,0 +1,241 @@
+#!/usr/bin/env python
+#
+# Generate and apply delta OTA patches, see include/ota_delta.h for the format.
+#
+#   ota_delta.py diff old.bin new.bin patch.bin     make a patch from the running image to the new one
+#   ota_delta.py apply old.bin patch.bin new.bin    apply a patch, the same way the device does
+#
+# The matching follows bsdiff: the new image is split into regions that line up with
+# the old image, stored as a byte-wise difference that is mostly zero, and extra bytes
+# that have no counterpart. Moved code and shifted addresses give long mostly-zero
+# differences, which the zero run encoding keeps small.
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = b"IOTD"
+VERSION = 1
+HEADER_FMT = "<4sIII32s32s"
+
+BLOCK = 32          # bytes compared at once while following an alignment
+GRAM = 8            # length of the old image substrings in the index
+STRIDE = 4          # index every STRIDE-th position of the old image
+MIN_MATCH = 24      # exact match needed to start a new alignment
+MIN_ZERO_RUN = 3    # shorter zero runs are cheaper as literals
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7f
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def zigzag(value):
+    return (value << 1) if value >= 0 else ((-value << 1) - 1)
+
+
+def match_len(old, o, new, n, limit):
+    """ length of the exact match of old[o:] and new[n:], found by doubling and bisecting slices """
+    size = 0
+    step = 16
+    while size < limit:
+        step = min(step, limit - size)
+        if old[o + size:o + size + step] == new[n + size:n + size + step]:
+            size += step
+            step *= 2
+        elif step > 1:
+            step //= 2
+        else:
+            break
+    return size
+
+
+def mismatches(a, b):
+    return sum(1 for x, y in zip(a, b) if x != y)
+
+
+def find_segments(old, new):
+    """ return (new_start, length, old_start) regions of new that are aligned with old """
+    index = {}
+    for i in range(0, len(old) - GRAM + 1, STRIDE):
+        index.setdefault(old[i:i + GRAM], i)
+
+    segments = []
+    seg = None          # [new_start, length, old_start] of the current region
+    pos = 0
+    while pos < len(new):
+        block = min(BLOCK, len(new) - pos)
+        if seg is not None:
+            o = pos - seg[0] + seg[2]
+            if o + block <= len(old):
+                bad = mismatches(new[pos:pos + block], old[o:o + block])
+                if bad <= block // 4:
+                    seg[1] += block
+                    pos += block
+                    continue
+        # look for a new alignment starting in this block
+        found = None
+        for q in range(pos, min(pos + block, len(new) - GRAM + 1)):
+            o = index.get(new[q:q + GRAM])
+            if o is not None and (seg is None or o - q != seg[2] - seg[0]):
+                limit = min(len(old) - o, len(new) - q)
+                if match_len(old, o, new, q, limit) >= MIN_MATCH:
+                    found = (q, o)
+                    break
+        if found:
+            q, o = found
+            if seg is not None and q > pos:
+                seg[1] += q - pos
+            seg = [q, 0, o]
+            segments.append(seg)
+            pos = q
+            continue
+        if seg is not None and pos - seg[0] + seg[2] + block <= len(old) \
+                and mismatches(new[pos:pos + block], old[pos - seg[0] + seg[2]:][:block]) <= block * 3 // 4:
+            # still cheaper as a difference than as extra bytes
+            seg[1] += block
+        else:
+            seg = None
+        pos += block
+    # the first new alignment of a block may start inside a region already extended over it
+    result = []
+    for s in segments:
+        if result and result[-1][0] + result[-1][1] > s[0]:
+            result[-1][1] = s[0] - result[-1][0]
+        if s[1] > 0:
+            result.append(s)
+    return [tuple(s) for s in result if s[1] > 0]
+
+
+def encode_diff(diff):
+    out = bytearray()
+    pos = 0
+    while pos < len(diff):
+        zeros = 0
+        while pos + zeros < len(diff) and diff[pos + zeros] == 0:
+            zeros += 1
+        pos += zeros
+        # the literal ends where a zero run worth its own pair starts
+        lit = pos
+        while lit < len(diff):
+            run = 0
+            while lit + run < len(diff) and diff[lit + run] == 0:
+                run += 1
+            if run >= MIN_ZERO_RUN or (run and lit + run == len(diff)):
+                break
+            lit += max(run, 1)
+        out += varint(zeros) + varint(lit - pos) + diff[pos:lit]
+        pos = lit
+    return bytes(out)
+
+
+def make_patch(old, new):
+    segments = find_segments(old, new)
+    body = bytearray()
+    old_pos = 0
+    new_pos = 0
+    if not segments or segments[0][0] > 0 or segments[0][2] > 0:
+        first_old = segments[0][2] if segments else 0
+        extra_end = segments[0][0] if segments else len(new)
+        body += varint(0) + varint(extra_end) + varint(zigzag(first_old))
+        body += new[:extra_end]
+        old_pos = first_old
+        new_pos = extra_end
+    for i, (n, length, o) in enumerate(segments):
+        assert n == new_pos and o == old_pos
+        next_new = segments[i + 1][0] if i + 1 < len(segments) else len(new)
+        next_old = segments[i + 1][2] if i + 1 < len(segments) else o + length
+        diff = bytes((new[n + k] - old[o + k]) & 0xff for k in range(length))
+        body += varint(length) + varint(next_new - n - length) + varint(zigzag(next_old - o - length))
+        body += encode_diff(diff) + new[n + length:next_new]
+        old_pos = next_old
+        new_pos = next_new
+    header = struct.pack(HEADER_FMT, MAGIC, VERSION, len(old), len(new),
+                         hashlib.sha256(old).digest(), hashlib.sha256(new).digest())
+    return header + bytes(body)
+
+
+def read_varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7f) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def apply_patch(old, patch):
+    size = struct.calcsize(HEADER_FMT)
+    magic, version, old_size, new_size, old_sha, new_sha = struct.unpack(HEADER_FMT, patch[:size])
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a delta patch")
+    if old_size > len(old) or hashlib.sha256(old[:old_size]).digest() != old_sha:
+        raise ValueError("the patch does not apply to this image")
+    new = bytearray()
+    pos = size
+    old_pos = 0
+    while len(new) < new_size:
+        diff_len, pos = read_varint(patch, pos)
+        extra_len, pos = read_varint(patch, pos)
+        seek, pos = read_varint(patch, pos)
+        seek = (seek >> 1) ^ -(seek & 1)
+        while diff_len > 0:
+            zeros, pos = read_varint(patch, pos)
+            new += old[old_pos:old_pos + zeros]
+            old_pos += zeros
+            lit, pos = read_varint(patch, pos)
+            new += bytes((old[old_pos + k] + patch[pos + k]) & 0xff for k in range(lit))
+            old_pos += lit
+            pos += lit
+            diff_len -= zeros + lit
+        new += patch[pos:pos + extra_len]
+        pos += extra_len
+        old_pos += seek
+    if hashlib.sha256(new).digest() != new_sha:
+        raise ValueError("new image hash mismatch")
+    return bytes(new)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="delta OTA patch tool")
+    sub = parser.add_subparsers(dest="cmd")
+    p = sub.add_parser("diff", help="make a patch")
+    p.add_argument("old")
+    p.add_argument("new")
+    p.add_argument("patch")
+    p = sub.add_parser("apply", help="apply a patch")
+    p.add_argument("old")
+    p.add_argument("patch")
+    p.add_argument("new")
+    args = parser.parse_args()
+
+    if args.cmd == "diff":
+        old = open(args.old, "rb").read()
+        new = open(args.new, "rb").read()
+        patch = make_patch(old, new)
+        # never ship a patch that does not reproduce the image
+        if apply_patch(old, patch) != new:
+            sys.exit("patch verification failed")
+        open(args.patch, "wb").write(patch)
+        print("%s: %d bytes, %.1f%% of %d" % (args.patch, len(patch), 100.0 * len(patch) / len(new), len(new)))
+    elif args.cmd == "apply":
+        new = apply_patch(open(args.old, "rb").read(), open(args.patch, "rb").read())
+        open(args.new, "wb").write(new)
+        print("%s: %d bytes, sha256 %s" % (args.new, len(new), hashlib.sha256(new).hexdigest()))
+    else:
+        parser.print_help()
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,119 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _IOT_PARAM_CACHE_H_
+#define _IOT_PARAM_CACHE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+  * @brief  commit policy of the param cache, dirty params are written to NVS in one batch when either limit is hit.
+  */
+typedef struct {
+    uint32_t commit_delay_ms;   /**< commit this long after the first uncommitted save, 0 to disable */
+    uint16_t commit_count;      /**< commit once this many saves are uncommitted, 0 to disable */
+} param_cache_config_t;
+
+#define PARAM_CACHE_CONFIG_DEFAULT() { \
+    .commit_delay_ms = 5000, \
+    .commit_count = 16, \
+}
+
+/**
+  * @brief  init the param cache, call nvs_flash_init() first.
+  *
+  * @param  config commit policy, NULL for PARAM_CACHE_CONFIG_DEFAULT.
+  *
+  * @return
+  *     - ESP_OK: succeed
+  *     - ESP_ERR_INVALID_STATE: already initialized
+  *     - ESP_ERR_NO_MEM: no memory
+  */
+esp_err_t iot_param_cache_init(const param_cache_config_t* config);
+
+/**
+  * @brief  commit the dirty params and free the cache.
+  *         It waits for a running commit timer callback, so do not call it from an esp_timer callback.
+  *
+  * @return
+  *     - ESP_OK: succeed
+  *     - others: the commit failed, the cache is kept
+  */
+esp_err_t iot_param_cache_deinit();
+
+/**
+  * @brief  save param to the cache, it reaches flash with the next commit.
+  *         Saving the value a param already holds does not touch flash.
+  *
+  * @param  space_name Namespace name, at most 15 characters.
+  * @param  key  Key name of param, at most 15 characters.
+  * @param  param pointer of param.
+  * @param  len length of param, Maximum length is 1984 bytes
+  *
+  * @return
+  *     - ESP_OK: succeed
+  *     - ESP_ERR_INVALID_ARG: invalid argument
+  *     - ESP_ERR_NO_MEM: no memory
+  *     - others: the commit triggered by this save failed, refer to nvs.h
+  */
+esp_err_t iot_param_cache_save(const char* space_name, const char* key, const void* param, uint16_t len);
+
+/**
+  * @brief  read param, from RAM if it is cached, or from flash once and cached.
+  *
+  * @param  space_name Namespace name.
+  * @param  key  Key name of param.
+  * @param  dest the address to save read param.
+  * @param  len size of dest.
+  *
+  * @return
+  *     - ESP_OK: succeed
+  *     - ESP_ERR_NVS_NOT_FOUND: the param has never been saved, or was erased
+  *     - ESP_ERR_NVS_INVALID_LENGTH: dest is smaller than the param
+  *     - others: refer to nvs.h
+  */
+esp_err_t iot_param_cache_load(const char* space_name, const char* key, void* dest, uint16_t len);
+
+/**
+  * @brief  erase param, the key is erased from flash with the next commit.
+  *
+  * @param  space_name Namespace name.
+  * @param  key  Key name of param.
+  *
+  * @return
+  *     - ESP_OK: succeed
+  *     - others: fail
+  */
+esp_err_t iot_param_cache_erase(const char* space_name, const char* key);
+
+/**
+  * @brief  write the dirty params to flash now, with one commit per namespace.
+  *         Call it before esp_restart() or esp_deep_sleep_start().
+  *
+  * @return
+  *     - ESP_OK: succeed
+  *     - others: refer to nvs.h, the params that failed stay dirty
+  */
+esp_err_t iot_param_cache_flush();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,394 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "iot_param_cache.h"
+
+#define PARAM_CACHE_CHECK(a, str, ret)  if(!(a)) {                                 \
+        ESP_LOGE(TAG,"%s:%d (%s):%s", __FILE__, __LINE__, __FUNCTION__, str);      \
+        return (ret);                                                              \
+        }
+
+#define PARAM_NAME_LEN      (16)
+#define PARAM_LEN_MAX       (1984)
+
+typedef struct param_entry {
+    struct param_entry* next;
+    char space_name[PARAM_NAME_LEN];
+    char key[PARAM_NAME_LEN];
+    bool dirty;                 /* differs from flash */
+    bool exist;                 /* false for a param erased or never saved */
+    uint16_t len;
+    uint16_t cap;
+    uint8_t* data;
+} param_entry_t;
+
+typedef struct {
+    param_cache_config_t config;
+    SemaphoreHandle_t lock;
+    esp_timer_handle_t timer;
+    esp_timer_handle_t fence;   /* runs after any commit callback dispatched before it */
+    SemaphoreHandle_t fence_done;
+    bool timer_run;
+    bool closing;               /* deinit has flushed, a late commit callback must not touch the cache */
+    uint16_t pending;           /* saves since the last commit */
+    param_entry_t* entry;
+} param_cache_t;
+
+static const char* TAG = "param_cache";
+static param_cache_t* g_cache = NULL;
+
+static param_entry_t* param_cache_find(const char* space_name, const char* key)
+{
+    for (param_entry_t* entry = g_cache->entry; entry; entry = entry->next) {
+        if (strcmp(entry->key, key) == 0 && strcmp(entry->space_name, space_name) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static param_entry_t* param_cache_add(const char* space_name, const char* key)
+{
+    param_entry_t* entry = (param_entry_t*) calloc(1, sizeof(param_entry_t));
+    if (entry == NULL) {
+        return NULL;
+    }
+    strncpy(entry->space_name, space_name, PARAM_NAME_LEN - 1);
+    strncpy(entry->key, key, PARAM_NAME_LEN - 1);
+    entry->next = g_cache->entry;
+    g_cache->entry = entry;
+    return entry;
+}
+
+static esp_err_t param_cache_reserve(param_entry_t* entry, uint16_t len)
+{
+    if (len <= entry->cap) {
+        return ESP_OK;
+    }
+    uint8_t* data = (uint8_t*) realloc(entry->data, len);
+    if (data == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    entry->data = data;
+    entry->cap = len;
+    return ESP_OK;
+}
+
+/* write the dirty params of the namespace of first, then commit once */
+static esp_err_t param_cache_flush_space(param_entry_t* first)
+{
+    nvs_handle handle;
+    esp_err_t ret = nvs_open(first->space_name, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "open %s error: %d", first->space_name, ret);
+        return ret;
+    }
+    const char* space_name = first->space_name;
+    int written = 0;
+    for (param_entry_t* entry = first; entry && ret == ESP_OK; entry = entry->next) {
+        if (!entry->dirty || strcmp(entry->space_name, space_name) != 0) {
+            continue;
+        }
+        if (entry->exist) {
+            ret = nvs_set_blob(handle, entry->key, entry->data, entry->len);
+        } else {
+            ret = nvs_erase_key(handle, entry->key);
+            ret = ret == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : ret;
+        }
+        written++;
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "commit %s error: %d", space_name, ret);
+        return ret;
+    }
+    for (param_entry_t* entry = first; entry; entry = entry->next) {
+        if (entry->dirty && strcmp(entry->space_name, space_name) == 0) {
+            entry->dirty = false;
+        }
+    }
+    ESP_LOGD(TAG, "committed %d params of %s", written, space_name);
+    return ESP_OK;
+}
+
+/* an earlier param of the namespace is still dirty, the namespace failed in this flush */
+static bool param_cache_space_failed(const param_entry_t* entry)
+{
+    for (param_entry_t* e = g_cache->entry; e != entry; e = e->next) {
+        if (e->dirty && strcmp(e->space_name, entry->space_name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* call it with the lock */
+static esp_err_t param_cache_flush_locked()
+{
+    if (g_cache->timer_run) {
+        esp_timer_stop(g_cache->timer);
+        g_cache->timer_run = false;
+    }
+    esp_err_t ret = ESP_OK;
+    for (param_entry_t* entry = g_cache->entry; entry; entry = entry->next) {
+        // the first dirty param of a namespace flushes all of it
+        if (entry->dirty && !param_cache_space_failed(entry)) {
+            esp_err_t err = param_cache_flush_space(entry);
+            ret = ret == ESP_OK ? err : ret;
+        }
+    }
+    if (ret == ESP_OK) {
+        g_cache->pending = 0;
+    }
+    return ret;
+}
+
+static void param_cache_timer_cb(void* arg)
+{
+    param_cache_t* cache = (param_cache_t*) arg;
+    xSemaphoreTake(cache->lock, portMAX_DELAY);
+    if (!cache->closing) {
+        cache->timer_run = false;
+        param_cache_flush_locked();
+    }
+    xSemaphoreGive(cache->lock);
+}
+
+/* esp_timer runs the callbacks one by one in its task, so the commit callback is done when this one runs */
+static void param_cache_fence_cb(void* arg)
+{
+    param_cache_t* cache = (param_cache_t*) arg;
+    xSemaphoreGive(cache->fence_done);
+}
+
+static void param_cache_free(param_cache_t* cache)
+{
+    if (cache->timer) {
+        esp_timer_delete(cache->timer);
+    }
+    if (cache->fence) {
+        esp_timer_delete(cache->fence);
+    }
+    if (cache->fence_done) {
+        vSemaphoreDelete(cache->fence_done);
+    }
+    if (cache->lock) {
+        vSemaphoreDelete(cache->lock);
+    }
+    free(cache);
+}
+
+/* read a param from flash into its entry */
+static esp_err_t param_cache_fill(param_entry_t* entry)
+{
+    nvs_handle handle;
+    size_t len = 0;
+    esp_err_t ret = nvs_open(entry->space_name, NVS_READONLY, &handle);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        // the namespace is created by the first save
+        entry->exist = false;
+        return ESP_OK;
+    }
+    PARAM_CACHE_CHECK(ret == ESP_OK, "nvs open error", ret);
+    ret = nvs_get_blob(handle, entry->key, NULL, &len);
+    if (ret == ESP_OK && len > 0) {
+        ret = param_cache_reserve(entry, len);
+        if (ret == ESP_OK) {
+            ret = nvs_get_blob(handle, entry->key, entry->data, &len);
+        }
+    }
+    nvs_close(handle);
+    if (ret == ESP_ERR_NVS_NOT_FOUND || (ret == ESP_OK && len == 0)) {
+        entry->exist = false;
+        return ESP_OK;
+    }
+    PARAM_CACHE_CHECK(ret == ESP_OK, "nvs read error", ret);
+    entry->exist = true;
+    entry->len = len;
+    return ESP_OK;
+}
+
+/* get the entry of a param, read from flash on the first access */
+static esp_err_t param_cache_get(const char* space_name, const char* key, param_entry_t** out)
+{
+    param_entry_t* entry = param_cache_find(space_name, key);
+    if (entry == NULL) {
+        entry = param_cache_add(space_name, key);
+        PARAM_CACHE_CHECK(entry != NULL, "no memory for the param", ESP_ERR_NO_MEM);
+        esp_err_t ret = param_cache_fill(entry);
+        if (ret != ESP_OK) {
+            g_cache->entry = entry->next;
+            free(entry->data);
+            free(entry);
+            return ret;
+        }
+    }
+    *out = entry;
+    return ESP_OK;
+}
+
+/* a save or an erase changed a param, apply the commit policy */
+static esp_err_t param_cache_changed(param_entry_t* entry)
+{
+    entry->dirty = true;
+    g_cache->pending++;
+    if (g_cache->config.commit_count && g_cache->pending >= g_cache->config.commit_count) {
+        return param_cache_flush_locked();
+    }
+    if (g_cache->config.commit_delay_ms && !g_cache->timer_run) {
+        esp_timer_start_once(g_cache->timer, (uint64_t) g_cache->config.commit_delay_ms * 1000);
+        g_cache->timer_run = true;
+    }
+    return ESP_OK;
+}
+
+esp_err_t iot_param_cache_init(const param_cache_config_t* config)
+{
+    PARAM_CACHE_CHECK(g_cache == NULL, "param cache is initialized", ESP_ERR_INVALID_STATE);
+    param_cache_t* cache = (param_cache_t*) calloc(1, sizeof(param_cache_t));
+    PARAM_CACHE_CHECK(cache != NULL, "no memory for the param cache", ESP_ERR_NO_MEM);
+    if (config) {
+        cache->config = *config;
+    } else {
+        cache->config = (param_cache_config_t) PARAM_CACHE_CONFIG_DEFAULT();
+    }
+    cache->lock = xSemaphoreCreateMutex();
+    cache->fence_done = xSemaphoreCreateBinary();
+    esp_timer_create_args_t timer_args = {
+        .callback = param_cache_timer_cb,
+        .arg = cache,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "param_cache",
+    };
+    esp_timer_create_args_t fence_args = {
+        .callback = param_cache_fence_cb,
+        .arg = cache,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "param_fence",
+    };
+    if (cache->lock == NULL || cache->fence_done == NULL || esp_timer_create(&timer_args, &cache->timer) != ESP_OK
+            || esp_timer_create(&fence_args, &cache->fence) != ESP_OK) {
+        ESP_LOGE(TAG, "param cache init error");
+        param_cache_free(cache);
+        return ESP_ERR_NO_MEM;
+    }
+    g_cache = cache;
+    return ESP_OK;
+}
+
+esp_err_t iot_param_cache_deinit()
+{
+    PARAM_CACHE_CHECK(g_cache != NULL, "param cache is not initialized", ESP_ERR_INVALID_STATE);
+    param_cache_t* cache = g_cache;
+    // stop the timer before the lock, a commit callback may already be waiting for it
+    esp_timer_stop(cache->timer);
+    xSemaphoreTake(cache->lock, portMAX_DELAY);
+    esp_err_t ret = param_cache_flush_locked();
+    if (ret != ESP_OK) {
+        xSemaphoreGive(cache->lock);
+        return ret;
+    }
+    cache->closing = true;
+    g_cache = NULL;
+    xSemaphoreGive(cache->lock);
+    // a callback dispatched before the stop still uses the cache, wait until it has returned
+    esp_timer_start_once(cache->fence, 0);
+    xSemaphoreTake(cache->fence_done, portMAX_DELAY);
+    while (cache->entry) {
+        param_entry_t* entry = cache->entry;
+        cache->entry = entry->next;
+        free(entry->data);
+        free(entry);
+    }
+    param_cache_free(cache);
+    return ESP_OK;
+}
+
+esp_err_t iot_param_cache_save(const char* space_name, const char* key, const void* param, uint16_t len)
+{
+    PARAM_CACHE_CHECK(g_cache != NULL, "param cache is not initialized", ESP_ERR_INVALID_STATE);
+    PARAM_CACHE_CHECK(space_name && key && param, "parameter is NULL", ESP_ERR_INVALID_ARG);
+    PARAM_CACHE_CHECK(strlen(space_name) < PARAM_NAME_LEN && strlen(key) < PARAM_NAME_LEN, "name is too long", ESP_ERR_INVALID_ARG);
+    PARAM_CACHE_CHECK(len > 0 && len <= PARAM_LEN_MAX, "param length error", ESP_ERR_INVALID_ARG);
+    xSemaphoreTake(g_cache->lock, portMAX_DELAY);
+    param_entry_t* entry;
+    esp_err_t ret = param_cache_get(space_name, key, &entry);
+    if (ret == ESP_OK && !(entry->exist && entry->len == len && memcmp(entry->data, param, len) == 0)) {
+        ret = param_cache_reserve(entry, len);
+        if (ret == ESP_OK) {
+            memcpy(entry->data, param, len);
+            entry->len = len;
+            entry->exist = true;
+            ret = param_cache_changed(entry);
+        }
+    }
+    xSemaphoreGive(g_cache->lock);
+    return ret;
+}
+
+esp_err_t iot_param_cache_load(const char* space_name, const char* key, void* dest, uint16_t len)
+{
+    PARAM_CACHE_CHECK(g_cache != NULL, "param cache is not initialized", ESP_ERR_INVALID_STATE);
+    PARAM_CACHE_CHECK(space_name && key && dest, "parameter is NULL", ESP_ERR_INVALID_ARG);
+    PARAM_CACHE_CHECK(strlen(space_name) < PARAM_NAME_LEN && strlen(key) < PARAM_NAME_LEN, "name is too long", ESP_ERR_INVALID_ARG);
+    xSemaphoreTake(g_cache->lock, portMAX_DELAY);
+    param_entry_t* entry;
+    esp_err_t ret = param_cache_get(space_name, key, &entry);
+    if (ret == ESP_OK) {
+        if (!entry->exist) {
+            ret = ESP_ERR_NVS_NOT_FOUND;
+        } else if (entry->len > len) {
+            ret = ESP_ERR_NVS_INVALID_LENGTH;
+        } else {
+            memcpy(dest, entry->data, entry->len);
+        }
+    }
+    xSemaphoreGive(g_cache->lock);
+    return ret;
+}
+
+esp_err_t iot_param_cache_erase(const char* space_name, const char* key)
+{
+    PARAM_CACHE_CHECK(g_cache != NULL, "param cache is not initialized", ESP_ERR_INVALID_STATE);
+    PARAM_CACHE_CHECK(space_name && key, "parameter is NULL", ESP_ERR_INVALID_ARG);
+    PARAM_CACHE_CHECK(strlen(space_name) < PARAM_NAME_LEN && strlen(key) < PARAM_NAME_LEN, "name is too long", ESP_ERR_INVALID_ARG);
+    xSemaphoreTake(g_cache->lock, portMAX_DELAY);
+    param_entry_t* entry;
+    esp_err_t ret = param_cache_get(space_name, key, &entry);
+    if (ret == ESP_OK && entry->exist) {
+        entry->exist = false;
+        entry->len = 0;
+        ret = param_cache_changed(entry);
+    }
+    xSemaphoreGive(g_cache->lock);
+    return ret;
+}
+
+esp_err_t iot_param_cache_flush()
+{
+    PARAM_CACHE_CHECK(g_cache != NULL, "param cache is not initialized", ESP_ERR_INVALID_STATE);
+    xSemaphoreTake(g_cache->lock, portMAX_DELAY);
+    esp_err_t ret = param_cache_flush_locked();
+    xSemaphoreGive(g_cache->lock);
+    return ret;
+}
@@ -0,0 +1,129 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "iot_param.h"
+#include "iot_param_cache.h"
+#include "unity.h"
+
+#define CACHE_NAMESPACE     "param_cache"
+#define CACHE_KEY           "state"
+#define CACHE_OTHER_KEY     "other"
+
+typedef struct {
+    uint32_t a;
+    uint32_t b;
+} cache_param_t;
+
+static void param_cache_test_nvs_init()
+{
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(err);
+    iot_param_erase(CACHE_NAMESPACE, CACHE_KEY);
+    iot_param_erase(CACHE_NAMESPACE, CACHE_OTHER_KEY);
+}
+
+/* what is in flash, a = 0 if nothing */
+static uint32_t param_cache_test_flash()
+{
+    cache_param_t param = { 0 };
+    iot_param_load(CACHE_NAMESPACE, CACHE_KEY, &param);
+    return param.a;
+}
+
+TEST_CASE("Param cache commit count test", "[param][iot]")
+{
+    param_cache_test_nvs_init();
+    param_cache_config_t config = { .commit_delay_ms = 0, .commit_count = 3 };
+    TEST_ASSERT_EQUAL_INT(ESP_OK, iot_param_cache_init(&config));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_STATE, iot_param_cache_init(&config));
+
+    cache_param_t param = { .a = 1, .b = 10 }, read;
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_NVS_NOT_FOUND, iot_param_cache_load(CACHE_NAMESPACE, CACHE_KEY, &read, sizeof(read)));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, iot_param_cache_save(CACHE_NAMESPACE, CACHE_KEY, &param, sizeof(param)));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, iot_param_cache_load(CACHE_NAMESPACE, CACHE_KEY, &read, sizeof(read)));
+    TEST_ASSERT_EQUAL_INT(1, read.a);
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_NVS_INVALID_LENGTH, iot_param_cache_load(CACHE_NAMESPACE, CACHE_KEY, &read, 4));
+    TEST_ASSERT_EQUAL_INT(0, param_cache_test_flash());
+    param.a = 2;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, iot_param_cache_save(CACHE_NAMESPACE, CACHE_KEY, &param, sizeof(param)));
+    TEST_ASSERT_EQUAL_INT(0, param_cache_test_flash());
+    param.a = 3;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, iot_param_cache_save(CACHE_NAMESPACE, CACHE_KEY, &param, sizeof(param)));
+    TEST_ASSERT_EQUAL_INT(3, param_cache_test_flash());
+
+    // saving the same value is not a change
+    param.a = 4;
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL_INT(ESP_OK, iot_param_cache_save(CACHE_NAMESPACE, CACHE_KEY, &param, sizeof(param)));
+    }
+    TEST_ASSERT_EQUAL_INT(3, param_cache_test_flash());
+    TEST_ASSERT_EQUAL_INT(ESP_OK, iot_param_cache_flush());
+    TEST_ASSERT_EQUAL_INT(4, param_cache_test_flash());
+
+    // erased in flash with the next commit
+    TEST_ASSERT_EQUAL_INT(ESP_OK, iot_param_cache_erase(CACHE_NAMESPACE, CACHE_KEY));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_NVS_NOT_FOUND, iot_param_cache_load(CACHE_NAMESPACE, CACHE_KEY, &read, sizeof(read)));
+    TEST_ASSERT_EQUAL_INT(4, param_cache_test_flash());
+    TEST_ASSERT_EQUAL_INT(ESP_OK, iot_param_cache_deinit());
+    TEST_ASSERT_EQUAL_INT(0, param_cache_test_flash());
+}
+
+TEST_CASE("Param cache commit delay test", "[param][iot]")
+{
+    param_cache_test_nvs_init();
+    cache_param_t param = { .a = 5, .b = 50 }, read = { 0 };
+    TEST_ASSERT_EQUAL_INT(ESP_OK, iot_param_save(CACHE_NAMESPACE, CACHE_OTHER_KEY, &param, sizeof(param)));
+    param_cache_config_t config = { .commit_delay_ms = 100, .commit_count = 0 };
+    TEST_ASSERT_EQUAL_INT(ESP_OK, iot_param_cache_init(&config));
+
+    // read from flash once, then from the cache
+    TEST_ASSERT_EQUAL_INT(ESP_OK, iot_param_cache_load(CACHE_NAMESPACE, CACHE_OTHER_KEY, &read, sizeof(read)));
+    TEST_ASSERT_EQUAL_INT(50, read.b);
+
+    for (int i = 0; i < 20; i++) {
+        param.a = 6 + i;
+        TEST_ASSERT_EQUAL_INT(ESP_OK, iot_param_cache_save(CACHE_NAMESPACE, CACHE_KEY, &param, sizeof(param)));
+    }
+    TEST_ASSERT_EQUAL_INT(0, param_cache_test_flash());
+    vTaskDelay(300 / portTICK_PERIOD_MS);
+    TEST_ASSERT_EQUAL_INT(25, param_cache_test_flash());
+    TEST_ASSERT_EQUAL_INT(ESP_OK, iot_param_cache_deinit());
+}
+
+TEST_CASE("Param cache deinit with a pending commit test", "[param][iot]")
+{
+    param_cache_test_nvs_init();
+    cache_param_t param = { .a = 0, .b = 70 };
+    param_cache_config_t config = { .commit_delay_ms = 20, .commit_count = 0 };
+    for (int i = 0; i < 10; i++) {
+        TEST_ASSERT_EQUAL_INT(ESP_OK, iot_param_cache_init(&config));
+        param.a = 40 + i;
+        TEST_ASSERT_EQUAL_INT(ESP_OK, iot_param_cache_save(CACHE_NAMESPACE, CACHE_KEY, &param, sizeof(param)));
+        // land on both sides of the commit timer
+        vTaskDelay(i * 5 / portTICK_PERIOD_MS);
+        TEST_ASSERT_EQUAL_INT(ESP_OK, iot_param_cache_deinit());
+        TEST_ASSERT_EQUAL_INT(40 + i, param_cache_test_flash());
+    }
+    vTaskDelay(100 / portTICK_PERIOD_MS);
+    TEST_ASSERT_EQUAL_INT(49, param_cache_test_flash());
+}
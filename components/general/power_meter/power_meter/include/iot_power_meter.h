@@ -93,6 +93,27 @@ uint32_t iot_powermeter_read(pm_handle_t pm_handle, pm_value_type_t value_type);
   */
 esp_err_t iot_powermeter_change_mode(pm_handle_t pm_handle, pm_mode_t mode);
 
+/**
+  * @brief  read energy integrated from the power pulses since create or reset,
+  *         every power pulse equals to power_ref_param W*us
+  *
+  * @param  pm_handle handle of the power meter
+  *
+  * @return energy in Wh * CONFIG_POWER_METER_VALUE_MULTIPLE
+  */
+uint64_t iot_powermeter_read_energy(pm_handle_t pm_handle);
+
+/**
+  * @brief  clear the energy accumulator
+  *
+  * @param  pm_handle handle of the power meter
+  *
+  * @return 
+  *     - ESP_OK: succeed
+  *     - ESP_FAIL: pm_handle is NULL or there is no power pin
+  */
+esp_err_t iot_powermeter_reset_energy(pm_handle_t pm_handle);
+
 #ifdef __cplusplus
 }
 #endif
@@ -138,6 +159,22 @@ public:
      */
     uint32_t read(pm_value_type_t value_type);
 
+    /**
+     * @brief  get energy integrated since create or reset
+     *
+     * @return energy in Wh * CONFIG_POWER_METER_VALUE_MULTIPLE
+     */
+    uint64_t read_energy();
+
+    /**
+     * @brief  clear the energy accumulator
+     *
+     * @return
+     *     - ESP_OK: succeed
+     *     - others: fail
+     */
+    esp_err_t reset_energy();
+
     /**
      * @brief  change mode of power meter
      *
@@ -0,0 +1,121 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _IOT_PM_ESTIMATOR_H_
+#define _IOT_PM_ESTIMATOR_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Period estimation and energy integration used by the power meter.
+ * Inputs are pulse counter event time stamps in us, so the code has no
+ * hardware dependency and can be fed with synthesised pulse trains.
+ */
+
+#define PM_EST_WINDOW       (8)             /**< number of event time stamps kept in the sliding window */
+#define PM_EST_US_PER_HOUR  (3600000000ULL)
+
+typedef struct {
+    int64_t stamp[PM_EST_WINDOW];           /**< event time stamps in us, ring buffer */
+    uint32_t pulses_per_evt;                /**< pulses between two events */
+    uint8_t head;                           /**< index of the next stamp to write */
+    uint8_t num;                            /**< number of valid stamps */
+} pm_est_t;
+
+typedef struct {
+    uint64_t wh;                            /**< integrated energy in Wh */
+    uint64_t rem;                           /**< remainder in W*us, always less than one Wh */
+} pm_energy_t;
+
+/**
+  * @brief  init a period estimator
+  *
+  * @param  est estimator
+  * @param  pulses_per_evt number of pulses between two events
+  */
+void pm_est_init(pm_est_t* est, uint32_t pulses_per_evt);
+
+/**
+  * @brief  drop all the time stamps, e.g. after the measured value is switched
+  *
+  * @param  est estimator
+  */
+void pm_est_reset(pm_est_t* est);
+
+/**
+  * @brief  add an event time stamp, O(1) and safe to call from ISR
+  *
+  * @param  est estimator
+  * @param  stamp_us time stamp of the event in us
+  */
+void pm_est_add(pm_est_t* est, int64_t stamp_us);
+
+/**
+  * @brief  calculate the measured value: value = multiple * ref_param / period_us
+  *
+  * @param  est estimator
+  * @param  ref_param reference value, equals to value_ref * period_ref(us)
+  * @param  multiple value multiple
+  * @param  now_us current time stamp in us
+  * @param  zero_us the value is 0 if there is no event for zero_us
+  *
+  * @return measured value, 0 if no valid period is known
+  */
+uint32_t pm_est_value(const pm_est_t* est, uint32_t ref_param, uint32_t multiple, int64_t now_us, int64_t zero_us);
+
+/**
+  * @brief  get the estimated period of one pulse, used to calibrate ref_param
+  *
+  * @param  est estimator
+  * @param  now_us current time stamp in us
+  * @param  zero_us the period is unknown if there is no event for zero_us
+  *
+  * @return period in us, 0 if no valid period is known
+  */
+uint32_t pm_est_period(const pm_est_t* est, int64_t now_us, int64_t zero_us);
+
+/**
+  * @brief  reset an energy accumulator
+  *
+  * @param  energy accumulator
+  */
+void pm_energy_reset(pm_energy_t* energy);
+
+/**
+  * @brief  integrate pulses, every pulse equals to ref_param W*us
+  *
+  * @param  energy accumulator
+  * @param  pulses number of pulses
+  * @param  ref_param reference value of power, equals to power_ref(W) * period_ref(us)
+  */
+void pm_energy_add(pm_energy_t* energy, uint32_t pulses, uint32_t ref_param);
+
+/**
+  * @brief  get integrated energy
+  *
+  * @param  energy accumulator
+  * @param  multiple value multiple
+  *
+  * @return energy in Wh * multiple
+  */
+uint64_t pm_energy_get(const pm_energy_t* energy, uint32_t multiple);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,110 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include <stdbool.h>
+#include "pm_estimator.h"
+
+#define PM_EST_IDX(est, back)   (((est)->head + PM_EST_WINDOW - 1 - (back)) % PM_EST_WINDOW)
+
+void pm_est_init(pm_est_t* est, uint32_t pulses_per_evt)
+{
+    memset(est, 0, sizeof(pm_est_t));
+    est->pulses_per_evt = pulses_per_evt ? pulses_per_evt : 1;
+}
+
+void pm_est_reset(pm_est_t* est)
+{
+    est->head = 0;
+    est->num = 0;
+}
+
+void pm_est_add(pm_est_t* est, int64_t stamp_us)
+{
+    if (est->num >= 2) {
+        // restart the window on a load step so that the estimate follows it at once
+        int64_t last = est->stamp[PM_EST_IDX(est, 0)] - est->stamp[PM_EST_IDX(est, 1)];
+        int64_t cur = stamp_us - est->stamp[PM_EST_IDX(est, 0)];
+        if (cur > 2 * last || 2 * cur < last) {
+            int64_t prev = est->stamp[PM_EST_IDX(est, 0)];
+            est->head = 0;
+            est->num = 1;
+            est->stamp[est->head++] = prev;
+        }
+    }
+    est->stamp[est->head] = stamp_us;
+    est->head = (est->head + 1) % PM_EST_WINDOW;
+    if (est->num < PM_EST_WINDOW) {
+        est->num++;
+    }
+}
+
+/* pulses and the time span they took, false if no valid period is known */
+static bool pm_est_span(const pm_est_t* est, int64_t now_us, int64_t zero_us, uint64_t* pulses, uint64_t* span)
+{
+    if (est->num < 2) {
+        return false;
+    }
+    int64_t newest = est->stamp[PM_EST_IDX(est, 0)];
+    int64_t oldest = est->stamp[PM_EST_IDX(est, est->num - 1)];
+    int64_t gap = now_us - newest;
+    if (gap > zero_us) {
+        return false;
+    }
+    *pulses = (uint64_t) est->pulses_per_evt * (est->num - 1);
+    *span = (uint64_t)(newest - oldest);
+    // no event for longer than one event period: the period is at least gap / pulses_per_evt
+    if ((uint64_t) gap * *pulses > *span * est->pulses_per_evt) {
+        *pulses = est->pulses_per_evt;
+        *span = (uint64_t) gap;
+    }
+    return *span != 0;
+}
+
+uint32_t pm_est_value(const pm_est_t* est, uint32_t ref_param, uint32_t multiple, int64_t now_us, int64_t zero_us)
+{
+    uint64_t pulses, span;
+    if (!pm_est_span(est, now_us, zero_us, &pulses, &span)) {
+        return 0;
+    }
+    return (uint32_t)((uint64_t) multiple * ref_param * pulses / span);
+}
+
+uint32_t pm_est_period(const pm_est_t* est, int64_t now_us, int64_t zero_us)
+{
+    uint64_t pulses, span;
+    if (!pm_est_span(est, now_us, zero_us, &pulses, &span)) {
+        return 0;
+    }
+    return (uint32_t)(span / pulses);
+}
+
+void pm_energy_reset(pm_energy_t* energy)
+{
+    energy->wh = 0;
+    energy->rem = 0;
+}
+
+void pm_energy_add(pm_energy_t* energy, uint32_t pulses, uint32_t ref_param)
+{
+    energy->rem += (uint64_t) pulses * ref_param;
+    if (energy->rem >= PM_EST_US_PER_HOUR) {
+        energy->wh += energy->rem / PM_EST_US_PER_HOUR;
+        energy->rem %= PM_EST_US_PER_HOUR;
+    }
+}
+
+uint64_t pm_energy_get(const pm_energy_t* energy, uint32_t multiple)
+{
+    return energy->wh * multiple + energy->rem * multiple / PM_EST_US_PER_HOUR;
+}
@@ -15,24 +15,21 @@
 #include <stdio.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/timers.h"
 #include "driver/gpio.h"
 #include "driver/pcnt.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "iot_power_meter.h"
-#include "sys/time.h"
+#include "pm_estimator.h"
 
 #define PM_PCNT_CHANNEL     CONFIG_POWER_METER_PCNT_CHANNEL
-#define PM_PCNT_THRES0     1
-#define PM_MAX  2
 #define PM_PIN_MAX  3
-#define PM_ZERO_PERIOD      CONFIG_POWER_METER_ZERO_PERIOD_MS
+#define PM_ZERO_PERIOD_US   ((int64_t)CONFIG_POWER_METER_ZERO_PERIOD_MS * 1000)
 #define PM_VALUE_MULTIPLE   CONFIG_POWER_METER_VALUE_MULTIPLE
-#define PM_PCNT_H_LIM   11
+#define PM_PULSES_PER_EVT   CONFIG_POWER_METER_PULSES_PER_EVENT
 #define PM_PCNT_L_LIM   -1000
 #define PM_PCNT_FILTER      CONFIG_POWER_METER_PCNT_FILTER
 #define PM_VALUE_INF    (1000 * 1000 * 1000)
-#define US_PER_SECOND   1000000
 
 #define IOT_CHECK(tag, a, ret)  if(!(a)) {       \
         return (ret);                            \
@@ -40,86 +37,76 @@
 #define ERR_ASSERT(tag, param)  IOT_CHECK(tag, (param) == ESP_OK, ESP_FAIL)
 #define POINT_ASSERT(tag, param)	IOT_CHECK(tag, (param) != NULL, ESP_FAIL)
 
+/* one pulse counter unit, shared by voltage and current when they are output by the same pin */
 typedef struct {
     pcnt_unit_t pcnt_unit;
-    int last_time;
-    int time_diff;
+    uint8_t ref_cnt;
+    uint32_t energy_ref;            /* ref_param of power if this unit counts power pulses, or 0 */
+    pm_est_t est;
+    pm_energy_t energy;
+} pm_unit_t;
+
+typedef struct {
+    pm_unit_t* unit;
     uint32_t ref_param;
-    bool zero_flag;
 } pm_pin_t;
 
 typedef struct {
     pm_pin_t* pm_pin[PM_PIN_MAX];
     pm_mode_t pm_mode;
-    TimerHandle_t zero_timer;
     uint8_t sel_io_num;
     uint8_t sel_level;
 } pm_dev_t;
 
 // Debug tag in esp log
 static const char* TAG = "power meter";
-static pm_dev_t* g_pm_group[PM_MAX];
-static uint8_t g_pm_num;
-
-static void pm_timer_callback(TimerHandle_t xTimer)
-{
-    pm_dev_t* pm_dev;
-    pm_pin_t* pm_pin;
-    for (int i = 0; i < g_pm_num; i++) {
-        pm_dev = g_pm_group[i];
-        for (int j = 0; j < PM_PIN_MAX; j++) {
-            if (pm_dev->pm_pin[j] != NULL) {
-                pm_pin = pm_dev->pm_pin[j];
-                if (pm_pin->zero_flag == true) {
-                    pm_pin->time_diff = PM_VALUE_INF;
-                    pcnt_counter_clear(pm_pin->pcnt_unit);
-                    pcnt_counter_resume(pm_pin->pcnt_unit);
-                }
-                pm_pin->zero_flag = true;
-            }
-        }
-    }
-}
+static pm_unit_t* g_pm_unit[PCNT_UNIT_MAX];
+static uint32_t g_pm_unit_mask;
+static pcnt_isr_handle_t g_pm_isr_handle;
+static portMUX_TYPE g_pm_spinlock = portMUX_INITIALIZER_UNLOCKED;
 
 static void pm_pcnt_intr_handler(void *arg)
 {
-    uint32_t intr_status = PCNT.int_st.val;
-    PCNT.int_clr.val = 0xff;
-    pm_dev_t* pm_dev;
-    pm_pin_t* pm_pin;
-    struct timeval tm;
-    for(uint8_t i = 0; i < PM_MAX; i++) {
-        if (g_pm_group[i] != NULL) {
-            pm_dev = g_pm_group[i];
-            for(uint8_t j = 0; j < PM_PIN_MAX; j++) {
-                pm_pin = pm_dev->pm_pin[j];
-                if (pm_pin != NULL && (BIT(pm_pin->pcnt_unit) & intr_status)) {
-                    if (PCNT.status_unit[pm_pin->pcnt_unit].h_lim_lat) {
-                        pcnt_counter_clear(pm_pin->pcnt_unit);
-                        pcnt_counter_resume(pm_pin->pcnt_unit);
-                        gettimeofday(&tm, NULL);
-                        int time = tm.tv_sec * US_PER_SECOND + tm.tv_usec;
-                        pm_pin->time_diff = (time - pm_pin->last_time) / (PM_PCNT_H_LIM - 1);
-                        pm_pin->last_time = time;
-                        pm_pin->zero_flag = false;
-                    }
-                    if (PCNT.status_unit[pm_pin->pcnt_unit].thres0_lat) {
-                        gettimeofday(&tm, NULL);
-                        pm_pin->last_time = tm.tv_sec * US_PER_SECOND + tm.tv_usec;
-                    }
-                }
+    uint32_t intr_status = PCNT.int_st.val & g_pm_unit_mask;
+    PCNT.int_clr.val = intr_status;
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL_ISR(&g_pm_spinlock);
+    // only dispatch the units flagged in int_st
+    while (intr_status) {
+        int unit = __builtin_ctz(intr_status);
+        intr_status &= intr_status - 1;
+        pm_unit_t* pm_unit = g_pm_unit[unit];
+        if (pm_unit != NULL && PCNT.status_unit[unit].h_lim_lat) {
+            pm_est_add(&pm_unit->est, now);
+            if (pm_unit->energy_ref) {
+                pm_energy_add(&pm_unit->energy, PM_PULSES_PER_EVT, pm_unit->energy_ref);
             }
         }
-    }   
+    }
+    portEXIT_CRITICAL_ISR(&g_pm_spinlock);
 }
 
-static pm_pin_t* powermeter_pin_create(uint8_t io_num, pcnt_unit_t pcnt_unit, uint32_t ref_param)
+static pm_unit_t* powermeter_unit_get(uint8_t io_num, pcnt_unit_t pcnt_unit)
 {
-    pm_pin_t* pm_pin = (pm_pin_t*) calloc(1, sizeof(pm_pin_t));
-    if (pm_pin == NULL) {
+    if (pcnt_unit >= PCNT_UNIT_MAX) {
+        ESP_LOGE(TAG, "error pcnt unit");
+        return NULL;
+    }
+    pm_unit_t* pm_unit = g_pm_unit[pcnt_unit];
+    if (pm_unit != NULL) {
+        pm_unit->ref_cnt++;
+        return pm_unit;
+    }
+    pm_unit = (pm_unit_t*) calloc(1, sizeof(pm_unit_t));
+    if (pm_unit == NULL) {
         ESP_LOGE(TAG, "error no memory");
         return NULL;
     }
+    pm_unit->pcnt_unit = pcnt_unit;
+    pm_unit->ref_cnt = 1;
+    pm_est_init(&pm_unit->est, PM_PULSES_PER_EVT);
+    pm_energy_reset(&pm_unit->energy);
+
     pcnt_config_t pcnt_config = {
         .pulse_gpio_num = io_num,
         .ctrl_gpio_num = -1,
@@ -129,42 +116,93 @@ static pm_pin_t* powermeter_pin_create(uint8_t io_num, pcnt_unit_t pcnt_unit, ui
         .neg_mode = PCNT_COUNT_DIS,
         .lctrl_mode = PCNT_MODE_KEEP,
         .hctrl_mode = PCNT_MODE_KEEP,
-        .counter_h_lim = PM_PCNT_H_LIM,
+        .counter_h_lim = PM_PULSES_PER_EVT,
         .counter_l_lim = PM_PCNT_L_LIM,
     };
     pcnt_unit_config(&pcnt_config);
     pcnt_set_filter_value(pcnt_unit, PM_PCNT_FILTER);
     pcnt_filter_enable(pcnt_unit);
     pcnt_event_enable(pcnt_unit, PCNT_EVT_H_LIM);
-    pcnt_set_event_value(pcnt_unit, PCNT_EVT_THRES_0, PM_PCNT_THRES0);
-    pcnt_event_enable(pcnt_unit, PCNT_EVT_THRES_0);
     pcnt_counter_pause(pcnt_unit);
     pcnt_counter_clear(pcnt_unit);
-    pcnt_isr_register(pm_pcnt_intr_handler, NULL, 0, NULL);
+
+    portENTER_CRITICAL(&g_pm_spinlock);
+    g_pm_unit[pcnt_unit] = pm_unit;
+    g_pm_unit_mask |= BIT(pcnt_unit);
+    portEXIT_CRITICAL(&g_pm_spinlock);
+    if (g_pm_isr_handle == NULL) {
+        pcnt_isr_register(pm_pcnt_intr_handler, NULL, 0, &g_pm_isr_handle);
+    }
     pcnt_intr_enable(pcnt_unit);
     pcnt_counter_resume(pcnt_unit);
+    return pm_unit;
+}
 
-    pm_pin->last_time = 0;
-    pm_pin->pcnt_unit = pcnt_unit;
+static void powermeter_unit_put(pm_unit_t* pm_unit)
+{
+    if (--pm_unit->ref_cnt > 0) {
+        return;
+    }
+    pcnt_intr_disable(pm_unit->pcnt_unit);
+    pcnt_counter_pause(pm_unit->pcnt_unit);
+    portENTER_CRITICAL(&g_pm_spinlock);
+    g_pm_unit[pm_unit->pcnt_unit] = NULL;
+    g_pm_unit_mask &= ~BIT(pm_unit->pcnt_unit);
+    portEXIT_CRITICAL(&g_pm_spinlock);
+    if (g_pm_unit_mask == 0 && g_pm_isr_handle != NULL) {
+        esp_intr_free(g_pm_isr_handle);
+        g_pm_isr_handle = NULL;
+    }
+    free(pm_unit);
+}
+
+static pm_pin_t* powermeter_pin_create(uint8_t io_num, pcnt_unit_t pcnt_unit, uint32_t ref_param)
+{
+    pm_pin_t* pm_pin = (pm_pin_t*) calloc(1, sizeof(pm_pin_t));
+    if (pm_pin == NULL) {
+        ESP_LOGE(TAG, "error no memory");
+        return NULL;
+    }
+    pm_pin->unit = powermeter_unit_get(io_num, pcnt_unit);
+    if (pm_pin->unit == NULL) {
+        free(pm_pin);
+        return NULL;
+    }
     pm_pin->ref_param = ref_param;
-    pm_pin->time_diff = PM_VALUE_INF;
-    pm_pin->zero_flag = true;
     return pm_pin;
 }
 
 static esp_err_t powermeter_pin_delete(pm_pin_t* pm_pin)
 {
     POINT_ASSERT(TAG, pm_pin);
+    powermeter_unit_put(pm_pin->unit);
     free(pm_pin);
     return ESP_OK;
 }
 
-pm_handle_t iot_powermeter_create(pm_config_t pm_config)
+static uint32_t powermeter_pin_read(pm_pin_t* pm_pin)
 {
-    if (g_pm_num >= PM_MAX) {
-        ESP_LOGE(TAG, "too many powermeters created");
-        return NULL;
+    pm_est_t est;
+    portENTER_CRITICAL(&g_pm_spinlock);
+    est = pm_pin->unit->est;
+    portEXIT_CRITICAL(&g_pm_spinlock);
+    if (pm_pin->ref_param == 0) {
+        // calibration: read the raw pulse period in us
+        uint32_t period = pm_est_period(&est, esp_timer_get_time(), PM_ZERO_PERIOD_US);
+        return period ? period : PM_VALUE_INF;
     }
+    return pm_est_value(&est, pm_pin->ref_param, PM_VALUE_MULTIPLE, esp_timer_get_time(), PM_ZERO_PERIOD_US);
+}
+
+static uint32_t powermeter_derive(uint32_t dividend, uint32_t divisor)
+{
+    IOT_CHECK(TAG, dividend != 0, 0);
+    IOT_CHECK(TAG, divisor != 0, PM_VALUE_INF);
+    return (uint32_t)((uint64_t) PM_VALUE_MULTIPLE * dividend / divisor);
+}
+
+pm_handle_t iot_powermeter_create(pm_config_t pm_config)
+{
     pm_dev_t* pm_dev = (pm_dev_t*)calloc(1, sizeof(pm_dev_t));
     if (pm_dev == NULL) {
         ESP_LOGE(TAG, "error no memory");
@@ -175,6 +213,11 @@ pm_handle_t iot_powermeter_create(pm_config_t pm_config)
     }
     if (pm_config.power_io_num != 0xff) {
         pm_dev->pm_pin[PM_POWER] = powermeter_pin_create(pm_config.power_io_num, pm_config.power_pcnt_unit, pm_config.power_ref_param);
+        if (pm_dev->pm_pin[PM_POWER] != NULL) {
+            portENTER_CRITICAL(&g_pm_spinlock);
+            pm_dev->pm_pin[PM_POWER]->unit->energy_ref = pm_config.power_ref_param;
+            portEXIT_CRITICAL(&g_pm_spinlock);
+        }
     }
     if (pm_config.voltage_io_num != 0xff) {
         pm_dev->pm_pin[PM_VOLTAGE] = powermeter_pin_create(pm_config.voltage_io_num, pm_config.voltage_pcnt_unit, pm_config.voltage_ref_param);
@@ -195,15 +238,6 @@ pm_handle_t iot_powermeter_create(pm_config_t pm_config)
         gpio_set_level(pm_dev->sel_io_num, pm_config.sel_level);
     }
     pm_dev->pm_mode = pm_config.pm_mode;
-    pm_dev->zero_timer = xTimerCreate("pm_zero_timer", PM_ZERO_PERIOD, pdTRUE, (void*)0, pm_timer_callback);
-    g_pm_num++;
-    for (int i = 0; i < PM_MAX; i++) {
-        if (g_pm_group[i] == NULL) {
-            g_pm_group[i] = pm_dev;
-            break;
-        }
-    }
-            
     return (pm_handle_t) pm_dev;
 }
 
@@ -211,24 +245,13 @@ esp_err_t iot_powermeter_delete(pm_handle_t pm_handle)
 {
     pm_dev_t* pm_dev = (pm_dev_t*) pm_handle;
     POINT_ASSERT(TAG, pm_handle);
-    for (int i = 0; i < PM_MAX; i++) {
-        if (g_pm_group[i] == pm_dev) {
-            g_pm_group[i] = NULL;
-            break;
-        }
-    }
     for (int i = 0; i < PM_PIN_MAX; i++) {
         if (pm_dev->pm_pin[i] != NULL) {
             powermeter_pin_delete(pm_dev->pm_pin[i]);
             pm_dev->pm_pin[i] = NULL;
         }
     }
-    if (pm_dev->zero_timer != NULL) {
-        xTimerDelete(pm_dev->zero_timer, portMAX_DELAY);
-        pm_dev->zero_timer = NULL;
-    }
     free(pm_dev);
-    g_pm_num--;
     return ESP_OK;
 }
 
@@ -252,6 +275,13 @@ esp_err_t iot_powermeter_change_mode(pm_handle_t pm_handle, pm_mode_t mode)
         pm_dev->sel_level = (~pm_dev->sel_level) & 0x01;
         IOT_CHECK(TAG, pm_dev->sel_io_num < GPIO_PIN_COUNT, ESP_FAIL);
         gpio_set_level(pm_dev->sel_io_num, pm_dev->sel_level);
+        // the pulses counted so far belong to the other value
+        pm_pin_t* pm_pin = pm_dev->pm_pin[(mode == PM_SINGLE_VOLTAGE) ? PM_VOLTAGE : PM_CURRENT];
+        if (pm_pin != NULL) {
+            portENTER_CRITICAL(&g_pm_spinlock);
+            pm_est_reset(&pm_pin->unit->est);
+            portEXIT_CRITICAL(&g_pm_spinlock);
+        }
         ESP_LOGI(TAG, "power meter mode:%d", mode);
         return ESP_OK;
     }
@@ -267,60 +297,32 @@ uint32_t iot_powermeter_read(pm_handle_t pm_handle, pm_value_type_t value_type)
     switch (value_type) {
         case PM_POWER:
             if (pm_dev->pm_pin[PM_POWER] != NULL) {
-                if (pm_dev->pm_pin[PM_POWER]->ref_param == 0) {
-                    return pm_dev->pm_pin[PM_POWER]->time_diff;
-                }
-                else {
-                    IOT_CHECK(TAG, pm_dev->pm_pin[PM_POWER]->time_diff != 0, PM_VALUE_INF);
-                    return PM_VALUE_MULTIPLE * pm_dev->pm_pin[PM_POWER]->ref_param / pm_dev->pm_pin[PM_POWER]->time_diff;
-                }
+                return powermeter_pin_read(pm_dev->pm_pin[PM_POWER]);
             }
             break;
-         case PM_VOLTAGE:
+        case PM_VOLTAGE:
             if (pm_dev->pm_mode == PM_SINGLE_CURRENT) {
                 if (pm_dev->pm_pin[PM_POWER] != NULL && pm_dev->pm_pin[PM_CURRENT] != NULL) {
-                    IOT_CHECK(TAG, pm_dev->pm_pin[PM_POWER]->time_diff != 0, PM_VALUE_INF);
-                    uint32_t power = pm_dev->pm_pin[PM_POWER]->ref_param / pm_dev->pm_pin[PM_POWER]->time_diff;
-                    IOT_CHECK(TAG, pm_dev->pm_pin[PM_CURRENT]->time_diff != 0, PM_VALUE_INF);
-                    uint32_t current = pm_dev->pm_pin[PM_CURRENT]->ref_param / pm_dev->pm_pin[PM_CURRENT]->time_diff;
-                    IOT_CHECK(TAG, power != 0, 0);
-                    IOT_CHECK(TAG, current != 0, PM_VALUE_INF);
-                    return PM_VALUE_MULTIPLE * power / current;     
+                    return powermeter_derive(powermeter_pin_read(pm_dev->pm_pin[PM_POWER]),
+                                             powermeter_pin_read(pm_dev->pm_pin[PM_CURRENT]));
                 }
             }
             else {
                 if (pm_dev->pm_pin[PM_VOLTAGE] != NULL) {
-                    if (pm_dev->pm_pin[PM_VOLTAGE]->ref_param == 0) {
-                        return pm_dev->pm_pin[PM_VOLTAGE]->time_diff;
-                    }
-                    else {
-                        IOT_CHECK(TAG, pm_dev->pm_pin[PM_VOLTAGE]->time_diff != 0, PM_VALUE_INF);
-                        return PM_VALUE_MULTIPLE * pm_dev->pm_pin[PM_VOLTAGE]->ref_param / pm_dev->pm_pin[PM_VOLTAGE]->time_diff;
-                    }
+                    return powermeter_pin_read(pm_dev->pm_pin[PM_VOLTAGE]);
                 }
             }
             break;
         case PM_CURRENT:
             if (pm_dev->pm_mode == PM_SINGLE_VOLTAGE) {
                 if (pm_dev->pm_pin[PM_POWER] != NULL && pm_dev->pm_pin[PM_VOLTAGE] != NULL) {
-                    IOT_CHECK(TAG, pm_dev->pm_pin[PM_POWER]->time_diff != 0, PM_VALUE_INF);
-                    uint32_t power = pm_dev->pm_pin[PM_POWER]->ref_param / pm_dev->pm_pin[PM_POWER]->time_diff;
-                    IOT_CHECK(TAG, pm_dev->pm_pin[PM_VOLTAGE]->time_diff != 0, PM_VALUE_INF);
-                    uint32_t voltage = pm_dev->pm_pin[PM_VOLTAGE]->ref_param / pm_dev->pm_pin[PM_VOLTAGE]->time_diff;
-                    IOT_CHECK(TAG, power != 0, 0);
-                    IOT_CHECK(TAG, voltage != 0, PM_VALUE_INF);
-                    return PM_VALUE_MULTIPLE * power / voltage;
+                    return powermeter_derive(powermeter_pin_read(pm_dev->pm_pin[PM_POWER]),
+                                             powermeter_pin_read(pm_dev->pm_pin[PM_VOLTAGE]));
                 }
             }
             else {
                 if (pm_dev->pm_pin[PM_CURRENT] != NULL) {
-                    if (pm_dev->pm_pin[PM_CURRENT]->ref_param == 0) {
-                        return pm_dev->pm_pin[PM_CURRENT]->time_diff;
-                    }
-                    else {
-                        IOT_CHECK(TAG, pm_dev->pm_pin[PM_CURRENT]->time_diff != 0, PM_VALUE_INF);
-                        return PM_VALUE_MULTIPLE * pm_dev->pm_pin[PM_CURRENT]->ref_param / pm_dev->pm_pin[PM_CURRENT]->time_diff;
-                    }
+                    return powermeter_pin_read(pm_dev->pm_pin[PM_CURRENT]);
                 }
             }
             break;
@@ -330,3 +332,36 @@ uint32_t iot_powermeter_read(pm_handle_t pm_handle, pm_value_type_t value_type)
     }
     return 0;
 }
+
+uint64_t iot_powermeter_read_energy(pm_handle_t pm_handle)
+{
+    if (pm_handle == NULL) {
+        ESP_LOGE(TAG, "argument check error");
+        return 0;
+    }
+    pm_dev_t* pm_dev = (pm_dev_t*) pm_handle;
+    pm_pin_t* pm_pin = pm_dev->pm_pin[PM_POWER];
+    IOT_CHECK(TAG, pm_pin != NULL, 0);
+    int16_t pending = 0;
+    pm_energy_t energy;
+    portENTER_CRITICAL(&g_pm_spinlock);
+    energy = pm_pin->unit->energy;
+    pcnt_get_counter_value(pm_pin->unit->pcnt_unit, &pending);
+    portEXIT_CRITICAL(&g_pm_spinlock);
+    // add the pulses not reported by an event yet
+    if (pending > 0) {
+        pm_energy_add(&energy, pending, pm_pin->ref_param);
+    }
+    return pm_energy_get(&energy, PM_VALUE_MULTIPLE);
+}
+
+esp_err_t iot_powermeter_reset_energy(pm_handle_t pm_handle)
+{
+    POINT_ASSERT(TAG, pm_handle);
+    pm_dev_t* pm_dev = (pm_dev_t*) pm_handle;
+    POINT_ASSERT(TAG, pm_dev->pm_pin[PM_POWER]);
+    portENTER_CRITICAL(&g_pm_spinlock);
+    pm_energy_reset(&pm_dev->pm_pin[PM_POWER]->unit->energy);
+    portEXIT_CRITICAL(&g_pm_spinlock);
+    return ESP_OK;
+}
@@ -35,6 +35,16 @@ uint32_t CPowerMeter::read(pm_value_type_t value_type)
     return iot_powermeter_read(m_pm_handle, value_type);
 }
 
+uint64_t CPowerMeter::read_energy()
+{
+    return iot_powermeter_read_energy(m_pm_handle);
+}
+
+esp_err_t CPowerMeter::reset_energy()
+{
+    return iot_powermeter_reset_energy(m_pm_handle);
+}
+
 esp_err_t CPowerMeter::change_mode(pm_mode_t mode)
 {
     return iot_powermeter_change_mode(m_pm_handle, mode);
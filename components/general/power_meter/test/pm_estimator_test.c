@@ -0,0 +1,142 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include "unity.h"
+#include "pm_estimator.h"
+
+#define PM_SIM_POWER_PARAM      1293699     /* power_ref * period_ref of a HLW8012 board, W*us */
+#define PM_SIM_MULTIPLE         100
+#define PM_SIM_PULSES_PER_EVT   10
+#define PM_SIM_ZERO_US          5000000
+#define PM_SIM_JITTER_US        20
+
+static uint32_t s_rand = 1;
+
+/* deterministic jitter in [-PM_SIM_JITTER_US, PM_SIM_JITTER_US] */
+static int32_t pm_sim_jitter()
+{
+    s_rand = s_rand * 1103515245 + 12345;
+    return (int32_t)((s_rand >> 16) % (2 * PM_SIM_JITTER_US + 1)) - PM_SIM_JITTER_US;
+}
+
+/*
+ * Feed a CF pulse train of the given power for duration_us into the estimator and the energy
+ * accumulator the same way the pcnt interrupt does, return the time stamp of the end of the train.
+ */
+static int64_t pm_sim_pulse_train(pm_est_t* est, pm_energy_t* energy, int64_t start_us, double* pulse_us,
+                                  uint32_t power_w, int64_t duration_us, uint64_t* pulses)
+{
+    double period_us = (double) PM_SIM_POWER_PARAM / power_w;
+    uint32_t cnt = 0;
+    while (*pulse_us + period_us < start_us + duration_us) {
+        *pulse_us += period_us;
+        (*pulses)++;
+        if (++cnt == PM_SIM_PULSES_PER_EVT) {
+            cnt = 0;
+            pm_est_add(est, (int64_t) *pulse_us + pm_sim_jitter());
+            pm_energy_add(energy, PM_SIM_PULSES_PER_EVT, PM_SIM_POWER_PARAM);
+        }
+    }
+    return start_us + duration_us;
+}
+
+TEST_CASE("Power meter estimator accuracy test", "[power_meter][iot]")
+{
+    const uint32_t loads[] = { 5, 20, 100, 500, 1000, 2200, 3500 };
+    for (int i = 0; i < sizeof(loads) / sizeof(loads[0]); i++) {
+        pm_est_t est;
+        pm_energy_t energy;
+        pm_est_init(&est, PM_SIM_PULSES_PER_EVT);
+        pm_energy_reset(&energy);
+        double pulse_us = 0;
+        uint64_t pulses = 0;
+        /* long enough to get a full window at every load */
+        int64_t duration = (int64_t) PM_SIM_POWER_PARAM / loads[i] * PM_SIM_PULSES_PER_EVT * (PM_EST_WINDOW + 1);
+        int64_t now = pm_sim_pulse_train(&est, &energy, 0, &pulse_us, loads[i], duration, &pulses);
+        uint32_t expect = loads[i] * PM_SIM_MULTIPLE;
+        uint32_t value = pm_est_value(&est, PM_SIM_POWER_PARAM, PM_SIM_MULTIPLE, now, PM_SIM_ZERO_US);
+        printf("load %dW, read %d.%02dW\n", loads[i], value / PM_SIM_MULTIPLE, value % PM_SIM_MULTIPLE);
+        TEST_ASSERT_UINT32_WITHIN(expect / 100 + 1, expect, value);
+    }
+}
+
+TEST_CASE("Power meter estimator load step test", "[power_meter][iot]")
+{
+    pm_est_t est;
+    pm_energy_t energy;
+    pm_est_init(&est, PM_SIM_PULSES_PER_EVT);
+    pm_energy_reset(&energy);
+    double pulse_us = 0;
+    uint64_t pulses = 0;
+    int64_t now = pm_sim_pulse_train(&est, &energy, 0, &pulse_us, 100, 2000000, &pulses);
+    TEST_ASSERT_UINT32_WITHIN(100, 100 * PM_SIM_MULTIPLE, pm_est_value(&est, PM_SIM_POWER_PARAM, PM_SIM_MULTIPLE, now, PM_SIM_ZERO_US));
+
+    /* step up: the window restarts, two events later the new load is read */
+    now = pm_sim_pulse_train(&est, &energy, now, &pulse_us, 1000, 200000, &pulses);
+    TEST_ASSERT_UINT32_WITHIN(1000, 1000 * PM_SIM_MULTIPLE, pm_est_value(&est, PM_SIM_POWER_PARAM, PM_SIM_MULTIPLE, now, PM_SIM_ZERO_US));
+
+    /* step down: before the next event the value decays with the gap since the last event */
+    int64_t last_evt = (int64_t) pulse_us;
+    now = pm_sim_pulse_train(&est, &energy, now, &pulse_us, 10, 1000000, &pulses);
+    uint32_t value = pm_est_value(&est, PM_SIM_POWER_PARAM, PM_SIM_MULTIPLE, now, PM_SIM_ZERO_US);
+    TEST_ASSERT_TRUE(value < 1000 * PM_SIM_MULTIPLE * ((int64_t) pulse_us - last_evt) / (now - last_evt) + 100);
+
+    /* load off: the value drops to 0 after the zero period */
+    now += PM_SIM_ZERO_US + 1;
+    TEST_ASSERT_EQUAL_UINT32(0, pm_est_value(&est, PM_SIM_POWER_PARAM, PM_SIM_MULTIPLE, now, PM_SIM_ZERO_US));
+}
+
+TEST_CASE("Power meter energy accumulation test", "[power_meter][iot]")
+{
+    pm_est_t est;
+    pm_energy_t energy;
+    pm_est_init(&est, PM_SIM_PULSES_PER_EVT);
+    pm_energy_reset(&energy);
+    double pulse_us = 0;
+    uint64_t pulses = 0;
+    /* 2000W for 30 minutes is 1000Wh */
+    pm_sim_pulse_train(&est, &energy, 0, &pulse_us, 2000, 1800LL * 1000000, &pulses);
+    uint64_t wh = pm_energy_get(&energy, PM_SIM_MULTIPLE);
+    printf("energy %u.%02uWh, %u pulses\n", (uint32_t)(wh / PM_SIM_MULTIPLE), (uint32_t)(wh % PM_SIM_MULTIPLE), (uint32_t) pulses);
+    TEST_ASSERT_UINT32_WITHIN(100, 1000 * PM_SIM_MULTIPLE, (uint32_t) wh);
+
+    /* no overflow for a huge number of pulses: 2^32 pulses of 1293699 W*us */
+    pm_energy_reset(&energy);
+    for (int i = 0; i < 4; i++) {
+        pm_energy_add(&energy, 0x40000000, PM_SIM_POWER_PARAM);
+    }
+    uint64_t expect = (uint64_t) PM_SIM_POWER_PARAM * 0x100000000ULL / PM_EST_US_PER_HOUR;
+    TEST_ASSERT_TRUE(pm_energy_get(&energy, 1) == expect);
+}
+
+TEST_CASE("Power meter estimator calibration period test", "[power_meter][iot]")
+{
+    pm_est_t est;
+    pm_energy_t energy;
+    pm_est_init(&est, PM_SIM_PULSES_PER_EVT);
+    pm_energy_reset(&energy);
+    double pulse_us = 0;
+    uint64_t pulses = 0;
+    TEST_ASSERT_EQUAL_UINT32(0, pm_est_period(&est, 0, PM_SIM_ZERO_US));
+
+    /* the period read with ref_param 0 gives back ref_param = power * period */
+    int64_t now = pm_sim_pulse_train(&est, &energy, 0, &pulse_us, 100, 2000000, &pulses);
+    uint32_t period = pm_est_period(&est, now, PM_SIM_ZERO_US);
+    printf("load 100W, period %dus\n", period);
+    TEST_ASSERT_UINT32_WITHIN(PM_SIM_POWER_PARAM / 100 / 100 + 1, PM_SIM_POWER_PARAM / 100, period);
+    TEST_ASSERT_UINT32_WITHIN(PM_SIM_POWER_PARAM / 100, PM_SIM_POWER_PARAM, 100 * period);
+
+    now += PM_SIM_ZERO_US + 1;
+    TEST_ASSERT_EQUAL_UINT32(0, pm_est_period(&est, now, PM_SIM_ZERO_US));
+}
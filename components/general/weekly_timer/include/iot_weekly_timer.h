@@ -18,6 +18,10 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
 #define TIMER_NEAREST_INF     2147483647
 typedef void (*timer_cb_t)(void *);
 
@@ -0,0 +1,111 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _IOT_WEEKLY_SCHED_H_
+#define _IOT_WEEKLY_SCHED_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <time.h>
+#include "esp_err.h"
+
+/*
+ * Deadline heap of the weekly timer. All the point-in-times of all the timers are kept in one min-heap
+ * keyed by their next trigger time, so only the earliest one needs a FreeRTOS timer.
+ */
+
+#define WEEKLY_SCHED_ALL_DAYS   (0x7f)
+
+typedef struct {
+    time_t next;                /**< next trigger time */
+    void* ctx;                  /**< owner of the node */
+    int* pos;                   /**< set to the heap position of the node, -1 once it is removed */
+} weekly_sched_node_t;
+
+typedef struct {
+    weekly_sched_node_t* node;
+    int num;
+    int cap;
+} weekly_sched_t;
+
+/**
+  * @brief  init a deadline heap
+  *
+  * @param  sched heap
+  * @param  cap initial capacity, the heap grows when it is full
+  *
+  * @return
+  *     - ESP_OK: succeed
+  *     - ESP_ERR_NO_MEM: no memory
+  */
+esp_err_t weekly_sched_init(weekly_sched_t* sched, int cap);
+
+/**
+  * @brief  free a deadline heap
+  */
+void weekly_sched_deinit(weekly_sched_t* sched);
+
+/**
+  * @brief  add a node
+  *
+  * @param  sched heap
+  * @param  next trigger time
+  * @param  ctx owner of the node
+  * @param  pos kept up to date with the heap position of the node
+  *
+  * @return
+  *     - ESP_OK: succeed
+  *     - ESP_ERR_NO_MEM: no memory
+  */
+esp_err_t weekly_sched_push(weekly_sched_t* sched, time_t next, void* ctx, int* pos);
+
+/**
+  * @brief  remove the node at a heap position
+  */
+void weekly_sched_remove(weekly_sched_t* sched, int pos);
+
+/**
+  * @brief  change the trigger time of the node at a heap position
+  */
+void weekly_sched_update(weekly_sched_t* sched, int pos, time_t next);
+
+/**
+  * @brief  earliest node, NULL if the heap is empty
+  */
+const weekly_sched_node_t* weekly_sched_peek(const weekly_sched_t* sched);
+
+/**
+  * @brief  next trigger time of a point-in-time, without mktime
+  *
+  * @param  now current time, the result is later than it
+  * @param  tz_offset local time minus UTC, in seconds
+  * @param  days days of the week it triggers, bit 0 for sunday
+  * @param  sec_of_day local time of the day, in seconds
+  *
+  * @return trigger time, TIMER_NEAREST_INF if no day is set
+  */
+time_t weekly_sched_next_time(time_t now, int32_t tz_offset, uint8_t days, int32_t sec_of_day);
+
+/**
+  * @brief  local time minus UTC at a time, it follows TZ
+  */
+int32_t weekly_sched_tz_offset(time_t now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,85 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <string.h>
+#include "iot_weekly_timer.h"
+#include "weekly_sched.h"
+#include "unity.h"
+
+#define SCHED_TEST_NOW      (1559613600)    /* 2019-06-04 10:00:00 tuesday, UTC+8 */
+#define SCHED_TEST_TZ       (8 * 3600)
+#define SCHED_TEST_DAY      (86400)
+#define SCHED_TEST_NUM      (200)
+#define SCHED_SEC(h, m, s)  ((h) * 3600 + (m) * 60 + (s))
+#define SCHED_DAY(wday)     (1 << (wday))
+
+TEST_CASE("Weekly timer next time test", "[weekly_timer][iot]")
+{
+    const time_t now = SCHED_TEST_NOW;
+    TEST_ASSERT_EQUAL_INT(now + 1800, weekly_sched_next_time(now, SCHED_TEST_TZ, WEEKLY_SCHED_ALL_DAYS, SCHED_SEC(10, 30, 0)));
+    // today has passed, or is now
+    TEST_ASSERT_EQUAL_INT(now - 3600 + 7 * SCHED_TEST_DAY, weekly_sched_next_time(now, SCHED_TEST_TZ, SCHED_DAY(2), SCHED_SEC(9, 0, 0)));
+    TEST_ASSERT_EQUAL_INT(now + 7 * SCHED_TEST_DAY, weekly_sched_next_time(now, SCHED_TEST_TZ, SCHED_DAY(2), SCHED_SEC(10, 0, 0)));
+    TEST_ASSERT_EQUAL_INT(now + SCHED_TEST_DAY - 7200, weekly_sched_next_time(now, SCHED_TEST_TZ, SCHED_DAY(1) | SCHED_DAY(3), SCHED_SEC(8, 0, 0)));
+    TEST_ASSERT_EQUAL_INT(now + 4 * SCHED_TEST_DAY + SCHED_SEC(13, 59, 59),
+                          weekly_sched_next_time(now, SCHED_TEST_TZ, SCHED_DAY(6), SCHED_SEC(23, 59, 59)));
+    TEST_ASSERT_EQUAL_INT(now + 5 * SCHED_TEST_DAY - SCHED_SEC(10, 0, 0), weekly_sched_next_time(now, SCHED_TEST_TZ, SCHED_DAY(0), 0));
+    TEST_ASSERT_EQUAL_INT(TIMER_NEAREST_INF, weekly_sched_next_time(now, SCHED_TEST_TZ, 0, 0));
+    // the same time is monday 21:00 at UTC-5
+    TEST_ASSERT_EQUAL_INT(now + 3600, weekly_sched_next_time(now, -5 * 3600, SCHED_DAY(1), SCHED_SEC(22, 0, 0)));
+    TEST_ASSERT_EQUAL_INT(now + 3600 + 6 * SCHED_TEST_DAY, weekly_sched_next_time(now, -5 * 3600, SCHED_DAY(0), SCHED_SEC(22, 0, 0)));
+
+    setenv("TZ", "GMT-8", 1);
+    tzset();
+    TEST_ASSERT_EQUAL_INT(SCHED_TEST_TZ, weekly_sched_tz_offset(now));
+}
+
+TEST_CASE("Weekly timer deadline heap test", "[weekly_timer][iot]")
+{
+    static int pos[SCHED_TEST_NUM];
+    static time_t next[SCHED_TEST_NUM];
+    weekly_sched_t sched;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, weekly_sched_init(&sched, 4));
+    srand(1);
+    for (int i = 0; i < SCHED_TEST_NUM; i++) {
+        next[i] = rand() % 10000;
+        TEST_ASSERT_EQUAL_INT(ESP_OK, weekly_sched_push(&sched, next[i], &next[i], &pos[i]));
+    }
+    for (int i = 0; i < SCHED_TEST_NUM; i += 3) {
+        weekly_sched_remove(&sched, pos[i]);
+        TEST_ASSERT_EQUAL_INT(-1, pos[i]);
+    }
+    for (int i = 1; i < SCHED_TEST_NUM; i += 3) {
+        next[i] = rand() % 10000;
+        weekly_sched_update(&sched, pos[i], next[i]);
+    }
+    for (int i = 0; i < SCHED_TEST_NUM; i++) {
+        if (pos[i] >= 0) {
+            TEST_ASSERT(sched.node[pos[i]].ctx == &next[i]);
+        }
+    }
+
+    int num = 0;
+    time_t last = 0;
+    const weekly_sched_node_t* node;
+    while ((node = weekly_sched_peek(&sched)) != NULL) {
+        TEST_ASSERT(node->next >= last);
+        TEST_ASSERT_EQUAL_INT(*(time_t*) node->ctx, node->next);
+        last = node->next;
+        weekly_sched_remove(&sched, 0);
+        num++;
+    }
+    TEST_ASSERT_EQUAL_INT(SCHED_TEST_NUM - (SCHED_TEST_NUM + 2) / 3, num);
+    weekly_sched_deinit(&sched);
+}
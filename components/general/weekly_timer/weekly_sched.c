@@ -0,0 +1,179 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "iot_weekly_timer.h"
+#include "weekly_sched.h"
+
+#define SEC_PER_DAY     86400
+#define DAYS_PER_WEEK   7
+#define EPOCH_WDAY      4       /* 1970-01-01 is a thursday */
+
+static const char* TAG = "weekly_sched";
+
+static void weekly_sched_place(weekly_sched_t* sched, int pos, const weekly_sched_node_t* node)
+{
+    sched->node[pos] = *node;
+    *node->pos = pos;
+}
+
+static void weekly_sched_sift_up(weekly_sched_t* sched, int pos)
+{
+    weekly_sched_node_t node = sched->node[pos];
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (sched->node[parent].next <= node.next) {
+            break;
+        }
+        weekly_sched_place(sched, pos, &sched->node[parent]);
+        pos = parent;
+    }
+    weekly_sched_place(sched, pos, &node);
+}
+
+static void weekly_sched_sift_down(weekly_sched_t* sched, int pos)
+{
+    weekly_sched_node_t node = sched->node[pos];
+    for (;;) {
+        int child = pos * 2 + 1;
+        if (child >= sched->num) {
+            break;
+        }
+        if (child + 1 < sched->num && sched->node[child + 1].next < sched->node[child].next) {
+            child++;
+        }
+        if (node.next <= sched->node[child].next) {
+            break;
+        }
+        weekly_sched_place(sched, pos, &sched->node[child]);
+        pos = child;
+    }
+    weekly_sched_place(sched, pos, &node);
+}
+
+esp_err_t weekly_sched_init(weekly_sched_t* sched, int cap)
+{
+    sched->num = 0;
+    sched->cap = cap > 0 ? cap : 1;
+    sched->node = (weekly_sched_node_t*) calloc(sched->cap, sizeof(weekly_sched_node_t));
+    if (sched->node == NULL) {
+        ESP_LOGE(TAG, "no memory for %d nodes", sched->cap);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void weekly_sched_deinit(weekly_sched_t* sched)
+{
+    free(sched->node);
+    sched->node = NULL;
+    sched->num = 0;
+    sched->cap = 0;
+}
+
+esp_err_t weekly_sched_push(weekly_sched_t* sched, time_t next, void* ctx, int* pos)
+{
+    if (sched->num == sched->cap) {
+        weekly_sched_node_t* node = (weekly_sched_node_t*) realloc(sched->node, sched->cap * 2 * sizeof(weekly_sched_node_t));
+        if (node == NULL) {
+            ESP_LOGE(TAG, "no memory for %d nodes", sched->cap * 2);
+            return ESP_ERR_NO_MEM;
+        }
+        sched->node = node;
+        sched->cap *= 2;
+    }
+    weekly_sched_node_t node = { .next = next, .ctx = ctx, .pos = pos };
+    weekly_sched_place(sched, sched->num++, &node);
+    weekly_sched_sift_up(sched, sched->num - 1);
+    return ESP_OK;
+}
+
+void weekly_sched_remove(weekly_sched_t* sched, int pos)
+{
+    if (pos < 0 || pos >= sched->num) {
+        return;
+    }
+    *sched->node[pos].pos = -1;
+    if (--sched->num == pos) {
+        return;
+    }
+    // the last node takes the hole, it may need to go either way
+    weekly_sched_place(sched, pos, &sched->node[sched->num]);
+    if (pos > 0 && sched->node[pos].next < sched->node[(pos - 1) / 2].next) {
+        weekly_sched_sift_up(sched, pos);
+    } else {
+        weekly_sched_sift_down(sched, pos);
+    }
+}
+
+void weekly_sched_update(weekly_sched_t* sched, int pos, time_t next)
+{
+    if (pos < 0 || pos >= sched->num) {
+        return;
+    }
+    time_t old = sched->node[pos].next;
+    sched->node[pos].next = next;
+    if (next < old) {
+        weekly_sched_sift_up(sched, pos);
+    } else {
+        weekly_sched_sift_down(sched, pos);
+    }
+}
+
+const weekly_sched_node_t* weekly_sched_peek(const weekly_sched_t* sched)
+{
+    return sched->num > 0 ? &sched->node[0] : NULL;
+}
+
+time_t weekly_sched_next_time(time_t now, int32_t tz_offset, uint8_t days, int32_t sec_of_day)
+{
+    days &= WEEKLY_SCHED_ALL_DAYS;
+    if (days == 0) {
+        return TIMER_NEAREST_INF;
+    }
+    time_t local = now + tz_offset;
+    time_t day = local / SEC_PER_DAY;
+    if (local % SEC_PER_DAY < 0) {
+        day--;
+    }
+    int wday = (day + EPOCH_WDAY) % DAYS_PER_WEEK;
+    // rotate the mask so bit k is the day k days from today, today again next week is bit 7
+    uint32_t ahead = ((days >> wday) | (days << (DAYS_PER_WEEK - wday))) & WEEKLY_SCHED_ALL_DAYS;
+    if (sec_of_day <= local - day * SEC_PER_DAY) {
+        ahead = (ahead & ~1) | ((ahead & 1) << DAYS_PER_WEEK);
+    }
+    int k = __builtin_ctz(ahead);
+    return (day + k) * SEC_PER_DAY + sec_of_day - tz_offset;
+}
+
+/* days from 1970-01-01 of a civil date */
+static int32_t weekly_sched_days_from_civil(int y, int m, int d)
+{
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+int32_t weekly_sched_tz_offset(time_t now)
+{
+    struct tm timeinfo;
+    localtime_r(&now, &timeinfo);
+    time_t local = (time_t) weekly_sched_days_from_civil(timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday) * SEC_PER_DAY
+                   + timeinfo.tm_hour * 3600 + timeinfo.tm_min * 60 + timeinfo.tm_sec;
+    return local - now;
+}
@@ -16,9 +16,11 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/timers.h"
+#include "freertos/semphr.h"
 #include "esp_system.h"
 #include "esp_log.h"
 #include "iot_weekly_timer.h"
+#include "weekly_sched.h"
 #include "apps/sntp/sntp.h"
 
 #define IOT_CHECK(tag, a, ret)  if(!(a)) {                                 \
@@ -30,102 +32,134 @@
 #define POINT_ASSERT(tag, param)	IOT_CHECK(tag, (param) != NULL, ESP_FAIL)
 #define RES_ASSERT(tag, res, ret)   IOT_CHECK(tag, (res) != pdFALSE, ret)
 
-#define INIT_BUFF_LEN   5
-#define SEC_PER_DAY     86400
+#define INIT_BUFF_LEN       5
+#define INIT_HEAP_LEN       16
+#define TIME_VALID_MIN      1451606400      /**< 2016-01-01, the time is not synced before it */
+#define SLEEP_MAX_SEC       3600            /**< the timer wakes up at least hourly to follow clock adjustments */
+
+struct event_timer_loop;
 
 typedef struct {
+    event_time_t ev;
+    struct event_timer_loop* loop;
+    int heap_pos;                   /**< position in the deadline heap, -1 if not scheduled */
+} event_entry_t;
+
+typedef struct event_timer_loop {
     bool weekly_loop;               /**< whether the timer would loop weekly */
     weekday_mask_t week_mark;
     uint32_t time_num;              /**< how many event_time this timer should contain */
-    time_t nearest_tm;      
-    uint32_t nearest_idx;
-    TimerHandle_t tmr;
-    event_time_t time_group[0];
+    event_entry_t entry[0];
 } event_timer_loop_t;
 
 static const char* TAG = "event_timer";
 static event_timer_loop_t **g_timer_loops = NULL;
 static uint32_t g_max_num = INIT_BUFF_LEN;
 static time_t g_now;
-static esp_err_t weekly_timer_update(event_timer_loop_t* tm_loop);
+static int32_t g_tz_offset;
+static weekly_sched_t g_sched;      /**< deadlines of all the timers, one FreeRTOS timer for the earliest */
+static TimerHandle_t g_tmr;
+static SemaphoreHandle_t g_lock;
 
-static void weekly_timer_cb(TimerHandle_t xTimer)
+static bool weekly_timer_time_valid(time_t now)
+{
+    return now >= TIME_VALID_MIN;
+}
+
+static time_t weekly_timer_entry_next(const event_entry_t* entry, time_t now)
+{
+    const event_timer_loop_t* tm_loop = entry->loop;
+    // a timer that does not loop triggers at the next point-in-time, whatever the day
+    uint8_t days = tm_loop->weekly_loop ? tm_loop->week_mark.en : WEEKLY_SCHED_ALL_DAYS;
+    int32_t sec = entry->ev.hour * 3600 + entry->ev.minute * 60 + entry->ev.second;
+    return weekly_sched_next_time(now, g_tz_offset, days, sec);
+}
+
+static void weekly_timer_loop_disarm(event_timer_loop_t* tm_loop)
 {
-    event_timer_loop_t* tm_loop = (event_timer_loop_t*) pvTimerGetTimerID(xTimer);
-    event_time_t* event_tm = &tm_loop->time_group[tm_loop->nearest_idx];
-    if (tm_loop->weekly_loop == false) {
-        event_tm->en = false;
+    for (int i = 0; i < tm_loop->time_num; i++) {
+        weekly_sched_remove(&g_sched, tm_loop->entry[i].heap_pos);
     }
-    event_tm->tm_cb(event_tm->arg);
-    weekly_timer_update(tm_loop);
 }
 
-static time_t weekly_timer_loop_get_nearest(event_timer_loop_t* timer_loop)
+static esp_err_t weekly_timer_loop_arm(event_timer_loop_t* tm_loop, time_t now)
 {
-    timer_loop->nearest_tm = TIMER_NEAREST_INF;
-    struct tm timeinfo, tminfo_loc;
-    uint32_t old_idx = timer_loop->nearest_idx;
-    time_t time_loc;
-    time(&g_now);
-    localtime_r(&g_now, &timeinfo);
-    if (timer_loop->week_mark.enable == 0) {
-        return TIMER_NEAREST_INF;
-    }
-    for (int i = 0; i < timer_loop->time_num; i++) {
-        if (timer_loop->time_group[i].en) {
-            event_time_t ev_tm = timer_loop->time_group[i];
-            tminfo_loc = timeinfo;
-            tminfo_loc.tm_hour = ev_tm.hour;
-            tminfo_loc.tm_min = ev_tm.minute;
-            tminfo_loc.tm_sec = ev_tm.second;
-            time_loc = mktime(&tminfo_loc);
-            if (timer_loop->weekly_loop) {
-                int week_day = timeinfo.tm_wday;
-                int day_diff = 0;
-                if (i == old_idx) {
-                    week_day = (week_day + 1) % 7;
-                    day_diff++;
-                }
-                while (day_diff <= 7) {
-                    if ((timer_loop->week_mark.en >> week_day) & 0x01) {
-                        if ((time_loc + SEC_PER_DAY * day_diff) > g_now) {
-                            time_loc += (SEC_PER_DAY * day_diff);
-                            break;
-                        }
-                    }
-                    week_day = (week_day + 1) % 7;
-                    day_diff++;
-                }
-            } else {
-                time_loc = time_loc > g_now ? time_loc : (time_loc + SEC_PER_DAY);
-            }
-            if (time_loc < timer_loop->nearest_tm) {
-                timer_loop->nearest_tm = time_loc;
-                timer_loop->nearest_idx = i;
+    if (tm_loop->week_mark.enable == 0 || !weekly_timer_time_valid(now)) {
+        return ESP_OK;
+    }
+    for (int i = 0; i < tm_loop->time_num; i++) {
+        event_entry_t* entry = &tm_loop->entry[i];
+        if (entry->ev.en && entry->heap_pos < 0) {
+            time_t next = weekly_timer_entry_next(entry, now);
+            if (next != TIMER_NEAREST_INF) {
+                ERR_ASSERT(TAG, weekly_sched_push(&g_sched, next, entry, &entry->heap_pos));
             }
         }
     }
-    return timer_loop->nearest_tm;
+    return ESP_OK;
 }
 
-static esp_err_t weekly_timer_update(event_timer_loop_t* tm_loop)
+/* recompute all the deadlines, after the time is synced or the UTC offset changes */
+static void weekly_timer_rearm_all(time_t now)
 {
-    POINT_ASSERT(TAG, g_timer_loops);
-    POINT_ASSERT(TAG, tm_loop);
-    struct tm timeinfo;
-    time(&g_now);
-    time_t tm_loc;
-    localtime_r(&g_now, &timeinfo);
-    if (timeinfo.tm_year <= (2016 -1900))
-        return ESP_FAIL;  
-    tm_loc = weekly_timer_loop_get_nearest(tm_loop);
-    xTimerStop(tm_loop->tmr, portMAX_DELAY);
-    if (tm_loc != TIMER_NEAREST_INF && (tm_loc - g_now) > 0) {
-        xTimerChangePeriod(tm_loop->tmr, (tm_loc - g_now) * 1000 / portTICK_PERIOD_MS, portMAX_DELAY);
-        xTimerStart(tm_loop->tmr, portMAX_DELAY);
-        ESP_LOGI(TAG, "the timer at %p will trigger in %ld seconds", tm_loop, tm_loc-g_now);
+    g_tz_offset = weekly_sched_tz_offset(now);
+    for (int i = 0; i < g_max_num; i++) {
+        if (g_timer_loops[i] != NULL) {
+            weekly_timer_loop_disarm(g_timer_loops[i]);
+            weekly_timer_loop_arm(g_timer_loops[i], now);
+        }
     }
-    return ESP_OK;
+}
+
+/* point the FreeRTOS timer at the earliest deadline, call it with the lock */
+static void weekly_timer_update(time_t now)
+{
+    /*
+     * In the timer task, i.e. from weekly_timer_cb or a timer callback that starts, stops or deletes timers,
+     * waiting for room in the timer queue would block the task that empties it. A command that does not fit
+     * is not lost, weekly_timer_cb points the timer at the earliest deadline again when the callbacks are done.
+     */
+    TickType_t wait = xTaskGetCurrentTaskHandle() == xTimerGetTimerDaemonTaskHandle() ? 0 : portMAX_DELAY;
+    const weekly_sched_node_t* node = weekly_sched_peek(&g_sched);
+    if (node == NULL) {
+        xTimerStop(g_tmr, wait);
+        return;
+    }
+    time_t delay = node->next - now;
+    delay = delay < 1 ? 1 : (delay > SLEEP_MAX_SEC ? SLEEP_MAX_SEC : delay);
+    xTimerChangePeriod(g_tmr, delay * 1000 / portTICK_PERIOD_MS, wait);
+    ESP_LOGD(TAG, "the next timer at %p will trigger in %ld seconds", ((event_entry_t*) node->ctx)->loop, (long) (node->next - now));
+}
+
+static void weekly_timer_cb(TimerHandle_t xTimer)
+{
+    for (;;) {
+        xSemaphoreTake(g_lock, portMAX_DELAY);
+        time(&g_now);
+        if (weekly_sched_tz_offset(g_now) != g_tz_offset) {
+            weekly_timer_rearm_all(g_now);
+        }
+        const weekly_sched_node_t* node = weekly_sched_peek(&g_sched);
+        if (node == NULL || node->next > g_now) {
+            break;
+        }
+        event_entry_t* entry = (event_entry_t*) node->ctx;
+        timer_cb_t tm_cb = entry->ev.tm_cb;
+        void* arg = entry->ev.arg;
+        if (entry->loop->weekly_loop) {
+            weekly_sched_update(&g_sched, entry->heap_pos, weekly_timer_entry_next(entry, g_now));
+        } else {
+            entry->ev.en = false;
+            weekly_sched_remove(&g_sched, entry->heap_pos);
+        }
+        // the callback may stop or delete timers
+        xSemaphoreGive(g_lock);
+        if (tm_cb) {
+            tm_cb(arg);
+        }
+    }
+    weekly_timer_update(g_now);
+    xSemaphoreGive(g_lock);
 }
 
 static void weekly_timer_obtain_time_task()
@@ -134,11 +168,9 @@ static void weekly_timer_obtain_time_task()
     sntp_setoperatingmode(SNTP_OPMODE_POLL);
     sntp_setservername(0, "pool.ntp.org");
     sntp_init();
-    localtime_r(&g_now, &timeinfo);
-    while (timeinfo.tm_year < (2016 -1900)) {
+    while (!weekly_timer_time_valid(g_now)) {
         vTaskDelay(100 / portTICK_PERIOD_MS);
         time(&g_now);
-        localtime_r(&g_now, &timeinfo);
     }
     setenv("TZ", "GMT-8", 1);
     tzset();
@@ -146,11 +178,10 @@ static void weekly_timer_obtain_time_task()
     char strftime_buf[64];
     strftime(strftime_buf, sizeof(strftime_buf), "%c", &timeinfo);
     ESP_LOGI(TAG, "The current date/time in Shanghai is: %s", strftime_buf);
-    for (int i = 0; i < g_max_num; i++) {
-        if (g_timer_loops[i] != NULL) {
-            weekly_timer_update(g_timer_loops[i]);
-        }
-    }
+    xSemaphoreTake(g_lock, portMAX_DELAY);
+    weekly_timer_rearm_all(g_now);
+    weekly_timer_update(g_now);
+    xSemaphoreGive(g_lock);
     vTaskDelete(NULL);
 }
 
@@ -160,13 +191,25 @@ esp_err_t iot_weekly_timer_init()
         return ESP_FAIL;
     }
     g_timer_loops = (event_timer_loop_t**)calloc(INIT_BUFF_LEN, sizeof(event_timer_loop_t*));
-    memset(g_timer_loops, 0, INIT_BUFF_LEN * sizeof(event_timer_loop_t*));
     POINT_ASSERT(TAG, g_timer_loops);
-    struct tm timeinfo;
+    g_lock = xSemaphoreCreateMutex();
+    g_tmr = xTimerCreate("event_timer", portMAX_DELAY, pdFALSE, NULL, weekly_timer_cb);
+    if (g_lock == NULL || g_tmr == NULL || weekly_sched_init(&g_sched, INIT_HEAP_LEN) != ESP_OK) {
+        ESP_LOGE(TAG, "weekly timer init error");
+        if (g_lock) {
+            vSemaphoreDelete(g_lock);
+        }
+        if (g_tmr) {
+            xTimerDelete(g_tmr, portMAX_DELAY);
+        }
+        free(g_timer_loops);
+        g_timer_loops = NULL;
+        return ESP_FAIL;
+    }
     g_now = 0;
     time(&g_now);
-    localtime_r(&g_now, &timeinfo);
-    if (timeinfo.tm_year < (2016 - 1900)) {
+    g_tz_offset = weekly_sched_tz_offset(g_now);
+    if (!weekly_timer_time_valid(g_now)) {
         xTaskCreate(weekly_timer_obtain_time_task, "obtain_time", 2048, NULL, 7, NULL);
     }
     return ESP_OK;
@@ -176,6 +219,18 @@ weekly_timer_handle_t iot_weekly_timer_add(bool weekly_loop, weekday_mask_t week
 {
     IOT_CHECK(TAG, g_timer_loops != NULL, NULL);
     IOT_CHECK(TAG, time_group != NULL, NULL);
+    event_timer_loop_t* new_loop = (event_timer_loop_t*)calloc(1, sizeof(event_timer_loop_t) + time_num * sizeof(event_entry_t));
+    IOT_CHECK(TAG, new_loop != NULL, NULL);
+    new_loop->weekly_loop = weekly_loop;
+    new_loop->week_mark = week_mark;
+    new_loop->time_num = time_num;
+    for (int j = 0; j < time_num; j++) {
+        new_loop->entry[j].ev = time_group[j];
+        new_loop->entry[j].loop = new_loop;
+        new_loop->entry[j].heap_pos = -1;
+    }
+
+    xSemaphoreTake(g_lock, portMAX_DELAY);
     int i = 0;
     for (i = 0; i < g_max_num; i++) {
         if (g_timer_loops[i] == NULL) {
@@ -183,73 +238,79 @@ weekly_timer_handle_t iot_weekly_timer_add(bool weekly_loop, weekday_mask_t week
         }
     }
     if (i == g_max_num) {
-        g_max_num = g_max_num * 2;
-        event_timer_loop_t **new_time_loops = (event_timer_loop_t**)calloc(g_max_num, sizeof(event_timer_loop_t*));
-        IOT_CHECK(TAG, new_time_loops != NULL, NULL);
-        memset(new_time_loops, 0, g_max_num * sizeof(event_timer_loop_t*));
-        memcpy(new_time_loops, g_timer_loops, (g_max_num / 2) * sizeof(event_timer_loop_t*));
+        event_timer_loop_t **new_time_loops = (event_timer_loop_t**)calloc(g_max_num * 2, sizeof(event_timer_loop_t*));
+        if (new_time_loops == NULL) {
+            xSemaphoreGive(g_lock);
+            free(new_loop);
+            ESP_LOGE(TAG, "no memory for %d timers", g_max_num * 2);
+            return NULL;
+        }
+        memcpy(new_time_loops, g_timer_loops, g_max_num * sizeof(event_timer_loop_t*));
         free(g_timer_loops);
         g_timer_loops = new_time_loops;
+        g_max_num = g_max_num * 2;
     }
-    event_timer_loop_t* new_loop = (event_timer_loop_t*)calloc(1, sizeof(event_timer_loop_t) + time_num * sizeof(event_time_t));
-    IOT_CHECK(TAG, new_loop != NULL, NULL);
-    new_loop->weekly_loop = weekly_loop;
-    new_loop->week_mark = week_mark;
-    new_loop->time_num = time_num;
-    new_loop->nearest_tm = TIMER_NEAREST_INF;
-    new_loop->nearest_idx = TIMER_NEAREST_INF;
-    memcpy(new_loop->time_group, time_group, time_num * sizeof(event_time_t));
-    new_loop->tmr = xTimerCreate("event_timer", portMAX_DELAY, pdFALSE, new_loop, weekly_timer_cb);
     g_timer_loops[i] = new_loop;
-    struct tm timeinfo;
-    localtime_r(&g_now, &timeinfo);
-    if (timeinfo.tm_year >= (2016 -1900)) {
-        weekly_timer_update(new_loop);
+    time(&g_now);
+    if (weekly_timer_loop_arm(new_loop, g_now) != ESP_OK) {
+        weekly_timer_loop_disarm(new_loop);
+        g_timer_loops[i] = NULL;
+        free(new_loop);
+        new_loop = NULL;
     }
+    weekly_timer_update(g_now);
+    xSemaphoreGive(g_lock);
     return (weekly_timer_handle_t)new_loop;
 }
 
 esp_err_t iot_weekly_timer_delete(weekly_timer_handle_t timer_handle)
 {
     POINT_ASSERT(TAG, timer_handle);
+    POINT_ASSERT(TAG, g_timer_loops);
     event_timer_loop_t* tm_loop = (event_timer_loop_t*) timer_handle;
+    esp_err_t ret = ESP_FAIL;
+    xSemaphoreTake(g_lock, portMAX_DELAY);
     for (int i = 0; i < g_max_num; i++) {
         if (g_timer_loops[i] == tm_loop) {
             g_timer_loops[i] = NULL;
-            xTimerStop(tm_loop->tmr, portMAX_DELAY);
-            xTimerDelete(tm_loop->tmr, portMAX_DELAY);
-            tm_loop->tmr = NULL;
+            weekly_timer_loop_disarm(tm_loop);
             free(tm_loop);
-            return ESP_OK;
+            weekly_timer_update(time(&g_now));
+            ret = ESP_OK;
+            break;
         }
     }
-    return ESP_FAIL;
+    xSemaphoreGive(g_lock);
+    return ret;
 }
 
 esp_err_t iot_weekly_timer_start(weekly_timer_handle_t timer_handle)
 {
     POINT_ASSERT(TAG, timer_handle);
     event_timer_loop_t* tm_loop = (event_timer_loop_t*) timer_handle;
+    xSemaphoreTake(g_lock, portMAX_DELAY);
     tm_loop->week_mark.enable = 1;
-    tm_loop->nearest_tm = TIMER_NEAREST_INF;
-    tm_loop->nearest_idx = TIMER_NEAREST_INF;
     for(int j = 0; j < tm_loop->time_num; j++) {
-        tm_loop->time_group[j].en = true;
+        tm_loop->entry[j].ev.en = true;
     }
-    weekly_timer_update(tm_loop);
-    return ESP_OK;
+    weekly_timer_loop_disarm(tm_loop);
+    esp_err_t ret = weekly_timer_loop_arm(tm_loop, time(&g_now));
+    weekly_timer_update(g_now);
+    xSemaphoreGive(g_lock);
+    return ret;
 }
 
 esp_err_t iot_weekly_timer_stop(weekly_timer_handle_t timer_handle)
 {
     POINT_ASSERT(TAG, timer_handle);
     event_timer_loop_t* tm_loop = (event_timer_loop_t*) timer_handle;
+    xSemaphoreTake(g_lock, portMAX_DELAY);
     tm_loop->week_mark.enable = 0;
-    tm_loop->nearest_tm = TIMER_NEAREST_INF;
-    tm_loop->nearest_idx = TIMER_NEAREST_INF;
     for(int j = 0; j < tm_loop->time_num; j++) {
-        tm_loop->time_group[j].en = false;
+        tm_loop->entry[j].ev.en = false;
     }
-    weekly_timer_update(tm_loop);
+    weekly_timer_loop_disarm(tm_loop);
+    weekly_timer_update(time(&g_now));
+    xSemaphoreGive(g_lock);
     return ESP_OK;
 }
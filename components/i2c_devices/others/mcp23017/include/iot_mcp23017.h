@@ -35,6 +35,25 @@ extern "C"
 
 typedef void* mcp23017_handle_t;                        /*handle of mcp23017*/
 typedef uint8_t mcp23017_gpio_t;
+typedef void* mcp23017_input_handle_t;                  /*handle of mcp23017 input service*/
+
+/**
+ * @brief   Callback of input service, called from the service task
+ *
+ * @param   changed pins whose level changed
+ * @param   level level of all the input pins after the change
+ * @param   arg user argument
+ */
+typedef void (*mcp23017_input_cb_t)(uint16_t changed, uint16_t level, void* arg);
+
+typedef struct {
+    gpio_num_t int_io;               /*!< ESP32 GPIO connected to INTA, INTA/INTB are mirrored by the service */
+    uint16_t pins;                   /*!< expander pins used as inputs, the other pins are set as outputs */
+    uint16_t pullup_pins;            /*!< input pins with internal pull-up enabled */
+    mcp23017_input_cb_t cb;          /*!< edge callback */
+    void* arg;                       /*!< argument of edge callback */
+    UBaseType_t task_priority;       /*!< priority of the service task */
+} mcp23017_input_config_t;
 
 typedef enum {
     MCP23017_NOPIN = 0x0000,
@@ -229,6 +248,23 @@ uint16_t iot_mcp23017_get_int_pin(mcp23017_handle_t dev);
  */
 uint16_t iot_mcp23017_get_int_flag(mcp23017_handle_t dev);
 
+/**
+ * @brief   Read INTF, INTCAP and GPIO of both ports in one I2C burst,
+ *          reading INTCAP/GPIO also clears the interrupt.
+ *          Sequential operation mode (default) is required.
+ *
+ * @param   dev object handle of MCP23017
+ * @param   intf pointer to save interrupt flags of GPIOA/GPIOB, can be NULL
+ * @param   intcap pointer to save interrupt capture of GPIOA/GPIOB, can be NULL
+ * @param   level pointer to save current level of GPIOA/GPIOB, can be NULL
+ *
+ * @return
+ *     - ESP_OK Success
+ *     - ESP_FAIL Fail
+ */
+esp_err_t iot_mcp23017_read_int_state(mcp23017_handle_t dev, uint16_t *intf,
+        uint16_t *intcap, uint16_t *level);
+
 /**
  * @brief   Check device Present
  *
@@ -293,6 +329,43 @@ uint8_t iot_mcp23017_read_io(mcp23017_handle_t dev, mcp23017_gpio_t gpio);
 esp_err_t iot_mcp23017_set_io_dir(mcp23017_handle_t dev, uint8_t value,
         mcp23017_gpio_t gpio);
 
+/**
+ * @brief   Create input service: the expander pins are configured as inputs with
+ *          interrupt on change, and on each falling edge of the INT line INTF/INTCAP/GPIO
+ *          of both ports are read in one burst and diffed against the previous state.
+ *          The callback is called for every level change, a short pulse captured by INTCAP
+ *          is reported as two changes.
+ *
+ * @param   dev object handle of MCP23017
+ * @param   conf configuration of input service
+ *
+ * @return
+ *     - handle of input service, NULL if fail
+ */
+mcp23017_input_handle_t iot_mcp23017_input_create(mcp23017_handle_t dev,
+        const mcp23017_input_config_t *conf);
+
+/**
+ * @brief   Delete input service, interrupts of the input pins are disabled
+ *
+ * @param   input handle of input service
+ *
+ * @return
+ *     - ESP_OK Success
+ *     - ESP_FAIL Fail
+ */
+esp_err_t iot_mcp23017_input_delete(mcp23017_input_handle_t input);
+
+/**
+ * @brief   Get the last level of input pins known by the service, no I2C access
+ *
+ * @param   input handle of input service
+ *
+ * @return
+ *     - level of input pins
+ */
+uint16_t iot_mcp23017_input_get_level(mcp23017_input_handle_t input);
+
 #ifdef __cplusplus
 }
 #endif
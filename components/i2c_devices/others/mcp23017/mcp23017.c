@@ -186,7 +186,7 @@ esp_err_t iot_mcp23017_delete(mcp23017_handle_t dev, bool del_bus)
 esp_err_t iot_mcp23017_set_pullup(mcp23017_handle_t dev, uint16_t pins)
 {
     uint8_t data[] = { MCP23017_PORT_A_BYTE(pins), MCP23017_PORT_B_BYTE(pins) };
-    return iot_mcp23017_write(dev, MCP23017_REG_GPIOA, sizeof(data), data); //set REG_GPIOA(); REG_GPIOB();
+    return iot_mcp23017_write(dev, MCP23017_REG_GPPUA, sizeof(data), data); //set REG_GPPUA(); REG_GPPUB();
 }
 
 esp_err_t iot_mcp23017_interrupt_en(mcp23017_handle_t dev, uint16_t pins,
@@ -353,6 +353,26 @@ uint16_t iot_mcp23017_get_int_flag(mcp23017_handle_t dev)
     return pinIntfValues & device->intEnabledPins;
 }
 
+esp_err_t iot_mcp23017_read_int_state(mcp23017_handle_t dev, uint16_t *intf,
+        uint16_t *intcap, uint16_t *level)
+{
+    // INTFA, INTFB, INTCAPA, INTCAPB, GPIOA, GPIOB are adjacent in BANK 0, read them in one burst
+    uint8_t regs[6] = { 0 };
+    if (iot_mcp23017_read(dev, MCP23017_REG_INTFA, sizeof(regs), regs) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (intf) {
+        *intf = MCP23017_PORT_AB_WORD(regs);
+    }
+    if (intcap) {
+        *intcap = MCP23017_PORT_AB_WORD((regs + 2));
+    }
+    if (level) {
+        *level = MCP23017_PORT_AB_WORD((regs + 4));
+    }
+    return ESP_OK;
+}
+
 esp_err_t iot_mcp23017_check_present(mcp23017_handle_t dev)
 {
     uint8_t lastregValue = 0x00;
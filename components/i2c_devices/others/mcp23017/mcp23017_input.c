@@ -0,0 +1,171 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "driver/gpio.h"
+#include "iot_mcp23017.h"
+
+#define MCP23017_INPUT_TASK_STACK       (2048)
+#define MCP23017_INPUT_RESYNC_MS        (500)      /*!< check INT level periodically in case an edge is missed */
+
+#define IOT_CHECK(tag, a, ret)  if(!(a)) {                                 \
+        ESP_LOGE(tag,"%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__);      \
+        return (ret);                                                      \
+        }
+#define POINT_ASSERT(tag, param, ret)    IOT_CHECK(tag, (param) != NULL, (ret))
+
+typedef struct {
+    mcp23017_handle_t dev;
+    mcp23017_input_config_t conf;
+    volatile uint16_t level;
+    volatile bool stop;
+    TaskHandle_t task;
+    SemaphoreHandle_t exit_sem;
+} mcp23017_input_t;
+
+static const char* TAG = "mcp23017_input";
+
+static void IRAM_ATTR mcp23017_input_isr_handler(void* arg)
+{
+    mcp23017_input_t* input = (mcp23017_input_t*) arg;
+    portBASE_TYPE HPTaskAwoken = pdFALSE;
+    vTaskNotifyGiveFromISR(input->task, &HPTaskAwoken);
+    if (HPTaskAwoken == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+static void mcp23017_input_report(mcp23017_input_t* input, uint16_t level)
+{
+    uint16_t changed = level ^ input->level;
+    if (changed) {
+        input->level = level;
+        if (input->conf.cb) {
+            input->conf.cb(changed, level, input->conf.arg);
+        }
+    }
+}
+
+static void mcp23017_input_update(mcp23017_input_t* input)
+{
+    uint16_t intf, intcap, level;
+    uint16_t pins = input->conf.pins;
+    if (iot_mcp23017_read_int_state(input->dev, &intf, &intcap, &level) != ESP_OK) {
+        ESP_LOGE(TAG, "read interrupt state fail");
+        return;
+    }
+    // report the captured level first so that a pulse shorter than the I2C latency is not lost
+    intf &= pins;
+    mcp23017_input_report(input, (input->level & ~intf) | (intcap & intf));
+    mcp23017_input_report(input, level & pins);
+}
+
+static void mcp23017_input_task(void* arg)
+{
+    mcp23017_input_t* input = (mcp23017_input_t*) arg;
+    while (!input->stop) {
+        uint32_t notified = ulTaskNotifyTake(pdTRUE, MCP23017_INPUT_RESYNC_MS / portTICK_PERIOD_MS);
+        if (input->stop) {
+            break;
+        }
+        if (notified || gpio_get_level(input->conf.int_io) == 0) {
+            mcp23017_input_update(input);
+        }
+    }
+    xSemaphoreGive(input->exit_sem);
+    vTaskDelete(NULL);
+}
+
+mcp23017_input_handle_t iot_mcp23017_input_create(mcp23017_handle_t dev,
+        const mcp23017_input_config_t *conf)
+{
+    POINT_ASSERT(TAG, dev, NULL);
+    POINT_ASSERT(TAG, conf, NULL);
+    IOT_CHECK(TAG, conf->int_io < GPIO_NUM_MAX, NULL);
+    mcp23017_input_t* input = (mcp23017_input_t*) calloc(1, sizeof(mcp23017_input_t));
+    POINT_ASSERT(TAG, input, NULL);
+    input->dev = dev;
+    input->conf = *conf;
+    input->exit_sem = xSemaphoreCreateBinary();
+    if (input->exit_sem == NULL) {
+        goto fail;
+    }
+
+    // inputs: IODIR = 1, interrupt on change against the previous value, INTA/INTB mirrored (active low)
+    if (iot_mcp23017_set_io_dir(dev, conf->pins & 0xFF, MCP23017_GPIOA) != ESP_OK
+            || iot_mcp23017_set_io_dir(dev, conf->pins >> 8, MCP23017_GPIOB) != ESP_OK
+            || iot_mcp23017_set_pullup(dev, conf->pullup_pins & conf->pins) != ESP_OK
+            || iot_mcp23017_mirror_interrupt(dev, 1, MCP23017_GPIOA) != ESP_OK
+            || iot_mcp23017_interrupt_en(dev, conf->pins, false, 0) != ESP_OK) {
+        ESP_LOGE(TAG, "config expander fail");
+        goto fail;
+    }
+    // read once to clear pending interrupt and get the initial level
+    uint16_t level = 0;
+    if (iot_mcp23017_read_int_state(dev, NULL, NULL, &level) != ESP_OK) {
+        goto fail;
+    }
+    input->level = level & conf->pins;
+
+    xTaskCreate(mcp23017_input_task, "mcp23017_input", MCP23017_INPUT_TASK_STACK, input,
+            conf->task_priority, &input->task);
+    if (input->task == NULL) {
+        goto fail;
+    }
+
+    gpio_install_isr_service(0);
+    gpio_config_t gpio_conf;
+    gpio_conf.intr_type = GPIO_INTR_NEGEDGE;
+    gpio_conf.mode = GPIO_MODE_INPUT;
+    gpio_conf.pin_bit_mask = (1ULL << conf->int_io);
+    gpio_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    gpio_conf.pull_up_en = GPIO_PULLUP_ENABLE;
+    gpio_config(&gpio_conf);
+    gpio_isr_handler_add(conf->int_io, mcp23017_input_isr_handler, input);
+    // the INT line may have gone low before the handler was installed
+    xTaskNotifyGive(input->task);
+    return (mcp23017_input_handle_t) input;
+
+fail:
+    if (input->exit_sem) {
+        vSemaphoreDelete(input->exit_sem);
+    }
+    free(input);
+    return NULL;
+}
+
+esp_err_t iot_mcp23017_input_delete(mcp23017_input_handle_t input_handle)
+{
+    POINT_ASSERT(TAG, input_handle, ESP_FAIL);
+    mcp23017_input_t* input = (mcp23017_input_t*) input_handle;
+    gpio_set_intr_type(input->conf.int_io, GPIO_INTR_DISABLE);
+    gpio_isr_handler_remove(input->conf.int_io);
+    input->stop = true;
+    xTaskNotifyGive(input->task);
+    xSemaphoreTake(input->exit_sem, portMAX_DELAY);
+    vSemaphoreDelete(input->exit_sem);
+    esp_err_t ret = iot_mcp23017_interrupt_disable(input->dev, input->conf.pins);
+    free(input);
+    return ret;
+}
+
+uint16_t iot_mcp23017_input_get_level(mcp23017_input_handle_t input_handle)
+{
+    POINT_ASSERT(TAG, input_handle, 0);
+    mcp23017_input_t* input = (mcp23017_input_t*) input_handle;
+    return input->level;
+}
@@ -16,6 +16,7 @@
 #include "driver/i2c.h"
 #include "iot_mcp23017.h"
 #include "iot_i2c_bus.h"
+#include "iot_button.h"
 #include "esp_log.h"
 
 #define I2C_MASTER_SCL_IO           21          /*!< gpio number for I2C master clock IO21*/
@@ -24,6 +25,8 @@
 #define I2C_MASTER_TX_BUF_DISABLE   0           /*!< I2C master do not need buffer */
 #define I2C_MASTER_RX_BUF_DISABLE   0           /*!< I2C master do not need buffer */
 #define I2C_MASTER_FREQ_HZ          100000      /*!< I2C master clock frequency */
+#define MCP23017_INT_IO             4           /*!< gpio number connected to INTA of mcp23017 */
+#define MCP23017_KEY_NUM            16
 
 static i2c_bus_handle_t i2c_bus = NULL;
 static mcp23017_handle_t device = NULL;
@@ -92,3 +95,51 @@ TEST_CASE("Device mcp23017 test", "[mcp23017][iot][device]")
 {
     mcp23017_test();
 }
+
+static button_handle_t s_keys[MCP23017_KEY_NUM];
+
+static void mcp23017_key_cb(void* arg)
+{
+    ESP_LOGI("mcp23017_test", "key %d tap", (int) arg);
+}
+
+static void mcp23017_input_cb(uint16_t changed, uint16_t level, void* arg)
+{
+    // feed the edges into the button state machine, debounce is done by the button scan task
+    for (int i = 0; i < MCP23017_KEY_NUM; i++) {
+        if (changed & (1 << i)) {
+            iot_button_set_level(s_keys[i], (level >> i) & 0x1);
+        }
+    }
+}
+
+void mcp23017_keypad_test()
+{
+    mcp23017_init();
+    for (int i = 0; i < MCP23017_KEY_NUM; i++) {
+        s_keys[i] = iot_button_create_virtual(BUTTON_ACTIVE_LOW);
+        TEST_ASSERT_NOT_NULL(s_keys[i]);
+        iot_button_set_evt_cb(s_keys[i], BUTTON_CB_TAP, mcp23017_key_cb, (void*) i);
+    }
+    mcp23017_input_config_t conf = {
+        .int_io = MCP23017_INT_IO,
+        .pins = MCP23017_ALLPINS,
+        .pullup_pins = MCP23017_ALLPINS,
+        .cb = mcp23017_input_cb,
+        .arg = NULL,
+        .task_priority = 10,
+    };
+    mcp23017_input_handle_t input = iot_mcp23017_input_create(device, &conf);
+    TEST_ASSERT_NOT_NULL(input);
+    vTaskDelay(10000 / portTICK_RATE_MS);
+    iot_mcp23017_input_delete(input);
+    for (int i = 0; i < MCP23017_KEY_NUM; i++) {
+        iot_button_delete(s_keys[i]);
+    }
+    iot_mcp23017_delete(device, true);
+}
+
+TEST_CASE("Device mcp23017 keypad test", "[mcp23017][iot][device]")
+{
+    mcp23017_keypad_test();
+}
@@ -0,0 +1,120 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _IOT_SERVO_GROUP_H_
+#define _IOT_SERVO_GROUP_H_
+#include "esp_err.h"
+#include "driver/ledc.h"
+#include "freertos/FreeRTOS.h"
+#include "servo_ramp.h"
+
+#define SERVO_GROUP_NUM_MAX     (LEDC_CHANNEL_MAX * LEDC_SPEED_MODE_MAX)
+#define SERVO_GROUP_TICK_MS     (20)    /* one tick per PWM frame */
+
+typedef struct {
+    int servo_io;           /*!< GPIO for servo signal */
+    int max_angle;          /*!< Max angle of servo motor, positive value */
+    int min_width_us;       /*!< Minimum pulse width, corresponding to 0 position */
+    int max_width_us;       /*!< Maximum pulse width, corresponding to max_angle position */
+} servo_group_channel_t;
+
+#ifdef __cplusplus
+
+/**
+ * A group of servos sharing one LEDC timer per speed mode.
+ * Servo n uses channel (chn_base + n), the first 8 channels are high speed channels and the next 8 are low speed channels.
+ * All moving servos are updated together once per PWM frame from one esp_timer.
+ */
+class CServoGroup
+{
+private:
+    void* m_group;
+
+    /**
+     * prevent copy constructing
+     */
+    CServoGroup(const CServoGroup&);
+    CServoGroup& operator =(const CServoGroup&);
+public:
+    /**
+     * @brief Constructor for CServoGroup class
+     * @param servos configuration of each servo
+     * @param servo_num number of servos, up to SERVO_GROUP_NUM_MAX - chn_base
+     * @param tim_idx LEDC timer index, the timer of this index is used in both speed modes
+     * @param chn_base first LEDC channel, counted across both speed modes
+     *
+     * @note The LEDC timers and channels of the group must not be used by other modules.
+     */
+    CServoGroup(const servo_group_channel_t* servos, int servo_num, ledc_timer_t tim_idx = LEDC_TIMER_0, int chn_base = 0);
+
+    /**
+     * @brief Set a servo to a position at the next PWM frame, a running move of the servo is cancelled
+     * @param idx servo index
+     * @param angle the angle to go
+     * @return ESP_OK if success
+     *         ESP_ERR_INVALID_ARG if the parameter is invalid
+     */
+    esp_err_t write(int idx, float angle);
+
+    /**
+     * @brief Move a servo to a position in a given time, with smooth start and stop
+     * @param idx servo index
+     * @param angle the angle to go
+     * @param duration_ms time of the move
+     * @return ESP_OK if success
+     *         ESP_ERR_INVALID_ARG if the parameter is invalid
+     */
+    esp_err_t moveTo(int idx, float angle, uint32_t duration_ms);
+
+    /**
+     * @brief Move a servo to a position with a velocity limit, with smooth start and stop
+     * @param idx servo index
+     * @param angle the angle to go
+     * @param max_dps max velocity in degree per second
+     * @return ESP_OK if success
+     *         ESP_ERR_INVALID_ARG if the parameter is invalid
+     */
+    esp_err_t moveAt(int idx, float angle, float max_dps);
+
+    /**
+     * @brief Get the position a servo is driven to at the current frame
+     * @param idx servo index
+     * @return angle
+     */
+    float read(int idx);
+
+    /**
+     * @brief Check whether a servo is moving
+     * @param idx servo index
+     * @return true if the servo is moving
+     */
+    bool isMoving(int idx);
+
+    /**
+     * @brief Wait all moves to finish
+     * @param ticks_to_wait block time for this function
+     * @return ESP_OK if success
+     *         ESP_ERR_TIMEOUT if operation timeout
+     */
+    esp_err_t wait(TickType_t ticks_to_wait = portMAX_DELAY);
+
+    /**
+     * @brief Destructor function of CServoGroup object
+     */
+    ~CServoGroup(void);
+};
+
+#endif
+
+#endif /* _IOT_SERVO_GROUP_H_ */
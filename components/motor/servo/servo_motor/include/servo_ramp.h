@@ -0,0 +1,100 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _IOT_SERVO_RAMP_H_
+#define _IOT_SERVO_RAMP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Integer duty math for servo moves. A move follows an ease-in/ease-out (smoothstep) curve
+ * taken from a precomputed table, so the peak velocity is 1.5 times the mean velocity.
+ */
+
+#define SERVO_RAMP_PEAK_NUM     (3)     /* peak velocity over mean velocity is SERVO_RAMP_PEAK_NUM / SERVO_RAMP_PEAK_DEN */
+#define SERVO_RAMP_PEAK_DEN     (2)
+
+typedef struct {
+    uint32_t duty_min;      /*!< duty at angle 0 */
+    uint32_t duty_max;      /*!< duty at max_angle */
+    uint32_t max_angle;     /*!< max angle in degree */
+} servo_duty_map_t;
+
+typedef struct {
+    uint32_t from;          /*!< duty at the start of the move */
+    uint32_t to;            /*!< duty at the end of the move */
+    uint32_t tick;          /*!< ticks done */
+    uint32_t ticks;         /*!< ticks of the move, 0 when the servo is idle */
+} servo_ramp_t;
+
+/**
+ * @brief Convert a pulse width to a LEDC duty
+ *
+ * @param us pulse width in microseconds
+ * @param freq PWM frequency in Hz
+ * @param duty_bits LEDC duty resolution
+ *
+ * @return duty
+ */
+uint32_t servo_duty_from_us(uint32_t us, uint32_t freq, uint32_t duty_bits);
+
+/**
+ * @brief Convert an angle to a LEDC duty
+ *
+ * @param map duty range of the servo
+ * @param angle_cdeg angle in 1/100 degree, clamped to the range of the servo
+ *
+ * @return duty
+ */
+uint32_t servo_duty_from_angle(const servo_duty_map_t* map, int32_t angle_cdeg);
+
+/**
+ * @brief Convert a LEDC duty back to an angle
+ *
+ * @param map duty range of the servo
+ * @param duty duty
+ *
+ * @return angle in 1/100 degree
+ */
+int32_t servo_angle_from_duty(const servo_duty_map_t* map, uint32_t duty);
+
+/**
+ * @brief Start a move
+ *
+ * @param ramp move state
+ * @param from duty at the start
+ * @param to duty at the end
+ * @param ticks number of ticks of the move, 0 to jump to the end at the next tick
+ */
+void servo_ramp_start(servo_ramp_t* ramp, uint32_t from, uint32_t to, uint32_t ticks);
+
+/**
+ * @brief Advance a move by one tick
+ *
+ * @param ramp move state
+ * @param duty duty to output at this tick
+ *
+ * @return true if the move goes on, false if this was the last tick
+ */
+bool servo_ramp_step(servo_ramp_t* ramp, uint32_t* duty);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,279 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <esp_types.h>
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "driver/ledc.h"
+#include "soc/ledc_struct.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "iot_servo_group.h"
+
+static const char* SERVO_GROUP_TAG = "servo_group";
+#define SERVO_GROUP_CHECK(a, str, ret_val) \
+    if (!(a)) { \
+        ESP_LOGE(SERVO_GROUP_TAG,"%s(%d): %s", __FUNCTION__, __LINE__, str); \
+        return (ret_val); \
+    }
+
+#define SERVO_GROUP_LEDC_BITS   LEDC_TIMER_15_BIT
+#define SERVO_GROUP_LEDC_FREQ   (50)
+
+typedef struct {
+    ledc_mode_t mode;
+    ledc_channel_t chn;
+    servo_duty_map_t map;
+    servo_ramp_t ramp;
+    uint32_t duty;          /* duty driven at the current frame */
+} servo_group_servo_t;
+
+typedef struct {
+    int servo_num;
+    servo_group_servo_t* servo;
+    esp_timer_handle_t tmr;
+    esp_timer_handle_t fence;   /* runs after any tick dispatched before it */
+    bool tmr_run;
+    bool closing;               /* the group is being deleted, a late tick must not touch it */
+    SemaphoreHandle_t mux;
+    SemaphoreHandle_t done;
+    SemaphoreHandle_t fence_done;
+} servo_group_t;
+
+/* the duty is latched by the hardware at the start of the next PWM period */
+static inline void servo_duty_write(const servo_group_servo_t* servo, uint32_t duty)
+{
+    LEDC.channel_group[servo->mode].channel[servo->chn].duty.duty = duty << 4;
+    LEDC.channel_group[servo->mode].channel[servo->chn].conf1.duty_start = 1;
+    if (servo->mode == LEDC_LOW_SPEED_MODE) {
+        LEDC.channel_group[servo->mode].channel[servo->chn].conf0.low_speed_update = 1;
+    }
+}
+
+static void servo_group_tick_cb(void* arg)
+{
+    servo_group_t* group = (servo_group_t*) arg;
+    bool moving = false;
+    xSemaphoreTake(group->mux, portMAX_DELAY);
+    if (group->closing) {
+        xSemaphoreGive(group->mux);
+        return;
+    }
+    for (int i = 0; i < group->servo_num; i++) {
+        servo_group_servo_t* servo = &group->servo[i];
+        if (servo->ramp.ticks == 0) {
+            continue;
+        }
+        moving |= servo_ramp_step(&servo->ramp, &servo->duty);
+        servo_duty_write(servo, servo->duty);
+    }
+    if (!moving) {
+        esp_timer_stop(group->tmr);
+        group->tmr_run = false;
+        xSemaphoreGive(group->done);
+    }
+    xSemaphoreGive(group->mux);
+}
+
+/* esp_timer runs the callbacks one by one in its task, so the tick is done when this one runs */
+static void servo_group_fence_cb(void* arg)
+{
+    servo_group_t* group = (servo_group_t*) arg;
+    xSemaphoreGive(group->fence_done);
+}
+
+static esp_err_t servo_group_move(servo_group_t* group, int idx, float angle, uint32_t ticks)
+{
+    servo_group_servo_t* servo = &group->servo[idx];
+    uint32_t target = servo_duty_from_angle(&servo->map, (int32_t)(angle * 100));
+    xSemaphoreTake(group->mux, portMAX_DELAY);
+    if (servo->duty == 0) {
+        // the position is unknown before the first output, go there directly
+        ticks = 0;
+    }
+    servo_ramp_start(&servo->ramp, servo->duty, target, ticks);
+    if (!group->tmr_run) {
+        xSemaphoreTake(group->done, 0);
+        esp_timer_start_periodic(group->tmr, SERVO_GROUP_TICK_MS * 1000);
+        group->tmr_run = true;
+    }
+    xSemaphoreGive(group->mux);
+    return ESP_OK;
+}
+
+CServoGroup::CServoGroup(const servo_group_channel_t* servos, int servo_num, ledc_timer_t tim_idx, int chn_base)
+{
+    m_group = NULL;
+    if (servos == NULL || servo_num <= 0 || chn_base < 0 || chn_base + servo_num > SERVO_GROUP_NUM_MAX) {
+        ESP_LOGE(SERVO_GROUP_TAG, "servo group parameter error");
+        return;
+    }
+    servo_group_t* group = (servo_group_t*) calloc(1, sizeof(servo_group_t));
+    if (group == NULL) {
+        ESP_LOGE(SERVO_GROUP_TAG, "no memory for servo group");
+        return;
+    }
+    group->servo = (servo_group_servo_t*) calloc(servo_num, sizeof(servo_group_servo_t));
+    if (group->servo == NULL) {
+        ESP_LOGE(SERVO_GROUP_TAG, "no memory for servo group");
+        free(group);
+        return;
+    }
+    group->servo_num = servo_num;
+    group->mux = xSemaphoreCreateMutex();
+    group->done = xSemaphoreCreateBinary();
+    xSemaphoreGive(group->done);
+    group->fence_done = xSemaphoreCreateBinary();
+
+    esp_timer_create_args_t tmr_args;
+    tmr_args.callback = servo_group_tick_cb;
+    tmr_args.arg = group;
+    tmr_args.dispatch_method = ESP_TIMER_TASK;
+    tmr_args.name = "servo_group";
+    esp_timer_create(&tmr_args, &group->tmr);
+    tmr_args.callback = servo_group_fence_cb;
+    tmr_args.name = "servo_fence";
+    esp_timer_create(&tmr_args, &group->fence);
+
+    // One timer for each speed mode in use, every channel of the group shares it
+    bool mode_used[LEDC_SPEED_MODE_MAX] = {false};
+    for (int i = 0; i < servo_num; i++) {
+        mode_used[(chn_base + i) / LEDC_CHANNEL_MAX] = true;
+    }
+    for (int m = 0; m < LEDC_SPEED_MODE_MAX; m++) {
+        if (!mode_used[m]) {
+            continue;
+        }
+        ledc_timer_config_t ledc_timer;
+        memset(&ledc_timer, 0, sizeof(ledc_timer));
+        ledc_timer.duty_resolution = SERVO_GROUP_LEDC_BITS;
+        ledc_timer.freq_hz = SERVO_GROUP_LEDC_FREQ;
+        ledc_timer.speed_mode = (ledc_mode_t) m;
+        ledc_timer.timer_num = tim_idx;
+        ledc_timer_config(&ledc_timer);
+    }
+
+    for (int i = 0; i < servo_num; i++) {
+        servo_group_servo_t* servo = &group->servo[i];
+        servo->mode = (ledc_mode_t) ((chn_base + i) / LEDC_CHANNEL_MAX);
+        servo->chn = (ledc_channel_t) ((chn_base + i) % LEDC_CHANNEL_MAX);
+        servo->map.duty_min = servo_duty_from_us(servos[i].min_width_us, SERVO_GROUP_LEDC_FREQ, SERVO_GROUP_LEDC_BITS);
+        servo->map.duty_max = servo_duty_from_us(servos[i].max_width_us, SERVO_GROUP_LEDC_FREQ, SERVO_GROUP_LEDC_BITS);
+        servo->map.max_angle = servos[i].max_angle;
+        servo->duty = 0;
+
+        ledc_channel_config_t ledc_ch;
+        memset(&ledc_ch, 0, sizeof(ledc_ch));
+        ledc_ch.channel    = servo->chn;
+        ledc_ch.duty       = 0;
+        ledc_ch.gpio_num   = servos[i].servo_io;
+        ledc_ch.speed_mode = servo->mode;
+        ledc_ch.timer_sel  = tim_idx;
+        ledc_channel_config(&ledc_ch);
+    }
+    m_group = group;
+}
+
+esp_err_t CServoGroup::write(int idx, float angle)
+{
+    servo_group_t* group = (servo_group_t*) m_group;
+    SERVO_GROUP_CHECK(group != NULL, "servo group not created", ESP_FAIL);
+    SERVO_GROUP_CHECK(idx >= 0 && idx < group->servo_num, "servo index error", ESP_ERR_INVALID_ARG);
+    return servo_group_move(group, idx, angle, 0);
+}
+
+esp_err_t CServoGroup::moveTo(int idx, float angle, uint32_t duration_ms)
+{
+    servo_group_t* group = (servo_group_t*) m_group;
+    SERVO_GROUP_CHECK(group != NULL, "servo group not created", ESP_FAIL);
+    SERVO_GROUP_CHECK(idx >= 0 && idx < group->servo_num, "servo index error", ESP_ERR_INVALID_ARG);
+    return servo_group_move(group, idx, angle, (duration_ms + SERVO_GROUP_TICK_MS / 2) / SERVO_GROUP_TICK_MS);
+}
+
+esp_err_t CServoGroup::moveAt(int idx, float angle, float max_dps)
+{
+    servo_group_t* group = (servo_group_t*) m_group;
+    SERVO_GROUP_CHECK(group != NULL, "servo group not created", ESP_FAIL);
+    SERVO_GROUP_CHECK(idx >= 0 && idx < group->servo_num, "servo index error", ESP_ERR_INVALID_ARG);
+    SERVO_GROUP_CHECK(max_dps > 0, "velocity error", ESP_ERR_INVALID_ARG);
+    float dist = angle - read(idx);
+    if (dist < 0) {
+        dist = -dist;
+    }
+    // the eased move peaks at 1.5 times its mean velocity
+    float duration_ms = dist * 1000 / max_dps * SERVO_RAMP_PEAK_NUM / SERVO_RAMP_PEAK_DEN;
+    uint32_t ticks = (uint32_t)(duration_ms / SERVO_GROUP_TICK_MS) + 1;
+    return servo_group_move(group, idx, angle, ticks);
+}
+
+float CServoGroup::read(int idx)
+{
+    servo_group_t* group = (servo_group_t*) m_group;
+    SERVO_GROUP_CHECK(group != NULL && idx >= 0 && idx < group->servo_num, "servo index error", 0);
+    xSemaphoreTake(group->mux, portMAX_DELAY);
+    servo_group_servo_t* servo = &group->servo[idx];
+    int32_t cdeg = servo->duty == 0 ? 0 : servo_angle_from_duty(&servo->map, servo->duty);
+    xSemaphoreGive(group->mux);
+    return cdeg / 100.0f;
+}
+
+bool CServoGroup::isMoving(int idx)
+{
+    servo_group_t* group = (servo_group_t*) m_group;
+    SERVO_GROUP_CHECK(group != NULL && idx >= 0 && idx < group->servo_num, "servo index error", false);
+    xSemaphoreTake(group->mux, portMAX_DELAY);
+    bool moving = group->servo[idx].ramp.ticks != 0;
+    xSemaphoreGive(group->mux);
+    return moving;
+}
+
+esp_err_t CServoGroup::wait(TickType_t ticks_to_wait)
+{
+    servo_group_t* group = (servo_group_t*) m_group;
+    SERVO_GROUP_CHECK(group != NULL, "servo group not created", ESP_FAIL);
+    if (xSemaphoreTake(group->done, ticks_to_wait) == pdFALSE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    // leave it given so later waiters return until the next move starts
+    xSemaphoreGive(group->done);
+    return ESP_OK;
+}
+
+CServoGroup::~CServoGroup()
+{
+    servo_group_t* group = (servo_group_t*) m_group;
+    if (group == NULL) {
+        return;
+    }
+    esp_timer_stop(group->tmr);
+    xSemaphoreTake(group->mux, portMAX_DELAY);
+    group->closing = true;
+    xSemaphoreGive(group->mux);
+    // a tick dispatched before the stop may still wait for mux, let it return before freeing
+    esp_timer_start_once(group->fence, 0);
+    xSemaphoreTake(group->fence_done, portMAX_DELAY);
+    esp_timer_delete(group->tmr);
+    esp_timer_delete(group->fence);
+    for (int i = 0; i < group->servo_num; i++) {
+        ledc_stop(group->servo[i].mode, group->servo[i].chn, 0);
+    }
+    vSemaphoreDelete(group->mux);
+    vSemaphoreDelete(group->done);
+    vSemaphoreDelete(group->fence_done);
+    free(group->servo);
+    free(group);
+    m_group = NULL;
+}
@@ -0,0 +1,92 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "servo_ramp.h"
+
+#define SERVO_SEC_TO_US         (1000000)
+#define SERVO_EASE_BITS         (6)
+#define SERVO_EASE_NUM          (1 << SERVO_EASE_BITS)
+#define SERVO_EASE_SHIFT        (15)
+
+/* 3x^2 - 2x^3 in Q15, sampled at x = i / 64 */
+static const uint16_t s_ease_table[SERVO_EASE_NUM + 1] = {
+    0, 24, 94, 209, 368, 569, 810, 1090,
+    1408, 1762, 2150, 2571, 3024, 3507, 4018, 4556,
+    5120, 5708, 6318, 6949, 7600, 8269, 8954, 9654,
+    10368, 11094, 11830, 12575, 13328, 14087, 14850, 15616,
+    16384, 17152, 17918, 18681, 19440, 20193, 20938, 21674,
+    22400, 23114, 23814, 24499, 25168, 25819, 26450, 27060,
+    27648, 28212, 28750, 29261, 29744, 30197, 30618, 31006,
+    31360, 31678, 31958, 32199, 32400, 32559, 32674, 32744,
+    32768,
+};
+
+uint32_t servo_duty_from_us(uint32_t us, uint32_t freq, uint32_t duty_bits)
+{
+    uint64_t full = (1ULL << duty_bits) - 1;
+    return (uint32_t)((full * us * freq + SERVO_SEC_TO_US / 2) / SERVO_SEC_TO_US);
+}
+
+uint32_t servo_duty_from_angle(const servo_duty_map_t* map, int32_t angle_cdeg)
+{
+    int32_t max_cdeg = map->max_angle * 100;
+    if (angle_cdeg < 0) {
+        angle_cdeg = 0;
+    } else if (angle_cdeg > max_cdeg) {
+        angle_cdeg = max_cdeg;
+    }
+    if (max_cdeg == 0) {
+        return map->duty_min;
+    }
+    int64_t span = (int64_t) map->duty_max - map->duty_min;
+    return (uint32_t)(map->duty_min + (span * angle_cdeg + (span >= 0 ? max_cdeg / 2 : -max_cdeg / 2)) / max_cdeg);
+}
+
+int32_t servo_angle_from_duty(const servo_duty_map_t* map, uint32_t duty)
+{
+    int64_t span = (int64_t) map->duty_max - map->duty_min;
+    if (span == 0) {
+        return 0;
+    }
+    return (int32_t)(((int64_t) duty - map->duty_min) * map->max_angle * 100 / span);
+}
+
+void servo_ramp_start(servo_ramp_t* ramp, uint32_t from, uint32_t to, uint32_t ticks)
+{
+    ramp->from = from;
+    ramp->to = to;
+    ramp->tick = 0;
+    ramp->ticks = ticks > 0 ? ticks : 1;
+}
+
+bool servo_ramp_step(servo_ramp_t* ramp, uint32_t* duty)
+{
+    if (ramp->ticks == 0) {
+        *duty = ramp->to;
+        return false;
+    }
+    ramp->tick++;
+    if (ramp->tick >= ramp->ticks) {
+        *duty = ramp->to;
+        ramp->ticks = 0;
+        return false;
+    }
+    /* position on the table in Q8, then linear interpolation between two entries */
+    uint32_t pos = (uint32_t)(((uint64_t) ramp->tick << (SERVO_EASE_BITS + 8)) / ramp->ticks);
+    uint32_t idx = pos >> 8;
+    uint32_t frac = pos & 0xff;
+    int32_t ease = s_ease_table[idx] + (((s_ease_table[idx + 1] - s_ease_table[idx]) * (int32_t) frac) >> 8);
+    int64_t span = (int64_t) ramp->to - ramp->from;
+    *duty = (uint32_t)(ramp->from + ((span * ease) >> SERVO_EASE_SHIFT));
+    return true;
+}
@@ -0,0 +1,71 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include <string.h>
+#include "servo_ramp.h"
+#include "unity.h"
+
+TEST_CASE("Servo duty math test", "[servo][iot]")
+{
+    /* 15 bit duty at 50Hz: 500us is 1/40 and 2500us is 1/8 of the period */
+    servo_duty_map_t map = {
+        .duty_min = servo_duty_from_us(500, 50, 15),
+        .duty_max = servo_duty_from_us(2500, 50, 15),
+        .max_angle = 180,
+    };
+    TEST_ASSERT_EQUAL_UINT32(819, map.duty_min);
+    TEST_ASSERT_EQUAL_UINT32(4096, map.duty_max);
+    TEST_ASSERT_EQUAL_UINT32(819, servo_duty_from_angle(&map, 0));
+    TEST_ASSERT_EQUAL_UINT32(4096, servo_duty_from_angle(&map, 18000));
+    TEST_ASSERT_EQUAL_UINT32(4096, servo_duty_from_angle(&map, 25000));
+    TEST_ASSERT_EQUAL_UINT32(819, servo_duty_from_angle(&map, -500));
+    TEST_ASSERT_EQUAL_UINT32(2458, servo_duty_from_angle(&map, 9000));
+    TEST_ASSERT_INT_WITHIN(6, 9000, servo_angle_from_duty(&map, 2458));
+}
+
+TEST_CASE("Servo ramp test", "[servo][iot]")
+{
+    servo_ramp_t ramp;
+    uint32_t duty = 0, last = 1000;
+    int max_step = 0, ticks = 0;
+    servo_ramp_start(&ramp, 1000, 4000, 50);
+    while (servo_ramp_step(&ramp, &duty)) {
+        int step = (int) duty - (int) last;
+        TEST_ASSERT_TRUE(step >= 0);
+        if (step > max_step) {
+            max_step = step;
+        }
+        /* eased start and stop */
+        if (ticks == 0 || ticks == 48) {
+            TEST_ASSERT_TRUE(step < 15);
+        }
+        last = duty;
+        ticks++;
+    }
+    TEST_ASSERT_EQUAL(49, ticks);
+    TEST_ASSERT_EQUAL_UINT32(4000, duty);
+    /* the peak rate is 1.5 times the mean rate of 3000 / 50 per tick */
+    TEST_ASSERT_INT_WITHIN(2, 3000 * 3 / 2 / 50, max_step);
+
+    /* moving down, and jumping with 0 ticks */
+    servo_ramp_start(&ramp, 4000, 1000, 10);
+    for (int i = 0; i < 5; i++) {
+        servo_ramp_step(&ramp, &duty);
+    }
+    TEST_ASSERT_EQUAL_UINT32(2500, duty);
+    servo_ramp_start(&ramp, 4000, 1000, 0);
+    TEST_ASSERT_FALSE(servo_ramp_step(&ramp, &duty));
+    TEST_ASSERT_EQUAL_UINT32(1000, duty);
+    TEST_ASSERT_EQUAL_UINT32(0, ramp.ticks);
+}
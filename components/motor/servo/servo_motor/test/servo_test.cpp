@@ -19,8 +19,36 @@
 #include "freertos/semphr.h"
 #include "esp_log.h"
 #include "iot_servo.h"
+#include "iot_servo_group.h"
 #include "unity.h"
 
 TEST_CASE("Servo_motor test", "[servo][iot]")
 {
 }
+TEST_CASE("Servo group test", "[servo][iot]")
+{
+    servo_group_channel_t servos[4];
+    const int servo_io[] = {18, 19, 21, 22};
+    for (int i = 0; i < 4; i++) {
+        servos[i].servo_io = servo_io[i];
+        servos[i].max_angle = 180;
+        servos[i].min_width_us = 500;
+        servos[i].max_width_us = 2500;
+    }
+    // channels 6..9 cover both speed modes
+    CServoGroup group(servos, 4, LEDC_TIMER_1, 6);
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, group.write(i, 0));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, group.wait());
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, group.moveTo(i, 45 * (i + 1), 1000));
+    }
+    TEST_ASSERT_TRUE(group.isMoving(3));
+    TEST_ASSERT_EQUAL(ESP_OK, group.wait());
+    TEST_ASSERT_FLOAT_WITHIN(0.5, 180, group.read(3));
+    TEST_ASSERT_EQUAL(ESP_OK, group.moveAt(0, 180, 90));
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, group.wait(1000 / portTICK_RATE_MS));
+    TEST_ASSERT_EQUAL(ESP_OK, group.wait());
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, group.moveTo(4, 0, 100));
+}
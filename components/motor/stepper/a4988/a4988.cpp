@@ -24,6 +24,7 @@ extern "C" {
 #include "driver/ledc.h"
 #include "driver/pcnt.h"
 #include "soc/ledc_struct.h"
+#include "soc/ledc_reg.h"
 #include "iot_a4988.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -46,6 +47,15 @@ static const char* STEPPER_A4988_TAG = "stepper_a4988";
 #define STEPPER_SPEED_UP_DELAY_MS     (20)
 #define STEPPER_START_LIMIT_RPM       (60*3)
 #define STEPPER_INC_GAP               (60)
+#define STEPPER_LEDC_APB_CLK_SEL      (1)
+#define STEPPER_LEDC_REF_TICK_SEL     (0)
+
+/* LEDC timer setting of one planned segment, computed before the move so the ISR only writes registers */
+typedef struct {
+    uint32_t div;
+    uint32_t tick_sel;
+    int rpm;
+} stepper_seg_clk_t;
 typedef struct {
     int step_io;
     int dir_io;
@@ -63,8 +73,40 @@ typedef struct {
     int direction;
     SemaphoreHandle_t sem;
     SemaphoreHandle_t mux;
+    stepper_plan_t* plan;
+    stepper_seg_clk_t* seg_clk;
+    bool plan_run;
+    int seg_idx;
+    int seg_left;
 } stepper_dev_t;
 
+static void stepper_seg_clk_calc(stepper_dev_t* dev, const stepper_seg_t* seg, stepper_seg_clk_t* clk)
+{
+    uint64_t div = ((uint64_t) LEDC_APB_CLK_HZ << 8) / seg->rate / (1 << STEPPER_LEDC_INIT_BITS);
+    clk->tick_sel = STEPPER_LEDC_APB_CLK_SEL;
+    if (div > LEDC_DIV_NUM_HSTIMER0_V) {
+        div = ((uint64_t) LEDC_REF_CLK_HZ << 8) / seg->rate / (1 << STEPPER_LEDC_INIT_BITS);
+        clk->tick_sel = STEPPER_LEDC_REF_TICK_SEL;
+    }
+    if (div < 256) {
+        div = 256;
+    } else if (div > LEDC_DIV_NUM_HSTIMER0_V) {
+        div = LEDC_DIV_NUM_HSTIMER0_V;
+    }
+    clk->div = (uint32_t) div;
+    clk->rpm = seg->rate * 60 / dev->number_of_steps;
+}
+
+static inline void IRAM_ATTR stepper_seg_clk_set(stepper_dev_t* dev, const stepper_seg_clk_t* clk)
+{
+    LEDC.timer_group[dev->ledc_mode].timer[dev->ledc_timer].conf.clock_divider = clk->div;
+    LEDC.timer_group[dev->ledc_mode].timer[dev->ledc_timer].conf.tick_sel = clk->tick_sel;
+    if (dev->ledc_mode == LEDC_LOW_SPEED_MODE) {
+        LEDC.timer_group[dev->ledc_mode].timer[dev->ledc_timer].conf.low_speed_update = 1;
+    }
+    dev->rpm = clk->rpm;
+}
+
 static void IRAM_ATTR stepper_pcnt_intr_handler(void *arg)
 {
     uint32_t intr_status = PCNT.int_st.val;
@@ -84,10 +126,25 @@ static void IRAM_ATTR stepper_pcnt_intr_handler(void *arg)
             }
             dev->steps_left = 0;
             dev->rpm = 0;
-            xTimerStopFromISR(dev->tmr, &HPTaskAwoken);
+            dev->plan_run = false;
+            if (dev->tmr) {
+                xTimerStopFromISR(dev->tmr, &HPTaskAwoken);
+            }
             xSemaphoreGiveFromISR(dev->sem, &HPTaskAwoken);
         } else {
             int steps = dev->steps_left >= STEPPER_CNT_H ? STEPPER_CNT_H - 1 : dev->steps_left;
+            if (dev->plan_run) {
+                // Switch to the next segment of the plan, the clock setting is ready in the table
+                dev->seg_left -= cnt;
+                if (dev->seg_left <= 0 && dev->seg_idx + 1 < dev->plan->seg_num) {
+                    dev->seg_idx++;
+                    dev->seg_left += dev->plan->seg[dev->seg_idx].steps;
+                    stepper_seg_clk_set(dev, &dev->seg_clk[dev->seg_idx]);
+                }
+                if (dev->seg_left > 0 && dev->seg_left < steps) {
+                    steps = dev->seg_left;
+                }
+            }
             PCNT.conf_unit[dev->pcnt_unit].conf1.cnt_thres0 = steps;
             PCNT.conf_unit[dev->pcnt_unit].conf0.thr_thres0_en = 1;
             // Counter reset
@@ -124,7 +181,6 @@ static void stepper_speed_up_cb(xTimerHandle tmr)
 CA4988Stepper::CA4988Stepper(int step_io, int dir_io, int number_of_steps, ledc_mode_t speed_mode, ledc_timer_t tim_idx, ledc_channel_t chn,
         pcnt_unit_t pcnt_unit, pcnt_channel_t pcnt_chn)
 {
-    esp_log_level_set(STEPPER_A4988_TAG, ESP_LOG_DEBUG);
     stepper_dev_t *pstepper = (stepper_dev_t*) calloc(sizeof(stepper_dev_t), 1);
     pstepper->step_io = step_io;
     pstepper->dir_io = dir_io;
@@ -198,7 +254,8 @@ CA4988Stepper::CA4988Stepper(int step_io, int dir_io, int number_of_steps, ledc_
 esp_err_t CA4988Stepper::stop(bool instant)
 {
     stepper_dev_t *pstepper = (stepper_dev_t*) m_stepper;
-    if (instant || pstepper->rpm <= STEPPER_START_LIMIT_RPM) {
+    if (instant || pstepper->plan_run || pstepper->rpm <= STEPPER_START_LIMIT_RPM) {
+        pstepper->plan_run = false;
         pstepper->steps_left = 0;
         pstepper->rpm = 0;
         if (pstepper->tmr) {
@@ -251,7 +308,7 @@ esp_err_t CA4988Stepper::setSpeedRpmCur(int rpm)
     pstepper->rpm = rpm;
     int freq = rpm * pstepper->number_of_steps / 60;
     if (freq > 0) {
-        ESP_LOGI(STEPPER_A4988_TAG, "set freq: %d\n", freq);
+        ESP_LOGD(STEPPER_A4988_TAG, "set freq: %d", freq);
         ledc_set_freq(pstepper->ledc_mode, pstepper->ledc_timer, freq);
     } else {
         ESP_LOGE(STEPPER_A4988_TAG, "LEDC freq error.");
@@ -272,7 +329,7 @@ esp_err_t CA4988Stepper::wait()
 
 esp_err_t CA4988Stepper::run(int dir, bool instant)
 {
-    ESP_LOGI(STEPPER_A4988_TAG, "Stepper run, dir: %d \n", dir);
+    ESP_LOGD(STEPPER_A4988_TAG, "Stepper run, dir: %d", dir);
     stepper_dev_t *pstepper = (stepper_dev_t*) m_stepper;
     xSemaphoreTake(pstepper->mux, portMAX_DELAY);
     xSemaphoreTake(pstepper->sem, 0);
@@ -353,6 +410,65 @@ esp_err_t CA4988Stepper::step(int steps, TickType_t ticks_to_wait, bool instant)
     return ESP_OK;
 }
 
+esp_err_t CA4988Stepper::move(int steps, const stepper_plan_cfg_t* cfg, TickType_t ticks_to_wait)
+{
+    stepper_dev_t *pstepper = (stepper_dev_t*) m_stepper;
+    STEPPER_A4988_CHECK(cfg != NULL, "motion config is NULL", ESP_ERR_INVALID_ARG);
+    xSemaphoreTake(pstepper->mux, portMAX_DELAY);
+    if (pstepper->plan == NULL) {
+        pstepper->plan = (stepper_plan_t*) calloc(1, sizeof(stepper_plan_t));
+        pstepper->seg_clk = (stepper_seg_clk_t*) calloc(STEPPER_PLAN_SEG_MAX, sizeof(stepper_seg_clk_t));
+        if (pstepper->plan == NULL || pstepper->seg_clk == NULL) {
+            free(pstepper->plan);
+            free(pstepper->seg_clk);
+            pstepper->plan = NULL;
+            pstepper->seg_clk = NULL;
+            xSemaphoreGive(pstepper->mux);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    int steps_abs = steps >= 0 ? steps : (-1 * steps);
+    esp_err_t ret = stepper_plan_move(pstepper->plan, cfg, steps_abs);
+    if (ret != ESP_OK || steps_abs == 0) {
+        xSemaphoreGive(pstepper->mux);
+        return ret;
+    }
+    stepper_plan_t* plan = pstepper->plan;
+    for (int i = 0; i < plan->seg_num; i++) {
+        stepper_seg_clk_calc(pstepper, &plan->seg[i], &pstepper->seg_clk[i]);
+    }
+    if (pstepper->tmr) {
+        xTimerStop(pstepper->tmr, portMAX_DELAY);
+    }
+
+    pstepper->direction = steps >= 0 ? 1 : -1;
+    gpio_set_level((gpio_num_t)pstepper->dir_io, steps >= 0 ? 1 : 0);
+    pstepper->steps_left = steps_abs;
+    pstepper->seg_idx = 0;
+    pstepper->seg_left = plan->seg[0].steps;
+    pstepper->plan_run = true;
+    stepper_seg_clk_set(pstepper, &pstepper->seg_clk[0]);
+
+    int thres = pstepper->seg_left;
+    if (thres > STEPPER_CNT_H - 1) {
+        thres = STEPPER_CNT_H - 1;
+    }
+    pcnt_set_event_value(pstepper->pcnt_unit, PCNT_EVT_THRES_0, thres);
+    pcnt_event_enable(pstepper->pcnt_unit, PCNT_EVT_THRES_0);
+    pcnt_counter_clear(pstepper->pcnt_unit);
+    xSemaphoreTake(pstepper->sem, 0);
+    pcnt_intr_enable(pstepper->pcnt_unit);
+    ledc_set_duty(pstepper->ledc_mode, pstepper->ledc_channel, STEPPER_LEDC_DUTY);
+    ledc_update_duty(pstepper->ledc_mode, pstepper->ledc_channel);
+
+    BaseType_t res = xSemaphoreTake(pstepper->sem, ticks_to_wait);
+    xSemaphoreGive(pstepper->mux);
+    if (res == pdFALSE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
 CA4988Stepper::~CA4988Stepper()
 {
     stepper_dev_t *pstepper = (stepper_dev_t*) m_stepper;
@@ -365,6 +481,8 @@ CA4988Stepper::~CA4988Stepper()
         xTimerDelete(pstepper->tmr, portMAX_DELAY);
         pstepper->tmr = NULL;
     }
+    free(pstepper->plan);
+    free(pstepper->seg_clk);
     free(pstepper);
     m_stepper = NULL;
 }
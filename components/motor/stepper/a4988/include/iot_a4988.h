@@ -19,6 +19,7 @@
 #include "driver/ledc.h"
 #include "driver/pcnt.h"
 #include "freertos/timers.h"
+#include "stepper_planner.h"
 
 /**
  *
@@ -107,6 +108,21 @@ public:
      */
     esp_err_t step(int steps, TickType_t ticks_to_wait = portMAX_DELAY, bool instant = false);
 
+    /**
+     * @brief Turn the motor a specific number of steps with a planned velocity profile.
+     *        The move is planned into a table of constant rate segments before the motor starts,
+     *        the PCNT threshold interrupt switches the LEDC clock to the next segment, so no timer
+     *        task is involved and the number of steps is exact.
+     * @param steps The number of steps to turn, negative or positive values determine the direction
+     * @param cfg velocity profile, rates are in steps per second
+     * @param ticks_to_wait block time for this function
+     * @note The LEDC timer of this stepper must not be shared with other steppers.
+     * @return ESP_OK if success
+     *         ESP_ERR_INVALID_ARG if the profile is invalid
+     *         ESP_ERR_TIMEOUT if operation timeout
+     */
+    esp_err_t move(int steps, const stepper_plan_cfg_t* cfg, TickType_t ticks_to_wait = portMAX_DELAY);
+
     /**
      * @brief Make the motor run towards a direction.
      * @param dir the direction to run, positive or negative values.
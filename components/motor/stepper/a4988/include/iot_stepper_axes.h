@@ -0,0 +1,107 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _IOT_STEPPER_AXES_H_
+#define _IOT_STEPPER_AXES_H_
+#include "esp_err.h"
+#include "driver/timer.h"
+#include "freertos/FreeRTOS.h"
+#include "stepper_interp.h"
+
+/**
+ * Coordinated step/dir axes driven from one hardware timer.
+ *
+ * Every timer alarm steps the dominant axis of the running line, the other axes step
+ * when their Bresenham error overflows, so all axes of a line start and arrive together.
+ * Lines are queued, the corner between two lines is passed without stopping when the
+ * directions allow it, and the rates of the queued lines are re-planned each time a line is added.
+ */
+#define STEPPER_AXES_QUEUE_LEN     (16)
+
+#ifdef __cplusplus
+
+class CStepperAxes
+{
+private:
+    void* m_axes;
+
+    /**
+     * prevent copy constructing
+     */
+    CStepperAxes(const CStepperAxes&);
+    CStepperAxes& operator =(const CStepperAxes&);
+
+public:
+    /**
+     * @brief Constructor for CStepperAxes class
+     * @param step_io Output GPIOs for step signals, one for each axis
+     * @param dir_io Output GPIOs for direction signals, one for each axis
+     * @param axis_num number of axes, up to STEPPER_AXIS_MAX
+     * @param start_rate rate the axes can start and stop at without acceleration, in steps per second
+     * @param accel acceleration of the dominant axis, in steps per second^2
+     * @param group hardware timer group used as the time base
+     * @param tim_idx hardware timer index used as the time base
+     *
+     * @note The axes are not driven by LEDC or PCNT, the A4988 steppers on these GPIOs must not be driven by CA4988Stepper objects.
+     */
+    CStepperAxes(const int* step_io, const int* dir_io, int axis_num, uint32_t start_rate, uint32_t accel,
+            timer_group_t group = TIMER_GROUP_0, timer_idx_t tim_idx = TIMER_0);
+
+    /**
+     * @brief Queue a straight line move of all axes
+     * @param steps steps of each axis, negative or positive values determine the direction
+     * @param rate rate of the axis that moves the most steps, in steps per second
+     * @param ticks_to_wait block time to wait for a free slot in the queue
+     * @return ESP_OK if success
+     *         ESP_ERR_INVALID_ARG if the parameter is invalid
+     *         ESP_ERR_TIMEOUT if the queue is still full
+     */
+    esp_err_t line(const int32_t* steps, uint32_t rate, TickType_t ticks_to_wait = portMAX_DELAY);
+
+    /**
+     * @brief Wait for the queued lines to finish
+     * @param ticks_to_wait block time for this function
+     * @return ESP_OK if success
+     *         ESP_ERR_TIMEOUT if operation timeout
+     */
+    esp_err_t wait(TickType_t ticks_to_wait = portMAX_DELAY);
+
+    /**
+     * @brief Stop all axes immediately and drop the queued lines
+     * @return ESP_OK if success
+     */
+    esp_err_t stop();
+
+    /**
+     * @brief Get the position of an axis, counted from the creation of the object
+     * @param axis axis index
+     * @return position in steps
+     */
+    int32_t getPosition(int axis);
+
+    /**
+     * @brief Check whether the axes are moving
+     * @return true if there are lines running or queued
+     */
+    bool isBusy();
+
+    /**
+     * @brief Destructor function of CStepperAxes object
+     */
+    ~CStepperAxes(void);
+};
+
+#endif
+
+#endif /* _IOT_STEPPER_AXES_H_ */
@@ -0,0 +1,129 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _IOT_STEPPER_INTERP_H_
+#define _IOT_STEPPER_INTERP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Linear interpolation and look-ahead for coordinated step/dir axes.
+ * Rates and acceleration are counted on the dominant axis of a line, which is the axis with the most steps.
+ * Nothing here touches hardware. stepper_line_rate, stepper_bres_init, stepper_bres_step and stepper_isqrt
+ * are placed in IRAM and use integer math only (64-bit multiply and memset come from ROM),
+ * so they can run from an ESP_INTR_FLAG_IRAM interrupt.
+ */
+
+#define STEPPER_AXIS_MAX    (4)
+
+typedef struct {
+    int32_t delta[STEPPER_AXIS_MAX];    /*!< steps of each axis, the sign is the direction */
+    uint32_t steps;                     /*!< steps of the dominant axis */
+    uint32_t nominal_rate;              /*!< requested rate of the dominant axis, steps/s */
+    uint32_t max_entry_rate;            /*!< limit of the entry rate from the corner with the previous line */
+    uint32_t entry_rate;                /*!< planned rate at the start of the line */
+    uint32_t exit_rate;                 /*!< planned rate at the end of the line */
+} stepper_line_t;
+
+typedef struct {
+    uint32_t abs[STEPPER_AXIS_MAX];     /*!< absolute steps of each axis */
+    int32_t err[STEPPER_AXIS_MAX];      /*!< Bresenham error of each axis */
+    uint32_t steps;                     /*!< steps of the dominant axis */
+    uint32_t step_idx;                  /*!< steps done */
+    uint8_t axis_num;
+} stepper_bres_t;
+
+/**
+ * @brief Fill the dominant step count of a line
+ *
+ * @param line line with delta filled
+ * @param axis_num number of axes in use
+ * @param rate requested rate of the dominant axis, steps/s
+ */
+void stepper_line_init(stepper_line_t* line, uint8_t axis_num, uint32_t rate);
+
+/**
+ * @brief Limit the entry rate of a line by the corner with the previous line
+ *
+ * The rate through a corner is scaled by the cosine of the angle between the two lines,
+ * it is start_rate for a reversal or a right angle and the lower nominal rate when the lines are collinear.
+ *
+ * @param prev previous line, NULL if the line starts from rest
+ * @param line line to update
+ * @param axis_num number of axes in use
+ * @param start_rate rate that can be reached or left without acceleration, steps/s
+ */
+void stepper_line_junction(const stepper_line_t* prev, stepper_line_t* line, uint8_t axis_num, uint32_t start_rate);
+
+/**
+ * @brief Plan entry and exit rates of queued lines
+ *
+ * The first line may already be running as long as it has not started to slow down:
+ * its entry rate is kept and its exit rate can only rise, so the rate it is stepping at does not change.
+ *
+ * @param lines lines in execution order
+ * @param num number of lines
+ * @param entry_rate fixed entry rate of the first line
+ * @param start_rate exit rate of the last line, the motion stops there unless more lines are added
+ * @param accel acceleration of the dominant axis, steps/s^2
+ */
+void stepper_lookahead(stepper_line_t* const* lines, int num, uint32_t entry_rate, uint32_t start_rate, uint32_t accel);
+
+/**
+ * @brief Get the rate of a line at a step, the rate ramps from entry_rate and down to exit_rate
+ *
+ * @param line planned line
+ * @param step_idx steps done in the line
+ * @param accel acceleration of the dominant axis, steps/s^2
+ *
+ * @return rate in steps/s
+ */
+uint32_t stepper_line_rate(const stepper_line_t* line, uint32_t step_idx, uint32_t accel);
+
+/**
+ * @brief Start Bresenham stepping of a line
+ *
+ * @param bres stepping state
+ * @param line line to run
+ * @param axis_num number of axes in use
+ */
+void stepper_bres_init(stepper_bres_t* bres, const stepper_line_t* line, uint8_t axis_num);
+
+/**
+ * @brief Run one step of the dominant axis
+ *
+ * @param bres stepping state
+ *
+ * @return bit mask of the axes that step at this tick, 0 when the line is done
+ */
+uint32_t stepper_bres_step(stepper_bres_t* bres);
+
+/**
+ * @brief Integer square root
+ *
+ * @param val value
+ *
+ * @return floor(sqrt(val))
+ */
+uint32_t stepper_isqrt(uint64_t val);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,85 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _IOT_STEPPER_PLANNER_H_
+#define _IOT_STEPPER_PLANNER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * Motion planner for step/dir drivers.
+ * A move is planned into a table of segments, each segment runs a number of steps at a constant step rate.
+ * The table only depends on the motion parameters, so it can be built and checked without any hardware.
+ */
+
+#define STEPPER_PLAN_RAMP_SEG     (32)                          /*!< segments of the acceleration ramp */
+#define STEPPER_PLAN_SEG_MAX      (STEPPER_PLAN_RAMP_SEG * 2 + 1) /*!< ramp up, cruise, ramp down */
+
+typedef enum {
+    STEPPER_PROFILE_TRAPEZOID = 0,   /*!< constant acceleration */
+    STEPPER_PROFILE_SCURVE,          /*!< acceleration changes with limited jerk */
+} stepper_profile_t;
+
+typedef struct {
+    stepper_profile_t profile;       /*!< velocity profile */
+    uint32_t start_rate;             /*!< step rate at start and end of the move, steps/s, must be > 0 */
+    uint32_t max_rate;               /*!< cruise step rate, steps/s */
+    uint32_t accel;                  /*!< max acceleration, steps/s^2 */
+    uint32_t jerk;                   /*!< max jerk for STEPPER_PROFILE_SCURVE, steps/s^3 */
+} stepper_plan_cfg_t;
+
+typedef struct {
+    uint32_t steps;                  /*!< steps in this segment */
+    uint32_t rate;                   /*!< step rate of this segment, steps/s */
+} stepper_seg_t;
+
+typedef struct {
+    stepper_seg_t seg[STEPPER_PLAN_SEG_MAX];
+    uint16_t seg_num;                /*!< segments in use */
+    uint32_t total_steps;            /*!< sum of the steps of all segments */
+    uint32_t peak_rate;              /*!< highest rate reached, lower than max_rate if the move is short */
+    uint32_t accel_steps;            /*!< steps of the acceleration ramp, the deceleration ramp has the same length */
+} stepper_plan_t;
+
+/**
+ * @brief Plan a move
+ *
+ * @param plan output segment table
+ * @param cfg motion parameters
+ * @param steps number of steps of the move
+ *
+ * @return
+ *     - ESP_OK: succeed
+ *     - ESP_ERR_INVALID_ARG: parameters are invalid
+ */
+esp_err_t stepper_plan_move(stepper_plan_t* plan, const stepper_plan_cfg_t* cfg, uint32_t steps);
+
+/**
+ * @brief Get the duration of a planned move
+ *
+ * @param plan segment table
+ *
+ * @return time of the move in us
+ */
+uint64_t stepper_plan_duration_us(const stepper_plan_t* plan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,395 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <esp_types.h>
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_intr_alloc.h"
+#include "esp_heap_caps.h"
+#include "driver/gpio.h"
+#include "driver/timer.h"
+#include "soc/gpio_struct.h"
+#include "soc/timer_group_struct.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "iot_stepper_axes.h"
+
+static const char* STEPPER_AXES_TAG = "stepper_axes";
+#define STEPPER_AXES_CHECK(a, str, ret_val) \
+    if (!(a)) { \
+        ESP_LOGE(STEPPER_AXES_TAG,"%s(%d): %s", __FUNCTION__, __LINE__, str); \
+        return (ret_val); \
+    }
+
+#define STEPPER_AXES_TIMER_DIV      (80)
+#define STEPPER_AXES_TICK_HZ        (TIMER_BASE_CLK / STEPPER_AXES_TIMER_DIV)
+#define STEPPER_AXES_PULSE_TICKS    (3)     /* A4988 needs 1us high and 1us low on STEP */
+
+typedef struct {
+    uint32_t lo;
+    uint32_t hi;
+} stepper_io_mask_t;
+
+typedef struct {
+    uint8_t axis_num;
+    stepper_io_mask_t step_mask[STEPPER_AXIS_MAX];
+    stepper_io_mask_t dir_mask[STEPPER_AXIS_MAX];
+    timer_group_t group;
+    timer_idx_t tim_idx;
+    timg_dev_t* hw;
+    intr_handle_t intr;
+    uint32_t start_rate;
+    uint32_t accel;
+    stepper_line_t lines[STEPPER_AXES_QUEUE_LEN];
+    int head;               /* oldest line, it is running when line_run is set */
+    int count;
+    bool line_run;
+    bool busy;
+    bool pulse_high;        /* the next alarm drops the step pins */
+    uint32_t exit_rate;     /* exit rate of the last finished line, the entry of the next one */
+    uint32_t period;        /* timer ticks between two steps */
+    stepper_bres_t bres;
+    stepper_io_mask_t pulse;
+    int32_t pos[STEPPER_AXIS_MAX];
+    portMUX_TYPE spinlock;
+    SemaphoreHandle_t space;
+    SemaphoreHandle_t done;
+    SemaphoreHandle_t mux;
+} stepper_axes_t;
+
+static void stepper_io_mask(int io, stepper_io_mask_t* mask)
+{
+    mask->lo = io < 32 ? BIT(io) : 0;
+    mask->hi = io >= 32 ? BIT(io - 32) : 0;
+}
+
+static inline void IRAM_ATTR stepper_io_set(const stepper_io_mask_t* mask)
+{
+    GPIO.out_w1ts = mask->lo;
+    GPIO.out1_w1ts.val = mask->hi;
+}
+
+static inline void IRAM_ATTR stepper_io_clear(const stepper_io_mask_t* mask)
+{
+    GPIO.out_w1tc = mask->lo;
+    GPIO.out1_w1tc.val = mask->hi;
+}
+
+static inline void IRAM_ATTR stepper_alarm_set(stepper_axes_t* dev, uint32_t ticks)
+{
+    dev->hw->hw_timer[dev->tim_idx].alarm_high = 0;
+    dev->hw->hw_timer[dev->tim_idx].alarm_low = ticks;
+    dev->hw->hw_timer[dev->tim_idx].config.alarm_en = TIMER_ALARM_EN;
+}
+
+/* take the oldest line and set the direction pins, they settle for at least one pulse width before the first step */
+static bool IRAM_ATTR stepper_line_load(stepper_axes_t* dev)
+{
+    if (dev->count == 0) {
+        return false;
+    }
+    stepper_line_t* line = &dev->lines[dev->head];
+    for (int i = 0; i < dev->axis_num; i++) {
+        if (line->delta[i] >= 0) {
+            stepper_io_set(&dev->dir_mask[i]);
+        } else {
+            stepper_io_clear(&dev->dir_mask[i]);
+        }
+    }
+    stepper_bres_init(&dev->bres, line, dev->axis_num);
+    dev->line_run = true;
+    return true;
+}
+
+/*
+ * Two alarms per step: the rising alarm steps the axes and the falling alarm drops the pins
+ * STEPPER_AXES_PULSE_TICKS later. The falling alarm is also where the next line is loaded.
+ * The handler is registered with ESP_INTR_FLAG_IRAM, everything it calls must stay in IRAM or ROM.
+ */
+static void IRAM_ATTR stepper_axes_intr_handler(void *arg)
+{
+    stepper_axes_t* dev = (stepper_axes_t*) arg;
+    portBASE_TYPE HPTaskAwoken = pdFALSE;
+    bool line_done = false;
+    bool stopped = false;
+    dev->hw->int_clr_timers.val = BIT(dev->tim_idx);
+
+    portENTER_CRITICAL_ISR(&dev->spinlock);
+    if (!dev->busy) {
+        // stopped while the alarm was pending
+        portEXIT_CRITICAL_ISR(&dev->spinlock);
+        return;
+    }
+    if (dev->pulse_high) {
+        stepper_io_clear(&dev->pulse);
+        dev->pulse_high = false;
+        if (!dev->line_run && !stepper_line_load(dev)) {
+            dev->busy = false;
+            dev->hw->hw_timer[dev->tim_idx].config.enable = 0;
+            stopped = true;
+        } else {
+            stepper_alarm_set(dev, dev->period - STEPPER_AXES_PULSE_TICKS);
+        }
+    } else {
+        stepper_line_t* line = &dev->lines[dev->head];
+        uint32_t mask = stepper_bres_step(&dev->bres);
+        dev->pulse.lo = 0;
+        dev->pulse.hi = 0;
+        for (int i = 0; i < dev->axis_num; i++) {
+            if (mask & BIT(i)) {
+                dev->pulse.lo |= dev->step_mask[i].lo;
+                dev->pulse.hi |= dev->step_mask[i].hi;
+                dev->pos[i] += line->delta[i] >= 0 ? 1 : -1;
+            }
+        }
+        stepper_io_set(&dev->pulse);
+        dev->period = STEPPER_AXES_TICK_HZ / stepper_line_rate(line, dev->bres.step_idx, dev->accel);
+        if (dev->period < 2 * STEPPER_AXES_PULSE_TICKS) {
+            dev->period = 2 * STEPPER_AXES_PULSE_TICKS;
+        }
+        if (dev->bres.step_idx >= dev->bres.steps) {
+            dev->exit_rate = line->exit_rate;
+            dev->head = (dev->head + 1) % STEPPER_AXES_QUEUE_LEN;
+            dev->count--;
+            dev->line_run = false;
+            line_done = true;
+        }
+        dev->pulse_high = true;
+        stepper_alarm_set(dev, STEPPER_AXES_PULSE_TICKS);
+    }
+    portEXIT_CRITICAL_ISR(&dev->spinlock);
+
+    if (line_done) {
+        xSemaphoreGiveFromISR(dev->space, &HPTaskAwoken);
+    }
+    if (stopped) {
+        xSemaphoreGiveFromISR(dev->done, &HPTaskAwoken);
+    }
+    if (HPTaskAwoken == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+CStepperAxes::CStepperAxes(const int* step_io, const int* dir_io, int axis_num, uint32_t start_rate, uint32_t accel,
+        timer_group_t group, timer_idx_t tim_idx)
+{
+    m_axes = NULL;
+    if (step_io == NULL || dir_io == NULL || axis_num <= 0 || axis_num > STEPPER_AXIS_MAX || start_rate == 0 || accel == 0) {
+        ESP_LOGE(STEPPER_AXES_TAG, "stepper axes parameter error");
+        return;
+    }
+    // the ISR reads the state with the cache disabled, keep it out of PSRAM
+    stepper_axes_t* dev = (stepper_axes_t*) heap_caps_calloc(1, sizeof(stepper_axes_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (dev == NULL) {
+        ESP_LOGE(STEPPER_AXES_TAG, "no memory for stepper axes");
+        return;
+    }
+    dev->axis_num = axis_num;
+    dev->group = group;
+    dev->tim_idx = tim_idx;
+    dev->hw = (group == TIMER_GROUP_0) ? &TIMERG0 : &TIMERG1;
+    dev->start_rate = start_rate;
+    dev->accel = accel;
+    dev->exit_rate = start_rate;
+    vPortCPUInitializeMutex(&dev->spinlock);
+    dev->space = xSemaphoreCreateCounting(STEPPER_AXES_QUEUE_LEN, STEPPER_AXES_QUEUE_LEN);
+    dev->done = xSemaphoreCreateBinary();
+    dev->mux = xSemaphoreCreateMutex();
+
+    gpio_config_t io;
+    io.intr_type = GPIO_INTR_DISABLE;
+    io.mode = GPIO_MODE_OUTPUT;
+    io.pin_bit_mask = 0;
+    io.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    io.pull_up_en = GPIO_PULLUP_DISABLE;
+    for (int i = 0; i < axis_num; i++) {
+        stepper_io_mask(step_io[i], &dev->step_mask[i]);
+        stepper_io_mask(dir_io[i], &dev->dir_mask[i]);
+        io.pin_bit_mask |= (1ULL << step_io[i]) | (1ULL << dir_io[i]);
+        gpio_set_level((gpio_num_t) step_io[i], 0);
+    }
+    gpio_config(&io);
+
+    timer_config_t tim;
+    tim.alarm_en = TIMER_ALARM_EN;
+    tim.counter_en = TIMER_PAUSE;
+    tim.intr_type = TIMER_INTR_LEVEL;
+    tim.counter_dir = TIMER_COUNT_UP;
+    tim.auto_reload = TIMER_AUTORELOAD_EN;
+    tim.divider = STEPPER_AXES_TIMER_DIV;
+    timer_init(group, tim_idx, &tim);
+    timer_set_counter_value(group, tim_idx, 0);
+    timer_enable_intr(group, tim_idx);
+    timer_isr_register(group, tim_idx, stepper_axes_intr_handler, dev, ESP_INTR_FLAG_IRAM, &dev->intr);
+    m_axes = dev;
+}
+
+esp_err_t CStepperAxes::line(const int32_t* steps, uint32_t rate, TickType_t ticks_to_wait)
+{
+    stepper_axes_t* dev = (stepper_axes_t*) m_axes;
+    STEPPER_AXES_CHECK(dev != NULL, "stepper axes not created", ESP_FAIL);
+    STEPPER_AXES_CHECK(steps != NULL, "steps is NULL", ESP_ERR_INVALID_ARG);
+    STEPPER_AXES_CHECK(rate > 0, "rate is 0", ESP_ERR_INVALID_ARG);
+
+    stepper_line_t line;
+    memset(&line, 0, sizeof(stepper_line_t));
+    memcpy(line.delta, steps, dev->axis_num * sizeof(int32_t));
+    stepper_line_init(&line, dev->axis_num, rate > dev->start_rate ? rate : dev->start_rate);
+    if (line.steps == 0) {
+        return ESP_OK;
+    }
+
+    xSemaphoreTake(dev->mux, portMAX_DELAY);
+    if (xSemaphoreTake(dev->space, ticks_to_wait) == pdFALSE) {
+        xSemaphoreGive(dev->mux);
+        return ESP_ERR_TIMEOUT;
+    }
+    // The corner is computed from a copy, the previous line may finish meanwhile
+    stepper_line_t prev;
+    bool has_prev;
+    portENTER_CRITICAL(&dev->spinlock);
+    has_prev = dev->count > 0;
+    if (has_prev) {
+        prev = dev->lines[(dev->head + dev->count - 1) % STEPPER_AXES_QUEUE_LEN];
+    }
+    portEXIT_CRITICAL(&dev->spinlock);
+    stepper_line_junction(has_prev ? &prev : NULL, &line, dev->axis_num, dev->start_rate);
+
+    /*
+     * Re-plan every line that has not started. The running line is re-planned too until it starts
+     * to slow down: its exit can only rise, so the rate it steps at now stays the same and the
+     * new line blends in. Once it is on its down ramp its exit rate is fixed.
+     */
+    stepper_line_t* plan[STEPPER_AXES_QUEUE_LEN];
+    bool start = false;
+    portENTER_CRITICAL(&dev->spinlock);
+    dev->lines[(dev->head + dev->count) % STEPPER_AXES_QUEUE_LEN] = line;
+    dev->count++;
+    int first = 0;
+    uint32_t entry_rate = dev->busy ? dev->exit_rate : dev->start_rate;
+    if (dev->line_run) {
+        stepper_line_t* run = &dev->lines[dev->head];
+        uint32_t left = run->steps - dev->bres.step_idx;
+        uint32_t now = stepper_line_rate(run, dev->bres.step_idx, dev->accel);
+        uint32_t down = stepper_isqrt((uint64_t) run->exit_rate * run->exit_rate + 2ULL * dev->accel * left);
+        if (down > now) {
+            entry_rate = run->entry_rate;
+        } else {
+            first = 1;
+            entry_rate = run->exit_rate;
+        }
+    }
+    int num = dev->count - first;
+    for (int i = 0; i < num; i++) {
+        plan[i] = &dev->lines[(dev->head + first + i) % STEPPER_AXES_QUEUE_LEN];
+    }
+    stepper_lookahead(plan, num, entry_rate, dev->start_rate, dev->accel);
+    if (!dev->busy) {
+        dev->exit_rate = dev->start_rate;
+        dev->busy = true;
+        dev->pulse_high = true;
+        dev->period = 2 * STEPPER_AXES_PULSE_TICKS;
+        start = true;
+    }
+    portEXIT_CRITICAL(&dev->spinlock);
+
+    if (start) {
+        xSemaphoreTake(dev->done, 0);
+        timer_set_counter_value(dev->group, dev->tim_idx, 0);
+        timer_set_alarm_value(dev->group, dev->tim_idx, STEPPER_AXES_PULSE_TICKS);
+        timer_set_alarm(dev->group, dev->tim_idx, TIMER_ALARM_EN);
+        timer_start(dev->group, dev->tim_idx);
+    }
+    xSemaphoreGive(dev->mux);
+    return ESP_OK;
+}
+
+esp_err_t CStepperAxes::wait(TickType_t ticks_to_wait)
+{
+    stepper_axes_t* dev = (stepper_axes_t*) m_axes;
+    STEPPER_AXES_CHECK(dev != NULL, "stepper axes not created", ESP_FAIL);
+    // No mutex here, line() must be able to queue more lines while a task waits.
+    // A token left from an earlier stop only wakes the loop up, busy is checked again.
+    TickType_t start = xTaskGetTickCount();
+    while (isBusy()) {
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (ticks_to_wait != portMAX_DELAY && waited >= ticks_to_wait) {
+            return ESP_ERR_TIMEOUT;
+        }
+        xSemaphoreTake(dev->done, ticks_to_wait == portMAX_DELAY ? portMAX_DELAY : ticks_to_wait - waited);
+    }
+    // pass the wake up on to the next waiter, line() clears it before the next start
+    xSemaphoreGive(dev->done);
+    return ESP_OK;
+}
+
+esp_err_t CStepperAxes::stop()
+{
+    stepper_axes_t* dev = (stepper_axes_t*) m_axes;
+    STEPPER_AXES_CHECK(dev != NULL, "stepper axes not created", ESP_FAIL);
+    timer_pause(dev->group, dev->tim_idx);
+    portENTER_CRITICAL(&dev->spinlock);
+    int dropped = dev->count;
+    bool busy = dev->busy;
+    stepper_io_clear(&dev->pulse);
+    dev->count = 0;
+    dev->line_run = false;
+    dev->busy = false;
+    dev->pulse_high = false;
+    portEXIT_CRITICAL(&dev->spinlock);
+    for (int i = 0; i < dropped; i++) {
+        xSemaphoreGive(dev->space);
+    }
+    if (busy) {
+        xSemaphoreGive(dev->done);
+    }
+    return ESP_OK;
+}
+
+int32_t CStepperAxes::getPosition(int axis)
+{
+    stepper_axes_t* dev = (stepper_axes_t*) m_axes;
+    STEPPER_AXES_CHECK(dev != NULL && axis >= 0 && axis < dev->axis_num, "axis error", 0);
+    return dev->pos[axis];
+}
+
+bool CStepperAxes::isBusy()
+{
+    stepper_axes_t* dev = (stepper_axes_t*) m_axes;
+    if (dev == NULL) {
+        return false;
+    }
+    portENTER_CRITICAL(&dev->spinlock);
+    bool busy = dev->busy;
+    portEXIT_CRITICAL(&dev->spinlock);
+    return busy;
+}
+
+CStepperAxes::~CStepperAxes()
+{
+    stepper_axes_t* dev = (stepper_axes_t*) m_axes;
+    if (dev == NULL) {
+        return;
+    }
+    stop();
+    timer_disable_intr(dev->group, dev->tim_idx);
+    esp_intr_free(dev->intr);
+    vSemaphoreDelete(dev->mux);
+    vSemaphoreDelete(dev->done);
+    vSemaphoreDelete(dev->space);
+    free(dev);
+    m_axes = NULL;
+}
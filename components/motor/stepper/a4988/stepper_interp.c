@@ -0,0 +1,146 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include <math.h>
+#include "esp_attr.h"
+#include "stepper_interp.h"
+
+#define STEPPER_MIN(a, b)   ((a) < (b) ? (a) : (b))
+
+uint32_t IRAM_ATTR stepper_isqrt(uint64_t val)
+{
+    uint64_t res = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > val) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (val >= res + bit) {
+            val -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t) res;
+}
+
+void stepper_line_init(stepper_line_t* line, uint8_t axis_num, uint32_t rate)
+{
+    line->steps = 0;
+    for (int i = 0; i < axis_num; i++) {
+        uint32_t abs = line->delta[i] >= 0 ? line->delta[i] : -line->delta[i];
+        if (abs > line->steps) {
+            line->steps = abs;
+        }
+    }
+    line->nominal_rate = rate;
+    line->max_entry_rate = rate;
+    line->entry_rate = 0;
+    line->exit_rate = 0;
+}
+
+void stepper_line_junction(const stepper_line_t* prev, stepper_line_t* line, uint8_t axis_num, uint32_t start_rate)
+{
+    if (prev == NULL || prev->steps == 0 || line->steps == 0) {
+        line->max_entry_rate = start_rate;
+        return;
+    }
+    float dot = 0, len_a = 0, len_b = 0;
+    for (int i = 0; i < axis_num; i++) {
+        dot += (float) prev->delta[i] * line->delta[i];
+        len_a += (float) prev->delta[i] * prev->delta[i];
+        len_b += (float) line->delta[i] * line->delta[i];
+    }
+    float cos = dot / sqrtf(len_a * len_b);
+    uint32_t rate = STEPPER_MIN(prev->nominal_rate, line->nominal_rate);
+    if (cos <= 0) {
+        rate = start_rate;
+    } else {
+        rate = start_rate + (uint32_t)((rate > start_rate ? rate - start_rate : 0) * cos);
+    }
+    line->max_entry_rate = STEPPER_MIN(rate, line->nominal_rate);
+}
+
+/* highest rate reachable after accelerating from rate over steps */
+static uint32_t stepper_rate_reach(uint32_t rate, uint32_t steps, uint32_t accel)
+{
+    return stepper_isqrt((uint64_t) rate * rate + 2ULL * accel * steps);
+}
+
+void stepper_lookahead(stepper_line_t* const* lines, int num, uint32_t entry_rate, uint32_t start_rate, uint32_t accel)
+{
+    if (num <= 0) {
+        return;
+    }
+    /* backward: every line must be able to slow down to the entry of the next one, the last one stops */
+    uint32_t exit_rate = start_rate;
+    for (int i = num - 1; i >= 0; i--) {
+        stepper_line_t* line = lines[i];
+        line->exit_rate = exit_rate;
+        uint32_t entry = STEPPER_MIN(line->max_entry_rate, stepper_rate_reach(exit_rate, line->steps, accel));
+        line->entry_rate = STEPPER_MIN(entry, line->nominal_rate);
+        exit_rate = line->entry_rate;
+    }
+    /* forward: every line must be able to speed up to its exit from its entry */
+    lines[0]->entry_rate = entry_rate;
+    for (int i = 0; i < num; i++) {
+        stepper_line_t* line = lines[i];
+        if (i > 0) {
+            line->entry_rate = lines[i - 1]->exit_rate;
+        }
+        uint32_t reach = stepper_rate_reach(line->entry_rate, line->steps, accel);
+        line->exit_rate = STEPPER_MIN(line->exit_rate, reach);
+    }
+}
+
+uint32_t IRAM_ATTR stepper_line_rate(const stepper_line_t* line, uint32_t step_idx, uint32_t accel)
+{
+    uint64_t nominal = (uint64_t) line->nominal_rate * line->nominal_rate;
+    uint64_t up = (uint64_t) line->entry_rate * line->entry_rate + 2ULL * accel * step_idx;
+    uint32_t left = step_idx < line->steps ? line->steps - step_idx : 0;
+    uint64_t down = (uint64_t) line->exit_rate * line->exit_rate + 2ULL * accel * left;
+    uint64_t rate2 = STEPPER_MIN(nominal, STEPPER_MIN(up, down));
+    uint32_t rate = stepper_isqrt(rate2);
+    return rate > 0 ? rate : 1;
+}
+
+void IRAM_ATTR stepper_bres_init(stepper_bres_t* bres, const stepper_line_t* line, uint8_t axis_num)
+{
+    memset(bres, 0, sizeof(stepper_bres_t));
+    bres->axis_num = axis_num;
+    bres->steps = line->steps;
+    for (int i = 0; i < axis_num; i++) {
+        bres->abs[i] = line->delta[i] >= 0 ? line->delta[i] : -line->delta[i];
+        bres->err[i] = line->steps / 2;
+    }
+}
+
+uint32_t IRAM_ATTR stepper_bres_step(stepper_bres_t* bres)
+{
+    uint32_t mask = 0;
+    if (bres->step_idx >= bres->steps) {
+        return 0;
+    }
+    for (int i = 0; i < bres->axis_num; i++) {
+        bres->err[i] -= bres->abs[i];
+        if (bres->err[i] < 0) {
+            bres->err[i] += bres->steps;
+            mask |= (1 << i);
+        }
+    }
+    bres->step_idx++;
+    return mask;
+}
@@ -0,0 +1,198 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include <math.h>
+#include "stepper_planner.h"
+
+#define STEPPER_PLAN_SEARCH_LOOP    (40)
+
+/* one acceleration ramp from v0 to vp, the deceleration ramp is its mirror */
+typedef struct {
+    stepper_profile_t profile;
+    double v0;
+    double vp;
+    double accel;       /* max acceleration */
+    double jerk;
+    double a_m;         /* acceleration actually reached */
+    double t1;          /* S-curve: time of the jerk phases */
+    double t2;          /* S-curve: time of the constant acceleration phase */
+    double ta;          /* time of the ramp */
+} stepper_ramp_t;
+
+static void stepper_ramp_init(stepper_ramp_t* ramp, const stepper_plan_cfg_t* cfg, double vp)
+{
+    double dv = vp - cfg->start_rate;
+    ramp->profile = cfg->profile;
+    ramp->v0 = cfg->start_rate;
+    ramp->vp = vp;
+    ramp->accel = cfg->accel;
+    ramp->jerk = cfg->jerk;
+    ramp->t1 = 0;
+    ramp->t2 = 0;
+    if (dv <= 0) {
+        ramp->vp = ramp->v0;
+        ramp->a_m = 0;
+        ramp->ta = 0;
+    } else if (cfg->profile == STEPPER_PROFILE_TRAPEZOID) {
+        ramp->a_m = ramp->accel;
+        ramp->ta = dv / ramp->accel;
+    } else {
+        if (dv * ramp->jerk >= ramp->accel * ramp->accel) {
+            ramp->a_m = ramp->accel;
+            ramp->t1 = ramp->accel / ramp->jerk;
+            ramp->t2 = dv / ramp->accel - ramp->t1;
+        } else {
+            /* the ramp is too short to reach the max acceleration */
+            ramp->a_m = sqrt(dv * ramp->jerk);
+            ramp->t1 = ramp->a_m / ramp->jerk;
+        }
+        ramp->ta = 2 * ramp->t1 + ramp->t2;
+    }
+}
+
+/* both profiles are symmetric, so the mean velocity of the ramp is (v0 + vp) / 2 */
+static double stepper_ramp_dist(const stepper_ramp_t* ramp)
+{
+    return (ramp->v0 + ramp->vp) / 2 * ramp->ta;
+}
+
+static double stepper_ramp_pos(const stepper_ramp_t* ramp, double t)
+{
+    double v0 = ramp->v0;
+    if (t >= ramp->ta) {
+        return stepper_ramp_dist(ramp);
+    }
+    if (ramp->profile == STEPPER_PROFILE_TRAPEZOID) {
+        return v0 * t + ramp->a_m * t * t / 2;
+    }
+    double j = ramp->jerk;
+    double a = ramp->a_m;
+    double t1 = ramp->t1;
+    if (t <= t1) {
+        return v0 * t + j * t * t * t / 6;
+    }
+    double v1 = v0 + j * t1 * t1 / 2;
+    double s1 = v0 * t1 + j * t1 * t1 * t1 / 6;
+    if (t <= t1 + ramp->t2) {
+        double tau = t - t1;
+        return s1 + v1 * tau + a * tau * tau / 2;
+    }
+    double t2 = ramp->t2;
+    double v2 = v1 + a * t2;
+    double s2 = s1 + v1 * t2 + a * t2 * t2 / 2;
+    double tau = t - t1 - t2;
+    return s2 + v2 * tau + a * tau * tau / 2 - j * tau * tau * tau / 6;
+}
+
+/* time at which the ramp reaches pos, pos must be within the ramp */
+static double stepper_ramp_time(const stepper_ramp_t* ramp, double pos)
+{
+    double lo = 0;
+    double hi = ramp->ta;
+    for (int i = 0; i < STEPPER_PLAN_SEARCH_LOOP; i++) {
+        double mid = (lo + hi) / 2;
+        if (stepper_ramp_pos(ramp, mid) < pos) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return hi;
+}
+
+static void stepper_plan_add(stepper_plan_t* plan, uint32_t steps, double rate)
+{
+    stepper_seg_t* seg = &plan->seg[plan->seg_num++];
+    seg->steps = steps;
+    seg->rate = (uint32_t)(rate + 0.5);
+    if (seg->rate == 0) {
+        seg->rate = 1;
+    }
+    plan->total_steps += steps;
+}
+
+esp_err_t stepper_plan_move(stepper_plan_t* plan, const stepper_plan_cfg_t* cfg, uint32_t steps)
+{
+    if (plan == NULL || cfg == NULL || cfg->start_rate == 0 || cfg->accel == 0
+            || (cfg->profile == STEPPER_PROFILE_SCURVE && cfg->jerk == 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(plan, 0, sizeof(stepper_plan_t));
+    if (steps == 0) {
+        return ESP_OK;
+    }
+
+    /* the ramp is cut to a whole number of steps, then the peak rate is searched so the ramp ends exactly there */
+    stepper_ramp_t ramp;
+    double vmax = cfg->max_rate > cfg->start_rate ? cfg->max_rate : cfg->start_rate;
+    stepper_ramp_init(&ramp, cfg, vmax);
+    uint32_t accel_steps = (uint32_t) stepper_ramp_dist(&ramp);
+    if (accel_steps > steps / 2) {
+        accel_steps = steps / 2;
+    }
+    double lo = cfg->start_rate;
+    double hi = vmax;
+    for (int i = 0; i < STEPPER_PLAN_SEARCH_LOOP; i++) {
+        double mid = (lo + hi) / 2;
+        stepper_ramp_init(&ramp, cfg, mid);
+        if (stepper_ramp_dist(&ramp) > accel_steps) {
+            hi = mid;
+        } else {
+            lo = mid;
+        }
+    }
+    stepper_ramp_init(&ramp, cfg, lo);
+    plan->accel_steps = accel_steps;
+    plan->peak_rate = (uint32_t)(ramp.vp + 0.5);
+
+    /*
+     * segment ends are taken from equal time slices of the ramp and rounded to whole steps,
+     * then the exact time of each end is solved so the rate of a segment is its true mean velocity
+     */
+    uint16_t ramp_num = 0;
+    uint32_t last_pos = 0;
+    double last_t = 0;
+    for (int k = 1; k <= STEPPER_PLAN_RAMP_SEG && accel_steps > 0; k++) {
+        uint32_t pos = accel_steps;
+        if (k < STEPPER_PLAN_RAMP_SEG) {
+            pos = (uint32_t)(stepper_ramp_pos(&ramp, ramp.ta * k / STEPPER_PLAN_RAMP_SEG) + 0.5);
+        }
+        if (pos <= last_pos) {
+            continue;
+        }
+        double t = stepper_ramp_time(&ramp, pos);
+        stepper_plan_add(plan, pos - last_pos, (pos - last_pos) / (t - last_t));
+        last_pos = pos;
+        last_t = t;
+    }
+    ramp_num = plan->seg_num;
+    if (steps > 2 * accel_steps) {
+        stepper_plan_add(plan, steps - 2 * accel_steps, ramp.vp);
+    }
+    for (int i = ramp_num - 1; i >= 0; i--) {
+        plan->seg[plan->seg_num] = plan->seg[i];
+        plan->total_steps += plan->seg[i].steps;
+        plan->seg_num++;
+    }
+    return ESP_OK;
+}
+
+uint64_t stepper_plan_duration_us(const stepper_plan_t* plan)
+{
+    uint64_t us = 0;
+    for (int i = 0; i < plan->seg_num; i++) {
+        us += (uint64_t) plan->seg[i].steps * 1000000 / plan->seg[i].rate;
+    }
+    return us;
+}
@@ -19,6 +19,7 @@
 #include "freertos/semphr.h"
 #include "esp_log.h"
 #include "iot_a4988.h"
+#include "iot_stepper_axes.h"
 #include "unity.h"
 
 TEST_CASE("Stepper A4988 test", "[stepper][a4988][iot]")
@@ -65,3 +66,50 @@ TEST_CASE("Stepper A4988 test", "[stepper][a4988][iot]")
     stepper2.stop();
 
 }
+
+TEST_CASE("Stepper A4988 planned move test", "[stepper][a4988][iot]")
+{
+    stepper_plan_cfg_t trapezoid = {
+        .profile = STEPPER_PROFILE_TRAPEZOID,
+        .start_rate = 800,
+        .max_rate = 8000,
+        .accel = 16000,
+        .jerk = 0,
+    };
+    stepper_plan_cfg_t scurve = trapezoid;
+    scurve.profile = STEPPER_PROFILE_SCURVE;
+    scurve.jerk = 80000;
+
+    CA4988Stepper stepper(2, 15, 800);
+    TEST_ASSERT_EQUAL(ESP_OK, stepper.move(800 * 5, &trapezoid));
+    vTaskDelay(500 / portTICK_RATE_MS);
+    TEST_ASSERT_EQUAL(ESP_OK, stepper.move(-800 * 5, &scurve));
+    vTaskDelay(500 / portTICK_RATE_MS);
+    TEST_ASSERT_EQUAL(ESP_OK, stepper.move(100, &scurve));
+    TEST_ASSERT_EQUAL(0, stepper.getSpeedRpm());
+}
+
+TEST_CASE("Stepper axes coordinated move test", "[stepper][a4988][iot]")
+{
+    const int step_io[] = {2, 21};
+    const int dir_io[] = {15, 18};
+    const int32_t square[][2] = {{4000, 0}, {0, 4000}, {-4000, 0}, {0, -4000}};
+    const int32_t arc[][2] = {{800, 100}, {700, 300}, {500, 500}, {300, 700}, {100, 800}};
+
+    CStepperAxes axes(step_io, dir_io, 2, 800, 16000);
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, axes.line(square[i], 6000));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, axes.wait());
+    TEST_ASSERT_EQUAL(0, axes.getPosition(0));
+    TEST_ASSERT_EQUAL(0, axes.getPosition(1));
+
+    // the arc is blended through its corners without stopping
+    for (int i = 0; i < 5; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, axes.line(arc[i], 6000));
+    }
+    TEST_ASSERT_TRUE(axes.isBusy());
+    TEST_ASSERT_EQUAL(ESP_OK, axes.wait());
+    TEST_ASSERT_EQUAL(2400, axes.getPosition(0));
+    TEST_ASSERT_EQUAL(2400, axes.getPosition(1));
+}
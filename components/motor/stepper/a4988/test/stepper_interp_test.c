@@ -0,0 +1,170 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "stepper_interp.h"
+#include "unity.h"
+
+#define INTERP_AXIS_NUM     (3)
+#define INTERP_START_RATE   (200)
+#define INTERP_ACCEL        (8000)
+
+static void stepper_line_make(stepper_line_t* line, int32_t x, int32_t y, int32_t z, uint32_t rate)
+{
+    memset(line, 0, sizeof(stepper_line_t));
+    line->delta[0] = x;
+    line->delta[1] = y;
+    line->delta[2] = z;
+    stepper_line_init(line, INTERP_AXIS_NUM, rate);
+}
+
+/* plan the lines as the driver does when they are queued one by one before the motion starts */
+static void stepper_path_plan(stepper_line_t* lines, int num)
+{
+    stepper_line_t* plan[8];
+    for (int i = 0; i < num; i++) {
+        stepper_line_junction(i > 0 ? &lines[i - 1] : NULL, &lines[i], INTERP_AXIS_NUM, INTERP_START_RATE);
+        plan[i] = &lines[i];
+    }
+    stepper_lookahead(plan, num, INTERP_START_RATE, INTERP_START_RATE, INTERP_ACCEL);
+}
+
+TEST_CASE("Stepper bresenham test", "[stepper][iot]")
+{
+    stepper_line_t line;
+    stepper_bres_t bres;
+    uint32_t cnt[INTERP_AXIS_NUM] = {0};
+    stepper_line_make(&line, 300, -120, 7, 1000);
+    TEST_ASSERT_EQUAL_UINT32(300, line.steps);
+    stepper_bres_init(&bres, &line, INTERP_AXIS_NUM);
+    for (int k = 1; k <= 300; k++) {
+        uint32_t mask = stepper_bres_step(&bres);
+        TEST_ASSERT_TRUE(mask & 1);
+        for (int i = 0; i < INTERP_AXIS_NUM; i++) {
+            if (mask & (1 << i)) {
+                cnt[i]++;
+            }
+            /* every axis stays within one step of the straight line */
+            int32_t ideal = abs(line.delta[i]) * k / 300;
+            TEST_ASSERT_INT_WITHIN(1, ideal, cnt[i]);
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, stepper_bres_step(&bres));
+    TEST_ASSERT_EQUAL_UINT32(300, cnt[0]);
+    TEST_ASSERT_EQUAL_UINT32(120, cnt[1]);
+    TEST_ASSERT_EQUAL_UINT32(7, cnt[2]);
+    TEST_ASSERT_EQUAL_UINT32(3, stepper_isqrt(15));
+    TEST_ASSERT_EQUAL_UINT32(4000000000UL, stepper_isqrt(16000000000000000000ULL));
+}
+
+TEST_CASE("Stepper look-ahead test", "[stepper][iot]")
+{
+    stepper_line_t lines[4];
+    /* collinear lines are blended at full rate, the last one stops */
+    for (int i = 0; i < 4; i++) {
+        stepper_line_make(&lines[i], 2000, 1000, 0, 3000);
+    }
+    stepper_path_plan(lines, 4);
+    TEST_ASSERT_EQUAL_UINT32(INTERP_START_RATE, lines[0].entry_rate);
+    TEST_ASSERT_EQUAL_UINT32(3000, lines[1].entry_rate);
+    TEST_ASSERT_EQUAL_UINT32(3000, lines[3].entry_rate);
+    TEST_ASSERT_EQUAL_UINT32(INTERP_START_RATE, lines[3].exit_rate);
+
+    /* a right angle and a reversal stop at the corner, a 45 degree corner slows down */
+    stepper_line_make(&lines[0], 2000, 0, 0, 3000);
+    stepper_line_make(&lines[1], 0, 2000, 0, 3000);
+    stepper_line_make(&lines[2], 0, -2000, 0, 3000);
+    stepper_line_make(&lines[3], 0, -2000, -2000, 3000);
+    stepper_path_plan(lines, 4);
+    TEST_ASSERT_EQUAL_UINT32(INTERP_START_RATE, lines[1].entry_rate);
+    TEST_ASSERT_EQUAL_UINT32(INTERP_START_RATE, lines[2].entry_rate);
+    TEST_ASSERT_INT_WITHIN(2, INTERP_START_RATE + (3000 - INTERP_START_RATE) * 0.7071f, lines[3].entry_rate);
+
+    /* short lines can not reach the nominal rate, every corner must stay reachable from both sides */
+    for (int i = 0; i < 4; i++) {
+        stepper_line_make(&lines[i], 100, 0, 10 * i, 6000);
+    }
+    stepper_path_plan(lines, 4);
+    for (int i = 0; i < 4; i++) {
+        uint64_t entry2 = (uint64_t) lines[i].entry_rate * lines[i].entry_rate;
+        uint64_t exit2 = (uint64_t) lines[i].exit_rate * lines[i].exit_rate;
+        uint64_t ramp = 2ULL * INTERP_ACCEL * lines[i].steps;
+        TEST_ASSERT_TRUE(exit2 <= entry2 + ramp + 2 * lines[i].exit_rate);
+        TEST_ASSERT_TRUE(entry2 <= exit2 + ramp + 2 * lines[i].entry_rate);
+        if (i > 0) {
+            TEST_ASSERT_EQUAL_UINT32(lines[i - 1].exit_rate, lines[i].entry_rate);
+        }
+    }
+}
+
+TEST_CASE("Stepper line rate test", "[stepper][iot]")
+{
+    stepper_line_t lines[3];
+    stepper_line_make(&lines[0], 3000, 0, 0, 4000);
+    stepper_line_make(&lines[1], 3000, 300, 0, 2500);
+    stepper_line_make(&lines[2], 800, 100, 0, 4000);
+    stepper_path_plan(lines, 3);
+
+    /* walk the steps with the timing the driver uses, the rate must follow the acceleration limit */
+    uint32_t last_rate = INTERP_START_RATE;
+    uint32_t peak = 0;
+    double t = 0;
+    for (int n = 0; n < 3; n++) {
+        for (uint32_t k = 1; k <= lines[n].steps; k++) {
+            uint32_t rate = stepper_line_rate(&lines[n], k, INTERP_ACCEL);
+            double dt = 1.0 / last_rate;
+            /* v^2 changes by 2a per step, allow one step/s of rounding in the integer rate */
+            int64_t dv2 = (int64_t) rate * rate - (int64_t) last_rate * last_rate;
+            int64_t round = 2 * (rate > last_rate ? rate : last_rate);
+            TEST_ASSERT_TRUE(dv2 <= 2 * INTERP_ACCEL + round);
+            TEST_ASSERT_TRUE(dv2 >= -2 * INTERP_ACCEL - round);
+            TEST_ASSERT_TRUE(rate <= lines[n].nominal_rate);
+            if (rate > peak) {
+                peak = rate;
+            }
+            t += dt;
+            last_rate = rate;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(4000, peak);
+    TEST_ASSERT_INT_WITHIN(1, INTERP_START_RATE, last_rate);
+    /* the 6 degree corner into the second line only takes off a little of its nominal rate */
+    TEST_ASSERT_INT_WITHIN(20, 2500, lines[1].entry_rate);
+    printf("path time: %d ms\n", (int)(t * 1000));
+}
+
+TEST_CASE("Stepper running line re-plan test", "[stepper][iot]")
+{
+    stepper_line_t lines[2];
+    stepper_line_t* plan[2] = {&lines[0], &lines[1]};
+    stepper_line_make(&lines[0], 4000, 0, 0, 3000);
+    stepper_lookahead(plan, 1, INTERP_START_RATE, INTERP_START_RATE, INTERP_ACCEL);
+    TEST_ASSERT_EQUAL_UINT32(INTERP_START_RATE, lines[0].exit_rate);
+
+    /* a collinear line is queued while the first one cruises, the first one keeps its rate and no longer stops */
+    uint32_t step_idx = 1500;
+    uint32_t rate = stepper_line_rate(&lines[0], step_idx, INTERP_ACCEL);
+    TEST_ASSERT_EQUAL_UINT32(3000, rate);
+    stepper_line_make(&lines[1], 4000, 0, 0, 3000);
+    stepper_line_junction(&lines[0], &lines[1], INTERP_AXIS_NUM, INTERP_START_RATE);
+    stepper_lookahead(plan, 2, lines[0].entry_rate, INTERP_START_RATE, INTERP_ACCEL);
+    TEST_ASSERT_EQUAL_UINT32(INTERP_START_RATE, lines[0].entry_rate);
+    TEST_ASSERT_EQUAL_UINT32(3000, lines[0].exit_rate);
+    TEST_ASSERT_EQUAL_UINT32(3000, lines[1].entry_rate);
+    for (uint32_t k = step_idx; k <= lines[0].steps; k++) {
+        TEST_ASSERT_EQUAL_UINT32(3000, stepper_line_rate(&lines[0], k, INTERP_ACCEL));
+    }
+    TEST_ASSERT_EQUAL_UINT32(INTERP_START_RATE, lines[1].exit_rate);
+}
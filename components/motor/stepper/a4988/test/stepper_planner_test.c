@@ -0,0 +1,145 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "stepper_planner.h"
+#include "unity.h"
+
+/* limits are checked on the mean rate of each segment, allow for the sampling error */
+#define SIM_LIMIT_TOL(val)      ((val) * 11 / 10)
+
+typedef struct {
+    uint32_t pos;
+    uint32_t peak;
+    double max_accel;
+    double max_jerk;
+    double time_s;
+} sim_result_t;
+
+/* integrate the segment table: position, and acceleration and jerk between neighbour segments */
+static void stepper_sim_run(const stepper_plan_t* plan, sim_result_t* res)
+{
+    double last_rate = 0, last_mid = 0, last_accel = 0, last_accel_t = 0;
+    memset(res, 0, sizeof(sim_result_t));
+    for (int i = 0; i < plan->seg_num; i++) {
+        const stepper_seg_t* seg = &plan->seg[i];
+        double dt = (double) seg->steps / seg->rate;
+        double mid = res->time_s + dt / 2;
+        res->pos += seg->steps;
+        res->time_s += dt;
+        if (seg->rate > res->peak) {
+            res->peak = seg->rate;
+        }
+        if (i > 0) {
+            double accel = (seg->rate - last_rate) / (mid - last_mid);
+            double accel_t = (mid + last_mid) / 2;
+            if (fabs(accel) > res->max_accel) {
+                res->max_accel = fabs(accel);
+            }
+            if (i > 1) {
+                double jerk = fabs(accel - last_accel) / (accel_t - last_accel_t);
+                if (jerk > res->max_jerk) {
+                    res->max_jerk = jerk;
+                }
+            }
+            last_accel = accel;
+            last_accel_t = accel_t;
+        }
+        last_rate = seg->rate;
+        last_mid = mid;
+    }
+}
+
+TEST_CASE("Stepper planner trapezoid test", "[stepper][iot]")
+{
+    stepper_plan_cfg_t cfg = {
+        .profile = STEPPER_PROFILE_TRAPEZOID,
+        .start_rate = 200,
+        .max_rate = 4000,
+        .accel = 8000,
+        .jerk = 0,
+    };
+    stepper_plan_t plan;
+    sim_result_t res;
+    const uint32_t moves[] = {1, 2, 3, 77, 1000, 1001, 2400, 50000};
+    for (int i = 0; i < sizeof(moves) / sizeof(moves[0]); i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, stepper_plan_move(&plan, &cfg, moves[i]));
+        stepper_sim_run(&plan, &res);
+        TEST_ASSERT_EQUAL_UINT32(moves[i], res.pos);
+        TEST_ASSERT_EQUAL_UINT32(moves[i], plan.total_steps);
+        TEST_ASSERT_TRUE(res.peak <= cfg.max_rate);
+        TEST_ASSERT_TRUE(res.max_accel <= SIM_LIMIT_TOL(cfg.accel));
+        TEST_ASSERT_EQUAL_UINT32(plan.seg[0].rate, plan.seg[plan.seg_num - 1].rate);
+    }
+    /* long move: (4000 - 200) / 8000 = 0.475s and 997.5 steps per ramp, the ramp is cut to 997 steps */
+    TEST_ASSERT_INT_WITHIN(1, cfg.max_rate, res.peak);
+    TEST_ASSERT_EQUAL_UINT32(997, plan.accel_steps);
+    TEST_ASSERT_INT_WITHIN(20, 950 + (50000 - 997 * 2) / 4, (int)(res.time_s * 1000));
+    TEST_ASSERT_INT_WITHIN(20, 950 + (50000 - 997 * 2) / 4, (int)(stepper_plan_duration_us(&plan) / 1000));
+}
+
+TEST_CASE("Stepper planner s-curve test", "[stepper][iot]")
+{
+    stepper_plan_cfg_t cfg = {
+        .profile = STEPPER_PROFILE_SCURVE,
+        .start_rate = 100,
+        .max_rate = 5000,
+        .accel = 10000,
+        .jerk = 50000,
+    };
+    stepper_plan_t plan;
+    sim_result_t res;
+    const uint32_t moves[] = {1, 10, 333, 2000, 4001, 100000};
+    for (int i = 0; i < sizeof(moves) / sizeof(moves[0]); i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, stepper_plan_move(&plan, &cfg, moves[i]));
+        stepper_sim_run(&plan, &res);
+        TEST_ASSERT_EQUAL_UINT32(moves[i], res.pos);
+        TEST_ASSERT_TRUE(res.peak <= cfg.max_rate);
+        TEST_ASSERT_TRUE(res.max_accel <= SIM_LIMIT_TOL(cfg.accel));
+        if (moves[i] >= 2000) {
+            TEST_ASSERT_TRUE(res.max_jerk <= SIM_LIMIT_TOL(cfg.jerk));
+        }
+    }
+    /* long move: ramp takes 0.2 + 0.29 + 0.2 = 0.69s and 1759.5 steps */
+    TEST_ASSERT_INT_WITHIN(1, cfg.max_rate, res.peak);
+    TEST_ASSERT_EQUAL_UINT32(1759, plan.accel_steps);
+}
+
+TEST_CASE("Stepper planner short move test", "[stepper][iot]")
+{
+    stepper_plan_cfg_t cfg = {
+        .profile = STEPPER_PROFILE_TRAPEZOID,
+        .start_rate = 500,
+        .max_rate = 4000,
+        .accel = 2000,
+        .jerk = 0,
+    };
+    stepper_plan_t plan;
+    sim_result_t res;
+    /* peak of a triangle move: v^2 = v0^2 + a * steps = 250000 + 2000 * 1000 */
+    TEST_ASSERT_EQUAL(ESP_OK, stepper_plan_move(&plan, &cfg, 1000));
+    stepper_sim_run(&plan, &res);
+    TEST_ASSERT_INT_WITHIN(2, 1500, plan.peak_rate);
+    TEST_ASSERT_EQUAL_UINT32(1000, res.pos);
+
+    cfg.start_rate = 0;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, stepper_plan_move(&plan, &cfg, 1000));
+    cfg.start_rate = 500;
+    cfg.profile = STEPPER_PROFILE_SCURVE;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, stepper_plan_move(&plan, &cfg, 1000));
+    cfg.jerk = 10000;
+    TEST_ASSERT_EQUAL(ESP_OK, stepper_plan_move(&plan, &cfg, 0));
+    TEST_ASSERT_EQUAL(0, plan.seg_num);
+}
@@ -11,13 +11,13 @@
 ifndef CONFIG_IOT_SOLUTION_EMBED   
 
 COMPONENT_ADD_INCLUDEDIRS := include espmqtt/lib/include
-COMPONENT_SRCDIRS := espmqtt espmqtt/lib
+COMPONENT_SRCDIRS := espmqtt espmqtt/lib mqtt_pub
 
 else
 
 ifdef CONFIG_IOT_MQTT_ENABLE
 COMPONENT_ADD_INCLUDEDIRS := include espmqtt/lib/include
-COMPONENT_SRCDIRS := espmqtt espmqtt/lib
+COMPONENT_SRCDIRS := espmqtt espmqtt/lib mqtt_pub
 else
 # Disable component
 COMPONENT_ADD_INCLUDEDIRS :=
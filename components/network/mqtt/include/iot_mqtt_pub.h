@@ -0,0 +1,189 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _IOT_MQTT_PUB_H_
+#define _IOT_MQTT_PUB_H_
+
+#include "mqtt_client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CONFIG_IOT_MQTT_PUB_BATCH_INTERVAL
+#define IOT_MQTT_PUB_BATCH_INTERVAL     CONFIG_IOT_MQTT_PUB_BATCH_INTERVAL
+#else
+#define IOT_MQTT_PUB_BATCH_INTERVAL     1000
+#endif
+
+#ifdef CONFIG_IOT_MQTT_PUB_BATCH_SIZE
+#define IOT_MQTT_PUB_BATCH_SIZE         CONFIG_IOT_MQTT_PUB_BATCH_SIZE
+#else
+#define IOT_MQTT_PUB_BATCH_SIZE         512
+#endif
+
+#ifdef CONFIG_IOT_MQTT_PUB_SPOOL_PARTITION
+#define IOT_MQTT_PUB_SPOOL_PARTITION    CONFIG_IOT_MQTT_PUB_SPOOL_PARTITION
+#else
+#define IOT_MQTT_PUB_SPOOL_PARTITION    "mqtt_spool"
+#endif
+
+#ifdef CONFIG_IOT_MQTT_PUB_DRAIN_RATE
+#define IOT_MQTT_PUB_DRAIN_RATE         CONFIG_IOT_MQTT_PUB_DRAIN_RATE
+#else
+#define IOT_MQTT_PUB_DRAIN_RATE         20
+#endif
+
+#define IOT_MQTT_PUB_SPOOL_RAM_SIZE     (8 * 1024)
+#define IOT_MQTT_PUB_DRAIN_BURST        5
+#define IOT_MQTT_PUB_DRAIN_WINDOW       4
+
+/**
+ * @brief flags of iot_mqtt_pub_publish()
+ */
+#define IOT_MQTT_PUB_NO_BATCH           (1 << 0)  /**< publish the message on its own */
+#define IOT_MQTT_PUB_RETAIN             (1 << 1)  /**< publish on its own with the retain flag */
+
+typedef enum {
+    IOT_MQTT_BATCH_DELIMITER = 0,   /**< messages are joined by the delimiter */
+    IOT_MQTT_BATCH_LENGTH,          /**< each message follows its length, 2 bytes big endian */
+} iot_mqtt_batch_format_t;
+
+typedef struct {
+    esp_mqtt_client_handle_t client;
+    uint32_t batch_interval_ms;     /**< longest time a message waits for others of its topic, 0 to not batch */
+    uint16_t batch_size;            /**< largest payload of a batch */
+    iot_mqtt_batch_format_t batch_format;
+    char batch_delimiter;
+    const char *spool_partition;    /**< label of the data partition for the spool, NULL to keep it in RAM */
+    uint32_t spool_ram_size;        /**< spool size in RAM, also used when the partition is not found */
+    uint16_t drain_rate;            /**< spooled payloads published per second once connected */
+    uint16_t drain_burst;
+    uint8_t drain_window;           /**< spooled QoS 1/2 payloads waiting for the broker */
+} iot_mqtt_pub_config_t;
+
+#define IOT_MQTT_PUB_CONFIG_DEFAULT(c) { \
+    .client = (c), \
+    .batch_interval_ms = IOT_MQTT_PUB_BATCH_INTERVAL, \
+    .batch_size = IOT_MQTT_PUB_BATCH_SIZE, \
+    .batch_format = IOT_MQTT_BATCH_DELIMITER, \
+    .batch_delimiter = '\n', \
+    .spool_partition = IOT_MQTT_PUB_SPOOL_PARTITION, \
+    .spool_ram_size = IOT_MQTT_PUB_SPOOL_RAM_SIZE, \
+    .drain_rate = IOT_MQTT_PUB_DRAIN_RATE, \
+    .drain_burst = IOT_MQTT_PUB_DRAIN_BURST, \
+    .drain_window = IOT_MQTT_PUB_DRAIN_WINDOW, \
+}
+
+typedef struct {
+    uint32_t msg_in;            /**< messages given to iot_mqtt_pub_publish() */
+    uint32_t batches;           /**< payloads made of the messages */
+    uint32_t pub_live;          /**< payloads published as they were made */
+    uint32_t pub_spool;         /**< payloads published from the spool */
+    uint32_t spooled;           /**< payloads written to the spool */
+    uint32_t spool_pending;     /**< payloads in the spool not acknowledged yet */
+    uint32_t dropped;           /**< payloads lost, the spool was full or could not take them */
+    uint32_t corrupt;           /**< spooled payloads that failed their crc */
+} iot_mqtt_pub_stat_t;
+
+typedef struct iot_mqtt_pub *iot_mqtt_pub_handle_t;
+
+/**
+ * @brief  create a publisher on top of an MQTT client.
+ *
+ * @attention 1. Messages of one topic are put into one payload and published when the
+ *               first of them has waited batch_interval_ms, or when the next would not fit.
+ * @attention 2. Payloads that can not be published go to a ring on the spool partition, the
+ *               oldest ones are overwritten when it is full. What is in the spool is published
+ *               first after a reconnect, at drain_rate, and survives a restart.
+ * @attention 3. Create it before esp_mqtt_client_start() and pass the events of the client to
+ *               iot_mqtt_pub_event().
+ *
+ * @param  config configuration, see IOT_MQTT_PUB_CONFIG_DEFAULT()
+ *
+ * @return
+ *     - the handle
+ *     - NULL: invalid argument or no memory
+ */
+iot_mqtt_pub_handle_t iot_mqtt_pub_create(const iot_mqtt_pub_config_t *config);
+
+/**
+ * @brief  publish the waiting batches (or spool them) and delete the publisher.
+ *
+ * @param  handle publisher
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t iot_mqtt_pub_delete(iot_mqtt_pub_handle_t handle);
+
+/**
+ * @brief  pass an event of the MQTT client, call it from the event handler.
+ *
+ * @param  handle publisher
+ * @param  event  event of the client, events the publisher does not use are ignored
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t iot_mqtt_pub_event(iot_mqtt_pub_handle_t handle, esp_mqtt_event_handle_t event);
+
+/**
+ * @brief  publish a message, it is copied.
+ *
+ * @param  handle publisher
+ * @param  topic  topic
+ * @param  data   message
+ * @param  len    message length
+ * @param  qos    QoS of the message, a batch is published with the highest QoS of its messages
+ * @param  flags  IOT_MQTT_PUB_NO_BATCH, IOT_MQTT_PUB_RETAIN or 0
+ *
+ * @return
+ *     - ESP_OK: the message is in a batch, published or spooled
+ *     - ESP_ERR_INVALID_ARG
+ *     - ESP_ERR_INVALID_SIZE: too large for the spool while it can not be published
+ *     - ESP_ERR_NO_MEM
+ */
+esp_err_t iot_mqtt_pub_publish(iot_mqtt_pub_handle_t handle, const char *topic, const void *data, size_t len,
+                               int qos, uint32_t flags);
+
+/**
+ * @brief  publish the waiting batches now.
+ *
+ * @param  handle publisher
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t iot_mqtt_pub_flush(iot_mqtt_pub_handle_t handle);
+
+/**
+ * @brief  get the statistics of the publisher.
+ *
+ * @param  handle publisher
+ * @param  stat   statistics
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t iot_mqtt_pub_get_stat(iot_mqtt_pub_handle_t handle, iot_mqtt_pub_stat_t *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,589 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "iot_mqtt_pub.h"
+#include "mqtt_spool.h"
+
+static const char* TAG = "iot_mqtt_pub";
+
+#ifdef CONFIG_IOT_MQTT_PUB_TOPIC_NUM
+#define MQTT_PUB_TOPIC_NUM          CONFIG_IOT_MQTT_PUB_TOPIC_NUM
+#else
+#define MQTT_PUB_TOPIC_NUM          8
+#endif
+
+#define MQTT_PUB_TASK_STACK         3072
+#define MQTT_PUB_TASK_PRIO          5
+#define MQTT_PUB_EVENT_NUM          16
+#ifndef MQTT_PUB_ACK_TIMEOUT_MS
+#define MQTT_PUB_ACK_TIMEOUT_MS     (MQTT_NETWORK_TIMEOUT_MS * 2)  /**< the host test sets a shorter one */
+#endif
+#define MQTT_PUB_SPOOL_RETAIN       0x80    /**< in the flags of a spool record, the QoS is below */
+
+typedef enum {
+    MQTT_PUB_CONNECTED = 0,
+    MQTT_PUB_DISCONNECTED,
+    MQTT_PUB_PUBLISHED,
+    MQTT_PUB_WAKE,          /**< a batch was started or a payload spooled */
+    MQTT_PUB_STOP,
+} mqtt_pub_event_type_t;
+
+typedef struct {
+    mqtt_pub_event_type_t type;
+    int msg_id;
+} mqtt_pub_event_t;
+
+typedef struct {
+    char *topic;            /**< NULL for a free slot */
+    uint8_t *buf;
+    uint16_t len;
+    uint16_t count;
+    uint8_t qos;
+    TickType_t first_tick;
+} mqtt_pub_batch_t;
+
+typedef struct {
+    int msg_id;
+    mqtt_spool_pos_t pos;
+} mqtt_pub_inflight_t;
+
+/**
+ * lock guards the batches, the spool and the statistics and is never held
+ * while publishing. tx_lock keeps payloads in order while one is published,
+ * the event handler of the client takes neither and only fills event_q, so
+ * it can not wait for a task that waits for the client.
+ */
+struct iot_mqtt_pub {
+    iot_mqtt_pub_config_t config;
+    SemaphoreHandle_t lock;
+    SemaphoreHandle_t tx_lock;
+    xQueueHandle event_q;
+    SemaphoreHandle_t exit_sem;
+    mqtt_spool_t *spool;
+    mqtt_pub_batch_t batch[MQTT_PUB_TOPIC_NUM];
+    uint8_t *tx_buf;                /**< payload being published */
+    size_t tx_buf_size;
+    char tx_topic[256];
+    bool connected;                 /**< written by the task under lock, so the task reads it without */
+    bool wake_pending;
+    uint32_t tokens;                /**< drain budget in 1/1000 payloads */
+    TickType_t token_tick;
+    mqtt_pub_inflight_t *inflight;
+    uint8_t inflight_num;
+    TickType_t inflight_tick;
+    iot_mqtt_pub_stat_t stat;
+};
+
+static void mqtt_pub_wake(iot_mqtt_pub_handle_t p)
+{
+    /**< one wake up in the queue at a time, so acknowledgements still find room */
+    xSemaphoreTake(p->lock, portMAX_DELAY);
+    bool send = !p->wake_pending;
+    p->wake_pending = true;
+    xSemaphoreGive(p->lock);
+    if (send) {
+        mqtt_pub_event_t ev = { .type = MQTT_PUB_WAKE };
+        xQueueSend(p->event_q, &ev, 0);
+    }
+}
+
+/**< called with tx_lock held */
+static esp_err_t mqtt_pub_deliver(iot_mqtt_pub_handle_t p, const char *topic, const void *data, size_t len,
+                                  int qos, bool retain)
+{
+    xSemaphoreTake(p->lock, portMAX_DELAY);
+    mqtt_spool_stat_t spool_stat;
+    mqtt_spool_get_stat(p->spool, &spool_stat);
+    bool connected = p->connected;
+    xSemaphoreGive(p->lock);
+
+    /**< nothing goes live while older payloads wait in the spool */
+    if (connected && spool_stat.count == 0) {
+        if (esp_mqtt_client_publish(p->config.client, topic, (const char *) data, len, qos, retain) >= 0) {
+            xSemaphoreTake(p->lock, portMAX_DELAY);
+            p->stat.pub_live++;
+            xSemaphoreGive(p->lock);
+            return ESP_OK;
+        }
+        ESP_LOGD(TAG, "publish to %s fail, spool it", topic);
+    }
+
+    xSemaphoreTake(p->lock, portMAX_DELAY);
+    esp_err_t ret = mqtt_spool_append(p->spool, topic, data, len, qos | (retain ? MQTT_PUB_SPOOL_RETAIN : 0));
+    if (ret == ESP_OK) {
+        p->stat.spooled++;
+    } else {
+        p->stat.dropped++;
+    }
+    xSemaphoreGive(p->lock);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "spool %d bytes to %s fail: %d", len, topic, ret);
+    } else if (connected) {
+        mqtt_pub_wake(p);
+    }
+    return ret;
+}
+
+/**< called with tx_lock held */
+static void mqtt_pub_flush_batch(iot_mqtt_pub_handle_t p, mqtt_pub_batch_t *b, bool expired_only)
+{
+    xSemaphoreTake(p->lock, portMAX_DELAY);
+    if (b->count == 0 || (expired_only
+                          && xTaskGetTickCount() - b->first_tick < pdMS_TO_TICKS(p->config.batch_interval_ms))) {
+        xSemaphoreGive(p->lock);
+        return;
+    }
+    size_t len = b->len;
+    int qos = b->qos;
+    memcpy(p->tx_buf, b->buf, len);
+    strcpy(p->tx_topic, b->topic);
+    b->len = 0;
+    b->count = 0;
+    b->qos = 0;
+    p->stat.batches++;
+    xSemaphoreGive(p->lock);
+
+    mqtt_pub_deliver(p, p->tx_topic, p->tx_buf, len, qos, false);
+}
+
+static void mqtt_pub_flush_all(iot_mqtt_pub_handle_t p, bool expired_only)
+{
+    for (int i = 0; i < MQTT_PUB_TOPIC_NUM; i++) {
+        mqtt_pub_flush_batch(p, &p->batch[i], expired_only);
+    }
+}
+
+/**< called with tx_lock held */
+static void mqtt_pub_drain(iot_mqtt_pub_handle_t p)
+{
+    TickType_t now = xTaskGetTickCount();
+    uint32_t burst = p->config.drain_burst * 1000;
+    uint32_t ms = (now - p->token_tick) * portTICK_PERIOD_MS;
+    p->tokens += (ms < 60000 ? ms : 60000) * p->config.drain_rate;
+    p->token_tick = now;
+    if (p->tokens > burst) {
+        p->tokens = burst;
+    }
+
+    while (p->connected && p->tokens >= 1000 && p->inflight_num < p->config.drain_window) {
+        mqtt_spool_rec_t rec;
+        xSemaphoreTake(p->lock, portMAX_DELAY);
+        esp_err_t ret = mqtt_spool_read(p->spool, &rec, p->tx_topic, p->tx_buf, p->tx_buf_size);
+        xSemaphoreGive(p->lock);
+        if (ret != ESP_OK) {
+            break;
+        }
+
+        int qos = rec.flags & ~MQTT_PUB_SPOOL_RETAIN;
+        int msg_id = esp_mqtt_client_publish(p->config.client, p->tx_topic, (const char *) p->tx_buf, rec.data_len,
+                                             qos, !!(rec.flags & MQTT_PUB_SPOOL_RETAIN));
+        if (msg_id < 0) {
+            /**< sent again from the oldest payload not acknowledged, after a pause of one token */
+            xSemaphoreTake(p->lock, portMAX_DELAY);
+            mqtt_spool_rewind(p->spool);
+            xSemaphoreGive(p->lock);
+            p->inflight_num = 0;
+            p->tokens = 0;
+            break;
+        }
+        p->tokens -= 1000;
+
+        xSemaphoreTake(p->lock, portMAX_DELAY);
+        p->stat.pub_spool++;
+        if (qos == 0) {
+            mqtt_spool_ack(p->spool, &rec.pos);
+        }
+        xSemaphoreGive(p->lock);
+        if (qos > 0) {
+            if (p->inflight_num == 0) {
+                p->inflight_tick = now;
+            }
+            p->inflight[p->inflight_num].msg_id = msg_id;
+            p->inflight[p->inflight_num].pos = rec.pos;
+            p->inflight_num++;
+        }
+    }
+}
+
+static void mqtt_pub_handle_event(iot_mqtt_pub_handle_t p, const mqtt_pub_event_t *ev)
+{
+    switch (ev->type) {
+    case MQTT_PUB_CONNECTED:
+        xSemaphoreTake(p->lock, portMAX_DELAY);
+        p->connected = true;
+        xSemaphoreGive(p->lock);
+        p->tokens = p->config.drain_burst * 1000;
+        p->token_tick = xTaskGetTickCount();
+        break;
+
+    case MQTT_PUB_DISCONNECTED:
+        p->inflight_num = 0;
+        xSemaphoreTake(p->lock, portMAX_DELAY);
+        p->connected = false;
+        mqtt_spool_rewind(p->spool);
+        xSemaphoreGive(p->lock);
+        break;
+
+    case MQTT_PUB_PUBLISHED:
+        for (int i = 0; i < p->inflight_num; i++) {
+            if (p->inflight[i].msg_id == ev->msg_id) {
+                xSemaphoreTake(p->lock, portMAX_DELAY);
+                mqtt_spool_ack(p->spool, &p->inflight[i].pos);
+                xSemaphoreGive(p->lock);
+                memmove(&p->inflight[i], &p->inflight[i + 1], (p->inflight_num - i - 1) * sizeof(mqtt_pub_inflight_t));
+                p->inflight_num--;
+                p->inflight_tick = xTaskGetTickCount();
+                break;
+            }
+        }
+        break;
+
+    case MQTT_PUB_WAKE:
+        xSemaphoreTake(p->lock, portMAX_DELAY);
+        p->wake_pending = false;
+        xSemaphoreGive(p->lock);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static TickType_t mqtt_pub_next_wait(iot_mqtt_pub_handle_t p)
+{
+    TickType_t now = xTaskGetTickCount();
+    TickType_t interval = pdMS_TO_TICKS(p->config.batch_interval_ms);
+    TickType_t wait = portMAX_DELAY;
+    mqtt_spool_stat_t spool_stat;
+
+    xSemaphoreTake(p->lock, portMAX_DELAY);
+    mqtt_spool_get_stat(p->spool, &spool_stat);
+    for (int i = 0; i < MQTT_PUB_TOPIC_NUM; i++) {
+        if (p->batch[i].count > 0) {
+            TickType_t age = now - p->batch[i].first_tick;
+            TickType_t left = age >= interval ? 0 : interval - age;
+            wait = left < wait ? left : wait;
+        }
+    }
+    xSemaphoreGive(p->lock);
+
+    if (p->connected && p->inflight_num > 0) {
+        TickType_t timeout = pdMS_TO_TICKS(MQTT_PUB_ACK_TIMEOUT_MS);
+        TickType_t age = now - p->inflight_tick;
+        TickType_t left = age >= timeout ? 0 : timeout - age;
+        wait = left < wait ? left : wait;
+    }
+
+    if (p->connected && spool_stat.count > p->inflight_num && p->inflight_num < p->config.drain_window) {
+        uint32_t ms = p->tokens >= 1000 ? 0 : (1000 - p->tokens + p->config.drain_rate - 1) / p->config.drain_rate;
+        TickType_t left = pdMS_TO_TICKS(ms) ? pdMS_TO_TICKS(ms) : (ms ? 1 : 0);
+        wait = left < wait ? left : wait;
+    }
+    return wait;
+}
+
+static void mqtt_pub_task(void *arg)
+{
+    iot_mqtt_pub_handle_t p = (iot_mqtt_pub_handle_t) arg;
+    mqtt_pub_event_t ev;
+
+    for (;;) {
+        if (xQueueReceive(p->event_q, &ev, mqtt_pub_next_wait(p)) == pdTRUE) {
+            if (ev.type == MQTT_PUB_STOP) {
+                break;
+            }
+            mqtt_pub_handle_event(p, &ev);
+            /**< take what else is queued before publishing */
+            while (xQueueReceive(p->event_q, &ev, 0) == pdTRUE && ev.type != MQTT_PUB_STOP) {
+                mqtt_pub_handle_event(p, &ev);
+            }
+            if (ev.type == MQTT_PUB_STOP) {
+                break;
+            }
+        }
+
+        if (p->inflight_num > 0
+                && xTaskGetTickCount() - p->inflight_tick >= pdMS_TO_TICKS(MQTT_PUB_ACK_TIMEOUT_MS)) {
+            ESP_LOGW(TAG, "%d spooled payloads not acknowledged, send them again", p->inflight_num);
+            p->inflight_num = 0;
+            xSemaphoreTake(p->lock, portMAX_DELAY);
+            mqtt_spool_rewind(p->spool);
+            xSemaphoreGive(p->lock);
+        }
+
+        xSemaphoreTake(p->tx_lock, portMAX_DELAY);
+        mqtt_pub_flush_all(p, true);
+        mqtt_pub_drain(p);
+        xSemaphoreGive(p->tx_lock);
+    }
+
+    xSemaphoreGive(p->exit_sem);
+    vTaskDelete(NULL);
+}
+
+static void mqtt_pub_free(iot_mqtt_pub_handle_t p)
+{
+    for (int i = 0; i < MQTT_PUB_TOPIC_NUM; i++) {
+        free(p->batch[i].topic);
+        free(p->batch[i].buf);
+    }
+    mqtt_spool_delete(p->spool);
+    if (p->lock) {
+        vSemaphoreDelete(p->lock);
+    }
+    if (p->tx_lock) {
+        vSemaphoreDelete(p->tx_lock);
+    }
+    if (p->exit_sem) {
+        vSemaphoreDelete(p->exit_sem);
+    }
+    if (p->event_q) {
+        vQueueDelete(p->event_q);
+    }
+    free(p->inflight);
+    free(p->tx_buf);
+    free(p);
+}
+
+iot_mqtt_pub_handle_t iot_mqtt_pub_create(const iot_mqtt_pub_config_t *config)
+{
+    if (!config || !config->client || config->drain_rate == 0 || config->drain_burst == 0
+            || config->drain_window == 0 || (config->batch_interval_ms && config->batch_size < 2)) {
+        ESP_LOGE(TAG, "invalid config");
+        return NULL;
+    }
+    iot_mqtt_pub_handle_t p = calloc(1, sizeof(struct iot_mqtt_pub));
+    if (!p) {
+        return NULL;
+    }
+    p->config = *config;
+
+    const esp_partition_t *part = NULL;
+    if (config->spool_partition) {
+        part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, config->spool_partition);
+        if (!part) {
+            ESP_LOGW(TAG, "no partition %s, spool in RAM", config->spool_partition);
+        }
+    }
+    p->spool = part ? mqtt_spool_create(part, part->size) : mqtt_spool_create(NULL, config->spool_ram_size);
+
+    /**< the largest payload is a spool record, or a batch if that is larger */
+    p->tx_buf_size = mqtt_spool_max_data(p->spool, 0);
+    p->tx_buf_size = config->batch_size > p->tx_buf_size ? config->batch_size : p->tx_buf_size;
+    p->tx_buf = malloc(p->tx_buf_size);
+    p->inflight = calloc(config->drain_window, sizeof(mqtt_pub_inflight_t));
+    p->lock = xSemaphoreCreateMutex();
+    p->tx_lock = xSemaphoreCreateMutex();
+    p->exit_sem = xSemaphoreCreateBinary();
+    p->event_q = xQueueCreate(MQTT_PUB_EVENT_NUM + config->drain_window, sizeof(mqtt_pub_event_t));
+    if (!p->spool || !p->tx_buf || !p->inflight || !p->lock || !p->tx_lock || !p->exit_sem || !p->event_q) {
+        ESP_LOGE(TAG, "no memory");
+        mqtt_pub_free(p);
+        return NULL;
+    }
+
+    if (xTaskCreate(mqtt_pub_task, "mqtt_pub", MQTT_PUB_TASK_STACK, p, MQTT_PUB_TASK_PRIO, NULL) != pdPASS) {
+        mqtt_pub_free(p);
+        return NULL;
+    }
+    return p;
+}
+
+esp_err_t iot_mqtt_pub_delete(iot_mqtt_pub_handle_t handle)
+{
+    if (!handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    mqtt_pub_event_t ev = { .type = MQTT_PUB_STOP };
+    xQueueSend(handle->event_q, &ev, portMAX_DELAY);
+    xSemaphoreTake(handle->exit_sem, portMAX_DELAY);
+
+    xSemaphoreTake(handle->tx_lock, portMAX_DELAY);
+    mqtt_pub_flush_all(handle, false);
+    xSemaphoreGive(handle->tx_lock);
+    mqtt_pub_free(handle);
+    return ESP_OK;
+}
+
+esp_err_t iot_mqtt_pub_event(iot_mqtt_pub_handle_t handle, esp_mqtt_event_handle_t event)
+{
+    if (!handle || !event) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    mqtt_pub_event_t ev = { .msg_id = event->msg_id };
+    switch (event->event_id) {
+    case MQTT_EVENT_CONNECTED:
+        ev.type = MQTT_PUB_CONNECTED;
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+        ev.type = MQTT_PUB_DISCONNECTED;
+        break;
+    case MQTT_EVENT_PUBLISHED:
+        ev.type = MQTT_PUB_PUBLISHED;
+        break;
+    default:
+        return ESP_OK;
+    }
+    if (xQueueSend(handle->event_q, &ev, 0) != pdTRUE) {
+        /**< a lost acknowledgement times out, the payload is sent again */
+        ESP_LOGW(TAG, "event %d dropped", event->event_id);
+    }
+    return ESP_OK;
+}
+
+static inline size_t mqtt_pub_msg_size(iot_mqtt_pub_handle_t p, const mqtt_pub_batch_t *b, size_t len)
+{
+    if (p->config.batch_format == IOT_MQTT_BATCH_LENGTH) {
+        return len + 2;
+    }
+    return b->count > 0 ? len + 1 : len;
+}
+
+static void mqtt_pub_append(iot_mqtt_pub_handle_t p, mqtt_pub_batch_t *b, const void *data, size_t len, int qos)
+{
+    uint8_t *dst = b->buf + b->len;
+    if (p->config.batch_format == IOT_MQTT_BATCH_LENGTH) {
+        *dst++ = len >> 8;
+        *dst++ = len & 0xff;
+    } else if (b->count > 0) {
+        *dst++ = p->config.batch_delimiter;
+    }
+    memcpy(dst, data, len);
+    b->len = dst + len - b->buf;
+    if (b->count++ == 0) {
+        b->first_tick = xTaskGetTickCount();
+    }
+    b->qos = qos > b->qos ? qos : b->qos;
+}
+
+/**
+ * @return the batch of the topic, a free one if there is none yet, NULL if all are taken
+ */
+static mqtt_pub_batch_t *mqtt_pub_find_batch(iot_mqtt_pub_handle_t p, const char *topic)
+{
+    mqtt_pub_batch_t *free_batch = NULL;
+    for (int i = 0; i < MQTT_PUB_TOPIC_NUM; i++) {
+        if (!p->batch[i].topic) {
+            free_batch = free_batch ? free_batch : &p->batch[i];
+        } else if (!strcmp(p->batch[i].topic, topic)) {
+            return &p->batch[i];
+        }
+    }
+    if (free_batch) {
+        free_batch->topic = strdup(topic);
+        free_batch->buf = malloc(p->config.batch_size);
+        if (!free_batch->topic || !free_batch->buf) {
+            free(free_batch->topic);
+            free(free_batch->buf);
+            free_batch->topic = NULL;
+            free_batch->buf = NULL;
+            return NULL;
+        }
+    }
+    return free_batch;
+}
+
+esp_err_t iot_mqtt_pub_publish(iot_mqtt_pub_handle_t handle, const char *topic, const void *data, size_t len,
+                               int qos, uint32_t flags)
+{
+    if (!handle || !topic || (!data && len) || qos < 0 || qos > 2) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    iot_mqtt_pub_handle_t p = handle;
+    esp_err_t ret;
+
+    xSemaphoreTake(p->lock, portMAX_DELAY);
+    p->stat.msg_in++;
+    mqtt_pub_batch_t *b = NULL;
+    if (p->config.batch_interval_ms && !flags && len + 2 <= p->config.batch_size && strlen(topic) < sizeof(p->tx_topic)) {
+        b = mqtt_pub_find_batch(p, topic);
+    }
+    if (b && b->len + mqtt_pub_msg_size(p, b, len) <= p->config.batch_size) {
+        bool first = (b->count == 0);
+        mqtt_pub_append(p, b, data, len, qos);
+        xSemaphoreGive(p->lock);
+        if (first) {
+            mqtt_pub_wake(p);
+        }
+        return ESP_OK;
+    }
+    xSemaphoreGive(p->lock);
+
+    xSemaphoreTake(p->tx_lock, portMAX_DELAY);
+    if (b) {
+        /**< full, the batch goes out and the message starts the next one. Other tasks
+             can only add to it meanwhile, so it is flushed again until the message fits */
+        for (;;) {
+            mqtt_pub_flush_batch(p, b, false);
+            xSemaphoreTake(p->lock, portMAX_DELAY);
+            if (b->len + mqtt_pub_msg_size(p, b, len) <= p->config.batch_size) {
+                mqtt_pub_append(p, b, data, len, qos);
+                xSemaphoreGive(p->lock);
+                mqtt_pub_wake(p);
+                break;
+            }
+            xSemaphoreGive(p->lock);
+        }
+        ret = ESP_OK;
+    } else {
+        mqtt_pub_batch_t *own = NULL;
+        for (int i = 0; i < MQTT_PUB_TOPIC_NUM && !own; i++) {
+            own = (p->batch[i].topic && !strcmp(p->batch[i].topic, topic)) ? &p->batch[i] : NULL;
+        }
+        if (own) {
+            /**< keep the order of the topic */
+            mqtt_pub_flush_batch(p, own, false);
+        }
+        xSemaphoreTake(p->lock, portMAX_DELAY);
+        p->stat.batches++;
+        xSemaphoreGive(p->lock);
+        ret = mqtt_pub_deliver(p, topic, data, len, qos, flags & IOT_MQTT_PUB_RETAIN);
+    }
+    xSemaphoreGive(p->tx_lock);
+    return ret;
+}
+
+esp_err_t iot_mqtt_pub_flush(iot_mqtt_pub_handle_t handle)
+{
+    if (!handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(handle->tx_lock, portMAX_DELAY);
+    mqtt_pub_flush_all(handle, false);
+    xSemaphoreGive(handle->tx_lock);
+    return ESP_OK;
+}
+
+esp_err_t iot_mqtt_pub_get_stat(iot_mqtt_pub_handle_t handle, iot_mqtt_pub_stat_t *stat)
+{
+    if (!handle || !stat) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    mqtt_spool_stat_t spool_stat;
+    xSemaphoreTake(handle->lock, portMAX_DELAY);
+    mqtt_spool_get_stat(handle->spool, &spool_stat);
+    *stat = handle->stat;
+    xSemaphoreGive(handle->lock);
+    stat->spool_pending = spool_stat.count;
+    stat->dropped += spool_stat.dropped;
+    stat->corrupt = spool_stat.corrupt;
+    return ESP_OK;
+}
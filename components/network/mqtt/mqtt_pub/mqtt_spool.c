@@ -0,0 +1,437 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "rom/crc.h"
+#include "mqtt_spool.h"
+
+static const char* TAG = "mqtt_spool";
+
+/**
+ * The spool is a ring of sectors written as a log. Every sector starts with
+ * a header carrying a sequence number, records follow it and never cross a
+ * sector. A record is sent by clearing its state word, which flash allows
+ * without an erase, so nothing but the records themselves is written and a
+ * reset loses at most the record being written. When the ring is full the
+ * oldest sector is erased together with whatever was still in it.
+ */
+#define SPOOL_MAGIC                 0x5053514d  /**< "MQSP" */
+#define SPOOL_REC_PENDING           0xffffffff
+#define SPOOL_REC_SENT              0x00000000
+#define SPOOL_ALIGN(x)              (((x) + 3) & ~3)
+#define SPOOL_TOPIC_MAX             255
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+} spool_sector_hdr_t;
+
+typedef struct {
+    uint32_t state;
+    uint16_t data_len;
+    uint8_t topic_len;
+    uint8_t flags;
+    uint32_t crc;       /**< of data_len to flags, the topic and the data */
+} spool_rec_hdr_t;
+
+#define SPOOL_SECTOR_HDR            sizeof(spool_sector_hdr_t)
+#define SPOOL_REC_HDR               sizeof(spool_rec_hdr_t)
+
+struct mqtt_spool {
+    const esp_partition_t *part;
+    uint8_t *ram;
+    uint32_t sector_num;
+    uint32_t *sector_seq;       /**< 0 for a sector that is not in use */
+    uint32_t head;              /**< sector being written */
+    uint32_t head_off;
+    uint32_t tail;              /**< oldest record not sent */
+    uint32_t tail_off;
+    uint32_t rd;                /**< next record to read */
+    uint32_t rd_off;
+    mqtt_spool_stat_t stat;
+};
+
+static esp_err_t spool_flash_read(mqtt_spool_t *sp, uint32_t sec, uint32_t off, void *buf, size_t len)
+{
+    size_t addr = sec * MQTT_SPOOL_SECTOR_SIZE + off;
+    if (!sp->part) {
+        memcpy(buf, sp->ram + addr, len);
+        return ESP_OK;
+    }
+    return esp_partition_read(sp->part, addr, buf, len);
+}
+
+static esp_err_t spool_flash_write(mqtt_spool_t *sp, uint32_t sec, uint32_t off, const void *buf, size_t len)
+{
+    size_t addr = sec * MQTT_SPOOL_SECTOR_SIZE + off;
+    if (!sp->part) {
+        /**< like flash, a write only clears bits */
+        for (size_t i = 0; i < len; i++) {
+            sp->ram[addr + i] &= ((const uint8_t *) buf)[i];
+        }
+        return ESP_OK;
+    }
+    return esp_partition_write(sp->part, addr, buf, len);
+}
+
+static esp_err_t spool_flash_erase(mqtt_spool_t *sp, uint32_t sec)
+{
+    sp->stat.erases++;
+    if (!sp->part) {
+        memset(sp->ram + sec * MQTT_SPOOL_SECTOR_SIZE, 0xff, MQTT_SPOOL_SECTOR_SIZE);
+        return ESP_OK;
+    }
+    return esp_partition_erase_range(sp->part, sec * MQTT_SPOOL_SECTOR_SIZE, MQTT_SPOOL_SECTOR_SIZE);
+}
+
+static inline uint32_t spool_rec_size(const spool_rec_hdr_t *hdr)
+{
+    return SPOOL_ALIGN(SPOOL_REC_HDR + hdr->topic_len + hdr->data_len);
+}
+
+/**
+ * @return ESP_ERR_NOT_FOUND at the end of the records of the sector,
+ *         ESP_ERR_INVALID_SIZE for a header that can not be right
+ */
+static esp_err_t spool_load(mqtt_spool_t *sp, uint32_t sec, uint32_t off, spool_rec_hdr_t *hdr)
+{
+    if (off + SPOOL_REC_HDR > MQTT_SPOOL_SECTOR_SIZE) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (spool_flash_read(sp, sec, off, hdr, SPOOL_REC_HDR) != ESP_OK) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (hdr->data_len == 0xffff && hdr->topic_len == 0xff && hdr->flags == 0xff && hdr->crc == 0xffffffff) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (off + spool_rec_size(hdr) > MQTT_SPOOL_SECTOR_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief step to the first record of the next sector, false past the head
+ */
+static bool spool_next_sector(mqtt_spool_t *sp, uint32_t *sec, uint32_t *off)
+{
+    if (*sec == sp->head) {
+        return false;
+    }
+    *sec = (*sec + 1) % sp->sector_num;
+    *off = SPOOL_SECTOR_HDR;
+    return true;
+}
+
+static void spool_set_sent(mqtt_spool_t *sp, uint32_t sec, uint32_t off)
+{
+    uint32_t state = SPOOL_REC_SENT;
+    if (spool_flash_write(sp, sec, off, &state, sizeof(state)) != ESP_OK) {
+        ESP_LOGW(TAG, "mark record %u:%u fail", sp->sector_seq[sec], off);
+    }
+}
+
+static void spool_advance_tail(mqtt_spool_t *sp)
+{
+    spool_rec_hdr_t hdr;
+    for (;;) {
+        if (spool_load(sp, sp->tail, sp->tail_off, &hdr) != ESP_OK) {
+            if (!spool_next_sector(sp, &sp->tail, &sp->tail_off)) {
+                break;
+            }
+            continue;
+        }
+        if (hdr.state == SPOOL_REC_PENDING) {
+            break;
+        }
+        sp->tail_off += spool_rec_size(&hdr);
+    }
+}
+
+static uint32_t spool_count_pending(mqtt_spool_t *sp, uint32_t sec, uint32_t off)
+{
+    spool_rec_hdr_t hdr;
+    uint32_t count = 0;
+    while (spool_load(sp, sec, off, &hdr) == ESP_OK) {
+        count += (hdr.state == SPOOL_REC_PENDING);
+        off += spool_rec_size(&hdr);
+    }
+    return count;
+}
+
+static esp_err_t spool_open_sector(mqtt_spool_t *sp)
+{
+    uint32_t next = (sp->head + 1) % sp->sector_num;
+    if (next == sp->tail) {
+        uint32_t lost = spool_count_pending(sp, sp->tail, sp->tail_off);
+        ESP_LOGW(TAG, "spool full, %u records dropped", lost);
+        sp->stat.dropped += lost;
+        sp->stat.count -= lost;
+        sp->tail = (next + 1) % sp->sector_num;
+        sp->tail_off = SPOOL_SECTOR_HDR;
+        spool_advance_tail(sp);
+        if (sp->rd == next) {
+            sp->rd = sp->tail;
+            sp->rd_off = sp->tail_off;
+        }
+    }
+    spool_sector_hdr_t shdr = {
+        .magic = SPOOL_MAGIC,
+        .seq = sp->sector_seq[sp->head] + 1,
+    };
+    sp->sector_seq[next] = 0;
+    esp_err_t ret = spool_flash_erase(sp, next);
+    if (ret == ESP_OK) {
+        ret = spool_flash_write(sp, next, 0, &shdr, sizeof(shdr));
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "open sector %u fail: %d", next, ret);
+        return ret;
+    }
+    sp->sector_seq[next] = shdr.seq;
+    sp->head = next;
+    sp->head_off = SPOOL_SECTOR_HDR;
+    return ESP_OK;
+}
+
+static esp_err_t spool_scan(mqtt_spool_t *sp)
+{
+    spool_sector_hdr_t shdr;
+    uint32_t head = 0, max_seq = 0;
+    for (uint32_t i = 0; i < sp->sector_num; i++) {
+        if (spool_flash_read(sp, i, 0, &shdr, sizeof(shdr)) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        sp->sector_seq[i] = (shdr.magic == SPOOL_MAGIC && shdr.seq != 0xffffffff) ? shdr.seq : 0;
+        if (sp->sector_seq[i] > max_seq) {
+            max_seq = sp->sector_seq[i];
+            head = i;
+        }
+    }
+    if (max_seq == 0) {
+        /**< nothing spooled yet, pretend the last sector is full so the first one is opened */
+        sp->head = sp->tail = sp->rd = sp->sector_num - 1;
+        sp->head_off = sp->tail_off = sp->rd_off = MQTT_SPOOL_SECTOR_SIZE;
+        if (spool_open_sector(sp) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        sp->tail = sp->rd = sp->head;
+        sp->tail_off = sp->rd_off = sp->head_off;
+        return ESP_OK;
+    }
+
+    /**< sectors with consecutive sequences before the head are the log, the others are stale */
+    uint32_t first = head;
+    for (uint32_t i = 1; i < sp->sector_num; i++) {
+        uint32_t prev = (first + sp->sector_num - 1) % sp->sector_num;
+        if (sp->sector_seq[prev] == 0 || sp->sector_seq[prev] != sp->sector_seq[first] - 1) {
+            break;
+        }
+        first = prev;
+    }
+    for (uint32_t i = 0, sec = head; i < sp->sector_num; i++) {
+        sec = (sec + 1) % sp->sector_num;
+        if (sec == first) {
+            break;
+        }
+        sp->sector_seq[sec] = 0;
+    }
+
+    sp->head = head;
+    spool_rec_hdr_t hdr;
+    esp_err_t ret;
+    for (sp->head_off = SPOOL_SECTOR_HDR;
+            (ret = spool_load(sp, head, sp->head_off, &hdr)) == ESP_OK;
+            sp->head_off += spool_rec_size(&hdr)) {
+    }
+    if (ret == ESP_ERR_INVALID_SIZE) {
+        /**< a header cut by a reset, nothing more goes to this sector */
+        sp->head_off = MQTT_SPOOL_SECTOR_SIZE;
+    }
+
+    for (uint32_t sec = first;; sec = (sec + 1) % sp->sector_num) {
+        sp->stat.count += spool_count_pending(sp, sec, SPOOL_SECTOR_HDR);
+        if (sec == head) {
+            break;
+        }
+    }
+    sp->tail = first;
+    sp->tail_off = SPOOL_SECTOR_HDR;
+    spool_advance_tail(sp);
+    sp->rd = sp->tail;
+    sp->rd_off = sp->tail_off;
+    ESP_LOGI(TAG, "spool of %u sectors, %u records to send", sp->sector_num, sp->stat.count);
+    return ESP_OK;
+}
+
+mqtt_spool_t *mqtt_spool_create(const esp_partition_t *part, size_t size)
+{
+    uint32_t sector_num = size / MQTT_SPOOL_SECTOR_SIZE;
+    if (sector_num < 2) {
+        ESP_LOGE(TAG, "spool needs two sectors at least");
+        return NULL;
+    }
+    mqtt_spool_t *sp = calloc(1, sizeof(mqtt_spool_t));
+    if (!sp) {
+        return NULL;
+    }
+    sp->part = part;
+    sp->sector_num = sector_num;
+    sp->sector_seq = calloc(sector_num, sizeof(uint32_t));
+    if (!part) {
+        sp->ram = malloc(sector_num * MQTT_SPOOL_SECTOR_SIZE);
+        if (sp->ram) {
+            memset(sp->ram, 0xff, sector_num * MQTT_SPOOL_SECTOR_SIZE);
+        }
+    }
+    if (!sp->sector_seq || (!part && !sp->ram) || spool_scan(sp) != ESP_OK) {
+        mqtt_spool_delete(sp);
+        return NULL;
+    }
+    return sp;
+}
+
+void mqtt_spool_delete(mqtt_spool_t *sp)
+{
+    if (sp) {
+        free(sp->ram);
+        free(sp->sector_seq);
+        free(sp);
+    }
+}
+
+size_t mqtt_spool_max_data(const mqtt_spool_t *sp, size_t topic_len)
+{
+    size_t room = MQTT_SPOOL_SECTOR_SIZE - SPOOL_SECTOR_HDR - SPOOL_REC_HDR;
+    return topic_len > SPOOL_TOPIC_MAX ? 0 : room - topic_len;
+}
+
+esp_err_t mqtt_spool_append(mqtt_spool_t *sp, const char *topic, const void *data, size_t len, uint8_t flags)
+{
+    size_t topic_len = strlen(topic);
+    if (topic_len > SPOOL_TOPIC_MAX || len > mqtt_spool_max_data(sp, topic_len)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    struct {
+        spool_rec_hdr_t hdr;
+        char topic[SPOOL_TOPIC_MAX];
+    } head = {
+        .hdr = {
+            .state = SPOOL_REC_PENDING,
+            .data_len = len,
+            .topic_len = topic_len,
+            .flags = flags,
+        },
+    };
+    memcpy(head.topic, topic, topic_len);
+    head.hdr.crc = crc32_le(0, (const uint8_t *) &head.hdr.data_len, 4);
+    head.hdr.crc = crc32_le(head.hdr.crc, (const uint8_t *) topic, topic_len);
+    head.hdr.crc = crc32_le(head.hdr.crc, data, len);
+
+    esp_err_t ret;
+    if (sp->head_off + spool_rec_size(&head.hdr) > MQTT_SPOOL_SECTOR_SIZE) {
+        if ((ret = spool_open_sector(sp)) != ESP_OK) {
+            return ret;
+        }
+    }
+    uint32_t off = sp->head_off;
+    sp->head_off += spool_rec_size(&head.hdr);
+    ret = spool_flash_write(sp, sp->head, off, &head, SPOOL_REC_HDR + topic_len);
+    if (ret == ESP_OK && len > 0) {
+        ret = spool_flash_write(sp, sp->head, off + SPOOL_REC_HDR + topic_len, data, len);
+    }
+    if (ret != ESP_OK) {
+        /**< the space is skipped, the record fails its crc if any of it was written */
+        ESP_LOGE(TAG, "write record fail: %d", ret);
+        return ret;
+    }
+    sp->stat.count++;
+    sp->stat.written++;
+    return ESP_OK;
+}
+
+esp_err_t mqtt_spool_read(mqtt_spool_t *sp, mqtt_spool_rec_t *rec, char *topic, void *data, size_t data_size)
+{
+    spool_rec_hdr_t hdr;
+    for (;;) {
+        if (spool_load(sp, sp->rd, sp->rd_off, &hdr) != ESP_OK) {
+            if (!spool_next_sector(sp, &sp->rd, &sp->rd_off)) {
+                return ESP_ERR_NOT_FOUND;
+            }
+            continue;
+        }
+        uint32_t off = sp->rd_off;
+        sp->rd_off += spool_rec_size(&hdr);
+        if (hdr.state != SPOOL_REC_PENDING) {
+            continue;
+        }
+
+        uint32_t crc = crc32_le(0, (const uint8_t *) &hdr.data_len, 4);
+        bool ok = hdr.data_len <= data_size
+                  && spool_flash_read(sp, sp->rd, off + SPOOL_REC_HDR, topic, hdr.topic_len) == ESP_OK
+                  && spool_flash_read(sp, sp->rd, off + SPOOL_REC_HDR + hdr.topic_len, data, hdr.data_len) == ESP_OK;
+        if (ok) {
+            crc = crc32_le(crc, (const uint8_t *) topic, hdr.topic_len);
+            crc = crc32_le(crc, data, hdr.data_len);
+        }
+        if (!ok || crc != hdr.crc) {
+            ESP_LOGW(TAG, "record %u:%u is corrupt", sp->sector_seq[sp->rd], off);
+            sp->stat.corrupt++;
+            sp->stat.count--;
+            spool_set_sent(sp, sp->rd, off);
+            if (sp->rd == sp->tail && off == sp->tail_off) {
+                spool_advance_tail(sp);
+            }
+            continue;
+        }
+        topic[hdr.topic_len] = '\0';
+        rec->pos.seq = sp->sector_seq[sp->rd];
+        rec->pos.off = off;
+        rec->data_len = hdr.data_len;
+        rec->flags = hdr.flags;
+        return ESP_OK;
+    }
+}
+
+esp_err_t mqtt_spool_ack(mqtt_spool_t *sp, const mqtt_spool_pos_t *pos)
+{
+    uint32_t behind = sp->sector_seq[sp->head] - pos->seq;
+    if (behind >= sp->sector_num) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint32_t sec = (sp->head + sp->sector_num - behind) % sp->sector_num;
+    spool_rec_hdr_t hdr;
+    if (sp->sector_seq[sec] != pos->seq || spool_load(sp, sec, pos->off, &hdr) != ESP_OK
+            || hdr.state != SPOOL_REC_PENDING) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    spool_set_sent(sp, sec, pos->off);
+    sp->stat.count--;
+    if (sec == sp->tail && pos->off == sp->tail_off) {
+        spool_advance_tail(sp);
+    }
+    return ESP_OK;
+}
+
+void mqtt_spool_rewind(mqtt_spool_t *sp)
+{
+    sp->rd = sp->tail;
+    sp->rd_off = sp->tail_off;
+}
+
+void mqtt_spool_get_stat(const mqtt_spool_t *sp, mqtt_spool_stat_t *stat)
+{
+    *stat = sp->stat;
+}
@@ -0,0 +1,92 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _MQTT_SPOOL_H_
+#define _MQTT_SPOOL_H_
+
+/* Offline spool of iot_mqtt_pub.c, not part of the API. Not thread safe, the caller locks. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#define MQTT_SPOOL_SECTOR_SIZE      4096
+
+typedef struct mqtt_spool mqtt_spool_t;
+
+/**
+ * Where a record is, stays valid after its sector is reused, so a late
+ * acknowledgement can not mark a newer record as sent.
+ */
+typedef struct {
+    uint32_t seq;       /**< sequence of the sector */
+    uint32_t off;
+} mqtt_spool_pos_t;
+
+typedef struct {
+    mqtt_spool_pos_t pos;
+    uint16_t data_len;
+    uint8_t flags;      /**< kept for the caller */
+} mqtt_spool_rec_t;
+
+typedef struct {
+    uint32_t count;     /**< records not sent yet */
+    uint32_t written;
+    uint32_t dropped;   /**< overwritten before they were sent */
+    uint32_t corrupt;   /**< failed their crc, e.g. cut by a reset */
+    uint32_t erases;
+} mqtt_spool_stat_t;
+
+/**
+ * @brief open the spool on a partition, or in RAM if part is NULL.
+ *        Records left on the partition by a previous run are found again.
+ * @param size bytes of the partition (or of RAM) to use, at least two sectors
+ */
+mqtt_spool_t *mqtt_spool_create(const esp_partition_t *part, size_t size);
+void mqtt_spool_delete(mqtt_spool_t *sp);
+
+/**
+ * @brief largest payload that fits one record with a topic of topic_len bytes
+ */
+size_t mqtt_spool_max_data(const mqtt_spool_t *sp, size_t topic_len);
+
+/**
+ * @brief append a record, the oldest sector is given up when the ring is full
+ * @return ESP_ERR_INVALID_SIZE if it does not fit a record
+ */
+esp_err_t mqtt_spool_append(mqtt_spool_t *sp, const char *topic, const void *data, size_t len, uint8_t flags);
+
+/**
+ * @brief read the next record after the read cursor and move the cursor past it,
+ *        records that fail their crc are marked as sent and skipped.
+ * @param topic     nul terminated topic, room for 256 bytes
+ * @param data_size room in data, at least mqtt_spool_max_data(sp, 0)
+ * @return ESP_ERR_NOT_FOUND if the cursor is at the end
+ */
+esp_err_t mqtt_spool_read(mqtt_spool_t *sp, mqtt_spool_rec_t *rec, char *topic, void *data, size_t data_size);
+
+/**
+ * @brief mark a record as sent, ESP_ERR_NOT_FOUND if it is gone already
+ */
+esp_err_t mqtt_spool_ack(mqtt_spool_t *sp, const mqtt_spool_pos_t *pos);
+
+/**
+ * @brief move the read cursor back to the oldest record not acknowledged
+ */
+void mqtt_spool_rewind(mqtt_spool_t *sp);
+
+void mqtt_spool_get_stat(const mqtt_spool_t *sp, mqtt_spool_stat_t *stat);
+
+#endif
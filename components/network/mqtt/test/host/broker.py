@@ -0,0 +1,173 @@
+#!/usr/bin/env python
+#
+# Stand-in MQTT broker for the publisher host test: CONNECT, PUBLISH with QoS 0/1
+# (PUBACK for QoS 1), PINGREQ and DISCONNECT, no subscriptions.
+#
+# Every PUBLISH payload is split at newlines, each message starts with '<id>,' and
+# the ids of a topic are checked for duplicates and order.
+#
+#   broker.py [port]    listen on port (default 18830) and port + 1 for control
+#
+# The control port takes one command per connection and answers one line:
+#   down        close the listener and all clients, the publisher goes offline
+#   up          listen again
+#   noack <n>   do not acknowledge the next n QoS 1 messages
+#   reset       clear the counters
+#   stats       counters as JSON
+import json
+import selectors
+import socket
+import sys
+
+PORT = int(sys.argv[1]) if len(sys.argv) > 1 else 18830
+
+sel = selectors.DefaultSelector()
+clients = {}
+listener = None
+state = {}
+
+
+def reset():
+    state.update(packets=0, msgs=0, bytes=0, dups=0, order_err=0, noack=0, topics={})
+
+
+def listen():
+    global listener
+    listener = socket.socket()
+    listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    listener.bind(("127.0.0.1", PORT))
+    listener.listen(8)
+    listener.setblocking(False)
+    sel.register(listener, selectors.EVENT_READ, "listen")
+
+
+def close_client(c):
+    sel.unregister(c)
+    c.close()
+    clients.pop(c, None)
+
+
+def record(topic, payload):
+    state["packets"] += 1
+    state["bytes"] += len(payload)
+    t = state["topics"].setdefault(topic, {"last": -1, "seen": set()})
+    for m in payload.split(b"\n"):
+        if not m:
+            continue
+        state["msgs"] += 1
+        i = int(m.split(b",")[0])
+        if i in t["seen"]:
+            state["dups"] += 1
+        elif i < t["last"]:
+            state["order_err"] += 1
+        t["seen"].add(i)
+        t["last"] = max(t["last"], i)
+
+
+def handle(c):
+    buf = clients[c]
+    while len(buf) >= 2:
+        length, mul, i = 0, 1, 1
+        while True:
+            if i >= len(buf):
+                return
+            d = buf[i]
+            length += (d & 0x7F) * mul
+            mul *= 128
+            i += 1
+            if not d & 0x80:
+                break
+        if len(buf) < i + length:
+            return
+        head, body = buf[0], bytes(buf[i:i + length])
+        del buf[:i + length]
+        kind = head >> 4
+        if kind == 1:
+            c.sendall(b"\x20\x02\x00\x00")
+        elif kind == 3:
+            qos = (head >> 1) & 3
+            topic_len = body[0] << 8 | body[1]
+            topic = body[2:2 + topic_len].decode()
+            p = 2 + topic_len
+            if qos:
+                if state["noack"]:
+                    state["noack"] -= 1
+                else:
+                    c.sendall(b"\x40\x02" + body[p:p + 2])
+                p += 2
+            record(topic, body[p:])
+        elif kind == 12:
+            c.sendall(b"\xd0\x00")
+        elif kind == 14:
+            close_client(c)
+            return
+
+
+def stats():
+    topics = {k: {"unique": len(v["seen"]), "max": v["last"]} for k, v in state["topics"].items()}
+    out = {k: state[k] for k in ("packets", "msgs", "bytes", "dups", "order_err")}
+    out["topics"] = topics
+    return json.dumps(out)
+
+
+def command(s, cmd):
+    args = cmd.split()
+    if args[0] == "down":
+        sel.unregister(listener)
+        listener.close()
+        for c in list(clients):
+            close_client(c)
+    elif args[0] == "up":
+        listen()
+    elif args[0] == "noack":
+        state["noack"] = int(args[1])
+    elif args[0] == "reset":
+        reset()
+    elif args[0] == "stats":
+        s.sendall((stats() + "\n").encode())
+        return
+    s.sendall(b"ok\n")
+
+
+def main():
+    reset()
+    ctrl = socket.socket()
+    ctrl.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    ctrl.bind(("127.0.0.1", PORT + 1))
+    ctrl.listen(4)
+    ctrl.setblocking(False)
+    sel.register(ctrl, selectors.EVENT_READ, "ctrl")
+    listen()
+    print("ready", flush=True)
+    while True:
+        for key, _ in sel.select():
+            s = key.fileobj
+            if key.data == "listen":
+                c, _ = s.accept()
+                c.setblocking(True)
+                clients[c] = bytearray()
+                sel.register(c, selectors.EVENT_READ, "client")
+            elif key.data == "ctrl":
+                c, _ = s.accept()
+                sel.register(c, selectors.EVENT_READ, "cmd")
+            elif key.data == "cmd":
+                cmd = s.recv(64).decode().strip()
+                if cmd:
+                    command(s, cmd)
+                else:
+                    sel.unregister(s)
+                    s.close()
+            else:
+                try:
+                    d = s.recv(65536)
+                except OSError:
+                    d = b""
+                if not d:
+                    close_client(s)
+                    continue
+                clients[s] += d
+                handle(s)
+
+
+if __name__ == "__main__":
+    main()
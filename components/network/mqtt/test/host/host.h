@@ -0,0 +1,39 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _MQTT_PUB_HOST_H_
+#define _MQTT_PUB_HOST_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "esp_partition.h"
+
+typedef struct {
+    const char *path;               /**< file that holds the spool partition */
+    esp_partition_t part;
+    bool present;                   /**< false: the partition is not in the table */
+    int cut_write;                  /**< index of the write cut half way through, -1 for none */
+    int write_count;
+    int erase_count;
+    FILE *file;
+} host_flash_t;
+
+extern host_flash_t g_host_flash;
+extern int g_host_log;
+
+/**
+  * @brief  close and delete the flash file, the next boot sees an erased chip
+  */
+void host_flash_wipe(void);
+
+#endif
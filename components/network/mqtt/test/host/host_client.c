@@ -0,0 +1,244 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Just enough of esp_mqtt_client on Linux sockets for the publisher: CONNECT,
+ * PUBLISH with QoS 0/1, PUBACK events and reconnect every 200 ms, dispatching
+ * the same events as the client on the target.
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "mqtt_client.h"
+
+#define HOST_RECONNECT_US   200000
+
+struct esp_mqtt_client {
+    esp_mqtt_client_config_t config;
+    int fd;
+    bool connected;
+    bool run;
+    int next_id;
+    pthread_mutex_t lock;
+    pthread_t thread;
+};
+
+static void host_dispatch(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t id, int msg_id)
+{
+    esp_mqtt_event_t event = {
+        .event_id = id,
+        .client = client,
+        .msg_id = msg_id,
+        .user_context = client->config.user_context,
+    };
+    if (client->config.event_handle) {
+        client->config.event_handle(&event);
+    }
+}
+
+static int host_send_all(int fd, const uint8_t *buf, size_t len)
+{
+    while (len) {
+        ssize_t ret = send(fd, buf, len, MSG_NOSIGNAL);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return -1;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+static int host_recv_all(int fd, uint8_t *buf, size_t len)
+{
+    while (len) {
+        ssize_t ret = recv(fd, buf, len, 0);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return -1;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+static size_t host_put_len(uint8_t *buf, size_t len)
+{
+    size_t i = 0;
+    do {
+        uint8_t d = len % 128;
+        len /= 128;
+        buf[i++] = len ? d | 0x80 : d;
+    } while (len);
+    return i;
+}
+
+static int host_connect(esp_mqtt_client_handle_t client)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(client->config.port) };
+    inet_pton(AF_INET, client->config.host, &addr.sin_addr);
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    uint8_t pkt[128], ack[4];
+    size_t id_len = strlen(client->config.client_id), n = 0;
+    pkt[n++] = 0x10;
+    n += host_put_len(pkt + n, 10 + 2 + id_len);
+    memcpy(pkt + n, "\0\4MQTT\4\2\0\170", 10);      /**< MQTT 3.1.1, clean session, keepalive 120 s */
+    n += 10;
+    pkt[n++] = id_len >> 8;
+    pkt[n++] = id_len & 0xff;
+    memcpy(pkt + n, client->config.client_id, id_len);
+    n += id_len;
+    if (host_send_all(fd, pkt, n) || host_recv_all(fd, ack, sizeof(ack)) || ack[0] != 0x20 || ack[3] != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void *host_client_task(void *arg)
+{
+    esp_mqtt_client_handle_t client = arg;
+    while (__atomic_load_n(&client->run, __ATOMIC_ACQUIRE)) {
+        int fd = host_connect(client);
+        if (fd < 0) {
+            usleep(HOST_RECONNECT_US);
+            continue;
+        }
+        pthread_mutex_lock(&client->lock);
+        client->fd = fd;
+        client->connected = true;
+        pthread_mutex_unlock(&client->lock);
+        host_dispatch(client, MQTT_EVENT_CONNECTED, 0);
+
+        for (;;) {
+            uint8_t head, d;
+            size_t len = 0, mul = 1;
+            if (host_recv_all(fd, &head, 1)) {
+                break;
+            }
+            do {
+                if (host_recv_all(fd, &d, 1)) {
+                    goto closed;
+                }
+                len += (d & 0x7f) * mul;
+                mul *= 128;
+            } while (d & 0x80);
+            uint8_t *body = malloc(len + 1);
+            if (len && host_recv_all(fd, body, len)) {
+                free(body);
+                break;
+            }
+            if ((head & 0xf0) == 0x40 && len >= 2) {
+                host_dispatch(client, MQTT_EVENT_PUBLISHED, body[0] << 8 | body[1]);
+            }
+            free(body);
+        }
+closed:
+        pthread_mutex_lock(&client->lock);
+        client->connected = false;
+        close(fd);
+        client->fd = -1;
+        pthread_mutex_unlock(&client->lock);
+        host_dispatch(client, MQTT_EVENT_DISCONNECTED, 0);
+        usleep(HOST_RECONNECT_US);
+    }
+    return NULL;
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    esp_mqtt_client_handle_t client = calloc(1, sizeof(struct esp_mqtt_client));
+    client->config = *config;
+    client->fd = -1;
+    client->next_id = 1;
+    pthread_mutex_init(&client->lock, NULL);
+    return client;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    __atomic_store_n(&client->run, true, __ATOMIC_RELEASE);
+    pthread_create(&client->thread, NULL, host_client_task, client);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
+{
+    __atomic_store_n(&client->run, false, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&client->lock);
+    if (client->fd >= 0) {
+        shutdown(client->fd, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&client->lock);
+    pthread_join(client->thread, NULL);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
+{
+    pthread_mutex_destroy(&client->lock);
+    free(client);
+    return ESP_OK;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
+{
+    size_t topic_len = strlen(topic);
+    size_t rem_len = 2 + topic_len + (qos ? 2 : 0) + len;
+    uint8_t *pkt = malloc(rem_len + 5);
+    size_t n = 0;
+    pkt[n++] = 0x30 | (qos << 1) | (retain ? 1 : 0);
+    n += host_put_len(pkt + n, rem_len);
+    pkt[n++] = topic_len >> 8;
+    pkt[n++] = topic_len & 0xff;
+    memcpy(pkt + n, topic, topic_len);
+    n += topic_len;
+
+    int msg_id = 0, ret = -1;
+    pthread_mutex_lock(&client->lock);
+    if (qos) {
+        msg_id = client->next_id;
+        client->next_id = client->next_id % 65535 + 1;
+        pkt[n++] = msg_id >> 8;
+        pkt[n++] = msg_id & 0xff;
+    }
+    memcpy(pkt + n, data, len);
+    n += len;
+    if (client->connected && host_send_all(client->fd, pkt, n) == 0) {
+        ret = msg_id;
+    }
+    pthread_mutex_unlock(&client->lock);
+    free(pkt);
+    return ret;
+}
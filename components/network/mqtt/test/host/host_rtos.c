@@ -0,0 +1,294 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * pthread stand-ins for the FreeRTOS calls the publisher makes, and a spool
+ * partition backed by a file with NOR flash semantics: a write can only clear
+ * bits, an erase sets a whole sector back to 0xff. A write can be cut half way
+ * through to simulate a power loss.
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_partition.h"
+#include "rom/crc.h"
+#include "host.h"
+
+int g_host_log = 0;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned len;
+    unsigned item_size;
+    unsigned head;
+    unsigned num;
+    uint8_t *buf;
+} host_queue_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size)
+{
+    host_queue_t *q = calloc(1, sizeof(host_queue_t));
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    q->len = len;
+    q->item_size = item_size;
+    q->buf = malloc(len * item_size + 1);
+    return q;
+}
+
+static void host_deadline(struct timespec *ts, TickType_t ticks)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    long long ns = ts->tv_nsec + (long long) ticks * portTICK_PERIOD_MS * 1000000;
+    ts->tv_sec += ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+}
+
+/* wait while the queue is full (or empty), false on timeout */
+static bool host_queue_wait(host_queue_t *q, bool full, TickType_t ticks)
+{
+    struct timespec ts;
+    if (ticks != portMAX_DELAY) {
+        host_deadline(&ts, ticks);
+    }
+    while (full ? q->num == q->len : q->num == 0) {
+        if (ticks == 0) {
+            return false;
+        }
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(&q->cond, &q->mutex);
+        } else if (pthread_cond_timedwait(&q->cond, &q->mutex, &ts)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    host_queue_t *q = queue;
+    pthread_mutex_lock(&q->mutex);
+    if (!host_queue_wait(q, true, ticks)) {
+        pthread_mutex_unlock(&q->mutex);
+        return pdFALSE;
+    }
+    memcpy(q->buf + (q->head + q->num) % q->len * q->item_size, item, q->item_size);
+    q->num++;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    host_queue_t *q = queue;
+    pthread_mutex_lock(&q->mutex);
+    if (!host_queue_wait(q, false, ticks)) {
+        pthread_mutex_unlock(&q->mutex);
+        return pdFALSE;
+    }
+    memcpy(item, q->buf + q->head * q->item_size, q->item_size);
+    q->head = (q->head + 1) % q->len;
+    q->num--;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+    return pdTRUE;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    host_queue_t *q = queue;
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->cond);
+    free(q->buf);
+    free(q);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t sem = xQueueCreate(1, 0);
+    xQueueSend(sem, "", 0);
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    char dummy;
+    return xQueueReceive(sem, &dummy, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return xQueueSend(sem, "", 0);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    vQueueDelete(sem);
+}
+
+typedef struct {
+    TaskFunction_t func;
+    void *arg;
+} host_task_t;
+
+static void *host_task_entry(void *arg)
+{
+    host_task_t task = *(host_task_t *) arg;
+    free(arg);
+    task.func(task.arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, unsigned stack, void *arg, UBaseType_t prio, TaskHandle_t *handle)
+{
+    pthread_t thread;
+    host_task_t *task = malloc(sizeof(host_task_t));
+    task->func = func;
+    task->arg = arg;
+    pthread_create(&thread, NULL, host_task_entry, task);
+    pthread_detach(thread);
+    if (handle) {
+        *handle = (TaskHandle_t) thread;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    if (handle == NULL) {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    usleep(ticks * portTICK_PERIOD_MS * 1000);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000LL + ts.tv_nsec / 1000000) / portTICK_PERIOD_MS;
+}
+
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+host_flash_t g_host_flash = {
+    .path = "mqtt_spool.bin",
+    .part = { ESP_PARTITION_TYPE_DATA, 0x81, 0, 64 * 1024, "mqtt_spool" },
+    .present = true,
+    .cut_write = -1,
+};
+
+void host_flash_wipe(void)
+{
+    if (g_host_flash.file) {
+        fclose(g_host_flash.file);
+        g_host_flash.file = NULL;
+    }
+    unlink(g_host_flash.path);
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, int subtype, const char *label)
+{
+    host_flash_t *f = &g_host_flash;
+    if (!f->present || type != f->part.type || strcmp(label, f->part.label)) {
+        return NULL;
+    }
+    if (f->file == NULL) {
+        f->file = fopen(f->path, "r+b");
+    }
+    if (f->file == NULL) {
+        /* a new chip is erased */
+        uint8_t ff[4096];
+        memset(ff, 0xff, sizeof(ff));
+        f->file = fopen(f->path, "w+b");
+        for (int i = 0; i < f->part.size / sizeof(ff); i++) {
+            fwrite(ff, 1, sizeof(ff), f->file);
+        }
+        fflush(f->file);
+    }
+    return &f->part;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size)
+{
+    if (offset + size > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    fseek(g_host_flash.file, part->address + offset, SEEK_SET);
+    return fread(dst, 1, size, g_host_flash.file) == size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t size)
+{
+    host_flash_t *f = &g_host_flash;
+    if (offset + size > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t *buf = malloc(size);
+    esp_partition_read(part, offset, buf, size);
+    size_t done = size;
+    if (f->cut_write >= 0 && f->write_count++ == f->cut_write) {
+        done = size / 2;
+    }
+    for (size_t i = 0; i < done; i++) {
+        buf[i] &= ((const uint8_t *) src)[i];
+    }
+    fseek(f->file, part->address + offset, SEEK_SET);
+    fwrite(buf, 1, size, f->file);
+    fflush(f->file);
+    free(buf);
+    return done == size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    if (offset % 4096 || size % 4096 || offset + size > part->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t *ff = malloc(size);
+    memset(ff, 0xff, size);
+    fseek(g_host_flash.file, part->address + offset, SEEK_SET);
+    fwrite(ff, 1, size, g_host_flash.file);
+    fflush(g_host_flash.file);
+    free(ff);
+    g_host_flash.erase_count++;
+    return ESP_OK;
+}
@@ -0,0 +1,430 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Host test of the MQTT publisher: the publisher and spool sources from
+ * mqtt_pub/ run on Linux against broker.py, with the spool partition in a
+ * file. Prints messages/s with and without batching, how long a spool takes
+ * to drain after an outage, and checks rate limiting, resending of
+ * unacknowledged payloads and recovery of the spool after a reboot, also
+ * with a record torn by a power loss.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "iot_mqtt_pub.h"
+#include "host.h"
+
+#define HOST_STATS_SIZE     (64 * 1024)
+
+static int s_port = 18830;
+static int s_failures;
+static iot_mqtt_pub_handle_t s_pub;
+static esp_mqtt_client_handle_t s_client;
+static char s_stats[HOST_STATS_SIZE];
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("  FAIL %s:%d %s\n", __FILE__, __LINE__, #cond); \
+            s_failures++; \
+        } \
+    } while (0)
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* send a command to the control port of the broker, the answer is in s_stats */
+static void broker(const char *cmd)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(s_port + 1) };
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    size_t n = 0;
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+        send(fd, cmd, strlen(cmd), 0);
+        while (n < sizeof(s_stats) - 1) {
+            ssize_t ret = recv(fd, s_stats + n, sizeof(s_stats) - 1 - n, 0);
+            if (ret <= 0) {
+                break;
+            }
+            n += ret;
+            if (s_stats[n - 1] == '\n') {
+                break;
+            }
+        }
+    } else {
+        printf("  no broker on port %d\n", s_port + 1);
+        exit(1);
+    }
+    s_stats[n] = '\0';
+    close(fd);
+}
+
+/* a counter from the last stats, of the given topic if topic is not NULL */
+static long stat_get(const char *topic, const char *key)
+{
+    char pattern[64];
+    const char *p = s_stats;
+    if (topic) {
+        snprintf(pattern, sizeof(pattern), "\"%s\": ", topic);
+        p = strstr(p, pattern);
+        if (p == NULL) {
+            return 0;
+        }
+    }
+    snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+    p = strstr(p, pattern);
+    return p ? atol(p + strlen(pattern)) : -1;
+}
+
+/* wait until the broker has want messages, returns what it has */
+static long wait_msgs(long want, double timeout)
+{
+    double start = now_s();
+    long got;
+    do {
+        usleep(20000);
+        broker("stats");
+        got = stat_get(NULL, "msgs");
+    } while (got < want && now_s() - start < timeout);
+    return got;
+}
+
+static iot_mqtt_pub_stat_t wait_spool_empty(double timeout)
+{
+    iot_mqtt_pub_stat_t stat;
+    double start = now_s();
+    do {
+        usleep(10000);
+        iot_mqtt_pub_get_stat(s_pub, &stat);
+    } while (stat.spool_pending && now_s() - start < timeout);
+    return stat;
+}
+
+static esp_err_t on_event(esp_mqtt_event_handle_t event)
+{
+    if (s_pub) {
+        iot_mqtt_pub_event(s_pub, event);
+    }
+    return ESP_OK;
+}
+
+/* the client is created and the publisher config set to defaults, start() creates the publisher */
+static iot_mqtt_pub_config_t setup(void)
+{
+    esp_mqtt_client_config_t mqtt_cfg = {
+        .event_handle = on_event,
+        .host = "127.0.0.1",
+        .port = s_port,
+        .client_id = "mqtt_pub_host",
+    };
+    s_client = esp_mqtt_client_init(&mqtt_cfg);
+    iot_mqtt_pub_config_t cfg = IOT_MQTT_PUB_CONFIG_DEFAULT(s_client);
+    return cfg;
+}
+
+static void start(const iot_mqtt_pub_config_t *cfg, bool connect)
+{
+    s_pub = iot_mqtt_pub_create(cfg);
+    CHECK(s_pub != NULL);
+    esp_mqtt_client_start(s_client);
+    if (connect) {
+        usleep(300000);
+    }
+}
+
+static void teardown(void)
+{
+    esp_mqtt_client_stop(s_client);
+    iot_mqtt_pub_delete(s_pub);
+    s_pub = NULL;
+    esp_mqtt_client_destroy(s_client);
+    s_client = NULL;
+}
+
+/* several topics, published as fast as possible */
+static void test_throughput(uint32_t interval_ms, int qos, int topics, double secs)
+{
+    broker("reset");
+    iot_mqtt_pub_config_t cfg = setup();
+    cfg.batch_interval_ms = interval_ms;
+    cfg.batch_size = 1024;
+    cfg.spool_partition = NULL;
+    cfg.spool_ram_size = 64 * 1024;
+    start(&cfg, true);
+
+    char topic[32], msg[64];
+    long sent = 0;
+    double start_s = now_s();
+    while (now_s() - start_s < secs) {
+        for (int i = 0; i < 64; i++, sent++) {
+            snprintf(topic, sizeof(topic), "/dev/t%d", (int)(sent % topics));
+            int len = snprintf(msg, sizeof(msg), "%ld,{\"temp\":%d,\"hum\":%d}", sent / topics, (int)(sent % 40), 55);
+            iot_mqtt_pub_publish(s_pub, topic, msg, len, qos, 0);
+        }
+    }
+    iot_mqtt_pub_flush(s_pub);
+    long got = wait_msgs(sent, 20);
+    double secs_all = now_s() - start_s;
+    long packets = stat_get(NULL, "packets");
+    printf("  batch %4u ms qos%d: %ld msgs in %.2f s, %.0f msg/s delivered, %ld PUBLISH packets (%.1f msgs/packet)\n",
+           interval_ms, qos, got, secs_all, got / secs_all, packets, (double) got / packets);
+    CHECK(got == sent);
+    CHECK(stat_get(NULL, "dups") == 0 && stat_get(NULL, "order_err") == 0);
+    teardown();
+}
+
+/* a producer at a fixed rate, the broker goes away for a while */
+static void test_outage(double down_at, double down_for, double total, int rate, uint16_t drain_rate, int qos)
+{
+    broker("reset");
+    host_flash_wipe();
+    iot_mqtt_pub_config_t cfg = setup();
+    cfg.batch_interval_ms = 200;
+    cfg.drain_rate = drain_rate;
+    cfg.drain_burst = 10;
+    cfg.drain_window = 8;
+    start(&cfg, true);
+
+    int erases = g_host_flash.erase_count;
+    bool down = false, up = false;
+    double start_s = now_s(), up_s = 0, empty_s = 0;
+    uint32_t peak = 0;
+    long sent = 0;
+    char msg[64];
+    iot_mqtt_pub_stat_t stat;
+    while (now_s() - start_s < total) {
+        double t = now_s() - start_s;
+        if (!down && t >= down_at) {
+            broker("down");
+            down = true;
+        }
+        if (down && !up && t >= down_at + down_for) {
+            broker("up");
+            up = true;
+            up_s = now_s();
+        }
+        int len = snprintf(msg, sizeof(msg), "%ld,{\"count\":%ld}", sent, sent);
+        iot_mqtt_pub_publish(s_pub, "/dev/flow", msg, len, qos, 0);
+        sent++;
+        iot_mqtt_pub_get_stat(s_pub, &stat);
+        peak = stat.spool_pending > peak ? stat.spool_pending : peak;
+        if (up && !empty_s && stat.spool_pending == 0) {
+            empty_s = now_s();
+        }
+        usleep(1000000 / rate);
+    }
+    iot_mqtt_pub_flush(s_pub);
+    stat = wait_spool_empty(60);
+    if (!empty_s) {
+        empty_s = now_s();
+    }
+    long got = wait_msgs(sent, 10);
+    printf("  %d msg/s, down %.1f s, drain %u/s qos%d: %ld sent, %ld delivered, peak spool %u payloads, "
+           "spool empty %.2f s after the broker is back, %d erases\n",
+           rate, down_for, drain_rate, qos, sent, got, peak, empty_s - up_s, g_host_flash.erase_count - erases);
+    CHECK(got >= sent && stat.dropped == 0 && stat.spooled > 0);
+    CHECK(stat_get(NULL, "order_err") == 0);
+    teardown();
+}
+
+/* a full spool drains at drain_rate after drain_burst */
+static void test_rate_limit(void)
+{
+    const int num = 100, rate = 25, burst = 5;
+    broker("reset");
+    broker("down");
+    host_flash_wipe();
+    iot_mqtt_pub_config_t cfg = setup();
+    cfg.drain_rate = rate;
+    cfg.drain_burst = burst;
+    start(&cfg, false);
+
+    char msg[32];
+    for (int i = 0; i < num; i++) {
+        int len = snprintf(msg, sizeof(msg), "%d,{}", i);
+        iot_mqtt_pub_publish(s_pub, "/dev/rate", msg, len, 0, IOT_MQTT_PUB_NO_BATCH);
+    }
+    broker("up");
+    double up_s = now_s();
+    sleep(2);
+    broker("stats");
+    long at_2s = stat_get(NULL, "msgs");
+    wait_spool_empty(30);
+    double secs = now_s() - up_s;
+    long got = wait_msgs(num, 2);
+    double expect = (double)(num - burst) / rate;
+    printf("  rate limit: %d payloads at %d/s, %ld after 2 s, drained in %.2f s (%.2f s expected)\n",
+           num, rate, at_2s, secs, expect);
+    CHECK(got == num);
+    CHECK(at_2s <= burst + 2 * rate + 2);
+    CHECK(secs >= expect * 0.9 && secs <= expect + 1.0);
+    teardown();
+}
+
+/* the broker loses PUBACKs, the payloads are sent again after MQTT_PUB_ACK_TIMEOUT_MS */
+static void test_ack_timeout(void)
+{
+    const int num = 20, lost = 3;
+    broker("reset");
+    broker("down");
+    host_flash_wipe();
+    iot_mqtt_pub_config_t cfg = setup();
+    cfg.drain_rate = 1000;
+    cfg.drain_burst = 50;
+    cfg.drain_window = 4;
+    start(&cfg, false);
+
+    char msg[32];
+    for (int i = 0; i < num; i++) {
+        int len = snprintf(msg, sizeof(msg), "%d,{}", i);
+        iot_mqtt_pub_publish(s_pub, "/dev/ack", msg, len, 1, IOT_MQTT_PUB_NO_BATCH);
+    }
+    char cmd[16];
+    snprintf(cmd, sizeof(cmd), "noack %d", lost);
+    broker(cmd);
+    broker("up");
+    double up_s = now_s();
+    iot_mqtt_pub_stat_t stat = wait_spool_empty(10);
+    double secs = now_s() - up_s;
+    broker("stats");
+    printf("  ack timeout: %d payloads, %d PUBACKs lost, %ld unique %ld resent, spool empty after %.2f s\n",
+           num, lost, stat_get("/dev/ack", "unique"), stat_get(NULL, "dups"), secs);
+    CHECK(stat.spool_pending == 0);
+    CHECK(stat_get("/dev/ack", "unique") == num);
+    CHECK(stat_get(NULL, "dups") >= lost);
+    CHECK(secs >= MQTT_PUB_ACK_TIMEOUT_MS / 1000.0);
+    teardown();
+}
+
+/* spool while the broker is down, reboot, then deliver from flash */
+static void test_restart(int cut_write)
+{
+    const long num = 2000;
+    broker("reset");
+    broker("down");
+    host_flash_wipe();
+    iot_mqtt_pub_config_t cfg = setup();
+    cfg.batch_interval_ms = 100;
+    cfg.batch_size = 256;
+    start(&cfg, false);
+
+    g_host_flash.write_count = 0;
+    g_host_flash.cut_write = cut_write;
+    char msg[64];
+    for (long i = 0; i < num; i++) {
+        int len = snprintf(msg, sizeof(msg), "%ld,{\"v\":%ld}", i, i * 3);
+        iot_mqtt_pub_publish(s_pub, "/dev/log", msg, len, 1, 0);
+    }
+    teardown();
+    g_host_flash.cut_write = -1;
+
+    /* reboot: only the flash is left */
+    broker("up");
+    cfg = setup();
+    cfg.batch_interval_ms = 100;
+    cfg.batch_size = 256;
+    s_pub = iot_mqtt_pub_create(&cfg);
+    iot_mqtt_pub_stat_t stat;
+    iot_mqtt_pub_get_stat(s_pub, &stat);
+    uint32_t pending = stat.spool_pending;
+    double start_s = now_s();
+    esp_mqtt_client_start(s_client);
+    stat = wait_spool_empty(30);
+    long got = wait_msgs(num, 2);
+    printf("  restart%s: %ld msgs in %u spooled payloads found after reboot, %ld delivered in %.2f s, %u corrupt\n",
+           cut_write >= 0 ? " with a torn record" : "", num, pending, got, now_s() - start_s, stat.corrupt);
+    CHECK(stat.spool_pending == 0);
+    CHECK(stat_get(NULL, "dups") == 0 && stat_get(NULL, "order_err") == 0);
+    if (cut_write < 0) {
+        CHECK(got == num && stat.corrupt == 0);
+    } else {
+        /* only the torn record is lost */
+        CHECK(got < num && got > num - 100 && stat.corrupt == 1);
+    }
+    teardown();
+}
+
+/* the spool is smaller than the outage, the oldest payloads go */
+static void test_overflow(void)
+{
+    const long num = 3000;
+    broker("reset");
+    broker("down");
+    iot_mqtt_pub_config_t cfg = setup();
+    cfg.spool_partition = NULL;
+    cfg.spool_ram_size = 16 * 1024;
+    cfg.batch_interval_ms = 0;
+    cfg.drain_rate = 1000;
+    cfg.drain_burst = 50;
+    start(&cfg, false);
+
+    char msg[64];
+    for (long i = 0; i < num; i++) {
+        int len = snprintf(msg, sizeof(msg), "%ld,{\"v\":%ld}", i, i);
+        iot_mqtt_pub_publish(s_pub, "/dev/ovf", msg, len, 0, 0);
+    }
+    iot_mqtt_pub_stat_t stat;
+    iot_mqtt_pub_get_stat(s_pub, &stat);
+    uint32_t dropped = stat.dropped, pending = stat.spool_pending;
+    broker("up");
+    wait_spool_empty(30);
+    long got = wait_msgs(pending, 2);
+    long newest = stat_get("/dev/ovf", "max");
+    printf("  overflow: %ld msgs into a 16 KB spool, %u dropped, %u kept, %ld delivered, newest id %ld\n",
+           num, dropped, pending, got, newest);
+    CHECK(dropped + pending == num && got == pending && newest == num - 1);
+    teardown();
+}
+
+int main(int argc, char **argv)
+{
+    if (getenv("LOG")) {
+        g_host_log = atoi(getenv("LOG"));
+    }
+    if (argc > 1) {
+        s_port = atoi(argv[1]);
+    }
+    printf("throughput, 4 topics, 2 s of publishing as fast as possible:\n");
+    test_throughput(0, 0, 4, 2);
+    test_throughput(100, 0, 4, 2);
+    test_throughput(0, 1, 4, 2);
+    test_throughput(100, 1, 4, 2);
+    printf("outage:\n");
+    test_outage(1.0, 3.0, 8.0, 200, 50, 1);
+    test_outage(1.0, 3.0, 8.0, 200, 20, 0);
+    g_host_flash.part.size = 256 * 1024;
+    test_outage(1.0, 5.0, 30.0, 1000, 100, 1);
+    g_host_flash.part.size = 64 * 1024;
+    printf("drain:\n");
+    test_rate_limit();
+    test_ack_timeout();
+    printf("restart:\n");
+    test_restart(-1);
+    test_restart(5);
+    printf("overflow:\n");
+    test_overflow();
+    host_flash_wipe();
+    printf(s_failures ? "FAILED %d\n" : "ALL PASS\n", s_failures);
+    return s_failures != 0;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <stdio.h>
+
+/* LOG=1 in the environment prints errors and warnings, LOG=2 also info */
+extern int g_host_log;
+#define ESP_LOGE(tag, fmt, ...) do { if (g_host_log) printf("E %s: " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGW(tag, fmt, ...) do { if (g_host_log) printf("W %s: " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGI(tag, fmt, ...) do { if (g_host_log > 1) printf("I %s: " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGD(tag, fmt, ...) do { } while (0)
@@ -0,0 +1,16 @@
+/* host stand-in for the FreeRTOS types the publisher uses */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef unsigned TickType_t;
+
+#define portMAX_DELAY       0xffffffff
+#define portTICK_PERIOD_MS  10
+#define portTICK_RATE_MS    portTICK_PERIOD_MS
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              1
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms) / portTICK_PERIOD_MS)
@@ -0,0 +1,77 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "iot_mqtt_pub.h"
+
+static const char *TAG = "MQTT_PUB_TEST";
+
+/* The client is never started, so everything the publisher makes goes to the spool */
+TEST_CASE("MQTT publisher batch and spool test", "[mqtt][iot]")
+{
+    const esp_mqtt_client_config_t mqtt_cfg = {
+        .host = "127.0.0.1",
+        .port = 1883,
+        .client_id = "mqtt_pub_test",
+    };
+    esp_mqtt_client_handle_t client = esp_mqtt_client_init(&mqtt_cfg);
+    TEST_ASSERT_NOT_NULL(client);
+
+    iot_mqtt_pub_config_t pub_cfg = IOT_MQTT_PUB_CONFIG_DEFAULT(client);
+    pub_cfg.batch_interval_ms = 100;
+    pub_cfg.batch_size = 128;
+    pub_cfg.spool_partition = NULL;
+    pub_cfg.spool_ram_size = 8 * 1024;
+    iot_mqtt_pub_handle_t pub = iot_mqtt_pub_create(&pub_cfg);
+    TEST_ASSERT_NOT_NULL(pub);
+
+    char msg[32];
+    int len, total = 0;
+    for (int i = 0; i < 100; i++) {
+        len = sprintf(msg, "{\"id\":%d}", i);
+        total += len + 1;
+        TEST_ASSERT_EQUAL(ESP_OK, iot_mqtt_pub_publish(pub, "/test/batch", msg, len, 1, 0));
+    }
+    /* the last batch goes when its first message has waited the interval */
+    vTaskDelay(300 / portTICK_RATE_MS);
+
+    iot_mqtt_pub_stat_t stat;
+    TEST_ASSERT_EQUAL(ESP_OK, iot_mqtt_pub_get_stat(pub, &stat));
+    ESP_LOGI(TAG, "%d messages in %d batches, %d spooled", stat.msg_in, stat.batches, stat.spooled);
+    TEST_ASSERT_EQUAL(100, stat.msg_in);
+    TEST_ASSERT(stat.batches >= total / 128 + 1 && stat.batches < 100 / 4);
+    TEST_ASSERT_EQUAL(stat.batches, stat.spooled);
+    TEST_ASSERT_EQUAL(stat.spooled, stat.spool_pending);
+    TEST_ASSERT_EQUAL(0, stat.pub_live);
+    TEST_ASSERT_EQUAL(0, stat.dropped);
+
+    /* more than two sectors of RAM hold, the oldest payloads are given up */
+    for (int i = 0; i < 1000; i++) {
+        len = sprintf(msg, "{\"id\":%d}", i);
+        TEST_ASSERT_EQUAL(ESP_OK, iot_mqtt_pub_publish(pub, "/test/single", msg, len, 0, IOT_MQTT_PUB_NO_BATCH));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, iot_mqtt_pub_get_stat(pub, &stat));
+    ESP_LOGI(TAG, "%d spooled, %d pending, %d dropped", stat.spooled, stat.spool_pending, stat.dropped);
+    TEST_ASSERT(stat.dropped > 0);
+    TEST_ASSERT_EQUAL(stat.spooled - stat.dropped, stat.spool_pending);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, iot_mqtt_pub_publish(pub, "/test/batch", msg, len, 3, 0));
+    TEST_ASSERT_EQUAL(ESP_OK, iot_mqtt_pub_delete(pub));
+    esp_mqtt_client_destroy(client);
+}
@@ -19,6 +19,8 @@
 class CTcpConn
 {
 friend class CTcpServer;
+friend class CTcpReactor;
+friend class CTcpWriter;
 private:
     /**
      * prevent copy constructing
@@ -67,11 +69,20 @@ public:
      */
     int SetTimeout(int timeout);
 
+    /**
+     * @brief switch the socket between blocking and non-blocking mode
+     * @param enable true for non-blocking
+     * @return
+     *     0 if success
+     *     <0 if fail
+     */
+    int SetNonBlock(bool enable);
+
     /**
      * @brief read data from socket
      * @param data buffer to receive data from socket
      * @param length max length for receive buffer
-     * @param timeout for reading data
+     * @param timeout for reading data, the socket option is only updated when it differs from the last one
      * @return
      *     <0 if fail to read
      *     otherwise data length that read from socket
@@ -83,8 +94,8 @@ public:
      * @param data pointer to data buffer to send
      * @param length data length to send to socket
      * return
-     *     <0 if fail to write
-     *     otherwise data length that written to socket
+     *     <0 if fail to write, the connection is closed
+     *     otherwise data length that written to socket, 0 if a non-blocking socket can not take more data
      */
     int Write(const void *data, int length);
 
@@ -97,6 +108,72 @@ public:
     int Disconnect();
 };
 
+/**
+ * @brief Buffered writer for a CTcpConn.
+ *        Small messages are copied into a coalescing buffer, large ones are queued by reference,
+ *        and the whole queue is sent with one writev() call, so a burst of tiny records costs one
+ *        system call and as few TCP segments as possible instead of one per record.
+ *        Since the writer does the coalescing, Nagle's algorithm is disabled on the socket by default.
+ */
+class CTcpWriter
+{
+private:
+    /**
+     * prevent copy constructing
+     */
+    CTcpWriter(const CTcpWriter&);
+    CTcpWriter& operator = (const CTcpWriter&);
+    void* m_writer;
+
+public:
+    /**
+     * @brief constructor of CTcpWriter
+     * @param conn connected TCP connection, must outlive the writer
+     * @param buf_size size of the coalescing buffer, the queue is flushed when it is full
+     * @param iov_num max number of segments sent in one writev() call
+     * @param copy_limit messages shorter than copy_limit bytes are copied into the buffer,
+     *        longer ones are sent from the caller memory without copy
+     * @param nodelay set TCP_NODELAY on the socket
+     */
+    CTcpWriter(CTcpConn* conn, int buf_size = 1024, int iov_num = 8, int copy_limit = 128, bool nodelay = true);
+    ~CTcpWriter();
+
+    /**
+     * @brief queue a message, the queue is flushed when the buffer or the segment list is full.
+     *        Messages of copy_limit bytes or more are queued by reference, see WriteRef().
+     * @param data pointer to data buffer
+     * @param length data length
+     * @return
+     *     <0 if the socket failed
+     *     0 if a non-blocking socket can not take more data and the message was not queued
+     *     otherwise length
+     */
+    int Write(const void* data, int length);
+
+    /**
+     * @brief queue a message by reference without copy.
+     *        The data must stay valid until Flush() or GetPending() reports that the queue is empty.
+     * @param data pointer to data buffer
+     * @param length data length
+     * @return same as Write()
+     */
+    int WriteRef(const void* data, int length);
+
+    /**
+     * @brief send the queued data with writev()
+     * @return
+     *     <0 if the socket failed
+     *     otherwise the number of bytes still queued, only non-zero for non-blocking sockets
+     */
+    int Flush();
+
+    /**
+     * @brief get the number of queued bytes
+     * @return queued data length
+     */
+    int GetPending();
+};
+
 class CTcpServer: public CTcpConn
 {
 private:
@@ -135,5 +212,122 @@ public:
     void Stop();
 };
 
+/**
+ * @brief Event driven TCP server.
+ *        One task multiplexes the listening socket and all accepted connections with select(),
+ *        every socket is non-blocking and the application is notified through callbacks,
+ *        so the number of clients is no longer bounded by one task stack per connection.
+ *        Connections are referred to by an integer id which stays unique after the
+ *        connection is closed, so a stale id is rejected rather than reaching a new client.
+ */
+class CTcpReactor: public CTcpServer
+{
+public:
+    /**
+     * @brief called when a new connection is accepted
+     */
+    typedef void (*accept_cb_t)(CTcpReactor* server, int conn_id, void* arg);
+    /**
+     * @brief called with the data received on a connection, the buffer is only valid during the call
+     */
+    typedef void (*data_cb_t)(CTcpReactor* server, int conn_id, const uint8_t* data, int len, void* arg);
+    /**
+     * @brief called once a connection is closed, by the peer, by an error or by Close()
+     */
+    typedef void (*close_cb_t)(CTcpReactor* server, int conn_id, void* arg);
+
+private:
+    /**
+     * prevent copy constructing
+     */
+    CTcpReactor(const CTcpReactor&);
+    CTcpReactor& operator = (const CTcpReactor&);
+    void* m_reactor;
+
+public:
+    /**
+     * @brief constructor of CTcpReactor
+     * @param max_conn max number of connections served at the same time,
+     *        further clients wait in the listen backlog until a connection is closed
+     * @param rx_size size of the receive buffer, at most rx_size bytes are passed to one data callback
+     * @param tx_size size of the write buffer of each connection,
+     *        only allocated when the socket can not take all the data at once
+     */
+    CTcpReactor(int max_conn = 8, int rx_size = 512, int tx_size = 1024);
+    ~CTcpReactor();
+
+    /**
+     * @brief set the event callbacks, must be called before Start()
+     * @param accept_cb callback for new connection, can be NULL
+     * @param data_cb callback for received data
+     * @param close_cb callback for closed connection, can be NULL
+     * @param arg user argument passed to the callbacks
+     */
+    void SetCallbacks(accept_cb_t accept_cb, data_cb_t data_cb, close_cb_t close_cb, void* arg);
+
+    /**
+     * @brief start TCP listening at given port, the listening socket is switched to non-blocking mode
+     * @param port listening port
+     * @param backlog length of the listen queue
+     * @return
+     *     <0 if error occur
+     *     otherwise success
+     */
+    int Listen(uint16_t port, int backlog);
+
+    /**
+     * @brief create the reactor task which calls Poll() until Stop()
+     * @param stack_size stack size of the reactor task
+     * @param priority priority of the reactor task
+     * @return
+     *     <0 if error occur
+     *     otherwise success
+     */
+    int Start(uint32_t stack_size = 3072, int priority = 5);
+
+    /**
+     * @brief run one iteration of the event loop in the calling task, for use without Start()
+     * @param timeout_ms max time to wait for an event, <0 to wait forever
+     * @return
+     *     <0 if select failed
+     *     0 on timeout
+     *     otherwise the number of sockets with events
+     */
+    int Poll(int timeout_ms);
+
+    /**
+     * @brief stop the reactor task, close all connections and the listening socket
+     */
+    void Stop();
+
+    /**
+     * @brief send data on a connection, can be called from any task and from the callbacks.
+     *        The data is written to the socket directly if possible, the rest is queued in the
+     *        connection write buffer and sent by the reactor when the socket is writable.
+     * @param conn_id connection id
+     * @param data pointer to data buffer to send
+     * @param length data length
+     * @return
+     *     <0 if the connection is not valid or was closed because of a socket error
+     *     otherwise data length accepted, less than length if the write buffer is full
+     */
+    int Send(int conn_id, const void* data, int length);
+
+    /**
+     * @brief close a connection once the queued data has been sent
+     * @param conn_id connection id
+     * @return
+     *     <0 if the connection is not valid
+     *     otherwise success
+     */
+    int Close(int conn_id);
+
+    /**
+     * @brief get the number of open connections
+     * @return connection number
+     */
+    int GetConnNum();
+};
+
 #endif
 #endif
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include <string.h>
+#include <fcntl.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_system.h"
@@ -46,6 +47,7 @@ int CTcpConn::Connect(const char* ip, uint16_t port)
             ESP_LOGE(TAG, "... Failed to allocate socket.");
         }
         ESP_LOGI(TAG, "... allocated socket");
+        tout = 0;
     }
 
     int ret = 0;
@@ -76,6 +78,7 @@ int CTcpConn::Connect(uint32_t ip, uint16_t port)
             ESP_LOGE(TAG, "... Failed to allocate socket.");
         }
         ESP_LOGD(TAG, "... allocated socket");
+        tout = 0;
     }
     int ret = 0;
     struct sockaddr_in servaddr;
@@ -121,7 +124,8 @@ int CTcpConn::Read(uint8_t* data, int length, int timeout)
         return -1;
     }
 
-    if (timeout > 0) {
+    /* SO_RCVTIMEO stays set on the socket, only change it when the timeout differs */
+    if (timeout > 0 && timeout != tout) {
         ret = SetTimeout(timeout);
         if (ret < 0) {
             return ret;
@@ -138,6 +142,10 @@ int CTcpConn::Write(const void *data, int length)
         return -1;
     }
     int ret = send(sockfd, data, length, 0);
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        /* non-blocking socket with a full send buffer, keep the connection */
+        return 0;
+    }
     if (ret < 0) {
         ESP_LOGE(TAG, "... socket send failed");
         close(sockfd);
@@ -146,10 +154,21 @@ int CTcpConn::Write(const void *data, int length)
     return ret;
 }
 
+int CTcpConn::SetNonBlock(bool enable)
+{
+    if (sockfd < 0) {
+        return -1;
+    }
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    flags = enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(sockfd, F_SETFL, flags);
+}
+
 int CTcpConn::Disconnect()
 {
     int ret = close(sockfd);
     sockfd = -1;
+    tout = 0;
     return ret;
 }
 
@@ -174,7 +193,6 @@ int CTcpServer::Listen(uint16_t port, int max_connection)
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET; /* Internet address family */
     server_addr.sin_addr.s_addr = INADDR_ANY; /* Any incoming interface */
-    server_addr.sin_len = sizeof(server_addr);
     server_addr.sin_port = htons(port); /* Local port */
 
     /* Create socket for incoming connections */
@@ -224,8 +242,9 @@ CTcpConn* CTcpServer::Accept()
 
 void CTcpServer::Stop()
 {
-    if (sockfd > 0) {
+    if (sockfd >= 0) {
         close(sockfd);
+        sockfd = -1;
     }
 }
 
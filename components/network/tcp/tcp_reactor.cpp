@@ -0,0 +1,479 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "lwip/sockets.h"
+#include "iot_tcp.h"
+
+static const char* TAG = "tcp_reactor";
+
+#define REACTOR_CHECK(a, str, ret) if(!(a)) {                                     \
+        ESP_LOGE(TAG,"%s:%d (%s):%s", __FILE__, __LINE__, __FUNCTION__, str);     \
+        return (ret);                                                             \
+        }
+
+#define REACTOR_ID(slot, gen)   ((int) (((uint32_t) (gen) << 16) | (slot)))
+#define REACTOR_ID_SLOT(id)     ((id) & 0xffff)
+#define REACTOR_ID_GEN(id)      (((uint32_t) (id) >> 16) & 0x7fff)
+
+typedef struct {
+    CTcpConn* conn;         /**< NULL if the slot is free */
+    uint16_t gen;           /**< generation, part of the connection id */
+    bool closing;           /**< close once the write buffer is empty */
+    uint8_t* tx_buf;        /**< write ring buffer, allocated on first use */
+    int tx_head;
+    int tx_len;
+} reactor_conn_t;
+
+typedef struct {
+    int max_conn;
+    int rx_size;
+    int tx_size;
+    int conn_num;
+    reactor_conn_t* conns;
+    uint8_t* rx_buf;
+    int wake_fd;            /**< UDP socket bound to loopback, wakes up select() from other tasks */
+    struct sockaddr_in wake_addr;
+    CTcpReactor::accept_cb_t accept_cb;
+    CTcpReactor::data_cb_t data_cb;
+    CTcpReactor::close_cb_t close_cb;
+    void* arg;
+    CTcpReactor* server;
+    SemaphoreHandle_t lock;
+    SemaphoreHandle_t exit_sem;
+    TaskHandle_t task;
+    volatile bool run;
+} tcp_reactor_t;
+
+static void reactor_set_nonblock(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static bool reactor_would_block()
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+static void reactor_wake(tcp_reactor_t* reactor)
+{
+    if (reactor->wake_fd >= 0) {
+        uint8_t c = 0;
+        sendto(reactor->wake_fd, &c, 1, 0, (struct sockaddr*) &reactor->wake_addr, sizeof(reactor->wake_addr));
+    }
+}
+
+static void reactor_wake_init(tcp_reactor_t* reactor)
+{
+    socklen_t len = sizeof(reactor->wake_addr);
+    reactor->wake_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (reactor->wake_fd < 0) {
+        ESP_LOGW(TAG, "no wake up socket, queued data waits for the next poll timeout");
+        return;
+    }
+    memset(&reactor->wake_addr, 0, sizeof(reactor->wake_addr));
+    reactor->wake_addr.sin_family = AF_INET;
+    reactor->wake_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    reactor->wake_addr.sin_port = 0;
+    if (bind(reactor->wake_fd, (struct sockaddr*) &reactor->wake_addr, sizeof(reactor->wake_addr)) != 0
+            || getsockname(reactor->wake_fd, (struct sockaddr*) &reactor->wake_addr, &len) != 0) {
+        ESP_LOGW(TAG, "fail to bind wake up socket, queued data waits for the next poll timeout");
+        close(reactor->wake_fd);
+        reactor->wake_fd = -1;
+        return;
+    }
+    reactor_set_nonblock(reactor->wake_fd);
+}
+
+static reactor_conn_t* reactor_get_conn(tcp_reactor_t* reactor, int conn_id)
+{
+    if (conn_id < 0 || REACTOR_ID_SLOT(conn_id) >= reactor->max_conn) {
+        return NULL;
+    }
+    reactor_conn_t* c = &reactor->conns[REACTOR_ID_SLOT(conn_id)];
+    if (c->conn == NULL || c->gen != REACTOR_ID_GEN(conn_id)) {
+        return NULL;
+    }
+    return c;
+}
+
+static void reactor_close_conn(CTcpReactor* server, tcp_reactor_t* reactor, int slot)
+{
+    reactor_conn_t* c = &reactor->conns[slot];
+    int conn_id = REACTOR_ID(slot, c->gen);
+    c->conn->Disconnect();
+    delete c->conn;
+    c->conn = NULL;
+    c->closing = false;
+    c->tx_head = 0;
+    c->tx_len = 0;
+    free(c->tx_buf);
+    c->tx_buf = NULL;
+    reactor->conn_num--;
+    ESP_LOGD(TAG, "connection %x closed, %d left", conn_id, reactor->conn_num);
+    if (reactor->close_cb) {
+        reactor->close_cb(server, conn_id, reactor->arg);
+    }
+}
+
+/* send as much of the write buffer as the socket takes, return <0 on socket error */
+static int reactor_flush(tcp_reactor_t* reactor, reactor_conn_t* c, int fd)
+{
+    while (c->tx_len > 0) {
+        int chunk = c->tx_len;
+        if (c->tx_head + chunk > reactor->tx_size) {
+            chunk = reactor->tx_size - c->tx_head;
+        }
+        int ret = send(fd, c->tx_buf + c->tx_head, chunk, 0);
+        if (ret < 0) {
+            return reactor_would_block() ? 0 : -1;
+        }
+        c->tx_head = (c->tx_head + ret) % reactor->tx_size;
+        c->tx_len -= ret;
+        if (ret < chunk) {
+            break;
+        }
+    }
+    if (c->tx_len == 0) {
+        c->tx_head = 0;
+    }
+    return 0;
+}
+
+static void reactor_accept(CTcpReactor* server, tcp_reactor_t* reactor, int listen_fd)
+{
+    while (reactor->conn_num < reactor->max_conn) {
+        int fd = accept(listen_fd, (struct sockaddr*) NULL, NULL);
+        if (fd < 0) {
+            if (!reactor_would_block()) {
+                ESP_LOGE(TAG, "accept socket error: %s(errno: %d)", strerror(errno), errno);
+            }
+            return;
+        }
+        if (fd >= FD_SETSIZE) {
+            ESP_LOGE(TAG, "socket %d out of select() range, drop connection", fd);
+            close(fd);
+            continue;
+        }
+        reactor_set_nonblock(fd);
+        int slot = 0;
+        while (reactor->conns[slot].conn != NULL) {
+            slot++;
+        }
+        reactor_conn_t* c = &reactor->conns[slot];
+        c->conn = new CTcpConn(fd);
+        c->gen = (c->gen + 1) & 0x7fff;
+        reactor->conn_num++;
+        ESP_LOGD(TAG, "connection %x accepted, %d open", REACTOR_ID(slot, c->gen), reactor->conn_num);
+        if (reactor->accept_cb) {
+            reactor->accept_cb(server, REACTOR_ID(slot, c->gen), reactor->arg);
+        }
+    }
+}
+
+static void reactor_task(void* arg)
+{
+    tcp_reactor_t* reactor = (tcp_reactor_t*) arg;
+    while (reactor->run) {
+        if (reactor->server->Poll(1000) < 0) {
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+        }
+    }
+    xSemaphoreGive(reactor->exit_sem);
+    vTaskDelete(NULL);
+}
+
+CTcpReactor::CTcpReactor(int max_conn, int rx_size, int tx_size)
+{
+    tcp_reactor_t* reactor = (tcp_reactor_t*) calloc(1, sizeof(tcp_reactor_t));
+    m_reactor = reactor;
+    if (reactor == NULL) {
+        ESP_LOGE(TAG, "no memory for reactor");
+        return;
+    }
+    reactor->server = this;
+    reactor->max_conn = max_conn > 0 ? max_conn : 1;
+    reactor->rx_size = rx_size > 0 ? rx_size : 512;
+    reactor->tx_size = tx_size > 0 ? tx_size : 1024;
+    reactor->conns = (reactor_conn_t*) calloc(reactor->max_conn, sizeof(reactor_conn_t));
+    reactor->rx_buf = (uint8_t*) malloc(reactor->rx_size);
+    reactor->lock = xSemaphoreCreateRecursiveMutex();
+    reactor->exit_sem = xSemaphoreCreateBinary();
+    if (reactor->conns == NULL || reactor->rx_buf == NULL || reactor->lock == NULL || reactor->exit_sem == NULL) {
+        ESP_LOGE(TAG, "no memory for reactor");
+        free(reactor->conns);
+        free(reactor->rx_buf);
+        if (reactor->lock) {
+            vSemaphoreDelete(reactor->lock);
+        }
+        if (reactor->exit_sem) {
+            vSemaphoreDelete(reactor->exit_sem);
+        }
+        free(reactor);
+        m_reactor = NULL;
+        return;
+    }
+    reactor_wake_init(reactor);
+}
+
+CTcpReactor::~CTcpReactor()
+{
+    tcp_reactor_t* reactor = (tcp_reactor_t*) m_reactor;
+    Stop();
+    if (reactor) {
+        if (reactor->wake_fd >= 0) {
+            close(reactor->wake_fd);
+        }
+        vSemaphoreDelete(reactor->lock);
+        vSemaphoreDelete(reactor->exit_sem);
+        free(reactor->conns);
+        free(reactor->rx_buf);
+        free(reactor);
+        m_reactor = NULL;
+    }
+}
+
+void CTcpReactor::SetCallbacks(accept_cb_t accept_cb, data_cb_t data_cb, close_cb_t close_cb, void* arg)
+{
+    tcp_reactor_t* reactor = (tcp_reactor_t*) m_reactor;
+    if (reactor) {
+        reactor->accept_cb = accept_cb;
+        reactor->data_cb = data_cb;
+        reactor->close_cb = close_cb;
+        reactor->arg = arg;
+    }
+}
+
+int CTcpReactor::Listen(uint16_t port, int backlog)
+{
+    REACTOR_CHECK(m_reactor != NULL, "reactor not initialized", -1);
+    if (sockfd < 0) {
+        sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        REACTOR_CHECK(sockfd >= 0, "failed to create sock", -1);
+        int reuse = 1;
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    }
+    if (CTcpServer::Listen(port, backlog) < 0) {
+        return -1;
+    }
+    reactor_set_nonblock(sockfd);
+    return 0;
+}
+
+int CTcpReactor::Start(uint32_t stack_size, int priority)
+{
+    tcp_reactor_t* reactor = (tcp_reactor_t*) m_reactor;
+    REACTOR_CHECK(reactor != NULL, "reactor not initialized", -1);
+    REACTOR_CHECK(sockfd >= 0, "call Listen() first", -1);
+    REACTOR_CHECK(reactor->task == NULL, "reactor already started", -1);
+    reactor->run = true;
+    if (xTaskCreate(reactor_task, "tcp_reactor", stack_size, reactor, priority, &reactor->task) != pdPASS) {
+        ESP_LOGE(TAG, "fail to create reactor task");
+        reactor->run = false;
+        reactor->task = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int CTcpReactor::Poll(int timeout_ms)
+{
+    tcp_reactor_t* reactor = (tcp_reactor_t*) m_reactor;
+    REACTOR_CHECK(reactor != NULL, "reactor not initialized", -1);
+    fd_set rd_set, wr_set;
+    int max_fd = -1;
+    int listen_fd = sockfd;
+
+    FD_ZERO(&rd_set);
+    FD_ZERO(&wr_set);
+    xSemaphoreTakeRecursive(reactor->lock, portMAX_DELAY);
+    if (listen_fd >= 0 && reactor->conn_num < reactor->max_conn) {
+        FD_SET(listen_fd, &rd_set);
+        max_fd = listen_fd;
+    }
+    if (reactor->wake_fd >= 0) {
+        FD_SET(reactor->wake_fd, &rd_set);
+        max_fd = reactor->wake_fd > max_fd ? reactor->wake_fd : max_fd;
+    }
+    for (int i = 0; i < reactor->max_conn; i++) {
+        reactor_conn_t* c = &reactor->conns[i];
+        if (c->conn == NULL) {
+            continue;
+        }
+        int fd = c->conn->sockfd;
+        FD_SET(fd, &rd_set);
+        if (c->tx_len > 0) {
+            FD_SET(fd, &wr_set);
+        }
+        max_fd = fd > max_fd ? fd : max_fd;
+    }
+    xSemaphoreGiveRecursive(reactor->lock);
+
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    int ret = select(max_fd + 1, &rd_set, &wr_set, NULL, timeout_ms < 0 ? NULL : &tv);
+    if (ret <= 0) {
+        if (ret < 0 && errno != EINTR) {
+            ESP_LOGE(TAG, "select error: %s(errno: %d)", strerror(errno), errno);
+            return -1;
+        }
+        return 0;
+    }
+
+    xSemaphoreTakeRecursive(reactor->lock, portMAX_DELAY);
+    if (reactor->wake_fd >= 0 && FD_ISSET(reactor->wake_fd, &rd_set)) {
+        uint8_t drain[16];
+        while (recv(reactor->wake_fd, drain, sizeof(drain), 0) > 0);
+    }
+    /* connections closed by another task during select() may have their fd reused here,
+     * a spurious readable flag on a new connection only results in EAGAIN */
+    if (listen_fd >= 0 && FD_ISSET(listen_fd, &rd_set)) {
+        reactor_accept(this, reactor, listen_fd);
+    }
+    for (int i = 0; i < reactor->max_conn; i++) {
+        reactor_conn_t* c = &reactor->conns[i];
+        if (c->conn == NULL) {
+            continue;
+        }
+        int fd = c->conn->sockfd;
+        if (FD_ISSET(fd, &wr_set) && reactor_flush(reactor, c, fd) < 0) {
+            reactor_close_conn(this, reactor, i);
+            continue;
+        }
+        if (FD_ISSET(fd, &rd_set)) {
+            int len = recv(fd, reactor->rx_buf, reactor->rx_size, 0);
+            if (len > 0) {
+                if (reactor->data_cb) {
+                    reactor->data_cb(this, REACTOR_ID(i, c->gen), reactor->rx_buf, len, reactor->arg);
+                }
+            } else if (len == 0 || !reactor_would_block()) {
+                reactor_close_conn(this, reactor, i);
+                continue;
+            }
+        }
+        /* the data callback may have closed the slot */
+        if (c->conn != NULL && c->closing && c->tx_len == 0) {
+            reactor_close_conn(this, reactor, i);
+        }
+    }
+    xSemaphoreGiveRecursive(reactor->lock);
+    return ret;
+}
+
+void CTcpReactor::Stop()
+{
+    tcp_reactor_t* reactor = (tcp_reactor_t*) m_reactor;
+    if (reactor == NULL) {
+        CTcpServer::Stop();
+        return;
+    }
+    if (reactor->task) {
+        reactor->run = false;
+        reactor_wake(reactor);
+        xSemaphoreTake(reactor->exit_sem, portMAX_DELAY);
+        reactor->task = NULL;
+    }
+    xSemaphoreTakeRecursive(reactor->lock, portMAX_DELAY);
+    for (int i = 0; i < reactor->max_conn; i++) {
+        if (reactor->conns[i].conn != NULL) {
+            reactor_close_conn(this, reactor, i);
+        }
+    }
+    CTcpServer::Stop();
+    xSemaphoreGiveRecursive(reactor->lock);
+}
+
+int CTcpReactor::Send(int conn_id, const void* data, int length)
+{
+    tcp_reactor_t* reactor = (tcp_reactor_t*) m_reactor;
+    REACTOR_CHECK(reactor != NULL, "reactor not initialized", -1);
+    const uint8_t* src = (const uint8_t*) data;
+    int sent = 0;
+
+    xSemaphoreTakeRecursive(reactor->lock, portMAX_DELAY);
+    reactor_conn_t* c = reactor_get_conn(reactor, conn_id);
+    if (c == NULL || c->closing) {
+        xSemaphoreGiveRecursive(reactor->lock);
+        return -1;
+    }
+    /* nothing queued, so the data can go to the socket directly without reordering */
+    if (c->tx_len == 0) {
+        sent = send(c->conn->sockfd, src, length, 0);
+        if (sent < 0) {
+            if (!reactor_would_block()) {
+                ESP_LOGE(TAG, "connection %x send failed", conn_id);
+                reactor_close_conn(this, reactor, REACTOR_ID_SLOT(conn_id));
+                xSemaphoreGiveRecursive(reactor->lock);
+                return -1;
+            }
+            sent = 0;
+        }
+    }
+    if (sent < length) {
+        if (c->tx_buf == NULL) {
+            c->tx_buf = (uint8_t*) malloc(reactor->tx_size);
+        }
+        if (c->tx_buf != NULL) {
+            bool was_empty = c->tx_len == 0;
+            while (sent < length && c->tx_len < reactor->tx_size) {
+                int tail = (c->tx_head + c->tx_len) % reactor->tx_size;
+                int chunk = tail >= c->tx_head ? reactor->tx_size - tail : c->tx_head - tail;
+                chunk = chunk < length - sent ? chunk : length - sent;
+                memcpy(c->tx_buf + tail, src + sent, chunk);
+                c->tx_len += chunk;
+                sent += chunk;
+            }
+            /* the reactor has to add the socket to the write set */
+            if (was_empty && xTaskGetCurrentTaskHandle() != reactor->task) {
+                reactor_wake(reactor);
+            }
+        }
+    }
+    xSemaphoreGiveRecursive(reactor->lock);
+    return sent;
+}
+
+int CTcpReactor::Close(int conn_id)
+{
+    tcp_reactor_t* reactor = (tcp_reactor_t*) m_reactor;
+    REACTOR_CHECK(reactor != NULL, "reactor not initialized", -1);
+    xSemaphoreTakeRecursive(reactor->lock, portMAX_DELAY);
+    reactor_conn_t* c = reactor_get_conn(reactor, conn_id);
+    if (c == NULL) {
+        xSemaphoreGiveRecursive(reactor->lock);
+        return -1;
+    }
+    if (c->tx_len == 0) {
+        reactor_close_conn(this, reactor, REACTOR_ID_SLOT(conn_id));
+    } else {
+        c->closing = true;
+    }
+    xSemaphoreGiveRecursive(reactor->lock);
+    return 0;
+}
+
+int CTcpReactor::GetConnNum()
+{
+    tcp_reactor_t* reactor = (tcp_reactor_t*) m_reactor;
+    return reactor ? reactor->conn_num : 0;
+}
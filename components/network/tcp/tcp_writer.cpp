@@ -0,0 +1,198 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "esp_log.h"
+
+#include "lwip/sockets.h"
+#include "iot_tcp.h"
+
+static const char* TAG = "tcp_writer";
+
+typedef struct {
+    CTcpConn* conn;
+    uint8_t* buf;           /**< coalescing buffer, reused once the queue is empty */
+    int buf_size;
+    int buf_used;
+    struct iovec* iov;      /**< queued segments, iov[head] to iov[head + num - 1] */
+    int iov_max;
+    int iov_head;
+    int iov_num;
+    int copy_limit;
+    int pending;
+} tcp_writer_t;
+
+CTcpWriter::CTcpWriter(CTcpConn* conn, int buf_size, int iov_num, int copy_limit, bool nodelay)
+{
+    tcp_writer_t* writer = (tcp_writer_t*) calloc(1, sizeof(tcp_writer_t));
+    m_writer = writer;
+    if (writer == NULL) {
+        ESP_LOGE(TAG, "no memory for writer");
+        return;
+    }
+    writer->conn = conn;
+    writer->buf_size = buf_size > 0 ? buf_size : 1024;
+    writer->iov_max = iov_num > 1 ? iov_num : 2;
+    writer->copy_limit = copy_limit < writer->buf_size ? copy_limit : writer->buf_size;
+    writer->buf = (uint8_t*) malloc(writer->buf_size);
+    writer->iov = (struct iovec*) calloc(writer->iov_max, sizeof(struct iovec));
+    if (writer->buf == NULL || writer->iov == NULL) {
+        ESP_LOGE(TAG, "no memory for writer");
+        free(writer->buf);
+        free(writer->iov);
+        free(writer);
+        m_writer = NULL;
+        return;
+    }
+    if (nodelay && conn->sockfd >= 0) {
+        int on = 1;
+        setsockopt(conn->sockfd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+}
+
+CTcpWriter::~CTcpWriter()
+{
+    tcp_writer_t* writer = (tcp_writer_t*) m_writer;
+    if (writer) {
+        if (writer->pending > 0) {
+            Flush();
+        }
+        free(writer->buf);
+        free(writer->iov);
+        free(writer);
+        m_writer = NULL;
+    }
+}
+
+int CTcpWriter::Flush()
+{
+    tcp_writer_t* writer = (tcp_writer_t*) m_writer;
+    if (writer == NULL || writer->conn->sockfd < 0) {
+        return -1;
+    }
+    while (writer->iov_num > 0) {
+        int ret = writev(writer->conn->sockfd, writer->iov + writer->iov_head, writer->iov_num);
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "writev failed: %s(errno: %d)", strerror(errno), errno);
+            return -1;
+        }
+        writer->pending -= ret;
+        /* drop the segments that are fully sent and trim the first partial one */
+        while (ret > 0) {
+            struct iovec* v = &writer->iov[writer->iov_head];
+            if ((size_t) ret < v->iov_len) {
+                v->iov_base = (uint8_t*) v->iov_base + ret;
+                v->iov_len -= ret;
+                break;
+            }
+            ret -= v->iov_len;
+            writer->iov_head++;
+            writer->iov_num--;
+        }
+    }
+    if (writer->iov_num == 0) {
+        writer->iov_head = 0;
+        writer->buf_used = 0;
+    } else if (writer->iov_head > 0) {
+        memmove(writer->iov, writer->iov + writer->iov_head, writer->iov_num * sizeof(struct iovec));
+        writer->iov_head = 0;
+    }
+    return writer->pending;
+}
+
+/* make room for a new segment and len bytes of buffer, flush if needed */
+static bool writer_has_room(CTcpWriter* w, tcp_writer_t* writer, int len, int* err)
+{
+    if (writer->iov_num < writer->iov_max && writer->buf_used + len <= writer->buf_size) {
+        return true;
+    }
+    *err = w->Flush();
+    if (*err < 0) {
+        return false;
+    }
+    return writer->iov_num < writer->iov_max && writer->buf_used + len <= writer->buf_size;
+}
+
+int CTcpWriter::WriteRef(const void* data, int length)
+{
+    tcp_writer_t* writer = (tcp_writer_t*) m_writer;
+    int err = 0;
+    if (writer == NULL || writer->conn->sockfd < 0) {
+        return -1;
+    }
+    if (length <= 0) {
+        return 0;
+    }
+    if (!writer_has_room(this, writer, 0, &err)) {
+        return err < 0 ? -1 : 0;
+    }
+    writer->iov[writer->iov_num].iov_base = (void*) data;
+    writer->iov[writer->iov_num].iov_len = length;
+    writer->iov_num++;
+    writer->pending += length;
+    /* a large message is worth a segment of its own, send it with what is queued before it */
+    if (Flush() < 0) {
+        return -1;
+    }
+    return length;
+}
+
+int CTcpWriter::Write(const void* data, int length)
+{
+    tcp_writer_t* writer = (tcp_writer_t*) m_writer;
+    int err = 0;
+    if (writer == NULL || writer->conn->sockfd < 0) {
+        return -1;
+    }
+    if (length >= writer->copy_limit) {
+        return WriteRef(data, length);
+    }
+    if (length <= 0) {
+        return 0;
+    }
+    struct iovec* last = writer->iov_num > 0 ? &writer->iov[writer->iov_num - 1] : NULL;
+    bool extend = last && (uint8_t*) last->iov_base + last->iov_len == writer->buf + writer->buf_used;
+    if (!(extend && writer->buf_used + length <= writer->buf_size)) {
+        if (!writer_has_room(this, writer, length, &err)) {
+            return err < 0 ? -1 : 0;
+        }
+        /* Flush() may have moved or emptied the segment list */
+        last = writer->iov_num > 0 ? &writer->iov[writer->iov_num - 1] : NULL;
+        extend = last && (uint8_t*) last->iov_base + last->iov_len == writer->buf + writer->buf_used;
+    }
+    memcpy(writer->buf + writer->buf_used, data, length);
+    if (extend) {
+        last->iov_len += length;
+    } else {
+        writer->iov[writer->iov_num].iov_base = writer->buf + writer->buf_used;
+        writer->iov[writer->iov_num].iov_len = length;
+        writer->iov_num++;
+    }
+    writer->buf_used += length;
+    writer->pending += length;
+    return length;
+}
+
+int CTcpWriter::GetPending()
+{
+    tcp_writer_t* writer = (tcp_writer_t*) m_writer;
+    return writer ? writer->pending : 0;
+}
@@ -0,0 +1,135 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * pthread stand-ins for the FreeRTOS tasks and semaphores the TCP classes use.
+ */
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+typedef struct {
+    pthread_mutex_t mutex;
+    sem_t sem;
+    bool binary;
+} host_sem_t;
+
+typedef struct {
+    pthread_t thread;
+    TaskFunction_t func;
+    void *arg;
+} host_task_t;
+
+static __thread host_task_t *s_current;
+
+static void *host_task_entry(void *arg)
+{
+    s_current = (host_task_t *) arg;
+    s_current->func(s_current->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, unsigned stack, void *arg, UBaseType_t prio, TaskHandle_t *handle)
+{
+    host_task_t *task = (host_task_t *) calloc(1, sizeof(host_task_t));
+    task->func = func;
+    task->arg = arg;
+    if (handle) {
+        *handle = task;
+    }
+    if (pthread_create(&task->thread, NULL, host_task_entry, task) != 0) {
+        free(task);
+        return pdFALSE;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return s_current;
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    /* only a task deleting itself at the end of its function is supported */
+    if (handle == NULL && s_current) {
+        host_task_t *task = s_current;
+        s_current = NULL;
+        free(task);
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    usleep(ticks * portTICK_PERIOD_MS * 1000);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+    host_sem_t *sem = (host_sem_t *) calloc(1, sizeof(host_sem_t));
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&sem->mutex, &attr);
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    host_sem_t *sem = (host_sem_t *) calloc(1, sizeof(host_sem_t));
+    sem->binary = true;
+    sem_init(&sem->sem, 0, 0);
+    return sem;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    pthread_mutex_lock(&((host_sem_t *) sem)->mutex);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem)
+{
+    pthread_mutex_unlock(&((host_sem_t *) sem)->mutex);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    sem_wait(&((host_sem_t *) sem)->sem);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    sem_post(&((host_sem_t *) sem)->sem);
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    host_sem_t *s = (host_sem_t *) sem;
+    if (s->binary) {
+        sem_destroy(&s->sem);
+    } else {
+        pthread_mutex_destroy(&s->mutex);
+    }
+    free(s);
+}
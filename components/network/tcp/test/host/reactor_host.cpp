@@ -0,0 +1,195 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Runs CTcpReactor on Linux loopback.
+ *
+ *   reactor_host [clients]     default 450
+ *
+ * Load: the clients connect at once and each sends 20 numbered messages to an
+ * echo server on one reactor task, every echo must come back to its client. All
+ * clients then close and every close must be reported.
+ *
+ * Backpressure: 4 MB are sent with Send() to a client with a 4 KB receive
+ * buffer that reads slowly. Send() accepts less than asked while the write
+ * buffer is full, and the stream must arrive byte exact. A closed connection
+ * id must then be rejected.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "freertos/FreeRTOS.h"
+#include "lwip/sockets.h"
+#include "iot_tcp.h"
+
+#define HOST_LOAD_PORT      9876
+#define HOST_BP_PORT        9877
+#define HOST_ROUNDS         20
+#define HOST_BP_LEN         (4 << 20)
+
+#define CHECK(c) do { if (!(c)) { printf("FAIL line %d: %s\n", __LINE__, #c); exit(1); } } while (0)
+
+static volatile int s_accepted;
+static volatile int s_closed;
+static volatile int s_conn_id = -1;
+
+static double host_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int host_connect(uint16_t port)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(fd >= 0 && connect(fd, (struct sockaddr*) &addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+static void host_accept(CTcpReactor* server, int conn_id, void* arg)
+{
+    s_conn_id = conn_id;
+    __sync_fetch_and_add(&s_accepted, 1);
+}
+
+static void host_echo(CTcpReactor* server, int conn_id, const uint8_t* data, int len, void* arg)
+{
+    CHECK(server->Send(conn_id, data, len) == len);
+}
+
+static void host_drop(CTcpReactor* server, int conn_id, const uint8_t* data, int len, void* arg)
+{
+}
+
+static void host_close(CTcpReactor* server, int conn_id, void* arg)
+{
+    __sync_fetch_and_add(&s_closed, 1);
+}
+
+static void host_test_load(int clients)
+{
+    CTcpReactor server(clients, 256, 4096);
+    server.SetCallbacks(host_accept, host_echo, host_close, NULL);
+    CHECK(server.Listen(HOST_LOAD_PORT, 128) >= 0);
+    CHECK(server.Start() >= 0);
+    int* fds = (int*) malloc(clients * sizeof(int));
+    double start = host_now();
+    for (int i = 0; i < clients; i++) {
+        fds[i] = host_connect(HOST_LOAD_PORT);
+    }
+    for (int r = 0; r < HOST_ROUNDS; r++) {
+        char msg[64];
+        char buf[64];
+        for (int i = 0; i < clients; i++) {
+            int len = snprintf(msg, sizeof(msg), "%05d-%03d-payload-data", i, r);
+            CHECK(send(fds[i], msg, len, 0) == len);
+        }
+        for (int i = 0; i < clients; i++) {
+            int len = snprintf(msg, sizeof(msg), "%05d-%03d-payload-data", i, r);
+            for (int got = 0, n; got < len; got += n) {
+                CHECK((n = recv(fds[i], buf + got, len - got, 0)) > 0);
+            }
+            CHECK(memcmp(buf, msg, len) == 0);
+        }
+    }
+    double elapsed = host_now() - start;
+    CHECK(s_accepted == clients && server.GetConnNum() == clients);
+    printf("load: %d clients, %d echoes each, %.0f ms\n", clients, HOST_ROUNDS, elapsed * 1e3);
+    for (int i = 0; i < clients; i++) {
+        close(fds[i]);
+    }
+    for (int i = 0; i < 1000 && s_closed < clients; i++) {
+        usleep(1000);
+    }
+    printf("load: %d closes reported, %d connections left\n", s_closed, server.GetConnNum());
+    CHECK(s_closed == clients && server.GetConnNum() == 0);
+    server.Stop();
+    free(fds);
+}
+
+static void host_test_backpressure(void)
+{
+    CTcpReactor server(2, 64, 3000);
+    server.SetCallbacks(host_accept, host_drop, NULL, NULL);
+    CHECK(server.Listen(HOST_BP_PORT, 4) >= 0);
+    CHECK(server.Start() >= 0);
+    s_conn_id = -1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int size = 4096;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(HOST_BP_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(connect(fd, (struct sockaddr*) &addr, sizeof(addr)) == 0);
+    while (s_conn_id < 0) {
+        usleep(1000);
+    }
+    int conn_id = s_conn_id;
+    uint8_t* out = (uint8_t*) malloc(HOST_BP_LEN);
+    uint8_t* in = (uint8_t*) malloc(HOST_BP_LEN);
+    for (int i = 0; i < HOST_BP_LEN; i++) {
+        out[i] = (i * 7) ^ (i >> 9);
+    }
+    int sent = 0;
+    int got = 0;
+    int partial = 0;
+    while (sent < HOST_BP_LEN || got < HOST_BP_LEN) {
+        if (sent < HOST_BP_LEN) {
+            int len = HOST_BP_LEN - sent < 1000 ? HOST_BP_LEN - sent : 1000;
+            int ret = server.Send(conn_id, out + sent, len);
+            CHECK(ret >= 0);
+            partial += ret < len;
+            sent += ret;
+        }
+        /* the reader falls behind until the writer has been held up a few times */
+        if (partial > 50 || sent == HOST_BP_LEN) {
+            int ret = recv(fd, in + got, HOST_BP_LEN - got, MSG_DONTWAIT);
+            got += ret > 0 ? ret : 0;
+        }
+    }
+    printf("backpressure: %d bytes, Send() accepted less %d times\n", HOST_BP_LEN, partial);
+    CHECK(partial > 0 && memcmp(in, out, HOST_BP_LEN) == 0);
+    CHECK(server.Close(conn_id) >= 0);
+    for (int i = 0; i < 1000 && server.GetConnNum() > 0; i++) {
+        usleep(1000);
+    }
+    CHECK(server.GetConnNum() == 0);
+    CHECK(server.Send(conn_id, out, 1) < 0 && server.Close(conn_id) < 0);
+    server.Stop();
+    close(fd);
+    free(out);
+    free(in);
+}
+
+int main(int argc, char** argv)
+{
+    int clients = argc > 1 ? atoi(argv[1]) : 450;
+    /* one descriptor per client on each side */
+    struct rlimit limit = { 4096, 4096 };
+    setrlimit(RLIMIT_NOFILE, &limit);
+    host_test_load(clients);
+    host_test_backpressure();
+    printf("ALL PASS\n");
+    return 0;
+}
@@ -0,0 +1,14 @@
+/* host stand-in for the FreeRTOS types the TCP classes use */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef unsigned TickType_t;
+
+#define portMAX_DELAY       0xffffffff
+#define portTICK_PERIOD_MS  1
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              1
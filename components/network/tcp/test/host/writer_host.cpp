@@ -0,0 +1,165 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Runs CTcpWriter on Linux loopback.
+ *
+ *   writer_host [records]      default 200000
+ *
+ * Throughput: numbered 24 byte records are written one by one with
+ * CTcpConn::Write(), then through a CTcpWriter with a 1460 byte buffer. A reader
+ * task stores the stream, and every record must have arrived in order.
+ *
+ * Non-blocking: small copied records and large records queued by reference
+ * are written to a peer that does not read until Write() returns 0. The peer
+ * then reads while Flush() sends the rest, and the stream must arrive byte exact.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "iot_tcp.h"
+
+#define HOST_PORT           9900
+#define HOST_REC_LEN        24
+#define HOST_BIG_LEN        3000
+
+#define CHECK(c) do { if (!(c)) { printf("FAIL line %d: %s\n", __LINE__, #c); exit(1); } } while (0)
+
+static CTcpConn* s_peer;
+static uint8_t* s_stream;
+static volatile long s_received;
+
+static double host_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void host_record(char* rec, int seq)
+{
+    memset(rec, '.', HOST_REC_LEN);
+    snprintf(rec, HOST_REC_LEN, "%010d", seq);
+}
+
+/* reads the stream until the connection closes, it is checked after the timing */
+static void host_reader(void* arg)
+{
+    int ret;
+    while ((ret = s_peer->Read(s_stream + s_received, 65536, 0)) > 0) {
+        s_received += ret;
+    }
+    vTaskDelete(NULL);
+}
+
+static void host_test_throughput(int records)
+{
+    char* recs = (char*) malloc((size_t) records * HOST_REC_LEN);
+    s_stream = (uint8_t*) malloc((size_t) records * HOST_REC_LEN + 65536);
+    for (int i = 0; i < records; i++) {
+        host_record(recs + (size_t) i * HOST_REC_LEN, i);
+    }
+    for (int mode = 0; mode < 2; mode++) {
+        CTcpServer server;
+        CTcpConn client;
+        CHECK(server.Listen(HOST_PORT + mode, 1) >= 0);
+        CHECK(client.Connect("127.0.0.1", HOST_PORT + mode) >= 0);
+        CHECK((s_peer = server.Accept()) != NULL);
+        s_received = 0;
+        xTaskCreate(host_reader, "reader", 4096, NULL, 5, NULL);
+        double start = host_now();
+        if (mode == 0) {
+            for (int i = 0; i < records; i++) {
+                CHECK(client.Write(recs + (size_t) i * HOST_REC_LEN, HOST_REC_LEN) == HOST_REC_LEN);
+            }
+        } else {
+            CTcpWriter writer(&client, 1460, 16, 128);
+            for (int i = 0; i < records; i++) {
+                CHECK(writer.Write(recs + (size_t) i * HOST_REC_LEN, HOST_REC_LEN) == HOST_REC_LEN);
+            }
+            CHECK(writer.Flush() == 0);
+        }
+        while (s_received < (long) records * HOST_REC_LEN) {
+            usleep(100);
+        }
+        double elapsed = host_now() - start;
+        printf("%-15s %d records of %d bytes: %.1f ms, %.0f records per second\n",
+               mode ? "CTcpWriter" : "CTcpConn::Write", records, HOST_REC_LEN, elapsed * 1e3, records / elapsed);
+        CHECK(memcmp(s_stream, recs, (size_t) records * HOST_REC_LEN) == 0);
+        client.Disconnect();
+        usleep(10000);
+        delete s_peer;
+    }
+    free(recs);
+    free(s_stream);
+}
+
+static void host_test_nonblock(void)
+{
+    CTcpServer server;
+    CTcpConn client;
+    CHECK(server.Listen(HOST_PORT + 2, 1) >= 0);
+    CHECK(client.Connect("127.0.0.1", HOST_PORT + 2) >= 0);
+    CTcpConn* peer = server.Accept();
+    CHECK(peer != NULL);
+    CHECK(client.SetNonBlock(true) >= 0);
+    static uint8_t big[HOST_BIG_LEN];
+    for (int i = 0; i < HOST_BIG_LEN; i++) {
+        big[i] = i * 13;
+    }
+    /* what the peer must read: records and big blocks in the order they were accepted */
+    size_t cap = 16 << 20;
+    uint8_t* expect = (uint8_t*) malloc(cap);
+    size_t expect_len = 0;
+    CTcpWriter writer(&client, 1024, 8, 128);
+    for (int i = 0; ; i++) {
+        char rec[HOST_REC_LEN];
+        host_record(rec, i);
+        int ret = (i % 10 == 9) ? writer.WriteRef(big, HOST_BIG_LEN) : writer.Write(rec, HOST_REC_LEN);
+        CHECK(ret >= 0);
+        if (ret == 0) {
+            break;
+        }
+        CHECK(expect_len + ret <= cap);
+        memcpy(expect + expect_len, (i % 10 == 9) ? (const void*) big : (const void*) rec, ret);
+        expect_len += ret;
+    }
+    printf("non-blocking: %u bytes accepted before Write() returned 0, %d queued\n",
+           (unsigned) expect_len, writer.GetPending());
+    uint8_t* got = (uint8_t*) malloc(expect_len);
+    size_t got_len = 0;
+    while (got_len < expect_len) {
+        int ret = peer->Read(got + got_len, expect_len - got_len, 1000);
+        CHECK(ret > 0);
+        got_len += ret;
+        CHECK(writer.Flush() >= 0);
+    }
+    CHECK(writer.GetPending() == 0 && memcmp(got, expect, expect_len) == 0);
+    free(expect);
+    free(got);
+    delete peer;
+}
+
+int main(int argc, char** argv)
+{
+    int records = argc > 1 ? atoi(argv[1]) : 200000;
+    host_test_throughput(records);
+    host_test_nonblock();
+    printf("ALL PASS\n");
+    return 0;
+}
@@ -0,0 +1,138 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "unity.h"
+#include "tcpip_adapter.h"
+#include "iot_tcp.h"
+
+#define REACTOR_TEST_PORT       8765
+#define REACTOR_TEST_MAX_CONN   4
+#define REACTOR_TEST_CLIENTS    REACTOR_TEST_MAX_CONN
+
+typedef struct {
+    int accepted;
+    int closed;
+    int last_id;
+    int bytes;
+} reactor_test_stat_t;
+
+static void reactor_test_accept(CTcpReactor* server, int conn_id, void* arg)
+{
+    reactor_test_stat_t* stat = (reactor_test_stat_t*) arg;
+    stat->accepted++;
+    stat->last_id = conn_id;
+}
+
+static void reactor_test_echo(CTcpReactor* server, int conn_id, const uint8_t* data, int len, void* arg)
+{
+    reactor_test_stat_t* stat = (reactor_test_stat_t*) arg;
+    stat->bytes += len;
+    if (len == 1 && data[0] == 'q') {
+        server->Close(conn_id);
+        return;
+    }
+    server->Send(conn_id, data, len);
+}
+
+static void reactor_test_close(CTcpReactor* server, int conn_id, void* arg)
+{
+    reactor_test_stat_t* stat = (reactor_test_stat_t*) arg;
+    stat->closed++;
+}
+
+static int reactor_test_read(CTcpConn* conn, uint8_t* buf, int len)
+{
+    int got = 0;
+    while (got < len) {
+        int ret = conn->Read(buf + got, len - got, 2);
+        if (ret <= 0) {
+            break;
+        }
+        got += ret;
+    }
+    return got;
+}
+
+TEST_CASE("TCP reactor echo test", "[tcp_reactor][iot]")
+{
+    reactor_test_stat_t stat;
+    memset(&stat, 0, sizeof(stat));
+    tcpip_adapter_init();
+
+    CTcpReactor* server = new CTcpReactor(REACTOR_TEST_MAX_CONN, 64, 256);
+    server->SetCallbacks(reactor_test_accept, reactor_test_echo, reactor_test_close, &stat);
+    TEST_ASSERT_EQUAL(0, server->Listen(REACTOR_TEST_PORT, 8));
+    TEST_ASSERT_EQUAL(0, server->Start());
+
+    CTcpConn* client[REACTOR_TEST_CLIENTS];
+    for (int i = 0; i < REACTOR_TEST_CLIENTS; i++) {
+        client[i] = new CTcpConn();
+        TEST_ASSERT_EQUAL(0, client[i]->Connect("127.0.0.1", REACTOR_TEST_PORT));
+    }
+    /* interleave the clients, every one is served by the single reactor task */
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < REACTOR_TEST_CLIENTS; i++) {
+            char msg[32];
+            uint8_t echo[32];
+            int len = snprintf(msg, sizeof(msg), "client %d round %d", i, round);
+            TEST_ASSERT_EQUAL(len, client[i]->Write(msg, len));
+            TEST_ASSERT_EQUAL(len, reactor_test_read(client[i], echo, len));
+            TEST_ASSERT_EQUAL_MEMORY(msg, echo, len);
+        }
+    }
+    TEST_ASSERT_EQUAL(REACTOR_TEST_CLIENTS, stat.accepted);
+    TEST_ASSERT_EQUAL(REACTOR_TEST_CLIENTS, server->GetConnNum());
+
+    /* more than rx_size bytes are delivered in several callbacks and still echoed in order */
+    uint8_t big[200], back[200];
+    for (int i = 0; i < (int) sizeof(big); i++) {
+        big[i] = i;
+    }
+    TEST_ASSERT_EQUAL(sizeof(big), client[0]->Write(big, sizeof(big)));
+    TEST_ASSERT_EQUAL(sizeof(big), reactor_test_read(client[0], back, sizeof(back)));
+    TEST_ASSERT_EQUAL_MEMORY(big, back, sizeof(big));
+
+    /* the server closes on request, the client sees EOF */
+    TEST_ASSERT_EQUAL(1, client[1]->Write("q", 1));
+    TEST_ASSERT_EQUAL(0, client[1]->Read(back, sizeof(back), 2));
+    client[1]->Disconnect();
+    /* the peer closes */
+    client[2]->Disconnect();
+    vTaskDelay(200 / portTICK_PERIOD_MS);
+    TEST_ASSERT_EQUAL(2, stat.closed);
+    TEST_ASSERT_EQUAL(REACTOR_TEST_CLIENTS - 2, server->GetConnNum());
+
+    /* a new client may reuse a slot, the old ids stay invalid */
+    int old_id = stat.last_id;
+    CTcpConn* late = new CTcpConn();
+    TEST_ASSERT_EQUAL(0, late->Connect("127.0.0.1", REACTOR_TEST_PORT));
+    TEST_ASSERT_EQUAL(1, late->Write("x", 1));
+    TEST_ASSERT_EQUAL(1, reactor_test_read(late, back, 1));
+    TEST_ASSERT_NOT_EQUAL(old_id, stat.last_id);
+    TEST_ASSERT_EQUAL(3, server->Send(stat.last_id, "abc", 3));
+    TEST_ASSERT_EQUAL(3, reactor_test_read(late, back, 3));
+
+    server->Stop();
+    TEST_ASSERT_EQUAL(0, server->GetConnNum());
+    TEST_ASSERT_EQUAL(REACTOR_TEST_CLIENTS + 1, stat.closed);
+    TEST_ASSERT_LESS_THAN(0, server->Send(stat.last_id, "abc", 3));
+
+    delete late;
+    for (int i = 0; i < REACTOR_TEST_CLIENTS; i++) {
+        delete client[i];
+    }
+    delete server;
+}
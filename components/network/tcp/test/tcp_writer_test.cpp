@@ -0,0 +1,100 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "unity.h"
+#include "tcpip_adapter.h"
+#include "iot_tcp.h"
+
+#define WRITER_TEST_PORT    8766
+
+static int writer_test_read(CTcpConn* conn, uint8_t* buf, int len)
+{
+    int got = 0;
+    while (got < len) {
+        int ret = conn->Read(buf + got, len - got, 2);
+        if (ret <= 0) {
+            break;
+        }
+        got += ret;
+    }
+    return got;
+}
+
+TEST_CASE("TCP writer coalescing test", "[tcp_writer][iot]")
+{
+    tcpip_adapter_init();
+    CTcpServer server;
+    CTcpConn client;
+    TEST_ASSERT_EQUAL(0, server.Listen(WRITER_TEST_PORT, 1));
+    TEST_ASSERT_EQUAL(0, client.Connect("127.0.0.1", WRITER_TEST_PORT));
+    CTcpConn* peer = server.Accept();
+    TEST_ASSERT_NOT_NULL(peer);
+
+    static uint8_t expect[4096], got[4096];
+    static uint8_t large[600];
+    int len = 0;
+    CTcpWriter* writer = new CTcpWriter(&client, 256, 4, 128);
+    for (int i = 0; i < (int) sizeof(large); i++) {
+        large[i] = 0xff - i;
+    }
+    /* tiny records are queued until the buffer or the segment list is full */
+    for (int i = 0; i < 100; i++) {
+        char rec[16];
+        int n = snprintf(rec, sizeof(rec), "rec%03d;", i);
+        TEST_ASSERT_EQUAL(n, writer->Write(rec, n));
+        memcpy(expect + len, rec, n);
+        len += n;
+        if (i == 10) {
+            TEST_ASSERT_EQUAL(len, writer->GetPending());
+        }
+        /* a large record goes out by reference together with the queued ones */
+        if (i == 50) {
+            TEST_ASSERT_EQUAL(sizeof(large), writer->Write(large, sizeof(large)));
+            memcpy(expect + len, large, sizeof(large));
+            len += sizeof(large);
+            TEST_ASSERT_EQUAL(0, writer->GetPending());
+        }
+    }
+    TEST_ASSERT_EQUAL(0, writer->Flush());
+    TEST_ASSERT_EQUAL(len, writer_test_read(peer, got, len));
+    TEST_ASSERT_EQUAL_MEMORY(expect, got, len);
+    delete writer;
+
+    /* non-blocking: the queue is kept when the socket is full and sent on later flushes */
+    static uint8_t block[1024];
+    int total = 0;
+    int read = 0;
+    TEST_ASSERT_EQUAL(0, client.SetNonBlock(true));
+    writer = new CTcpWriter(&client, 256, 4, 64);
+    while (writer->WriteRef(block, sizeof(block)) > 0) {
+        total += sizeof(block);
+        TEST_ASSERT_TRUE(total < 4 * 1024 * 1024);
+    }
+    TEST_ASSERT_TRUE(writer->GetPending() > 0);
+    TEST_ASSERT_TRUE(writer->Write("x", 1) >= 0);
+    while (writer->GetPending() > 0 || read < total) {
+        int ret = peer->Read(got, sizeof(got), 2);
+        TEST_ASSERT_TRUE(ret > 0);
+        read += ret;
+        TEST_ASSERT_TRUE(writer->Flush() >= 0);
+    }
+    TEST_ASSERT_EQUAL(0, writer->GetPending());
+    delete writer;
+
+    delete peer;
+    client.Disconnect();
+    server.Stop();
+}
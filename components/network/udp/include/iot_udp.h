@@ -18,6 +18,7 @@
 #include "tcpip_adapter.h"
 class CUdpConn
 {
+friend class CUdpBatch;
 private:
     /**
      * prevent copy constructing
@@ -52,7 +53,7 @@ public:
      * @brief read data from socket
      * @param data buffer to receive data from socket
      * @param length max length for receive buffer
-     * @param timeout for reading data
+     * @param timeout for reading data, the socket option is only updated when it differs from the last one
      * @return
      *     <0 if fail to read
      *     otherwise data length that read from socket
@@ -101,5 +102,89 @@ public:
     void Close();
 };
 
+/**
+ * @brief datagram in a CUdpBatch packet pool, or a datagram to send
+ */
+typedef struct {
+    uint8_t* data;              /**< payload */
+    int len;                    /**< payload length */
+    struct sockaddr_in addr;    /**< source address on receive, destination address on send */
+    bool truncated;             /**< the datagram was longer than the pool packet size and was cut to it */
+} udp_packet_t;
+
+/**
+ * @brief per socket counters of CUdpBatch
+ */
+typedef struct {
+    uint32_t rx_packets;        /**< datagrams received */
+    uint32_t rx_bytes;          /**< payload bytes received */
+    uint32_t rx_truncated;      /**< datagrams cut to the pool packet size */
+    uint32_t rx_overrun;        /**< Recv() calls that filled the whole pool, more datagrams were probably waiting */
+    uint32_t rx_dropped;        /**< datagrams dropped by the stack because the socket queue was full, where reported (SO_RXQ_OVFL) */
+    uint32_t tx_packets;        /**< datagrams sent */
+    uint32_t tx_bytes;          /**< payload bytes sent */
+    uint32_t tx_dropped;        /**< datagrams not sent because the stack was out of buffers */
+    uint32_t tx_error;          /**< datagrams not sent because of other socket errors */
+} udp_stat_t;
+
+/**
+ * @brief Batched datagram I/O on a CUdpConn.
+ *        Received datagrams are stored in a pool allocated once at construction and are
+ *        fetched several at a time, with recvmmsg()/sendmmsg() where the platform has them
+ *        and a non-blocking loop otherwise, so bursts of small packets need no allocation
+ *        and far fewer system calls.
+ */
+class CUdpBatch
+{
+private:
+    /**
+     * prevent copy constructing
+     */
+    CUdpBatch(const CUdpBatch&);
+    CUdpBatch& operator = (const CUdpBatch&);
+    void* m_batch;
+
+public:
+    /**
+     * @brief constructor of CUdpBatch
+     * @param conn UDP socket, must outlive the batch object
+     * @param pkt_num number of packets in the pool, the max datagrams returned by one Recv()
+     * @param pkt_size size of each packet buffer, longer datagrams are truncated
+     */
+    CUdpBatch(CUdpConn* conn, int pkt_num = 8, int pkt_size = 256);
+    ~CUdpBatch();
+
+    /**
+     * @brief wait for datagrams and receive all that are queued, up to the pool size
+     * @param pkts returns the pool packets, valid until the next Recv()
+     * @param timeout_ms max time to wait for the first datagram, <0 to wait forever, 0 to poll
+     * @return
+     *     <0 if the socket failed
+     *     otherwise the number of datagrams received, 0 on timeout
+     */
+    int Recv(udp_packet_t** pkts, int timeout_ms);
+
+    /**
+     * @brief send several datagrams, each to its own destination address
+     * @param pkts datagrams to send
+     * @param num number of datagrams
+     * @return
+     *     <0 if the socket is not valid
+     *     otherwise the number of datagrams sent, datagrams that fail are counted in the statistics and skipped
+     */
+    int Send(const udp_packet_t* pkts, int num);
+
+    /**
+     * @brief get the socket counters
+     * @param stat pointer to the counters to fill
+     */
+    void GetStat(udp_stat_t* stat);
+
+    /**
+     * @brief clear the socket counters
+     */
+    void ResetStat();
+};
+
 #endif
 #endif
@@ -67,13 +67,18 @@ int CUdpConn::RecvFrom(uint8_t* data, int length, struct sockaddr *from, size_t
         return -1;
     }
 
-    if (timeout > 0) {
+    /* SO_RCVTIMEO stays set on the socket, only change it when the timeout differs */
+    if (timeout > 0 && timeout != tout) {
         ret = SetTimeout(timeout);
         if (ret < 0) {
             return ret;
         }
     }
-    ret = recvfrom(sockfd, data, length, 0, from, fromlen);
+    socklen_t addr_len = fromlen ? *fromlen : 0;
+    ret = recvfrom(sockfd, data, length, 0, from, fromlen ? &addr_len : NULL);
+    if (fromlen) {
+        *fromlen = addr_len;
+    }
     return ret;
 }
 
@@ -147,5 +152,6 @@ void CUdpConn::Close()
 {
     close(sockfd);
     sockfd = -1;
+    tout = 0;
 }
 
@@ -0,0 +1,6 @@
+#pragma once
+#include <stdint.h>
+#define portMAX_DELAY 0xffffffff
+#define portTICK_PERIOD_MS 1
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
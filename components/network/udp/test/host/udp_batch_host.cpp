@@ -0,0 +1,137 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Runs CUdpBatch on Linux loopback: a burst read a pool at a time, truncation
+ * of datagrams longer than the pool packets, then a throughput comparison with
+ * CUdpConn. Built twice by the Makefile, once with recvmmsg()/sendmmsg() and once
+ * with the recvfrom()/sendto() loop used on lwIP.
+ *
+ *   udp_batch_host [datagrams]     default 200000
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lwip/sockets.h"
+#include "iot_udp.h"
+
+#define HOST_PORT       7790
+#define HOST_BURST      32
+#define HOST_PKT_LEN    48
+
+#define CHECK(c) do { if (!(c)) { printf("FAIL line %d: %s\n", __LINE__, #c); exit(1); } } while (0)
+
+static double host_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void host_packets(udp_packet_t* pkts, char (*payload)[64], int num, int len)
+{
+    for (int i = 0; i < num; i++) {
+        memset(payload[i], 'a' + i % 26, len);
+        pkts[i].data = (uint8_t*) payload[i];
+        pkts[i].len = len;
+        memset(&pkts[i].addr, 0, sizeof(pkts[i].addr));
+        pkts[i].addr.sin_family = AF_INET;
+        pkts[i].addr.sin_port = htons(HOST_PORT);
+        pkts[i].addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    }
+}
+
+static void host_test_truncation(CUdpConn* server, CUdpConn* client)
+{
+    CUdpBatch rx(server, 4, 32);
+    CUdpBatch tx(client, 4, 32);
+    udp_packet_t out[3];
+    char payload[3][64];
+    udp_packet_t* pkts;
+    udp_stat_t stat;
+    host_packets(out, payload, 3, 0);
+    out[0].len = 31;
+    out[1].len = 32;
+    out[2].len = 40;
+    CHECK(tx.Send(out, 3) == 3);
+    int got = 0;
+    while (got < 3) {
+        int num = rx.Recv(&pkts, 1000);
+        CHECK(num > 0);
+        for (int i = 0; i < num; i++, got++) {
+            CHECK(pkts[i].len == (out[got].len < 32 ? out[got].len : 32));
+            CHECK(pkts[i].truncated == (out[got].len > 32));
+            CHECK(memcmp(pkts[i].data, payload[got], pkts[i].len) == 0);
+        }
+    }
+    rx.GetStat(&stat);
+    CHECK(stat.rx_packets == 3 && stat.rx_truncated == 1 && stat.rx_bytes == 31 + 32 + 32);
+    printf("truncation: 31, 32 and 40 bytes into 32 byte packets, rx_truncated %u\n", stat.rx_truncated);
+}
+
+static void host_bench(CUdpConn* server, CUdpConn* client, int total)
+{
+    udp_packet_t out[HOST_BURST];
+    char payload[HOST_BURST][64];
+    host_packets(out, payload, HOST_BURST, HOST_PKT_LEN);
+    for (int mode = 0; mode < 2; mode++) {
+        CUdpBatch tx(client, HOST_BURST, 64);
+        CUdpBatch rx(server, HOST_BURST, 64);
+        uint8_t buf[64];
+        struct sockaddr_in from;
+        size_t from_len;
+        long got = 0;
+        double start = host_now();
+        for (int sent = 0; sent < total; sent += HOST_BURST) {
+            if (mode == 0) {
+                for (int i = 0; i < HOST_BURST; i++) {
+                    client->SendTo(payload[i], HOST_PKT_LEN, 0, (struct sockaddr*) &out[i].addr);
+                }
+                for (int i = 0; i < HOST_BURST; i++) {
+                    from_len = sizeof(from);
+                    if (server->RecvFrom(buf, sizeof(buf), (struct sockaddr*) &from, &from_len, 1) > 0) {
+                        got++;
+                    }
+                }
+            } else {
+                tx.Send(out, HOST_BURST);
+                udp_packet_t* pkts;
+                int num;
+                for (int burst = 0; burst < HOST_BURST; burst += num) {
+                    if ((num = rx.Recv(&pkts, 1000)) <= 0) {
+                        break;
+                    }
+                    got += num;
+                }
+            }
+        }
+        double elapsed = host_now() - start;
+        printf("%-9s %ld datagrams of %d bytes in bursts of %d: %.0f ms, %.0f per second\n", mode ? "CUdpBatch" : "CUdpConn",
+               got, HOST_PKT_LEN, HOST_BURST, elapsed * 1e3, got / elapsed);
+        CHECK(got >= total * 99 / 100);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int total = argc > 1 ? atoi(argv[1]) : 200000;
+    CUdpConn server;
+    CUdpConn client;
+    CHECK(server.Bind(HOST_PORT) == 0);
+    host_test_truncation(&server, &client);
+    host_bench(&server, &client, total);
+    printf("ALL PASS\n");
+    return 0;
+}
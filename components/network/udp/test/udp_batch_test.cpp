@@ -0,0 +1,85 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "unity.h"
+#include "tcpip_adapter.h"
+#include "lwip/sockets.h"
+#include "iot_udp.h"
+
+#define BATCH_TEST_PORT     7788
+#define BATCH_TEST_POOL     8
+#define BATCH_TEST_PKTS     20
+
+TEST_CASE("UDP batch test", "[udp_batch][iot]")
+{
+    tcpip_adapter_init();
+    CUdpConn server;
+    CUdpConn client;
+    TEST_ASSERT_EQUAL(0, server.Bind(BATCH_TEST_PORT));
+    CUdpBatch* rx = new CUdpBatch(&server, BATCH_TEST_POOL, 32);
+    CUdpBatch* tx = new CUdpBatch(&client, BATCH_TEST_POOL, 32);
+
+    /* nothing queued, polling returns at once */
+    udp_packet_t* pkts = NULL;
+    TEST_ASSERT_EQUAL(0, rx->Recv(&pkts, 0));
+    TEST_ASSERT_EQUAL(0, rx->Recv(&pkts, 50));
+
+    udp_packet_t out[BATCH_TEST_PKTS];
+    char payload[BATCH_TEST_PKTS][16];
+    for (int i = 0; i < BATCH_TEST_PKTS; i++) {
+        out[i].len = snprintf(payload[i], sizeof(payload[i]), "pkt %d", i);
+        out[i].data = (uint8_t*) payload[i];
+        memset(&out[i].addr, 0, sizeof(out[i].addr));
+        out[i].addr.sin_family = AF_INET;
+        out[i].addr.sin_port = htons(BATCH_TEST_PORT);
+        out[i].addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    }
+    TEST_ASSERT_EQUAL(BATCH_TEST_PKTS, tx->Send(out, BATCH_TEST_PKTS));
+
+    /* the burst is read a pool at a time, in order */
+    int got = 0;
+    while (got < BATCH_TEST_PKTS) {
+        int num = rx->Recv(&pkts, 1000);
+        TEST_ASSERT_TRUE(num > 0 && num <= BATCH_TEST_POOL);
+        for (int i = 0; i < num; i++, got++) {
+            TEST_ASSERT_EQUAL(out[got].len, pkts[i].len);
+            TEST_ASSERT_EQUAL_MEMORY(payload[got], pkts[i].data, pkts[i].len);
+            TEST_ASSERT_EQUAL(inet_addr("127.0.0.1"), pkts[i].addr.sin_addr.s_addr);
+        }
+    }
+
+    /* reply to the sources straight from the pool */
+    TEST_ASSERT_EQUAL(1, rx->Send(pkts, 1));
+    uint8_t buf[32];
+    struct sockaddr_in from;
+    size_t from_len = sizeof(from);
+    TEST_ASSERT_EQUAL(pkts[0].len, client.RecvFrom(buf, sizeof(buf), (struct sockaddr*) &from, &from_len, 1));
+
+    udp_stat_t stat;
+    rx->GetStat(&stat);
+    TEST_ASSERT_EQUAL(BATCH_TEST_PKTS, stat.rx_packets);
+    TEST_ASSERT_TRUE(stat.rx_overrun >= 1);
+    TEST_ASSERT_EQUAL(1, stat.tx_packets);
+    tx->GetStat(&stat);
+    TEST_ASSERT_EQUAL(BATCH_TEST_PKTS, stat.tx_packets);
+    TEST_ASSERT_EQUAL(0, stat.tx_dropped + stat.tx_error);
+    tx->ResetStat();
+    tx->GetStat(&stat);
+    TEST_ASSERT_EQUAL(0, stat.tx_packets);
+
+    delete rx;
+    delete tx;
+}
@@ -0,0 +1,308 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "esp_log.h"
+
+#include "lwip/sockets.h"
+#include "iot_udp.h"
+
+/* lwIP has neither recvmmsg() nor sendmmsg(), use them where the C library provides them */
+#ifndef UDP_BATCH_USE_MMSG
+#if defined(__linux__)
+#define UDP_BATCH_USE_MMSG  1
+#else
+#define UDP_BATCH_USE_MMSG  0
+#endif
+#endif
+
+static const char* TAG = "udp_batch";
+
+typedef struct {
+    CUdpConn* conn;
+    int pkt_num;
+    int pkt_size;
+    uint8_t* pool;
+    udp_packet_t* pkts;
+#if UDP_BATCH_USE_MMSG
+    struct mmsghdr* msgs;
+    struct iovec* iov;
+    uint8_t* ctrl;
+#endif
+    uint32_t kernel_drops;
+    udp_stat_t stat;
+} udp_batch_t;
+
+#if UDP_BATCH_USE_MMSG && defined(SO_RXQ_OVFL)
+#define UDP_BATCH_CTRL_SIZE     CMSG_SPACE(sizeof(uint32_t))
+#else
+#define UDP_BATCH_CTRL_SIZE     0
+#endif
+
+CUdpBatch::CUdpBatch(CUdpConn* conn, int pkt_num, int pkt_size)
+{
+    udp_batch_t* batch = (udp_batch_t*) calloc(1, sizeof(udp_batch_t));
+    m_batch = batch;
+    if (batch == NULL) {
+        ESP_LOGE(TAG, "no memory for udp batch");
+        return;
+    }
+    batch->conn = conn;
+    batch->pkt_num = pkt_num > 0 ? pkt_num : 1;
+    batch->pkt_size = pkt_size > 0 ? pkt_size : 256;
+    /* one spare byte per packet: a datagram that fills it was longer than pkt_size */
+    batch->pool = (uint8_t*) malloc(batch->pkt_num * (batch->pkt_size + 1));
+    batch->pkts = (udp_packet_t*) calloc(batch->pkt_num, sizeof(udp_packet_t));
+    bool ok = batch->pool && batch->pkts;
+#if UDP_BATCH_USE_MMSG
+    batch->msgs = (struct mmsghdr*) calloc(batch->pkt_num, sizeof(struct mmsghdr));
+    batch->iov = (struct iovec*) calloc(batch->pkt_num, sizeof(struct iovec));
+    batch->ctrl = (uint8_t*) calloc(1, batch->pkt_num * UDP_BATCH_CTRL_SIZE + 1);
+    ok = ok && batch->msgs && batch->iov && batch->ctrl;
+#endif
+    if (!ok) {
+        ESP_LOGE(TAG, "no memory for packet pool");
+        free(batch->pool);
+        free(batch->pkts);
+#if UDP_BATCH_USE_MMSG
+        free(batch->msgs);
+        free(batch->iov);
+        free(batch->ctrl);
+#endif
+        free(batch);
+        m_batch = NULL;
+        return;
+    }
+    for (int i = 0; i < batch->pkt_num; i++) {
+        batch->pkts[i].data = batch->pool + i * (batch->pkt_size + 1);
+    }
+#if UDP_BATCH_USE_MMSG && defined(SO_RXQ_OVFL)
+    int on = 1;
+    setsockopt(conn->sockfd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+#endif
+}
+
+CUdpBatch::~CUdpBatch()
+{
+    udp_batch_t* batch = (udp_batch_t*) m_batch;
+    if (batch) {
+        free(batch->pool);
+        free(batch->pkts);
+#if UDP_BATCH_USE_MMSG
+        free(batch->msgs);
+        free(batch->iov);
+        free(batch->ctrl);
+#endif
+        free(batch);
+        m_batch = NULL;
+    }
+}
+
+static void udp_batch_rx_done(udp_batch_t* batch, udp_packet_t* pkt)
+{
+    batch->stat.rx_packets++;
+    batch->stat.rx_bytes += pkt->len;
+    if (pkt->truncated) {
+        batch->stat.rx_truncated++;
+    }
+}
+
+#if UDP_BATCH_USE_MMSG
+static int udp_batch_recv(udp_batch_t* batch, int fd)
+{
+    for (int i = 0; i < batch->pkt_num; i++) {
+        struct msghdr* hdr = &batch->msgs[i].msg_hdr;
+        batch->iov[i].iov_base = batch->pkts[i].data;
+        batch->iov[i].iov_len = batch->pkt_size;
+        memset(hdr, 0, sizeof(*hdr));
+        hdr->msg_name = &batch->pkts[i].addr;
+        hdr->msg_namelen = sizeof(batch->pkts[i].addr);
+        hdr->msg_iov = &batch->iov[i];
+        hdr->msg_iovlen = 1;
+        if (UDP_BATCH_CTRL_SIZE > 0) {
+            hdr->msg_control = batch->ctrl + i * UDP_BATCH_CTRL_SIZE;
+            hdr->msg_controllen = UDP_BATCH_CTRL_SIZE;
+        }
+    }
+    int num = recvmmsg(fd, batch->msgs, batch->pkt_num, MSG_DONTWAIT, NULL);
+    if (num < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+    for (int i = 0; i < num; i++) {
+        struct msghdr* hdr = &batch->msgs[i].msg_hdr;
+        udp_packet_t* pkt = &batch->pkts[i];
+        pkt->len = batch->msgs[i].msg_len < (unsigned) batch->pkt_size ? batch->msgs[i].msg_len : batch->pkt_size;
+        pkt->truncated = (hdr->msg_flags & MSG_TRUNC) != 0;
+        udp_batch_rx_done(batch, pkt);
+#ifdef SO_RXQ_OVFL
+        /* the kernel reports the total drop count of the socket with every datagram */
+        for (struct cmsghdr* c = CMSG_FIRSTHDR(hdr); c; c = CMSG_NXTHDR(hdr, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL) {
+                uint32_t drops;
+                memcpy(&drops, CMSG_DATA(c), sizeof(drops));
+                batch->stat.rx_dropped += drops - batch->kernel_drops;
+                batch->kernel_drops = drops;
+            }
+        }
+#endif
+    }
+    return num;
+}
+
+static int udp_batch_send(udp_batch_t* batch, int fd, const udp_packet_t* pkts, int num)
+{
+    int sent = 0;
+    while (num > 0) {
+        int chunk = num < batch->pkt_num ? num : batch->pkt_num;
+        for (int i = 0; i < chunk; i++) {
+            struct msghdr* hdr = &batch->msgs[i].msg_hdr;
+            batch->iov[i].iov_base = pkts[i].data;
+            batch->iov[i].iov_len = pkts[i].len;
+            memset(hdr, 0, sizeof(*hdr));
+            hdr->msg_name = (void*) &pkts[i].addr;
+            hdr->msg_namelen = sizeof(pkts[i].addr);
+            hdr->msg_iov = &batch->iov[i];
+            hdr->msg_iovlen = 1;
+        }
+        int ret = sendmmsg(fd, batch->msgs, chunk, 0);
+        if (ret < 0) {
+            /* the first datagram of the chunk failed, skip it */
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS || errno == ENOMEM) {
+                batch->stat.tx_dropped++;
+            } else {
+                batch->stat.tx_error++;
+            }
+            ret = 0;
+            chunk = 1;
+        } else {
+            chunk = ret;
+        }
+        for (int i = 0; i < ret; i++) {
+            batch->stat.tx_packets++;
+            batch->stat.tx_bytes += pkts[i].len;
+        }
+        sent += ret;
+        pkts += chunk;
+        num -= chunk;
+    }
+    return sent;
+}
+#else
+static int udp_batch_recv(udp_batch_t* batch, int fd)
+{
+    int num = 0;
+    while (num < batch->pkt_num) {
+        udp_packet_t* pkt = &batch->pkts[num];
+        socklen_t addr_len = sizeof(pkt->addr);
+        /* lwIP returns the copied length and no MSG_TRUNC, read one byte more to see a longer datagram */
+        int ret = recvfrom(fd, pkt->data, batch->pkt_size + 1, MSG_DONTWAIT, (struct sockaddr*) &pkt->addr, &addr_len);
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return num > 0 ? num : -1;
+        }
+        pkt->truncated = ret > batch->pkt_size;
+        pkt->len = pkt->truncated ? batch->pkt_size : ret;
+        udp_batch_rx_done(batch, pkt);
+        num++;
+    }
+    return num;
+}
+
+static int udp_batch_send(udp_batch_t* batch, int fd, const udp_packet_t* pkts, int num)
+{
+    int sent = 0;
+    for (int i = 0; i < num; i++) {
+        int ret = sendto(fd, pkts[i].data, pkts[i].len, 0, (const struct sockaddr*) &pkts[i].addr, sizeof(pkts[i].addr));
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS || errno == ENOMEM) {
+                batch->stat.tx_dropped++;
+            } else {
+                batch->stat.tx_error++;
+            }
+            continue;
+        }
+        batch->stat.tx_packets++;
+        batch->stat.tx_bytes += pkts[i].len;
+        sent++;
+    }
+    return sent;
+}
+#endif
+
+int CUdpBatch::Recv(udp_packet_t** pkts, int timeout_ms)
+{
+    udp_batch_t* batch = (udp_batch_t*) m_batch;
+    if (batch == NULL || batch->conn->sockfd < 0) {
+        return -1;
+    }
+    int fd = batch->conn->sockfd;
+    *pkts = batch->pkts;
+    /* take what is queued first, only wait when the socket is empty */
+    int num = udp_batch_recv(batch, fd);
+    if (num != 0 || timeout_ms == 0) {
+        if (num == batch->pkt_num) {
+            batch->stat.rx_overrun++;
+        }
+        return num;
+    }
+    /* select() instead of SO_RCVTIMEO, so the timeout costs no setsockopt() per call */
+    fd_set rd_set;
+    struct timeval tv;
+    FD_ZERO(&rd_set);
+    FD_SET(fd, &rd_set);
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    int ret = select(fd + 1, &rd_set, NULL, NULL, timeout_ms < 0 ? NULL : &tv);
+    if (ret <= 0) {
+        return (ret < 0 && errno != EINTR) ? -1 : 0;
+    }
+    num = udp_batch_recv(batch, fd);
+    if (num == batch->pkt_num) {
+        batch->stat.rx_overrun++;
+    }
+    return num;
+}
+
+int CUdpBatch::Send(const udp_packet_t* pkts, int num)
+{
+    udp_batch_t* batch = (udp_batch_t*) m_batch;
+    if (batch == NULL || batch->conn->sockfd < 0) {
+        return -1;
+    }
+    return udp_batch_send(batch, batch->conn->sockfd, pkts, num);
+}
+
+void CUdpBatch::GetStat(udp_stat_t* stat)
+{
+    udp_batch_t* batch = (udp_batch_t*) m_batch;
+    if (batch) {
+        *stat = batch->stat;
+    } else {
+        memset(stat, 0, sizeof(*stat));
+    }
+}
+
+void CUdpBatch::ResetStat()
+{
+    udp_batch_t* batch = (udp_batch_t*) m_batch;
+    if (batch) {
+        memset(&batch->stat, 0, sizeof(batch->stat));
+    }
+}
@@ -0,0 +1,37 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _ESPNOW_PEER_H_
+#define _ESPNOW_PEER_H_
+
+/* Peer table shared by iot_espnow.c and iot_espnow_peer.c, not part of the API */
+
+#include "esp_now.h"
+#include "iot_espnow.h"
+
+esp_err_t espnow_peer_init(void);
+void espnow_peer_deinit(void);
+
+/**
+ * @brief give a known peer a driver slot before a frame is sent to it,
+ *        the least recently used peer gives up its slot if none is free
+ * @return ESP_ERR_NOT_FOUND if the peer is not in the table
+ */
+esp_err_t espnow_peer_activate(const uint8_t addr[ESP_NOW_ETH_ALEN]);
+
+/**
+ * @brief count the result of a frame for the peer and the total
+ */
+void espnow_peer_tx_stat(const uint8_t addr[ESP_NOW_ETH_ALEN], bool ok, uint32_t retries, uint32_t latency_us);
+
+#endif
@@ -0,0 +1,727 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <string.h>
+#include "rom/crc.h"
+#include "espnow_trans_proto.h"
+
+#define TRANS_DATA              0x01
+#define TRANS_ACK               0x02
+#define TRANS_POLL              0x03
+#define TRANS_NACK              0x04
+#define TRANS_TYPE_MASK         0x0f
+#define TRANS_FLAG_BCAST        0x10    /**< DATA of a broadcast message */
+#define TRANS_FLAG_RESET        0x20    /**< ACK: crc failed, everything is to be sent again */
+#define TRANS_DONE_NUM          16      /**< messages remembered for duplicate suppression */
+#define TRANS_BUSY_US           2000    /**< retry after the radio refused a frame */
+#define TRANS_RTO_SHIFT_MAX     3
+
+typedef struct {
+    uint8_t type;
+    uint16_t msg_id;
+    uint16_t frag;
+    uint16_t frag_num;
+    uint32_t crc;
+} trans_hdr_t;
+
+typedef struct {
+    bool used;
+    bool bcast;
+    uint8_t addr[ESPNOW_TRANS_ADDR_LEN];
+    uint16_t msg_id;
+    uint16_t frag_num;
+    uint16_t base;          /**< unicast: all fragments below are acknowledged */
+    uint16_t sent_hi;       /**< fragments below were sent at least once */
+    uint32_t crc;
+    const uint8_t *data;
+    size_t len;
+    void *ctx;
+    uint8_t *acked;         /**< bit per fragment */
+    uint8_t *pending;       /**< bit per fragment, to be sent (again) */
+    int retry;
+    int round;
+    int quiet;              /**< broadcast: polls in a row without a NACK */
+    bool polled;            /**< broadcast: POLL sent for this round */
+    bool nacked;            /**< broadcast: a NACK came in this round */
+    int64_t deadline;       /**< unicast: retransmission, broadcast: end of the NACK collection */
+} trans_tx_t;
+
+typedef struct {
+    bool used;
+    bool bcast;
+    uint8_t addr[ESPNOW_TRANS_ADDR_LEN];
+    uint16_t msg_id;
+    uint16_t frag_num;
+    uint16_t got_num;
+    uint16_t base;          /**< first missing fragment */
+    uint32_t crc;
+    size_t len;             /**< 0 until the last fragment or a POLL is seen */
+    uint8_t *buf;
+    uint8_t *got;
+    int unacked;
+    int64_t ack_deadline;   /**< unicast ACK, broadcast NACK, 0 if none */
+    int64_t last_us;
+} trans_rx_t;
+
+typedef struct {
+    uint8_t addr[ESPNOW_TRANS_ADDR_LEN];
+    uint16_t msg_id;
+    uint16_t frag_num;
+    uint32_t crc;
+} trans_done_t;
+
+struct espnow_trans_proto {
+    espnow_trans_proto_config_t config;
+    espnow_trans_proto_cb_t cb;
+    trans_tx_t *tx;
+    trans_rx_t *rx;
+    trans_done_t done[TRANS_DONE_NUM];
+    int done_num;
+    int done_pos;
+    int tx_next;            /**< round robin start of the pump */
+    uint16_t msg_id;
+    uint32_t rand;
+    bool busy;
+    espnow_trans_stat_t stat;
+};
+
+#define BIT_GET(map, i)     (((map)[(i) >> 3] >> ((i) & 7)) & 1)
+#define BIT_SET(map, i)     ((map)[(i) >> 3] |= 1 << ((i) & 7))
+#define BIT_CLR(map, i)     ((map)[(i) >> 3] &= ~(1 << ((i) & 7)))
+#define MAP_BYTES(n)        (((n) + 7) / 8)
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return get16(p) | ((uint32_t) get16(p + 2) << 16);
+}
+
+static uint32_t trans_rand(espnow_trans_proto_t *p)
+{
+    /* xorshift32, only for jitter */
+    uint32_t x = p->rand;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return p->rand = x;
+}
+
+static uint16_t trans_frag_len(uint16_t frag_num, size_t len, uint16_t frag)
+{
+    return frag + 1 < frag_num ? ESPNOW_TRANS_FRAG_SIZE : len - (size_t) frag * ESPNOW_TRANS_FRAG_SIZE;
+}
+
+static esp_err_t trans_output(espnow_trans_proto_t *p, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN], const trans_hdr_t *hdr,
+                              const uint8_t *payload, int len)
+{
+    if (p->busy) {
+        return ESP_ERR_TIMEOUT;
+    }
+    uint8_t frame[ESPNOW_TRANS_FRAME_MAX];
+    frame[0] = ESPNOW_TRANS_MAGIC;
+    frame[1] = hdr->type;
+    put16(frame + 2, hdr->msg_id);
+    put16(frame + 4, hdr->frag);
+    put16(frame + 6, hdr->frag_num);
+    put32(frame + 8, hdr->crc);
+    if (len > 0) {
+        memcpy(frame + ESPNOW_TRANS_HDR_SIZE, payload, len);
+    }
+    if (p->cb.send(p->cb.arg, addr, frame, ESPNOW_TRANS_HDR_SIZE + len) != ESP_OK) {
+        p->busy = true;
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+/* ---------------------------------------------------------------- sender */
+
+static void trans_tx_finish(espnow_trans_proto_t *p, trans_tx_t *tx, esp_err_t result)
+{
+    void *ctx = tx->ctx;
+    free(tx->acked);
+    free(tx->pending);
+    memset(tx, 0, sizeof(*tx));
+    if (result == ESP_OK) {
+        p->stat.tx_msgs++;
+    } else {
+        p->stat.tx_fail++;
+    }
+    p->cb.sent(p->cb.arg, ctx, result);
+}
+
+static int64_t trans_rto(const espnow_trans_proto_t *p, const trans_tx_t *tx)
+{
+    int shift = tx->retry < TRANS_RTO_SHIFT_MAX ? tx->retry : TRANS_RTO_SHIFT_MAX;
+    return ((int64_t) p->config.rto_ms * 1000) << shift;
+}
+
+/**
+ * Send the pending fragments a message may send now: unicast within the window,
+ * broadcast all of them followed by a POLL. Return false if the radio is busy.
+ */
+static bool trans_tx_pump(espnow_trans_proto_t *p, trans_tx_t *tx, int64_t now)
+{
+    int end = tx->bcast ? tx->frag_num : tx->base + p->config.window;
+    if (end > tx->frag_num) {
+        end = tx->frag_num;
+    }
+    trans_hdr_t hdr = {
+        .type = TRANS_DATA | (tx->bcast ? TRANS_FLAG_BCAST : 0),
+        .msg_id = tx->msg_id,
+        .frag_num = tx->frag_num,
+        .crc = tx->crc,
+    };
+    for (int i = tx->base; i < end; i++) {
+        if (!BIT_GET(tx->pending, i)) {
+            continue;
+        }
+        hdr.frag = i;
+        if (trans_output(p, tx->addr, &hdr, tx->data + (size_t) i * ESPNOW_TRANS_FRAG_SIZE,
+                         trans_frag_len(tx->frag_num, tx->len, i)) != ESP_OK) {
+            return false;
+        }
+        BIT_CLR(tx->pending, i);
+        p->stat.tx_frames++;
+        if (i < tx->sent_hi) {
+            p->stat.tx_retrans++;
+        } else {
+            tx->sent_hi = i + 1;
+        }
+        if (!tx->bcast && tx->deadline == 0) {
+            tx->deadline = now + trans_rto(p, tx);
+        }
+    }
+    if (tx->bcast && !tx->polled) {
+        uint8_t len[4];
+        put32(len, tx->len);
+        hdr.type = TRANS_POLL;
+        hdr.frag = tx->round;
+        if (trans_output(p, tx->addr, &hdr, len, sizeof(len)) != ESP_OK) {
+            return false;
+        }
+        tx->polled = true;
+        tx->deadline = now + (int64_t) p->config.nack_wait_ms * 1000;
+    }
+    return true;
+}
+
+static void trans_tx_timer(espnow_trans_proto_t *p, trans_tx_t *tx, int64_t now)
+{
+    if (tx->deadline == 0 || now < tx->deadline) {
+        return;
+    }
+    tx->deadline = 0;
+    if (tx->bcast) {
+        bool repair = tx->nacked;
+        tx->nacked = false;
+        /* a lost POLL or NACK looks like success, ask again before believing it */
+        if (!repair && ++tx->quiet >= p->config.quiet_polls) {
+            trans_tx_finish(p, tx, ESP_OK);
+        } else if (repair && ++tx->round > p->config.max_rounds) {
+            trans_tx_finish(p, tx, ESP_ERR_TIMEOUT);
+        } else {
+            tx->quiet = repair ? 0 : tx->quiet;
+            tx->polled = false;
+        }
+        return;
+    }
+    if (++tx->retry > p->config.max_retry) {
+        trans_tx_finish(p, tx, ESP_ERR_TIMEOUT);
+        return;
+    }
+    /* nothing heard, send everything unacknowledged in the window again */
+    for (int i = tx->base; i < tx->sent_hi; i++) {
+        if (!BIT_GET(tx->acked, i)) {
+            BIT_SET(tx->pending, i);
+        }
+    }
+}
+
+static trans_tx_t *trans_tx_find(espnow_trans_proto_t *p, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN], uint16_t msg_id, bool bcast)
+{
+    for (int i = 0; i < p->config.tx_msg_num; i++) {
+        trans_tx_t *tx = &p->tx[i];
+        if (tx->used && tx->msg_id == msg_id && tx->bcast == bcast
+                && (bcast || !memcmp(tx->addr, addr, ESPNOW_TRANS_ADDR_LEN))) {
+            return tx;
+        }
+    }
+    return NULL;
+}
+
+static void trans_ack_input(espnow_trans_proto_t *p, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN], const trans_hdr_t *hdr,
+                            const uint8_t *map, int map_len, int64_t now)
+{
+    trans_tx_t *tx = trans_tx_find(p, addr, hdr->msg_id, false);
+    if (tx == NULL || hdr->crc != tx->crc || hdr->frag > tx->frag_num) {
+        return;
+    }
+    /* a crc failure, or the receiver dropped what it had */
+    if ((hdr->type & TRANS_FLAG_RESET) || hdr->frag < tx->base) {
+        memset(tx->acked, 0, MAP_BYTES(tx->frag_num));
+        memset(tx->pending, 0xff, MAP_BYTES(tx->frag_num));
+        tx->base = 0;
+        tx->deadline = 0;
+        tx->retry++;
+        return;
+    }
+    bool progress = hdr->frag > tx->base;
+    for (int i = tx->base; i < hdr->frag; i++) {
+        BIT_SET(tx->acked, i);
+        BIT_CLR(tx->pending, i);
+    }
+    int hi = hdr->frag;
+    for (int i = 0; i < map_len * 8 && hdr->frag + i < tx->frag_num; i++) {
+        int frag = hdr->frag + i;
+        if ((map[i >> 3] >> (i & 7)) & 1) {
+            progress |= !BIT_GET(tx->acked, frag);
+            BIT_SET(tx->acked, frag);
+            BIT_CLR(tx->pending, frag);
+            hi = frag + 1;
+        }
+    }
+    if (hdr->frag > tx->base) {
+        tx->base = hdr->frag;
+    }
+    if (tx->base >= tx->frag_num) {
+        trans_tx_finish(p, tx, ESP_OK);
+        return;
+    }
+    /* frames arrive in order, a gap below a received fragment is a loss */
+    for (int i = tx->base; i < hi; i++) {
+        if (!BIT_GET(tx->acked, i)) {
+            BIT_SET(tx->pending, i);
+        }
+    }
+    if (progress) {
+        tx->retry = 0;
+        tx->deadline = tx->sent_hi > tx->base ? now + trans_rto(p, tx) : 0;
+    }
+}
+
+static void trans_nack_input(espnow_trans_proto_t *p, const trans_hdr_t *hdr, const uint8_t *map, int map_len)
+{
+    trans_tx_t *tx = trans_tx_find(p, NULL, hdr->msg_id, true);
+    if (tx == NULL || hdr->crc != tx->crc) {
+        return;
+    }
+    for (int i = 0; i < map_len * 8 && hdr->frag + i < tx->frag_num; i++) {
+        if ((map[i >> 3] >> (i & 7)) & 1) {
+            BIT_SET(tx->pending, hdr->frag + i);
+        }
+    }
+    tx->nacked = true;
+}
+
+/* -------------------------------------------------------------- receiver */
+
+static bool trans_done_find(const espnow_trans_proto_t *p, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN], const trans_hdr_t *hdr)
+{
+    for (int i = 0; i < p->done_num; i++) {
+        const trans_done_t *d = &p->done[i];
+        if (d->msg_id == hdr->msg_id && d->crc == hdr->crc && d->frag_num == hdr->frag_num
+                && !memcmp(d->addr, addr, ESPNOW_TRANS_ADDR_LEN)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void trans_done_add(espnow_trans_proto_t *p, const trans_rx_t *rx)
+{
+    trans_done_t *d = &p->done[p->done_pos];
+    memcpy(d->addr, rx->addr, ESPNOW_TRANS_ADDR_LEN);
+    d->msg_id = rx->msg_id;
+    d->frag_num = rx->frag_num;
+    d->crc = rx->crc;
+    p->done_pos = (p->done_pos + 1) % TRANS_DONE_NUM;
+    if (p->done_num < TRANS_DONE_NUM) {
+        p->done_num++;
+    }
+}
+
+static void trans_rx_free(trans_rx_t *rx)
+{
+    free(rx->buf);
+    free(rx->got);
+    memset(rx, 0, sizeof(*rx));
+}
+
+static void trans_send_ack(espnow_trans_proto_t *p, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN], uint8_t type,
+                           uint16_t msg_id, uint16_t frag_num, uint32_t crc, uint16_t base, const uint8_t *map)
+{
+    trans_hdr_t hdr = {
+        .type = type,
+        .msg_id = msg_id,
+        .frag = base,
+        .frag_num = frag_num,
+        .crc = crc,
+    };
+    if (trans_output(p, addr, &hdr, map, map ? ESPNOW_TRANS_MAP_SIZE : 0) == ESP_OK) {
+        p->stat.acks++;
+    }
+}
+
+/**
+ * ACK: bits of the received fragments above the first missing one.
+ * NACK: bits of the missing fragments from the first one, the length of a message
+ * whose last fragment was lost is known from the POLL.
+ */
+static esp_err_t trans_rx_report(espnow_trans_proto_t *p, trans_rx_t *rx)
+{
+    uint8_t map[ESPNOW_TRANS_MAP_SIZE] = { 0 };
+    for (int i = 0; i < ESPNOW_TRANS_MAP_SIZE * 8 && rx->base + i < rx->frag_num; i++) {
+        if (BIT_GET(rx->got, rx->base + i) != rx->bcast) {
+            map[i >> 3] |= 1 << (i & 7);
+        }
+    }
+    uint32_t acks = p->stat.acks;
+    trans_send_ack(p, rx->addr, rx->bcast ? TRANS_NACK : TRANS_ACK, rx->msg_id, rx->frag_num, rx->crc, rx->base, map);
+    if (p->stat.acks == acks) {
+        return ESP_ERR_TIMEOUT;
+    }
+    rx->unacked = 0;
+    rx->ack_deadline = 0;
+    return ESP_OK;
+}
+
+static trans_rx_t *trans_rx_get(espnow_trans_proto_t *p, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN], const trans_hdr_t *hdr,
+                                bool bcast, int64_t now)
+{
+    trans_rx_t *free_rx = NULL;
+    for (int i = 0; i < p->config.rx_msg_num; i++) {
+        trans_rx_t *rx = &p->rx[i];
+        if (!rx->used) {
+            free_rx = free_rx ? free_rx : rx;
+        } else if (rx->msg_id == hdr->msg_id && !memcmp(rx->addr, addr, ESPNOW_TRANS_ADDR_LEN)) {
+            if (rx->crc == hdr->crc && rx->frag_num == hdr->frag_num && rx->bcast == bcast) {
+                return rx;
+            }
+            /* the sender restarted and reuses the id */
+            p->stat.rx_drop++;
+            trans_rx_free(rx);
+            free_rx = rx;
+            break;
+        }
+    }
+    if (free_rx == NULL || hdr->frag_num == 0
+            || (size_t) (hdr->frag_num - 1) * ESPNOW_TRANS_FRAG_SIZE >= p->config.max_msg_len) {
+        p->stat.rx_drop++;
+        return NULL;
+    }
+    trans_rx_t *rx = free_rx;
+    rx->buf = malloc((size_t) hdr->frag_num * ESPNOW_TRANS_FRAG_SIZE);
+    rx->got = calloc(1, MAP_BYTES(hdr->frag_num));
+    if (rx->buf == NULL || rx->got == NULL) {
+        trans_rx_free(rx);
+        p->stat.rx_drop++;
+        return NULL;
+    }
+    rx->used = true;
+    rx->bcast = bcast;
+    memcpy(rx->addr, addr, ESPNOW_TRANS_ADDR_LEN);
+    rx->msg_id = hdr->msg_id;
+    rx->frag_num = hdr->frag_num;
+    rx->crc = hdr->crc;
+    rx->last_us = now;
+    return rx;
+}
+
+static void trans_rx_complete(espnow_trans_proto_t *p, trans_rx_t *rx)
+{
+    if (crc32_le(0, rx->buf, rx->len) != rx->crc) {
+        p->stat.rx_crc_err++;
+        if (!rx->bcast) {
+            trans_send_ack(p, rx->addr, TRANS_ACK | TRANS_FLAG_RESET, rx->msg_id, rx->frag_num, rx->crc, 0, NULL);
+        }
+        trans_rx_free(rx);
+        return;
+    }
+    trans_done_add(p, rx);
+    if (!rx->bcast) {
+        trans_rx_report(p, rx);
+    }
+    uint8_t addr[ESPNOW_TRANS_ADDR_LEN];
+    uint8_t *buf = rx->buf;
+    size_t len = rx->len;
+    memcpy(addr, rx->addr, ESPNOW_TRANS_ADDR_LEN);
+    rx->buf = NULL;
+    trans_rx_free(rx);
+    p->stat.rx_msgs++;
+    p->cb.recv(p->cb.arg, addr, buf, len);
+}
+
+static void trans_data_input(espnow_trans_proto_t *p, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN], const trans_hdr_t *hdr,
+                             const uint8_t *payload, int len, int64_t now)
+{
+    bool bcast = hdr->type & TRANS_FLAG_BCAST;
+    p->stat.rx_frames++;
+    if (hdr->frag >= hdr->frag_num || len > ESPNOW_TRANS_FRAG_SIZE
+            || (hdr->frag + 1 < hdr->frag_num && len != ESPNOW_TRANS_FRAG_SIZE)) {
+        return;
+    }
+    if (trans_done_find(p, addr, hdr)) {
+        /* our final ACK was lost */
+        p->stat.rx_dup++;
+        if (!bcast) {
+            trans_send_ack(p, addr, TRANS_ACK, hdr->msg_id, hdr->frag_num, hdr->crc, hdr->frag_num, NULL);
+        }
+        return;
+    }
+    trans_rx_t *rx = trans_rx_get(p, addr, hdr, bcast, now);
+    if (rx == NULL) {
+        return;
+    }
+    rx->last_us = now;
+    if (BIT_GET(rx->got, hdr->frag)) {
+        p->stat.rx_dup++;
+    } else {
+        BIT_SET(rx->got, hdr->frag);
+        rx->got_num++;
+        memcpy(rx->buf + (size_t) hdr->frag * ESPNOW_TRANS_FRAG_SIZE, payload, len);
+        if (hdr->frag + 1 == hdr->frag_num) {
+            rx->len = (size_t) hdr->frag * ESPNOW_TRANS_FRAG_SIZE + len;
+        }
+        while (rx->base < rx->frag_num && BIT_GET(rx->got, rx->base)) {
+            rx->base++;
+        }
+    }
+    if (rx->got_num == rx->frag_num) {
+        trans_rx_complete(p, rx);
+        return;
+    }
+    if (bcast) {
+        /* the POLL asks for the NACK, this only covers a lost POLL */
+        if (rx->ack_deadline == 0) {
+            rx->ack_deadline = now + (int64_t) p->config.nack_wait_ms * 2000;
+        }
+        return;
+    }
+    /* the last fragment leaves the sender waiting, answer it at once */
+    if (++rx->unacked >= p->config.ack_every || hdr->frag + 1 == rx->frag_num) {
+        rx->ack_deadline = now;
+    } else if (rx->ack_deadline == 0) {
+        rx->ack_deadline = now + (int64_t) p->config.ack_delay_ms * 1000;
+    }
+}
+
+static void trans_poll_input(espnow_trans_proto_t *p, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN], const trans_hdr_t *hdr,
+                             const uint8_t *payload, int len, int64_t now)
+{
+    if (len < 4 || trans_done_find(p, addr, hdr)) {
+        return;
+    }
+    size_t msg_len = get32(payload);
+    if (msg_len == 0 || (msg_len + ESPNOW_TRANS_FRAG_SIZE - 1) / ESPNOW_TRANS_FRAG_SIZE != hdr->frag_num) {
+        return;
+    }
+    trans_rx_t *rx = trans_rx_get(p, addr, hdr, true, now);
+    if (rx == NULL) {
+        return;
+    }
+    rx->len = msg_len;
+    rx->last_us = now;
+    /* answer at a random time within half the collection window, spreading the NACKs of many receivers */
+    uint32_t jitter_us = p->config.nack_wait_ms * 500;
+    rx->ack_deadline = now + (jitter_us ? trans_rand(p) % jitter_us : 0);
+}
+
+/* ------------------------------------------------------------------- api */
+
+espnow_trans_proto_t *espnow_trans_proto_create(const espnow_trans_proto_config_t *config,
+                                                const espnow_trans_proto_cb_t *cb)
+{
+    if (config == NULL || cb == NULL || cb->send == NULL || cb->recv == NULL || cb->sent == NULL
+            || config->window <= 0 || config->tx_msg_num <= 0 || config->rx_msg_num <= 0
+            || config->max_msg_len == 0 || config->max_msg_len > (size_t) ESPNOW_TRANS_FRAG_SIZE * 0xffff) {
+        return NULL;
+    }
+    espnow_trans_proto_t *p = calloc(1, sizeof(*p));
+    if (p == NULL) {
+        return NULL;
+    }
+    p->config = *config;
+    p->cb = *cb;
+    p->tx = calloc(config->tx_msg_num, sizeof(trans_tx_t));
+    p->rx = calloc(config->rx_msg_num, sizeof(trans_rx_t));
+    if (p->tx == NULL || p->rx == NULL) {
+        free(p->tx);
+        free(p->rx);
+        free(p);
+        return NULL;
+    }
+    p->rand = config->seed ? config->seed : 1;
+    p->msg_id = trans_rand(p);
+    return p;
+}
+
+void espnow_trans_proto_delete(espnow_trans_proto_t *p)
+{
+    if (p == NULL) {
+        return;
+    }
+    for (int i = 0; i < p->config.tx_msg_num; i++) {
+        if (p->tx[i].used) {
+            trans_tx_finish(p, &p->tx[i], ESP_ERR_INVALID_STATE);
+        }
+    }
+    for (int i = 0; i < p->config.rx_msg_num; i++) {
+        trans_rx_free(&p->rx[i]);
+    }
+    free(p->tx);
+    free(p->rx);
+    free(p);
+}
+
+esp_err_t espnow_trans_proto_send(espnow_trans_proto_t *p, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN],
+                                  bool broadcast, const void *data, size_t len, void *ctx, int64_t now_us)
+{
+    if (len == 0 || len > p->config.max_msg_len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    trans_tx_t *tx = NULL;
+    for (int i = 0; i < p->config.tx_msg_num && tx == NULL; i++) {
+        tx = p->tx[i].used ? NULL : &p->tx[i];
+    }
+    if (tx == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    uint16_t frag_num = (len + ESPNOW_TRANS_FRAG_SIZE - 1) / ESPNOW_TRANS_FRAG_SIZE;
+    tx->acked = calloc(1, MAP_BYTES(frag_num));
+    tx->pending = malloc(MAP_BYTES(frag_num));
+    if (tx->acked == NULL || tx->pending == NULL) {
+        free(tx->acked);
+        free(tx->pending);
+        tx->acked = tx->pending = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    memset(tx->pending, 0xff, MAP_BYTES(frag_num));
+    tx->used = true;
+    tx->bcast = broadcast;
+    memcpy(tx->addr, addr, ESPNOW_TRANS_ADDR_LEN);
+    tx->msg_id = p->msg_id++;
+    tx->frag_num = frag_num;
+    tx->crc = crc32_le(0, data, len);
+    tx->data = data;
+    tx->len = len;
+    tx->ctx = ctx;
+    return ESP_OK;
+}
+
+esp_err_t espnow_trans_proto_input(espnow_trans_proto_t *p, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN],
+                                   const uint8_t *frame, int len, int64_t now_us)
+{
+    if (len < ESPNOW_TRANS_HDR_SIZE || frame[0] != ESPNOW_TRANS_MAGIC) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    trans_hdr_t hdr = {
+        .type = frame[1],
+        .msg_id = get16(frame + 2),
+        .frag = get16(frame + 4),
+        .frag_num = get16(frame + 6),
+        .crc = get32(frame + 8),
+    };
+    const uint8_t *payload = frame + ESPNOW_TRANS_HDR_SIZE;
+    len -= ESPNOW_TRANS_HDR_SIZE;
+    if (len > ESPNOW_TRANS_MAP_SIZE && (hdr.type & TRANS_TYPE_MASK) != TRANS_DATA) {
+        len = ESPNOW_TRANS_MAP_SIZE;
+    }
+    switch (hdr.type & TRANS_TYPE_MASK) {
+    case TRANS_DATA:
+        if (len > 0) {
+            trans_data_input(p, addr, &hdr, payload, len, now_us);
+        }
+        break;
+    case TRANS_ACK:
+        trans_ack_input(p, addr, &hdr, payload, len, now_us);
+        break;
+    case TRANS_POLL:
+        trans_poll_input(p, addr, &hdr, payload, len, now_us);
+        break;
+    case TRANS_NACK:
+        trans_nack_input(p, &hdr, payload, len);
+        break;
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+int64_t espnow_trans_proto_poll(espnow_trans_proto_t *p, int64_t now_us)
+{
+    int64_t next = INT64_MAX;
+    p->busy = false;
+
+    for (int i = 0; i < p->config.rx_msg_num; i++) {
+        trans_rx_t *rx = &p->rx[i];
+        if (!rx->used) {
+            continue;
+        }
+        if (now_us - rx->last_us >= (int64_t) p->config.rx_timeout_ms * 1000) {
+            p->stat.rx_drop++;
+            trans_rx_free(rx);
+            continue;
+        }
+        if (rx->ack_deadline && now_us >= rx->ack_deadline) {
+            trans_rx_report(p, rx);
+        }
+        if (rx->ack_deadline && rx->ack_deadline < next) {
+            next = rx->ack_deadline;
+        }
+        if (rx->last_us + (int64_t) p->config.rx_timeout_ms * 1000 < next) {
+            next = rx->last_us + (int64_t) p->config.rx_timeout_ms * 1000;
+        }
+    }
+
+    for (int n = 0; n < p->config.tx_msg_num; n++) {
+        trans_tx_t *tx = &p->tx[(p->tx_next + n) % p->config.tx_msg_num];
+        if (tx->used) {
+            trans_tx_timer(p, tx, now_us);
+        }
+        if (tx->used && !trans_tx_pump(p, tx, now_us)) {
+            /* start with this one next time, the radio is shared fairly */
+            p->tx_next = (p->tx_next + n) % p->config.tx_msg_num;
+            break;
+        }
+        if (tx->used && tx->deadline && tx->deadline < next) {
+            next = tx->deadline;
+        }
+    }
+    if (p->busy) {
+        next = now_us + TRANS_BUSY_US;
+    }
+    return next;
+}
+
+void espnow_trans_proto_get_stat(const espnow_trans_proto_t *p, espnow_trans_stat_t *stat)
+{
+    *stat = p->stat;
+}
@@ -0,0 +1,147 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _ESPNOW_TRANS_PROTO_H_
+#define _ESPNOW_TRANS_PROTO_H_
+
+/*
+ * Message transport over ESP-NOW frames: fragmentation and reassembly, a per-message crc32,
+ * duplicate suppression, selective acknowledgement with a sliding window for unicast and
+ * NACK based repair for broadcast. The protocol is plain C without RTOS calls: frames go
+ * in through espnow_trans_proto_input(), time moves on through espnow_trans_proto_poll(),
+ * so it can run against a simulated radio. iot_espnow_trans.h runs it on iot_espnow.
+ *
+ * Frame: magic | type | msg_id(2) | frag(2) | frag_num(2) | crc(4) | payload, little endian.
+ *     DATA    payload is fragment frag of the message
+ *     ACK     frag is the first missing fragment, payload bit i set: fragment frag + i received
+ *     POLL    broadcast round ended, payload is the message length (4)
+ *     NACK    frag is the first missing fragment, payload bit i set: fragment frag + i missing
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define ESPNOW_TRANS_MAGIC          0xe5    /**< first byte of every frame */
+#define ESPNOW_TRANS_ADDR_LEN       6
+#define ESPNOW_TRANS_FRAME_MAX      250     /**< ESP_NOW_MAX_DATA_LEN */
+#define ESPNOW_TRANS_HDR_SIZE       12
+#define ESPNOW_TRANS_FRAG_SIZE      (ESPNOW_TRANS_FRAME_MAX - ESPNOW_TRANS_HDR_SIZE)
+#define ESPNOW_TRANS_MAP_SIZE       16      /**< bitmap bytes of ACK and NACK frames */
+
+typedef struct {
+    int window;                 /**< unicast fragments sent ahead of the first unacknowledged one */
+    int ack_every;              /**< the receiver acknowledges after this many fragments */
+    uint32_t ack_delay_ms;      /**< or after this time */
+    uint32_t rto_ms;            /**< unicast retransmission timeout, doubled while there is no progress */
+    int max_retry;              /**< timeouts without progress before a unicast message fails */
+    uint32_t nack_wait_ms;      /**< broadcast time to collect NACKs after a poll, receivers answer within half of it */
+    int max_rounds;             /**< broadcast repair rounds */
+    int quiet_polls;            /**< broadcast is finished after this many polls without a NACK */
+    uint32_t rx_timeout_ms;     /**< an incomplete message is dropped after this idle time */
+    size_t max_msg_len;
+    int tx_msg_num;             /**< messages being sent at the same time */
+    int rx_msg_num;             /**< messages being received at the same time */
+    uint32_t seed;              /**< first message id and NACK jitter */
+} espnow_trans_proto_config_t;
+
+#define ESPNOW_TRANS_PROTO_CONFIG_DEFAULT() { \
+    .window = 16, \
+    .ack_every = 8, \
+    .ack_delay_ms = 10, \
+    .rto_ms = 60, \
+    .max_retry = 10, \
+    .nack_wait_ms = 40, \
+    .max_rounds = 8, \
+    .quiet_polls = 3, \
+    .rx_timeout_ms = 10000, \
+    .max_msg_len = 16 * 1024, \
+    .tx_msg_num = 4, \
+    .rx_msg_num = 4, \
+    .seed = 1, \
+}
+
+typedef struct {
+    /**< send one frame, anything but ESP_OK means try again later */
+    esp_err_t (*send)(void *arg, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN], const uint8_t *frame, int len);
+    /**< a complete message, the callee owns data and frees it */
+    void (*recv)(void *arg, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN], uint8_t *data, size_t len);
+    /**< a message of espnow_trans_proto_send() is finished, ESP_OK when acknowledged */
+    void (*sent)(void *arg, void *ctx, esp_err_t result);
+    void *arg;
+} espnow_trans_proto_cb_t;
+
+typedef struct {
+    uint32_t tx_msgs;           /**< messages sent successfully */
+    uint32_t tx_fail;           /**< messages given up */
+    uint32_t tx_frames;         /**< DATA frames sent, retransmissions included */
+    uint32_t tx_retrans;        /**< DATA frames sent again */
+    uint32_t rx_msgs;           /**< messages delivered */
+    uint32_t rx_frames;         /**< DATA frames received */
+    uint32_t rx_dup;            /**< DATA frames of fragments or messages already received */
+    uint32_t rx_crc_err;        /**< reassembled messages with a wrong crc */
+    uint32_t rx_drop;           /**< incomplete messages dropped, too large or timed out */
+    uint32_t acks;              /**< ACK and NACK frames sent */
+} espnow_trans_stat_t;
+
+typedef struct espnow_trans_proto espnow_trans_proto_t;
+
+/**
+ * @brief create a protocol instance
+ * @return the instance, NULL if no memory
+ */
+espnow_trans_proto_t *espnow_trans_proto_create(const espnow_trans_proto_config_t *config,
+                                                const espnow_trans_proto_cb_t *cb);
+
+/**
+ * @brief delete the instance, messages still being sent complete with ESP_ERR_INVALID_STATE
+ */
+void espnow_trans_proto_delete(espnow_trans_proto_t *proto);
+
+/**
+ * @brief start sending a message, the data must stay valid until the sent callback
+ * @param proto instance
+ * @param addr destination, for a broadcast the address the frames go to
+ * @param broadcast no acknowledgement, receivers ask for missing fragments after each round
+ * @param data message
+ * @param len message length
+ * @param ctx passed to the sent callback
+ * @param now_us current time
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_SIZE: empty or longer than max_msg_len
+ *     - ESP_ERR_NO_MEM: tx_msg_num messages are being sent
+ */
+esp_err_t espnow_trans_proto_send(espnow_trans_proto_t *proto, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN],
+                                  bool broadcast, const void *data, size_t len, void *ctx, int64_t now_us);
+
+/**
+ * @brief a frame from the radio
+ * @return ESP_ERR_INVALID_ARG if it is not a frame of this protocol
+ */
+esp_err_t espnow_trans_proto_input(espnow_trans_proto_t *proto, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN],
+                                   const uint8_t *frame, int len, int64_t now_us);
+
+/**
+ * @brief send what is due and handle the timers
+ * @return the time of the next timer, INT64_MAX if there is none
+ */
+int64_t espnow_trans_proto_poll(espnow_trans_proto_t *proto, int64_t now_us);
+
+/**
+ * @brief get the statistics
+ */
+void espnow_trans_proto_get_stat(const espnow_trans_proto_t *proto, espnow_trans_stat_t *stat);
+
+#endif
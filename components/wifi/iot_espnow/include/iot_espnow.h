@@ -20,6 +20,61 @@
 extern "C" {
 #endif
 
+/**
+ * @brief received frame, a slot of the receive pool owned by the application until
+ *        it is given back with iot_espnow_release_pkt()
+ */
+typedef struct {
+    uint8_t src_addr[ESP_NOW_ETH_ALEN];     /**< source address */
+    uint16_t len;                           /**< data length */
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];     /**< frame data */
+} iot_espnow_pkt_t;
+
+/**
+ * @brief receive statistics of a queue
+ */
+typedef struct {
+    uint32_t rx_packets;    /**< frames put into the queue */
+    uint32_t rx_dropped;    /**< older frames dropped from the queue to make room */
+    uint32_t queued;        /**< frames waiting in the queue */
+    uint32_t rx_no_buf;     /**< frames lost because the application held every slot, all queues */
+    uint32_t pool_free;     /**< free slots of the receive pool */
+} iot_espnow_rx_stat_t;
+
+/**
+ * @brief transmit statistics of a peer, or of all peers
+ */
+typedef struct {
+    uint32_t tx_packets;        /**< frames completed, delivered or lost */
+    uint32_t tx_ok;             /**< frames acknowledged */
+    uint32_t tx_lost;           /**< frames given up after the retries */
+    uint32_t retries;           /**< retransmissions */
+    uint32_t latency_avg_us;    /**< from iot_espnow_send_async() to the acknowledgement */
+    uint32_t latency_max_us;
+} iot_espnow_tx_stat_t;
+
+/**
+ * @brief a peer of the peer table
+ */
+typedef struct {
+    uint8_t channel;            /**< 0: the channel of the interface */
+    wifi_interface_t ifidx;
+    bool encrypt;
+    bool active;                /**< holds a driver peer slot */
+    uint32_t activations;       /**< times it was given a driver slot */
+} iot_espnow_peer_info_t;
+
+/**
+ * @brief final result of a frame, called from the espnow transmit task, it must not block
+ */
+typedef void (*iot_espnow_send_cb_t)(const uint8_t dest_addr[ESP_NOW_ETH_ALEN], esp_now_send_status_t status, void *arg);
+
+/**
+ * @brief frame filter called in the Wi-Fi task before a frame is queued, it must not block
+ * @return true if the frame was consumed and is not queued
+ */
+typedef bool (*iot_espnow_rx_hook_t)(const uint8_t src_addr[ESP_NOW_ETH_ALEN], const uint8_t *data, int len, void *arg);
+
 /**
  * @brief  init espnow
  *
@@ -41,18 +96,26 @@ esp_err_t iot_espnow_deinit(void);
 /**
  * @brief  add a peer to espnow peer list based on esp_now_add_peer(...). It is convenient to use simplified MACRO follows.
  *
- * @attention 1. If the peer is exist, it will be deleted firstly.
+ * @attention 1. If the peer exists with the same settings nothing is done, otherwise it is updated.
  * @attention 2. If default_encrypt is true, use default lmk to encrypt espnow data;
  *               if default_encrypt is false and lmk is set, use customized lmk to encrypt espnow data;
  *               otherwise, not encrypt.
+ * @attention 3. Up to CONFIG_IOT_ESPNOW_PEER_MAX peers are kept in a table, the driver holds at most
+ *               CONFIG_IOT_ESPNOW_PEER_HW_MAX of them. A peer gets a driver slot when a frame is sent
+ *               to it, the least recently used peer gives its slot up. Encrypted peers take a slot at
+ *               once and keep it longest, their frames can only be decrypted while they hold one.
  *
  * @param  dest_addr       peer mac address
  * @param  default_encrypt whether to encrypt data with default IOT_ESPNOW_LMK
  * @param  lmk             local master key
+ * @param  interface       Wi-Fi interface
+ * @param  channel         channel, negative for the channel the interface is on
  *
  * @return
  *     - ESP_OK
- *     - ESP_FAIL
+ *     - ESP_ERR_NO_MEM: the peer table is full
+ *     - ESP_ERR_INVALID_STATE: espnow not inited
+ *     - others: the driver refused an encrypted peer
  */
 esp_err_t iot_espnow_add_peer_base(const uint8_t dest_addr[ESP_NOW_ETH_ALEN],
                                    bool default_encrypt, const uint8_t lmk[ESP_NOW_KEY_LEN],
@@ -72,6 +135,30 @@ esp_err_t iot_espnow_add_peer_base(const uint8_t dest_addr[ESP_NOW_ETH_ALEN],
  */
 esp_err_t iot_espnow_del_peer(const uint8_t dest_addr[ESP_NOW_ETH_ALEN]);
 
+/**
+ * @brief  get a peer from the peer table.
+ *
+ * @param  dest_addr peer mac address
+ * @param  info      peer settings and state, may be NULL to check that the peer is known
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NOT_FOUND
+ */
+esp_err_t iot_espnow_get_peer(const uint8_t dest_addr[ESP_NOW_ETH_ALEN], iot_espnow_peer_info_t *info);
+
+/**
+ * @brief  get the number of peers.
+ *
+ * @param  total  peers in the table, may be NULL
+ * @param  active peers holding a driver slot, may be NULL
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_STATE: espnow not inited
+ */
+esp_err_t iot_espnow_get_peer_num(int *total, int *active);
+
 /**
  * @brief  receive data from espnow.
  * 
@@ -88,12 +175,159 @@ esp_err_t iot_espnow_del_peer(const uint8_t dest_addr[ESP_NOW_ETH_ALEN]);
 size_t iot_espnow_recv(uint8_t src_addr[ESP_NOW_ETH_ALEN], void *data, 
                             TickType_t block_ticks);
 
+/**
+ * @brief  receive a frame without copying it.
+ *
+ * @attention 1. Frames come from a fixed pool of CONFIG_IOT_ESPNOW_RX_POOL_NUM slots, nothing is
+ *               allocated when a frame arrives. Release every frame with iot_espnow_release_pkt(),
+ *               a held frame is a slot the Wi-Fi task can not use.
+ * @attention 2. Frames from a source with its own queue (iot_espnow_add_rx_queue) are not returned here.
+ *
+ * @param  pkt         the received frame
+ * @param  block_ticks block ticks
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_TIMEOUT: no frame in time
+ *     - ESP_ERR_INVALID_STATE: espnow not inited
+ */
+esp_err_t iot_espnow_recv_pkt(iot_espnow_pkt_t **pkt, TickType_t block_ticks);
+
+/**
+ * @brief  receive a frame from the queue of one source, see iot_espnow_add_rx_queue().
+ *
+ * @param  src_addr    source address
+ * @param  pkt         the received frame, release it with iot_espnow_release_pkt()
+ * @param  block_ticks block ticks
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_TIMEOUT: no frame in time
+ *     - ESP_ERR_NOT_FOUND: the source has no queue, or it was deleted while waiting
+ */
+esp_err_t iot_espnow_recv_pkt_from(const uint8_t src_addr[ESP_NOW_ETH_ALEN], iot_espnow_pkt_t **pkt,
+                                   TickType_t block_ticks);
+
+/**
+ * @brief  give a frame back to the receive pool.
+ *
+ * @param  pkt frame from iot_espnow_recv_pkt() or iot_espnow_recv_pkt_from()
+ */
+void iot_espnow_release_pkt(iot_espnow_pkt_t *pkt);
+
+/**
+ * @brief  queue the frames of one source separately, so a chatty node can not push
+ *         the frames of the others out of the shared queue.
+ *
+ * @attention 1. When a queue is full, its oldest frame is dropped and counted in rx_dropped.
+ * @attention 2. A frame that arrives while another task adds, deletes or looks up a queue
+ *               goes to the shared queue.
+ *
+ * @param  src_addr  source address
+ * @param  queue_len frames kept for this source
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_STATE: the source already has a queue or espnow not inited
+ *     - ESP_ERR_NO_MEM: no memory or CONFIG_IOT_ESPNOW_RX_PEER_QUEUE_MAX queues in use
+ */
+esp_err_t iot_espnow_add_rx_queue(const uint8_t src_addr[ESP_NOW_ETH_ALEN], int queue_len);
+
+/**
+ * @brief  delete the queue of a source, its waiting frames are released and
+ *         its later frames go to the shared queue.
+ *
+ * @attention Tasks waiting in iot_espnow_recv_pkt_from() on the queue return ESP_ERR_NOT_FOUND,
+ *            the call returns once they have left.
+ *
+ * @param  src_addr source address
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NOT_FOUND: the source has no queue
+ */
+esp_err_t iot_espnow_del_rx_queue(const uint8_t src_addr[ESP_NOW_ETH_ALEN]);
+
+/**
+ * @brief  get the receive statistics.
+ *
+ * @param  src_addr source address for its own queue, NULL for the shared queue
+ * @param  stat     statistics
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NOT_FOUND: the source has no queue
+ */
+esp_err_t iot_espnow_get_rx_stat(const uint8_t src_addr[ESP_NOW_ETH_ALEN], iot_espnow_rx_stat_t *stat);
+
+/**
+ * @brief  let a protocol layer see every frame first, see iot_espnow_trans.h.
+ *
+ * @param  hook filter, NULL to remove it
+ * @param  arg  argument of hook
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_STATE: another hook is set
+ */
+esp_err_t iot_espnow_set_rx_hook(iot_espnow_rx_hook_t hook, void *arg);
+
+/**
+ * @brief  queue a frame and return at once.
+ *
+ * @attention 1. Up to CONFIG_IOT_ESPNOW_TX_WINDOW frames are in the driver at the same time, to the
+ *               same or different peers. A failed frame is sent again up to CONFIG_IOT_ESPNOW_TX_RETRY
+ *               times, after a pause that doubles each time, and keeps its place before the later
+ *               frames to the same peer.
+ * @attention 2. The data is copied, the buffer can be reused when this returns.
+ *
+ * @param  dest_addr   destination address, a peer added before
+ * @param  data        data to send
+ * @param  data_len    data length, at most ESP_NOW_MAX_DATA_LEN
+ * @param  cb          called with the final result, may be NULL
+ * @param  arg         argument of cb
+ * @param  block_ticks time to wait for room in the transmit queue
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_TIMEOUT: the transmit queue stayed full
+ *     - ESP_ERR_INVALID_ARG
+ *     - ESP_ERR_INVALID_STATE: espnow not inited
+ */
+esp_err_t iot_espnow_send_async(const uint8_t dest_addr[ESP_NOW_ETH_ALEN], const void *data, size_t data_len,
+                                iot_espnow_send_cb_t cb, void *arg, TickType_t block_ticks);
+
+/**
+ * @brief  wait until every queued frame is delivered or lost.
+ *
+ * @param  block_ticks block ticks
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_TIMEOUT
+ */
+esp_err_t iot_espnow_send_flush(TickType_t block_ticks);
+
+/**
+ * @brief  get the transmit statistics.
+ *
+ * @param  dest_addr peer address, NULL for all peers
+ * @param  stat      statistics
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NOT_FOUND: the peer is not in the peer table
+ */
+esp_err_t iot_espnow_get_tx_stat(const uint8_t dest_addr[ESP_NOW_ETH_ALEN], iot_espnow_tx_stat_t *stat);
+
 /**
  * @brief  send date package to espnow.
  * 
  * @attention 1. It is necessary to add device to espnow_peer befor send data to dest_addr.
- * @attention 2. When data_len to write is too long, it may fail duration some package and
- *               and the return value is the data len that actually sended.
+ * @attention 2. The frame goes through the transmit queue of iot_espnow_send_async() and this waits
+ *               for its final result, so several tasks can send at the same time.
+ * @attention 3. The wait uses the task notification of the calling task, its notification value is
+ *               consumed. Do not call this from a task that uses its notification for something else.
  *
  * @param  dest_addr   destination address
  * @param  data        point to send data buffer
@@ -0,0 +1,105 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _IOT_ESPNOW_TRANS_H_
+#define _IOT_ESPNOW_TRANS_H_
+
+#include "iot_espnow.h"
+#include "espnow_trans_proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief  start the message transport on top of iot_espnow, iot_espnow_init() must be called first.
+ *
+ * @attention 1. Frames of the transport are taken out before the iot_espnow receive queues,
+ *               the other frames still go there.
+ * @attention 2. Peers that were not added before are added without encryption on the station interface.
+ *
+ * @param  config protocol parameters, NULL for ESPNOW_TRANS_PROTO_CONFIG_DEFAULT()
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_STATE: already started, or another receive hook is set
+ *     - ESP_ERR_INVALID_ARG
+ *     - ESP_ERR_NO_MEM
+ */
+esp_err_t iot_espnow_trans_init(const espnow_trans_proto_config_t *config);
+
+/**
+ * @brief  stop the transport, messages being sent fail with ESP_ERR_INVALID_STATE.
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_STATE: not started
+ */
+esp_err_t iot_espnow_trans_deinit(void);
+
+/**
+ * @brief  send a message of up to max_msg_len bytes and wait for the result.
+ *
+ * @attention 1. To a peer the message is sent in fragments with a sliding window and
+ *               selective acknowledgement, ESP_OK means the peer has all of it.
+ * @attention 2. To the broadcast address every fragment goes out once, then receivers
+ *               ask for what they missed. ESP_OK means nobody asked any more, a receiver
+ *               that heard nothing at all can not ask.
+ * @attention 3. Several tasks can send at the same time, up to tx_msg_num messages are in flight.
+ *
+ * @param  dest_addr   destination address, or ff:ff:ff:ff:ff:ff
+ * @param  data        message, not copied
+ * @param  data_len    message length
+ * @param  block_ticks time to wait for a free message slot
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_TIMEOUT: no slot in time, or the message was not acknowledged
+ *     - ESP_ERR_INVALID_SIZE
+ *     - ESP_ERR_INVALID_STATE: not started
+ */
+esp_err_t iot_espnow_trans_send(const uint8_t dest_addr[ESP_NOW_ETH_ALEN], const void *data, size_t data_len,
+                                TickType_t block_ticks);
+
+/**
+ * @brief  receive a message, each one is delivered once and has passed its crc.
+ *
+ * @param  src_addr    source address
+ * @param  data        the message, free() it when done
+ * @param  data_len    message length
+ * @param  block_ticks block ticks
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_TIMEOUT
+ *     - ESP_ERR_INVALID_STATE: not started
+ */
+esp_err_t iot_espnow_trans_recv(uint8_t src_addr[ESP_NOW_ETH_ALEN], uint8_t **data, size_t *data_len,
+                                TickType_t block_ticks);
+
+/**
+ * @brief  get the transport statistics.
+ *
+ * @param  stat statistics
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_STATE: not started
+ */
+esp_err_t iot_espnow_trans_get_stat(espnow_trans_stat_t *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
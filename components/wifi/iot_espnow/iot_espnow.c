@@ -15,64 +15,488 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
-#include "freertos/event_groups.h"
 #include "freertos/semphr.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "esp_now.h"
 #include "esp_event_loop.h"
 #include "esp_log.h"
 #include "iot_espnow.h"
+#include "espnow_peer.h"
 
 static const char* TAG = "iot_espnow";
 
-#define SEND_CB_OK               BIT0
-#define SEND_CB_FAIL             BIT1
-
+#ifdef CONFIG_IOT_ESPNOW_RX_POOL_NUM
+#define ESPNOW_RX_POOL_NUM       CONFIG_IOT_ESPNOW_RX_POOL_NUM
+#else
+#define ESPNOW_RX_POOL_NUM       32
+#endif
+#ifdef CONFIG_IOT_ESPNOW_RX_QUEUE_NUM
+#define ESPNOW_ERCV_QUEUE_NUM    CONFIG_IOT_ESPNOW_RX_QUEUE_NUM
+#else
 #define ESPNOW_ERCV_QUEUE_NUM    10
+#endif
+#ifdef CONFIG_IOT_ESPNOW_RX_PEER_QUEUE_MAX
+#define ESPNOW_RX_PEER_QUEUE_MAX CONFIG_IOT_ESPNOW_RX_PEER_QUEUE_MAX
+#else
+#define ESPNOW_RX_PEER_QUEUE_MAX 16
+#endif
+#define ESPNOW_RX_SLOT_NONE      0xffff
+
+#ifdef CONFIG_IOT_ESPNOW_TX_QUEUE_NUM
+#define ESPNOW_TX_QUEUE_NUM      CONFIG_IOT_ESPNOW_TX_QUEUE_NUM
+#else
+#define ESPNOW_TX_QUEUE_NUM      16
+#endif
+#ifdef CONFIG_IOT_ESPNOW_TX_WINDOW
+#define ESPNOW_TX_WINDOW         CONFIG_IOT_ESPNOW_TX_WINDOW
+#else
+#define ESPNOW_TX_WINDOW         4
+#endif
+#ifdef CONFIG_IOT_ESPNOW_TX_RETRY
+#define ESPNOW_TX_RETRY          CONFIG_IOT_ESPNOW_TX_RETRY
+#else
+#define ESPNOW_TX_RETRY          3
+#endif
+#define ESPNOW_TX_RETRY_DELAY_MS 4      /**< doubled on each retry of a frame */
+#define ESPNOW_TX_TIMEOUT_MS     500    /**< a frame without send callback is counted as failed */
+#define ESPNOW_TX_TASK_STACK     2560
+#define ESPNOW_TX_TASK_PRIO      10
 
 #define IOT_ESPNOW_PMK_DEFAULT CONFIG_IOT_ESPNOW_PMK
-#define IOT_ESPNOW_LMK_DEFAULT "lmk1234567890123"
 
 static bool g_iot_espnow_inited = false;
-static EventGroupHandle_t g_event_group = NULL;
 static xQueueHandle s_espnow_queue = NULL;
-static const uint8_t g_bcast_mac[ESP_NOW_ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+/**< receive slot, pkt must stay the first member, the application only sees &slot->pkt */
+typedef struct {
+    iot_espnow_pkt_t pkt;
+    uint16_t next;
+} espnow_rx_slot_t;
 
 typedef struct {
+    xQueueHandle queue;                 /**< slot indexes, oldest first */
     uint8_t addr[ESP_NOW_ETH_ALEN];
-    uint8_t *data;
-    int data_len;
-} espnow_data_t;
+    uint32_t rx_packets;
+    uint32_t rx_dropped;
+    int readers;                        /**< tasks in iot_espnow_recv_pkt_from() on this queue */
+    bool closing;                       /**< being deleted, no longer found, readers are woken with ESPNOW_RX_SLOT_NONE */
+} espnow_rx_queue_t;
+
+/**
+ * The slots are allocated once in iot_espnow_init(), nothing is allocated per frame.
+ * The free list is a stack shared by the Wi-Fi task (pop) and the application tasks (push),
+ * its head holds a change counter in the upper 16 bits so a compare and swap never
+ * succeeds on a head that was popped and pushed back meanwhile.
+ */
+static espnow_rx_slot_t *s_rx_pool = NULL;
+static uint32_t s_rx_free_head = ESPNOW_RX_SLOT_NONE;
+static uint32_t s_rx_free_num = 0;
+static uint32_t s_rx_no_buf = 0;
+static espnow_rx_queue_t s_rx_default;
+static espnow_rx_queue_t s_rx_peer[ESPNOW_RX_PEER_QUEUE_MAX];
+static volatile int s_rx_peer_num = 0;
+static SemaphoreHandle_t s_rx_mutex = NULL;
+static iot_espnow_rx_hook_t s_rx_hook = NULL;
+static void *s_rx_hook_arg = NULL;
+
+typedef enum {
+    ESPNOW_TX_SUBMIT = 0,
+    ESPNOW_TX_DONE,
+    ESPNOW_TX_STOP,
+} espnow_tx_msg_type_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t status;
+    uint16_t idx;
+    uint8_t addr[ESP_NOW_ETH_ALEN];
+} espnow_tx_msg_t;
+
+typedef struct {
+    uint8_t dest_addr[ESP_NOW_ETH_ALEN];
+    uint16_t len;
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+    iot_espnow_send_cb_t cb;
+    void *arg;
+    uint8_t retry;
+    int64_t queued_us;          /**< handed in by the application */
+    int64_t send_us;            /**< given to esp_now_send, or when a retry may go */
+} espnow_tx_slot_t;
+
+/**
+ * Transmit engine. Frames are copied into slots and handed to the tx task, which keeps up to
+ * ESPNOW_TX_WINDOW of them in the driver at once. Send callbacks carry only the peer address,
+ * the driver reports the frames of a peer in the order they were sent, so a callback belongs
+ * to the oldest frame in flight to that address. Everything below but the stats is owned by the tx task.
+ */
+static struct {
+    espnow_tx_slot_t *slot;
+    xQueueHandle free_q;        /**< free slot indexes */
+    xQueueHandle msg_q;         /**< espnow_tx_msg_t from the application and the Wi-Fi task */
+    SemaphoreHandle_t exit_sem;
+    uint16_t wait[ESPNOW_TX_QUEUE_NUM];         /**< slots waiting for the window, in order */
+    int wait_num;
+    uint16_t flight[ESPNOW_TX_WINDOW];          /**< slots in the driver, in send order */
+    int flight_num;
+    bool driver_full;
+} s_tx;
 
 static void iot_espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
 {
-    if (status == ESP_NOW_SEND_SUCCESS) {
-        xEventGroupSetBits(g_event_group, SEND_CB_OK);
-    } else {
-        xEventGroupSetBits(g_event_group, SEND_CB_FAIL);
+    espnow_tx_msg_t msg = { .type = ESPNOW_TX_DONE, .status = status };
+    if (!s_tx.msg_q || !mac_addr) {
+        return;
+    }
+    memcpy(msg.addr, mac_addr, ESP_NOW_ETH_ALEN);
+    /**< if this is lost, the frame times out */
+    xQueueSend(s_tx.msg_q, &msg, 0);
+}
+
+static void espnow_tx_finish(uint16_t idx, bool ok, int64_t now)
+{
+    espnow_tx_slot_t *slot = &s_tx.slot[idx];
+    espnow_peer_tx_stat(slot->dest_addr, ok, slot->retry, now - slot->queued_us);
+    if (slot->cb) {
+        slot->cb(slot->dest_addr, ok ? ESP_NOW_SEND_SUCCESS : ESP_NOW_SEND_FAIL, slot->arg);
+    }
+    xQueueSend(s_tx.free_q, &idx, portMAX_DELAY);
+}
+
+/**< a frame left the driver, acknowledged or not */
+static void espnow_tx_complete(int pos, bool ok, int64_t now)
+{
+    uint16_t idx = s_tx.flight[pos];
+    espnow_tx_slot_t *slot = &s_tx.slot[idx];
+    memmove(&s_tx.flight[pos], &s_tx.flight[pos + 1], (s_tx.flight_num - pos - 1) * sizeof(uint16_t));
+    s_tx.flight_num--;
+    s_tx.driver_full = false;
+    if (ok || slot->retry >= ESPNOW_TX_RETRY) {
+        espnow_tx_finish(idx, ok, now);
+        return;
+    }
+    /**< retried ahead of the later frames, after a growing pause */
+    slot->send_us = now + (int64_t) (ESPNOW_TX_RETRY_DELAY_MS << slot->retry) * 1000;
+    slot->retry++;
+    memmove(&s_tx.wait[1], &s_tx.wait[0], s_tx.wait_num * sizeof(uint16_t));
+    s_tx.wait[0] = idx;
+    s_tx.wait_num++;
+}
+
+static void espnow_tx_done(const uint8_t addr[ESP_NOW_ETH_ALEN], bool ok, int64_t now)
+{
+    for (int i = 0; i < s_tx.flight_num; i++) {
+        if (!memcmp(s_tx.slot[s_tx.flight[i]].dest_addr, addr, ESP_NOW_ETH_ALEN)) {
+            espnow_tx_complete(i, ok, now);
+            return;
+        }
+    }
+    /**< a frame sent with esp_now_send directly */
+}
+
+/**< an earlier waiting frame to the same peer goes first, so a retry keeps its place */
+static bool espnow_tx_blocked(int pos)
+{
+    const uint8_t *addr = s_tx.slot[s_tx.wait[pos]].dest_addr;
+    for (int i = 0; i < pos; i++) {
+        if (!memcmp(s_tx.slot[s_tx.wait[i]].dest_addr, addr, ESP_NOW_ETH_ALEN)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void espnow_tx_pump(int64_t now)
+{
+    for (int i = 0; i < s_tx.wait_num && s_tx.flight_num < ESPNOW_TX_WINDOW;) {
+        uint16_t idx = s_tx.wait[i];
+        espnow_tx_slot_t *slot = &s_tx.slot[idx];
+        if (slot->send_us > now || espnow_tx_blocked(i)) {
+            i++;
+            continue;
+        }
+        /**< a peer beyond the driver slots takes the slot of the least recently used one */
+        esp_err_t ret = espnow_peer_activate(slot->dest_addr);
+        if (ret == ESP_OK || ret == ESP_ERR_NOT_FOUND) {
+            ret = esp_now_send(slot->dest_addr, slot->data, slot->len);
+        }
+        if (ret == ESP_ERR_ESPNOW_NO_MEM) {
+            /**< the driver buffers are full, go on after the next callback */
+            s_tx.driver_full = true;
+            break;
+        }
+        memmove(&s_tx.wait[i], &s_tx.wait[i + 1], (s_tx.wait_num - i - 1) * sizeof(uint16_t));
+        s_tx.wait_num--;
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "espnow send fail: %d", ret);
+            espnow_tx_finish(idx, false, now);
+            continue;
+        }
+        slot->send_us = now;
+        s_tx.flight[s_tx.flight_num++] = idx;
+    }
+}
+
+/**< ticks until the next retry or in-flight timeout */
+static TickType_t espnow_tx_next_wait(int64_t now)
+{
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < s_tx.flight_num; i++) {
+        int64_t t = s_tx.slot[s_tx.flight[i]].send_us + ESPNOW_TX_TIMEOUT_MS * 1000;
+        next = t < next ? t : next;
+    }
+    /**< with the driver full a waiting frame can only go after a callback or a timeout, do not poll for it */
+    if (s_tx.flight_num < ESPNOW_TX_WINDOW && !s_tx.driver_full) {
+        for (int i = 0; i < s_tx.wait_num; i++) {
+            int64_t t = s_tx.slot[s_tx.wait[i]].send_us;
+            next = t < next ? t : next;
+        }
+    }
+    if (s_tx.driver_full && s_tx.flight_num == 0) {
+        /**< the driver is busy with frames of others, no callback of ours will wake us */
+        return 1;
+    }
+    if (next == INT64_MAX) {
+        return portMAX_DELAY;
+    }
+    if (next <= now) {
+        return 0;
+    }
+    return (next - now + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000);
+}
+
+static void espnow_tx_task(void *arg)
+{
+    espnow_tx_msg_t msg;
+    for (;;) {
+        int64_t now = esp_timer_get_time();
+        if (xQueueReceive(s_tx.msg_q, &msg, espnow_tx_next_wait(now)) == pdTRUE) {
+            now = esp_timer_get_time();
+            if (msg.type == ESPNOW_TX_STOP) {
+                break;
+            } else if (msg.type == ESPNOW_TX_SUBMIT) {
+                s_tx.wait[s_tx.wait_num++] = msg.idx;
+            } else {
+                espnow_tx_done(msg.addr, msg.status == ESP_NOW_SEND_SUCCESS, now);
+            }
+        }
+        for (int i = s_tx.flight_num - 1; i >= 0; i--) {
+            if (now - s_tx.slot[s_tx.flight[i]].send_us > ESPNOW_TX_TIMEOUT_MS * 1000) {
+                espnow_tx_complete(i, false, now);
+            }
+        }
+        espnow_tx_pump(now);
+    }
+
+    /**< whatever is left fails */
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < s_tx.flight_num; i++) {
+        espnow_tx_finish(s_tx.flight[i], false, now);
+    }
+    for (int i = 0; i < s_tx.wait_num; i++) {
+        espnow_tx_finish(s_tx.wait[i], false, now);
     }
+    s_tx.flight_num = 0;
+    s_tx.wait_num = 0;
+    xSemaphoreGive(s_tx.exit_sem);
+    vTaskDelete(NULL);
+}
+
+static void espnow_tx_deinit(void)
+{
+    espnow_tx_msg_t msg = { .type = ESPNOW_TX_STOP };
+    if (s_tx.exit_sem && s_tx.msg_q && s_tx.slot) {
+        xQueueSend(s_tx.msg_q, &msg, portMAX_DELAY);
+        xSemaphoreTake(s_tx.exit_sem, portMAX_DELAY);
+    }
+    if (s_tx.free_q) {
+        vQueueDelete(s_tx.free_q);
+    }
+    if (s_tx.msg_q) {
+        vQueueDelete(s_tx.msg_q);
+    }
+    if (s_tx.exit_sem) {
+        vSemaphoreDelete(s_tx.exit_sem);
+    }
+    free(s_tx.slot);
+    memset(&s_tx, 0, sizeof(s_tx));
+}
+
+static esp_err_t espnow_tx_init(void)
+{
+    memset(&s_tx, 0, sizeof(s_tx));
+    s_tx.free_q = xQueueCreate(ESPNOW_TX_QUEUE_NUM, sizeof(uint16_t));
+    /**< room for every slot and every callback of the window, with a few to spare for direct sends */
+    s_tx.msg_q = xQueueCreate(ESPNOW_TX_QUEUE_NUM + ESPNOW_TX_WINDOW + 4, sizeof(espnow_tx_msg_t));
+    s_tx.exit_sem = xSemaphoreCreateBinary();
+    if (!s_tx.free_q || !s_tx.msg_q || !s_tx.exit_sem) {
+        goto ERR;
+    }
+    for (uint16_t i = 0; i < ESPNOW_TX_QUEUE_NUM; i++) {
+        xQueueSend(s_tx.free_q, &i, 0);
+    }
+    s_tx.slot = (espnow_tx_slot_t *) calloc(ESPNOW_TX_QUEUE_NUM, sizeof(espnow_tx_slot_t));
+    if (!s_tx.slot) {
+        goto ERR;
+    }
+    if (xTaskCreate(espnow_tx_task, "espnow_tx", ESPNOW_TX_TASK_STACK, NULL, ESPNOW_TX_TASK_PRIO, NULL) != pdPASS) {
+        free(s_tx.slot);
+        s_tx.slot = NULL;
+        goto ERR;
+    }
+    return ESP_OK;
+
+ERR:
+    ESP_LOGE(TAG, "espnow no memory for the transmit queue");
+    espnow_tx_deinit();
+    return ESP_ERR_NO_MEM;
+}
+
+static uint16_t espnow_rx_slot_alloc(void)
+{
+    uint32_t head = __atomic_load_n(&s_rx_free_head, __ATOMIC_ACQUIRE);
+    uint32_t next;
+    do {
+        if ((head & 0xffff) == ESPNOW_RX_SLOT_NONE) {
+            return ESPNOW_RX_SLOT_NONE;
+        }
+        next = ((head + 0x10000) & 0xffff0000) | __atomic_load_n(&s_rx_pool[head & 0xffff].next, __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&s_rx_free_head, &head, next, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    __atomic_sub_fetch(&s_rx_free_num, 1, __ATOMIC_RELAXED);
+    return head & 0xffff;
+}
+
+static void espnow_rx_slot_free(uint16_t idx)
+{
+    uint32_t head = __atomic_load_n(&s_rx_free_head, __ATOMIC_ACQUIRE);
+    uint32_t next;
+    do {
+        __atomic_store_n(&s_rx_pool[idx].next, head & 0xffff, __ATOMIC_RELAXED);
+        next = ((head + 0x10000) & 0xffff0000) | idx;
+    } while (!__atomic_compare_exchange_n(&s_rx_free_head, &head, next, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    __atomic_add_fetch(&s_rx_free_num, 1, __ATOMIC_RELAXED);
+}
+
+static void espnow_rx_queue_flush(xQueueHandle queue)
+{
+    uint16_t idx;
+    while (xQueueReceive(queue, &idx, 0) == pdTRUE) {
+        if (idx != ESPNOW_RX_SLOT_NONE) {
+            espnow_rx_slot_free(idx);
+        }
+    }
+}
+
+static espnow_rx_queue_t *espnow_rx_peer_find(const uint8_t addr[ESP_NOW_ETH_ALEN])
+{
+    for (int i = 0; i < ESPNOW_RX_PEER_QUEUE_MAX; i++) {
+        if (s_rx_peer[i].queue && !s_rx_peer[i].closing && !memcmp(s_rx_peer[i].addr, addr, ESP_NOW_ETH_ALEN)) {
+            return &s_rx_peer[i];
+        }
+    }
+    return NULL;
+}
+
+/**< runs in the Wi-Fi task: no allocation, one copy into a pool slot */
+static void espnow_rx_enqueue(espnow_rx_queue_t *rxq, const uint8_t *mac_addr, const uint8_t *data, int len)
+{
+    uint16_t idx = espnow_rx_slot_alloc();
+    uint16_t old;
+
+    /**< if the queue is full or the application holds every slot, drop the oldest frame of this queue */
+    if (idx == ESPNOW_RX_SLOT_NONE || !uxQueueSpacesAvailable(rxq->queue)) {
+        if (xQueueReceive(rxq->queue, &old, 0) == pdTRUE) {
+            rxq->rx_dropped++;
+            if (idx == ESPNOW_RX_SLOT_NONE) {
+                idx = old;
+            } else {
+                espnow_rx_slot_free(old);
+            }
+        }
+    }
+    if (idx == ESPNOW_RX_SLOT_NONE) {
+        s_rx_no_buf++;
+        return;
+    }
+
+    iot_espnow_pkt_t *pkt = &s_rx_pool[idx].pkt;
+    memcpy(pkt->src_addr, mac_addr, ESP_NOW_ETH_ALEN);
+    memcpy(pkt->data, data, len);
+    pkt->len = len;
+    if (xQueueSend(rxq->queue, &idx, 0) != pdTRUE) {
+        espnow_rx_slot_free(idx);
+        rxq->rx_dropped++;
+        return;
+    }
+    rxq->rx_packets++;
 }
 
 static void iot_espnow_recv_cb(const uint8_t *mac_addr, const uint8_t *data, int len)
 {
-    /**< if s_espnow_queue is full, delete the front item */
-    if (!uxQueueSpacesAvailable(s_espnow_queue)) {
-        espnow_data_t prev_data;
-        if(xQueueReceive(s_espnow_queue, (void *)&prev_data, 0) == pdTRUE) {
-            free(prev_data.data);
+    if (len <= 0 || len > ESP_NOW_MAX_DATA_LEN) {
+        return;
+    }
+    iot_espnow_rx_hook_t hook = __atomic_load_n(&s_rx_hook, __ATOMIC_ACQUIRE);
+    if (hook && hook(mac_addr, data, len, s_rx_hook_arg)) {
+        return;
+    }
+    /**
+     * the peer table is only locked once the application has asked for per-peer queues,
+     * the Wi-Fi task does not wait for it: while an application task holds it the frame goes to the shared queue
+     */
+    if (s_rx_peer_num > 0 && xSemaphoreTake(s_rx_mutex, 0) == pdTRUE) {
+        espnow_rx_queue_t *rxq = espnow_rx_peer_find(mac_addr);
+        if (rxq) {
+            espnow_rx_enqueue(rxq, mac_addr, data, len);
+            xSemaphoreGive(s_rx_mutex);
+            return;
         }
-        ESP_LOGW(TAG, "espnow recv queue is full...");
+        xSemaphoreGive(s_rx_mutex);
     }
+    espnow_rx_enqueue(&s_rx_default, mac_addr, data, len);
+}
 
-    espnow_data_t recv_data;
-    recv_data.data = (uint8_t *)calloc(1, len);
-    memcpy(recv_data.data, data, len);
-    memcpy(recv_data.addr, mac_addr, ESP_NOW_ETH_ALEN);
-    recv_data.data_len = len;
-    if(xQueueSend(s_espnow_queue, (void *)&recv_data, 0) != pdTRUE) {
-        free(recv_data.data);
+static void espnow_rx_pool_deinit(void)
+{
+    for (int i = 0; i < ESPNOW_RX_PEER_QUEUE_MAX; i++) {
+        if (s_rx_peer[i].queue) {
+            vQueueDelete(s_rx_peer[i].queue);
+        }
+    }
+    memset(s_rx_peer, 0, sizeof(s_rx_peer));
+    s_rx_peer_num = 0;
+    if (s_espnow_queue) {
+        vQueueDelete(s_espnow_queue);
+        s_espnow_queue = NULL;
+    }
+    memset(&s_rx_default, 0, sizeof(s_rx_default));
+    if (s_rx_mutex) {
+        vSemaphoreDelete(s_rx_mutex);
+        s_rx_mutex = NULL;
     }
+    free(s_rx_pool);
+    s_rx_pool = NULL;
+    s_rx_free_head = ESPNOW_RX_SLOT_NONE;
+    s_rx_free_num = 0;
+}
+
+static esp_err_t espnow_rx_pool_init(void)
+{
+    s_rx_pool = (espnow_rx_slot_t *) calloc(ESPNOW_RX_POOL_NUM, sizeof(espnow_rx_slot_t));
+    s_espnow_queue = xQueueCreate(ESPNOW_ERCV_QUEUE_NUM, sizeof(uint16_t));
+    s_rx_mutex = xSemaphoreCreateMutex();
+    if (!s_rx_pool || !s_espnow_queue || !s_rx_mutex) {
+        ESP_LOGE(TAG, "espnow no memory for the receive pool");
+        espnow_rx_pool_deinit();
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = ESPNOW_RX_POOL_NUM - 1; i >= 0; i--) {
+        espnow_rx_slot_free(i);
+    }
+    s_rx_no_buf = 0;
+    s_rx_default.queue = s_espnow_queue;
+    return ESP_OK;
 }
 
 esp_err_t iot_espnow_init(void)
@@ -81,9 +505,18 @@ esp_err_t iot_espnow_init(void)
         return ESP_OK;
     }
 
-    /**< event group for espnow sent cb */
-    g_event_group = xEventGroupCreate();
-    s_espnow_queue = xQueueCreate(ESPNOW_ERCV_QUEUE_NUM, sizeof(espnow_data_t));
+    if (espnow_peer_init() != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (espnow_rx_pool_init() != ESP_OK) {
+        espnow_peer_deinit();
+        return ESP_ERR_NO_MEM;
+    }
+    if (espnow_tx_init() != ESP_OK) {
+        espnow_rx_pool_deinit();
+        espnow_peer_deinit();
+        return ESP_ERR_NO_MEM;
+    }
 
     /**< init espnow, register cb and set pmk*/
     ESP_ERROR_CHECK(esp_now_init());
@@ -104,141 +537,297 @@ esp_err_t iot_espnow_deinit(void)
     
     ESP_ERROR_CHECK(esp_now_unregister_recv_cb());
     ESP_ERROR_CHECK(esp_now_unregister_send_cb());
+    espnow_tx_deinit();
     ESP_ERROR_CHECK(esp_now_deinit());
-    vEventGroupDelete(g_event_group);
-    g_event_group = NULL;
+    espnow_rx_pool_deinit();
+    espnow_peer_deinit();
 
     g_iot_espnow_inited = false;
     return ESP_OK;
 }
 
-esp_err_t iot_espnow_add_peer_base(const uint8_t dest_addr[ESP_NOW_ETH_ALEN],
-                                   bool default_encrypt, const uint8_t lmk[ESP_NOW_KEY_LEN],
-                                   wifi_interface_t interface, int8_t channel)
+size_t iot_espnow_recv(uint8_t src_addr[ESP_NOW_ETH_ALEN],
+                       void *data, TickType_t block_ticks)
 {
-    static SemaphoreHandle_t s_addpeer_mutex = NULL;
-
-    if (!s_addpeer_mutex) {
-        s_addpeer_mutex = xSemaphoreCreateMutex();
+    iot_espnow_pkt_t *pkt = NULL;
+    if (iot_espnow_recv_pkt(&pkt, block_ticks) != ESP_OK) {
+        ESP_LOGE(TAG, "espnow read fail");
+        return ESP_FAIL;
     }
+    size_t len = pkt->len;
+    memcpy(src_addr, pkt->src_addr, ESP_NOW_ETH_ALEN);
+    memcpy(data, pkt->data, len);
+    iot_espnow_release_pkt(pkt);
+    return len;
+}
 
-    xSemaphoreTake(s_addpeer_mutex, portMAX_DELAY);
+static esp_err_t espnow_rx_queue_recv(xQueueHandle queue, iot_espnow_pkt_t **pkt, TickType_t block_ticks)
+{
+    uint16_t idx;
+    if (xQueueReceive(queue, &idx, block_ticks) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    *pkt = &s_rx_pool[idx].pkt;
+    return ESP_OK;
+}
 
-    if (esp_now_is_peer_exist(dest_addr)) {
-        ESP_ERROR_CHECK(esp_now_del_peer(dest_addr));
+esp_err_t iot_espnow_recv_pkt(iot_espnow_pkt_t **pkt, TickType_t block_ticks)
+{
+    if (!s_espnow_queue) {
+        ESP_LOGE(TAG, "espnow not inited");
+        return ESP_ERR_INVALID_STATE;
     }
+    if (!pkt) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return espnow_rx_queue_recv(s_espnow_queue, pkt, block_ticks);
+}
 
-    esp_err_t ret = ESP_OK;
-    uint8_t pri_channel = 0;
-    if (channel < 0) {
-        wifi_second_chan_t sec_channel = 0;
-        ESP_ERROR_CHECK(esp_wifi_get_channel(&pri_channel, &sec_channel));
-        ESP_LOGI(TAG, "espnow add peer, channel: %d", pri_channel);
-    } else {
-        pri_channel = channel;
+esp_err_t iot_espnow_recv_pkt_from(const uint8_t src_addr[ESP_NOW_ETH_ALEN], iot_espnow_pkt_t **pkt,
+                                   TickType_t block_ticks)
+{
+    if (!s_rx_mutex) {
+        ESP_LOGE(TAG, "espnow not inited");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!src_addr || !pkt) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint16_t idx = ESPNOW_RX_SLOT_NONE;
+    xSemaphoreTake(s_rx_mutex, portMAX_DELAY);
+    espnow_rx_queue_t *rxq = espnow_rx_peer_find(src_addr);
+    if (rxq) {
+        /**< the queue is not deleted while readers is not 0 */
+        rxq->readers++;
+    }
+    xSemaphoreGive(s_rx_mutex);
+    if (!rxq) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    BaseType_t got = xQueueReceive(rxq->queue, &idx, block_ticks);
+    xSemaphoreTake(s_rx_mutex, portMAX_DELAY);
+    rxq->readers--;
+    xSemaphoreGive(s_rx_mutex);
+    if (got != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    if (idx == ESPNOW_RX_SLOT_NONE) {
+        /**< woken by iot_espnow_del_rx_queue() */
+        return ESP_ERR_NOT_FOUND;
     }
+    *pkt = &s_rx_pool[idx].pkt;
+    return ESP_OK;
+}
 
-    esp_now_peer_info_t *peer = calloc(1, sizeof(esp_now_peer_info_t));
-    peer->ifidx               = interface;
-    peer->channel             = pri_channel;
+void iot_espnow_release_pkt(iot_espnow_pkt_t *pkt)
+{
+    espnow_rx_slot_t *slot = (espnow_rx_slot_t *) pkt;
+    if (!pkt || !s_rx_pool || slot < s_rx_pool || slot >= s_rx_pool + ESPNOW_RX_POOL_NUM) {
+        ESP_LOGE(TAG, "release of a packet not from the receive pool");
+        return;
+    }
+    espnow_rx_slot_free(slot - s_rx_pool);
+}
 
-    if (!memcmp(dest_addr, g_bcast_mac, ESP_NOW_ETH_ALEN)) {
-        if (default_encrypt) {
-            ESP_LOGW(TAG, "broadcast addr cannot enable encryption");
-        }
-        /**< broadcast addr cannot encrypt */
-        peer->encrypt = false;
-    } else {
-        if (default_encrypt) {
-            ESP_LOGI(TAG, "Set default key...%s", IOT_ESPNOW_LMK_DEFAULT);
-            peer->encrypt = true;
-            memcpy(peer->lmk, IOT_ESPNOW_LMK_DEFAULT, ESP_NOW_KEY_LEN);
-        } else if (lmk) {
-            peer->encrypt = true;
-            memcpy(peer->lmk, lmk, ESP_NOW_KEY_LEN);
-        } else {
-            peer->encrypt = false;
+esp_err_t iot_espnow_add_rx_queue(const uint8_t src_addr[ESP_NOW_ETH_ALEN], int queue_len)
+{
+    esp_err_t ret = ESP_OK;
+    if (!s_rx_mutex) {
+        ESP_LOGE(TAG, "espnow not inited");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!src_addr || queue_len <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    /**< created before taking the lock, the Wi-Fi task skips the peer queues while it is held */
+    xQueueHandle queue = xQueueCreate(queue_len, sizeof(uint16_t));
+    if (!queue) {
+        return ESP_ERR_NO_MEM;
+    }
+    xSemaphoreTake(s_rx_mutex, portMAX_DELAY);
+    espnow_rx_queue_t *rxq = espnow_rx_peer_find(src_addr);
+    if (rxq) {
+        ret = ESP_ERR_INVALID_STATE;
+        goto EXIT;
+    }
+    for (int i = 0; i < ESPNOW_RX_PEER_QUEUE_MAX && !rxq; i++) {
+        if (!s_rx_peer[i].queue) {
+            rxq = &s_rx_peer[i];
         }
     }
+    if (!rxq) {
+        ret = ESP_ERR_NO_MEM;
+        goto EXIT;
+    }
+    memset(rxq, 0, sizeof(espnow_rx_queue_t));
+    rxq->queue = queue;
+    memcpy(rxq->addr, src_addr, ESP_NOW_ETH_ALEN);
+    s_rx_peer_num++;
 
-    memcpy(peer->peer_addr, dest_addr, ESP_NOW_ETH_ALEN);
-    ret = esp_now_add_peer(peer);
+EXIT:
+    xSemaphoreGive(s_rx_mutex);
     if (ret != ESP_OK) {
-        ESP_LOGW(TAG, "esp_now_add_peer fail, ret: %d", ret);
+        vQueueDelete(queue);
     }
-    
-    free(peer);
-    xSemaphoreGive(s_addpeer_mutex);
     return ret;
 }
 
-esp_err_t iot_espnow_del_peer(const uint8_t dest_addr[ESP_NOW_ETH_ALEN])
+esp_err_t iot_espnow_del_rx_queue(const uint8_t src_addr[ESP_NOW_ETH_ALEN])
 {
-    esp_err_t ret = ESP_OK;
-
-    if (esp_now_is_peer_exist(dest_addr)) {
-        ret = esp_now_del_peer(dest_addr);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "esp_now_del_peer fail, ret: %d", ret);
-            return ESP_FAIL;
-        }
+    if (!s_rx_mutex) {
+        ESP_LOGE(TAG, "espnow not inited");
+        return ESP_ERR_INVALID_STATE;
     }
-
+    if (!src_addr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s_rx_mutex, portMAX_DELAY);
+    espnow_rx_queue_t *rxq = espnow_rx_peer_find(src_addr);
+    if (!rxq) {
+        xSemaphoreGive(s_rx_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+    /**< later frames go to the shared queue, wake the waiting readers and let them leave before the queue goes */
+    rxq->closing = true;
+    while (rxq->readers > 0) {
+        uint16_t wake = ESPNOW_RX_SLOT_NONE;
+        espnow_rx_queue_flush(rxq->queue);
+        xQueueSend(rxq->queue, &wake, 0);
+        xSemaphoreGive(s_rx_mutex);
+        vTaskDelay(1);
+        xSemaphoreTake(s_rx_mutex, portMAX_DELAY);
+    }
+    espnow_rx_queue_flush(rxq->queue);
+    vQueueDelete(rxq->queue);
+    memset(rxq, 0, sizeof(espnow_rx_queue_t));
+    s_rx_peer_num--;
+    xSemaphoreGive(s_rx_mutex);
     return ESP_OK;
 }
 
-size_t iot_espnow_recv(uint8_t src_addr[ESP_NOW_ETH_ALEN],
-                       void *data, TickType_t block_ticks)
+esp_err_t iot_espnow_get_rx_stat(const uint8_t src_addr[ESP_NOW_ETH_ALEN], iot_espnow_rx_stat_t *stat)
 {
-    if (!s_espnow_queue) {
-        return ESP_FAIL;
+    esp_err_t ret = ESP_OK;
+    if (!s_rx_mutex) {
+        ESP_LOGE(TAG, "espnow not inited");
+        return ESP_ERR_INVALID_STATE;
     }
-
-    espnow_data_t espnow_recv_data;
-    if (xQueueReceive(s_espnow_queue, (void *)&espnow_recv_data, block_ticks) != pdTRUE) {
-        ESP_LOGE(TAG, "espnow read fail");
-        return ESP_FAIL;
+    if (!stat) {
+        return ESP_ERR_INVALID_ARG;
     }
-    memcpy(src_addr, espnow_recv_data.addr, ESP_NOW_ETH_ALEN);
-    memcpy(data, espnow_recv_data.data, espnow_recv_data.data_len);    
-    free(espnow_recv_data.data);
-    return espnow_recv_data.data_len;
+    xSemaphoreTake(s_rx_mutex, portMAX_DELAY);
+    espnow_rx_queue_t *rxq = src_addr ? espnow_rx_peer_find(src_addr) : &s_rx_default;
+    if (rxq) {
+        stat->rx_packets = rxq->rx_packets;
+        stat->rx_dropped = rxq->rx_dropped;
+        stat->queued = uxQueueMessagesWaiting(rxq->queue);
+    } else {
+        ret = ESP_ERR_NOT_FOUND;
+    }
+    stat->rx_no_buf = s_rx_no_buf;
+    stat->pool_free = __atomic_load_n(&s_rx_free_num, __ATOMIC_RELAXED);
+    xSemaphoreGive(s_rx_mutex);
+    return ret;
 }
 
-size_t iot_espnow_send(const uint8_t dest_addr[ESP_NOW_ETH_ALEN],
-                        const void *data, size_t data_len, TickType_t block_ticks)
+esp_err_t iot_espnow_set_rx_hook(iot_espnow_rx_hook_t hook, void *arg)
 {
-    size_t ret;
-    SemaphoreHandle_t s_send_mutex = NULL;
-
-    if (!s_send_mutex) {
-        s_send_mutex = xSemaphoreCreateMutex();
+    if (hook == NULL) {
+        __atomic_store_n(&s_rx_hook, NULL, __ATOMIC_RELEASE);
+        return ESP_OK;
     }
-
-    if (xSemaphoreTake(s_send_mutex, block_ticks) != pdTRUE) {
-        return ESP_FAIL;
+    if (__atomic_load_n(&s_rx_hook, __ATOMIC_ACQUIRE)) {
+        return ESP_ERR_INVALID_STATE;
     }
+    s_rx_hook_arg = arg;
+    __atomic_store_n(&s_rx_hook, hook, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
 
-    xEventGroupClearBits(g_event_group, SEND_CB_OK | SEND_CB_FAIL);
-    /**< espnow send and wait cb */
-    ret = esp_now_send(dest_addr, (uint8_t *)data, data_len);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "espnow send fail: %d", ret);
-        goto EXIT;
+esp_err_t iot_espnow_send_async(const uint8_t dest_addr[ESP_NOW_ETH_ALEN], const void *data, size_t data_len,
+                                iot_espnow_send_cb_t cb, void *arg, TickType_t block_ticks)
+{
+    uint16_t idx;
+    if (!s_tx.slot) {
+        ESP_LOGE(TAG, "espnow not inited");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!dest_addr || !data || data_len == 0 || data_len > ESP_NOW_MAX_DATA_LEN) {
+        return ESP_ERR_INVALID_ARG;
     }
+    if (xQueueReceive(s_tx.free_q, &idx, block_ticks) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    espnow_tx_slot_t *slot = &s_tx.slot[idx];
+    memcpy(slot->dest_addr, dest_addr, ESP_NOW_ETH_ALEN);
+    memcpy(slot->data, data, data_len);
+    slot->len = data_len;
+    slot->cb = cb;
+    slot->arg = arg;
+    slot->retry = 0;
+    slot->queued_us = esp_timer_get_time();
+    slot->send_us = 0;
+    espnow_tx_msg_t msg = { .type = ESPNOW_TX_SUBMIT, .idx = idx };
+    xQueueSend(s_tx.msg_q, &msg, portMAX_DELAY);
+    return ESP_OK;
+}
 
-    EventBits_t uxBits = xEventGroupWaitBits(g_event_group, SEND_CB_OK | SEND_CB_FAIL,
-                                             pdTRUE, pdFALSE, portMAX_DELAY);
-    if ((uxBits & SEND_CB_OK) != SEND_CB_OK) {
-        ret = ESP_FAIL;
-        ESP_LOGE(TAG, "g_event_group wait SEND_CB_OK fail");
-        goto EXIT;
+esp_err_t iot_espnow_send_flush(TickType_t block_ticks)
+{
+    uint16_t idx[ESPNOW_TX_QUEUE_NUM];
+    int num = 0;
+    esp_err_t ret = ESP_OK;
+    TickType_t start = xTaskGetTickCount();
+    if (!s_tx.slot) {
+        return ESP_ERR_INVALID_STATE;
     }
+    /**< every slot back in the free queue means nothing is pending */
+    for (; num < ESPNOW_TX_QUEUE_NUM; num++) {
+        TickType_t spent = xTaskGetTickCount() - start;
+        TickType_t wait = block_ticks == portMAX_DELAY ? portMAX_DELAY : spent < block_ticks ? block_ticks - spent : 0;
+        if (xQueueReceive(s_tx.free_q, &idx[num], wait) != pdTRUE) {
+            ret = ESP_ERR_TIMEOUT;
+            break;
+        }
+    }
+    for (int i = 0; i < num; i++) {
+        xQueueSend(s_tx.free_q, &idx[i], 0);
+    }
+    return ret;
+}
 
-    ret = data_len;
+typedef struct {
+    TaskHandle_t task;
+    bool done;
+    esp_now_send_status_t status;
+} espnow_send_wait_t;
 
-EXIT:
-    xSemaphoreGive(s_send_mutex);
-    return ret;
+static void espnow_send_wait_cb(const uint8_t *dest_addr, esp_now_send_status_t status, void *arg)
+{
+    espnow_send_wait_t *wait = (espnow_send_wait_t *) arg;
+    /**< the waiter may return as soon as done is set, wait must not be touched after that */
+    TaskHandle_t task = wait->task;
+    wait->status = status;
+    __atomic_store_n(&wait->done, true, __ATOMIC_RELEASE);
+    xTaskNotifyGive(task);
 }
 
+size_t iot_espnow_send(const uint8_t dest_addr[ESP_NOW_ETH_ALEN],
+                        const void *data, size_t data_len, TickType_t block_ticks)
+{
+    espnow_send_wait_t wait = { .task = xTaskGetCurrentTaskHandle(), .done = false };
+    esp_err_t ret = iot_espnow_send_async(dest_addr, data, data_len, espnow_send_wait_cb, &wait, block_ticks);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "espnow send fail: %d", ret);
+        return ESP_FAIL;
+    }
+    /**< the tx task always calls back, at the latest when the frame times out */
+    while (!__atomic_load_n(&wait.done, __ATOMIC_ACQUIRE)) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    if (wait.status != ESP_NOW_SEND_SUCCESS) {
+        ESP_LOGE(TAG, "espnow send to "MACSTR" fail", MAC2STR(dest_addr));
+        return ESP_FAIL;
+    }
+    return data_len;
+}
@@ -0,0 +1,423 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "espnow_peer.h"
+
+static const char* TAG = "iot_espnow_peer";
+
+#ifdef CONFIG_IOT_ESPNOW_PEER_MAX
+#define ESPNOW_PEER_MAX             CONFIG_IOT_ESPNOW_PEER_MAX
+#else
+#define ESPNOW_PEER_MAX             128
+#endif
+#ifdef CONFIG_IOT_ESPNOW_PEER_HW_MAX
+#define ESPNOW_PEER_HW_MAX          CONFIG_IOT_ESPNOW_PEER_HW_MAX
+#else
+#define ESPNOW_PEER_HW_MAX          ESP_NOW_MAX_TOTAL_PEER_NUM
+#endif
+#ifdef ESP_NOW_MAX_ENCRYPT_PEER_NUM
+#define ESPNOW_PEER_HW_ENCRYPT_MAX  ESP_NOW_MAX_ENCRYPT_PEER_NUM
+#else
+#define ESPNOW_PEER_HW_ENCRYPT_MAX  6
+#endif
+#define ESPNOW_PEER_NONE            0xffff
+
+#define IOT_ESPNOW_LMK_DEFAULT "lmk1234567890123"
+
+static const uint8_t g_bcast_mac[ESP_NOW_ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+typedef struct {
+    iot_espnow_tx_stat_t stat;
+    uint64_t latency_sum_us;
+} espnow_peer_stat_t;
+
+typedef struct {
+    uint8_t addr[ESP_NOW_ETH_ALEN];
+    uint8_t lmk[ESP_NOW_KEY_LEN];
+    uint8_t channel;            /**< 0: the channel the interface is on */
+    uint8_t ifidx;
+    bool encrypt;
+    int8_t hw;                  /**< position in s_peer.hw, -1 if not in the driver */
+    uint16_t next;              /**< hash chain, or free list */
+    uint32_t used;              /**< LRU clock of the last frame */
+    uint32_t activations;
+    espnow_peer_stat_t tx;
+} espnow_peer_t;
+
+/**
+ * Every known peer lives in a hash table, the driver only holds ESPNOW_PEER_HW_MAX of them.
+ * A peer gets a driver slot when a frame goes to it, taking the slot of the least recently
+ * used peer if none is free. Unencrypted peers give up their slot first, an encrypted peer
+ * out of the driver can still be sent to but its frames can not be decrypted.
+ */
+static struct {
+    espnow_peer_t *peer;
+    uint16_t *bucket;
+    int bucket_bits;
+    uint16_t free_head;
+    uint16_t num;
+    uint16_t hw[ESPNOW_PEER_HW_MAX];
+    int hw_num;
+    int hw_encrypt_num;
+    uint32_t clock;
+    espnow_peer_stat_t total;
+    SemaphoreHandle_t mutex;
+} s_peer;
+
+static uint32_t espnow_peer_hash(const uint8_t addr[ESP_NOW_ETH_ALEN])
+{
+    /**< the vendor prefix is shared by most peers, the last bytes tell them apart */
+    uint32_t h = ((uint32_t) addr[2] << 24 | addr[3] << 16 | addr[4] << 8 | addr[5]) ^ (addr[0] << 8 | addr[1]);
+    return (h * 2654435761u) >> (32 - s_peer.bucket_bits);
+}
+
+static uint16_t espnow_peer_find(const uint8_t addr[ESP_NOW_ETH_ALEN])
+{
+    uint16_t idx = s_peer.bucket[espnow_peer_hash(addr)];
+    while (idx != ESPNOW_PEER_NONE && memcmp(s_peer.peer[idx].addr, addr, ESP_NOW_ETH_ALEN)) {
+        idx = s_peer.peer[idx].next;
+    }
+    return idx;
+}
+
+static void espnow_peer_info(const espnow_peer_t *peer, esp_now_peer_info_t *info)
+{
+    memset(info, 0, sizeof(esp_now_peer_info_t));
+    memcpy(info->peer_addr, peer->addr, ESP_NOW_ETH_ALEN);
+    memcpy(info->lmk, peer->lmk, ESP_NOW_KEY_LEN);
+    info->channel = peer->channel;
+    info->ifidx = peer->ifidx;
+    info->encrypt = peer->encrypt;
+}
+
+static void espnow_peer_hw_remove(espnow_peer_t *peer)
+{
+    esp_err_t ret = esp_now_del_peer(peer->addr);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "esp_now_del_peer fail, ret: %d", ret);
+    }
+    /**< the last slot moves into the hole */
+    uint16_t last = s_peer.hw[--s_peer.hw_num];
+    s_peer.hw[peer->hw] = last;
+    s_peer.peer[last].hw = peer->hw;
+    peer->hw = -1;
+    if (peer->encrypt) {
+        s_peer.hw_encrypt_num--;
+    }
+}
+
+/**< free a driver slot, the least recently used unencrypted peer first unless an encrypted one must go */
+static bool espnow_peer_evict(bool encrypt_only)
+{
+    int lru = -1;
+    for (int pass = 0; pass < 2 && lru < 0; pass++) {
+        for (int i = 0; i < s_peer.hw_num; i++) {
+            const espnow_peer_t *peer = &s_peer.peer[s_peer.hw[i]];
+            if (encrypt_only ? !peer->encrypt : pass == 0 && peer->encrypt) {
+                continue;
+            }
+            if (lru < 0 || (int32_t) (peer->used - s_peer.peer[s_peer.hw[lru]].used) < 0) {
+                lru = i;
+            }
+        }
+    }
+    if (lru < 0) {
+        return false;
+    }
+    espnow_peer_hw_remove(&s_peer.peer[s_peer.hw[lru]]);
+    return true;
+}
+
+static esp_err_t espnow_peer_hw_add(uint16_t idx, bool evict)
+{
+    espnow_peer_t *peer = &s_peer.peer[idx];
+    esp_now_peer_info_t info;
+    esp_err_t ret;
+
+    if (peer->encrypt && s_peer.hw_encrypt_num >= ESPNOW_PEER_HW_ENCRYPT_MAX && (!evict || !espnow_peer_evict(true))) {
+        return ESP_ERR_ESPNOW_FULL;
+    }
+    if (s_peer.hw_num >= ESPNOW_PEER_HW_MAX && (!evict || !espnow_peer_evict(false))) {
+        return ESP_ERR_ESPNOW_FULL;
+    }
+    espnow_peer_info(peer, &info);
+    ret = esp_now_add_peer(&info);
+    if (ret == ESP_ERR_ESPNOW_EXIST) {
+        /**< added with esp_now_add_peer directly */
+        ret = esp_now_mod_peer(&info);
+    } else if (ret == ESP_ERR_ESPNOW_FULL && evict && espnow_peer_evict(false)) {
+        /**< the application holds driver slots of its own */
+        ret = esp_now_add_peer(&info);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "esp_now_add_peer fail, ret: %d", ret);
+        return ret;
+    }
+    peer->hw = s_peer.hw_num;
+    s_peer.hw[s_peer.hw_num++] = idx;
+    if (peer->encrypt) {
+        s_peer.hw_encrypt_num++;
+    }
+    peer->activations++;
+    return ESP_OK;
+}
+
+static void espnow_peer_stat_update(espnow_peer_stat_t *tx, bool ok, uint32_t retries, uint32_t latency_us)
+{
+    tx->stat.tx_packets++;
+    tx->stat.retries += retries;
+    if (ok) {
+        tx->stat.tx_ok++;
+        tx->latency_sum_us += latency_us;
+        tx->stat.latency_avg_us = tx->latency_sum_us / tx->stat.tx_ok;
+        if (latency_us > tx->stat.latency_max_us) {
+            tx->stat.latency_max_us = latency_us;
+        }
+    } else {
+        tx->stat.tx_lost++;
+    }
+}
+
+esp_err_t espnow_peer_init(void)
+{
+    memset(&s_peer, 0, sizeof(s_peer));
+    for (s_peer.bucket_bits = 1; (1 << s_peer.bucket_bits) < ESPNOW_PEER_MAX; s_peer.bucket_bits++);
+    s_peer.peer = (espnow_peer_t *) calloc(ESPNOW_PEER_MAX, sizeof(espnow_peer_t));
+    s_peer.bucket = (uint16_t *) malloc((1 << s_peer.bucket_bits) * sizeof(uint16_t));
+    s_peer.mutex = xSemaphoreCreateMutex();
+    if (!s_peer.peer || !s_peer.bucket || !s_peer.mutex) {
+        ESP_LOGE(TAG, "espnow no memory for the peer table");
+        espnow_peer_deinit();
+        return ESP_ERR_NO_MEM;
+    }
+    memset(s_peer.bucket, 0xff, (1 << s_peer.bucket_bits) * sizeof(uint16_t));
+    for (int i = 0; i < ESPNOW_PEER_MAX; i++) {
+        s_peer.peer[i].next = i + 1 < ESPNOW_PEER_MAX ? i + 1 : ESPNOW_PEER_NONE;
+    }
+    s_peer.free_head = 0;
+    return ESP_OK;
+}
+
+/**< the driver forgets its peers in esp_now_deinit */
+void espnow_peer_deinit(void)
+{
+    if (s_peer.mutex) {
+        vSemaphoreDelete(s_peer.mutex);
+    }
+    free(s_peer.peer);
+    free(s_peer.bucket);
+    memset(&s_peer, 0, sizeof(s_peer));
+}
+
+esp_err_t espnow_peer_activate(const uint8_t addr[ESP_NOW_ETH_ALEN])
+{
+    esp_err_t ret = ESP_OK;
+    xSemaphoreTake(s_peer.mutex, portMAX_DELAY);
+    uint16_t idx = espnow_peer_find(addr);
+    if (idx == ESPNOW_PEER_NONE) {
+        ret = ESP_ERR_NOT_FOUND;
+    } else {
+        s_peer.peer[idx].used = ++s_peer.clock;
+        if (s_peer.peer[idx].hw < 0) {
+            ret = espnow_peer_hw_add(idx, true);
+        }
+    }
+    xSemaphoreGive(s_peer.mutex);
+    return ret;
+}
+
+void espnow_peer_tx_stat(const uint8_t addr[ESP_NOW_ETH_ALEN], bool ok, uint32_t retries, uint32_t latency_us)
+{
+    xSemaphoreTake(s_peer.mutex, portMAX_DELAY);
+    uint16_t idx = espnow_peer_find(addr);
+    if (idx != ESPNOW_PEER_NONE) {
+        espnow_peer_stat_update(&s_peer.peer[idx].tx, ok, retries, latency_us);
+    }
+    espnow_peer_stat_update(&s_peer.total, ok, retries, latency_us);
+    xSemaphoreGive(s_peer.mutex);
+}
+
+esp_err_t iot_espnow_add_peer_base(const uint8_t dest_addr[ESP_NOW_ETH_ALEN],
+                                   bool default_encrypt, const uint8_t lmk[ESP_NOW_KEY_LEN],
+                                   wifi_interface_t interface, int8_t channel)
+{
+    espnow_peer_t conf = { .ifidx = interface, .hw = -1 };
+    esp_err_t ret = ESP_OK;
+
+    if (!s_peer.mutex) {
+        ESP_LOGE(TAG, "espnow not inited");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!dest_addr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(conf.addr, dest_addr, ESP_NOW_ETH_ALEN);
+    /**< channel 0 follows the interface, no need to ask Wi-Fi for it */
+    conf.channel = channel < 0 ? 0 : channel;
+    if (!memcmp(dest_addr, g_bcast_mac, ESP_NOW_ETH_ALEN)) {
+        if (default_encrypt) {
+            ESP_LOGW(TAG, "broadcast addr cannot enable encryption");
+        }
+        /**< broadcast addr cannot encrypt */
+        conf.encrypt = false;
+    } else if (default_encrypt) {
+        conf.encrypt = true;
+        memcpy(conf.lmk, IOT_ESPNOW_LMK_DEFAULT, ESP_NOW_KEY_LEN);
+    } else if (lmk) {
+        conf.encrypt = true;
+        memcpy(conf.lmk, lmk, ESP_NOW_KEY_LEN);
+    }
+
+    xSemaphoreTake(s_peer.mutex, portMAX_DELAY);
+    uint16_t idx = espnow_peer_find(dest_addr);
+    if (idx != ESPNOW_PEER_NONE) {
+        espnow_peer_t *peer = &s_peer.peer[idx];
+        if (peer->channel == conf.channel && peer->ifidx == conf.ifidx && peer->encrypt == conf.encrypt
+                && !memcmp(peer->lmk, conf.lmk, ESP_NOW_KEY_LEN)) {
+            xSemaphoreGive(s_peer.mutex);
+            return ESP_OK;
+        }
+        if (peer->hw >= 0) {
+            espnow_peer_hw_remove(peer);
+        }
+        memcpy(peer->lmk, conf.lmk, ESP_NOW_KEY_LEN);
+        peer->channel = conf.channel;
+        peer->ifidx = conf.ifidx;
+        peer->encrypt = conf.encrypt;
+    } else {
+        idx = s_peer.free_head;
+        if (idx == ESPNOW_PEER_NONE) {
+            xSemaphoreGive(s_peer.mutex);
+            ESP_LOGW(TAG, "espnow peer table full, %d peers", ESPNOW_PEER_MAX);
+            return ESP_ERR_NO_MEM;
+        }
+        espnow_peer_t *peer = &s_peer.peer[idx];
+        s_peer.free_head = peer->next;
+        uint32_t hash = espnow_peer_hash(dest_addr);
+        *peer = conf;
+        peer->next = s_peer.bucket[hash];
+        s_peer.bucket[hash] = idx;
+        s_peer.num++;
+    }
+    s_peer.peer[idx].used = ++s_peer.clock;
+    /**< take a free driver slot now, an encrypted peer also the slot of another one,
+         its frames can only be decrypted while it is in the driver */
+    if (s_peer.hw_num < ESPNOW_PEER_HW_MAX || conf.encrypt) {
+        ret = espnow_peer_hw_add(idx, conf.encrypt);
+    }
+    xSemaphoreGive(s_peer.mutex);
+    return ret == ESP_ERR_ESPNOW_FULL && !conf.encrypt ? ESP_OK : ret;
+}
+
+esp_err_t iot_espnow_del_peer(const uint8_t dest_addr[ESP_NOW_ETH_ALEN])
+{
+    if (!s_peer.mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_peer.mutex, portMAX_DELAY);
+    uint32_t hash = espnow_peer_hash(dest_addr);
+    uint16_t *link = &s_peer.bucket[hash];
+    while (*link != ESPNOW_PEER_NONE && memcmp(s_peer.peer[*link].addr, dest_addr, ESP_NOW_ETH_ALEN)) {
+        link = &s_peer.peer[*link].next;
+    }
+    uint16_t idx = *link;
+    if (idx != ESPNOW_PEER_NONE) {
+        espnow_peer_t *peer = &s_peer.peer[idx];
+        if (peer->hw >= 0) {
+            espnow_peer_hw_remove(peer);
+        }
+        *link = peer->next;
+        memset(peer, 0, sizeof(espnow_peer_t));
+        peer->next = s_peer.free_head;
+        s_peer.free_head = idx;
+        s_peer.num--;
+    } else if (esp_now_is_peer_exist(dest_addr)) {
+        /**< added with esp_now_add_peer directly */
+        esp_err_t ret = esp_now_del_peer(dest_addr);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "esp_now_del_peer fail, ret: %d", ret);
+            xSemaphoreGive(s_peer.mutex);
+            return ESP_FAIL;
+        }
+    }
+    xSemaphoreGive(s_peer.mutex);
+    return ESP_OK;
+}
+
+esp_err_t iot_espnow_get_peer(const uint8_t dest_addr[ESP_NOW_ETH_ALEN], iot_espnow_peer_info_t *info)
+{
+    esp_err_t ret = ESP_OK;
+    if (!s_peer.mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!dest_addr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s_peer.mutex, portMAX_DELAY);
+    uint16_t idx = espnow_peer_find(dest_addr);
+    if (idx == ESPNOW_PEER_NONE) {
+        ret = ESP_ERR_NOT_FOUND;
+    } else if (info) {
+        const espnow_peer_t *peer = &s_peer.peer[idx];
+        info->channel = peer->channel;
+        info->ifidx = peer->ifidx;
+        info->encrypt = peer->encrypt;
+        info->active = peer->hw >= 0;
+        info->activations = peer->activations;
+    }
+    xSemaphoreGive(s_peer.mutex);
+    return ret;
+}
+
+esp_err_t iot_espnow_get_peer_num(int *total, int *active)
+{
+    if (!s_peer.mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_peer.mutex, portMAX_DELAY);
+    if (total) {
+        *total = s_peer.num;
+    }
+    if (active) {
+        *active = s_peer.hw_num;
+    }
+    xSemaphoreGive(s_peer.mutex);
+    return ESP_OK;
+}
+
+esp_err_t iot_espnow_get_tx_stat(const uint8_t dest_addr[ESP_NOW_ETH_ALEN], iot_espnow_tx_stat_t *stat)
+{
+    esp_err_t ret = ESP_OK;
+    if (!s_peer.mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!stat) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s_peer.mutex, portMAX_DELAY);
+    uint16_t idx = dest_addr ? espnow_peer_find(dest_addr) : ESPNOW_PEER_NONE;
+    if (!dest_addr) {
+        *stat = s_peer.total.stat;
+    } else if (idx != ESPNOW_PEER_NONE) {
+        *stat = s_peer.peer[idx].tx.stat;
+    } else {
+        ret = ESP_ERR_NOT_FOUND;
+    }
+    xSemaphoreGive(s_peer.mutex);
+    return ret;
+}
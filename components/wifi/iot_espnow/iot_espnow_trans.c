@@ -0,0 +1,327 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "iot_espnow_trans.h"
+
+static const char* TAG = "iot_espnow_trans";
+
+#define ESPNOW_TRANS_EVENT_NUM      16
+#define ESPNOW_TRANS_RECV_NUM       4
+#define ESPNOW_TRANS_TASK_STACK     3072
+#define ESPNOW_TRANS_TASK_PRIO      9       /**< below the transmit task of iot_espnow */
+
+typedef enum {
+    ESPNOW_TRANS_FRAME = 0,
+    ESPNOW_TRANS_SEND,
+    ESPNOW_TRANS_STOP,
+} espnow_trans_event_type_t;
+
+typedef struct {
+    uint8_t addr[ESP_NOW_ETH_ALEN];
+    const void *data;
+    size_t len;
+    TaskHandle_t task;
+    esp_err_t result;
+    bool done;
+} espnow_trans_req_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t len;
+    uint8_t addr[ESP_NOW_ETH_ALEN];
+    union {
+        espnow_trans_req_t *req;
+        uint8_t data[ESP_NOW_MAX_DATA_LEN];
+    };
+} espnow_trans_event_t;
+
+typedef struct {
+    uint8_t addr[ESP_NOW_ETH_ALEN];
+    uint8_t *data;
+    size_t len;
+} espnow_trans_msg_t;
+
+/**
+ * The protocol is only touched by the transport task, the Wi-Fi task and the
+ * application tasks hand it frames and requests through event_q.
+ */
+static struct {
+    espnow_trans_proto_t *proto;
+    xQueueHandle event_q;
+    xQueueHandle msg_q;
+    SemaphoreHandle_t slot_sem;     /**< free message slots of the protocol */
+    SemaphoreHandle_t exit_sem;
+    SemaphoreHandle_t stat_mutex;
+    espnow_trans_stat_t stat;
+    uint32_t recv_overflow;
+} s_trans;
+
+static const uint8_t s_bcast_addr[ESP_NOW_ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+static bool espnow_trans_rx_hook(const uint8_t src_addr[ESP_NOW_ETH_ALEN], const uint8_t *data, int len, void *arg)
+{
+    if (len < ESPNOW_TRANS_HDR_SIZE || data[0] != ESPNOW_TRANS_MAGIC) {
+        return false;
+    }
+    espnow_trans_event_t ev = { .type = ESPNOW_TRANS_FRAME, .len = len };
+    memcpy(ev.addr, src_addr, ESP_NOW_ETH_ALEN);
+    memcpy(ev.data, data, len);
+    /**< a frame dropped here is recovered by the protocol */
+    xQueueSend(s_trans.event_q, &ev, 0);
+    return true;
+}
+
+static esp_err_t espnow_trans_output(void *arg, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN], const uint8_t *frame, int len)
+{
+    if (iot_espnow_get_peer(addr, NULL) == ESP_ERR_NOT_FOUND) {
+        esp_err_t ret = iot_espnow_add_peer_no_encrypt(addr, ESP_IF_WIFI_STA, -1);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "add peer "MACSTR" fail: %d", MAC2STR(addr), ret);
+            return ret;
+        }
+    }
+    return iot_espnow_send_async(addr, frame, len, NULL, NULL, 0);
+}
+
+static void espnow_trans_deliver(void *arg, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN], uint8_t *data, size_t len)
+{
+    espnow_trans_msg_t msg = { .data = data, .len = len };
+    memcpy(msg.addr, addr, ESP_NOW_ETH_ALEN);
+    if (xQueueSend(s_trans.msg_q, &msg, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "message from "MACSTR" dropped, nobody receives", MAC2STR(addr));
+        xSemaphoreTake(s_trans.stat_mutex, portMAX_DELAY);
+        s_trans.recv_overflow++;
+        xSemaphoreGive(s_trans.stat_mutex);
+        free(data);
+    }
+}
+
+static void espnow_trans_done(void *arg, void *ctx, esp_err_t result)
+{
+    espnow_trans_req_t *req = (espnow_trans_req_t *) ctx;
+    TaskHandle_t task = req->task;
+    req->result = result;
+    __atomic_store_n(&req->done, true, __ATOMIC_RELEASE);
+    xTaskNotifyGive(task);
+    xSemaphoreGive(s_trans.slot_sem);
+}
+
+static void espnow_trans_task(void *arg)
+{
+    espnow_trans_event_t ev;
+    int64_t next = INT64_MAX;
+
+    for (;;) {
+        TickType_t wait = portMAX_DELAY;
+        if (next != INT64_MAX) {
+            int64_t us = next - esp_timer_get_time();
+            int64_t tick_us = portTICK_PERIOD_MS * 1000;
+            wait = us <= 0 ? 0 : (us + tick_us - 1) / tick_us;
+        }
+        /**< take everything that is waiting, then let the protocol send */
+        for (BaseType_t got = xQueueReceive(s_trans.event_q, &ev, wait); got == pdTRUE;
+                got = xQueueReceive(s_trans.event_q, &ev, 0)) {
+            int64_t now = esp_timer_get_time();
+            if (ev.type == ESPNOW_TRANS_STOP) {
+                goto EXIT;
+            } else if (ev.type == ESPNOW_TRANS_FRAME) {
+                espnow_trans_proto_input(s_trans.proto, ev.addr, ev.data, ev.len, now);
+            } else {
+                espnow_trans_req_t *req = ev.req;
+                bool bcast = !memcmp(req->addr, s_bcast_addr, ESP_NOW_ETH_ALEN);
+                esp_err_t ret = espnow_trans_proto_send(s_trans.proto, req->addr, bcast, req->data, req->len, req, now);
+                if (ret != ESP_OK) {
+                    espnow_trans_done(NULL, req, ret);
+                }
+            }
+        }
+        next = espnow_trans_proto_poll(s_trans.proto, esp_timer_get_time());
+
+        xSemaphoreTake(s_trans.stat_mutex, portMAX_DELAY);
+        espnow_trans_proto_get_stat(s_trans.proto, &s_trans.stat);
+        xSemaphoreGive(s_trans.stat_mutex);
+    }
+
+EXIT:
+    /**< messages still being sent are completed with ESP_ERR_INVALID_STATE */
+    espnow_trans_proto_delete(s_trans.proto);
+    s_trans.proto = NULL;
+    xSemaphoreGive(s_trans.exit_sem);
+    vTaskDelete(NULL);
+}
+
+static void espnow_trans_cleanup(void)
+{
+    espnow_trans_event_t ev;
+    espnow_trans_msg_t msg;
+
+    if (s_trans.event_q) {
+        while (xQueueReceive(s_trans.event_q, &ev, 0) == pdTRUE) {
+            if (ev.type == ESPNOW_TRANS_SEND) {
+                espnow_trans_done(NULL, ev.req, ESP_ERR_INVALID_STATE);
+            }
+        }
+        vQueueDelete(s_trans.event_q);
+    }
+    if (s_trans.msg_q) {
+        while (xQueueReceive(s_trans.msg_q, &msg, 0) == pdTRUE) {
+            free(msg.data);
+        }
+        vQueueDelete(s_trans.msg_q);
+    }
+    if (s_trans.slot_sem) {
+        vSemaphoreDelete(s_trans.slot_sem);
+    }
+    if (s_trans.exit_sem) {
+        vSemaphoreDelete(s_trans.exit_sem);
+    }
+    if (s_trans.stat_mutex) {
+        vSemaphoreDelete(s_trans.stat_mutex);
+    }
+    espnow_trans_proto_delete(s_trans.proto);
+    memset(&s_trans, 0, sizeof(s_trans));
+}
+
+esp_err_t iot_espnow_trans_init(const espnow_trans_proto_config_t *config)
+{
+    espnow_trans_proto_config_t proto_config = ESPNOW_TRANS_PROTO_CONFIG_DEFAULT();
+    const espnow_trans_proto_cb_t cb = {
+        .send = espnow_trans_output,
+        .recv = espnow_trans_deliver,
+        .sent = espnow_trans_done,
+    };
+
+    if (s_trans.event_q) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (config) {
+        proto_config = *config;
+    }
+    proto_config.seed = esp_random();
+
+    s_trans.proto = espnow_trans_proto_create(&proto_config, &cb);
+    if (!s_trans.proto) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_trans.event_q = xQueueCreate(ESPNOW_TRANS_EVENT_NUM, sizeof(espnow_trans_event_t));
+    s_trans.msg_q = xQueueCreate(ESPNOW_TRANS_RECV_NUM, sizeof(espnow_trans_msg_t));
+    s_trans.slot_sem = xSemaphoreCreateCounting(proto_config.tx_msg_num, proto_config.tx_msg_num);
+    s_trans.exit_sem = xSemaphoreCreateBinary();
+    s_trans.stat_mutex = xSemaphoreCreateMutex();
+    if (!s_trans.event_q || !s_trans.msg_q || !s_trans.slot_sem || !s_trans.exit_sem || !s_trans.stat_mutex) {
+        ESP_LOGE(TAG, "espnow transport no memory");
+        espnow_trans_cleanup();
+        return ESP_ERR_NO_MEM;
+    }
+    if (iot_espnow_set_rx_hook(espnow_trans_rx_hook, NULL) != ESP_OK) {
+        espnow_trans_cleanup();
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xTaskCreate(espnow_trans_task, "espnow_trans", ESPNOW_TRANS_TASK_STACK, NULL,
+                    ESPNOW_TRANS_TASK_PRIO, NULL) != pdPASS) {
+        iot_espnow_set_rx_hook(NULL, NULL);
+        espnow_trans_cleanup();
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t iot_espnow_trans_deinit(void)
+{
+    if (!s_trans.event_q) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    iot_espnow_set_rx_hook(NULL, NULL);
+    espnow_trans_event_t ev = { .type = ESPNOW_TRANS_STOP };
+    xQueueSend(s_trans.event_q, &ev, portMAX_DELAY);
+    xSemaphoreTake(s_trans.exit_sem, portMAX_DELAY);
+    espnow_trans_cleanup();
+    return ESP_OK;
+}
+
+esp_err_t iot_espnow_trans_send(const uint8_t dest_addr[ESP_NOW_ETH_ALEN], const void *data, size_t data_len,
+                                TickType_t block_ticks)
+{
+    if (!s_trans.event_q) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!dest_addr || !data) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (xSemaphoreTake(s_trans.slot_sem, block_ticks) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    espnow_trans_req_t req = {
+        .data = data,
+        .len = data_len,
+        .task = xTaskGetCurrentTaskHandle(),
+        .done = false,
+    };
+    memcpy(req.addr, dest_addr, ESP_NOW_ETH_ALEN);
+    espnow_trans_event_t ev = { .type = ESPNOW_TRANS_SEND, .req = &req };
+    xQueueSend(s_trans.event_q, &ev, portMAX_DELAY);
+
+    /**< the protocol always completes a message, at the latest after its retries */
+    while (!__atomic_load_n(&req.done, __ATOMIC_ACQUIRE)) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    if (req.result != ESP_OK) {
+        ESP_LOGW(TAG, "message to "MACSTR" fail: %d", MAC2STR(dest_addr), req.result);
+    }
+    return req.result;
+}
+
+esp_err_t iot_espnow_trans_recv(uint8_t src_addr[ESP_NOW_ETH_ALEN], uint8_t **data, size_t *data_len,
+                                TickType_t block_ticks)
+{
+    espnow_trans_msg_t msg;
+    if (!s_trans.msg_q) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!data || !data_len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (xQueueReceive(s_trans.msg_q, &msg, block_ticks) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    if (src_addr) {
+        memcpy(src_addr, msg.addr, ESP_NOW_ETH_ALEN);
+    }
+    *data = msg.data;
+    *data_len = msg.len;
+    return ESP_OK;
+}
+
+esp_err_t iot_espnow_trans_get_stat(espnow_trans_stat_t *stat)
+{
+    if (!s_trans.stat_mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!stat) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s_trans.stat_mutex, portMAX_DELAY);
+    *stat = s_trans.stat;
+    stat->rx_drop += s_trans.recv_overflow;
+    xSemaphoreGive(s_trans.stat_mutex);
+    return ESP_OK;
+}
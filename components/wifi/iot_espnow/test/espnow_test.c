@@ -22,6 +22,7 @@
 #include "esp_event_loop.h"
 #include "iot_espnow.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "unity.h"
 
 static const char* TAG_TX = "espnow_sender";
@@ -175,6 +176,28 @@ static void espnow_recv_handle_task(void *arg)
     vTaskDelete(NULL);
 }
 
+/**< zero copy receive: frames of the sender wait in their own queue until released */
+static void espnow_recv_pool_task(void *arg)
+{
+    uint8_t mac_addr[ESP_NOW_ETH_ALEN] = { 0 };
+    iot_espnow_pkt_t *pkt = NULL;
+    iot_espnow_rx_stat_t stat;
+    str2mac(mac_addr, PEER_ADDR_TX);
+    ESP_ERROR_CHECK(iot_espnow_add_rx_queue(mac_addr, 8));
+
+    for (;;) {
+        if (iot_espnow_recv_pkt_from(mac_addr, &pkt, portMAX_DELAY) != ESP_OK) {
+            continue;
+        }
+        ESP_LOGI(TAG_RX, "Recv %d bytes from: %02X:%02X:%02X:%02X:%02X:%02X", pkt->len, MAC2STR(pkt->src_addr));
+        iot_espnow_release_pkt(pkt);
+        iot_espnow_get_rx_stat(mac_addr, &stat);
+        ESP_LOGI(TAG_RX, "rx %d, dropped %d, no buffer %d, free slots %d",
+                 stat.rx_packets, stat.rx_dropped, stat.rx_no_buf, stat.pool_free);
+    }
+    vTaskDelete(NULL);
+}
+
 static esp_err_t espnow_recv_task_init(void)
 {
     iot_espnow_init();
@@ -234,6 +257,98 @@ TEST_CASE("ESPNOW recv test", "[espnow][iot]")
     espnow_recv_test();
 }
 
+TEST_CASE("ESPNOW send pipeline test", "[espnow][iot]")
+{
+    uint8_t dest_addr[ESP_NOW_ETH_ALEN];
+    uint8_t data[200] = { 0 };
+    iot_espnow_tx_stat_t stat;
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(espnow_send_wifi_init());
+    iot_espnow_init();
+    str2mac(dest_addr, PEER_ADDR_RX);
+    iot_espnow_add_peer(dest_addr, (const uint8_t*)CONFIG_ESPNOW_LMK, ESP_IF_WIFI_STA, ESPNOW_CHANNEL);
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < 1000; i++) {
+        data[1] = i;
+        TEST_ASSERT_EQUAL(ESP_OK, iot_espnow_send_async(dest_addr, data, sizeof(data), NULL, NULL, portMAX_DELAY));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, iot_espnow_send_flush(portMAX_DELAY));
+    int64_t elapsed_us = esp_timer_get_time() - start;
+    TEST_ASSERT_EQUAL(ESP_OK, iot_espnow_get_tx_stat(dest_addr, &stat));
+    ESP_LOGI(TAG_TX, "1000 frames in %d ms: ok %d, lost %d, retries %d, latency avg %d us max %d us",
+             (int) (elapsed_us / 1000), stat.tx_ok, stat.tx_lost, stat.retries, stat.latency_avg_us, stat.latency_max_us);
+    iot_espnow_deinit();
+}
+
+TEST_CASE("ESPNOW recv pool test", "[espnow][iot]")
+{
+    uint8_t mac_addr[ESP_NOW_ETH_ALEN] = { 0 };
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(espnow_recv_wifi_init());
+    iot_espnow_init();
+    str2mac(mac_addr, PEER_ADDR_TX);
+    iot_espnow_add_peer(mac_addr, (const uint8_t*)CONFIG_ESPNOW_LMK, ESP_IF_WIFI_AP, ESPNOW_CHANNEL);
+    xTaskCreate(espnow_recv_pool_task, "espnow_recv_pool_task", 1024 * 3, NULL, 6, NULL);
+}
+
+TEST_CASE("ESPNOW peer table test", "[espnow][iot]")
+{
+    uint8_t addr[ESP_NOW_ETH_ALEN] = {0x24, 0x0a, 0xc4, 0x00, 0x00, 0x00};
+    uint8_t data[10] = { 0 };
+    iot_espnow_peer_info_t info;
+    int total, active;
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(espnow_send_wifi_init());
+    iot_espnow_init();
+
+    /**< more peers than driver slots, nobody needs to answer */
+    for (int i = 0; i < 60; i++) {
+        addr[5] = i;
+        TEST_ASSERT_EQUAL(ESP_OK, iot_espnow_add_peer_no_encrypt(addr, ESP_IF_WIFI_STA, -1));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, iot_espnow_get_peer_num(&total, &active));
+    TEST_ASSERT_EQUAL(60, total);
+    TEST_ASSERT_EQUAL(CONFIG_IOT_ESPNOW_PEER_HW_MAX, active);
+    addr[5] = 59;
+    TEST_ASSERT_EQUAL(ESP_OK, iot_espnow_get_peer(addr, &info));
+    TEST_ASSERT_FALSE(info.active);
+
+    for (int i = 0; i < 60; i++) {
+        addr[5] = i;
+        TEST_ASSERT_EQUAL(ESP_OK, iot_espnow_send_async(addr, data, sizeof(data), NULL, NULL, portMAX_DELAY));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, iot_espnow_send_flush(portMAX_DELAY));
+    addr[5] = 59;
+    TEST_ASSERT_EQUAL(ESP_OK, iot_espnow_get_peer(addr, &info));
+    TEST_ASSERT_TRUE(info.active);
+    addr[5] = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, iot_espnow_get_peer(addr, &info));
+    TEST_ASSERT_FALSE(info.active);
+
+    for (int i = 0; i < 60; i++) {
+        addr[5] = i;
+        TEST_ASSERT_EQUAL(ESP_OK, iot_espnow_del_peer(addr));
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, iot_espnow_get_peer(addr, NULL));
+    TEST_ASSERT_EQUAL(ESP_OK, iot_espnow_get_peer_num(&total, &active));
+    TEST_ASSERT_EQUAL(0, total);
+    TEST_ASSERT_EQUAL(0, active);
+    iot_espnow_deinit();
+}
+
 TEST_CASE("ESPNOW send test", "[espnow][iot]")
 {
     espnow_send_test();
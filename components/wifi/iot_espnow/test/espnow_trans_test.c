@@ -0,0 +1,437 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "espnow_trans_proto.h"
+#include "unity.h"
+
+/*
+ * The transport runs against a simulated radio in virtual time, no Wi-Fi is needed:
+ * one shared channel at 1 Mbps, a queue of 8 frames per sender like the driver,
+ * independent loss per receiver, optional duplicated and corrupted frames.
+ */
+static const char *TAG = "espnow_trans_test";
+
+#define SIM_NODE_MAX        6
+#define SIM_EVENT_MAX       128
+#define SIM_TX_DEPTH        8
+#define SIM_AIR_US(len)     (300 + (len) * 8)
+
+typedef struct {
+    int64_t time;
+    int src;
+    int dst;
+    int len;
+    uint8_t frame[ESPNOW_TRANS_FRAME_MAX];
+} sim_event_t;
+
+typedef struct sim sim_t;
+
+typedef struct {
+    sim_t *sim;
+    int idx;
+    uint8_t addr[ESPNOW_TRANS_ADDR_LEN];
+    espnow_trans_proto_t *proto;
+    int64_t next;
+    int64_t air_free;       /**< this sender's queue is on the air until */
+    int recv_num;
+    uint8_t *recv_data;
+    size_t recv_len;
+    int recv_src;
+} sim_node_t;
+
+struct sim {
+    int64_t now;
+    int node_num;
+    sim_node_t node[SIM_NODE_MAX];
+    sim_event_t *event;
+    int event_num;
+    int64_t air_free;
+    uint32_t rand;
+    int loss_pct;
+    int dup_pct;
+    int corrupt_num;
+    int pending;            /**< sends without sent callback */
+};
+
+typedef struct {
+    sim_t *sim;
+    esp_err_t result;
+    bool done;
+} sim_send_t;
+
+static const uint8_t s_bcast[ESPNOW_TRANS_ADDR_LEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+static uint32_t sim_rand(sim_t *s)
+{
+    s->rand = s->rand * 1103515245 + 12345;
+    return s->rand >> 8;
+}
+
+static void sim_deliver(sim_t *s, int src, int dst, const uint8_t *frame, int len, int64_t time)
+{
+    int copies = 1 + (sim_rand(s) % 100 < s->dup_pct);
+    for (int i = 0; i < copies && s->event_num < SIM_EVENT_MAX; i++) {
+        if (sim_rand(s) % 100 < s->loss_pct) {
+            continue;
+        }
+        sim_event_t *ev = &s->event[s->event_num++];
+        ev->time = time + i;
+        ev->src = src;
+        ev->dst = dst;
+        ev->len = len;
+        memcpy(ev->frame, frame, len);
+        if (s->corrupt_num > 0 && frame[1] == 0x01) {
+            s->corrupt_num--;
+            ev->frame[len - 1] ^= 0x5a;
+        }
+    }
+}
+
+static esp_err_t sim_send(void *arg, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN], const uint8_t *frame, int len)
+{
+    sim_node_t *node = arg;
+    sim_t *s = node->sim;
+    if (node->air_free - s->now > SIM_TX_DEPTH * SIM_AIR_US(ESPNOW_TRANS_FRAME_MAX)) {
+        return ESP_ERR_TIMEOUT;
+    }
+    int64_t start = s->air_free > s->now ? s->air_free : s->now;
+    s->air_free = node->air_free = start + SIM_AIR_US(len);
+    for (int i = 0; i < s->node_num; i++) {
+        if (i != node->idx && (!memcmp(addr, s_bcast, ESPNOW_TRANS_ADDR_LEN)
+                               || !memcmp(addr, s->node[i].addr, ESPNOW_TRANS_ADDR_LEN))) {
+            sim_deliver(s, node->idx, i, frame, len, s->air_free);
+        }
+    }
+    return ESP_OK;
+}
+
+static void sim_recv(void *arg, const uint8_t addr[ESPNOW_TRANS_ADDR_LEN], uint8_t *data, size_t len)
+{
+    sim_node_t *node = arg;
+    free(node->recv_data);
+    node->recv_data = data;
+    node->recv_len = len;
+    node->recv_src = addr[5];
+    node->recv_num++;
+}
+
+static void sim_sent(void *arg, void *ctx, esp_err_t result)
+{
+    sim_send_t *send = ctx;
+    send->result = result;
+    send->done = true;
+    send->sim->pending--;
+}
+
+static sim_t *sim_create_window(int node_num, uint32_t seed, int window)
+{
+    sim_t *s = calloc(1, sizeof(sim_t));
+    s->event = calloc(SIM_EVENT_MAX, sizeof(sim_event_t));
+    TEST_ASSERT_NOT_NULL(s);
+    TEST_ASSERT_NOT_NULL(s->event);
+    s->node_num = node_num;
+    s->rand = seed;
+    for (int i = 0; i < node_num; i++) {
+        sim_node_t *node = &s->node[i];
+        node->sim = s;
+        node->idx = i;
+        node->addr[0] = 0x02;
+        node->addr[5] = i;
+        node->next = INT64_MAX;
+        espnow_trans_proto_config_t config = ESPNOW_TRANS_PROTO_CONFIG_DEFAULT();
+        config.seed = seed + i;
+        config.window = window;
+        espnow_trans_proto_cb_t cb = {
+            .send = sim_send,
+            .recv = sim_recv,
+            .sent = sim_sent,
+            .arg = node,
+        };
+        node->proto = espnow_trans_proto_create(&config, &cb);
+        TEST_ASSERT_NOT_NULL(node->proto);
+    }
+    return s;
+}
+
+static sim_t *sim_create(int node_num, uint32_t seed)
+{
+    espnow_trans_proto_config_t config = ESPNOW_TRANS_PROTO_CONFIG_DEFAULT();
+    return sim_create_window(node_num, seed, config.window);
+}
+
+static void sim_delete(sim_t *s)
+{
+    for (int i = 0; i < s->node_num; i++) {
+        espnow_trans_proto_delete(s->node[i].proto);
+        free(s->node[i].recv_data);
+    }
+    free(s->event);
+    free(s);
+}
+
+static void sim_send_msg(sim_t *s, int src, int dst, const void *data, size_t len, sim_send_t *send)
+{
+    send->sim = s;
+    send->done = false;
+    const uint8_t *addr = dst < 0 ? s_bcast : s->node[dst].addr;
+    TEST_ASSERT_EQUAL(ESP_OK, espnow_trans_proto_send(s->node[src].proto, addr, dst < 0, data, len, send, s->now));
+    s->node[src].next = s->now;
+    s->pending++;
+}
+
+/**
+ * Run until every send has completed and the air is quiet, return the virtual time it took.
+ */
+static int64_t sim_run(sim_t *s, int64_t limit_us)
+{
+    int64_t start = s->now;
+    while (s->now - start < limit_us) {
+        for (int i = 0; i < s->event_num; i++) {
+            sim_event_t *ev = &s->event[i];
+            if (ev->time <= s->now) {
+                sim_node_t *node = &s->node[ev->dst];
+                espnow_trans_proto_input(node->proto, s->node[ev->src].addr, ev->frame, ev->len, s->now);
+                node->next = s->now;
+                *ev = s->event[--s->event_num];
+                i = -1;
+            }
+        }
+        int64_t next = INT64_MAX;
+        for (int i = 0; i < s->node_num; i++) {
+            sim_node_t *node = &s->node[i];
+            if (node->next <= s->now) {
+                node->next = espnow_trans_proto_poll(node->proto, s->now);
+            }
+            next = node->next < next ? node->next : next;
+        }
+        if (s->pending == 0 && s->event_num == 0) {
+            break;
+        }
+        for (int i = 0; i < s->event_num; i++) {
+            next = s->event[i].time < next ? s->event[i].time : next;
+        }
+        s->now = next > s->now ? next : s->now + 1;
+    }
+    return s->now - start;
+}
+
+static uint8_t *test_msg(size_t len, uint32_t seed)
+{
+    uint8_t *data = malloc(len);
+    TEST_ASSERT_NOT_NULL(data);
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+    }
+    return data;
+}
+
+TEST_CASE("ESPNOW trans unicast test", "[espnow][trans]")
+{
+    const size_t len = 16 * 1024;
+    const int loss[] = {0, 10, 30};
+    uint8_t *data = test_msg(len, 1);
+
+    for (int n = 0; n < sizeof(loss) / sizeof(loss[0]); n++) {
+        sim_t *s = sim_create(2, 100 + n);
+        s->loss_pct = loss[n];
+        sim_send_t send;
+        sim_send_msg(s, 0, 1, data, len, &send);
+        int64_t us = sim_run(s, 60 * 1000 * 1000);
+
+        TEST_ASSERT_TRUE(send.done);
+        TEST_ASSERT_EQUAL(ESP_OK, send.result);
+        TEST_ASSERT_EQUAL(1, s->node[1].recv_num);
+        TEST_ASSERT_EQUAL(len, s->node[1].recv_len);
+        TEST_ASSERT_EQUAL_MEMORY(data, s->node[1].recv_data, len);
+        espnow_trans_stat_t stat;
+        espnow_trans_proto_get_stat(s->node[0].proto, &stat);
+        ESP_LOGI(TAG, "loss %d%%: %u bytes in %u ms, %u KB/s, frames %u, retransmitted %u",
+                 loss[n], len, (uint32_t) (us / 1000), (uint32_t) (len * 1000 / us),
+                 stat.tx_frames, stat.tx_retrans);
+        sim_delete(s);
+    }
+    free(data);
+}
+
+TEST_CASE("ESPNOW trans concurrent test", "[espnow][trans]")
+{
+    sim_t *s = sim_create(3, 7);
+    s->loss_pct = 15;
+    uint8_t *data[3];
+    sim_send_t send[3];
+    const size_t len[3] = {5000, 1, ESPNOW_TRANS_FRAG_SIZE * 3};
+    for (int i = 0; i < 3; i++) {
+        data[i] = test_msg(len[i], i + 10);
+    }
+    /* two messages from node 0 to node 1, one from node 2 to node 1 */
+    sim_send_msg(s, 0, 1, data[0], len[0], &send[0]);
+    sim_send_msg(s, 2, 1, data[2], len[2], &send[2]);
+    sim_run(s, 60 * 1000 * 1000);
+    TEST_ASSERT_EQUAL(ESP_OK, send[0].result);
+    TEST_ASSERT_EQUAL(ESP_OK, send[2].result);
+    TEST_ASSERT_EQUAL(2, s->node[1].recv_num);
+    sim_send_msg(s, 0, 1, data[1], len[1], &send[1]);
+    sim_run(s, 60 * 1000 * 1000);
+    TEST_ASSERT_EQUAL(ESP_OK, send[1].result);
+    TEST_ASSERT_EQUAL(3, s->node[1].recv_num);
+    TEST_ASSERT_EQUAL(1, s->node[1].recv_len);
+    TEST_ASSERT_EQUAL(data[1][0], s->node[1].recv_data[0]);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, espnow_trans_proto_send(s->node[0].proto, s->node[1].addr, false,
+                      data[0], 0, NULL, s->now));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, espnow_trans_proto_send(s->node[0].proto, s->node[1].addr, false,
+                      data[0], 16 * 1024 + 1, NULL, s->now));
+    for (int i = 0; i < 3; i++) {
+        free(data[i]);
+    }
+    sim_delete(s);
+}
+
+TEST_CASE("ESPNOW trans duplicate and crc test", "[espnow][trans]")
+{
+    const size_t len = 3000;
+    uint8_t *data = test_msg(len, 3);
+    sim_t *s = sim_create(2, 11);
+    sim_send_t send;
+    espnow_trans_stat_t stat;
+
+    /* duplicated frames, and a final ACK that gets lost, deliver once */
+    s->dup_pct = 40;
+    s->loss_pct = 20;
+    for (int i = 0; i < 4; i++) {
+        sim_send_msg(s, 0, 1, data, len, &send);
+        sim_run(s, 60 * 1000 * 1000);
+        TEST_ASSERT_EQUAL(ESP_OK, send.result);
+        TEST_ASSERT_EQUAL(i + 1, s->node[1].recv_num);
+    }
+    espnow_trans_proto_get_stat(s->node[1].proto, &stat);
+    TEST_ASSERT_TRUE(stat.rx_dup > 0);
+    TEST_ASSERT_EQUAL(4, stat.rx_msgs);
+
+    /* a corrupted fragment fails the crc, the message is sent again */
+    s->dup_pct = 0;
+    s->loss_pct = 0;
+    s->corrupt_num = 1;
+    sim_send_msg(s, 0, 1, data, len, &send);
+    sim_run(s, 60 * 1000 * 1000);
+    TEST_ASSERT_EQUAL(ESP_OK, send.result);
+    espnow_trans_proto_get_stat(s->node[1].proto, &stat);
+    TEST_ASSERT_EQUAL(1, stat.rx_crc_err);
+    TEST_ASSERT_EQUAL(5, s->node[1].recv_num);
+    TEST_ASSERT_EQUAL_MEMORY(data, s->node[1].recv_data, len);
+
+    /* nobody answers */
+    s->loss_pct = 100;
+    sim_send_msg(s, 0, 1, data, len, &send);
+    sim_run(s, 60 * 1000 * 1000);
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, send.result);
+    espnow_trans_proto_get_stat(s->node[0].proto, &stat);
+    TEST_ASSERT_EQUAL(1, stat.tx_fail);
+    free(data);
+    sim_delete(s);
+}
+
+TEST_CASE("ESPNOW trans broadcast test", "[espnow][trans]")
+{
+    const size_t len = 8 * 1024;
+    const int loss[] = {0, 10};
+    uint8_t *data = test_msg(len, 5);
+
+    for (int n = 0; n < sizeof(loss) / sizeof(loss[0]); n++) {
+        sim_t *s = sim_create(SIM_NODE_MAX, 200 + n);
+        s->loss_pct = loss[n];
+        sim_send_t send;
+        sim_send_msg(s, 0, -1, data, len, &send);
+        int64_t us = sim_run(s, 60 * 1000 * 1000);
+
+        TEST_ASSERT_EQUAL(ESP_OK, send.result);
+        for (int i = 1; i < SIM_NODE_MAX; i++) {
+            TEST_ASSERT_EQUAL(1, s->node[i].recv_num);
+            TEST_ASSERT_EQUAL(0, s->node[i].recv_src);
+            TEST_ASSERT_EQUAL_MEMORY(data, s->node[i].recv_data, len);
+        }
+        espnow_trans_stat_t stat;
+        espnow_trans_proto_get_stat(s->node[0].proto, &stat);
+        ESP_LOGI(TAG, "broadcast to %d, loss %d%%: %u bytes in %u ms, frames %u, repaired %u",
+                 SIM_NODE_MAX - 1, loss[n], len, (uint32_t) (us / 1000), stat.tx_frames, stat.tx_retrans);
+        sim_delete(s);
+    }
+    free(data);
+}
+
+#define SIM_SWEEP_SEEDS     300
+
+/*
+ * Throughput and completion over many seeds, takes long so it only runs when asked for,
+ * e.g. "build/espnow_trans_host sweep" on the host.
+ */
+TEST_CASE("ESPNOW trans loss sweep", "[espnow][trans][ignore]")
+{
+    const struct {
+        int window;
+        int loss;
+    } rows[] = {
+        {16, 5}, {16, 10}, {16, 30}, {16, 50},
+        {1, 5}, {1, 10}, {1, 30},
+    };
+    const int bcast_loss[] = {10, 20};
+    const size_t len = 16 * 1024;
+    const size_t bcast_len = 8 * 1024;
+    uint8_t *data = test_msg(len, 1);
+
+    for (int r = 0; r < sizeof(rows) / sizeof(rows[0]); r++) {
+        int done = 0;
+        uint64_t bytes = 0, us = 0;
+        for (int seed = 0; seed < SIM_SWEEP_SEEDS; seed++) {
+            sim_t *s = sim_create_window(2, 1000 + seed * 2, rows[r].window);
+            s->loss_pct = rows[r].loss;
+            sim_send_t send;
+            sim_send_msg(s, 0, 1, data, len, &send);
+            int64_t run_us = sim_run(s, 60 * 1000 * 1000);
+            if (send.done && send.result == ESP_OK && s->node[1].recv_num == 1
+                    && !memcmp(data, s->node[1].recv_data, len)) {
+                done++;
+                bytes += len;
+                us += run_us;
+            }
+            sim_delete(s);
+        }
+        ESP_LOGI(TAG, "window %d, loss %d%%: %u KB/s, %d/%d complete", rows[r].window, rows[r].loss,
+                 us ? (uint32_t) (bytes * 1000 / us) : 0, done, SIM_SWEEP_SEEDS);
+        if (rows[r].loss <= 10) {
+            TEST_ASSERT_EQUAL(SIM_SWEEP_SEEDS, done);
+        }
+    }
+
+    for (int r = 0; r < sizeof(bcast_loss) / sizeof(bcast_loss[0]); r++) {
+        int done = 0;
+        for (int seed = 0; seed < SIM_SWEEP_SEEDS; seed++) {
+            sim_t *s = sim_create(SIM_NODE_MAX, 5000 + seed * SIM_NODE_MAX);
+            s->loss_pct = bcast_loss[r];
+            sim_send_t send;
+            sim_send_msg(s, 0, -1, data, bcast_len, &send);
+            sim_run(s, 60 * 1000 * 1000);
+            for (int i = 1; i < SIM_NODE_MAX; i++) {
+                done += s->node[i].recv_num == 1 && !memcmp(data, s->node[i].recv_data, bcast_len);
+            }
+            sim_delete(s);
+        }
+        ESP_LOGI(TAG, "broadcast to %d, loss %d%%: %d/%d receivers complete", SIM_NODE_MAX - 1, bcast_loss[r],
+                 done, SIM_SWEEP_SEEDS * (SIM_NODE_MAX - 1));
+    }
+    free(data);
+}
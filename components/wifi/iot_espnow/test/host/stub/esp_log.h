@@ -0,0 +1,9 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+
+/* the info logs are the test results, LOG=1 in the environment also prints the error logs */
+#define ESP_LOGE(tag, fmt, ...) do { if (getenv("LOG")) printf("E %s: " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGW(tag, fmt, ...) ESP_LOGE(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) printf("I %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) do { } while (0)
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <setjmp.h>
+
+/* the unity macros the tests use, a failed check ends the test case and host_unity.c goes on with the next one */
+
+typedef struct {
+    const char* name;
+    bool ignore;        /* tagged [ignore], only runs when asked for by name */
+    void (*fn)(void);
+} host_test_t;
+
+void host_test_register(const char* name, const char* tag, void (*fn)(void));
+void host_test_fail(const char* file, int line, const char* msg, long expected, long actual);
+
+#define HOST_CAT2(a, b) a##b
+#define HOST_CAT(a, b) HOST_CAT2(a, b)
+#define TEST_CASE(name, tag) \
+    static void HOST_CAT(host_test_, __LINE__)(void); \
+    __attribute__((constructor)) static void HOST_CAT(host_reg_, __LINE__)(void) \
+    { host_test_register(name, tag, HOST_CAT(host_test_, __LINE__)); } \
+    static void HOST_CAT(host_test_, __LINE__)(void)
+
+#define HOST_CHECK(cond, msg, e, a) do { if (!(cond)) host_test_fail(__FILE__, __LINE__, msg, (long) (e), (long) (a)); } while (0)
+
+#define TEST_ASSERT_EQUAL_INT(e, a)     do { long _e = (long) (e), _a = (long) (a); HOST_CHECK(_e == _a, "not equal", _e, _a); } while (0)
+#define TEST_ASSERT_EQUAL_UINT32(e, a)  TEST_ASSERT_EQUAL_INT((uint32_t) (e), (uint32_t) (a))
+#define TEST_ASSERT_EQUAL_UINT16(e, a)  TEST_ASSERT_EQUAL_INT((uint16_t) (e), (uint16_t) (a))
+#define TEST_ASSERT_EQUAL_UINT8(e, a)   TEST_ASSERT_EQUAL_INT((uint8_t) (e), (uint8_t) (a))
+#define TEST_ASSERT_EQUAL_HEX32(e, a)   TEST_ASSERT_EQUAL_UINT32(e, a)
+#define TEST_ASSERT_EQUAL(e, a)         TEST_ASSERT_EQUAL_INT(e, a)
+#define TEST_ASSERT_TRUE(c)             HOST_CHECK(c, #c " is false", 1, 0)
+#define TEST_ASSERT_FALSE(c)            HOST_CHECK(!(c), #c " is true", 0, 1)
+#define TEST_ASSERT(c)                  TEST_ASSERT_TRUE(c)
+#define TEST_ASSERT_NULL(p)             HOST_CHECK((p) == NULL, #p " is not NULL", 0, 0)
+#define TEST_ASSERT_NOT_NULL(p)         HOST_CHECK((p) != NULL, #p " is NULL", 0, 0)
+#define TEST_ASSERT_EQUAL_STRING(e, a)  HOST_CHECK(strcmp(e, a) == 0, "strings differ", 0, 0)
+#define TEST_ASSERT_EQUAL_MEMORY(e, a, n) HOST_CHECK(memcmp(e, a, n) == 0, "memory differs", 0, 0)
+#define TEST_ASSERT_INT_WITHIN(d, e, a) do { long _e = (long) (e), _a = (long) (a); \
+        HOST_CHECK(_a - _e <= (long) (d) && _e - _a <= (long) (d), "not within " #d, _e, _a); } while (0)
+#define TEST_ASSERT_UINT32_WITHIN(d, e, a) TEST_ASSERT_INT_WITHIN(d, e, a)
+#define TEST_ASSERT_FLOAT_WITHIN(d, e, a) do { double _e = (e), _a = (a); \
+        HOST_CHECK(_a - _e <= (d) && _e - _a <= (d), "not within " #d, _e * 1000, _a * 1000); } while (0)
+#define TEST_FAIL_MESSAGE(msg)          host_test_fail(__FILE__, __LINE__, msg, 0, 0)
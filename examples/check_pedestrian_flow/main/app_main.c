@@ -24,6 +24,7 @@
 #include "freertos/event_groups.h"
 
 #include "mqtt_client.h"
+#include "iot_mqtt_pub.h"
 #include "os.h"
 #include "onenet.h"
 #include "sniffer.h"
@@ -43,16 +44,17 @@ int s_device_info_num           = 0;
 station_info_t *station_info    = NULL;
 station_info_t *g_station_list  = NULL;
 /* MQTT settings about onenet */
+static iot_mqtt_pub_handle_t s_mqtt_pub = NULL;
 
 static esp_err_t mqtt_event_handler(esp_mqtt_event_handle_t event)
 {
-    esp_mqtt_client_handle_t client = event->client;
     int msg_id;
     // your_context_t *context = event->context;
+    iot_mqtt_pub_event(s_mqtt_pub, event);
     switch (event->event_id) {
     case MQTT_EVENT_CONNECTED:
         ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
-        onenet_start(client);
+        onenet_start(s_mqtt_pub);
         break;
     case MQTT_EVENT_DISCONNECTED:
         ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
@@ -200,6 +202,9 @@ static void mqtt_app_start(void)
     };
 
     esp_mqtt_client_handle_t client = esp_mqtt_client_init(&mqtt_cfg);
+    /* readings taken while oneNET can not be reached are kept and sent after the reconnect */
+    iot_mqtt_pub_config_t pub_cfg = IOT_MQTT_PUB_CONFIG_DEFAULT(client);
+    s_mqtt_pub = iot_mqtt_pub_create(&pub_cfg);
     esp_mqtt_client_start(client);
 }
 
@@ -7,7 +7,7 @@
 */
 #ifndef __ONENET_H__
 #define __ONENET_H__
-#include "mqtt_client.h"
+#include "iot_mqtt_pub.h"
 #define ONENET_HOST         "183.230.40.39"
 #define ONENET_PORT         (6002)
 
@@ -30,8 +30,8 @@ enum mqtt_save_data_type {
     data_type_float  = 0x07
 };
 
-void onenet_start(esp_mqtt_client_handle_t client);
+void onenet_start(iot_mqtt_pub_handle_t pub);
 
-void onenet_stop(esp_mqtt_client_handle_t client);
+void onenet_stop(iot_mqtt_pub_handle_t pub);
 
 #endif /* __ONENET_H__ */
\ No newline at end of file
@@ -21,6 +21,7 @@
 #include "lwip/netdb.h"
 
 #include "mqtt_client.h"
+#include "iot_mqtt_pub.h"
 #include "os.h"
 #include "onenet.h"
 #include "sniffer.h"
@@ -34,7 +35,7 @@ station_info_t *station_info_one = NULL;
 
 void onenet_task(void *param)
 {
-    esp_mqtt_client_handle_t client = *(esp_mqtt_client_handle_t *)param;
+    iot_mqtt_pub_handle_t pub = (iot_mqtt_pub_handle_t)param;
     uint32_t val;
 
     while (1) {
@@ -47,7 +48,8 @@ void onenet_task(void *param)
         buf[1] = len >> 8;
         buf[2] = len & 0xFF;
 
-        esp_mqtt_client_publish(client, "$dp", buf, len + 3, 0, 0);
+        /* a $dp packet carries one reading, it can not be joined with others */
+        iot_mqtt_pub_publish(pub, "$dp", buf, len + 3, 0, IOT_MQTT_PUB_NO_BATCH);
         s_device_info_num = 0;
 
         for (station_info_one = g_station_list->next; station_info_one; station_info_one = g_station_list->next) {
@@ -59,15 +61,15 @@ void onenet_task(void *param)
     }
 }
 
-void onenet_start(esp_mqtt_client_handle_t client)
+void onenet_start(iot_mqtt_pub_handle_t pub)
 {
     if (!onenet_initialised) {
-        xTaskCreate(&onenet_task, "onenet_task", 2048, &client, 6, &xOneNetTask);
+        xTaskCreate(&onenet_task, "onenet_task", 2048, pub, 6, &xOneNetTask);
         onenet_initialised = true;
     }
 }
 
-void onenet_stop(esp_mqtt_client_handle_t client)
+void onenet_stop(iot_mqtt_pub_handle_t pub)
 {
     if (onenet_initialised) {
         if (xOneNetTask) {